@@ -0,0 +1,2542 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Built-in benchmarks. These run inside the real executable, against the real code, with no window created,
+// so that a number from one build can be compared to a number from the next.
+
+#include <Windows.h>
+
+#include <stdio.h>
+
+#include "Main.h"
+
+#include "Log.h"
+
+#include "Export.h"
+
+#include "Search.h"
+
+#include "Pick.h"
+
+#include "Diff.h"
+
+#include "SiteGraph.h"
+
+#include "Convergence.h"
+
+#include "Kcc.h"
+
+#include "RenderList.h"
+
+#include "DistinguishedName.h"
+
+#include "TilePyramid.h"
+
+#include "TimeSeries.h"
+
+#include "Replication.h"
+
+#include "Probe.h"
+
+#include "Snapshot.h"
+
+#include "Timeline.h"
+
+#include "Labels.h"
+
+#include "Layout.h"
+
+#include "Scene.h"
+
+#include "Benchmark.h"
+
+
+
+#define LOG_BENCHMARK_THREADS				4
+
+#define LOG_BENCHMARK_MESSAGES_PER_THREAD	250000
+
+#define LOG_BENCHMARK_SYNC_MESSAGES_PER_THREAD	2500
+
+#define LOG_BENCHMARK_FILTERED_MESSAGES		10000000
+
+#define LOG_BENCHMARK_FILE_NAME				L"ADTV_benchmark.log"
+
+// 2,500 sites of 19 DCs each, plus the sites themselves, is 50,000 entities before trusts.
+#define SYNTHETIC_SITES						2500
+
+#define SYNTHETIC_DCS_PER_SITE				19
+
+#define SYNTHETIC_DOMAINS					10
+
+#define EXPORT_BENCHMARK_FILE_NAME			L"ADTV_benchmark.export"
+
+#define SEARCH_BENCHMARK_ITERATIONS			20000
+
+#define PICK_BENCHMARK_POINTS				100000
+
+// The linear scan is slow enough that it only gets a sample of the points.
+#define PICK_BENCHMARK_LINEAR_POINTS		1000
+
+#define DIFF_BENCHMARK_ITERATIONS			100
+
+#define CONVERGE_BENCHMARK_SITES			5000
+
+// Sites per region. Every region has a hub site, the hubs are joined in a ring, and every other site links to its hub.
+#define CONVERGE_BENCHMARK_REGION_SITES		100
+
+#define CONVERGE_BENCHMARK_SOURCES			200
+
+#define KCC_BENCHMARK_EDITS					500
+
+#define RENDER_BENCHMARK_WIDTH				1920
+
+#define RENDER_BENCHMARK_HEIGHT				1080
+
+// Frames panned across the forest at each altitude in RENDER_BENCHMARK_ALTITUDES.
+#define RENDER_BENCHMARK_FRAMES_PER_ALTITUDE	60
+
+#define RENDER_BENCHMARK_FILE_NAME			L"ADTV_benchmark.adtvr"
+
+#define DN_BENCHMARK_PASSES					20
+
+#define DN_BENCHMARK_MAX_DN					256
+
+// One site in this many gets a comma in its name, escaped in its DN, as a real one sometimes does.
+#define DN_BENCHMARK_ESCAPED_SITE_EVERY		8
+
+// How long the worker gets to draw the tiles for a view before the benchmark gives up on it.
+#define TILE_BENCHMARK_WARM_SECONDS			30
+
+#define HISTORY_BENCHMARK_SITES				500
+
+#define HISTORY_BENCHMARK_DCS_PER_SITE		10
+
+#define HISTORY_BENCHMARK_MB				64
+
+#define HISTORY_BENCHMARK_HOURS				6
+
+#define HISTORY_BENCHMARK_QUERIES			10000
+
+#define HISTORY_BENCHMARK_MAX_POINTS		4096
+
+#define TIMELINE_BENCHMARK_VERSIONS			64
+
+#define TIMELINE_BENCHMARK_CHANGES			40
+
+#define TIMELINE_BENCHMARK_FILE_NAME		L"ADTV_benchmark.adtvt"
+
+#define LABELS_BENCHMARK_PASSES				10
+
+#define LABELS_BENCHMARK_FRAMES_PER_ALTITUDE	30
+
+#define LAYOUT_BENCHMARK_PASSES				5
+
+BENCHMARK gBenchmarks[] = {
+	{ L"log", L"LogEventW throughput, synchronous vs. ring buffer", LogBenchmark },
+	{ L"export", L"JSON/GraphML/DOT export of a 50k entity synthetic forest", ExportBenchmark },
+	{ L"search", L"Search index build time and query latency on a 50k entity synthetic forest", SearchBenchmark },
+
+	{ L"pick", L"Hover picking index build time and lookup latency against a linear scan, 50k entities", PickBenchmark },
+
+	{ L"diff", L"Merkle tree build time and snapshot comparison time for growing numbers of changes, 50k entities", DiffBenchmark },
+
+	{ L"converge", L"Replication convergence simulation from one site and from every site, 5k sites", ConvergeBenchmark },
+
+	{ L"kcc", L"KCC what-if simulation build time and incremental recompute time after link cost and DC edits, 5k sites", KccBenchmark },
+
+	{ L"render", L"Render command recording and GDI playback over a camera sweep of a 50k entity synthetic forest", RenderBenchmark },
+
+	{ L"dn", L"DN tokenizing, name extraction and domain extraction throughput over the DNs of a 50k entity synthetic forest", DnBenchmark },
+
+	{ L"tiles", L"Frame time drawn as usual against blitted from the tile pyramid, zoomed out over a 50k entity synthetic forest", TileBenchmark },
+
+	{ L"history", L"Time-series store recording rate, compression and sparkline query time over 6 hours of a 5k DC synthetic forest", HistoryBenchmark },
+
+	{ L"timeline", L"Topology timeline size and speed over 64 versions of a 50k entity synthetic forest", TimelineBenchmark },
+
+	{ L"labels", L"Label placement time and labels kept at each altitude, and frame time with and without placement, 50k entities", LabelsBenchmark },
+
+	{ L"layout", L"Site packing time, and how big the world is packed against in a row, for 1k to 50k sites", LayoutBenchmark }
+};
+
+static BOOL gBenchmarkHaveConsole;
+
+static wchar_t gBenchmarkOutput[8192];
+
+
+
+double BenchmarkSeconds(_In_ LARGE_INTEGER Start, _In_ LARGE_INTEGER End)
+{
+	return((double)(End.QuadPart - Start.QuadPart) / (double)gGraphicsData.PerformanceFrequency.QuadPart);
+}
+
+void BenchmarkPrintW(_In_ wchar_t* Format, ...)
+{
+	va_list Args = NULL;
+
+	wchar_t Line[512] = { 0 };
+
+	DWORD Written = 0;
+
+	va_start(Args, Format);
+
+	_vsnwprintf_s(Line, _countof(Line), _TRUNCATE, Format, Args);
+
+	va_end(Args);
+
+	if (gBenchmarkHaveConsole)
+	{
+		WriteConsoleW(GetStdHandle(STD_OUTPUT_HANDLE), Line, (DWORD)wcslen(Line), &Written, NULL);
+	}
+	else
+	{
+		wcscat_s(gBenchmarkOutput, _countof(gBenchmarkOutput), Line);
+	}
+}
+
+DWORD RunBenchmarks(_In_ wchar_t* Name)
+{
+	DWORD Result = ERROR_NOT_FOUND;
+
+	gBenchmarkHaveConsole = AttachConsole(ATTACH_PARENT_PROCESS);
+
+	BenchmarkPrintW(L"\nADTV v%d.%d benchmarks\n", PRODUCT_VERSION_MAJOR, PRODUCT_VERSION_MINOR);
+
+	for (int Benchmark = 0; Benchmark < _countof(gBenchmarks); Benchmark++)
+	{
+		if (_wcsicmp(Name, L"all") != 0 && _wcsicmp(Name, gBenchmarks[Benchmark].Name) != 0)
+		{
+			continue;
+		}
+
+		BenchmarkPrintW(L"\n== %s: %s ==\n", gBenchmarks[Benchmark].Name, gBenchmarks[Benchmark].Description);
+
+		if ((Result = gBenchmarks[Benchmark].Proc()) != ERROR_SUCCESS)
+		{
+			BenchmarkPrintW(L"FAILED with 0x%08lx\n", Result);
+
+			break;
+		}
+	}
+
+	if (Result == ERROR_NOT_FOUND)
+	{
+		BenchmarkPrintW(L"\nUnknown benchmark '%s'. Available:\n", Name);
+
+		for (int Benchmark = 0; Benchmark < _countof(gBenchmarks); Benchmark++)
+		{
+			BenchmarkPrintW(L"  %s - %s\n", gBenchmarks[Benchmark].Name, gBenchmarks[Benchmark].Description);
+		}
+	}
+
+	if (gBenchmarkHaveConsole)
+	{
+		FreeConsole();
+	}
+	else
+	{
+		MessageBoxW(NULL, gBenchmarkOutput, L"ADTV Benchmarks", MB_OK | (Result == ERROR_SUCCESS ? MB_ICONINFORMATION : MB_ICONERROR));
+	}
+
+	return(Result);
+}
+
+static DWORD WINAPI LogBenchmarkThreadProc(_In_ LPVOID lpParameter)
+{
+	DWORD Messages = (DWORD)(ULONG_PTR)lpParameter;
+
+	for (DWORD Message = 0; Message < Messages; Message++)
+	{
+		LogEventW(LL_INFO, LF_FILE, L"[%s] Benchmark message %d from thread %d, padded out to look like a typical discovery message.", __FUNCTIONW__, Message, GetCurrentThreadId());
+	}
+
+	return(ERROR_SUCCESS);
+}
+
+static DWORD LogBenchmarkRun(_In_ BOOL Asynchronous, _In_ DWORD MessagesPerThread, _Out_ double* MessagesPerSecond)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	HANDLE Threads[LOG_BENCHMARK_THREADS] = { 0 };
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	ShutdownLog(LOG_SHUTDOWN_TIMEOUT_MS);
+
+	DeleteFileW(LOG_BENCHMARK_FILE_NAME);
+
+	if ((Result = InitializeLog(LOG_BENCHMARK_FILE_NAME, Asynchronous)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&Start);
+
+	for (int Thread = 0; Thread < LOG_BENCHMARK_THREADS; Thread++)
+	{
+		if ((Threads[Thread] = CreateThread(NULL, 0, LogBenchmarkThreadProc, (LPVOID)(ULONG_PTR)MessagesPerThread, 0, NULL)) == NULL)
+		{
+			Result = GetLastError();
+
+			goto Exit;
+		}
+	}
+
+	WaitForMultipleObjects(LOG_BENCHMARK_THREADS, Threads, TRUE, INFINITE);
+
+	// Shutting down flushes everything still in the ring, and that's part of the cost.
+
+	ShutdownLog(INFINITE);
+
+	QueryPerformanceCounter(&End);
+
+	*MessagesPerSecond = (LOG_BENCHMARK_THREADS * (double)MessagesPerThread) / BenchmarkSeconds(Start, End);
+
+Exit:
+
+	for (int Thread = 0; Thread < LOG_BENCHMARK_THREADS; Thread++)
+	{
+		if (Threads[Thread])
+		{
+			CloseHandle(Threads[Thread]);
+		}
+	}
+
+	DeleteFileW(LOG_BENCHMARK_FILE_NAME);
+
+	return(Result);
+}
+
+DWORD LogBenchmark(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	LOGLEVEL PreviousLevel = gRegParams.LogLevel;
+
+	DWORD PreviousPolicy = gRegParams.LogFullPolicy;
+
+	double Synchronous = 0;
+
+	double Asynchronous = 0;
+
+	double AsynchronousDropping = 0;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	gRegParams.LogLevel = LL_INFO;
+
+	gRegParams.LogFullPolicy = LFP_BLOCK;
+
+	if ((Result = LogBenchmarkRun(FALSE, LOG_BENCHMARK_SYNC_MESSAGES_PER_THREAD, &Synchronous)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	BenchmarkPrintW(L"Open-write-close, %d threads:      %12.0f messages/s\n", LOG_BENCHMARK_THREADS, Synchronous);
+
+	if ((Result = LogBenchmarkRun(TRUE, LOG_BENCHMARK_MESSAGES_PER_THREAD, &Asynchronous)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	BenchmarkPrintW(L"Ring buffer (block), %d threads:   %12.0f messages/s (%.1fx)\n", LOG_BENCHMARK_THREADS, Asynchronous, Asynchronous / Synchronous);
+
+	gRegParams.LogFullPolicy = LFP_DROP_INFO;
+
+	if ((Result = LogBenchmarkRun(TRUE, LOG_BENCHMARK_MESSAGES_PER_THREAD, &AsynchronousDropping)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	BenchmarkPrintW(L"Ring buffer (drop), %d threads:    %12.0f messages/s, %llu of %d dropped\n",
+		LOG_BENCHMARK_THREADS,
+		AsynchronousDropping,
+		GetLogDroppedCount(),
+		LOG_BENCHMARK_THREADS * LOG_BENCHMARK_MESSAGES_PER_THREAD);
+
+	// And what it costs to call LogEventW for a level that's turned off.
+
+	gRegParams.LogLevel = LL_ERROR;
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Message = 0; Message < LOG_BENCHMARK_FILTERED_MESSAGES; Message++)
+	{
+		LogEventW(LL_INFO, LF_FILE, L"[%s] Filtered message %d.", __FUNCTIONW__, Message);
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"Filtered out by level:             %12.1f ns/message\n", BenchmarkSeconds(Start, End) * 1e9 / LOG_BENCHMARK_FILTERED_MESSAGES);
+
+Exit:
+
+	gRegParams.LogLevel = PreviousLevel;
+
+	gRegParams.LogFullPolicy = PreviousPolicy;
+
+	InitializeLog(LOG_FILE_NAME, TRUE);
+
+	return(Result);
+}
+
+// Builds a made-up forest shaped like what discovery produces: domains first, then every site followed by its DCs,
+// laid out in a row the way LayoutTopology's LM_ROW does it. Some names have non-ASCII characters in them, as real
+// ones sometimes do. All of the entities come from one allocation; free them with FreeSyntheticForest.
+
+ENTITY* CreateSyntheticForest(_In_ DWORD Sites, _In_ DWORD DCsPerSite, _In_ DWORD Domains, _Out_ DWORD* EntityCount)
+{
+	static const wchar_t* Cities[] = { L"Seattle", L"Z\u00fcrich", L"S\u00e3o-Paulo", L"\u6771\u4eac", L"Reykjav\u00edk", L"Dallas", L"K\u00f8benhavn", L"Cairo" };
+
+	ENTITY* Entities = NULL;
+
+	DWORD Count = Domains + Sites + (Sites * DCsPerSite);
+
+	DWORD Index = 0;
+
+	int SiteX = 192;
+
+	*EntityCount = 0;
+
+	if ((Entities = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (SIZE_T)Count * sizeof(ENTITY))) == NULL)
+	{
+		return(NULL);
+	}
+
+	for (DWORD Domain = 0; Domain < Domains; Domain++, Index++)
+	{
+		Entities[Index].Type = ET_TRUST;
+
+		_snwprintf_s(Entities[Index].fqdn, _countof(Entities[Index].fqdn), _TRUNCATE, L"domain%lu.contoso.com", Domain);
+
+		wcscpy_s(Entities[Index].name, _countof(Entities[Index].name), Entities[Index].fqdn);
+	}
+
+	for (DWORD Site = 0; Site < Sites; Site++)
+	{
+		ENTITY* SiteEntity = &Entities[Index++];
+
+		SiteEntity->Type = ET_SITE;
+
+		_snwprintf_s(SiteEntity->name, _countof(SiteEntity->name), _TRUNCATE, L"%s-%lu", Cities[Site % _countof(Cities)], Site);
+
+		_snwprintf_s(SiteEntity->distinguishedname, _countof(SiteEntity->distinguishedname), _TRUNCATE, L"CN=%s,CN=Sites,CN=Configuration,DC=contoso,DC=com", SiteEntity->name);
+
+		SiteEntity->x = SiteX;
+
+		SiteEntity->y = 64;
+
+		SiteEntity->DCsInSite = DCsPerSite;
+
+		for (DWORD DC = 0; DC < DCsPerSite; DC++)
+		{
+			ENTITY* DCEntity = &Entities[Index++];
+
+			DCEntity->Type = ET_DC;
+
+			_snwprintf_s(DCEntity->name, _countof(DCEntity->name), _TRUNCATE, L"DC%lu-%lu", Site, DC);
+
+			_snwprintf_s(DCEntity->fqdn, _countof(DCEntity->fqdn), _TRUNCATE, L"dc%lu-%lu.domain%lu.contoso.com", Site, DC, (Site + DC) % max(Domains, 1));
+
+			_snwprintf_s(DCEntity->domain, _countof(DCEntity->domain), _TRUNCATE, L"domain%lu.contoso.com", (Site + DC) % max(Domains, 1));
+
+			_snwprintf_s(DCEntity->distinguishedname, _countof(DCEntity->distinguishedname), _TRUNCATE, L"CN=%s,CN=Servers,%s", DCEntity->name, SiteEntity->distinguishedname);
+
+			wcscpy_s(DCEntity->site, _countof(DCEntity->site), SiteEntity->distinguishedname);
+
+			DCEntity->Flags = (DC == 0 ? DCF_GC | DCF_PDCE : 0) | (DC % 7 == 3 ? DCF_RODC : 0);
+
+			DCEntity->x = SiteEntity->x + (DEF_DC_SIZE / 4);
+
+			DCEntity->y = (SiteEntity->y + (DEF_DC_SIZE / 4)) + (DC * (DEF_DC_SIZE + (DEF_DC_SIZE / 2)));
+
+			DCEntity->width = DEF_DC_SIZE;
+
+			DCEntity->height = DEF_DC_SIZE;
+		}
+
+		// No font to measure with here, so assume roughly what the huge font gives for an fqdn this long.
+
+		SiteEntity->width = (int)wcslen(Entities[Index - 1].fqdn) * 40 + DEF_DC_SIZE + (DEF_DC_SIZE / 2);
+
+		SiteEntity->height = DCsPerSite ? (DCsPerSite * DEF_DC_SIZE) + (DCsPerSite * (DEF_DC_SIZE / 2)) : DEF_DC_SIZE;
+
+		SiteX += SiteEntity->width + 256;
+	}
+
+	for (DWORD Entity = 0; Entity + 1 < Count; Entity++)
+	{
+		Entities[Entity].Next = &Entities[Entity + 1];
+	}
+
+	*EntityCount = Count;
+
+	return(Entities);
+}
+
+void FreeSyntheticForest(_In_ ENTITY* Entities)
+{
+	if (Entities)
+	{
+		HeapFree(GetProcessHeap(), 0, Entities);
+	}
+}
+
+DWORD ExportBenchmark(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	if ((Forest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	for (int Format = 0; Format < EF_COUNT; Format++)
+	{
+		LARGE_INTEGER Start = { 0 };
+
+		LARGE_INTEGER End = { 0 };
+
+		UINT64 Bytes = 0;
+
+		double Seconds = 0;
+
+		QueryPerformanceCounter(&Start);
+
+		if ((Result = ExportTopology(EXPORT_BENCHMARK_FILE_NAME, (EXPORT_FORMAT)Format, Forest, &Bytes)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		QueryPerformanceCounter(&End);
+
+		Seconds = BenchmarkSeconds(Start, End);
+
+		BenchmarkPrintW(L"%-8s %lu entities: %8.1f ms, %7.1f MB, %7.1f MB/s, %10.0f entities/s\n",
+			gExportExtensions[Format],
+			EntityCount,
+			Seconds * 1000.0,
+			Bytes / (1024.0 * 1024.0),
+			(Bytes / (1024.0 * 1024.0)) / Seconds,
+			EntityCount / Seconds);
+	}
+
+Exit:
+
+	DeleteFileW(EXPORT_BENCHMARK_FILE_NAME);
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+DWORD SearchBenchmark(void)
+{
+	// What someone might type, a character at a time, plus a few that match nearly everything or nothing at all.
+
+	static const wchar_t* Queries[] = { L"d", L"dc", L"dc1", L"dc12", L"dc123", L"dc1234-5", L"Z\u00fcr", L"SEATTLE-2", L"contoso", L"-7.domain3", L"xyzzy" };
+
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	SEARCHINDEX* Index = NULL;
+
+	ENTITY* Results[SEARCH_MAX_RESULTS] = { 0 };
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((Forest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&Start);
+
+	if ((Index = BuildSearchIndex(Forest)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"Index build, %lu entities:  %8.1f ms\n", EntityCount, BenchmarkSeconds(Start, End) * 1000.0);
+
+	for (int Query = 0; Query < _countof(Queries); Query++)
+	{
+		DWORD Matches = 0;
+
+		double Slowest = 0;
+
+		double Total = 0;
+
+		for (int Iteration = 0; Iteration < SEARCH_BENCHMARK_ITERATIONS; Iteration++)
+		{
+			double Seconds = 0;
+
+			QueryPerformanceCounter(&Start);
+
+			Matches = SearchQuery(Index, Queries[Query], Results, SEARCH_MAX_RESULTS);
+
+			QueryPerformanceCounter(&End);
+
+			Seconds = BenchmarkSeconds(Start, End);
+
+			Total += Seconds;
+
+			Slowest = max(Slowest, Seconds);
+		}
+
+		BenchmarkPrintW(L"%-12s %2lu results: %8.2f us average, %8.2f us slowest\n",
+			Queries[Query],
+			Matches,
+			(Total / SEARCH_BENCHMARK_ITERATIONS) * 1e6,
+			Slowest * 1e6);
+	}
+
+Exit:
+
+	FreeSearchIndex(Index);
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+// The smallest site or DC containing World, the slow way, to compare against PickEntity.
+
+static ENTITY* PickEntityLinear(_In_ ENTITY* Entities, _In_ POINT World)
+{
+	ENTITY* Best = NULL;
+
+	LONGLONG BestArea = MAXLONGLONG;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if ((Current->Type == ET_SITE || Current->Type == ET_DC) &&
+			World.x >= Current->x && World.x < Current->x + Current->width &&
+			World.y >= Current->y && World.y < Current->y + Current->height &&
+			(LONGLONG)Current->width * Current->height < BestArea)
+		{
+			Best = Current;
+
+			BestArea = (LONGLONG)Current->width * Current->height;
+		}
+	}
+
+	return(Best);
+}
+
+DWORD PickBenchmark(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	PICKINDEX* Index = NULL;
+
+	POINT* Points = NULL;
+
+	DWORD Hits = 0;
+
+	DWORD Mismatches = 0;
+
+	UINT32 Seed = 0x2545F491;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((Forest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL ||
+		(Points = HeapAlloc(GetProcessHeap(), 0, PICK_BENCHMARK_POINTS * sizeof(POINT))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&Start);
+
+	if ((Index = BuildPickIndex(Forest)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"Index build, %lu entities, %lu nodes: %8.1f ms\n", Index->ItemCount, Index->NodeCount, BenchmarkSeconds(Start, End) * 1000.0);
+
+	// Random points spread over the whole laid out forest, so plenty of them land in gaps between sites.
+
+	for (DWORD Point = 0; Point < PICK_BENCHMARK_POINTS; Point++)
+	{
+		Seed ^= Seed << 13;
+
+		Seed ^= Seed >> 17;
+
+		Seed ^= Seed << 5;
+
+		Points[Point].x = Index->Nodes[0].Bounds.left + (LONG)(Seed % (UINT32)(Index->Nodes[0].Bounds.right - Index->Nodes[0].Bounds.left));
+
+		Seed ^= Seed << 13;
+
+		Seed ^= Seed >> 17;
+
+		Seed ^= Seed << 5;
+
+		Points[Point].y = Index->Nodes[0].Bounds.top + (LONG)(Seed % (UINT32)(Index->Nodes[0].Bounds.bottom - Index->Nodes[0].Bounds.top));
+	}
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Point = 0; Point < PICK_BENCHMARK_POINTS; Point++)
+	{
+		Hits += (PickEntity(Index, Points[Point]) != NULL);
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"PickEntity:  %8.3f us average, %lu of %lu points hit something\n",
+		(BenchmarkSeconds(Start, End) / PICK_BENCHMARK_POINTS) * 1e6,
+		Hits,
+		PICK_BENCHMARK_POINTS);
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Point = 0; Point < PICK_BENCHMARK_LINEAR_POINTS; Point++)
+	{
+		Mismatches += (PickEntityLinear(Forest, Points[Point]) != PickEntity(Index, Points[Point]));
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"Linear scan: %8.3f us average, %lu mismatches in %lu points\n",
+		(BenchmarkSeconds(Start, End) / PICK_BENCHMARK_LINEAR_POINTS) * 1e6,
+		Mismatches,
+		PICK_BENCHMARK_LINEAR_POINTS);
+
+	if (Mismatches > 0)
+	{
+		Result = ERROR_INVALID_DATA;
+	}
+
+Exit:
+
+	if (Points != NULL)
+	{
+		HeapFree(GetProcessHeap(), 0, Points);
+	}
+
+	FreePickIndex(Index);
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+DWORD DiffBenchmark(void)
+{
+	// How many DCs get changed in the second forest for each round. The first round compares identical forests.
+
+	static const DWORD ChangedDCs[] = { 0, 1, 10, 100, 1000, 10000 };
+
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* OldForest = NULL;
+
+	ENTITY* NewForest = NULL;
+
+	TOPOLOGY_TREE* OldTree = NULL;
+
+	TOPOLOGY_TREE* NewTree = NULL;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((OldForest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL ||
+		(NewForest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&Start);
+
+	if ((OldTree = BuildTopologyTree(OldForest)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"Tree build, %lu entities: %8.2f ms\n", EntityCount, BenchmarkSeconds(Start, End) * 1000.0);
+
+	for (int Round = 0; Round < _countof(ChangedDCs); Round++)
+	{
+		TOPOLOGY_DIFF Diff = { 0 };
+
+		DWORD DCs = 0;
+
+		DWORD Changed = 0;
+
+		// Spread the changes evenly over the forest, so they land in as many different sites as possible.
+
+		for (ENTITY* Current = NewForest; Current != NULL && Changed < ChangedDCs[Round]; Current = Current->Next)
+		{
+			if (Current->Type == ET_DC && (DCs++ % ((SYNTHETIC_SITES * SYNTHETIC_DCS_PER_SITE) / max(ChangedDCs[Round], 1))) == 0)
+			{
+				Current->Flags ^= DCF_GC;
+
+				Changed++;
+			}
+		}
+
+		FreeTopologyTree(NewTree);
+
+		if ((NewTree = BuildTopologyTree(NewForest)) == NULL)
+		{
+			Result = ERROR_NOT_ENOUGH_MEMORY;
+
+			goto Exit;
+		}
+
+		QueryPerformanceCounter(&Start);
+
+		for (int Iteration = 0; Iteration < DIFF_BENCHMARK_ITERATIONS; Iteration++)
+		{
+			FreeTopologyDiff(&Diff);
+
+			if ((Result = DiffTopology(OldTree, NewTree, &Diff)) != ERROR_SUCCESS)
+			{
+				goto Exit;
+			}
+		}
+
+		QueryPerformanceCounter(&End);
+
+		BenchmarkPrintW(L"%5lu DCs changed: %10.2f us per diff, %5lu differences found, %5lu groups compared\n",
+			Changed,
+			(BenchmarkSeconds(Start, End) / DIFF_BENCHMARK_ITERATIONS) * 1e6,
+			Diff.Count,
+			Diff.GroupsCompared);
+
+		if (Diff.Count != Changed)
+		{
+			Result = ERROR_INVALID_DATA;
+		}
+
+		FreeTopologyDiff(&Diff);
+
+		// Put the forest back the way it was for the next round.
+
+		for (ENTITY* Old = OldForest, *New = NewForest; Old != NULL && New != NULL; Old = Old->Next, New = New->Next)
+		{
+			New->Flags = Old->Flags;
+		}
+	}
+
+Exit:
+
+	FreeTopologyTree(OldTree);
+
+	FreeTopologyTree(NewTree);
+
+	FreeSyntheticForest(OldForest);
+
+	FreeSyntheticForest(NewForest);
+
+	return(Result);
+}
+
+// Times single-source simulations, then the all-sites view, over a made-up hub-and-spoke site graph.
+
+static DWORD ConvergeBenchmarkRun(_In_ SITEGRAPH* SiteGraph)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	CONVERGENCE_GRAPH* Graph = NULL;
+
+	CONVERGENCE_RESULT* Convergence = NULL;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	QueryPerformanceCounter(&Start);
+
+	if ((Graph = BuildConvergenceGraph(SiteGraph)) == NULL)
+	{
+		return(ERROR_NOT_ENOUGH_MEMORY);
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"%s: %lu nodes, %lu edges, built in %.2f ms\n",
+		Graph->UsesConnections ? L"Connection objects" : L"Site links only",
+		Graph->NodeCount,
+		Graph->EdgeCount,
+		BenchmarkSeconds(Start, End) * 1000.0);
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Source = 0; Source < CONVERGE_BENCHMARK_SOURCES; Source++)
+	{
+		FreeConvergenceResult(Convergence);
+
+		if ((Result = ComputeConvergence(Graph, (Source * 7919) % Graph->SiteCount, (Source * 3571) % (SITEGRAPH_HOURS_PER_WEEK * 3600), &Convergence)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"  One source:  %10.3f ms per simulation, last one slowest site %lu s, %lu unreachable\n",
+		(BenchmarkSeconds(Start, End) / CONVERGE_BENCHMARK_SOURCES) * 1000.0,
+		Convergence->MaxSeconds,
+		Convergence->Unreachable);
+
+	FreeConvergenceResult(Convergence);
+
+	Convergence = NULL;
+
+	QueryPerformanceCounter(&Start);
+
+	if ((Result = ComputeConvergence(Graph, CONVERGENCE_ALL_SITES, 0, &Convergence)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"  Every site:  %10.2f ms for %lu simulations, worst %lu s, best %lu s\n",
+		BenchmarkSeconds(Start, End) * 1000.0,
+		Convergence->SiteCount,
+		Convergence->MaxSeconds,
+		Convergence->MinSeconds);
+
+Exit:
+
+	FreeConvergenceResult(Convergence);
+
+	FreeConvergenceGraph(Graph);
+
+	return(Result);
+}
+
+DWORD ConvergeBenchmark(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	SITEGRAPH* SiteGraph = NULL;
+
+	UINT64 NightsOnly[3] = { 0 };
+
+	if ((Forest = CreateSyntheticForest(CONVERGE_BENCHMARK_SITES, 3, SYNTHETIC_DOMAINS, &EntityCount)) == NULL ||
+		(SiteGraph = CreateSiteGraph(Forest)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	// Midnight to 6am UTC, every day.
+
+	for (DWORD Hour = 0; Hour < SITEGRAPH_HOURS_PER_WEEK; Hour++)
+	{
+		if (Hour % 24 < 6)
+		{
+			NightsOnly[Hour / 64] |= 1ULL << (Hour % 64);
+		}
+	}
+
+	// Site indices follow DN order rather than creation order, which is fine; any site can be a hub.
+
+	for (DWORD Site = 0; Site < SiteGraph->SiteCount; Site++)
+	{
+		DWORD Hub = Site - (Site % CONVERGE_BENCHMARK_REGION_SITES);
+
+		if (Site == Hub)
+		{
+			DWORD NextHub = (Site + CONVERGE_BENCHMARK_REGION_SITES) % SiteGraph->SiteCount;
+
+			DWORD Ring[] = { Hub, NextHub - (NextHub % CONVERGE_BENCHMARK_REGION_SITES) };
+
+			Result = SiteGraphAddLink(SiteGraph, L"Backbone", 50, 15, NULL, Ring, _countof(Ring));
+		}
+		else
+		{
+			DWORD Spoke[] = { Hub, Site };
+
+			Result = SiteGraphAddLink(SiteGraph, L"Spoke", 100, 15 + ((Site % 12) * 15), (Site % 7 == 0) ? NightsOnly : NULL, Spoke, _countof(Spoke));
+		}
+
+		if (Result != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+
+	if ((Result = FinalizeSiteGraph(SiteGraph)) != ERROR_SUCCESS ||
+		(Result = ConvergeBenchmarkRun(SiteGraph)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	// The same again, but with the KCC having built connections both ways along every link.
+
+	for (DWORD Link = 0; Link < SiteGraph->LinkCount; Link++)
+	{
+		DWORD* Sites = &SiteGraph->LinkSites[SiteGraph->Links[Link].FirstSite];
+
+		if (SiteGraph->Links[Link].SiteCount == 2 &&
+			((Result = SiteGraphAddConnection(SiteGraph, Sites[0], Sites[1])) != ERROR_SUCCESS ||
+			(Result = SiteGraphAddConnection(SiteGraph, Sites[1], Sites[0])) != ERROR_SUCCESS))
+		{
+			goto Exit;
+		}
+	}
+
+	if ((Result = FinalizeSiteGraph(SiteGraph)) != ERROR_SUCCESS ||
+		(Result = ConvergeBenchmarkRun(SiteGraph)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+Exit:
+
+	FreeSiteGraph(SiteGraph);
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+// Builds a KCC what-if simulation over a hub-and-spoke site graph where every site also has a dearer link to its
+// neighbour, then times recomputes after link cost edits and after DCs are removed and put back.
+
+DWORD KccBenchmark(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	SITEGRAPH* SiteGraph = NULL;
+
+	KCC_SIMULATION* Simulation = NULL;
+
+	DWORD DCCount = 0;
+
+	ENTITY** DCs = NULL;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((Forest = CreateSyntheticForest(CONVERGE_BENCHMARK_SITES, 3, SYNTHETIC_DOMAINS, &EntityCount)) == NULL ||
+		(SiteGraph = CreateSiteGraph(Forest)) == NULL ||
+		(DCs = HeapAlloc(GetProcessHeap(), 0, sizeof(ENTITY*) * EntityCount)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	for (DWORD Site = 0; Site < SiteGraph->SiteCount; Site++)
+	{
+		DWORD Hub = Site - (Site % CONVERGE_BENCHMARK_REGION_SITES);
+
+		DWORD Neighbour[] = { Site, (Site + 1) % SiteGraph->SiteCount };
+
+		if (Site == Hub)
+		{
+			DWORD NextHub = (Site + CONVERGE_BENCHMARK_REGION_SITES) % SiteGraph->SiteCount;
+
+			DWORD Ring[] = { Hub, NextHub - (NextHub % CONVERGE_BENCHMARK_REGION_SITES) };
+
+			Result = SiteGraphAddLink(SiteGraph, L"Backbone", 50, 15, NULL, Ring, _countof(Ring));
+		}
+		else
+		{
+			DWORD Spoke[] = { Hub, Site };
+
+			Result = SiteGraphAddLink(SiteGraph, L"Spoke", 100, 180, NULL, Spoke, _countof(Spoke));
+		}
+
+		if (Result != ERROR_SUCCESS ||
+			(Result = SiteGraphAddLink(SiteGraph, L"Neighbour", 150 + (Site % 50), 180, NULL, Neighbour, _countof(Neighbour))) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+
+	if ((Result = FinalizeSiteGraph(SiteGraph)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	for (ENTITY* Current = Forest; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			DCs[DCCount++] = Current;
+		}
+	}
+
+	QueryPerformanceCounter(&Start);
+
+	if ((Simulation = CreateKccSimulation(SiteGraph, Forest)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"%lu sites, %lu site links, %lu DCs: built in %.2f ms, %lu connections\n",
+		SiteGraph->SiteCount,
+		SiteGraph->LinkCount,
+		DCCount,
+		BenchmarkSeconds(Start, End) * 1000.0,
+		Simulation->ConnectionCount);
+
+	// Making a spoke dearer than the neighbour link next to it swaps one edge of the tree for another.
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Edit = 0; Edit < KCC_BENCHMARK_EDITS; Edit++)
+	{
+		DWORD Link = (Edit * 7919) % SiteGraph->LinkCount;
+
+		if ((Result = KccSetLinkCost(Simulation, Link, Simulation->LinkCosts[Link] + 100)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"  Link cost:   %10.3f ms per edit, %lu new and %lu removed connections after %lu edits\n",
+		(BenchmarkSeconds(Start, End) / KCC_BENCHMARK_EDITS) * 1000.0,
+		Simulation->ChangeCounts[KC_NEW],
+		Simulation->ChangeCounts[KC_REMOVED],
+		KCC_BENCHMARK_EDITS);
+
+	if ((Result = KccResetEdits(Simulation)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	// Removing DCs one after another mostly just moves bridgeheads. Now and then a site loses its last DC.
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Edit = 0; Edit < KCC_BENCHMARK_EDITS; Edit++)
+	{
+		if ((Result = KccToggleDC(Simulation, DCs[(Edit * 3) % DCCount])) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"  DC removed:  %10.3f ms per edit\n", (BenchmarkSeconds(Start, End) / KCC_BENCHMARK_EDITS) * 1000.0);
+
+	if ((Result = KccResetEdits(Simulation)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Edit = 0; Edit < KCC_BENCHMARK_EDITS; Edit++)
+	{
+		ENTITY* DC = DCs[(Edit * 7919) % DCCount];
+
+		if ((Result = KccToggleDC(Simulation, DC)) != ERROR_SUCCESS ||
+			(Result = KccToggleDC(Simulation, DC)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"  DC toggled:  %10.3f ms per edit, %lu isolated sites at the end\n",
+		(BenchmarkSeconds(Start, End) / (KCC_BENCHMARK_EDITS * 2)) * 1000.0,
+		Simulation->IsolatedSites);
+
+Exit:
+
+	FreeKccSimulation(Simulation);
+
+	if (DCs)
+	{
+		HeapFree(GetProcessHeap(), 0, DCs);
+	}
+
+	FreeSiteGraph(SiteGraph);
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+// Pans the camera across the synthetic forest at a few altitudes, from close enough to read every label to far
+// enough out to have hundreds of entities on screen, and times recording each frame's render commands apart from
+// playing them into an offscreen bitmap with GDI. Every frame is also written to RENDER_BENCHMARK_FILE_NAME, for
+// Tools/ReplayBench to play back with other backends.
+
+DWORD RenderBenchmark(void)
+{
+	static const int Altitudes[] = { 1, 2, 4, 16, 64 };
+
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	RENDER_LIST* List = NULL;
+
+	HDC DeviceContext = NULL;
+
+	HBITMAP Bitmap = NULL;
+
+	void* Bits = NULL;
+
+	BITMAPINFO BitmapInfo = { 0 };
+
+	HANDLE File = INVALID_HANDLE_VALUE;
+
+	SCENE* PreviousScene = gFrameScene;
+
+	SCENE Scene = { 0 };
+
+	CAMERA PreviousCamera = gCamera;
+
+	RECT PreviousClientRect = gGraphicsData.ClientRect;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((Forest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL ||
+		(List = CreateRenderList()) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	BitmapInfo.bmiHeader.biSize = sizeof(BitmapInfo.bmiHeader);
+
+	BitmapInfo.bmiHeader.biWidth = RENDER_BENCHMARK_WIDTH;
+
+	BitmapInfo.bmiHeader.biHeight = RENDER_BENCHMARK_HEIGHT;
+
+	BitmapInfo.bmiHeader.biBitCount = 32;
+
+	BitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+	BitmapInfo.bmiHeader.biPlanes = 1;
+
+	if ((DeviceContext = CreateCompatibleDC(NULL)) == NULL ||
+		(Bitmap = CreateDIBSection(DeviceContext, &BitmapInfo, DIB_RGB_COLORS, &Bits, NULL, 0)) == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	if ((File = CreateFileW(RENDER_BENCHMARK_FILE_NAME, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	SelectObject(DeviceContext, Bitmap);
+
+	SetBkMode(DeviceContext, TRANSPARENT);
+
+	SetTextColor(DeviceContext, RGB(255, 255, 255));
+
+	CreateDrawingObjects();
+
+	Scene.Entities = Forest;
+
+	gFrameScene = &Scene;
+
+	SetRect(&gGraphicsData.ClientRect, 0, 0, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT);
+
+	BenchmarkPrintW(L"%lu entities, %dx%d, %lu frames per altitude\n", EntityCount, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT, RENDER_BENCHMARK_FRAMES_PER_ALTITUDE);
+
+	for (DWORD Altitude = 0; Altitude < _countof(Altitudes); Altitude++)
+	{
+		double RecordSeconds = 0.0;
+
+		double PlaySeconds = 0.0;
+
+		DWORD64 Entities = 0;
+
+		DWORD64 Commands = 0;
+
+		DWORD64 Words = 0;
+
+		gCamera.z = Altitudes[Altitude];
+
+		gCamera.y = 0;
+
+		for (DWORD Frame = 0; Frame < RENDER_BENCHMARK_FRAMES_PER_ALTITUDE; Frame++)
+		{
+			gCamera.x = (int)Frame * (RENDER_BENCHMARK_WIDTH / 3);
+
+			QueryPerformanceCounter(&Start);
+
+			CullEntities();
+
+			ResetRenderList(List, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT);
+
+			RecordScene(List);
+
+			QueryPerformanceCounter(&End);
+
+			RecordSeconds += BenchmarkSeconds(Start, End);
+
+			if (List->Result != ERROR_SUCCESS)
+			{
+				Result = List->Result;
+
+				goto Exit;
+			}
+
+			memset(Bits, 0, RENDER_BENCHMARK_WIDTH * RENDER_BENCHMARK_HEIGHT * 4);
+
+			QueryPerformanceCounter(&Start);
+
+			PlayRenderList(List, DeviceContext);
+
+			GdiFlush();
+
+			QueryPerformanceCounter(&End);
+
+			PlaySeconds += BenchmarkSeconds(Start, End);
+
+			Entities += gGraphicsData.EntitiesOnScreen;
+
+			Commands += List->CommandCount;
+
+			Words += List->WordCount;
+
+			if ((Result = AppendRenderList(List, File)) != ERROR_SUCCESS)
+			{
+				goto Exit;
+			}
+		}
+
+		BenchmarkPrintW(L"  Altitude %2d: %6llu entities, %7llu commands, %8.1f KB per frame; record %8.3f ms, play %8.3f ms per frame\n",
+			Altitudes[Altitude],
+			Entities / RENDER_BENCHMARK_FRAMES_PER_ALTITUDE,
+			Commands / RENDER_BENCHMARK_FRAMES_PER_ALTITUDE,
+			(double)(Words * sizeof(UINT32)) / RENDER_BENCHMARK_FRAMES_PER_ALTITUDE / 1024.0,
+			(RecordSeconds / RENDER_BENCHMARK_FRAMES_PER_ALTITUDE) * 1000.0,
+			(PlaySeconds / RENDER_BENCHMARK_FRAMES_PER_ALTITUDE) * 1000.0);
+	}
+
+	BenchmarkPrintW(L"Frames written to %s\n", RENDER_BENCHMARK_FILE_NAME);
+
+Exit:
+
+	gFrameScene = PreviousScene;
+
+	gCamera = PreviousCamera;
+
+	gGraphicsData.ClientRect = PreviousClientRect;
+
+	if (File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(File);
+	}
+
+	if (DeviceContext)
+	{
+		DeleteDC(DeviceContext);
+	}
+
+	if (Bitmap)
+	{
+		DeleteObject(Bitmap);
+	}
+
+	FreeRenderList(List);
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+// The name of a site or server the way discovery used to get it, from the fourth character up to the first comma,
+// for comparison.
+
+static void DnBenchmarkOldName(_In_ wchar_t* DN, _Out_ wchar_t* Name)
+{
+	wchar_t CommonName[64] = { 0 };
+
+	for (int Character = 3; Character < _countof(CommonName) - 1; Character++)
+	{
+		if (DN[Character] == L',' || DN[Character] == L'\0')
+		{
+			break;
+		}
+
+		CommonName[Character - 3] = DN[Character];
+	}
+
+	wcscpy_s(Name, _countof(CommonName), CommonName);
+}
+
+// Reads the DN of every site and DC in the synthetic forest, plus a computer account DN for every DC, and times
+// walking their attributes, getting the site or server name out of each, and getting the domain out of each
+// computer account DN.
+
+DWORD DnBenchmark(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	wchar_t** DNs = NULL;
+
+	wchar_t (*ComputerDNs)[DN_BENCHMARK_MAX_DN] = NULL;
+
+	DWORD DNCount = 0;
+
+	DWORD ComputerDNCount = 0;
+
+	DWORD SiteCount = 0;
+
+	DWORD64 Characters = 0;
+
+	DWORD64 Attributes = 0;
+
+	DWORD Invalid = 0;
+
+	DWORD Mismatches = 0;
+
+	wchar_t Name[128] = { 0 };
+
+	wchar_t OldName[64] = { 0 };
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((Forest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL ||
+		(DNs = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, EntityCount * sizeof(wchar_t*))) == NULL ||
+		(ComputerDNs = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, EntityCount * sizeof(*ComputerDNs))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	for (ENTITY* Current = Forest; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_SITE && (SiteCount++ % DN_BENCHMARK_ESCAPED_SITE_EVERY) == 0)
+		{
+			// Seattle-8 becomes Seattle\, West-8 in the DN of the site, and of every server in it.
+
+			wchar_t* Dash = wcsrchr(Current->name, L'-');
+
+			if (Dash)
+			{
+				wchar_t Renamed[128] = { 0 };
+
+				_snwprintf_s(Renamed, _countof(Renamed), _TRUNCATE, L"%.*s\\, West%s", (int)(Dash - Current->name), Current->name, Dash);
+
+				_snwprintf_s(Current->distinguishedname, _countof(Current->distinguishedname), _TRUNCATE, L"CN=%s,CN=Sites,CN=Configuration,DC=contoso,DC=com", Renamed);
+
+				for (ENTITY* DC = Current->Next; DC != NULL && DC->Type == ET_DC; DC = DC->Next)
+				{
+					_snwprintf_s(DC->distinguishedname, _countof(DC->distinguishedname), _TRUNCATE, L"CN=%s,CN=Servers,%s", DC->name, Current->distinguishedname);
+				}
+			}
+		}
+
+		if (Current->Type == ET_SITE || Current->Type == ET_DC)
+		{
+			DNs[DNCount++] = Current->distinguishedname;
+
+			Characters += wcslen(Current->distinguishedname);
+		}
+
+		// The domain is in the DC's fqdn; its computer account DN says the same thing the long way round.
+
+		if (Current->Type == ET_DC && wcschr(Current->fqdn, L'.'))
+		{
+			wchar_t* Computer = ComputerDNs[ComputerDNCount];
+
+			size_t Length = (size_t)_snwprintf_s(Computer, DN_BENCHMARK_MAX_DN, _TRUNCATE, L"CN=%s,OU=Domain Controllers,DC=", Current->name);
+
+			for (wchar_t* Character = wcschr(Current->fqdn, L'.') + 1; *Character != L'\0' && Length + 4 < DN_BENCHMARK_MAX_DN; Character++)
+			{
+				if (*Character == L'.')
+				{
+					wmemcpy(Computer + Length, L",DC=", 4);
+
+					Length += 4;
+				}
+				else
+				{
+					Computer[Length++] = *Character;
+				}
+			}
+
+			Computer[Length] = L'\0';
+
+			ComputerDNCount++;
+		}
+	}
+
+	BenchmarkPrintW(L"%lu site and server DNs, %llu characters; %lu computer account DNs; %lu passes\n", DNCount, Characters, ComputerDNCount, DN_BENCHMARK_PASSES);
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Pass = 0; Pass < DN_BENCHMARK_PASSES; Pass++)
+	{
+		for (DWORD Index = 0; Index < DNCount; Index++)
+		{
+			DN_READER Reader = { 0 };
+
+			DN_ATTRIBUTE Attribute = { 0 };
+
+			InitializeDnReader(&Reader, DNs[Index], (DWORD)wcslen(DNs[Index]));
+
+			while (DnNextAttribute(&Reader, &Attribute) == ERROR_SUCCESS)
+			{
+				Attributes++;
+			}
+
+			Invalid += (Reader.Result != ERROR_NO_MORE_ITEMS);
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"  Tokenize:      %8.1f ns per DN, %7.1f MB/s, %llu attributes per pass, %lu invalid\n",
+		(BenchmarkSeconds(Start, End) / ((double)DNCount * DN_BENCHMARK_PASSES)) * 1e9,
+		((double)Characters * sizeof(wchar_t) * DN_BENCHMARK_PASSES) / BenchmarkSeconds(Start, End) / (1024.0 * 1024.0),
+		Attributes / DN_BENCHMARK_PASSES,
+		Invalid / DN_BENCHMARK_PASSES);
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Pass = 0; Pass < DN_BENCHMARK_PASSES; Pass++)
+	{
+		for (DWORD Index = 0; Index < DNCount; Index++)
+		{
+			DnFirstValue(DNs[Index], Name, _countof(Name));
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"  DnFirstValue:  %8.1f ns per DN\n", (BenchmarkSeconds(Start, End) / ((double)DNCount * DN_BENCHMARK_PASSES)) * 1e9);
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Pass = 0; Pass < DN_BENCHMARK_PASSES; Pass++)
+	{
+		for (DWORD Index = 0; Index < DNCount; Index++)
+		{
+			DnBenchmarkOldName(DNs[Index], OldName);
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	for (DWORD Index = 0; Index < DNCount; Index++)
+	{
+		DnFirstValue(DNs[Index], Name, _countof(Name));
+
+		DnBenchmarkOldName(DNs[Index], OldName);
+
+		Mismatches += (wcscmp(Name, OldName) != 0);
+	}
+
+	BenchmarkPrintW(L"  Old copy:      %8.1f ns per DN, wrong for %lu of %lu names\n",
+		(BenchmarkSeconds(Start, End) / ((double)DNCount * DN_BENCHMARK_PASSES)) * 1e9,
+		Mismatches,
+		DNCount);
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Pass = 0; Pass < DN_BENCHMARK_PASSES; Pass++)
+	{
+		for (DWORD Index = 0; Index < ComputerDNCount; Index++)
+		{
+			DnToDomainName(ComputerDNs[Index], Name, _countof(Name));
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"  DnToDomainName:%8.1f ns per DN\n", (BenchmarkSeconds(Start, End) / ((double)max(ComputerDNCount, 1) * DN_BENCHMARK_PASSES)) * 1e9);
+
+	if (Invalid > 0)
+	{
+		Result = ERROR_INVALID_DATA;
+	}
+
+Exit:
+
+	if (ComputerDNs)
+	{
+		HeapFree(GetProcessHeap(), 0, ComputerDNs);
+	}
+
+	if (DNs)
+	{
+		HeapFree(GetProcessHeap(), 0, DNs);
+	}
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+// Draws the same views of the synthetic forest as usual and from the tile pyramid, once the tiles they need are
+// drawn, and times both. How long the tiles took to draw the first time is shown as well.
+
+DWORD TileBenchmark(void)
+{
+	static const int Altitudes[] = { 8, 16, 32, 64 };
+
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	PICKINDEX* Index = NULL;
+
+	BOOL PyramidStarted = FALSE;
+
+	RENDER_LIST* List = NULL;
+
+	HDC DeviceContext = NULL;
+
+	HBITMAP Bitmap = NULL;
+
+	void* Bits = NULL;
+
+	BITMAPINFO BitmapInfo = { 0 };
+
+	SCENE* PreviousScene = gFrameScene;
+
+	SCENE Scene = { 0 };
+
+	CAMERA PreviousCamera = gCamera;
+
+	RECT PreviousClientRect = gGraphicsData.ClientRect;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((Forest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL ||
+		(List = CreateRenderList()) == NULL ||
+		(Index = BuildPickIndex(Forest)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	BitmapInfo.bmiHeader.biSize = sizeof(BitmapInfo.bmiHeader);
+
+	BitmapInfo.bmiHeader.biWidth = RENDER_BENCHMARK_WIDTH;
+
+	BitmapInfo.bmiHeader.biHeight = RENDER_BENCHMARK_HEIGHT;
+
+	BitmapInfo.bmiHeader.biBitCount = 32;
+
+	BitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+	BitmapInfo.bmiHeader.biPlanes = 1;
+
+	if ((DeviceContext = CreateCompatibleDC(NULL)) == NULL ||
+		(Bitmap = CreateDIBSection(DeviceContext, &BitmapInfo, DIB_RGB_COLORS, &Bits, NULL, 0)) == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	SelectObject(DeviceContext, Bitmap);
+
+	CreateDrawingObjects();
+
+	Scene.Entities = Forest;
+
+	gFrameScene = &Scene;
+
+	SetRect(&gGraphicsData.ClientRect, 0, 0, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT);
+
+	if ((Result = StartTilePyramid(Index)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	PyramidStarted = TRUE;
+
+	BenchmarkPrintW(L"%lu entities, %dx%d, %lu frames per altitude\n", EntityCount, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT, RENDER_BENCHMARK_FRAMES_PER_ALTITUDE);
+
+	for (DWORD Altitude = 0; Altitude < _countof(Altitudes); Altitude++)
+	{
+		double VectorSeconds = 0.0;
+
+		double TileSeconds = 0.0;
+
+		double WarmSeconds = 0.0;
+
+		DWORD Ready = 0;
+
+		DWORD Waiting = 0;
+
+		UINT64 Frame = 0;
+
+		gCamera.z = Altitudes[Altitude];
+
+		gCamera.x = 0;
+
+		gCamera.y = 0;
+
+		// Keep asking for the view until every tile in it is drawn, the way frames would while the worker catches up.
+
+		QueryPerformanceCounter(&Start);
+
+		while (!DrawTiles(DeviceContext, &gCamera, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT, DCCM_REPLICATION, Frame++) || (GetTileCounts(&Ready, &Waiting), Waiting > 0))
+		{
+			QueryPerformanceCounter(&End);
+
+			if (BenchmarkSeconds(Start, End) > TILE_BENCHMARK_WARM_SECONDS)
+			{
+				BenchmarkPrintW(L"  Altitude %2d: tiles weren't ready after %d seconds\n", Altitudes[Altitude], TILE_BENCHMARK_WARM_SECONDS);
+
+				Result = ERROR_TIMEOUT;
+
+				goto Exit;
+			}
+
+			Sleep(1);
+		}
+
+		QueryPerformanceCounter(&End);
+
+		WarmSeconds = BenchmarkSeconds(Start, End);
+
+		for (DWORD Pass = 0; Pass < RENDER_BENCHMARK_FRAMES_PER_ALTITUDE; Pass++)
+		{
+			memset(Bits, 0, RENDER_BENCHMARK_WIDTH * RENDER_BENCHMARK_HEIGHT * 4);
+
+			QueryPerformanceCounter(&Start);
+
+			CullEntities();
+
+			ResetRenderList(List, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT);
+
+			RecordScene(List);
+
+			PlayRenderList(List, DeviceContext);
+
+			GdiFlush();
+
+			QueryPerformanceCounter(&End);
+
+			VectorSeconds += BenchmarkSeconds(Start, End);
+
+			memset(Bits, 0, RENDER_BENCHMARK_WIDTH * RENDER_BENCHMARK_HEIGHT * 4);
+
+			QueryPerformanceCounter(&Start);
+
+			DrawTiles(DeviceContext, &gCamera, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT, DCCM_REPLICATION, Frame++);
+
+			GdiFlush();
+
+			QueryPerformanceCounter(&End);
+
+			TileSeconds += BenchmarkSeconds(Start, End);
+		}
+
+		GetTileCounts(&Ready, &Waiting);
+
+		BenchmarkPrintW(L"  Altitude %2d: %6d entities; as usual %8.3f ms, from %3lu tiles %8.3f ms per frame (%.1fx); first drawn in %8.1f ms\n",
+			Altitudes[Altitude],
+			gGraphicsData.EntitiesOnScreen,
+			(VectorSeconds / RENDER_BENCHMARK_FRAMES_PER_ALTITUDE) * 1000.0,
+			Ready,
+			(TileSeconds / RENDER_BENCHMARK_FRAMES_PER_ALTITUDE) * 1000.0,
+			VectorSeconds / max(TileSeconds, 1e-9),
+			WarmSeconds * 1000.0);
+	}
+
+Exit:
+
+	if (PyramidStarted)
+	{
+		StopTilePyramid(TILE_SHUTDOWN_TIMEOUT_MS);
+	}
+
+	gFrameScene = PreviousScene;
+
+	gCamera = PreviousCamera;
+
+	gGraphicsData.ClientRect = PreviousClientRect;
+
+	if (DeviceContext)
+	{
+		DeleteDC(DeviceContext);
+	}
+
+	if (Bitmap)
+	{
+		DeleteObject(Bitmap);
+	}
+
+	FreeRenderList(List);
+
+	FreePickIndex(Index);
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+static UINT32 HistoryBenchmarkRandom(_Inout_ UINT32* Seed)
+{
+	*Seed ^= *Seed << 13;
+
+	*Seed ^= *Seed >> 17;
+
+	*Seed ^= *Seed << 5;
+
+	return(*Seed);
+}
+
+// Feeds the time-series store HISTORY_BENCHMARK_HOURS of made-up probe and replication results for every DC of a
+// synthetic forest, as fast as it will take them, then times reading sparklines back out. Each DC has a latency of
+// its own on each port with some noise and the odd spike, probed every PROBE_DEF_INTERVAL_SECONDS give or take a
+// second, and a replication queue that's usually empty, polled every REPL_DEF_POLL_SECONDS.
+
+DWORD HistoryBenchmark(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	DWORD DCCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	ENTITY** DCs = NULL;
+
+	TIMESERIES_POINT* Points = NULL;
+
+	TIMESERIES_STATS Stats = { 0 };
+
+	UINT32 Maximums[TIMESERIES_SPARKLINE_BUCKETS] = { 0 };
+
+	UINT32 Seed = 0x12345678;
+
+	INT64 Now = TimeSeriesNow();
+
+	INT64 Begin = Now - (HISTORY_BENCHMARK_HOURS * 60 * 60);
+
+	UINT64 Recorded = 0;
+
+	UINT64 Returned = 0;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((Forest = CreateSyntheticForest(HISTORY_BENCHMARK_SITES, HISTORY_BENCHMARK_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	for (ENTITY* Current = Forest; Current != NULL; Current = Current->Next)
+	{
+		DCCount += (Current->Type == ET_DC);
+	}
+
+	DCs = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(ENTITY*) * DCCount);
+
+	Points = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TIMESERIES_POINT) * HISTORY_BENCHMARK_MAX_POINTS);
+
+	if (DCs == NULL || Points == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	DCCount = 0;
+
+	for (ENTITY* Current = Forest; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			DCs[DCCount++] = Current;
+		}
+	}
+
+	if ((Result = StartTimeSeries(Forest, HISTORY_BENCHMARK_MB, NULL)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	BenchmarkPrintW(L"%lu DCs, %d MB, %d hours\n", DCCount, HISTORY_BENCHMARK_MB, HISTORY_BENCHMARK_HOURS);
+
+	QueryPerformanceCounter(&Start);
+
+	for (INT64 Tick = Begin; Tick < Now; Tick += PROBE_DEF_INTERVAL_SECONDS)
+	{
+		BOOL Poll = ((Tick - Begin) % REPL_DEF_POLL_SECONDS) < PROBE_DEF_INTERVAL_SECONDS;
+
+		for (DWORD DC = 0; DC < DCCount; DC++)
+		{
+			// Every DC is probed at its own point in the interval, which doesn't change, and a second either side.
+
+			INT64 Time = Tick + (DC % PROBE_DEF_INTERVAL_SECONDS) + (INT64)(HistoryBenchmarkRandom(&Seed) % 3) - 1;
+
+			for (int Port = 0; Port < PP_COUNT; Port++)
+			{
+				UINT32 Typical = 400 + ((DC * 7919 + Port * 104729) % 8000);
+
+				UINT32 Latency = Typical + (HistoryBenchmarkRandom(&Seed) % (Typical / 4 + 1));
+
+				if (HistoryBenchmarkRandom(&Seed) % 200 == 0)
+				{
+					Latency *= 20;
+				}
+
+				RecordTimeSeries(DCs[DC], (TIMESERIES_METRIC)(TSM_LDAP_LATENCY + Port), Time, Latency);
+
+				Recorded++;
+			}
+
+			if (Poll)
+			{
+				UINT32 Failing = (DC % 13 == 0) ? 1 : 0;
+
+				UINT32 Queued = (HistoryBenchmarkRandom(&Seed) % 17 == 0) ? HistoryBenchmarkRandom(&Seed) % 40 : 0;
+
+				RecordTimeSeries(DCs[DC], TSM_FAILING_NEIGHBORS, Time, Failing);
+
+				RecordTimeSeries(DCs[DC], TSM_PENDING_OPS, Time, Queued);
+
+				Recorded += 2;
+			}
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	GetTimeSeriesStats(&Stats);
+
+	BenchmarkPrintW(L"Record:    %8.1f ns per point, %llu points\n", (BenchmarkSeconds(Start, End) / (double)Recorded) * 1e9, Recorded);
+
+	BenchmarkPrintW(L"Kept:      %llu points in %lu of %lu blocks, %.2f bytes per point, going back %.1f hours, %lu dropped\n",
+		Stats.Points,
+		Stats.BlocksInUse,
+		Stats.BlockCount,
+		((double)Stats.BlocksInUse * TIMESERIES_BLOCK_BYTES) / (double)max(Stats.Points, 1),
+		(double)(Now - max(Stats.Oldest, Begin)) / (60.0 * 60.0),
+		Stats.Dropped);
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Query = 0; Query < HISTORY_BENCHMARK_QUERIES; Query++)
+	{
+		ENTITY* DC = DCs[HistoryBenchmarkRandom(&Seed) % DCCount];
+
+		SummarizeTimeSeries(DC, (TIMESERIES_METRIC)(HistoryBenchmarkRandom(&Seed) % TSM_COUNT), Now - TIMESERIES_SPARKLINE_SECONDS, Now, Maximums, _countof(Maximums));
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"Sparkline: %8.2f us for the last %d minutes of one series\n",
+		(BenchmarkSeconds(Start, End) / HISTORY_BENCHMARK_QUERIES) * 1e6,
+		TIMESERIES_SPARKLINE_SECONDS / 60);
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Query = 0; Query < HISTORY_BENCHMARK_QUERIES; Query++)
+	{
+		ENTITY* DC = DCs[HistoryBenchmarkRandom(&Seed) % DCCount];
+
+		DWORD Count = 0;
+
+		QueryTimeSeries(DC, TSM_LDAP_LATENCY, Now - TIMESERIES_SPARKLINE_SECONDS, Now, Points, HISTORY_BENCHMARK_MAX_POINTS, &Count);
+
+		Returned += Count;
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"Query:     %8.2f us for the last %d minutes of one series, %.0f points\n",
+		(BenchmarkSeconds(Start, End) / HISTORY_BENCHMARK_QUERIES) * 1e6,
+		TIMESERIES_SPARKLINE_SECONDS / 60,
+		(double)Returned / HISTORY_BENCHMARK_QUERIES);
+
+Exit:
+
+	StopTimeSeries();
+
+	if (Points)
+	{
+		HeapFree(GetProcessHeap(), 0, Points);
+	}
+
+	if (DCs)
+	{
+		HeapFree(GetProcessHeap(), 0, DCs);
+	}
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+// Builds up a timeline of TIMELINE_BENCHMARK_VERSIONS versions of a synthetic forest, as a couple of months of nightly
+// headless collections would, with a few dozen DCs changing between each and now and then one going away. Then reads
+// every version back. The file should come out a small multiple of one compressed keyframe, however many versions
+// there are.
+
+DWORD TimelineBenchmark(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	UINT32 Seed = 0x2545F491;
+
+	UINT64 FileBytes = sizeof(TIMELINE_HEADER);
+
+	DWORD Keyframes = 0;
+
+	double Slowest = 0.0;
+
+	TIMELINE_RECORD First = { 0 };
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	DeleteFileW(TIMELINE_BENCHMARK_FILE_NAME);
+
+	if ((Forest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Version = 0; Version < TIMELINE_BENCHMARK_VERSIONS; Version++)
+	{
+		for (DWORD Change = 0; Version > 0 && Change < TIMELINE_BENCHMARK_CHANGES; Change++)
+		{
+			DWORD Skip = 0;
+
+			ENTITY* Current = Forest;
+
+			Seed ^= Seed << 13;
+
+			Seed ^= Seed >> 17;
+
+			Seed ^= Seed << 5;
+
+			for (Skip = Seed % EntityCount; Skip > 0 && Current->Next != NULL; Skip--)
+			{
+				Current = Current->Next;
+			}
+
+			// The first change of every eighth version takes the entity after this one out of the forest instead.
+			// It's still in the forest's allocation, so nothing needs freeing.
+
+			if (Change == 0 && Version % 8 == 0 && Current->Next != NULL && Current->Next->Type == ET_DC)
+			{
+				Current->Next = Current->Next->Next;
+			}
+			else if (Current->Type == ET_DC)
+			{
+				Current->Flags ^= DCF_GC;
+			}
+		}
+
+		if ((Result = OpenTimeline(TIMELINE_BENCHMARK_FILE_NAME, Forest, NULL)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+
+	QueryPerformanceCounter(&End);
+
+	for (DWORD Version = 0; Version < GetTimelineCount(); Version++)
+	{
+		TIMELINE_RECORD Record = { 0 };
+
+		GetTimelineRecord(Version, &Record);
+
+		FileBytes += sizeof(TIMELINE_RECORD) + Record.CompressedBytes;
+
+		Keyframes += (Record.Kind == TLK_KEYFRAME);
+	}
+
+	GetTimelineRecord(0, &First);
+
+	BenchmarkPrintW(L"Record:  %8.1f ms per version, %lu versions of %lu entities, %lu keyframes\n",
+		(BenchmarkSeconds(Start, End) * 1000.0) / TIMELINE_BENCHMARK_VERSIONS,
+		GetTimelineCount(),
+		EntityCount,
+		Keyframes);
+
+	BenchmarkPrintW(L"Size:    %8.1f MB; one keyframe is %.1f MB compressed from %.1f MB, so %lu snapshots would be %.1f MB\n",
+		FileBytes / (1024.0 * 1024.0),
+		First.CompressedBytes / (1024.0 * 1024.0),
+		First.Bytes / (1024.0 * 1024.0),
+		GetTimelineCount(),
+		((double)First.Bytes * GetTimelineCount()) / (1024.0 * 1024.0));
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Version = 0; Version < GetTimelineCount(); Version++)
+	{
+		ENTITY* Loaded = NULL;
+
+		LARGE_INTEGER LoadStart = { 0 };
+
+		LARGE_INTEGER LoadEnd = { 0 };
+
+		QueryPerformanceCounter(&LoadStart);
+
+		if ((Result = LoadTimelineVersion(Version, &Loaded)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		QueryPerformanceCounter(&LoadEnd);
+
+		Slowest = max(Slowest, BenchmarkSeconds(LoadStart, LoadEnd));
+
+		FreeEntities(Loaded);
+	}
+
+	QueryPerformanceCounter(&End);
+
+	BenchmarkPrintW(L"Load:    %8.1f ms per version, %.1f ms at worst\n",
+		(BenchmarkSeconds(Start, End) * 1000.0) / GetTimelineCount(),
+		Slowest * 1000.0);
+
+Exit:
+
+	CloseTimeline();
+
+	DeleteFileW(TIMELINE_BENCHMARK_FILE_NAME);
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+// Records and plays LABELS_BENCHMARK_FRAMES_PER_ALTITUDE frames panning across the forest at Altitude, adding how long
+// that took and how many commands there were to the totals given.
+
+static DWORD LabelsBenchmarkFrames(_Inout_ RENDER_LIST* List, _In_ HDC DeviceContext, _In_ void* Bits, _In_ int Altitude, _Inout_ double* Seconds, _Inout_ DWORD64* Commands)
+{
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	gCamera.z = Altitude;
+
+	gCamera.y = 0;
+
+	for (DWORD Frame = 0; Frame < LABELS_BENCHMARK_FRAMES_PER_ALTITUDE; Frame++)
+	{
+		gCamera.x = (int)Frame * (RENDER_BENCHMARK_WIDTH / 3);
+
+		memset(Bits, 0, RENDER_BENCHMARK_WIDTH * RENDER_BENCHMARK_HEIGHT * 4);
+
+		QueryPerformanceCounter(&Start);
+
+		CullEntities();
+
+		ResetRenderList(List, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT);
+
+		RecordScene(List);
+
+		PlayRenderList(List, DeviceContext);
+
+		GdiFlush();
+
+		QueryPerformanceCounter(&End);
+
+		if (List->Result != ERROR_SUCCESS)
+		{
+			return(List->Result);
+		}
+
+		*Seconds += BenchmarkSeconds(Start, End);
+
+		*Commands += List->CommandCount;
+	}
+
+	return(ERROR_SUCCESS);
+}
+
+// Places the labels of the synthetic forest at every altitude they're drawn at, and shows how many of them are kept.
+// Then times frames at each of those altitudes, recorded and played, with every label drawn where it always was and
+// with only the ones placement kept. There's no window to measure text with here, so the fonts are taken to be
+// monospaced, with characters two thirds as wide as they are high, as CreateSyntheticForest has it.
+
+DWORD LabelsBenchmark(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD EntityCount = 0;
+
+	ENTITY* Forest = NULL;
+
+	RENDER_LIST* List = NULL;
+
+	HDC DeviceContext = NULL;
+
+	HBITMAP Bitmap = NULL;
+
+	void* Bits = NULL;
+
+	BITMAPINFO BitmapInfo = { 0 };
+
+	SCENE* PreviousScene = gFrameScene;
+
+	SCENE Scene = { 0 };
+
+	CAMERA PreviousCamera = gCamera;
+
+	RECT PreviousClientRect = gGraphicsData.ClientRect;
+
+	LABEL_FONT Fonts[LFS_COUNT] = { 0 };
+
+	LABEL_STATS Stats = { 0 };
+
+	double PlaceSeconds = 0.0;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((Forest = CreateSyntheticForest(SYNTHETIC_SITES, SYNTHETIC_DCS_PER_SITE, SYNTHETIC_DOMAINS, &EntityCount)) == NULL ||
+		(List = CreateRenderList()) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	Fonts[LFS_HUGE].Height = 60;
+
+	Fonts[LFS_BIG].Height = 36;
+
+	Fonts[LFS_SMALL].Height = 18;
+
+	for (int Font = 0; Font < LFS_COUNT; Font++)
+	{
+		Fonts[Font].MaxWidth = Fonts[Font].Height * 2 / 3;
+
+		for (int Character = 0; Character < LABEL_FONT_CHARS; Character++)
+		{
+			Fonts[Font].Widths[Character] = Fonts[Font].MaxWidth;
+		}
+	}
+
+	for (DWORD Pass = 0; Pass < LABELS_BENCHMARK_PASSES; Pass++)
+	{
+		QueryPerformanceCounter(&Start);
+
+		if ((Result = PlaceLabels(Forest, Fonts, &Stats)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		QueryPerformanceCounter(&End);
+
+		PlaceSeconds += BenchmarkSeconds(Start, End);
+	}
+
+	BenchmarkPrintW(L"%lu entities, placed in %.3f ms\n", EntityCount, (PlaceSeconds / LABELS_BENCHMARK_PASSES) * 1000.0);
+
+	for (int Altitude = 1; Altitude <= SITE_LABEL_MAX_ALTITUDE; Altitude++)
+	{
+		BenchmarkPrintW(L"  Altitude %d: %6lu of %6lu labels kept\n", Altitude, Stats.Placed[Altitude - 1], Stats.Labels[Altitude - 1]);
+	}
+
+	BitmapInfo.bmiHeader.biSize = sizeof(BitmapInfo.bmiHeader);
+
+	BitmapInfo.bmiHeader.biWidth = RENDER_BENCHMARK_WIDTH;
+
+	BitmapInfo.bmiHeader.biHeight = RENDER_BENCHMARK_HEIGHT;
+
+	BitmapInfo.bmiHeader.biBitCount = 32;
+
+	BitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+	BitmapInfo.bmiHeader.biPlanes = 1;
+
+	if ((DeviceContext = CreateCompatibleDC(NULL)) == NULL ||
+		(Bitmap = CreateDIBSection(DeviceContext, &BitmapInfo, DIB_RGB_COLORS, &Bits, NULL, 0)) == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	SelectObject(DeviceContext, Bitmap);
+
+	SetBkMode(DeviceContext, TRANSPARENT);
+
+	SetTextColor(DeviceContext, RGB(255, 255, 255));
+
+	CreateDrawingObjects();
+
+	Scene.Entities = Forest;
+
+	gFrameScene = &Scene;
+
+	SetRect(&gGraphicsData.ClientRect, 0, 0, RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT);
+
+	BenchmarkPrintW(L"%dx%d, %lu frames per altitude, recorded and played\n", RENDER_BENCHMARK_WIDTH, RENDER_BENCHMARK_HEIGHT, LABELS_BENCHMARK_FRAMES_PER_ALTITUDE);
+
+	for (int Altitude = 1; Altitude <= SITE_LABEL_MAX_ALTITUDE; Altitude++)
+	{
+		double PlacedSeconds = 0.0;
+
+		double UnplacedSeconds = 0.0;
+
+		DWORD64 PlacedCommands = 0;
+
+		DWORD64 UnplacedCommands = 0;
+
+		if ((Result = LabelsBenchmarkFrames(List, DeviceContext, Bits, Altitude, &PlacedSeconds, &PlacedCommands)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		// Zero LabelSpots draws every label where it always was.
+
+		for (ENTITY* Current = Forest; Current != NULL; Current = Current->Next)
+		{
+			memset(Current->LabelSpots, 0, sizeof(Current->LabelSpots));
+		}
+
+		if ((Result = LabelsBenchmarkFrames(List, DeviceContext, Bits, Altitude, &UnplacedSeconds, &UnplacedCommands)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		if ((Result = PlaceLabels(Forest, Fonts, NULL)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		BenchmarkPrintW(L"  Altitude %d: every label %8.3f ms, %6llu commands; placed %8.3f ms, %6llu commands per frame\n",
+			Altitude,
+			(UnplacedSeconds / LABELS_BENCHMARK_FRAMES_PER_ALTITUDE) * 1000.0,
+			UnplacedCommands / LABELS_BENCHMARK_FRAMES_PER_ALTITUDE,
+			(PlacedSeconds / LABELS_BENCHMARK_FRAMES_PER_ALTITUDE) * 1000.0,
+			PlacedCommands / LABELS_BENCHMARK_FRAMES_PER_ALTITUDE);
+	}
+
+Exit:
+
+	gFrameScene = PreviousScene;
+
+	gCamera = PreviousCamera;
+
+	gGraphicsData.ClientRect = PreviousClientRect;
+
+	if (DeviceContext)
+	{
+		DeleteDC(DeviceContext);
+	}
+
+	if (Bitmap)
+	{
+		DeleteObject(Bitmap);
+	}
+
+	FreeRenderList(List);
+
+	FreeSyntheticForest(Forest);
+
+	return(Result);
+}
+
+// Packs made-up sites, a thousand up to fifty thousand of them, and compares the world they take up with the row they
+// used to be laid out in: how big it is, how much of it is sites, and how far out the camera has to be to see all of it
+// on a RENDER_BENCHMARK_WIDTH by RENDER_BENCHMARK_HEIGHT screen. Most sites have a DC or two, and now and then one
+// has dozens, the way branch offices and hubs do.
+
+DWORD LayoutBenchmark(void)
+{
+	static const DWORD SiteCounts[] = { 1000, 10000, 50000 };
+
+	DWORD Result = ERROR_SUCCESS;
+
+	ENTITY* Sites = NULL;
+
+	ENTITY** SitePointers = NULL;
+
+	UINT32 Seed = 0x2545F491;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	if ((Sites = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, SiteCounts[_countof(SiteCounts) - 1] * sizeof(ENTITY))) == NULL ||
+		(SitePointers = HeapAlloc(GetProcessHeap(), 0, SiteCounts[_countof(SiteCounts) - 1] * sizeof(ENTITY*))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	for (DWORD Site = 0; Site < SiteCounts[_countof(SiteCounts) - 1]; Site++)
+	{
+		DWORD DCs = (HistoryBenchmarkRandom(&Seed) % 10 < 8) ? 1 + (HistoryBenchmarkRandom(&Seed) % 2) : 1 + (HistoryBenchmarkRandom(&Seed) % 40);
+
+		Sites[Site].Type = ET_SITE;
+
+		Sites[Site].DCsInSite = DCs;
+
+		// As wide as an fqdn of 16 to 40 characters in the huge font, plus room for the triangles.
+
+		Sites[Site].width = (int)(16 + (HistoryBenchmarkRandom(&Seed) % 25)) * 40 + DEF_DC_SIZE + (DEF_DC_SIZE / 2);
+
+		Sites[Site].height = (int)DCs * (DEF_DC_SIZE + (DEF_DC_SIZE / 2));
+
+		SitePointers[Site] = &Sites[Site];
+	}
+
+	for (DWORD Count = 0; Count < _countof(SiteCounts); Count++)
+	{
+		double Seconds = 0.0;
+
+		double SiteArea = 0.0;
+
+		INT64 RowWidth = -LAYOUT_SITE_GAP;
+
+		int RowHeight = 0;
+
+		SIZE Extent = { 0 };
+
+		for (DWORD Site = 0; Site < SiteCounts[Count]; Site++)
+		{
+			SiteArea += (double)Sites[Site].width * (double)Sites[Site].height;
+
+			RowWidth += Sites[Site].width + LAYOUT_SITE_GAP;
+
+			RowHeight = max(RowHeight, Sites[Site].height);
+		}
+
+		for (DWORD Pass = 0; Pass < LAYOUT_BENCHMARK_PASSES; Pass++)
+		{
+			QueryPerformanceCounter(&Start);
+
+			if ((Result = PackSites(SitePointers, SiteCounts[Count], (float)RENDER_BENCHMARK_WIDTH / (float)RENDER_BENCHMARK_HEIGHT, &Extent)) != ERROR_SUCCESS)
+			{
+				goto Exit;
+			}
+
+			QueryPerformanceCounter(&End);
+
+			Seconds += BenchmarkSeconds(Start, End);
+		}
+
+		BenchmarkPrintW(L"%6lu sites: packed in %8.3f ms\n", SiteCounts[Count], (Seconds / LAYOUT_BENCHMARK_PASSES) * 1000.0);
+
+		BenchmarkPrintW(L"  Row:    %10lld x %7d, %5.1f%% sites, whole forest on screen at altitude %lld\n",
+			RowWidth,
+			RowHeight,
+			(SiteArea / ((double)RowWidth * (double)RowHeight)) * 100.0,
+			max((RowWidth + RENDER_BENCHMARK_WIDTH - 1) / RENDER_BENCHMARK_WIDTH, (INT64)((RowHeight + RENDER_BENCHMARK_HEIGHT - 1) / RENDER_BENCHMARK_HEIGHT)));
+
+		BenchmarkPrintW(L"  Packed: %10ld x %7ld, %5.1f%% sites, whole forest on screen at altitude %ld\n",
+			Extent.cx,
+			Extent.cy,
+			(SiteArea / ((double)Extent.cx * (double)Extent.cy)) * 100.0,
+			max((Extent.cx + RENDER_BENCHMARK_WIDTH - 1) / RENDER_BENCHMARK_WIDTH, (Extent.cy + RENDER_BENCHMARK_HEIGHT - 1) / RENDER_BENCHMARK_HEIGHT));
+	}
+
+Exit:
+
+	if (Sites)
+	{
+		HeapFree(GetProcessHeap(), 0, Sites);
+	}
+
+	if (SitePointers)
+	{
+		HeapFree(GetProcessHeap(), 0, SitePointers);
+	}
+
+	return(Result);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+// Benchmarks are run from the command line with -benchmark <name>, or -benchmark all. Results go to the console the
+// app was started from, or a message box if there isn't one.
+
+typedef DWORD(*BENCHMARK_PROC)(void);
+
+typedef struct BENCHMARK
+{
+	wchar_t* Name;
+
+	wchar_t* Description;
+
+	BENCHMARK_PROC Proc;
+
+} BENCHMARK;
+
+DWORD RunBenchmarks(_In_ wchar_t* Name);
+
+void BenchmarkPrintW(_In_ wchar_t* Format, ...);
+
+double BenchmarkSeconds(_In_ LARGE_INTEGER Start, _In_ LARGE_INTEGER End);
+
+DWORD LogBenchmark(void);
+
+ENTITY* CreateSyntheticForest(_In_ DWORD Sites, _In_ DWORD DCsPerSite, _In_ DWORD Domains, _Out_ DWORD* EntityCount);
+
+void FreeSyntheticForest(_In_ ENTITY* Entities);
+
+DWORD ExportBenchmark(void);
+
+DWORD SearchBenchmark(void);
+
+DWORD PickBenchmark(void);
+
+DWORD DiffBenchmark(void);
+
+DWORD ConvergeBenchmark(void);
+
+DWORD KccBenchmark(void);
+
+DWORD RenderBenchmark(void);
+
+DWORD DnBenchmark(void);
+
+DWORD TileBenchmark(void);
+
+DWORD HistoryBenchmark(void);
+
+DWORD TimelineBenchmark(void);
+
+DWORD LabelsBenchmark(void);
+
+DWORD LayoutBenchmark(void);
\ No newline at end of file
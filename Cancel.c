@@ -0,0 +1,423 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Cancellation and deadlines for discovery. See Cancel.h.
+
+#include <Windows.h>
+
+#include <NtDsAPI.h>
+
+#include <DsGetDC.h>
+
+#include <LM.h>
+
+#include "Main.h"
+
+#include "Trace.h"
+
+#include "Cancel.h"
+
+
+
+typedef enum DEADLINE_STATE
+{
+	DLS_PENDING,
+
+	DLS_DONE,		// Finished while the caller was still waiting; the caller frees the record
+
+	DLS_ABANDONED	// The caller stopped waiting; the callback frees the record when the call returns
+
+} DEADLINE_STATE;
+
+typedef struct DEADLINE_RECORD
+{
+	DEADLINE_CALL_PROC Call;
+
+	DEADLINE_RELEASE_PROC Release;
+
+	DWORD Result;
+
+	volatile LONG State;
+
+	HANDLE DoneEvent;
+
+	// The caller's context is copied in here, after the record, since an abandoned call outlives its caller.
+	void* Context;
+
+} DEADLINE_RECORD;
+
+typedef struct DCNAME_CALL
+{
+	wchar_t ComputerName[256];
+
+	ULONG Flags;
+
+	DOMAIN_CONTROLLER_INFOW* Info;
+
+} DCNAME_CALL;
+
+typedef struct BIND_CALL
+{
+	wchar_t DomainController[256];
+
+	HANDLE BindHandle;
+
+} BIND_CALL;
+
+typedef struct TRUSTS_CALL
+{
+	wchar_t ServerName[256];
+
+	ULONG Flags;
+
+	DS_DOMAIN_TRUSTSW* Trusts;
+
+	ULONG TrustCount;
+
+} TRUSTS_CALL;
+
+// DsListSitesW, or DsListServersInSiteW if Site isn't empty.
+typedef struct LIST_CALL
+{
+	HANDLE BindHandle;
+
+	wchar_t Site[256];
+
+	DS_NAME_RESULTW* Names;
+
+} LIST_CALL;
+
+
+
+// Set along with gContinue going FALSE, so anything waiting on a DC can stop waiting.
+static HANDLE gCancelEvent;
+
+
+
+DWORD InitializeCancellation(void)
+{
+	if ((gCancelEvent = CreateEventW(NULL, TRUE, FALSE, NULL)) == NULL)
+	{
+		return(GetLastError());
+	}
+
+	return(ERROR_SUCCESS);
+}
+
+void RequestShutdown(void)
+{
+	gContinue = FALSE;
+
+	if (gCancelEvent)
+	{
+		SetEvent(gCancelEvent);
+	}
+}
+
+// Waits for Handle, unless the deadline passes or the user quits first. ERROR_TIMEOUT or ERROR_CANCELLED if so.
+
+DWORD WaitOrCancel(_In_ HANDLE Handle, _In_ DWORD TimeoutMilliseconds)
+{
+	HANDLE Handles[2] = { Handle, gCancelEvent };
+
+	switch (WaitForMultipleObjects(_countof(Handles), Handles, FALSE, TimeoutMilliseconds))
+	{
+		case WAIT_OBJECT_0:
+		{
+			return(ERROR_SUCCESS);
+		}
+		case WAIT_OBJECT_0 + 1:
+		{
+			return(ERROR_CANCELLED);
+		}
+		case WAIT_TIMEOUT:
+		{
+			return(ERROR_TIMEOUT);
+		}
+		default:
+		{
+			return(GetLastError());
+		}
+	}
+}
+
+static void FreeDeadlineRecord(_In_ DEADLINE_RECORD* Record)
+{
+	if (Record->DoneEvent)
+	{
+		CloseHandle(Record->DoneEvent);
+	}
+
+	HeapFree(GetProcessHeap(), 0, Record);
+}
+
+static void CALLBACK DeadlineCallback(_Inout_ PTP_CALLBACK_INSTANCE Instance, _Inout_opt_ PVOID Context)
+{
+	DEADLINE_RECORD* Record = Context;
+
+	// A DC that isn't answering can hold this thread for minutes.
+
+	CallbackMayRunLong(Instance);
+
+	Record->Result = Record->Call(Record->Context);
+
+	if (InterlockedCompareExchange(&Record->State, DLS_DONE, DLS_PENDING) == DLS_PENDING)
+	{
+		// The caller is still waiting, and owns the record again from here on.
+
+		SetEvent(Record->DoneEvent);
+
+		return;
+	}
+
+	Record->Release(Record->Context);
+
+	FreeDeadlineRecord(Record);
+}
+
+// Makes Call on a thread pool thread and waits for it. If it hasn't returned within TimeoutMilliseconds, or the user
+// quits, returns ERROR_TIMEOUT or ERROR_CANCELLED and zeroes Context, since anything it held now belongs to the call;
+// the call is left to finish by itself, after which Release frees whatever it returned and whatever it was given.
+// Otherwise Context is updated and the call's own result returned.
+
+DWORD CallWithDeadline(_In_ wchar_t* Name, _In_ DEADLINE_CALL_PROC Call, _In_ DEADLINE_RELEASE_PROC Release, _Inout_ void* Context, _In_ DWORD ContextSize, _In_ DWORD TimeoutMilliseconds)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DEADLINE_RECORD* Record = NULL;
+
+	if (gContinue == FALSE)
+	{
+		return(ERROR_CANCELLED);
+	}
+
+	if ((Record = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DEADLINE_RECORD) + ContextSize)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	Record->Call = Call;
+
+	Record->Release = Release;
+
+	Record->State = DLS_PENDING;
+
+	Record->Context = Record + 1;
+
+	memcpy(Record->Context, Context, ContextSize);
+
+	if ((Record->DoneEvent = CreateEventW(NULL, TRUE, FALSE, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	if (TrySubmitThreadpoolCallback(DeadlineCallback, Record, NULL) == FALSE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] TrySubmitThreadpoolCallback failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	if ((Result = WaitOrCancel(Record->DoneEvent, TimeoutMilliseconds)) != ERROR_SUCCESS &&
+		InterlockedCompareExchange(&Record->State, DLS_ABANDONED, DLS_PENDING) == DLS_PENDING)
+	{
+		if (Result == ERROR_TIMEOUT)
+		{
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] %s did not return within %lu ms; giving up on it.", __FUNCTIONW__, Name, TimeoutMilliseconds);
+		}
+
+		memset(Context, 0, ContextSize);
+
+		Record = NULL;
+
+		goto Exit;
+	}
+
+	// Done, even if only just as we were giving up on it. The event is set, or about to be.
+
+	WaitForSingleObject(Record->DoneEvent, INFINITE);
+
+	memcpy(Context, Record->Context, ContextSize);
+
+	Result = Record->Result;
+
+Exit:
+
+	if (Record)
+	{
+		FreeDeadlineRecord(Record);
+	}
+
+	return(Result);
+}
+
+static DWORD DcNameCall(_Inout_ void* Context)
+{
+	DCNAME_CALL* Call = Context;
+
+	return(TRACED("DsGetDcNameW", DsGetDcNameW(Call->ComputerName[0] ? Call->ComputerName : NULL, NULL, NULL, NULL, Call->Flags, &Call->Info)));
+}
+
+static void DcNameRelease(_Inout_ void* Context)
+{
+	DCNAME_CALL* Call = Context;
+
+	if (Call->Info)
+	{
+		NetApiBufferFree(Call->Info);
+	}
+}
+
+// An empty ComputerName means this computer, as NULL does for DsGetDcNameW.
+
+DWORD DeadlineDsGetDcNameW(_In_ wchar_t* ComputerName, _In_ ULONG Flags, _Out_ DOMAIN_CONTROLLER_INFOW** Info, _In_ DWORD TimeoutMilliseconds)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DCNAME_CALL Call = { .Flags = Flags };
+
+	wcscpy_s(Call.ComputerName, _countof(Call.ComputerName), ComputerName);
+
+	Result = CallWithDeadline(L"DsGetDcNameW", DcNameCall, DcNameRelease, &Call, sizeof(Call), TimeoutMilliseconds);
+
+	*Info = Call.Info;
+
+	return(Result);
+}
+
+static DWORD BindCall(_Inout_ void* Context)
+{
+	BIND_CALL* Call = Context;
+
+	return(TRACED("DsBindW", DsBindW(Call->DomainController, NULL, &Call->BindHandle)));
+}
+
+static void BindRelease(_Inout_ void* Context)
+{
+	BIND_CALL* Call = Context;
+
+	if (Call->BindHandle)
+	{
+		DsUnBindW(&Call->BindHandle);
+	}
+}
+
+DWORD DeadlineDsBindW(_In_ wchar_t* DomainController, _Out_ HANDLE* BindHandle, _In_ DWORD TimeoutMilliseconds)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	BIND_CALL Call = { 0 };
+
+	wcscpy_s(Call.DomainController, _countof(Call.DomainController), DomainController);
+
+	Result = CallWithDeadline(L"DsBindW", BindCall, BindRelease, &Call, sizeof(Call), TimeoutMilliseconds);
+
+	*BindHandle = Call.BindHandle;
+
+	return(Result);
+}
+
+static DWORD TrustsCall(_Inout_ void* Context)
+{
+	TRUSTS_CALL* Call = Context;
+
+	return(TRACED("DsEnumerateDomainTrustsW", DsEnumerateDomainTrustsW(Call->ServerName, Call->Flags, &Call->Trusts, &Call->TrustCount)));
+}
+
+static void TrustsRelease(_Inout_ void* Context)
+{
+	TRUSTS_CALL* Call = Context;
+
+	if (Call->Trusts)
+	{
+		NetApiBufferFree(Call->Trusts);
+	}
+}
+
+DWORD DeadlineDsEnumerateDomainTrustsW(_In_ wchar_t* ServerName, _In_ ULONG Flags, _Out_ DS_DOMAIN_TRUSTSW** Trusts, _Out_ ULONG* TrustCount, _In_ DWORD TimeoutMilliseconds)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	TRUSTS_CALL Call = { .Flags = Flags };
+
+	wcscpy_s(Call.ServerName, _countof(Call.ServerName), ServerName);
+
+	Result = CallWithDeadline(L"DsEnumerateDomainTrustsW", TrustsCall, TrustsRelease, &Call, sizeof(Call), TimeoutMilliseconds);
+
+	*Trusts = Call.Trusts;
+
+	*TrustCount = Call.TrustCount;
+
+	return(Result);
+}
+
+static DWORD ListCall(_Inout_ void* Context)
+{
+	LIST_CALL* Call = Context;
+
+	DWORD Result = ERROR_SUCCESS;
+
+	if (Call->Site[0] == L'\0')
+	{
+		Result = TRACED("DsListSitesW", DsListSitesW(Call->BindHandle, &Call->Names));
+	}
+	else
+	{
+		Result = TRACED("DsListServersInSiteW", DsListServersInSiteW(Call->BindHandle, Call->Site, &Call->Names));
+	}
+
+	return(Result);
+}
+
+// The bind handle was still in use when the caller gave up on the call, so it's unbound here instead.
+
+static void ListRelease(_Inout_ void* Context)
+{
+	LIST_CALL* Call = Context;
+
+	if (Call->Names)
+	{
+		DsFreeNameResultW(Call->Names);
+	}
+
+	DsUnBindW(&Call->BindHandle);
+}
+
+// If the call is abandoned, *BindHandle is still in use by it, so it's handed over to be unbound when the call
+// returns, and set to NULL.
+
+static DWORD DeadlineList(_Inout_ HANDLE* BindHandle, _In_opt_ wchar_t* Site, _Out_ DS_NAME_RESULTW** Names, _In_ DWORD TimeoutMilliseconds)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	LIST_CALL Call = { .BindHandle = *BindHandle };
+
+	if (Site)
+	{
+		wcscpy_s(Call.Site, _countof(Call.Site), Site);
+	}
+
+	Result = CallWithDeadline(Site ? L"DsListServersInSiteW" : L"DsListSitesW", ListCall, ListRelease, &Call, sizeof(Call), TimeoutMilliseconds);
+
+	*BindHandle = Call.BindHandle;
+
+	*Names = Call.Names;
+
+	return(Result);
+}
+
+DWORD DeadlineDsListSitesW(_Inout_ HANDLE* BindHandle, _Out_ DS_NAME_RESULTW** Sites, _In_ DWORD TimeoutMilliseconds)
+{
+	return(DeadlineList(BindHandle, NULL, Sites, TimeoutMilliseconds));
+}
+
+DWORD DeadlineDsListServersInSiteW(_Inout_ HANDLE* BindHandle, _In_ wchar_t* Site, _Out_ DS_NAME_RESULTW** Servers, _In_ DWORD TimeoutMilliseconds)
+{
+	return(DeadlineList(BindHandle, Site, Servers, TimeoutMilliseconds));
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// Cancellation and deadlines for discovery. DsGetDcNameW and the NtDsAPI calls take no timeout, so a DC that accepts
+// a connection and then stops answering can hold the calling thread for as long as it likes. Each of those calls is
+// made on a thread pool thread instead, while the caller waits for it to finish, for its deadline to pass, or for the
+// user to quit, whichever comes first. A call that is given up on carries on by itself, and frees whatever it gets
+// back, bind handle included, when it does eventually return.
+
+// How long one remote call may take before discovery gives up on it, unless DiscoveryCallTimeoutMs says otherwise.
+#define DISCOVERY_DEF_CALL_TIMEOUT_MS		30000
+
+// How long the UI thread waits, when quitting, for the discovery thread to notice.
+#define DISCOVERY_SHUTDOWN_TIMEOUT_MS		2000
+
+// Makes the call. Whatever it returns goes in Context.
+typedef DWORD(*DEADLINE_CALL_PROC)(_Inout_ void* Context);
+
+// Frees whatever a call put in Context, for a call whose caller stopped waiting for it. Called whether the call
+// succeeded or not, so it has to cope with outputs that were never filled in.
+typedef void(*DEADLINE_RELEASE_PROC)(_Inout_ void* Context);
+
+DWORD InitializeCancellation(void);
+
+void RequestShutdown(void);
+
+DWORD WaitOrCancel(_In_ HANDLE Handle, _In_ DWORD TimeoutMilliseconds);
+
+DWORD CallWithDeadline(_In_ wchar_t* Name, _In_ DEADLINE_CALL_PROC Call, _In_ DEADLINE_RELEASE_PROC Release, _Inout_ void* Context, _In_ DWORD ContextSize, _In_ DWORD TimeoutMilliseconds);
+
+DWORD DeadlineDsGetDcNameW(_In_ wchar_t* ComputerName, _In_ ULONG Flags, _Out_ DOMAIN_CONTROLLER_INFOW** Info, _In_ DWORD TimeoutMilliseconds);
+
+DWORD DeadlineDsBindW(_In_ wchar_t* DomainController, _Out_ HANDLE* BindHandle, _In_ DWORD TimeoutMilliseconds);
+
+DWORD DeadlineDsEnumerateDomainTrustsW(_In_ wchar_t* ServerName, _In_ ULONG Flags, _Out_ DS_DOMAIN_TRUSTSW** Trusts, _Out_ ULONG* TrustCount, _In_ DWORD TimeoutMilliseconds);
+
+DWORD DeadlineDsListSitesW(_Inout_ HANDLE* BindHandle, _Out_ DS_NAME_RESULTW** Sites, _In_ DWORD TimeoutMilliseconds);
+
+DWORD DeadlineDsListServersInSiteW(_Inout_ HANDLE* BindHandle, _In_ wchar_t* Site, _Out_ DS_NAME_RESULTW** Servers, _In_ DWORD TimeoutMilliseconds);
@@ -0,0 +1,658 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Replication convergence simulation. See Convergence.h.
+
+#include <Windows.h>
+
+#include "Main.h"
+
+#include "Log.h"
+
+#include "Trace.h"
+
+#include "SiteGraph.h"
+
+#include "Convergence.h"
+
+// What a connection follows when no site link contains both of its sites.
+static const SITELINK gDefaultLink = {
+	.Cost = SITEGRAPH_DEF_COST,
+	.IntervalMinutes = SITEGRAPH_DEF_INTERVAL_MINUTES,
+	.Schedule = { MAXULONGLONG, MAXULONGLONG, (1ULL << (SITEGRAPH_HOURS_PER_WEEK - 128)) - 1 } };
+
+typedef struct CONVERGENCE_JOB
+{
+	CONVERGENCE_GRAPH* Graph;
+
+	DWORD StartWeekSecond;
+
+	CONVERGENCE_RESULT* Result;
+
+	volatile LONG NextSource;
+
+	volatile LONG Unreachable;
+
+	volatile LONG Failed;
+
+	volatile LONG Outstanding;
+
+	HANDLE DoneEvent;
+
+} CONVERGENCE_JOB;
+
+typedef struct CONVERGENCE_REQUEST
+{
+	CONVERGENCE_GRAPH* Graph;
+
+	DWORD Source;
+
+	DWORD StartWeekSecond;
+
+	HWND Window;
+
+} CONVERGENCE_REQUEST;
+
+
+
+CONVERGENCE_GRAPH* BuildConvergenceGraph(_In_ SITEGRAPH* SiteGraph)
+{
+	CONVERGENCE_GRAPH* Graph = NULL;
+
+	DWORD* Cursor = NULL;
+
+	if ((Graph = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CONVERGENCE_GRAPH))) == NULL)
+	{
+		return(NULL);
+	}
+
+	Graph->References = 1;
+
+	Graph->SiteCount = SiteGraph->SiteCount;
+
+	Graph->UsesConnections = (SiteGraph->ConnectionCount > 0);
+
+	Graph->NodeCount = SiteGraph->SiteCount + (Graph->UsesConnections ? 0 : SiteGraph->LinkCount);
+
+	Graph->EdgeCount = Graph->UsesConnections ? SiteGraph->ConnectionCount : 2 * SiteGraph->LinkSiteCount;
+
+	Graph->LinkCount = SiteGraph->LinkCount;
+
+	if ((Graph->EdgeFirst = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ((SIZE_T)Graph->NodeCount + 1) * sizeof(DWORD))) == NULL ||
+		(Graph->Edges = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Graph->EdgeCount, 1) * sizeof(CONVERGENCE_EDGE))) == NULL ||
+		(Graph->IntraSiteSeconds = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Graph->SiteCount, 1) * sizeof(DWORD))) == NULL ||
+		(Graph->Links = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Graph->LinkCount, 1) * sizeof(SITELINK))) == NULL ||
+		(Cursor = HeapAlloc(GetProcessHeap(), 0, ((SIZE_T)Graph->NodeCount + 1) * sizeof(DWORD))) == NULL)
+	{
+		FreeConvergenceGraph(Graph);
+
+		return(NULL);
+	}
+
+	if (Graph->LinkCount > 0)
+	{
+		memcpy(Graph->Links, SiteGraph->Links, Graph->LinkCount * sizeof(SITELINK));
+	}
+
+	// Count every node's edges, turn the counts into offsets, then drop each edge into place.
+
+	for (int Pass = 0; Pass < 2; Pass++)
+	{
+		if (Pass == 1)
+		{
+			for (DWORD Node = 0; Node < Graph->NodeCount; Node++)
+			{
+				Graph->EdgeFirst[Node + 1] += Graph->EdgeFirst[Node];
+
+				Cursor[Node] = Graph->EdgeFirst[Node];
+			}
+		}
+
+		if (Graph->UsesConnections)
+		{
+			for (DWORD Index = 0; Index < SiteGraph->ConnectionCount; Index++)
+			{
+				SITECONNECTION* Connection = &SiteGraph->Connections[Index];
+
+				if (Pass == 0)
+				{
+					Graph->EdgeFirst[Connection->FromSite + 1]++;
+				}
+				else
+				{
+					Graph->Edges[Cursor[Connection->FromSite]++] = (CONVERGENCE_EDGE){ .To = Connection->ToSite, .Link = Connection->Link };
+				}
+			}
+
+			continue;
+		}
+
+		for (DWORD Link = 0; Link < SiteGraph->LinkCount; Link++)
+		{
+			DWORD Hub = Graph->SiteCount + Link;
+
+			for (DWORD Index = 0; Index < SiteGraph->Links[Link].SiteCount; Index++)
+			{
+				DWORD Site = SiteGraph->LinkSites[SiteGraph->Links[Link].FirstSite + Index];
+
+				if (Pass == 0)
+				{
+					Graph->EdgeFirst[Site + 1]++;
+
+					Graph->EdgeFirst[Hub + 1]++;
+				}
+				else
+				{
+					Graph->Edges[Cursor[Site]++] = (CONVERGENCE_EDGE){ .To = Hub, .Link = Link };
+
+					Graph->Edges[Cursor[Hub]++] = (CONVERGENCE_EDGE){ .To = Site, .Link = CONVERGENCE_IMMEDIATE };
+				}
+			}
+		}
+	}
+
+	HeapFree(GetProcessHeap(), 0, Cursor);
+
+	for (DWORD Site = 0; Site < Graph->SiteCount; Site++)
+	{
+		DWORD DCs = SiteGraph->Sites[Site]->DCsInSite;
+
+		Graph->IntraSiteSeconds[Site] = (DCs <= 1) ? 0 :
+			CONVERGENCE_INTRASITE_FIRST_SECONDS + (CONVERGENCE_INTRASITE_NEXT_SECONDS * ((DCs / 2) - 1));
+	}
+
+	return(Graph);
+}
+
+void FreeConvergenceGraph(_In_opt_ CONVERGENCE_GRAPH* Graph)
+{
+	if (Graph == NULL || InterlockedDecrement(&Graph->References) > 0)
+	{
+		return;
+	}
+
+	void* Arrays[] = { Graph->EdgeFirst, Graph->Edges, Graph->IntraSiteSeconds, Graph->Links };
+
+	for (int Index = 0; Index < _countof(Arrays); Index++)
+	{
+		if (Arrays[Index])
+		{
+			HeapFree(GetProcessHeap(), 0, Arrays[Index]);
+		}
+	}
+
+	HeapFree(GetProcessHeap(), 0, Graph);
+}
+
+void FreeConvergenceResult(_In_opt_ CONVERGENCE_RESULT* Result)
+{
+	if (Result)
+	{
+		HeapFree(GetProcessHeap(), 0, Result);
+	}
+}
+
+DWORD CurrentWeekSecond(void)
+{
+	SYSTEMTIME Now = { 0 };
+
+	GetSystemTime(&Now);
+
+	return((Now.wDayOfWeek * 86400) + (Now.wHour * 3600) + (Now.wMinute * 60) + Now.wSecond);
+}
+
+// The first time at or after Time, in seconds since the start of the week (and possibly past the end of it), at which
+// a destination site pulls over Link. MAXULONGLONG if the link is never open.
+
+static UINT64 NextPoll(_In_ const SITELINK* Link, _In_ UINT64 Time)
+{
+	UINT64 Interval = (UINT64)Link->IntervalMinutes * 60;
+
+	if (Link->Schedule[0] == MAXULONGLONG && Link->Schedule[1] == MAXULONGLONG && Link->Schedule[2] == gDefaultLink.Schedule[2])
+	{
+		return(((Time + Interval - 1) / Interval) * Interval);
+	}
+
+	// Two weeks is enough to get from anywhere to the next open hour, if there is one.
+
+	for (DWORD Step = 0; Step <= 2 * SITEGRAPH_HOURS_PER_WEEK; Step++)
+	{
+		UINT64 Hour = Time / 3600;
+
+		UINT64 HourEnd = (Hour + 1) * 3600;
+
+		if (SiteLinkIsOpen((SITELINK*)Link, Hour))
+		{
+			UINT64 Poll = 0;
+
+			// Replication starts as soon as a closed schedule opens.
+
+			if (Time == Hour * 3600 && !SiteLinkIsOpen((SITELINK*)Link, Hour + SITEGRAPH_HOURS_PER_WEEK - 1))
+			{
+				return(Time);
+			}
+
+			if ((Poll = ((Time + Interval - 1) / Interval) * Interval) < HourEnd)
+			{
+				return(Poll);
+			}
+		}
+
+		Time = HourEnd;
+	}
+
+	return(MAXULONGLONG);
+}
+
+// Dijkstra's algorithm with a lazy binary min-heap of (time << 32 | node). Arrival gets the second each node first
+// has the change, relative to the start. Heap needs room for EdgeCount + 1 entries: every push is a relaxed edge.
+
+static void ConvergenceFromSource(_In_ CONVERGENCE_GRAPH* Graph, _In_ DWORD Source, _In_ DWORD StartWeekSecond, _Out_ DWORD* Arrival, _Inout_ UINT64* Heap)
+{
+	DWORD HeapCount = 0;
+
+	for (DWORD Node = 0; Node < Graph->NodeCount; Node++)
+	{
+		Arrival[Node] = CONVERGENCE_UNREACHABLE;
+	}
+
+	Arrival[Source] = 0;
+
+	Heap[HeapCount++] = Source;
+
+	while (HeapCount > 0)
+	{
+		UINT64 Top = Heap[0];
+
+		DWORD Node = (DWORD)Top;
+
+		DWORD Time = (DWORD)(Top >> 32);
+
+		DWORD Departure = Time;
+
+		// Sift the last entry down from the root.
+
+		UINT64 Last = Heap[--HeapCount];
+
+		DWORD Hole = 0;
+
+		while (TRUE)
+		{
+			DWORD Child = (2 * Hole) + 1;
+
+			if (Child >= HeapCount)
+			{
+				break;
+			}
+
+			if (Child + 1 < HeapCount && Heap[Child + 1] < Heap[Child])
+			{
+				Child++;
+			}
+
+			if (Heap[Child] >= Last)
+			{
+				break;
+			}
+
+			Heap[Hole] = Heap[Child];
+
+			Hole = Child;
+		}
+
+		if (HeapCount > 0)
+		{
+			Heap[Hole] = Last;
+		}
+
+		if (Time > Arrival[Node])
+		{
+			continue;
+		}
+
+		// The DC the change was made on has to notify its site's bridgehead before the change can leave.
+
+		if (Node == Source)
+		{
+			Departure += min(Graph->IntraSiteSeconds[Source], CONVERGENCE_INTRASITE_FIRST_SECONDS);
+		}
+
+		for (DWORD Index = Graph->EdgeFirst[Node]; Index < Graph->EdgeFirst[Node + 1]; Index++)
+		{
+			CONVERGENCE_EDGE* Edge = &Graph->Edges[Index];
+
+			UINT64 Candidate = Departure;
+
+			if (Edge->Link != CONVERGENCE_IMMEDIATE)
+			{
+				UINT64 Poll = NextPoll((Edge->Link == MAXDWORD) ? &gDefaultLink : &Graph->Links[Edge->Link], (UINT64)StartWeekSecond + Departure);
+
+				if (Poll == MAXULONGLONG)
+				{
+					continue;
+				}
+
+				Candidate = Poll - StartWeekSecond + CONVERGENCE_TRANSFER_SECONDS;
+			}
+
+			if (Candidate >= Arrival[Edge->To])
+			{
+				continue;
+			}
+
+			Arrival[Edge->To] = (DWORD)Candidate;
+
+			// Sift up.
+
+			UINT64 Entry = (Candidate << 32) | Edge->To;
+
+			DWORD Position = HeapCount++;
+
+			while (Position > 0 && Heap[(Position - 1) / 2] > Entry)
+			{
+				Heap[Position] = Heap[(Position - 1) / 2];
+
+				Position = (Position - 1) / 2;
+			}
+
+			Heap[Position] = Entry;
+		}
+	}
+
+	// Arriving at a site's bridgehead isn't the same as every DC in it having the change.
+
+	for (DWORD Site = 0; Site < Graph->SiteCount; Site++)
+	{
+		if (Arrival[Site] != CONVERGENCE_UNREACHABLE)
+		{
+			Arrival[Site] += Graph->IntraSiteSeconds[Site];
+		}
+	}
+}
+
+// Pulls sources off the job until there are none left, recording each one's worst site.
+
+static void ConvergenceWorker(_Inout_ CONVERGENCE_JOB* Job)
+{
+	CONVERGENCE_GRAPH* Graph = Job->Graph;
+
+	DWORD* Arrival = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Graph->NodeCount, 1) * sizeof(DWORD));
+
+	UINT64* Heap = HeapAlloc(GetProcessHeap(), 0, ((SIZE_T)Graph->EdgeCount + 1) * sizeof(UINT64));
+
+	LONG Source = 0;
+
+	if (Arrival == NULL || Heap == NULL)
+	{
+		InterlockedExchange(&Job->Failed, TRUE);
+
+		goto Exit;
+	}
+
+	while (gContinue && (Source = InterlockedIncrement(&Job->NextSource) - 1) < (LONG)Graph->SiteCount)
+	{
+		DWORD Worst = 0;
+
+		BOOL Unreachable = FALSE;
+
+		ConvergenceFromSource(Graph, (DWORD)Source, Job->StartWeekSecond, Arrival, Heap);
+
+		for (DWORD Site = 0; Site < Graph->SiteCount; Site++)
+		{
+			if (Arrival[Site] == CONVERGENCE_UNREACHABLE)
+			{
+				Unreachable = TRUE;
+			}
+			else
+			{
+				Worst = max(Worst, Arrival[Site]);
+			}
+		}
+
+		Job->Result->Seconds[Source] = Worst;
+
+		if (Unreachable)
+		{
+			InterlockedIncrement(&Job->Unreachable);
+		}
+	}
+
+Exit:
+
+	if (Arrival)
+	{
+		HeapFree(GetProcessHeap(), 0, Arrival);
+	}
+
+	if (Heap)
+	{
+		HeapFree(GetProcessHeap(), 0, Heap);
+	}
+}
+
+static void CALLBACK ConvergenceWorkerCallback(_Inout_ PTP_CALLBACK_INSTANCE Instance, _Inout_opt_ PVOID Context)
+{
+	UNREFERENCED_PARAMETER(Instance);
+
+	CONVERGENCE_JOB* Job = Context;
+
+	ConvergenceWorker(Job);
+
+	if (InterlockedDecrement(&Job->Outstanding) == 0)
+	{
+		SetEvent(Job->DoneEvent);
+	}
+}
+
+// Simulates a change made in Source at StartWeekSecond. With CONVERGENCE_ALL_SITES, simulates one from every site,
+// spread over the thread pool with the calling thread pitching in.
+
+DWORD ComputeConvergence(_In_ CONVERGENCE_GRAPH* Graph, _In_ DWORD Source, _In_ DWORD StartWeekSecond, _Out_ CONVERGENCE_RESULT** Result)
+{
+	DWORD Status = ERROR_SUCCESS;
+
+	CONVERGENCE_RESULT* New = NULL;
+
+	UINT64 Start = GetTickCount64();
+
+	*Result = NULL;
+
+	if (Source != CONVERGENCE_ALL_SITES && Source >= Graph->SiteCount)
+	{
+		return(ERROR_INVALID_PARAMETER);
+	}
+
+	TRACE_BEGIN("ComputeConvergence");
+
+	if ((New = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(CONVERGENCE_RESULT) + ((SIZE_T)max(Graph->SiteCount, 1) * sizeof(DWORD)))) == NULL)
+	{
+		Status = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	New->Source = Source;
+
+	New->StartWeekSecond = StartWeekSecond;
+
+	New->SiteCount = Graph->SiteCount;
+
+	New->Seconds = (DWORD*)(New + 1);
+
+	if (Source != CONVERGENCE_ALL_SITES)
+	{
+		DWORD* Arrival = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)Graph->NodeCount * sizeof(DWORD));
+
+		UINT64* Heap = HeapAlloc(GetProcessHeap(), 0, ((SIZE_T)Graph->EdgeCount + 1) * sizeof(UINT64));
+
+		if (Arrival && Heap)
+		{
+			ConvergenceFromSource(Graph, Source, StartWeekSecond, Arrival, Heap);
+
+			memcpy(New->Seconds, Arrival, Graph->SiteCount * sizeof(DWORD));
+		}
+		else
+		{
+			Status = ERROR_NOT_ENOUGH_MEMORY;
+		}
+
+		if (Arrival)
+		{
+			HeapFree(GetProcessHeap(), 0, Arrival);
+		}
+
+		if (Heap)
+		{
+			HeapFree(GetProcessHeap(), 0, Heap);
+		}
+	}
+	else
+	{
+		CONVERGENCE_JOB Job = { .Graph = Graph, .StartWeekSecond = StartWeekSecond, .Result = New };
+
+		SYSTEM_INFO SystemInfo = { 0 };
+
+		DWORD Workers = 0;
+
+		GetSystemInfo(&SystemInfo);
+
+		Workers = min(min(SystemInfo.dwNumberOfProcessors, CONVERGENCE_MAX_WORKERS), max(Graph->SiteCount, 1)) - 1;
+
+		if ((Job.DoneEvent = CreateEventW(NULL, TRUE, FALSE, NULL)) == NULL)
+		{
+			Status = GetLastError();
+
+			goto Exit;
+		}
+
+		// The calling thread counts as one of the workers.
+
+		Job.Outstanding = (LONG)Workers + 1;
+
+		for (DWORD Worker = 0; Worker < Workers; Worker++)
+		{
+			if (TrySubmitThreadpoolCallback(ConvergenceWorkerCallback, &Job, NULL) == FALSE)
+			{
+				InterlockedDecrement(&Job.Outstanding);
+			}
+		}
+
+		ConvergenceWorker(&Job);
+
+		if (InterlockedDecrement(&Job.Outstanding) > 0)
+		{
+			WaitForSingleObject(Job.DoneEvent, INFINITE);
+		}
+
+		CloseHandle(Job.DoneEvent);
+
+		New->Unreachable = (DWORD)Job.Unreachable;
+
+		if (Job.Failed)
+		{
+			Status = ERROR_NOT_ENOUGH_MEMORY;
+		}
+		else if (gContinue == FALSE)
+		{
+			Status = ERROR_CANCELLED;
+		}
+	}
+
+	if (Status != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	New->MinSeconds = CONVERGENCE_UNREACHABLE;
+
+	for (DWORD Site = 0; Site < New->SiteCount; Site++)
+	{
+		if (New->Seconds[Site] == CONVERGENCE_UNREACHABLE)
+		{
+			New->Unreachable += (Source != CONVERGENCE_ALL_SITES);
+
+			continue;
+		}
+
+		New->MinSeconds = min(New->MinSeconds, New->Seconds[Site]);
+
+		New->MaxSeconds = max(New->MaxSeconds, New->Seconds[Site]);
+	}
+
+	New->MinSeconds = (New->MinSeconds == CONVERGENCE_UNREACHABLE) ? 0 : New->MinSeconds;
+
+	New->ElapsedMilliseconds = GetTickCount64() - Start;
+
+	*Result = New;
+
+	New = NULL;
+
+Exit:
+
+	TRACE_END();
+
+	FreeConvergenceResult(New);
+
+	return(Status);
+}
+
+static void CALLBACK ConvergenceRequestCallback(_Inout_ PTP_CALLBACK_INSTANCE Instance, _Inout_opt_ PVOID Context)
+{
+	UNREFERENCED_PARAMETER(Instance);
+
+	CONVERGENCE_REQUEST* Request = Context;
+
+	CONVERGENCE_RESULT* Result = NULL;
+
+	DWORD Status = ComputeConvergence(Request->Graph, Request->Source, Request->StartWeekSecond, &Result);
+
+	if (Status != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] ComputeConvergence failed with 0x%08lx!", __FUNCTIONW__, Status);
+	}
+	else
+	{
+		LogEventW(LL_INFO, LF_FILE, L"[%s] Simulated convergence over %lu sites in %llu ms.", __FUNCTIONW__, Result->SiteCount, Result->ElapsedMilliseconds);
+	}
+
+	// The window gets a NULL result on failure, so it knows the simulation is over either way.
+
+	if (PostMessageW(Request->Window, CONVERGENCE_DONE_MESSAGE, 0, (LPARAM)Result) == FALSE)
+	{
+		FreeConvergenceResult(Result);
+	}
+
+	FreeConvergenceGraph(Request->Graph);
+
+	HeapFree(GetProcessHeap(), 0, Request);
+}
+
+// Runs ComputeConvergence on the thread pool and posts the result to Window. Holds its own reference to Graph, so the
+// caller can let go of it at any time.
+
+DWORD StartConvergence(_In_ CONVERGENCE_GRAPH* Graph, _In_ DWORD Source, _In_ DWORD StartWeekSecond, _In_ HWND Window)
+{
+	CONVERGENCE_REQUEST* Request = NULL;
+
+	if ((Request = HeapAlloc(GetProcessHeap(), 0, sizeof(CONVERGENCE_REQUEST))) == NULL)
+	{
+		return(ERROR_NOT_ENOUGH_MEMORY);
+	}
+
+	*Request = (CONVERGENCE_REQUEST){ .Graph = Graph, .Source = Source, .StartWeekSecond = StartWeekSecond, .Window = Window };
+
+	InterlockedIncrement(&Graph->References);
+
+	if (TrySubmitThreadpoolCallback(ConvergenceRequestCallback, Request, NULL) == FALSE)
+	{
+		DWORD Result = GetLastError();
+
+		FreeConvergenceGraph(Graph);
+
+		HeapFree(GetProcessHeap(), 0, Request);
+
+		return(Result);
+	}
+
+	return(ERROR_SUCCESS);
+}
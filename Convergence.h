@@ -0,0 +1,112 @@
+#pragma once
+
+// Replication convergence simulation. Given a change written at a DC in one site, how long until every DC in every
+// other site has it? Inside a site, change notification passes it on within seconds. Between sites, the destination
+// bridgehead pulls on the site link's replication interval, and only while the link's schedule is open. The sites and
+// the site links joining them become a graph whose edge weights depend on the time of day, and Dijkstra's algorithm
+// with those weights gives the earliest time each site can have the change.
+//
+// Approximations, so that the numbers are read as estimates:
+// - Polls on a link happen on multiples of its interval since the start of the week, plus once as a closed schedule
+//   opens. Real DCs drift from that.
+// - Inside a site the DCs form a ring. The first partner is notified after INTRASITE_FIRST_SECONDS and every one
+//   after that INTRASITE_NEXT_SECONDS later, and the farthest DC is half way round.
+// - Every inter-site hop then takes TRANSFER_SECONDS to actually move the change.
+// - If the KCC's inter-site connection objects were read, changes only flow along them. Otherwise any two sites in a
+//   site link are assumed to replicate with each other directly.
+
+#define CONVERGENCE_TRANSFER_SECONDS			30
+
+#define CONVERGENCE_INTRASITE_FIRST_SECONDS		15
+
+#define CONVERGENCE_INTRASITE_NEXT_SECONDS		3
+
+#define CONVERGENCE_UNREACHABLE					MAXDWORD
+
+// Source of a CONVERGENCE_RESULT that simulates from every site, rather than from one.
+#define CONVERGENCE_ALL_SITES					MAXDWORD
+
+#define CONVERGENCE_MAX_WORKERS					64
+
+// Posted to the window that asked for a simulation, with the CONVERGENCE_RESULT* as the LPARAM. The window owns it.
+#define CONVERGENCE_DONE_MESSAGE				(WM_APP + 1)
+
+// The edge's Link for a hub-to-site edge, which costs nothing; the wait was on the way into the hub.
+#define CONVERGENCE_IMMEDIATE					(MAXDWORD - 1)
+
+typedef struct CONVERGENCE_EDGE
+{
+	DWORD To;
+
+	// Index into the graph's Links, CONVERGENCE_IMMEDIATE, or MAXDWORD for a connection that isn't in any site link
+	// and so replicates on the default interval around the clock.
+	DWORD Link;
+
+} CONVERGENCE_EDGE;
+
+// An immutable, reference counted snapshot of a SITEGRAPH, cheap to walk from many threads at once.
+typedef struct CONVERGENCE_GRAPH
+{
+	volatile LONG References;
+
+	DWORD SiteCount;
+
+	// Sites come first. Without connection objects, each site link gets a hub node after them, so a link joining N
+	// sites costs 2N edges instead of N squared.
+	DWORD NodeCount;
+
+	// Node N's edges are Edges[EdgeFirst[N]] up to Edges[EdgeFirst[N + 1]].
+	DWORD* EdgeFirst;
+
+	CONVERGENCE_EDGE* Edges;
+
+	DWORD EdgeCount;
+
+	// How long a site takes to pass a change around all of its own DCs.
+	DWORD* IntraSiteSeconds;
+
+	DWORD LinkCount;
+
+	SITELINK* Links;
+
+	BOOL UsesConnections;
+
+} CONVERGENCE_GRAPH;
+
+typedef struct CONVERGENCE_RESULT
+{
+	// A site index, or CONVERGENCE_ALL_SITES.
+	DWORD Source;
+
+	// Seconds since Sunday midnight UTC at which the change was made.
+	DWORD StartWeekSecond;
+
+	DWORD SiteCount;
+
+	// Per site. From one source: seconds until every DC in the site has the change. For CONVERGENCE_ALL_SITES: seconds
+	// until a change made in the site has reached every site it can reach. CONVERGENCE_UNREACHABLE if never.
+	DWORD* Seconds;
+
+	DWORD MinSeconds;
+
+	DWORD MaxSeconds;
+
+	// From one source, sites the change never reaches. For CONVERGENCE_ALL_SITES, sites whose changes don't reach all
+	// the others.
+	DWORD Unreachable;
+
+	UINT64 ElapsedMilliseconds;
+
+} CONVERGENCE_RESULT;
+
+CONVERGENCE_GRAPH* BuildConvergenceGraph(_In_ SITEGRAPH* Graph);
+
+void FreeConvergenceGraph(_In_opt_ CONVERGENCE_GRAPH* Graph);
+
+DWORD ComputeConvergence(_In_ CONVERGENCE_GRAPH* Graph, _In_ DWORD Source, _In_ DWORD StartWeekSecond, _Out_ CONVERGENCE_RESULT** Result);
+
+DWORD StartConvergence(_In_ CONVERGENCE_GRAPH* Graph, _In_ DWORD Source, _In_ DWORD StartWeekSecond, _In_ HWND Window);
+
+void FreeConvergenceResult(_In_opt_ CONVERGENCE_RESULT* Result);
+
+DWORD CurrentWeekSecond(void);
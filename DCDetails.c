@@ -0,0 +1,734 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Lazily fetched per-DC details. The renderer asks for the details of every DC it culls in, or nearly in, and a few
+// worker threads fetch them over LDAP, so what the user is looking at fills in first and the rest of a big forest
+// is never asked about at all.
+//
+// Requests sit on two stacks, one for DCs on screen and one for DCs just off it. Workers always empty the on-screen
+// stack first, and take the newest request from either, since that's where the camera is now. A DC close to the
+// screen that then comes onto it is pushed again onto the on-screen stack; whichever of its two requests is popped
+// second finds the DC no longer waiting and is skipped. A request that has waited too long for a DC that has gone
+// out of view is dropped, so panning across a forest doesn't leave a backlog of DCs nobody is looking at.
+
+#include <Windows.h>
+
+#include <Winldap.h>
+
+#include <stdlib.h>
+
+#include "Main.h"
+
+#include "Trace.h"
+
+#include "DistinguishedName.h"
+
+#include "DCDetails.h"
+
+#pragma comment(lib, "Wldap32.lib")
+
+typedef struct DCDETAILS_REQUEST
+{
+	ENTITY* DC;
+
+	// TotalFramesRendered when the DC was asked for.
+	UINT64 Frame;
+
+} DCDETAILS_REQUEST;
+
+typedef struct DCDETAILS_STACK
+{
+	DWORD Count;
+
+	DWORD Capacity;
+
+	DCDETAILS_REQUEST* Requests;
+
+} DCDETAILS_STACK;
+
+// Each worker keeps its connections open between DCs. The global catalog has the computer objects of every domain.
+typedef struct DCDETAILS_CONNECTION
+{
+	LDAP* Directory;
+
+	LDAP* GlobalCatalog;
+
+} DCDETAILS_CONNECTION;
+
+
+
+static wchar_t gDetailsServer[256];
+
+static DCDETAILS* gDetails;
+
+static CRITICAL_SECTION gDetailsLock;
+
+static DCDETAILS_STACK gDetailsVisible;
+
+static DCDETAILS_STACK gDetailsNearby;
+
+// Released once for every request pushed.
+static HANDLE gDetailsWorkAvailable;
+
+static HANDLE gDetailsStopEvent;
+
+static HANDLE gDetailsThreads[DCDETAILS_WORKERS];
+
+static DWORD gDetailsThreadCount;
+
+static volatile LONG gDetailsReady;
+
+static volatile LONG gDetailsWaiting;
+
+
+
+// Other threads read DC strings such as the fqdn without a lock, and take an empty one to mean not known yet.
+// Writing every character but the first, then the first, means they only ever see nothing or all of it.
+
+static void DetailsPublishString(_Inout_ wchar_t* Destination, _In_ size_t Count, _In_ wchar_t* Source)
+{
+	size_t Length = wcslen(Source);
+
+	if (Destination[0] != L'\0' || Length == 0 || Length >= Count)
+	{
+		return;
+	}
+
+	Destination[Length] = L'\0';
+
+	wmemcpy(Destination + 1, Source + 1, Length - 1);
+
+	MemoryBarrier();
+
+	*(volatile wchar_t*)Destination = Source[0];
+}
+
+static BOOL DetailsHasObjectClass(_In_opt_ wchar_t** Classes, _In_ wchar_t* Class)
+{
+	for (ULONG Index = 0; Classes != NULL && Classes[Index] != NULL; Index++)
+	{
+		if (_wcsicmp(Classes[Index], Class) == 0)
+		{
+			return(TRUE);
+		}
+	}
+
+	return(FALSE);
+}
+
+static DWORD DetailsConnect(_In_ wchar_t* Server, _In_ ULONG Port, _Out_ LDAP** Ldap)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	ULONG Version = LDAP_VERSION3;
+
+	ULONG TimeLimit = DCDETAILS_LDAP_TIMEOUT_SECONDS;
+
+	LDAP_TIMEVAL Timeout = { .tv_sec = DCDETAILS_LDAP_TIMEOUT_SECONDS };
+
+	if ((*Ldap = ldap_initW(Server, Port)) == NULL)
+	{
+		return(LdapMapErrorToWin32(LdapGetLastError()));
+	}
+
+	ldap_set_optionW(*Ldap, LDAP_OPT_PROTOCOL_VERSION, &Version);
+
+	ldap_set_optionW(*Ldap, LDAP_OPT_REFERRALS, LDAP_OPT_OFF);
+
+	ldap_set_optionW(*Ldap, LDAP_OPT_TIMELIMIT, &TimeLimit);
+
+	if ((Result = LdapMapErrorToWin32(ldap_connect(*Ldap, &Timeout))) != ERROR_SUCCESS ||
+		(Result = LdapMapErrorToWin32(TRACED("ldap_bind_sW", ldap_bind_sW(*Ldap, NULL, NULL, LDAP_AUTH_NEGOTIATE)))) != ERROR_SUCCESS)
+	{
+		ldap_unbind(*Ldap);
+
+		*Ldap = NULL;
+	}
+
+	return(Result);
+}
+
+static BOOL DetailsConnectionLost(_In_ ULONG LdapResult)
+{
+	return(LdapResult == LDAP_SERVER_DOWN || LdapResult == LDAP_TIMEOUT || LdapResult == LDAP_CONNECT_ERROR);
+}
+
+static void DetailsDisconnect(_Inout_ DCDETAILS_CONNECTION* Connection)
+{
+	if (Connection->Directory)
+	{
+		ldap_unbind(Connection->Directory);
+	}
+
+	if (Connection->GlobalCatalog)
+	{
+		ldap_unbind(Connection->GlobalCatalog);
+	}
+
+	Connection->Directory = NULL;
+
+	Connection->GlobalCatalog = NULL;
+}
+
+// Reads the DC's server object and everything under it in the configuration NC: its DNS host name and computer
+// account from the server object, options from NTDS Settings, and one connection object per inbound partner.
+// ComputerDN may be NULL if it isn't wanted.
+
+static DWORD DetailsReadServer(_Inout_ DCDETAILS_CONNECTION* Connection, _In_ ENTITY* DC, _Inout_ DCDETAILS* Details, _Out_opt_ wchar_t* ComputerDN, _In_ size_t ComputerDNCount)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	ULONG LdapResult = LDAP_SUCCESS;
+
+	LDAPMessage* Entries = NULL;
+
+	LDAP_TIMEVAL Timeout = { .tv_sec = DCDETAILS_LDAP_TIMEOUT_SECONDS };
+
+	wchar_t* Attributes[] = { L"objectClass", L"dNSHostName", L"serverReference", L"options", L"fromServer", NULL };
+
+	if (ComputerDN)
+	{
+		ComputerDN[0] = L'\0';
+	}
+
+	if (Connection->Directory == NULL && (Result = DetailsConnect(gDetailsServer, LDAP_PORT, &Connection->Directory)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	if ((LdapResult = TRACED("ldap_search_stW", ldap_search_stW(
+		Connection->Directory,
+		DC->distinguishedname,
+		LDAP_SCOPE_SUBTREE,
+		L"(|(objectClass=server)(objectClass=nTDSDSA)(objectClass=nTDSConnection))",
+		Attributes,
+		FALSE,
+		&Timeout,
+		&Entries))) != LDAP_SUCCESS)
+	{
+		Result = LdapMapErrorToWin32(LdapResult);
+
+		goto Exit;
+	}
+
+	for (LDAPMessage* Entry = ldap_first_entry(Connection->Directory, Entries); Entry != NULL; Entry = ldap_next_entry(Connection->Directory, Entry))
+	{
+		wchar_t** Classes = ldap_get_valuesW(Connection->Directory, Entry, L"objectClass");
+
+		wchar_t** Values = NULL;
+
+		if (DetailsHasObjectClass(Classes, L"server"))
+		{
+			if ((Values = ldap_get_valuesW(Connection->Directory, Entry, L"dNSHostName")) != NULL)
+			{
+				DetailsPublishString(DC->fqdn, _countof(DC->fqdn), Values[0]);
+
+				ldap_value_freeW(Values);
+			}
+
+			if (ComputerDN && (Values = ldap_get_valuesW(Connection->Directory, Entry, L"serverReference")) != NULL)
+			{
+				wcsncpy_s(ComputerDN, ComputerDNCount, Values[0], _TRUNCATE);
+
+				ldap_value_freeW(Values);
+			}
+		}
+		else if (DetailsHasObjectClass(Classes, L"nTDSDSA"))
+		{
+			if ((Values = ldap_get_valuesW(Connection->Directory, Entry, L"options")) != NULL)
+			{
+				Details->DsaOptions = wcstoul(Values[0], NULL, 10);
+
+				ldap_value_freeW(Values);
+			}
+
+			// A DC its domain didn't report on has no role flags yet. These two can be told from here.
+
+			if (Details->DsaOptions & NTDSDSA_OPT_IS_GC)
+			{
+				InterlockedOr((volatile LONG*)&DC->Flags, DCF_GC);
+			}
+
+			if (DetailsHasObjectClass(Classes, L"nTDSDSARO"))
+			{
+				InterlockedOr((volatile LONG*)&DC->Flags, DCF_RODC);
+			}
+		}
+		else if (DetailsHasObjectClass(Classes, L"nTDSConnection"))
+		{
+			// fromServer is the partner's NTDS Settings object; the server's name is the RDN above it.
+
+			if ((Values = ldap_get_valuesW(Connection->Directory, Entry, L"fromServer")) != NULL)
+			{
+				wchar_t* ServerDN = DnParent(Values[0]);
+
+				if (ServerDN && Details->InboundPartners < DCDETAILS_MAX_PARTNER_NAMES)
+				{
+					DnFirstValue(ServerDN, Details->PartnerNames[Details->InboundPartners], _countof(Details->PartnerNames[0]));
+				}
+
+				ldap_value_freeW(Values);
+			}
+
+			Details->InboundPartners++;
+		}
+
+		if (Classes)
+		{
+			ldap_value_freeW(Classes);
+		}
+	}
+
+	// A DC its domain didn't report on doesn't know its domain either. The DN of its computer account says which
+	// domain it's in; failing that, the DNS host name is the best guess.
+
+	if (DC->domain[0] == L'\0')
+	{
+		wchar_t Domain[256] = { 0 };
+
+		if (ComputerDN && ComputerDN[0] != L'\0' && DnToDomainName(ComputerDN, Domain, _countof(Domain)) == ERROR_SUCCESS)
+		{
+			DetailsPublishString(DC->domain, _countof(DC->domain), Domain);
+		}
+		else if (DC->fqdn[0] != L'\0' && wcschr(DC->fqdn, L'.') != NULL)
+		{
+			DetailsPublishString(DC->domain, _countof(DC->domain), wcschr(DC->fqdn, L'.') + 1);
+		}
+	}
+
+Exit:
+
+	if (Entries)
+	{
+		ldap_msgfree(Entries);
+	}
+
+	// The connection is made again next time.
+
+	if (DetailsConnectionLost(LdapResult))
+	{
+		DetailsDisconnect(Connection);
+	}
+
+	return(Result);
+}
+
+static DWORD DetailsReadComputer(_Inout_ DCDETAILS_CONNECTION* Connection, _In_ wchar_t* ComputerDN, _Inout_ DCDETAILS* Details)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	ULONG LdapResult = LDAP_SUCCESS;
+
+	LDAPMessage* Entries = NULL;
+
+	LDAPMessage* Entry = NULL;
+
+	wchar_t** Values = NULL;
+
+	LDAP_TIMEVAL Timeout = { .tv_sec = DCDETAILS_LDAP_TIMEOUT_SECONDS };
+
+	wchar_t* Attributes[] = { L"operatingSystem", L"operatingSystemVersion", NULL };
+
+	if (Connection->GlobalCatalog == NULL && (Result = DetailsConnect(gDetailsServer, LDAP_GC_PORT, &Connection->GlobalCatalog)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	if ((LdapResult = TRACED("ldap_search_stW", ldap_search_stW(
+		Connection->GlobalCatalog,
+		ComputerDN,
+		LDAP_SCOPE_BASE,
+		L"(objectClass=*)",
+		Attributes,
+		FALSE,
+		&Timeout,
+		&Entries))) != LDAP_SUCCESS)
+	{
+		Result = LdapMapErrorToWin32(LdapResult);
+
+		goto Exit;
+	}
+
+	if ((Entry = ldap_first_entry(Connection->GlobalCatalog, Entries)) == NULL)
+	{
+		Result = ERROR_DS_NO_ATTRIBUTE_OR_VALUE;
+
+		goto Exit;
+	}
+
+	if ((Values = ldap_get_valuesW(Connection->GlobalCatalog, Entry, L"operatingSystem")) != NULL)
+	{
+		wcsncpy_s(Details->OperatingSystem, _countof(Details->OperatingSystem), Values[0], _TRUNCATE);
+
+		ldap_value_freeW(Values);
+	}
+
+	if ((Values = ldap_get_valuesW(Connection->GlobalCatalog, Entry, L"operatingSystemVersion")) != NULL)
+	{
+		wcsncpy_s(Details->OperatingSystemVersion, _countof(Details->OperatingSystemVersion), Values[0], _TRUNCATE);
+
+		ldap_value_freeW(Values);
+	}
+
+Exit:
+
+	if (Entries)
+	{
+		ldap_msgfree(Entries);
+	}
+
+	if (DetailsConnectionLost(LdapResult))
+	{
+		ldap_unbind(Connection->GlobalCatalog);
+
+		Connection->GlobalCatalog = NULL;
+	}
+
+	return(Result);
+}
+
+static BOOL DetailsPush(_Inout_ DCDETAILS_STACK* Stack, _In_ ENTITY* DC)
+{
+	BOOL Pushed = FALSE;
+
+	EnterCriticalSection(&gDetailsLock);
+
+	if (Stack->Count < Stack->Capacity)
+	{
+		Stack->Requests[Stack->Count++] = (DCDETAILS_REQUEST){ .DC = DC, .Frame = gGraphicsData.TotalFramesRendered };
+
+		Pushed = TRUE;
+	}
+
+	LeaveCriticalSection(&gDetailsLock);
+
+	return(Pushed);
+}
+
+// Takes the next DC to fetch off the stacks and marks it DDS_FETCHING. NULL if there's nothing worth fetching.
+
+static ENTITY* DetailsNextRequest(void)
+{
+	ENTITY* DC = NULL;
+
+	UINT64 Frame = gGraphicsData.TotalFramesRendered;
+
+	EnterCriticalSection(&gDetailsLock);
+
+	while (DC == NULL && (gDetailsVisible.Count > 0 || gDetailsNearby.Count > 0))
+	{
+		LONG Waiting = (gDetailsVisible.Count > 0) ? DDS_VISIBLE : DDS_NEARBY;
+
+		DCDETAILS_REQUEST Request = (Waiting == DDS_VISIBLE) ? gDetailsVisible.Requests[--gDetailsVisible.Count] : gDetailsNearby.Requests[--gDetailsNearby.Count];
+
+		BOOL Stale = (Request.Frame + DCDETAILS_STALE_FRAMES < Frame && Request.DC->LastVisibleFrame + DCDETAILS_STALE_FRAMES < Frame);
+
+		if (InterlockedCompareExchange(&Request.DC->DetailsState, Stale ? DDS_NONE : DDS_FETCHING, Waiting) != Waiting)
+		{
+			// The other request for the same DC got there first.
+
+			continue;
+		}
+
+		InterlockedDecrement(&gDetailsWaiting);
+
+		if (Stale == FALSE)
+		{
+			DC = Request.DC;
+		}
+	}
+
+	LeaveCriticalSection(&gDetailsLock);
+
+	return(DC);
+}
+
+static DWORD WINAPI DetailsWorkerThreadProc(_In_ LPVOID Parameter)
+{
+	HANDLE Handles[] = { gDetailsStopEvent, gDetailsWorkAvailable };
+
+	DCDETAILS_CONNECTION Connection = { 0 };
+
+	UNREFERENCED_PARAMETER(Parameter);
+
+	TRACE_THREAD_NAME(L"DCDetails");
+
+	while (WaitForMultipleObjects(_countof(Handles), Handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1)
+	{
+		ENTITY* DC = DetailsNextRequest();
+
+		DCDETAILS* Details = NULL;
+
+		wchar_t ComputerDN[256] = { 0 };
+
+		UINT64 Start = GetTickCount64();
+
+		if (DC == NULL)
+		{
+			continue;
+		}
+
+		Details = DC->Details;
+
+		// A retry starts from nothing. Nobody else looks at Details while the DC is DDS_FETCHING.
+
+		memset(Details, 0, sizeof(DCDETAILS));
+
+		TRACE_BEGIN("FetchDCDetails");
+
+		if ((Details->Result = DetailsReadServer(&Connection, DC, Details, ComputerDN, _countof(ComputerDN))) == ERROR_SUCCESS && ComputerDN[0] != L'\0')
+		{
+			// Not every domain's computer objects have to be readable from here; what's in the configuration NC is
+			// still worth showing without them.
+
+			DWORD ComputerResult = DetailsReadComputer(&Connection, ComputerDN, Details);
+
+			if (ComputerResult != ERROR_SUCCESS)
+			{
+				LogEventW(LL_WARN, LF_FILE, L"[%s] Reading computer account %s failed with 0x%08lx.", __FUNCTIONW__, ComputerDN, ComputerResult);
+			}
+		}
+
+		TRACE_END();
+
+		Details->FetchedAt = GetTickCount64();
+
+		Details->FetchMilliseconds = Details->FetchedAt - Start;
+
+		if (Details->Result == ERROR_SUCCESS)
+		{
+			InterlockedIncrement(&gDetailsReady);
+
+			InterlockedExchange(&DC->DetailsState, DDS_READY);
+		}
+		else
+		{
+			LogEventW(LL_WARN, LF_FILE, L"[%s] Fetching details of %s failed with 0x%08lx.", __FUNCTIONW__, DC->distinguishedname, Details->Result);
+
+			InterlockedExchange(&DC->DetailsState, DDS_FAILED);
+		}
+	}
+
+	DetailsDisconnect(&Connection);
+
+	return(0);
+}
+
+// Asks for the details of a DC the renderer has just culled in (Visible) or found close to the screen. Cheap enough
+// to call for every such DC on every frame.
+
+void RequestDCDetails(_In_ ENTITY* DC, _In_ BOOL Visible)
+{
+	LONG State = DC->DetailsState;
+
+	LONG Wanted = Visible ? DDS_VISIBLE : DDS_NEARBY;
+
+	if (gDetailsThreadCount == 0 || DC->Details == NULL)
+	{
+		return;
+	}
+
+	if (State == DDS_FAILED && Visible && GetTickCount64() - DC->Details->FetchedAt >= DCDETAILS_RETRY_MS &&
+		InterlockedCompareExchange(&DC->DetailsState, DDS_NONE, DDS_FAILED) == DDS_FAILED)
+	{
+		State = DDS_NONE;
+	}
+
+	if ((State != DDS_NONE && (State != DDS_NEARBY || Visible == FALSE)) ||
+		InterlockedCompareExchange(&DC->DetailsState, Wanted, State) != State)
+	{
+		return;
+	}
+
+	if (DetailsPush(Visible ? &gDetailsVisible : &gDetailsNearby, DC) == FALSE)
+	{
+		InterlockedExchange(&DC->DetailsState, State);
+
+		return;
+	}
+
+	if (State == DDS_NONE)
+	{
+		InterlockedIncrement(&gDetailsWaiting);
+	}
+
+	ReleaseSemaphore(gDetailsWorkAvailable, 1, NULL);
+}
+
+void GetDCDetailsCounts(_Out_ DWORD* Ready, _Out_ DWORD* Waiting)
+{
+	*Ready = (DWORD)gDetailsReady;
+
+	*Waiting = (DWORD)max(gDetailsWaiting, 0);
+}
+
+// Gives every DC in Entities somewhere to keep its details and starts the workers. They ask DomainController, which
+// has to be a global catalog, as the one discovery started from is.
+
+DWORD StartDCDetails(_In_ wchar_t* DomainController, _In_ ENTITY* Entities)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD DCCount = 0;
+
+	// DsGetDcName hands back names like \\dc01.contoso.com.
+
+	while (*DomainController == L'\\')
+	{
+		DomainController++;
+	}
+
+	wcscpy_s(gDetailsServer, _countof(gDetailsServer), DomainController);
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		DCCount += (Current->Type == ET_DC);
+	}
+
+	if (DCCount == 0)
+	{
+		goto Exit;
+	}
+
+	gDetails = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DCDETAILS) * DCCount);
+
+	gDetailsVisible.Requests = HeapAlloc(GetProcessHeap(), 0, sizeof(DCDETAILS_REQUEST) * DCCount);
+
+	gDetailsNearby.Requests = HeapAlloc(GetProcessHeap(), 0, sizeof(DCDETAILS_REQUEST) * DCCount);
+
+	if (gDetails == NULL || gDetailsVisible.Requests == NULL || gDetailsNearby.Requests == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	gDetailsVisible.Capacity = DCCount;
+
+	gDetailsNearby.Capacity = DCCount;
+
+	DCCount = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			Current->Details = &gDetails[DCCount++];
+		}
+	}
+
+	InitializeCriticalSection(&gDetailsLock);
+
+	gDetailsStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+	gDetailsWorkAvailable = CreateSemaphoreW(NULL, 0, MAXLONG, NULL);
+
+	if (gDetailsStopEvent == NULL || gDetailsWorkAvailable == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Creating events failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	for (DWORD Worker = 0; Worker < DCDETAILS_WORKERS; Worker++)
+	{
+		if ((gDetailsThreads[gDetailsThreadCount] = CreateThread(NULL, 0, DetailsWorkerThreadProc, NULL, 0, NULL)) == NULL)
+		{
+			Result = GetLastError();
+
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] CreateThread failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+			break;
+		}
+
+		gDetailsThreadCount++;
+	}
+
+	// Fewer workers is only slower.
+
+	if (gDetailsThreadCount > 0)
+	{
+		Result = ERROR_SUCCESS;
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] %lu workers fetching details for %lu DCs from %s as they come into view.", __FUNCTIONW__, gDetailsThreadCount, DCCount, gDetailsServer);
+
+Exit:
+
+	return(Result);
+}
+
+// Stops the workers. One stuck waiting on a DC that isn't answering is left behind after TimeoutMilliseconds.
+
+void StopDCDetails(_In_ DWORD TimeoutMilliseconds)
+{
+	if (gDetailsThreadCount == 0)
+	{
+		return;
+	}
+
+	SetEvent(gDetailsStopEvent);
+
+	if (WaitForMultipleObjects(gDetailsThreadCount, gDetailsThreads, TRUE, TimeoutMilliseconds) != WAIT_OBJECT_0)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] DC details workers did not stop within %dms.", __FUNCTIONW__, TimeoutMilliseconds);
+	}
+
+	for (DWORD Worker = 0; Worker < gDetailsThreadCount; Worker++)
+	{
+		CloseHandle(gDetailsThreads[Worker]);
+	}
+
+	gDetailsThreadCount = 0;
+}
+
+// With no window there's no viewport to go by, so headless discovery fills in every missing DNS host name up front,
+// one DC at a time, as discovery itself used to.
+
+DWORD FetchMissingDCNames(_In_ wchar_t* DomainController, _In_ ENTITY* Entities)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DCDETAILS_CONNECTION Connection = { 0 };
+
+	DCDETAILS Scratch = { 0 };
+
+	while (*DomainController == L'\\')
+	{
+		DomainController++;
+	}
+
+	wcscpy_s(gDetailsServer, _countof(gDetailsServer), DomainController);
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type != ET_DC || Current->fqdn[0] != L'\0')
+		{
+			continue;
+		}
+
+		if (gContinue == FALSE)
+		{
+			Result = ERROR_CANCELLED;
+
+			break;
+		}
+
+		memset(&Scratch, 0, sizeof(Scratch));
+
+		if ((Result = DetailsReadServer(&Connection, Current, &Scratch, NULL, 0)) != ERROR_SUCCESS)
+		{
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] Reading server object %s failed with 0x%08lx!", __FUNCTIONW__, Current->distinguishedname, Result);
+
+			break;
+		}
+	}
+
+	DetailsDisconnect(&Connection);
+
+	return(Result);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// Per-DC details that discovery doesn't wait for: operating system, NTDS Settings options and inbound replication
+// partners, plus the DNS host name of any DC its own domain didn't tell us about. Discovery only finds the skeleton
+// of the forest, which is a handful of calls per site and per domain. These are fetched in the background, for DCs
+// that are on screen or close to it, most recently seen first, and kept once fetched.
+
+// How many worker threads fetch details at once. Each one has its own pair of LDAP connections.
+#define DCDETAILS_WORKERS				4
+
+// DCs this far off the edge of the screen, in screen pixels, are fetched ahead of time in case they're panned to.
+#define DCDETAILS_PREFETCH_MARGIN		512
+
+// A request that has waited this many frames for a worker is dropped, unless the DC is still on screen. It gets
+// asked for again if the DC comes back into view.
+#define DCDETAILS_STALE_FRAMES			300
+
+// A DC whose details couldn't be fetched is tried again after this long, if it's still being looked at.
+#define DCDETAILS_RETRY_MS				60000
+
+#define DCDETAILS_LDAP_TIMEOUT_SECONDS	30
+
+#define DCDETAILS_SHUTDOWN_TIMEOUT_MS	2000
+
+// Only the first few partners are kept by name; InboundPartners has the full count.
+#define DCDETAILS_MAX_PARTNER_NAMES		4
+
+typedef enum DCDETAILS_STATE
+{
+	DDS_NONE,			// Not asked for yet
+
+	DDS_NEARBY,			// Waiting, because the DC is close to the screen
+
+	DDS_VISIBLE,		// Waiting, because the DC is on screen; goes ahead of every DDS_NEARBY request
+
+	DDS_FETCHING,
+
+	DDS_READY,
+
+	DDS_FAILED
+
+} DCDETAILS_STATE;
+
+// Written by a worker while the DC is DDS_FETCHING, and read-only once it's DDS_READY or DDS_FAILED.
+typedef struct DCDETAILS
+{
+	// The computer account's operatingSystem and operatingSystemVersion, as found in the global catalog.
+	wchar_t OperatingSystem[64];
+
+	wchar_t OperatingSystemVersion[32];
+
+	// The options attribute of the DC's NTDS Settings object. NTDSDSA_OPT_* bits.
+	DWORD DsaOptions;
+
+	// Connection objects under NTDS Settings: the DCs this one replicates from.
+	DWORD InboundPartners;
+
+	// Server names, as in the CN of each partner's server object.
+	wchar_t PartnerNames[DCDETAILS_MAX_PARTNER_NAMES][64];
+
+	DWORD Result;
+
+	// GetTickCount64 when the worker finished with the DC.
+	UINT64 FetchedAt;
+
+	UINT64 FetchMilliseconds;
+
+} DCDETAILS;
+
+DWORD StartDCDetails(_In_ wchar_t* DomainController, _In_ ENTITY* Entities);
+
+void StopDCDetails(_In_ DWORD TimeoutMilliseconds);
+
+void RequestDCDetails(_In_ ENTITY* DC, _In_ BOOL Visible);
+
+DWORD FetchMissingDCNames(_In_ wchar_t* DomainController, _In_ ENTITY* Entities);
+
+void GetDCDetailsCounts(_Out_ DWORD* Ready, _Out_ DWORD* Waiting);
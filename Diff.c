@@ -0,0 +1,661 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Topology diffing. See Diff.h.
+
+#include <Windows.h>
+
+#include <stdio.h>
+
+#include <stdlib.h>
+
+#include <wctype.h>
+
+#include "Main.h"
+
+#include "Snapshot.h"
+
+#include "Diff.h"
+
+#define DIFF_FNV_OFFSET		0xCBF29CE484222325ULL
+
+#define DIFF_FNV_PRIME		0x100000001B3ULL
+
+
+
+static const wchar_t* gDiffTypeNames[] = { L"none", L"site", L"dc", L"sitelink", L"trust" };
+
+static const wchar_t gDiffKindSymbols[DK_COUNT] = { L' ', L'+', L'-', L'~' };
+
+// The splitmix64 finalizer. FNV on its own leaves the low bits poorly mixed, and sums of hashes need every bit to
+// count.
+
+static UINT64 DiffMix(_In_ UINT64 Value)
+{
+	Value ^= Value >> 30;
+
+	Value *= 0xBF58476D1CE4E5B9ULL;
+
+	Value ^= Value >> 27;
+
+	Value *= 0x94D049BB133111EBULL;
+
+	Value ^= Value >> 31;
+
+	return(Value);
+}
+
+static UINT64 DiffHashString(_In_ UINT64 Hash, _In_ const wchar_t* String, _In_ BOOL IgnoreCase)
+{
+	for (; *String; String++)
+	{
+		Hash = (Hash ^ (IgnoreCase ? towlower(*String) : *String)) * DIFF_FNV_PRIME;
+	}
+
+	// Hash the terminator too, so moving a character from one field to the next changes the result.
+
+	return(Hash * DIFF_FNV_PRIME);
+}
+
+// Distinguished names don't care about case, so neither do keys.
+
+static UINT64 DiffEntityKey(_In_ ENTITY_TYPE Type, _In_ const wchar_t* Identity)
+{
+	return(DiffMix(DiffHashString(DIFF_FNV_OFFSET ^ Type, Identity, TRUE)));
+}
+
+// Only what discovery fills in the same way every time. A DC's fqdn, domain, NTDS settings DN and role flags arrive
+// later, from whichever domains answered in time or the DC details workers once it's been scrolled past, so hashing
+// them would call a DC changed for no reason other than when it was looked at. A trust's flags come straight from
+// DsEnumerateDomainTrustsW, so they count.
+
+static UINT64 DiffEntityContentHash(_In_ ENTITY* Entity)
+{
+	UINT64 Hash = DIFF_FNV_OFFSET ^ Entity->Type;
+
+	if (Entity->Type == ET_TRUST)
+	{
+		Hash = (Hash ^ Entity->Flags) * DIFF_FNV_PRIME;
+	}
+
+	Hash = DiffHashString(Hash, Entity->name, FALSE);
+
+	Hash = DiffHashString(Hash, Entity->distinguishedname, FALSE);
+
+	Hash = DiffHashString(Hash, Entity->site, FALSE);
+
+	return(DiffMix(Hash));
+}
+
+static const wchar_t* DiffEntityIdentity(_In_ ENTITY* Entity)
+{
+	return((Entity->Type == ET_TRUST || Entity->distinguishedname[0] == L'\0') ? Entity->fqdn : Entity->distinguishedname);
+}
+
+// The key an entity is matched on between two topologies.
+
+UINT64 TopologyEntityKey(_In_ ENTITY* Entity)
+{
+	return(DiffEntityKey(Entity->Type, DiffEntityIdentity(Entity)));
+}
+
+static int __cdecl DiffCompareGroups(_In_ const void* A, _In_ const void* B)
+{
+	const DIFF_NODE* NodeA = A;
+
+	const DIFF_NODE* NodeB = B;
+
+	return((NodeA->Key > NodeB->Key) - (NodeA->Key < NodeB->Key));
+}
+
+static int __cdecl DiffCompareLeaves(_In_ const void* A, _In_ const void* B)
+{
+	const DIFF_NODE* NodeA = A;
+
+	const DIFF_NODE* NodeB = B;
+
+	if (NodeA->ParentKey != NodeB->ParentKey)
+	{
+		return((NodeA->ParentKey > NodeB->ParentKey) - (NodeA->ParentKey < NodeB->ParentKey));
+	}
+
+	return((NodeA->Key > NodeB->Key) - (NodeA->Key < NodeB->Key));
+}
+
+TOPOLOGY_TREE* BuildTopologyTree(_In_ ENTITY* Entities)
+{
+	TOPOLOGY_TREE* Tree = NULL;
+
+	DWORD EntityCount = 0;
+
+	DWORD GroupCount = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		EntityCount++;
+	}
+
+	// Every group either is a non-DC entity or was made up for at least one DC, so there can't be more groups than
+	// entities.
+
+	if ((Tree = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TOPOLOGY_TREE))) == NULL ||
+		(Tree->Groups = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (SIZE_T)max(EntityCount, 1) * sizeof(DIFF_NODE))) == NULL ||
+		(Tree->Leaves = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (SIZE_T)max(EntityCount, 1) * sizeof(DIFF_NODE))) == NULL)
+	{
+		FreeTopologyTree(Tree);
+
+		return(NULL);
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		DIFF_NODE* Node = (Current->Type == ET_DC) ? &Tree->Leaves[Tree->LeafCount++] : &Tree->Groups[Tree->GroupCount++];
+
+		Node->Key = DiffEntityKey(Current->Type, DiffEntityIdentity(Current));
+
+		Node->ContentHash = DiffEntityContentHash(Current);
+
+		Node->Hash = Node->ContentHash;
+
+		Node->Entity = Current;
+
+		if (Current->Type == ET_DC)
+		{
+			Node->ParentKey = DiffEntityKey(ET_SITE, Current->site);
+		}
+	}
+
+	qsort(Tree->Groups, Tree->GroupCount, sizeof(DIFF_NODE), DiffCompareGroups);
+
+	qsort(Tree->Leaves, Tree->LeafCount, sizeof(DIFF_NODE), DiffCompareLeaves);
+
+	// DCs whose site isn't in the topology still need a group to hang off.
+
+	GroupCount = Tree->GroupCount;
+
+	for (DWORD Leaf = 0; Leaf < Tree->LeafCount; Leaf++)
+	{
+		DIFF_NODE Key = { .Key = Tree->Leaves[Leaf].ParentKey };
+
+		if (Leaf > 0 && Tree->Leaves[Leaf - 1].ParentKey == Key.Key)
+		{
+			continue;
+		}
+
+		if (bsearch(&Key, Tree->Groups, GroupCount, sizeof(DIFF_NODE), DiffCompareGroups) == NULL)
+		{
+			Tree->Groups[Tree->GroupCount++] = Key;
+		}
+	}
+
+	if (Tree->GroupCount != GroupCount)
+	{
+		qsort(Tree->Groups, Tree->GroupCount, sizeof(DIFF_NODE), DiffCompareGroups);
+	}
+
+	// Both arrays are sorted by the group key now, so one pass hands every group its children.
+
+	for (DWORD Group = 0, Leaf = 0; Group < Tree->GroupCount; Group++)
+	{
+		DIFF_NODE* Node = &Tree->Groups[Group];
+
+		UINT64 ChildrenHash = 0;
+
+		DWORD Bucket = (DWORD)(Node->Key >> 56);
+
+		while (Leaf < Tree->LeafCount && Tree->Leaves[Leaf].ParentKey < Node->Key)
+		{
+			Leaf++;
+		}
+
+		Node->FirstChild = Leaf;
+
+		while (Leaf < Tree->LeafCount && Tree->Leaves[Leaf].ParentKey == Node->Key)
+		{
+			ChildrenHash += DiffMix(Tree->Leaves[Leaf].Key ^ Tree->Leaves[Leaf].Hash);
+
+			Leaf++;
+		}
+
+		Node->ChildCount = Leaf - Node->FirstChild;
+
+		Node->Hash = DiffMix(Node->ContentHash ^ DiffMix(ChildrenHash));
+
+		Tree->BucketHashes[Bucket] += DiffMix(Node->Key ^ Node->Hash);
+
+		Tree->BucketFirst[Bucket + 1]++;
+	}
+
+	for (DWORD Bucket = 0; Bucket < DIFF_BUCKETS; Bucket++)
+	{
+		Tree->BucketFirst[Bucket + 1] += Tree->BucketFirst[Bucket];
+
+		Tree->Root = DiffMix(Tree->Root ^ Tree->BucketHashes[Bucket]);
+	}
+
+	return(Tree);
+}
+
+void FreeTopologyTree(_In_opt_ TOPOLOGY_TREE* Tree)
+{
+	if (Tree == NULL)
+	{
+		return;
+	}
+
+	if (Tree->Groups)
+	{
+		HeapFree(GetProcessHeap(), 0, Tree->Groups);
+	}
+
+	if (Tree->Leaves)
+	{
+		HeapFree(GetProcessHeap(), 0, Tree->Leaves);
+	}
+
+	HeapFree(GetProcessHeap(), 0, Tree);
+}
+
+static BOOL DiffAddEntry(_Inout_ TOPOLOGY_DIFF* Diff, _In_ DIFF_KIND Kind, _In_opt_ ENTITY* Old, _In_opt_ ENTITY* New, _In_opt_ ENTITY* NewParent)
+{
+	if (Diff->Count == Diff->Capacity)
+	{
+		DWORD Capacity = max(64, Diff->Capacity * 2);
+
+		DIFF_ENTRY* Entries = Diff->Entries ?
+			HeapReAlloc(GetProcessHeap(), 0, Diff->Entries, Capacity * sizeof(DIFF_ENTRY)) :
+			HeapAlloc(GetProcessHeap(), 0, Capacity * sizeof(DIFF_ENTRY));
+
+		if (Entries == NULL)
+		{
+			return(FALSE);
+		}
+
+		Diff->Entries = Entries;
+
+		Diff->Capacity = Capacity;
+	}
+
+	Diff->Entries[Diff->Count++] = (DIFF_ENTRY){ .Kind = Kind, .Old = Old, .New = New, .NewParent = NewParent };
+
+	Diff->KindCounts[Kind]++;
+
+	return(TRUE);
+}
+
+// Walks two key-sorted runs of DCs side by side.
+
+static BOOL DiffLeaves(_In_ DIFF_NODE* Old, _In_ DWORD OldCount, _In_ DIFF_NODE* New, _In_ DWORD NewCount, _In_opt_ ENTITY* NewParent, _Inout_ TOPOLOGY_DIFF* Diff)
+{
+	DWORD OldIndex = 0;
+
+	DWORD NewIndex = 0;
+
+	while (OldIndex < OldCount || NewIndex < NewCount)
+	{
+		BOOL Succeeded = TRUE;
+
+		if (NewIndex == NewCount || (OldIndex < OldCount && Old[OldIndex].Key < New[NewIndex].Key))
+		{
+			Succeeded = DiffAddEntry(Diff, DK_REMOVED, Old[OldIndex++].Entity, NULL, NewParent);
+		}
+		else if (OldIndex == OldCount || New[NewIndex].Key < Old[OldIndex].Key)
+		{
+			Succeeded = DiffAddEntry(Diff, DK_ADDED, NULL, New[NewIndex++].Entity, NULL);
+		}
+		else
+		{
+			if (Old[OldIndex].Hash != New[NewIndex].Hash)
+			{
+				Succeeded = DiffAddEntry(Diff, DK_CHANGED, Old[OldIndex].Entity, New[NewIndex].Entity, NULL);
+			}
+
+			OldIndex++;
+
+			NewIndex++;
+		}
+
+		if (Succeeded == FALSE)
+		{
+			return(FALSE);
+		}
+	}
+
+	return(TRUE);
+}
+
+// Appends what changed between Old and New to Diff. Buckets and groups with matching hashes are skipped without
+// looking inside them.
+
+DWORD DiffTopology(_In_ TOPOLOGY_TREE* Old, _In_ TOPOLOGY_TREE* New, _Inout_ TOPOLOGY_DIFF* Diff)
+{
+	if (Old->Root == New->Root)
+	{
+		return(ERROR_SUCCESS);
+	}
+
+	for (DWORD Bucket = 0; Bucket < DIFF_BUCKETS; Bucket++)
+	{
+		DWORD OldIndex = Old->BucketFirst[Bucket];
+
+		DWORD NewIndex = New->BucketFirst[Bucket];
+
+		if (Old->BucketHashes[Bucket] == New->BucketHashes[Bucket])
+		{
+			continue;
+		}
+
+		while (OldIndex < Old->BucketFirst[Bucket + 1] || NewIndex < New->BucketFirst[Bucket + 1])
+		{
+			DIFF_NODE* OldGroup = (OldIndex < Old->BucketFirst[Bucket + 1]) ? &Old->Groups[OldIndex] : NULL;
+
+			DIFF_NODE* NewGroup = (NewIndex < New->BucketFirst[Bucket + 1]) ? &New->Groups[NewIndex] : NULL;
+
+			BOOL Succeeded = TRUE;
+
+			Diff->GroupsCompared++;
+
+			if (NewGroup == NULL || (OldGroup != NULL && OldGroup->Key < NewGroup->Key))
+			{
+				// Gone, along with everything that was in it.
+
+				if (OldGroup->Entity)
+				{
+					Succeeded = DiffAddEntry(Diff, DK_REMOVED, OldGroup->Entity, NULL, NULL);
+				}
+
+				Succeeded = Succeeded && DiffLeaves(&Old->Leaves[OldGroup->FirstChild], OldGroup->ChildCount, NULL, 0, NULL, Diff);
+
+				OldIndex++;
+			}
+			else if (OldGroup == NULL || NewGroup->Key < OldGroup->Key)
+			{
+				if (NewGroup->Entity)
+				{
+					Succeeded = DiffAddEntry(Diff, DK_ADDED, NULL, NewGroup->Entity, NULL);
+				}
+
+				Succeeded = Succeeded && DiffLeaves(NULL, 0, &New->Leaves[NewGroup->FirstChild], NewGroup->ChildCount, NULL, Diff);
+
+				NewIndex++;
+			}
+			else
+			{
+				if (OldGroup->Hash != NewGroup->Hash)
+				{
+					// A group made up for DCs whose site wasn't there is matched by the site when it turns up, or
+					// the other way round, which is the site itself being added or removed.
+
+					if (OldGroup->Entity && NewGroup->Entity)
+					{
+						if (OldGroup->ContentHash != NewGroup->ContentHash)
+						{
+							Succeeded = DiffAddEntry(Diff, DK_CHANGED, OldGroup->Entity, NewGroup->Entity, NULL);
+						}
+					}
+					else if (NewGroup->Entity)
+					{
+						Succeeded = DiffAddEntry(Diff, DK_ADDED, NULL, NewGroup->Entity, NULL);
+					}
+					else if (OldGroup->Entity)
+					{
+						Succeeded = DiffAddEntry(Diff, DK_REMOVED, OldGroup->Entity, NULL, NULL);
+					}
+
+					Succeeded = Succeeded && DiffLeaves(
+						&Old->Leaves[OldGroup->FirstChild],
+						OldGroup->ChildCount,
+						&New->Leaves[NewGroup->FirstChild],
+						NewGroup->ChildCount,
+						NewGroup->Entity,
+						Diff);
+				}
+
+				OldIndex++;
+
+				NewIndex++;
+			}
+
+			if (Succeeded == FALSE)
+			{
+				return(ERROR_NOT_ENOUGH_MEMORY);
+			}
+		}
+	}
+
+	return(ERROR_SUCCESS);
+}
+
+// Flags the new side of every difference so the renderer can highlight it. A site that lost DCs but is otherwise
+// unchanged is marked DK_REMOVED, since the DCs themselves aren't there to highlight.
+
+void MarkTopologyDiff(_In_ TOPOLOGY_DIFF* Diff)
+{
+	for (DWORD Index = 0; Index < Diff->Count; Index++)
+	{
+		DIFF_ENTRY* Entry = &Diff->Entries[Index];
+
+		if (Entry->New)
+		{
+			Entry->New->DiffKind = Entry->Kind;
+		}
+		else if (Entry->NewParent && Entry->NewParent->DiffKind == DK_NONE)
+		{
+			Entry->NewParent->DiffKind = DK_REMOVED;
+		}
+	}
+}
+
+// Clears the marks MarkTopologyDiff made. Diff is left as it was.
+
+void UnmarkTopologyDiff(_In_ TOPOLOGY_DIFF* Diff)
+{
+	for (DWORD Index = 0; Index < Diff->Count; Index++)
+	{
+		DIFF_ENTRY* Entry = &Diff->Entries[Index];
+
+		if (Entry->New)
+		{
+			Entry->New->DiffKind = DK_NONE;
+		}
+
+		if (Entry->NewParent)
+		{
+			Entry->NewParent->DiffKind = DK_NONE;
+		}
+	}
+}
+
+// Loads the snapshot in FileName and compares Entities against it, marking Entities with the differences. Diff keeps
+// the loaded snapshot, since the removed entities it lists live there.
+
+DWORD CompareWithSnapshot(_In_ wchar_t* FileName, _In_ ENTITY* Entities, _Inout_ TOPOLOGY_DIFF* Diff)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	wchar_t ForestName[_countof(gForestName)] = { 0 };
+
+	ENTITY* Baseline = NULL;
+
+	// LoadSnapshot sets the forest name, but the forest on screen is still the one we already had.
+
+	wcscpy_s(ForestName, _countof(ForestName), gForestName);
+
+	Result = LoadSnapshot(FileName, &Baseline, NULL);
+
+	wcscpy_s(gForestName, _countof(gForestName), ForestName);
+
+	if (Result != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] LoadSnapshot failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		return(Result);
+	}
+
+	return(CompareWithBaseline(Baseline, FileName, Entities, Diff));
+}
+
+// Compares Entities against Baseline, marking Entities with the differences. Diff takes Baseline, whatever happens,
+// since the removed entities it lists live there. Name is what the baseline is called on screen and in the report.
+
+DWORD CompareWithBaseline(_In_ ENTITY* Baseline, _In_ wchar_t* Name, _In_ ENTITY* Entities, _Inout_ TOPOLOGY_DIFF* Diff)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	TOPOLOGY_TREE* OldTree = NULL;
+
+	TOPOLOGY_TREE* NewTree = NULL;
+
+	Diff->Baseline = Baseline;
+
+	wcscpy_s(Diff->BaselineFileName, _countof(Diff->BaselineFileName), Name);
+
+	if ((OldTree = BuildTopologyTree(Diff->Baseline)) == NULL || (NewTree = BuildTopologyTree(Entities)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	if ((Result = DiffTopology(OldTree, NewTree, Diff)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	MarkTopologyDiff(Diff);
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Compared against %s: %lu added, %lu removed, %lu changed, %lu groups compared.", __FUNCTIONW__,
+		Name,
+		Diff->KindCounts[DK_ADDED],
+		Diff->KindCounts[DK_REMOVED],
+		Diff->KindCounts[DK_CHANGED],
+		Diff->GroupsCompared);
+
+Exit:
+
+	FreeTopologyTree(OldTree);
+
+	FreeTopologyTree(NewTree);
+
+	return(Result);
+}
+
+static void DiffWriteLine(_In_ HANDLE File, _Inout_ DWORD* Result, _In_ wchar_t* Format, ...)
+{
+	va_list Args = NULL;
+
+	wchar_t Line[1024] = { 0 };
+
+	char Utf8[sizeof(Line) * 2] = { 0 };
+
+	int Length = 0;
+
+	DWORD Written = 0;
+
+	if (*Result != ERROR_SUCCESS)
+	{
+		return;
+	}
+
+	va_start(Args, Format);
+
+	_vsnwprintf_s(Line, _countof(Line), _TRUNCATE, Format, Args);
+
+	va_end(Args);
+
+	Length = WideCharToMultiByte(CP_UTF8, 0, Line, -1, Utf8, sizeof(Utf8), NULL, NULL);
+
+	if (Length <= 1)
+	{
+		return;
+	}
+
+	if (WriteFile(File, Utf8, Length - 1, &Written, NULL) == FALSE)
+	{
+		*Result = GetLastError();
+	}
+}
+
+static void DiffWriteField(_In_ HANDLE File, _Inout_ DWORD* Result, _In_ wchar_t* Name, _In_ wchar_t* Old, _In_ wchar_t* New)
+{
+	if (wcscmp(Old, New) != 0)
+	{
+		DiffWriteLine(File, Result, L"      %s: '%s' -> '%s'\r\n", Name, Old, New);
+	}
+}
+
+// Writes a plain text, UTF-8 list of everything in Diff: one line per entity, marked +, - or ~, and for changed
+// entities a line for each field that changed.
+
+DWORD WriteDiffReport(_In_ wchar_t* FileName, _In_ TOPOLOGY_DIFF* Diff)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	HANDLE File = INVALID_HANDLE_VALUE;
+
+	if ((File = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		return(Result);
+	}
+
+	DiffWriteLine(File, &Result, L"Topology of %s compared against %s\r\n", gForestName, Diff->BaselineFileName[0] ? Diff->BaselineFileName : L"(baseline)");
+
+	DiffWriteLine(File, &Result, L"%lu added, %lu removed, %lu changed\r\n\r\n", Diff->KindCounts[DK_ADDED], Diff->KindCounts[DK_REMOVED], Diff->KindCounts[DK_CHANGED]);
+
+	for (DWORD Index = 0; Index < Diff->Count; Index++)
+	{
+		DIFF_ENTRY* Entry = &Diff->Entries[Index];
+
+		ENTITY* Entity = Entry->New ? Entry->New : Entry->Old;
+
+		DiffWriteLine(File, &Result, L"%c %-8s %s\r\n",
+			gDiffKindSymbols[Entry->Kind],
+			Entity->Type <= ET_TRUST ? gDiffTypeNames[Entity->Type] : L"?",
+			DiffEntityIdentity(Entity));
+
+		if (Entry->Kind == DK_CHANGED)
+		{
+			DiffWriteField(File, &Result, L"name", Entry->Old->name, Entry->New->name);
+
+			DiffWriteField(File, &Result, L"fqdn", Entry->Old->fqdn, Entry->New->fqdn);
+
+			DiffWriteField(File, &Result, L"dn", Entry->Old->distinguishedname, Entry->New->distinguishedname);
+
+			DiffWriteField(File, &Result, L"ntds settings", Entry->Old->ntdssettingsdn, Entry->New->ntdssettingsdn);
+
+			DiffWriteField(File, &Result, L"site", Entry->Old->site, Entry->New->site);
+
+			DiffWriteField(File, &Result, L"domain", Entry->Old->domain, Entry->New->domain);
+
+			if (Entry->Old->Flags != Entry->New->Flags)
+			{
+				DiffWriteLine(File, &Result, L"      flags: 0x%08lx -> 0x%08lx\r\n", Entry->Old->Flags, Entry->New->Flags);
+			}
+		}
+	}
+
+	if (Result != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+	}
+
+	CloseHandle(File);
+
+	return(Result);
+}
+
+void FreeTopologyDiff(_Inout_ TOPOLOGY_DIFF* Diff)
+{
+	if (Diff->Entries)
+	{
+		HeapFree(GetProcessHeap(), 0, Diff->Entries);
+	}
+
+	FreeEntities(Diff->Baseline);
+
+	memset(Diff, 0, sizeof(TOPOLOGY_DIFF));
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+// Topology diffing. A TOPOLOGY_TREE hashes a topology into a shallow Merkle tree: every DC hashes into the site it
+// lives in, every site (and every trust or site link, which have nothing beneath them) lands in one of DIFF_BUCKETS
+// buckets by the hash of its distinguished name, and the buckets hash into a root. Two trees are compared from the
+// top down, only descending where hashes differ, so the cost follows the size of the difference rather than the size
+// of the forest.
+//
+// Positions are not hashed; laying the same forest out again is not a change.
+
+#define DIFF_BUCKETS				256
+
+#define DIFF_REPORT_FILE_NAME		L"ADTV_diff.txt"
+
+typedef struct DIFF_NODE
+{
+	// Hash of the entity's identity: its type and distinguished name, or DNS name for trusts.
+	UINT64 Key;
+
+	// For a DC, the Key of its site; unused for groups.
+	UINT64 ParentKey;
+
+	// Hash of the entity's own fields, those that discovery always fills in.
+	UINT64 ContentHash;
+
+	// ContentHash combined with the Hash of every child. Equal to ContentHash for DCs.
+	UINT64 Hash;
+
+	// NULL for a group made up to hold DCs whose site isn't in the topology.
+	ENTITY* Entity;
+
+	DWORD FirstChild;
+
+	DWORD ChildCount;
+
+} DIFF_NODE;
+
+typedef struct TOPOLOGY_TREE
+{
+	UINT64 Root;
+
+	UINT64 BucketHashes[DIFF_BUCKETS];
+
+	// Groups are sorted by Key, and the bucket is the top bits of the Key, so the groups in bucket B are
+	// Groups[BucketFirst[B]] up to Groups[BucketFirst[B + 1]].
+	DWORD BucketFirst[DIFF_BUCKETS + 1];
+
+	DWORD GroupCount;
+
+	DIFF_NODE* Groups;
+
+	// Sorted by ParentKey and then Key, so each group's children are contiguous.
+	DWORD LeafCount;
+
+	DIFF_NODE* Leaves;
+
+} TOPOLOGY_TREE;
+
+typedef struct DIFF_ENTRY
+{
+	DIFF_KIND Kind;
+
+	// NULL for DK_ADDED.
+	ENTITY* Old;
+
+	// NULL for DK_REMOVED.
+	ENTITY* New;
+
+	// For a removed DC, the site it used to be in, if that site still exists.
+	ENTITY* NewParent;
+
+} DIFF_ENTRY;
+
+typedef struct TOPOLOGY_DIFF
+{
+	DWORD Count;
+
+	DWORD Capacity;
+
+	DIFF_ENTRY* Entries;
+
+	DWORD KindCounts[DK_COUNT];
+
+	// How many groups had to be looked at; a measure of how much work the comparison did.
+	DWORD GroupsCompared;
+
+	// The topology the current one was compared against, if CompareWithSnapshot or CompareWithBaseline was given it.
+	// Old entities point in here.
+	ENTITY* Baseline;
+
+	// The snapshot's file name, or whatever else the baseline was called.
+	wchar_t BaselineFileName[MAX_PATH];
+
+} TOPOLOGY_DIFF;
+
+UINT64 TopologyEntityKey(_In_ ENTITY* Entity);
+
+TOPOLOGY_TREE* BuildTopologyTree(_In_ ENTITY* Entities);
+
+void FreeTopologyTree(_In_opt_ TOPOLOGY_TREE* Tree);
+
+DWORD DiffTopology(_In_ TOPOLOGY_TREE* Old, _In_ TOPOLOGY_TREE* New, _Inout_ TOPOLOGY_DIFF* Diff);
+
+void MarkTopologyDiff(_In_ TOPOLOGY_DIFF* Diff);
+
+void UnmarkTopologyDiff(_In_ TOPOLOGY_DIFF* Diff);
+
+DWORD CompareWithSnapshot(_In_ wchar_t* FileName, _In_ ENTITY* Entities, _Inout_ TOPOLOGY_DIFF* Diff);
+
+DWORD CompareWithBaseline(_In_ ENTITY* Baseline, _In_ wchar_t* Name, _In_ ENTITY* Entities, _Inout_ TOPOLOGY_DIFF* Diff);
+
+DWORD WriteDiffReport(_In_ wchar_t* FileName, _In_ TOPOLOGY_DIFF* Diff);
+
+void FreeTopologyDiff(_Inout_ TOPOLOGY_DIFF* Diff);
@@ -0,0 +1,562 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Distinguished name parsing. See DistinguishedName.h.
+
+#include <Windows.h>
+
+#include "DistinguishedName.h"
+
+
+
+typedef struct DN_TYPE_OID
+{
+	wchar_t* Name;
+
+	wchar_t* Oid;
+
+} DN_TYPE_OID;
+
+// Attribute types that turn up in AD DNs, for DNs that give them by OID instead of by name.
+static const DN_TYPE_OID gDnTypeOids[] = {
+	{ L"CN", L"2.5.4.3" },
+	{ L"OU", L"2.5.4.11" },
+	{ L"O", L"2.5.4.10" },
+	{ L"DC", L"0.9.2342.19200300.100.1.25" }
+};
+
+
+
+static BOOL DnIsAlpha(_In_ wchar_t Character)
+{
+	return((Character >= L'a' && Character <= L'z') || (Character >= L'A' && Character <= L'Z'));
+}
+
+static BOOL DnIsDigit(_In_ wchar_t Character)
+{
+	return(Character >= L'0' && Character <= L'9');
+}
+
+static int DnHexDigit(_In_ wchar_t Character)
+{
+	if (DnIsDigit(Character))
+	{
+		return(Character - L'0');
+	}
+
+	if (Character >= L'a' && Character <= L'f')
+	{
+		return(Character - L'a' + 10);
+	}
+
+	if (Character >= L'A' && Character <= L'F')
+	{
+		return(Character - L'A' + 10);
+	}
+
+	return(-1);
+}
+
+// What may follow a backslash on its own, rather than as two hex digits.
+static BOOL DnIsSpecial(_In_ wchar_t Character)
+{
+	return(Character != L'\0' && wcschr(L"\"+,;<>\\ #=", Character) != NULL);
+}
+
+// The byte escaped at Position, as in \2C, or -1 if there isn't one there.
+static int DnHexEscape(_In_ wchar_t* Value, _In_ DWORD Length, _In_ DWORD Position)
+{
+	if (Position + 2 >= Length)
+	{
+		return(-1);
+	}
+
+	if (Value[Position] != L'\\' || DnHexDigit(Value[Position + 1]) < 0 || DnHexDigit(Value[Position + 2]) < 0)
+	{
+		return(-1);
+	}
+
+	return((DnHexDigit(Value[Position + 1]) << 4) | DnHexDigit(Value[Position + 2]));
+}
+
+void InitializeDnReader(_Out_ DN_READER* Reader, _In_ wchar_t* DN, _In_ DWORD Length)
+{
+	Reader->DN = DN;
+
+	Reader->Length = Length;
+
+	Reader->Position = 0;
+
+	Reader->Rdn = 0;
+
+	Reader->Result = ERROR_SUCCESS;
+}
+
+// The next attribute in the DN. ERROR_NO_MORE_ITEMS once they've all been read, or ERROR_INVALID_DATA, from then on,
+// if the DN breaks the rules somewhere. An empty DN is a valid one with no attributes.
+
+DWORD DnNextAttribute(_Inout_ DN_READER* Reader, _Out_ DN_ATTRIBUTE* Attribute)
+{
+	DWORD Result = ERROR_INVALID_DATA;
+
+	wchar_t* DN = Reader->DN;
+
+	DWORD Length = Reader->Length;
+
+	DWORD Position = Reader->Position;
+
+	DWORD ValueEnd = 0;
+
+	memset(Attribute, 0, sizeof(DN_ATTRIBUTE));
+
+	if (Reader->Result != ERROR_SUCCESS)
+	{
+		return(Reader->Result);
+	}
+
+	while (Position < Length && DN[Position] == L' ')
+	{
+		Position++;
+	}
+
+	// Nothing at all is an empty DN; nothing after a separator is a mistake.
+
+	if (Position == Length)
+	{
+		Result = Reader->Position == 0 ? ERROR_NO_MORE_ITEMS : ERROR_INVALID_DATA;
+
+		goto Exit;
+	}
+
+	// The type is a name that starts with a letter, or an OID with no leading zeros.
+
+	Attribute->Type.Offset = Position;
+
+	if (DnIsAlpha(DN[Position]))
+	{
+		while (Position < Length && (DnIsAlpha(DN[Position]) || DnIsDigit(DN[Position]) || DN[Position] == L'-'))
+		{
+			Position++;
+		}
+	}
+	else
+	{
+		for (;;)
+		{
+			if (Position == Length || DnIsDigit(DN[Position]) == FALSE ||
+				(DN[Position] == L'0' && Position + 1 < Length && DnIsDigit(DN[Position + 1])))
+			{
+				goto Exit;
+			}
+
+			while (Position < Length && DnIsDigit(DN[Position]))
+			{
+				Position++;
+			}
+
+			if (Position == Length || DN[Position] != L'.')
+			{
+				break;
+			}
+
+			Position++;
+		}
+	}
+
+	Attribute->Type.Length = Position - Attribute->Type.Offset;
+
+	while (Position < Length && DN[Position] == L' ')
+	{
+		Position++;
+	}
+
+	if (Position == Length || DN[Position] != L'=')
+	{
+		goto Exit;
+	}
+
+	Position++;
+
+	while (Position < Length && DN[Position] == L' ')
+	{
+		Position++;
+	}
+
+	Attribute->Value.Offset = Position;
+
+	if (Position < Length && DN[Position] == L'#')
+	{
+		// A BER encoding, in hex. At least one byte of it.
+
+		Attribute->Flags |= DNAF_HEX;
+
+		Position++;
+
+		do
+		{
+			if (Position + 1 >= Length || DnHexDigit(DN[Position]) < 0 || DnHexDigit(DN[Position + 1]) < 0)
+			{
+				goto Exit;
+			}
+
+			Position += 2;
+
+		} while (Position < Length && DnHexDigit(DN[Position]) >= 0);
+
+		ValueEnd = Position;
+
+		while (Position < Length && DN[Position] == L' ')
+		{
+			Position++;
+		}
+	}
+	else
+	{
+		// A string. Spaces at the end of it aren't part of it unless they're escaped.
+
+		ValueEnd = Position;
+
+		while (Position < Length && DN[Position] != L',' && DN[Position] != L'+' && DN[Position] != L';')
+		{
+			wchar_t Character = DN[Position];
+
+			if (Character == L'\\')
+			{
+				if (Position + 1 < Length && DnIsSpecial(DN[Position + 1]))
+				{
+					Position += 2;
+				}
+				else if (DnHexEscape(DN, Length, Position) >= 0)
+				{
+					Position += 3;
+				}
+				else
+				{
+					goto Exit;
+				}
+
+				Attribute->Flags |= DNAF_ESCAPED;
+
+				ValueEnd = Position;
+			}
+			else if (Character == L'"' || Character == L'<' || Character == L'>' || Character == L'\0')
+			{
+				goto Exit;
+			}
+			else
+			{
+				Position++;
+
+				if (Character != L' ')
+				{
+					ValueEnd = Position;
+				}
+			}
+		}
+	}
+
+	Attribute->Value.Length = ValueEnd - Attribute->Value.Offset;
+
+	Attribute->Rdn = Reader->Rdn;
+
+	// Then the end of the DN, a + for another attribute in the same RDN, or a comma for the next RDN.
+
+	if (Position == Length)
+	{
+		Reader->Result = ERROR_NO_MORE_ITEMS;
+	}
+	else if (DN[Position] == L'+')
+	{
+		Position++;
+	}
+	else if (DN[Position] == L',' || DN[Position] == L';')
+	{
+		Position++;
+
+		Reader->Rdn++;
+	}
+	else
+	{
+		goto Exit;
+	}
+
+	Reader->Position = Position;
+
+	Result = ERROR_SUCCESS;
+
+Exit:
+
+	if (Result != ERROR_SUCCESS)
+	{
+		memset(Attribute, 0, sizeof(DN_ATTRIBUTE));
+
+		Reader->Result = Result;
+	}
+
+	return(Result);
+}
+
+// Whether the attribute is of the type named, ignoring case, or of the type's OID.
+
+BOOL DnTypeIs(_In_ wchar_t* DN, _In_ DN_ATTRIBUTE* Attribute, _In_ wchar_t* Type)
+{
+	wchar_t* Name = DN + Attribute->Type.Offset;
+
+	if (Attribute->Type.Length == 0)
+	{
+		return(FALSE);
+	}
+
+	if (DnIsDigit(Name[0]))
+	{
+		for (DWORD Index = 0; Index < _countof(gDnTypeOids); Index++)
+		{
+			if (_wcsicmp(Type, gDnTypeOids[Index].Name) == 0)
+			{
+				Type = gDnTypeOids[Index].Oid;
+
+				break;
+			}
+		}
+	}
+
+	return(wcslen(Type) == Attribute->Type.Length && _wcsnicmp(Name, Type, Attribute->Type.Length) == 0);
+}
+
+// Copies the attribute's value into Destination with its escapes undone. Hex escapes are UTF-8, and a byte that isn't
+// part of a valid sequence, or an escaped NUL, becomes U+FFFD. A #hex value is copied as it's written. The copy is
+// always terminated; ERROR_INSUFFICIENT_BUFFER if it had to be cut short, at a whole character.
+
+DWORD DnCopyValue(_In_ wchar_t* DN, _In_ DN_ATTRIBUTE* Attribute, _Out_ wchar_t* Destination, _In_ size_t Count)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	wchar_t* Value = DN + Attribute->Value.Offset;
+
+	DWORD Length = Attribute->Value.Length;
+
+	size_t Written = 0;
+
+	if (Count == 0)
+	{
+		return(ERROR_INSUFFICIENT_BUFFER);
+	}
+
+	if ((Attribute->Flags & DNAF_ESCAPED) == 0)
+	{
+		Written = min(Length, Count - 1);
+
+		wmemcpy(Destination, Value, Written);
+
+		Destination[Written] = L'\0';
+
+		return(Written < Length ? ERROR_INSUFFICIENT_BUFFER : ERROR_SUCCESS);
+	}
+
+	for (DWORD Position = 0; Position < Length; )
+	{
+		UINT32 CodePoint = 0;
+
+		int Byte = DnHexEscape(Value, Length, Position);
+
+		if (Value[Position] != L'\\')
+		{
+			CodePoint = Value[Position++];
+		}
+		else if (Byte < 0)
+		{
+			CodePoint = Value[Position + 1];
+
+			Position += 2;
+		}
+		else
+		{
+			// The lead byte says how many continuation bytes should follow, and the smallest code point that needs
+			// that many, so an overlong encoding can be turned away.
+
+			int Needed = Byte < 0x80 ? 0 : (Byte >= 0xC2 && Byte <= 0xDF ? 1 : (Byte >= 0xE0 && Byte <= 0xEF ? 2 : (Byte >= 0xF0 && Byte <= 0xF4 ? 3 : -1)));
+
+			static const UINT32 Smallest[] = { 0, 0x80, 0x800, 0x10000 };
+
+			Position += 3;
+
+			if (Needed < 0)
+			{
+				CodePoint = 0xFFFD;
+			}
+			else
+			{
+				CodePoint = Needed == 0 ? (UINT32)Byte : ((UINT32)Byte & (0x3F >> Needed));
+
+				for (int Continuation = 0; Continuation < Needed; Continuation++)
+				{
+					int Next = DnHexEscape(Value, Length, Position);
+
+					if (Next < 0x80 || Next > 0xBF)
+					{
+						CodePoint = 0xFFFD;
+
+						Needed = 0;
+
+						break;
+					}
+
+					CodePoint = (CodePoint << 6) | ((UINT32)Next & 0x3F);
+
+					Position += 3;
+				}
+
+				if (CodePoint == 0 || CodePoint < Smallest[Needed] || CodePoint > 0x10FFFF || (CodePoint >= 0xD800 && CodePoint <= 0xDFFF))
+				{
+					CodePoint = 0xFFFD;
+				}
+			}
+		}
+
+		if (CodePoint >= 0x10000)
+		{
+			if (Written + 2 >= Count)
+			{
+				Result = ERROR_INSUFFICIENT_BUFFER;
+
+				break;
+			}
+
+			Destination[Written++] = (wchar_t)(0xD800 + ((CodePoint - 0x10000) >> 10));
+
+			Destination[Written++] = (wchar_t)(0xDC00 + ((CodePoint - 0x10000) & 0x3FF));
+		}
+		else
+		{
+			if (Written + 1 >= Count)
+			{
+				Result = ERROR_INSUFFICIENT_BUFFER;
+
+				break;
+			}
+
+			Destination[Written++] = (wchar_t)CodePoint;
+		}
+	}
+
+	Destination[Written] = L'\0';
+
+	return(Result);
+}
+
+// The value of the first attribute of a DN, e.g. Seattle from CN=Seattle,CN=Sites,..., unescaped. Destination is
+// left empty, and the result is ERROR_INVALID_DATA, if any part of the DN is invalid.
+
+DWORD DnFirstValue(_In_ wchar_t* DN, _Out_ wchar_t* Destination, _In_ size_t Count)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DN_READER Reader = { 0 };
+
+	DN_ATTRIBUTE First = { 0 };
+
+	DN_ATTRIBUTE Attribute = { 0 };
+
+	if (Count)
+	{
+		Destination[0] = L'\0';
+	}
+
+	InitializeDnReader(&Reader, DN, (DWORD)wcslen(DN));
+
+	if ((Result = DnNextAttribute(&Reader, &First)) != ERROR_SUCCESS)
+	{
+		return(Result);
+	}
+
+	while ((Result = DnNextAttribute(&Reader, &Attribute)) == ERROR_SUCCESS)
+	{
+	}
+
+	if (Result != ERROR_NO_MORE_ITEMS)
+	{
+		return(Result);
+	}
+
+	return(DnCopyValue(DN, &First, Destination, Count));
+}
+
+// The DN of the object's parent, e.g. CN=Servers,CN=Seattle,... from CN=DC01,CN=Servers,CN=Seattle,..., as a
+// pointer into DN. NULL if DN is invalid or has no parent.
+
+wchar_t* DnParent(_In_ wchar_t* DN)
+{
+	DN_READER Reader = { 0 };
+
+	DN_ATTRIBUTE Attribute = { 0 };
+
+	wchar_t* Parent = NULL;
+
+	InitializeDnReader(&Reader, DN, (DWORD)wcslen(DN));
+
+	while (DnNextAttribute(&Reader, &Attribute) == ERROR_SUCCESS)
+	{
+		if (Attribute.Rdn == 1 && Parent == NULL)
+		{
+			Parent = DN + Attribute.Type.Offset;
+		}
+	}
+
+	return(Reader.Result == ERROR_NO_MORE_ITEMS ? Parent : NULL);
+}
+
+// The DNS name of the domain a DN is in, from its DC= attributes: contoso.com from ...,DC=contoso,DC=com.
+// ERROR_NOT_FOUND if it has none.
+
+DWORD DnToDomainName(_In_ wchar_t* DN, _Out_ wchar_t* Destination, _In_ size_t Count)
+{
+	DWORD Result = ERROR_NOT_FOUND;
+
+	DN_READER Reader = { 0 };
+
+	DN_ATTRIBUTE Attribute = { 0 };
+
+	size_t Written = 0;
+
+	if (Count == 0)
+	{
+		return(ERROR_INSUFFICIENT_BUFFER);
+	}
+
+	Destination[0] = L'\0';
+
+	InitializeDnReader(&Reader, DN, (DWORD)wcslen(DN));
+
+	while (DnNextAttribute(&Reader, &Attribute) == ERROR_SUCCESS)
+	{
+		if (DnTypeIs(DN, &Attribute, L"DC") == FALSE || Result == ERROR_INSUFFICIENT_BUFFER)
+		{
+			continue;
+		}
+
+		if (Written > 0)
+		{
+			if (Written + 1 >= Count)
+			{
+				Result = ERROR_INSUFFICIENT_BUFFER;
+
+				continue;
+			}
+
+			Destination[Written++] = L'.';
+		}
+
+		Result = DnCopyValue(DN, &Attribute, Destination + Written, Count - Written);
+
+		Written += wcslen(Destination + Written);
+	}
+
+	if (Reader.Result != ERROR_NO_MORE_ITEMS)
+	{
+		Destination[0] = L'\0';
+
+		return(Reader.Result);
+	}
+
+	return(Result);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+// Distinguished names, as RFC 4514 writes them: CN=DC01,CN=Servers,CN=Seattle,CN=Sites,CN=Configuration,DC=contoso,
+// DC=com. A DN is read one attribute at a time, and each attribute comes back as views into the DN, so nothing is
+// copied unless a caller wants the value on its own. Escaped characters (\, or \2C for a comma), values written as
+// #hex, numeric attribute types and multi-valued RDNs (CN=x+UID=y) are all understood. Anything RFC 4514 doesn't
+// allow makes the DN invalid, rather than being guessed at. Spaces around the separators are skipped, as they are by
+// every directory that reads RFC 2253 DNs, and so is a semicolon in place of a comma.
+
+// Part of a DN, by where it starts and how many characters long it is.
+typedef struct DN_VIEW
+{
+	DWORD Offset;
+
+	DWORD Length;
+
+} DN_VIEW;
+
+typedef enum DN_ATTRIBUTE_FLAGS
+{
+	// The value has at least one backslash escape in it, so the view isn't the value as it stands.
+	DNAF_ESCAPED = 1,
+
+	// The value is # followed by the hex of its BER encoding.
+	DNAF_HEX = 2
+
+} DN_ATTRIBUTE_FLAGS;
+
+typedef struct DN_ATTRIBUTE
+{
+	DN_VIEW Type;
+
+	// As written: escapes left in, and the spaces that aren't part of it left out.
+	DN_VIEW Value;
+
+	// Which RDN the attribute is in, counting from the left. The attributes of a multi-valued RDN share one.
+	DWORD Rdn;
+
+	DWORD Flags;
+
+} DN_ATTRIBUTE;
+
+typedef struct DN_READER
+{
+	wchar_t* DN;
+
+	DWORD Length;
+
+	DWORD Position;
+
+	DWORD Rdn;
+
+	// ERROR_SUCCESS until the end of the DN or the first thing wrong with it.
+	DWORD Result;
+
+} DN_READER;
+
+void InitializeDnReader(_Out_ DN_READER* Reader, _In_ wchar_t* DN, _In_ DWORD Length);
+
+DWORD DnNextAttribute(_Inout_ DN_READER* Reader, _Out_ DN_ATTRIBUTE* Attribute);
+
+BOOL DnTypeIs(_In_ wchar_t* DN, _In_ DN_ATTRIBUTE* Attribute, _In_ wchar_t* Type);
+
+DWORD DnCopyValue(_In_ wchar_t* DN, _In_ DN_ATTRIBUTE* Attribute, _Out_ wchar_t* Destination, _In_ size_t Count);
+
+DWORD DnFirstValue(_In_ wchar_t* DN, _Out_ wchar_t* Destination, _In_ size_t Count);
+
+wchar_t* DnParent(_In_ wchar_t* DN);
+
+DWORD DnToDomainName(_In_ wchar_t* DN, _Out_ wchar_t* Destination, _In_ size_t Count);
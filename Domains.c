@@ -0,0 +1,459 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Concurrent per-domain discovery. See Domains.h.
+
+#include <Windows.h>
+
+#include <NtDsAPI.h>
+
+#include <DsGetDC.h>
+
+#include <LM.h>
+
+#include <stdlib.h>
+
+#include "Main.h"
+
+#include "Trace.h"
+
+#include "Cancel.h"
+
+#include "DistinguishedName.h"
+
+#include "Domains.h"
+
+
+
+static void ReleaseDomainDiscovery(_In_ DOMAIN_DISCOVERY_SET* Set)
+{
+	if (InterlockedDecrement(&Set->References) != 0)
+	{
+		return;
+	}
+
+	for (DWORD Index = 0; Index < Set->Count; Index++)
+	{
+		if (Set->Domains[Index].DCs)
+		{
+			DsFreeDomainControllerInfoW(Set->Domains[Index].DCInfoLevel, Set->Domains[Index].DCCount, Set->Domains[Index].DCs);
+		}
+
+		if (Set->Domains[Index].Roles)
+		{
+			DsFreeNameResultW(Set->Domains[Index].Roles);
+		}
+	}
+
+	if (Set->DoneEvent)
+	{
+		CloseHandle(Set->DoneEvent);
+	}
+
+	if (Set->Domains)
+	{
+		HeapFree(GetProcessHeap(), 0, Set->Domains);
+	}
+
+	HeapFree(GetProcessHeap(), 0, Set);
+}
+
+static void CALLBACK DomainDiscoveryCallback(_Inout_ PTP_CALLBACK_INSTANCE Instance, _Inout_opt_ PVOID Context)
+{
+	DOMAIN_DISCOVERY* Domain = Context;
+
+	DOMAIN_DISCOVERY_SET* Set = Domain->Set;
+
+	DOMAIN_CONTROLLER_INFOW* DCLocatorInfo = NULL;
+
+	HANDLE BindHandle = NULL;
+
+	UINT64 Start = GetTickCount64();
+
+	// Each domain can take as long as its slowest DC, and discovery will stop waiting for it if it has to.
+
+	CallbackMayRunLong(Instance);
+
+	if (gContinue == FALSE)
+	{
+		Domain->Result = ERROR_CANCELLED;
+
+		goto Exit;
+	}
+
+	if ((Domain->Result = TRACED("DsGetDcNameW", DsGetDcNameW(NULL, Domain->DomainName, NULL, NULL, DS_DIRECTORY_SERVICE_REQUIRED | DS_RETURN_DNS_NAME, &DCLocatorInfo))) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	// DomainControllerName comes back with a leading \\, which DsBindW is fine with but isn't nice to log.
+
+	wcscpy_s(Domain->BoundDC, _countof(Domain->BoundDC), DCLocatorInfo->DomainControllerName + (wcsncmp(DCLocatorInfo->DomainControllerName, L"\\\\", 2) == 0 ? 2 : 0));
+
+	if (gContinue == FALSE)
+	{
+		Domain->Result = ERROR_CANCELLED;
+
+		goto Exit;
+	}
+
+	if ((Domain->Result = TRACED("DsBindW", DsBindW(DCLocatorInfo->DomainControllerName, Domain->DomainName, &BindHandle))) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	// One call for every DC in the domain, GC and RODC flags included. Level 3 is the first to say which DCs are
+	// read-only; a DC too old to know about it gets asked for level 2 instead.
+
+	Domain->DCInfoLevel = 3;
+
+	if ((Domain->Result = TRACED("DsGetDomainControllerInfoW", DsGetDomainControllerInfoW(BindHandle, Domain->DomainName, 3, &Domain->DCCount, &Domain->DCs))) != ERROR_SUCCESS)
+	{
+		Domain->DCInfoLevel = 2;
+
+		Domain->Result = TRACED("DsGetDomainControllerInfoW", DsGetDomainControllerInfoW(BindHandle, Domain->DomainName, 2, &Domain->DCCount, &Domain->DCs));
+	}
+
+	if (Domain->Result != ERROR_SUCCESS)
+	{
+		Domain->DCCount = 0;
+
+		Domain->DCs = NULL;
+
+		goto Exit;
+	}
+
+	if ((Domain->Result = TRACED("DsListRolesW", DsListRolesW(BindHandle, &Domain->Roles))) != ERROR_SUCCESS)
+	{
+		Domain->Roles = NULL;
+
+		goto Exit;
+	}
+
+Exit:
+
+	if (BindHandle)
+	{
+		DsUnBindW(&BindHandle);
+	}
+
+	if (DCLocatorInfo)
+	{
+		NetApiBufferFree(DCLocatorInfo);
+	}
+
+	Domain->ElapsedMilliseconds = GetTickCount64() - Start;
+
+	InterlockedExchange(&Domain->Done, TRUE);
+
+	if (InterlockedDecrement(&Set->Outstanding) == 0)
+	{
+		SetEvent(Set->DoneEvent);
+	}
+
+	ReleaseDomainDiscovery(Set);
+}
+
+// Starts a callback for every domain in the forest, as enumerated into ET_TRUST entities. Set is filled in even if
+// there are no domains to look at, in which case it is already done.
+
+DWORD StartDomainDiscovery(_In_ ENTITY* Entities, _Out_ DOMAIN_DISCOVERY_SET** Set)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DOMAIN_DISCOVERY_SET* New = NULL;
+
+	DWORD Count = 0;
+
+	*Set = NULL;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_TRUST && (Current->Flags & DS_DOMAIN_IN_FOREST))
+		{
+			Count++;
+		}
+	}
+
+	if ((New = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(DOMAIN_DISCOVERY_SET))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	New->References = 1;
+
+	if (Count > 0 && (New->Domains = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, Count * sizeof(DOMAIN_DISCOVERY))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	if ((New->DoneEvent = CreateEventW(NULL, TRUE, Count == 0, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_TRUST && (Current->Flags & DS_DOMAIN_IN_FOREST))
+		{
+			DOMAIN_DISCOVERY* Domain = &New->Domains[New->Count++];
+
+			wcscpy_s(Domain->DomainName, _countof(Domain->DomainName), Current->fqdn);
+
+			Domain->Result = ERROR_IO_PENDING;
+
+			Domain->Set = New;
+		}
+	}
+
+	// Count every callback as outstanding before submitting any, so an early finisher can't signal the event while
+	// the rest are still being submitted.
+
+	New->Outstanding = (LONG)New->Count;
+
+	New->References += (LONG)New->Count;
+
+	for (DWORD Index = 0; Index < New->Count; Index++)
+	{
+		if (TrySubmitThreadpoolCallback(DomainDiscoveryCallback, &New->Domains[Index], NULL) == FALSE)
+		{
+			New->Domains[Index].Result = GetLastError();
+
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] TrySubmitThreadpoolCallback failed with 0x%08lx!", __FUNCTIONW__, New->Domains[Index].Result);
+
+			if (InterlockedDecrement(&New->Outstanding) == 0)
+			{
+				SetEvent(New->DoneEvent);
+			}
+
+			InterlockedDecrement(&New->References);
+		}
+	}
+
+	*Set = New;
+
+	New = NULL;
+
+Exit:
+
+	if (New)
+	{
+		FreeDomainDiscovery(New);
+	}
+
+	return(Result);
+}
+
+// ERROR_CANCELLED if the user quits first.
+
+DWORD WaitForDomainDiscovery(_In_ DOMAIN_DISCOVERY_SET* Set, _In_ DWORD TimeoutMilliseconds)
+{
+	return(WaitOrCancel(Set->DoneEvent, TimeoutMilliseconds));
+}
+
+// The parts of a DS_DOMAIN_CONTROLLER_INFO_2W or _3W that discovery uses.
+typedef struct DOMAIN_DC_INFO
+{
+	wchar_t* DnsHostName;
+
+	wchar_t* ServerObjectName;
+
+	wchar_t* NtdsDsaObjectName;
+
+	DWORD Flags;
+
+} DOMAIN_DC_INFO;
+
+static void GetDomainDCInfo(_In_ DOMAIN_DISCOVERY* Domain, _In_ DWORD Index, _Out_ DOMAIN_DC_INFO* Info)
+{
+	if (Domain->DCInfoLevel == 3)
+	{
+		DS_DOMAIN_CONTROLLER_INFO_3W* DC = &((DS_DOMAIN_CONTROLLER_INFO_3W*)Domain->DCs)[Index];
+
+		*Info = (DOMAIN_DC_INFO){
+			.DnsHostName = DC->DnsHostName,
+			.ServerObjectName = DC->ServerObjectName,
+			.NtdsDsaObjectName = DC->NtdsDsaObjectName,
+			.Flags = (DC->fIsGc ? DCF_GC : 0) | (DC->fIsRodc ? DCF_RODC : 0) | (DC->fIsPdc ? DCF_PDCE : 0) };
+	}
+	else
+	{
+		DS_DOMAIN_CONTROLLER_INFO_2W* DC = &((DS_DOMAIN_CONTROLLER_INFO_2W*)Domain->DCs)[Index];
+
+		*Info = (DOMAIN_DC_INFO){
+			.DnsHostName = DC->DnsHostName,
+			.ServerObjectName = DC->ServerObjectName,
+			.NtdsDsaObjectName = DC->NtdsDsaObjectName,
+			.Flags = (DC->fIsGc ? DCF_GC : 0) | (DC->fIsPdc ? DCF_PDCE : 0) };
+	}
+}
+
+static int __cdecl CompareEntityDN(_In_ const void* A, _In_ const void* B)
+{
+	return(_wcsicmp((*(ENTITY**)A)->distinguishedname, (*(ENTITY**)B)->distinguishedname));
+}
+
+// DCs is sorted by CompareEntityDN.
+
+static ENTITY** FindDCByServerDN(_In_ ENTITY** DCs, _In_ DWORD DCCount, _In_ wchar_t* ServerDN)
+{
+	ENTITY Key = { 0 };
+
+	ENTITY* KeyPointer = &Key;
+
+	wcsncpy_s(Key.distinguishedname, _countof(Key.distinguishedname), ServerDN, _TRUNCATE);
+
+	return(bsearch(&KeyPointer, DCs, DCCount, sizeof(ENTITY*), CompareEntityDN));
+}
+
+// Folds what every finished domain reported into the DC entities found through the configuration NC, matching them
+// up by server object DN. Runs on the discovery thread once the callbacks are done or it has stopped waiting for
+// them. A callback still running only ever writes to its own domain, which is skipped.
+
+DWORD MergeDomainDiscovery(_In_ DOMAIN_DISCOVERY_SET* Set, _In_ ENTITY* Entities)
+{
+	// Indexed by DS_ROLE_*.
+	static const DWORD RoleFlags[] = { DCF_SCHEMAMASTER, DCF_DOMAINNAMINGMASTER, DCF_PDCE, DCF_RIDMASTER, DCF_INFRASTRUCTUREMASTER };
+
+	DWORD Result = ERROR_SUCCESS;
+
+	ENTITY** DCs = NULL;
+
+	DWORD DCCount = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		DCCount += (Current->Type == ET_DC);
+	}
+
+	if (DCCount > 0 && (DCs = HeapAlloc(GetProcessHeap(), 0, DCCount * sizeof(ENTITY*))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	DCCount = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			DCs[DCCount++] = Current;
+		}
+	}
+
+	qsort(DCs, DCCount, sizeof(ENTITY*), CompareEntityDN);
+
+	for (DWORD Index = 0; Index < Set->Count; Index++)
+	{
+		DOMAIN_DISCOVERY* Domain = &Set->Domains[Index];
+
+		DWORD Matched = 0;
+
+		if (Domain->Done == FALSE)
+		{
+			LogEventW(LL_WARN, LF_FILE, L"[%s] Domain %s didn't finish in time. Its DCs are left for the DC details workers.", __FUNCTIONW__, Domain->DomainName);
+
+			continue;
+		}
+
+		if (Domain->DCs == NULL)
+		{
+			LogEventW(LL_WARN, LF_FILE, L"[%s] Domain %s failed with 0x%08lx after %llu ms. Its DCs are left for the DC details workers.", __FUNCTIONW__, Domain->DomainName, Domain->Result, Domain->ElapsedMilliseconds);
+
+			continue;
+		}
+
+		for (DWORD DCIndex = 0; DCIndex < Domain->DCCount; DCIndex++)
+		{
+			DOMAIN_DC_INFO Info = { 0 };
+
+			ENTITY** Found = NULL;
+
+			GetDomainDCInfo(Domain, DCIndex, &Info);
+
+			// A DC whose server object has gone missing can't be placed in a site, so there's nothing to merge it into.
+
+			if (Info.ServerObjectName == NULL || (Found = FindDCByServerDN(DCs, DCCount, Info.ServerObjectName)) == NULL)
+			{
+				continue;
+			}
+
+			wcscpy_s((*Found)->domain, _countof((*Found)->domain), Domain->DomainName);
+
+			if (Info.DnsHostName && (*Found)->fqdn[0] == L'\0')
+			{
+				wcscpy_s((*Found)->fqdn, _countof((*Found)->fqdn), Info.DnsHostName);
+			}
+
+			if (Info.NtdsDsaObjectName)
+			{
+				wcscpy_s((*Found)->ntdssettingsdn, _countof((*Found)->ntdssettingsdn), Info.NtdsDsaObjectName);
+			}
+
+			(*Found)->Flags |= Info.Flags;
+
+			Matched++;
+		}
+
+		// Role owners are named by their NTDS Settings object, which sits directly under the server object.
+
+		for (DWORD Role = 0; Domain->Roles && Role < min(Domain->Roles->cItems, _countof(RoleFlags)); Role++)
+		{
+			wchar_t* Owner = Domain->Roles->rItems[Role].pName;
+
+			wchar_t* ServerDN = (Domain->Roles->rItems[Role].status == DS_NAME_NO_ERROR && Owner) ? DnParent(Owner) : NULL;
+
+			ENTITY** Found = ServerDN ? FindDCByServerDN(DCs, DCCount, ServerDN) : NULL;
+
+			if (Found)
+			{
+				(*Found)->Flags |= RoleFlags[Role];
+			}
+		}
+
+		LogEventW(LL_INFO, LF_FILE, L"[%s] Domain %s: %lu DCs via %s in %llu ms, %lu matched to servers in sites.", __FUNCTIONW__, Domain->DomainName, Domain->DCCount, Domain->BoundDC, Domain->ElapsedMilliseconds, Matched);
+
+		if (Domain->Roles && Domain->Roles->cItems > DS_ROLE_INFRASTRUCTURE_OWNER)
+		{
+			LogEventW(LL_INFO, LF_FILE, L"[%s] Domain %s: PDC %s, RID %s, Infrastructure %s.", __FUNCTIONW__,
+				Domain->DomainName,
+				Domain->Roles->rItems[DS_ROLE_PDC_OWNER].pName ? Domain->Roles->rItems[DS_ROLE_PDC_OWNER].pName : L"?",
+				Domain->Roles->rItems[DS_ROLE_RID_OWNER].pName ? Domain->Roles->rItems[DS_ROLE_RID_OWNER].pName : L"?",
+				Domain->Roles->rItems[DS_ROLE_INFRASTRUCTURE_OWNER].pName ? Domain->Roles->rItems[DS_ROLE_INFRASTRUCTURE_OWNER].pName : L"?");
+		}
+	}
+
+Exit:
+
+	if (DCs)
+	{
+		HeapFree(GetProcessHeap(), 0, DCs);
+	}
+
+	return(Result);
+}
+
+void FreeDomainDiscovery(_In_opt_ DOMAIN_DISCOVERY_SET* Set)
+{
+	if (Set == NULL)
+	{
+		return;
+	}
+
+	// Callbacks still running free the set once the last of them returns, bind handles and results included.
+
+	if (Set->Outstanding != 0)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] %ld domains still being discovered; abandoning them.", __FUNCTIONW__, Set->Outstanding);
+	}
+
+	ReleaseDomainDiscovery(Set);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Per-domain discovery. Sites and servers come from the configuration NC, which any DC can answer for, but what a
+// domain knows about its own DCs has to come from a DC in that domain. Every domain in the forest gets a thread pool
+// callback that locates and binds to one of its DCs, so the whole thing takes as long as the slowest domain rather
+// than the sum of them all.
+
+// How long discovery waits for the slowest domain. Whatever the domains that finished by then found is used; the DCs
+// the rest would have named are left for the DC details workers.
+#define DOMAIN_DISCOVERY_TIMEOUT_MS	120000
+
+typedef struct DOMAIN_DISCOVERY
+{
+	wchar_t DomainName[256];
+
+	// Filled in by the callback; nothing else touches a DOMAIN_DISCOVERY until the callback has finished.
+	DWORD Result;
+
+	UINT64 ElapsedMilliseconds;
+
+	wchar_t BoundDC[256];
+
+	DWORD DCCount;
+
+	// DS_DOMAIN_CONTROLLER_INFO_3W, or DS_DOMAIN_CONTROLLER_INFO_2W if the DC asked doesn't know about RODCs.
+	DWORD DCInfoLevel;
+
+	void* DCs;
+
+	// Indexed by DS_ROLE_*. Each pName is the NTDS Settings DN of the role owner. Every domain reports the two
+	// forest-wide roles as well as its own three.
+	DS_NAME_RESULTW* Roles;
+
+	struct DOMAIN_DISCOVERY_SET* Set;
+
+	// Set by the callback once it has written everything above, so discovery can use this domain's results without
+	// waiting for the others.
+	volatile LONG Done;
+
+} DOMAIN_DISCOVERY;
+
+typedef struct DOMAIN_DISCOVERY_SET
+{
+	DWORD Count;
+
+	DOMAIN_DISCOVERY* Domains;
+
+	volatile LONG Outstanding;
+
+	// Set by the last callback to finish.
+	HANDLE DoneEvent;
+
+	// One for each callback still running and one for whoever called StartDomainDiscovery. The set is freed when the
+	// last of them lets go, so discovery can give up on a domain without waiting for it.
+	volatile LONG References;
+
+} DOMAIN_DISCOVERY_SET;
+
+DWORD StartDomainDiscovery(_In_ ENTITY* Entities, _Out_ DOMAIN_DISCOVERY_SET** Set);
+
+DWORD WaitForDomainDiscovery(_In_ DOMAIN_DISCOVERY_SET* Set, _In_ DWORD TimeoutMilliseconds);
+
+DWORD MergeDomainDiscovery(_In_ DOMAIN_DISCOVERY_SET* Set, _In_ ENTITY* Entities);
+
+void FreeDomainDiscovery(_In_opt_ DOMAIN_DISCOVERY_SET* Set);
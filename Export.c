@@ -0,0 +1,465 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Streaming topology export to JSON, GraphML and DOT. Each exporter walks the entity list exactly once and writes
+// UTF-8 through a fixed-size buffer, so the whole document never exists in memory.
+//
+// Sites, DCs and site links become nodes identified by their distinguished name; trusted domains become nodes
+// identified by their DNS name. Every DC gets an edge to the site it lives in. GraphML and DOT both allow nodes and
+// edges in any order, which is what lets the edge be written as soon as its DC is reached.
+
+#include <Windows.h>
+
+#include <stdio.h>
+
+#include "Main.h"
+
+#include "Export.h"
+
+
+
+wchar_t* gExportExtensions[EF_COUNT] = { L"json", L"graphml", L"dot" };
+
+static const char* gExportTypeNames[] = { "none", "site", "dc", "sitelink", "trust" };
+
+static const char* gExportDCFlagNames[] = { "GC", "RODC", "PDCEmulator", "SchemaMaster", "DomainNamingMaster", "RIDMaster", "InfrastructureMaster" };
+
+
+
+static void ExportFlush(_Inout_ EXPORTWRITER* Writer)
+{
+	DWORD Written = 0;
+
+	if (Writer->Used == 0 || Writer->Result != ERROR_SUCCESS)
+	{
+		Writer->Used = 0;
+
+		return;
+	}
+
+	if (WriteFile(Writer->FileHandle, Writer->Buffer, Writer->Used, &Written, NULL) == FALSE)
+	{
+		Writer->Result = GetLastError();
+	}
+
+	Writer->BytesWritten += Written;
+
+	Writer->Used = 0;
+}
+
+static void ExportWriteA(_Inout_ EXPORTWRITER* Writer, _In_ const char* Text)
+{
+	while (*Text)
+	{
+		if (Writer->Used == EXPORT_BUFFER_BYTES)
+		{
+			ExportFlush(Writer);
+		}
+
+		Writer->Buffer[Writer->Used++] = *Text++;
+	}
+}
+
+static void ExportPrintA(_Inout_ EXPORTWRITER* Writer, _In_ const char* Format, ...)
+{
+	char Line[256] = { 0 };
+
+	va_list Args = NULL;
+
+	va_start(Args, Format);
+
+	_vsnprintf_s(Line, sizeof(Line), _TRUNCATE, Format, Args);
+
+	va_end(Args);
+
+	ExportWriteA(Writer, Line);
+}
+
+// Writes a UTF-16 string as UTF-8, escaped for whichever format is being written. Unpaired surrogates become U+FFFD.
+
+static void ExportWriteString(_Inout_ EXPORTWRITER* Writer, _In_ const wchar_t* Text)
+{
+	for (; *Text; Text++)
+	{
+		UINT32 CodePoint = *Text;
+
+		char Encoded[8] = { 0 };
+
+		int Length = 0;
+
+		// Reserve enough for the longest thing one character can turn into.
+
+		if (Writer->Used > EXPORT_BUFFER_BYTES - 8)
+		{
+			ExportFlush(Writer);
+		}
+
+		if (CodePoint >= 0xD800 && CodePoint <= 0xDBFF && Text[1] >= 0xDC00 && Text[1] <= 0xDFFF)
+		{
+			CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (Text[1] - 0xDC00);
+
+			Text++;
+		}
+		else if (CodePoint >= 0xD800 && CodePoint <= 0xDFFF)
+		{
+			CodePoint = 0xFFFD;
+		}
+
+		switch (CodePoint)
+		{
+			case L'"':
+			{
+				ExportWriteA(Writer, Writer->Format == EF_GRAPHML ? "&quot;" : "\\\"");
+
+				continue;
+			}
+			case L'\\':
+			{
+				ExportWriteA(Writer, Writer->Format == EF_GRAPHML ? "\\" : "\\\\");
+
+				continue;
+			}
+			case L'&':
+			case L'<':
+			case L'>':
+			{
+				if (Writer->Format == EF_GRAPHML)
+				{
+					ExportWriteA(Writer, CodePoint == L'&' ? "&amp;" : (CodePoint == L'<' ? "&lt;" : "&gt;"));
+
+					continue;
+				}
+
+				break;
+			}
+		}
+
+		if (CodePoint < 0x20)
+		{
+			// Control characters have no business in a DN, but they're legal in one, and they'd break all three formats.
+
+			if (Writer->Format == EF_JSON)
+			{
+				ExportPrintA(Writer, "\\u%04x", CodePoint);
+			}
+			else if (Writer->Format == EF_GRAPHML)
+			{
+				ExportPrintA(Writer, "&#xFFFD;");
+			}
+
+			continue;
+		}
+
+		if (CodePoint < 0x80)
+		{
+			Encoded[Length++] = (char)CodePoint;
+		}
+		else if (CodePoint < 0x800)
+		{
+			Encoded[Length++] = (char)(0xC0 | (CodePoint >> 6));
+
+			Encoded[Length++] = (char)(0x80 | (CodePoint & 0x3F));
+		}
+		else if (CodePoint < 0x10000)
+		{
+			Encoded[Length++] = (char)(0xE0 | (CodePoint >> 12));
+
+			Encoded[Length++] = (char)(0x80 | ((CodePoint >> 6) & 0x3F));
+
+			Encoded[Length++] = (char)(0x80 | (CodePoint & 0x3F));
+		}
+		else
+		{
+			Encoded[Length++] = (char)(0xF0 | (CodePoint >> 18));
+
+			Encoded[Length++] = (char)(0x80 | ((CodePoint >> 12) & 0x3F));
+
+			Encoded[Length++] = (char)(0x80 | ((CodePoint >> 6) & 0x3F));
+
+			Encoded[Length++] = (char)(0x80 | (CodePoint & 0x3F));
+		}
+
+		memcpy(&Writer->Buffer[Writer->Used], Encoded, Length);
+
+		Writer->Used += Length;
+	}
+}
+
+static const wchar_t* ExportEntityId(_In_ ENTITY* Entity)
+{
+	return(Entity->distinguishedname[0] ? Entity->distinguishedname : Entity->fqdn);
+}
+
+// Writes the names of the role flags that are set, as a list of JSON strings or space separated for everything else.
+
+static void ExportDCRoles(_Inout_ EXPORTWRITER* Writer, _In_ DWORD Flags)
+{
+	BOOL First = TRUE;
+
+	for (int Flag = 0; Flag < _countof(gExportDCFlagNames); Flag++)
+	{
+		if (Flags & (1 << Flag))
+		{
+			if (Writer->Format == EF_JSON)
+			{
+				ExportPrintA(Writer, "%s\"%s\"", First ? "" : ",", gExportDCFlagNames[Flag]);
+			}
+			else
+			{
+				ExportPrintA(Writer, "%s%s", First ? "" : " ", gExportDCFlagNames[Flag]);
+			}
+
+			First = FALSE;
+		}
+	}
+}
+
+static void ExportEntityJson(_Inout_ EXPORTWRITER* Writer, _In_ ENTITY* Entity, _In_ BOOL First)
+{
+	ExportPrintA(Writer, "%s\n{\"type\":\"%s\",\"id\":\"", First ? "" : ",", gExportTypeNames[Entity->Type]);
+
+	ExportWriteString(Writer, ExportEntityId(Entity));
+
+	ExportWriteA(Writer, "\",\"name\":\"");
+
+	ExportWriteString(Writer, Entity->name);
+
+	ExportWriteA(Writer, "\"");
+
+	if (Entity->fqdn[0])
+	{
+		ExportWriteA(Writer, ",\"fqdn\":\"");
+
+		ExportWriteString(Writer, Entity->fqdn);
+
+		ExportWriteA(Writer, "\"");
+	}
+
+	if (Entity->Type == ET_DC)
+	{
+		ExportWriteA(Writer, ",\"site\":\"");
+
+		ExportWriteString(Writer, Entity->site);
+
+		ExportWriteA(Writer, "\",\"domain\":\"");
+
+		ExportWriteString(Writer, Entity->domain);
+
+		ExportWriteA(Writer, "\",\"roles\":[");
+
+		ExportDCRoles(Writer, Entity->Flags);
+
+		ExportWriteA(Writer, "]");
+	}
+
+	ExportPrintA(Writer, ",\"flags\":%lu}", Entity->Flags);
+}
+
+static void ExportEntityGraphML(_Inout_ EXPORTWRITER* Writer, _In_ ENTITY* Entity)
+{
+	ExportWriteA(Writer, "<node id=\"");
+
+	ExportWriteString(Writer, ExportEntityId(Entity));
+
+	ExportPrintA(Writer, "\"><data key=\"type\">%s</data><data key=\"name\">", gExportTypeNames[Entity->Type]);
+
+	ExportWriteString(Writer, Entity->name);
+
+	ExportWriteA(Writer, "</data><data key=\"fqdn\">");
+
+	ExportWriteString(Writer, Entity->fqdn);
+
+	ExportPrintA(Writer, "</data><data key=\"flags\">%lu</data>", Entity->Flags);
+
+	if (Entity->Type == ET_DC)
+	{
+		ExportWriteA(Writer, "<data key=\"roles\">");
+
+		ExportDCRoles(Writer, Entity->Flags);
+
+		ExportWriteA(Writer, "</data>");
+	}
+
+	ExportWriteA(Writer, "</node>\n");
+
+	if (Entity->Type == ET_DC && Entity->site[0])
+	{
+		ExportWriteA(Writer, "<edge source=\"");
+
+		ExportWriteString(Writer, Entity->distinguishedname);
+
+		ExportWriteA(Writer, "\" target=\"");
+
+		ExportWriteString(Writer, Entity->site);
+
+		ExportWriteA(Writer, "\"><data key=\"type\">member</data></edge>\n");
+	}
+}
+
+static void ExportEntityDot(_Inout_ EXPORTWRITER* Writer, _In_ ENTITY* Entity)
+{
+	static const char* Shapes[] = { "point", "box", "triangle", "diamond", "ellipse" };
+
+	ExportWriteA(Writer, "\"");
+
+	ExportWriteString(Writer, ExportEntityId(Entity));
+
+	ExportPrintA(Writer, "\" [shape=%s, type=%s, flags=%lu, label=\"", Shapes[Entity->Type], gExportTypeNames[Entity->Type], Entity->Flags);
+
+	ExportWriteString(Writer, Entity->Type == ET_DC ? Entity->fqdn : Entity->name);
+
+	if (Entity->Type == ET_DC && Entity->Flags)
+	{
+		ExportWriteA(Writer, "\\n");
+
+		ExportDCRoles(Writer, Entity->Flags);
+	}
+
+	ExportWriteA(Writer, "\"];\n");
+
+	if (Entity->Type == ET_DC && Entity->site[0])
+	{
+		ExportWriteA(Writer, "\"");
+
+		ExportWriteString(Writer, Entity->distinguishedname);
+
+		ExportWriteA(Writer, "\" -> \"");
+
+		ExportWriteString(Writer, Entity->site);
+
+		ExportWriteA(Writer, "\";\n");
+	}
+}
+
+DWORD ExportTopology(_In_ wchar_t* FileName, _In_ EXPORT_FORMAT Format, _In_ ENTITY* Entities, _Out_opt_ UINT64* BytesWritten)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	EXPORTWRITER* Writer = NULL;
+
+	BOOL First = TRUE;
+
+	if ((Writer = HeapAlloc(GetProcessHeap(), 0, sizeof(EXPORTWRITER))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	Writer->Format = Format;
+
+	Writer->Result = ERROR_SUCCESS;
+
+	Writer->BytesWritten = 0;
+
+	Writer->Used = 0;
+
+	if ((Writer->FileHandle = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+	switch (Format)
+	{
+		case EF_JSON:
+		{
+			ExportPrintA(Writer, "{\"generator\":\"ADTV %d.%d\",\"entities\":[", PRODUCT_VERSION_MAJOR, PRODUCT_VERSION_MINOR);
+
+			break;
+		}
+		case EF_GRAPHML:
+		{
+			ExportWriteA(Writer,
+				"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				"<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+				"<key id=\"type\" for=\"all\" attr.name=\"type\" attr.type=\"string\"/>\n"
+				"<key id=\"name\" for=\"node\" attr.name=\"name\" attr.type=\"string\"/>\n"
+				"<key id=\"fqdn\" for=\"node\" attr.name=\"fqdn\" attr.type=\"string\"/>\n"
+				"<key id=\"flags\" for=\"node\" attr.name=\"flags\" attr.type=\"long\"/>\n"
+				"<key id=\"roles\" for=\"node\" attr.name=\"roles\" attr.type=\"string\"/>\n"
+				"<graph id=\"forest\" edgedefault=\"directed\">\n");
+
+			break;
+		}
+		case EF_DOT:
+		{
+			ExportWriteA(Writer, "digraph forest {\n");
+
+			break;
+		}
+		default:
+		{
+			Result = ERROR_INVALID_PARAMETER;
+
+			goto Exit;
+		}
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL && Writer->Result == ERROR_SUCCESS; Current = Current->Next)
+	{
+		if (Current->Type == ET_NONE)
+		{
+			continue;
+		}
+
+		switch (Format)
+		{
+			case EF_JSON:
+			{
+				ExportEntityJson(Writer, Current, First);
+
+				break;
+			}
+			case EF_GRAPHML:
+			{
+				ExportEntityGraphML(Writer, Current);
+
+				break;
+			}
+			case EF_DOT:
+			{
+				ExportEntityDot(Writer, Current);
+
+				break;
+			}
+		}
+
+		First = FALSE;
+	}
+
+	ExportWriteA(Writer, Format == EF_JSON ? "\n]}\n" : (Format == EF_GRAPHML ? "</graph>\n</graphml>\n" : "}\n"));
+
+	ExportFlush(Writer);
+
+	if ((Result = Writer->Result) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+	}
+
+Exit:
+
+	if (Writer)
+	{
+		if (BytesWritten)
+		{
+			*BytesWritten = Writer->BytesWritten;
+		}
+
+		if (Writer->FileHandle != INVALID_HANDLE_VALUE && Writer->FileHandle != NULL)
+		{
+			CloseHandle(Writer->FileHandle);
+		}
+
+		HeapFree(GetProcessHeap(), 0, Writer);
+	}
+	else if (BytesWritten)
+	{
+		*BytesWritten = 0;
+	}
+
+	return(Result);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Output is collected in a buffer this big and written to the file whenever it fills, so an export never needs more
+// memory than this no matter how large the forest is.
+#define EXPORT_BUFFER_BYTES		65536
+
+#define EXPORT_FILE_BASE_NAME	L"ADTV_topology"
+
+typedef enum EXPORT_FORMAT
+{
+	EF_JSON,
+
+	EF_GRAPHML,
+
+	EF_DOT,
+
+	EF_COUNT
+
+} EXPORT_FORMAT;
+
+typedef struct EXPORTWRITER
+{
+	HANDLE FileHandle;
+
+	EXPORT_FORMAT Format;
+
+	// The first error from WriteFile, if any. Once set, further writes are skipped.
+	DWORD Result;
+
+	UINT64 BytesWritten;
+
+	DWORD Used;
+
+	char Buffer[EXPORT_BUFFER_BYTES];
+
+} EXPORTWRITER;
+
+extern wchar_t* gExportExtensions[EF_COUNT];
+
+DWORD ExportTopology(_In_ wchar_t* FileName, _In_ EXPORT_FORMAT Format, _In_ ENTITY* Entities, _Out_opt_ UINT64* BytesWritten);
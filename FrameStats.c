@@ -0,0 +1,163 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Rolling frame-time statistics for the F11 overlay. Every frame's work time goes into a ring of the last
+// FRAME_STATS_WINDOW frames and into a histogram that always matches that ring, so percentiles are cheap to read and
+// a single slow frame stays visible for as long as it's in the window, instead of being averaged away.
+// Everything here is touched only by the UI thread.
+
+#include <Windows.h>
+
+#include "Main.h"
+
+#include "Probe.h"
+
+#include "FrameStats.h"
+
+
+
+wchar_t* gFrameStageNames[FS_COUNT] = { L"Clear", L"Cull", L"Record", L"Play", L"Tiles", L"Overlay", L"Blit" };
+
+static FRAMESAMPLE gFrameSamples[FRAME_STATS_WINDOW];
+
+static UINT64 gFrameSampleCount;
+
+static PROBE_HISTOGRAM gFrameHistogram;
+
+// The sample being filled in by the stages of the frame that's currently being rendered.
+static FRAMESAMPLE gCurrentFrame;
+
+static LARGE_INTEGER gStageMark;
+
+
+
+void FrameStageStart(void)
+{
+	QueryPerformanceCounter(&gStageMark);
+}
+
+// Charges the time since the last FrameStageStart or FrameStageEnd to Stage.
+
+void FrameStageEnd(_In_ FRAME_STAGE Stage)
+{
+	LARGE_INTEGER Now = { 0 };
+
+	QueryPerformanceCounter(&Now);
+
+	gCurrentFrame.StageMicroseconds[Stage] += (UINT32)(((Now.QuadPart - gStageMark.QuadPart) * 1000000) / gGraphicsData.PerformanceFrequency.QuadPart);
+
+	gStageMark = Now;
+}
+
+void FrameStatsEndFrame(_In_ UINT64 Microseconds, _In_ UINT32 EntitiesTested, _In_ UINT32 EntitiesDrawn)
+{
+	FRAMESAMPLE* Slot = &gFrameSamples[gFrameSampleCount % FRAME_STATS_WINDOW];
+
+	if (gFrameSampleCount >= FRAME_STATS_WINDOW)
+	{
+		HistogramRemove(&gFrameHistogram, Slot->Microseconds);
+	}
+
+	gCurrentFrame.Microseconds = (UINT32)min(Microseconds, MAXDWORD);
+
+	gCurrentFrame.EntitiesTested = EntitiesTested;
+
+	gCurrentFrame.EntitiesDrawn = EntitiesDrawn;
+
+	*Slot = gCurrentFrame;
+
+	HistogramRecord(&gFrameHistogram, gCurrentFrame.Microseconds);
+
+	gFrameSampleCount++;
+
+	memset(&gCurrentFrame, 0, sizeof(gCurrentFrame));
+}
+
+// The sample FrameStatsEndFrame added last.
+
+void FrameStatsLastFrame(_Out_ FRAMESAMPLE* Sample)
+{
+	memset(Sample, 0, sizeof(FRAMESAMPLE));
+
+	if (gFrameSampleCount > 0)
+	{
+		*Sample = gFrameSamples[(gFrameSampleCount - 1) % FRAME_STATS_WINDOW];
+	}
+}
+
+void FrameStatsSummarize(_Out_ FRAMESUMMARY* Summary)
+{
+	UINT64 StageTotals[FS_COUNT] = { 0 };
+
+	memset(Summary, 0, sizeof(FRAMESUMMARY));
+
+	Summary->Frames = (UINT32)min(gFrameSampleCount, FRAME_STATS_WINDOW);
+
+	if (Summary->Frames == 0)
+	{
+		return;
+	}
+
+	Summary->P50Microseconds = HistogramPercentile(&gFrameHistogram, 50);
+
+	Summary->P95Microseconds = HistogramPercentile(&gFrameHistogram, 95);
+
+	Summary->P99Microseconds = HistogramPercentile(&gFrameHistogram, 99);
+
+	for (UINT32 Sample = 0; Sample < Summary->Frames; Sample++)
+	{
+		Summary->MaxMicroseconds = max(Summary->MaxMicroseconds, gFrameSamples[Sample].Microseconds);
+
+		for (int Stage = 0; Stage < FS_COUNT; Stage++)
+		{
+			StageTotals[Stage] += gFrameSamples[Sample].StageMicroseconds[Stage];
+		}
+	}
+
+	for (int Stage = 0; Stage < FS_COUNT; Stage++)
+	{
+		Summary->StageAverageMicroseconds[Stage] = (float)StageTotals[Stage] / Summary->Frames;
+	}
+
+	Summary->EntitiesTested = gFrameSamples[(gFrameSampleCount - 1) % FRAME_STATS_WINDOW].EntitiesTested;
+
+	Summary->EntitiesDrawn = gFrameSamples[(gFrameSampleCount - 1) % FRAME_STATS_WINDOW].EntitiesDrawn;
+}
+
+// Draws the most recent frame times as a line, oldest on the left, with a horizontal line marking the frame budget.
+// Uses whatever pen is currently selected.
+
+void DrawFrameGraph(_In_ HDC DeviceContext, _In_ int Left, _In_ int Bottom)
+{
+	POINT Points[FRAME_GRAPH_FRAMES] = { 0 };
+
+	int Frames = (int)min(gFrameSampleCount, FRAME_GRAPH_FRAMES);
+
+	int BudgetY = Bottom - (int)((TARGET_MICROSECS_PER_FRAME * FRAME_GRAPH_HEIGHT) / FRAME_GRAPH_MAX_MICROSECS);
+
+	RECT Background = { Left, Bottom - FRAME_GRAPH_HEIGHT, Left + FRAME_GRAPH_FRAMES, Bottom + 1 };
+
+	FillRect(DeviceContext, &Background, GetStockObject(BLACK_BRUSH));
+
+	MoveToEx(DeviceContext, Left, BudgetY, NULL);
+
+	LineTo(DeviceContext, Left + FRAME_GRAPH_FRAMES, BudgetY);
+
+	if (Frames < 2)
+	{
+		return;
+	}
+
+	for (int Frame = 0; Frame < Frames; Frame++)
+	{
+		UINT64 Microseconds = gFrameSamples[(gFrameSampleCount - Frames + Frame) % FRAME_STATS_WINDOW].Microseconds;
+
+		Microseconds = min(Microseconds, FRAME_GRAPH_MAX_MICROSECS);
+
+		Points[Frame].x = Left + (FRAME_GRAPH_FRAMES - Frames) + Frame;
+
+		Points[Frame].y = Bottom - (int)((Microseconds * FRAME_GRAPH_HEIGHT) / FRAME_GRAPH_MAX_MICROSECS);
+	}
+
+	Polyline(DeviceContext, Points, Frames);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// How many of the most recent frames the percentiles, stage averages and max are taken over. About 17 seconds at 60 FPS.
+#define FRAME_STATS_WINDOW			1024
+
+// How many of the most recent frames the on-screen frame-time graph shows, one pixel per frame.
+#define FRAME_GRAPH_FRAMES			256
+
+#define FRAME_GRAPH_HEIGHT			100
+
+// The graph's vertical scale; frames that took longer than this are clipped to the top.
+#define FRAME_GRAPH_MAX_MICROSECS	(TARGET_MICROSECS_PER_FRAME * 2)
+
+// The parts of RenderFrameGraphics that are timed separately.
+typedef enum FRAME_STAGE
+{
+	FS_CLEAR,
+
+	FS_CULL,
+
+	FS_RECORD,		// Building the scene's render command list
+
+	FS_PLAY,		// Drawing it
+
+	FS_TILES,		// Or, zoomed out, blitting it from the tile pyramid instead
+
+	FS_OVERLAY,		// Text and status drawn straight over the scene
+
+	FS_BLIT,
+
+	FS_COUNT
+
+} FRAME_STAGE;
+
+typedef struct FRAMESAMPLE
+{
+	// Time spent working on the frame, not counting the sleep that paces us to TARGET_MICROSECS_PER_FRAME.
+	UINT32 Microseconds;
+
+	UINT32 StageMicroseconds[FS_COUNT];
+
+	UINT32 EntitiesTested;
+
+	UINT32 EntitiesDrawn;
+
+} FRAMESAMPLE;
+
+typedef struct FRAMESUMMARY
+{
+	UINT32 Frames;
+
+	UINT32 P50Microseconds;
+
+	UINT32 P95Microseconds;
+
+	UINT32 P99Microseconds;
+
+	UINT32 MaxMicroseconds;
+
+	float StageAverageMicroseconds[FS_COUNT];
+
+	UINT32 EntitiesTested;
+
+	UINT32 EntitiesDrawn;
+
+} FRAMESUMMARY;
+
+extern wchar_t* gFrameStageNames[FS_COUNT];
+
+void FrameStageStart(void);
+
+void FrameStageEnd(_In_ FRAME_STAGE Stage);
+
+void FrameStatsEndFrame(_In_ UINT64 Microseconds, _In_ UINT32 EntitiesTested, _In_ UINT32 EntitiesDrawn);
+
+void FrameStatsLastFrame(_Out_ FRAMESAMPLE* Sample);
+
+void FrameStatsSummarize(_Out_ FRAMESUMMARY* Summary);
+
+void DrawFrameGraph(_In_ HDC DeviceContext, _In_ int Left, _In_ int Bottom);
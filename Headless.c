@@ -0,0 +1,310 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Headless collection. See Headless.h.
+
+#include <Windows.h>
+
+#include <stdio.h>
+
+#include "Main.h"
+
+#include "Snapshot.h"
+
+#include "Export.h"
+
+#include "Diff.h"
+
+#include "DCDetails.h"
+
+#include "Cancel.h"
+
+#include "Timeline.h"
+
+#include "FrameStats.h"
+
+#include "InputTrace.h"
+
+#include "Layout.h"
+
+#include "Headless.h"
+
+
+
+static int gHeadlessCharWidth = HEADLESS_DEF_CHAR_WIDTH;
+
+static BOOL gHeadlessHaveConsole;
+
+
+
+static int MonospaceMeasureText(_In_ wchar_t* Text, _In_ int Length)
+{
+	UNREFERENCED_PARAMETER(Text);
+
+	return(Length * gHeadlessCharWidth);
+}
+
+static void HeadlessPrintW(_In_ wchar_t* Format, ...)
+{
+	va_list Args = NULL;
+
+	wchar_t Line[512] = { 0 };
+
+	DWORD Written = 0;
+
+	if (gHeadlessHaveConsole == FALSE)
+	{
+		return;
+	}
+
+	va_start(Args, Format);
+
+	_vsnwprintf_s(Line, _countof(Line), _TRUNCATE, Format, Args);
+
+	va_end(Args);
+
+	WriteConsoleW(GetStdHandle(STD_OUTPUT_HANDLE), Line, (DWORD)wcslen(Line), &Written, NULL);
+}
+
+// Ctrl+C stops discovery at the next remote call, instead of killing the process part way through writing a file.
+
+static BOOL WINAPI HeadlessCtrlHandler(_In_ DWORD CtrlType)
+{
+	if (CtrlType == CTRL_C_EVENT || CtrlType == CTRL_BREAK_EVENT)
+	{
+		RequestShutdown();
+
+		return(TRUE);
+	}
+
+	return(FALSE);
+}
+
+// Args are whatever followed -headless on the command line. Returns the process exit code: 0, or the error that
+// stopped us.
+
+DWORD RunHeadless(_In_ int ArgCount, _In_ wchar_t** Args)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	wchar_t* OutFileName = SNAPSHOT_DEF_FILE_NAME;
+
+	BOOL Layout = TRUE;
+
+	BOOL Export[EF_COUNT] = { 0 };
+
+	wchar_t* CompareFileName = NULL;
+
+	wchar_t* ReplayFileName = NULL;
+
+	TOPOLOGY_DIFF Diff = { 0 };
+
+	DWORD EntityCount = 0;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	gHeadlessHaveConsole = AttachConsole(ATTACH_PARENT_PROCESS);
+
+	SetConsoleCtrlHandler(HeadlessCtrlHandler, TRUE);
+
+	for (int Arg = 0; Arg < ArgCount; Arg++)
+	{
+		BOOL HaveValue = (Arg + 1 < ArgCount);
+
+		if (_wcsicmp(Args[Arg], L"-out") == 0 && HaveValue)
+		{
+			OutFileName = Args[++Arg];
+		}
+		else if (_wcsicmp(Args[Arg], L"-nolayout") == 0)
+		{
+			Layout = FALSE;
+		}
+		else if (_wcsicmp(Args[Arg], L"-charwidth") == 0 && HaveValue)
+		{
+			gHeadlessCharWidth = max(1, _wtoi(Args[++Arg]));
+		}
+		else if (_wcsicmp(Args[Arg], L"-compare") == 0 && HaveValue)
+		{
+			CompareFileName = Args[++Arg];
+		}
+		else if (_wcsicmp(Args[Arg], L"-replay") == 0 && HaveValue)
+		{
+			ReplayFileName = Args[++Arg];
+		}
+		else if (_wcsicmp(Args[Arg], L"-export") == 0 && HaveValue)
+		{
+			int Format = 0;
+
+			Arg++;
+
+			for (Format = 0; Format < EF_COUNT; Format++)
+			{
+				if (_wcsicmp(Args[Arg], gExportExtensions[Format]) == 0)
+				{
+					Export[Format] = TRUE;
+
+					break;
+				}
+			}
+
+			if (Format == EF_COUNT)
+			{
+				HeadlessPrintW(L"Unknown export format '%s'.\n", Args[Arg]);
+
+				Result = ERROR_INVALID_PARAMETER;
+
+				goto Exit;
+			}
+		}
+		else
+		{
+			HeadlessPrintW(L"Unknown option '%s'.\nUsage: ADTV.exe -headless [-out <file>] [-nolayout] [-charwidth <pixels>] [-export json|graphml|dot]... [-compare <snapshot>]\n       ADTV.exe -headless -replay <trace>\n", Args[Arg]);
+
+			Result = ERROR_INVALID_PARAMETER;
+
+			goto Exit;
+		}
+	}
+
+	// A replay draws the topology its trace was recorded against; there's nothing to discover.
+
+	if (ReplayFileName)
+	{
+		INPUT_REPLAY_SUMMARY Replay = { 0 };
+
+		wchar_t Summary[1024] = { 0 };
+
+		if ((Result = ReplayInputOffscreen(ReplayFileName, &Replay)) != ERROR_SUCCESS)
+		{
+			HeadlessPrintW(L"Failed to replay %s, error 0x%08lx. See %s for details.\n", ReplayFileName, Result, LOG_FILE_NAME);
+
+			goto Exit;
+		}
+
+		FormatInputReplaySummary(&Replay, Summary, _countof(Summary));
+
+		HeadlessPrintW(L"%s", Summary);
+
+		HeadlessPrintW(L"Frame times written to %s and %s.\n", INPUT_REPLAY_CSV_FILE_NAME, INPUT_REPLAY_SUMMARY_FILE_NAME);
+
+		goto Exit;
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Headless discovery beginning.", __FUNCTIONW__);
+
+	QueryPerformanceCounter(&Start);
+
+	if ((Result = DiscoverTopology()) != ERROR_SUCCESS ||
+		(Result = FetchMissingDCNames(gDiscoveryDC, gEntities)) != ERROR_SUCCESS)
+	{
+		if (Result == ERROR_CANCELLED)
+		{
+			HeadlessPrintW(L"Discovery cancelled.\n");
+		}
+		else
+		{
+			HeadlessPrintW(L"Discovery failed with error 0x%08lx. See %s for details.\n", Result, LOG_FILE_NAME);
+		}
+
+		goto Exit;
+	}
+
+	// There's no screen to fit the layout to.
+
+	if (Layout && (Result = LayoutTopology(gEntities, MonospaceMeasureText, (LAYOUT_MODE)gRegParams.Layout, LAYOUT_DEF_ASPECT_RATIO)) != ERROR_SUCCESS)
+	{
+		HeadlessPrintW(L"Layout failed with error 0x%08lx.\n", Result);
+
+		goto Exit;
+	}
+
+	if ((Result = SaveSnapshot(OutFileName, gEntities, Layout)) != ERROR_SUCCESS)
+	{
+		HeadlessPrintW(L"Failed to write %s, error 0x%08lx.\n", OutFileName, Result);
+
+		goto Exit;
+	}
+
+	// Run on a schedule, this is what builds up the timeline. Not being able to add to it isn't worth failing over.
+
+	if (gRegParams.KeepTimeline)
+	{
+		BOOL Added = FALSE;
+
+		DWORD TimelineResult = OpenTimeline(TIMELINE_FILE_NAME, gEntities, &Added);
+
+		if (TimelineResult != ERROR_SUCCESS)
+		{
+			HeadlessPrintW(L"Failed to add to %s, error 0x%08lx. See %s for details.\n", TIMELINE_FILE_NAME, TimelineResult, LOG_FILE_NAME);
+		}
+		else
+		{
+			HeadlessPrintW(Added ? L"Added version %lu to %s.\n" : L"No change since version %lu in %s.\n", GetTimelineCount(), TIMELINE_FILE_NAME);
+		}
+
+		CloseTimeline();
+	}
+
+	for (int Format = 0; Format < EF_COUNT; Format++)
+	{
+		wchar_t FileName[MAX_PATH] = { 0 };
+
+		if (Export[Format] == FALSE)
+		{
+			continue;
+		}
+
+		_snwprintf_s(FileName, _countof(FileName), _TRUNCATE, L"%s.%s", EXPORT_FILE_BASE_NAME, gExportExtensions[Format]);
+
+		if ((Result = ExportTopology(FileName, (EXPORT_FORMAT)Format, gEntities, NULL)) != ERROR_SUCCESS)
+		{
+			HeadlessPrintW(L"Failed to write %s, error 0x%08lx.\n", FileName, Result);
+
+			goto Exit;
+		}
+	}
+
+	if (CompareFileName)
+	{
+		if ((Result = CompareWithSnapshot(CompareFileName, gEntities, &Diff)) != ERROR_SUCCESS ||
+			(Result = WriteDiffReport(DIFF_REPORT_FILE_NAME, &Diff)) != ERROR_SUCCESS)
+		{
+			HeadlessPrintW(L"Failed to compare with %s, error 0x%08lx.\n", CompareFileName, Result);
+
+			goto Exit;
+		}
+
+		HeadlessPrintW(L"Compared with %s: %lu added, %lu removed, %lu changed. Report written to %s.\n",
+			CompareFileName,
+			Diff.KindCounts[DK_ADDED],
+			Diff.KindCounts[DK_REMOVED],
+			Diff.KindCounts[DK_CHANGED],
+			DIFF_REPORT_FILE_NAME);
+	}
+
+	QueryPerformanceCounter(&End);
+
+	for (ENTITY* Current = gEntities; Current != NULL; Current = Current->Next)
+	{
+		EntityCount++;
+	}
+
+	HeadlessPrintW(L"Discovered %lu entities in forest %s in %.1f seconds. Snapshot written to %s.\n",
+		EntityCount,
+		gForestName,
+		(double)(End.QuadPart - Start.QuadPart) / (double)gGraphicsData.PerformanceFrequency.QuadPart,
+		OutFileName);
+
+Exit:
+
+	FreeTopologyDiff(&Diff);
+
+	if (gHeadlessHaveConsole)
+	{
+		FreeConsole();
+	}
+
+	return(Result);
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// ADTV.exe -headless [-out <file>] [-nolayout] [-charwidth <pixels>] [-export json|graphml|dot]... [-compare <snapshot>]
+// ADTV.exe -headless -replay <trace>
+//
+// Runs discovery with no window, no GDI and no render loop, writes a snapshot, and exits. Meant for scheduled
+// collection on servers, including Server Core; open the snapshot later with ADTV.exe -open <file>. With -compare,
+// also writes a report of what changed since the given snapshot. With -replay, draws an input trace's frames offscreen
+// instead, and writes how long they took; see InputTrace.h.
+
+// Without GDI there's no font to measure with, so layout assumes every character of the huge font is this wide.
+// Consolas, the default font face, advances about 28 pixels per character at the huge font's 60 pixel cell height.
+#define HEADLESS_DEF_CHAR_WIDTH		28
+
+DWORD RunHeadless(_In_ int ArgCount, _In_ wchar_t** Args);
@@ -0,0 +1,1007 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Input trace recording and replay. See InputTrace.h.
+
+#include <Windows.h>
+
+#include <stdio.h>
+
+#include <stdlib.h>
+
+#include "Main.h"
+
+#include "Snapshot.h"
+
+#include "RenderList.h"
+
+#include "Cancel.h"
+
+#include "FrameStats.h"
+
+#include "Pick.h"
+
+#include "Search.h"
+
+#include "Labels.h"
+
+#include "Layout.h"
+
+#include "Scene.h"
+
+#include "InputTrace.h"
+
+
+
+// Open while F9 is recording.
+static HANDLE gInputRecordFile = INVALID_HANDLE_VALUE;
+
+static LARGE_INTEGER gInputRecordStart;
+
+static DWORD gInputRecordFrame;
+
+// The trace being replayed, if there is one, and how far through it the replay has got.
+static INPUT_TRACE_HEADER gInputReplayHeader;
+
+static INPUT_TRACE_EVENT* gInputReplayEvents;
+
+static DWORD gInputReplayEventCount;
+
+static DWORD gInputReplayNext;
+
+static DWORD gInputReplayFrameCount;
+
+static DWORD gInputReplayFrame;
+
+// One for each frame of the trace, filled in as they're replayed.
+static FRAMESAMPLE* gInputReplaySamples;
+
+static DWORD gInputReplayFirstDiverged = MAXDWORD;
+
+// Set once the camera and colour mode have been put back where they were when recording started.
+static BOOL gInputReplayStarted;
+
+// Set while a replayed message is being sent, so TraceInputMessage can tell it apart from real input.
+static BOOL gInputReplaySending;
+
+// Which keys were down at this point in the recording. GetKeyState has to see Ctrl held while the arrow keys are
+// replayed if it was held when they were recorded, whatever the real keyboard is doing now.
+static BYTE gInputReplayKeys[256];
+
+
+
+static BOOL IsTracedMessage(_In_ UINT Message, _In_ WPARAM WParam)
+{
+	switch (Message)
+	{
+		case WM_MOUSEMOVE:
+		case WM_LBUTTONDOWN:
+		case WM_LBUTTONUP:
+		case WM_MOUSEWHEEL:
+		case WM_CHAR:
+		{
+			return(TRUE);
+		}
+		case WM_KEYDOWN:
+		case WM_KEYUP:
+		{
+			// Replaying F9 would start another recording.
+
+			return(WParam != VK_F9);
+		}
+	}
+
+	return(FALSE);
+}
+
+static UINT64 InputRecordMicroseconds(void)
+{
+	LARGE_INTEGER Now = { 0 };
+
+	QueryPerformanceCounter(&Now);
+
+	return(((Now.QuadPart - gInputRecordStart.QuadPart) * 1000000) / gGraphicsData.PerformanceFrequency.QuadPart);
+}
+
+// A trace that can't be written to stops being recorded, rather than going on with a gap in it.
+
+static void WriteInputEvent(_In_ INPUT_TRACE_EVENT* Event)
+{
+	DWORD Written = 0;
+
+	if (WriteFile(gInputRecordFile, Event, sizeof(INPUT_TRACE_EVENT), &Written, NULL) == FALSE)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write to %s! Error 0x%08lx", __FUNCTIONW__, INPUT_TRACE_FILE_NAME, GetLastError());
+
+		CloseHandle(gInputRecordFile);
+
+		gInputRecordFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+// Records Message if a trace is being recorded. Returns FALSE for real input that arrives while a trace is being
+// replayed, which MainWindowProc then ignores.
+
+BOOL TraceInputMessage(_In_ UINT Message, _In_ WPARAM WParam, _In_ LPARAM LParam)
+{
+	INPUT_TRACE_EVENT Event = { 0 };
+
+	if (IsTracedMessage(Message, WParam) == FALSE)
+	{
+		return(TRUE);
+	}
+
+	if (gInputReplayEvents != NULL && gInputReplaySending == FALSE)
+	{
+		return(Message == WM_KEYDOWN && WParam == VK_ESCAPE);
+	}
+
+	if (gInputRecordFile != INVALID_HANDLE_VALUE)
+	{
+		Event.Frame = gInputRecordFrame;
+
+		Event.Message = Message;
+
+		Event.WParam = WParam;
+
+		Event.LParam = LParam;
+
+		Event.Time = InputRecordMicroseconds();
+
+		WriteInputEvent(&Event);
+	}
+
+	return(TRUE);
+}
+
+void ToggleInputRecording(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	INPUT_TRACE_HEADER Header = { 0 };
+
+	DWORD Written = 0;
+
+	if (gInputRecordFile != INVALID_HANDLE_VALUE)
+	{
+		LogEventW(LL_INFO, LF_FILE, L"[%s] Recorded %lu frames of input to %s.", __FUNCTIONW__, gInputRecordFrame, INPUT_TRACE_FILE_NAME);
+
+		CloseHandle(gInputRecordFile);
+
+		gInputRecordFile = INVALID_HANDLE_VALUE;
+
+		return;
+	}
+
+	// Where things are on screen now, which after L isn't where discovery put them, with their status as of now.
+
+	if ((Result = SaveSnapshot(INPUT_TRACE_SNAPSHOT_FILE_NAME, gFrameScene->Entities, TRUE)) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to save %s! Error 0x%08lx", __FUNCTIONW__, INPUT_TRACE_SNAPSHOT_FILE_NAME, Result);
+
+		goto Exit;
+	}
+
+	Header.Magic = INPUT_TRACE_MAGIC;
+
+	Header.Version = INPUT_TRACE_VERSION;
+
+	wcscpy_s(Header.SnapshotFileName, _countof(Header.SnapshotFileName), INPUT_TRACE_SNAPSHOT_FILE_NAME);
+
+	Header.Camera = gCamera;
+
+	Header.Resolution = gGraphicsData.Resolution;
+
+	Header.ClientWidth = gGraphicsData.ClientRect.right - gGraphicsData.ClientRect.left;
+
+	Header.ClientHeight = gGraphicsData.ClientRect.bottom - gGraphicsData.ClientRect.top;
+
+	Header.DCColorMode = gDCColorMode;
+
+	if ((gInputRecordFile = CreateFileW(INPUT_TRACE_FILE_NAME, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create %s! Error 0x%08lx", __FUNCTIONW__, INPUT_TRACE_FILE_NAME, Result);
+
+		goto Exit;
+	}
+
+	if (WriteFile(gInputRecordFile, &Header, sizeof(Header), &Written, NULL) == FALSE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write to %s! Error 0x%08lx", __FUNCTIONW__, INPUT_TRACE_FILE_NAME, Result);
+
+		goto Exit;
+	}
+
+	QueryPerformanceCounter(&gInputRecordStart);
+
+	gInputRecordFrame = 0;
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Recording input to %s.", __FUNCTIONW__, INPUT_TRACE_FILE_NAME);
+
+Exit:
+
+	if (Result != ERROR_SUCCESS && gInputRecordFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(gInputRecordFile);
+
+		gInputRecordFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+BOOL IsReplayingInput(void)
+{
+	return(gInputReplayEvents != NULL);
+}
+
+// Reads the whole trace in FileName, ready to be replayed, and returns the name of the snapshot it was recorded
+// against, which stays valid until StopInputTrace.
+
+DWORD StartInputReplay(_In_ wchar_t* FileName, _Out_ wchar_t** SnapshotFileName)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	HANDLE File = INVALID_HANDLE_VALUE;
+
+	LARGE_INTEGER FileSize = { 0 };
+
+	DWORD Read = 0;
+
+	DWORD EventBytes = 0;
+
+	*SnapshotFileName = NULL;
+
+	if ((File = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to open %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+	if (GetFileSizeEx(File, &FileSize) == FALSE)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	if (FileSize.QuadPart < (LONGLONG)sizeof(INPUT_TRACE_HEADER) || FileSize.QuadPart > MAXDWORD)
+	{
+		Result = ERROR_BAD_FORMAT;
+
+		goto Exit;
+	}
+
+	if (ReadFile(File, &gInputReplayHeader, sizeof(INPUT_TRACE_HEADER), &Read, NULL) == FALSE || Read != sizeof(INPUT_TRACE_HEADER))
+	{
+		Result = ERROR_BAD_FORMAT;
+
+		goto Exit;
+	}
+
+	if (gInputReplayHeader.Magic != INPUT_TRACE_MAGIC || gInputReplayHeader.Version != INPUT_TRACE_VERSION ||
+		gInputReplayHeader.Resolution.Width <= 0 || gInputReplayHeader.Resolution.Height <= 0 ||
+		gInputReplayHeader.DCColorMode >= DCCM_COUNT)
+	{
+		Result = ERROR_BAD_FORMAT;
+
+		goto Exit;
+	}
+
+	gInputReplayHeader.SnapshotFileName[_countof(gInputReplayHeader.SnapshotFileName) - 1] = L'\0';
+
+	gInputReplayEventCount = (DWORD)((FileSize.QuadPart - sizeof(INPUT_TRACE_HEADER)) / sizeof(INPUT_TRACE_EVENT));
+
+	EventBytes = gInputReplayEventCount * sizeof(INPUT_TRACE_EVENT);
+
+	if (gInputReplayEventCount == 0 || (gInputReplayEvents = HeapAlloc(GetProcessHeap(), 0, EventBytes)) == NULL)
+	{
+		Result = gInputReplayEventCount ? ERROR_NOT_ENOUGH_MEMORY : ERROR_BAD_FORMAT;
+
+		goto Exit;
+	}
+
+	if (ReadFile(File, gInputReplayEvents, EventBytes, &Read, NULL) == FALSE || Read != EventBytes)
+	{
+		Result = ERROR_BAD_FORMAT;
+
+		goto Exit;
+	}
+
+	// Whatever came after the last frame ended was cut off by F9, or by the process stopping; no frame drew it.
+
+	while (gInputReplayEventCount > 0 && gInputReplayEvents[gInputReplayEventCount - 1].Message != INPUT_TRACE_FRAME_END)
+	{
+		gInputReplayEventCount--;
+	}
+
+	for (DWORD Event = 0; Event < gInputReplayEventCount; Event++)
+	{
+		gInputReplayFrameCount += (gInputReplayEvents[Event].Message == INPUT_TRACE_FRAME_END);
+	}
+
+	if (gInputReplayFrameCount == 0)
+	{
+		Result = ERROR_BAD_FORMAT;
+
+		goto Exit;
+	}
+
+	if ((gInputReplaySamples = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, gInputReplayFrameCount * sizeof(FRAMESAMPLE))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	*SnapshotFileName = gInputReplayHeader.SnapshotFileName;
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Replaying %lu frames of input from %s against %s.", __FUNCTIONW__, gInputReplayFrameCount, FileName, *SnapshotFileName);
+
+Exit:
+
+	if (File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(File);
+	}
+
+	if (Result != ERROR_SUCCESS)
+	{
+		if (Result == ERROR_BAD_FORMAT)
+		{
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] %s is not an input trace this version can replay.", __FUNCTIONW__, FileName);
+		}
+
+		StopInputTrace();
+	}
+
+	return(Result);
+}
+
+// Puts the view back the way it was when recording started.
+
+static void BeginInputReplay(void)
+{
+	int ClientWidth = gGraphicsData.ClientRect.right - gGraphicsData.ClientRect.left;
+
+	int ClientHeight = gGraphicsData.ClientRect.bottom - gGraphicsData.ClientRect.top;
+
+	gCamera = gInputReplayHeader.Camera;
+
+	gDCColorMode = gInputReplayHeader.DCColorMode;
+
+	if (gGraphicsData.Resolution.Width != gInputReplayHeader.Resolution.Width ||
+		gGraphicsData.Resolution.Height != gInputReplayHeader.Resolution.Height ||
+		ClientWidth != gInputReplayHeader.ClientWidth ||
+		ClientHeight != gInputReplayHeader.ClientHeight)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] The trace was recorded at %dx%d in a %dx%d window, not %dx%d in %dx%d. Frame times won't be comparable, and the replay may diverge.",
+			__FUNCTIONW__,
+			gInputReplayHeader.Resolution.Width,
+			gInputReplayHeader.Resolution.Height,
+			gInputReplayHeader.ClientWidth,
+			gInputReplayHeader.ClientHeight,
+			gGraphicsData.Resolution.Width,
+			gGraphicsData.Resolution.Height,
+			ClientWidth,
+			ClientHeight);
+	}
+
+	gInputReplayStarted = TRUE;
+}
+
+// Sends MainWindowProc every message recorded in the frame the replay is up to.
+
+static void SendReplayedMessages(void)
+{
+	gInputReplaySending = TRUE;
+
+	while (gInputReplayNext < gInputReplayEventCount && gInputReplayEvents[gInputReplayNext].Message != INPUT_TRACE_FRAME_END)
+	{
+		INPUT_TRACE_EVENT* Event = &gInputReplayEvents[gInputReplayNext++];
+
+		if (Event->Message == WM_KEYDOWN || Event->Message == WM_KEYUP)
+		{
+			gInputReplayKeys[Event->WParam & 0xFF] = (Event->Message == WM_KEYDOWN) ? 0x80 : 0;
+		}
+
+		SetKeyboardState(gInputReplayKeys);
+
+		MainWindowProc(gMainWindowHandle, Event->Message, (WPARAM)Event->WParam, (LPARAM)Event->LParam);
+	}
+
+	gInputReplaySending = FALSE;
+}
+
+// Called once the frame the replay is up to has been drawn and FrameStatsEndFrame has its time.
+
+static void EndReplayedFrame(void)
+{
+	INPUT_TRACE_EVENT* FrameEnd = &gInputReplayEvents[gInputReplayNext++];
+
+	FrameStatsLastFrame(&gInputReplaySamples[gInputReplayFrame]);
+
+	if (gInputReplayFirstDiverged == MAXDWORD &&
+		(gCamera.x != FrameEnd->Camera.x || gCamera.y != FrameEnd->Camera.y || gCamera.z != FrameEnd->Camera.z))
+	{
+		gInputReplayFirstDiverged = gInputReplayFrame;
+
+		LogEventW(LL_WARN, LF_FILE, L"[%s] The replay diverged from the recording at frame %lu: the camera is at %d,%d,%d, not %d,%d,%d.",
+			__FUNCTIONW__,
+			gInputReplayFrame,
+			gCamera.x,
+			gCamera.y,
+			gCamera.z,
+			FrameEnd->Camera.x,
+			FrameEnd->Camera.y,
+			FrameEnd->Camera.z);
+	}
+
+	gInputReplayFrame++;
+}
+
+static int __cdecl InputReplayCompareMicroseconds(_In_ const void* A, _In_ const void* B)
+{
+	UINT32 Left = *(const UINT32*)A;
+
+	UINT32 Right = *(const UINT32*)B;
+
+	return((Left > Right) - (Left < Right));
+}
+
+// Sorts Microseconds in place.
+
+static UINT32 InputReplayPercentile(_Inout_ UINT32* Microseconds, _In_ DWORD Count, _In_ DWORD Percent)
+{
+	qsort(Microseconds, Count, sizeof(UINT32), InputReplayCompareMicroseconds);
+
+	return(Microseconds[((UINT64)(Count - 1) * Percent) / 100]);
+}
+
+static void InputReplayWriteLine(_In_ HANDLE File, _Inout_ DWORD* Result, _In_ wchar_t* Format, ...)
+{
+	va_list Args = NULL;
+
+	wchar_t Line[1024] = { 0 };
+
+	char Utf8[sizeof(Line) * 2] = { 0 };
+
+	int Length = 0;
+
+	DWORD Written = 0;
+
+	if (*Result != ERROR_SUCCESS)
+	{
+		return;
+	}
+
+	va_start(Args, Format);
+
+	_vsnwprintf_s(Line, _countof(Line), _TRUNCATE, Format, Args);
+
+	va_end(Args);
+
+	Length = WideCharToMultiByte(CP_UTF8, 0, Line, -1, Utf8, sizeof(Utf8), NULL, NULL);
+
+	if (Length <= 1)
+	{
+		return;
+	}
+
+	if (WriteFile(File, Utf8, Length - 1, &Written, NULL) == FALSE)
+	{
+		*Result = GetLastError();
+	}
+}
+
+// Once every frame of the trace has been replayed: summarizes their times, and writes them all out.
+
+static DWORD FinishInputReplay(_Out_ INPUT_REPLAY_SUMMARY* Summary)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	UINT32* Microseconds = NULL;
+
+	UINT32* RecordedMicroseconds = NULL;
+
+	UINT64 StageTotals[FS_COUNT] = { 0 };
+
+	HANDLE File = INVALID_HANDLE_VALUE;
+
+	DWORD Frame = 0;
+
+	wchar_t Text[1024] = { 0 };
+
+	memset(Summary, 0, sizeof(INPUT_REPLAY_SUMMARY));
+
+	Summary->FirstDiverged = gInputReplayFirstDiverged;
+
+	Summary->Replayed.Frames = gInputReplayFrame;
+
+	if ((Microseconds = HeapAlloc(GetProcessHeap(), 0, gInputReplayFrameCount * sizeof(UINT32))) == NULL ||
+		(RecordedMicroseconds = HeapAlloc(GetProcessHeap(), 0, gInputReplayFrameCount * sizeof(UINT32))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	if ((File = CreateFileW(INPUT_REPLAY_CSV_FILE_NAME, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create %s! Error 0x%08lx", __FUNCTIONW__, INPUT_REPLAY_CSV_FILE_NAME, Result);
+
+		goto Exit;
+	}
+
+	InputReplayWriteLine(File, &Result, L"Frame,Microseconds,Recorded microseconds");
+
+	for (int Stage = 0; Stage < FS_COUNT; Stage++)
+	{
+		InputReplayWriteLine(File, &Result, L",%s", gFrameStageNames[Stage]);
+	}
+
+	InputReplayWriteLine(File, &Result, L",Entities tested,Entities drawn\r\n");
+
+	for (DWORD Event = 0; Event < gInputReplayEventCount && Frame < gInputReplayFrame; Event++)
+	{
+		FRAMESAMPLE* Sample = &gInputReplaySamples[Frame];
+
+		if (gInputReplayEvents[Event].Message != INPUT_TRACE_FRAME_END)
+		{
+			continue;
+		}
+
+		Microseconds[Frame] = Sample->Microseconds;
+
+		RecordedMicroseconds[Frame] = gInputReplayEvents[Event].Microseconds;
+
+		Summary->Replayed.MaxMicroseconds = max(Summary->Replayed.MaxMicroseconds, Sample->Microseconds);
+
+		InputReplayWriteLine(File, &Result, L"%lu,%u,%u", Frame, Sample->Microseconds, RecordedMicroseconds[Frame]);
+
+		for (int Stage = 0; Stage < FS_COUNT; Stage++)
+		{
+			StageTotals[Stage] += Sample->StageMicroseconds[Stage];
+
+			InputReplayWriteLine(File, &Result, L",%u", Sample->StageMicroseconds[Stage]);
+		}
+
+		InputReplayWriteLine(File, &Result, L",%u,%u\r\n", Sample->EntitiesTested, Sample->EntitiesDrawn);
+
+		Frame++;
+	}
+
+	if (Result != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write %s! Error 0x%08lx", __FUNCTIONW__, INPUT_REPLAY_CSV_FILE_NAME, Result);
+
+		goto Exit;
+	}
+
+	if (Frame > 0)
+	{
+		Summary->Replayed.P50Microseconds = InputReplayPercentile(Microseconds, Frame, 50);
+
+		Summary->Replayed.P95Microseconds = InputReplayPercentile(Microseconds, Frame, 95);
+
+		Summary->Replayed.P99Microseconds = InputReplayPercentile(Microseconds, Frame, 99);
+
+		Summary->RecordedP50Microseconds = InputReplayPercentile(RecordedMicroseconds, Frame, 50);
+
+		Summary->RecordedP95Microseconds = InputReplayPercentile(RecordedMicroseconds, Frame, 95);
+
+		for (int Stage = 0; Stage < FS_COUNT; Stage++)
+		{
+			Summary->Replayed.StageAverageMicroseconds[Stage] = (float)StageTotals[Stage] / Frame;
+		}
+
+		Summary->Replayed.EntitiesTested = gInputReplaySamples[Frame - 1].EntitiesTested;
+
+		Summary->Replayed.EntitiesDrawn = gInputReplaySamples[Frame - 1].EntitiesDrawn;
+	}
+
+	CloseHandle(File);
+
+	if ((File = CreateFileW(INPUT_REPLAY_SUMMARY_FILE_NAME, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create %s! Error 0x%08lx", __FUNCTIONW__, INPUT_REPLAY_SUMMARY_FILE_NAME, Result);
+
+		goto Exit;
+	}
+
+	FormatInputReplaySummary(Summary, Text, _countof(Text));
+
+	InputReplayWriteLine(File, &Result, L"%s", Text);
+
+	if (Result != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write %s! Error 0x%08lx", __FUNCTIONW__, INPUT_REPLAY_SUMMARY_FILE_NAME, Result);
+	}
+
+Exit:
+
+	if (File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(File);
+	}
+
+	if (Microseconds)
+	{
+		HeapFree(GetProcessHeap(), 0, Microseconds);
+	}
+
+	if (RecordedMicroseconds)
+	{
+		HeapFree(GetProcessHeap(), 0, RecordedMicroseconds);
+	}
+
+	return(Result);
+}
+
+// Called at the start of every frame, after the real messages. Nothing is replayed until the topology is on screen.
+
+void ReplayInputFrame(void)
+{
+	if (gInputReplayEvents == NULL || gInputReplayFrame == gInputReplayFrameCount ||
+		WaitForSingleObject(gDiscoveryThread, 0) != DISCOVERY_THREAD_FINISHED)
+	{
+		return;
+	}
+
+	if (gInputReplayStarted == FALSE)
+	{
+		BeginInputReplay();
+	}
+
+	SendReplayedMessages();
+}
+
+// Called at the end of every frame, once FrameStatsEndFrame has its time.
+
+void EndInputFrame(void)
+{
+	INPUT_TRACE_EVENT Event = { 0 };
+
+	FRAMESAMPLE Sample = { 0 };
+
+	INPUT_REPLAY_SUMMARY Summary = { 0 };
+
+	wchar_t Text[1024] = { 0 };
+
+	if (gInputRecordFile != INVALID_HANDLE_VALUE)
+	{
+		FrameStatsLastFrame(&Sample);
+
+		Event.Frame = gInputRecordFrame++;
+
+		Event.Message = INPUT_TRACE_FRAME_END;
+
+		Event.Time = InputRecordMicroseconds();
+
+		Event.Camera = gCamera;
+
+		Event.Microseconds = Sample.Microseconds;
+
+		WriteInputEvent(&Event);
+	}
+	else if (gInputReplayStarted && gInputReplayFrame < gInputReplayFrameCount)
+	{
+		EndReplayedFrame();
+
+		if (gInputReplayFrame == gInputReplayFrameCount)
+		{
+			if (FinishInputReplay(&Summary) == ERROR_SUCCESS)
+			{
+				FormatInputReplaySummary(&Summary, Text, _countof(Text));
+
+				LogEventW(LL_INFO, LF_FILE, L"[%s] %s", __FUNCTIONW__, Text);
+			}
+
+			RequestShutdown();
+		}
+	}
+}
+
+// Replays the trace in FileName with no window, drawing each frame into an offscreen bitmap. See InputTrace.h.
+
+DWORD ReplayInputOffscreen(_In_ wchar_t* FileName, _Out_ INPUT_REPLAY_SUMMARY* Summary)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	wchar_t* SnapshotFileName = NULL;
+
+	BOOL LaidOut = FALSE;
+
+	SCENE* Scene = NULL;
+
+	RENDER_LIST* List = NULL;
+
+	HDC DeviceContext = NULL;
+
+	HBITMAP Bitmap = NULL;
+
+	void* Bits = NULL;
+
+	BITMAPINFO BitmapInfo = { 0 };
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	int Width = 0;
+
+	int Height = 0;
+
+	memset(Summary, 0, sizeof(INPUT_REPLAY_SUMMARY));
+
+	if ((Result = StartInputReplay(FileName, &SnapshotFileName)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	if ((Result = LoadSnapshot(SnapshotFileName, &gEntities, &LaidOut)) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] LoadSnapshot failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	// Laying it out again without GDI could put things somewhere else than they were when the trace was recorded.
+
+	if (LaidOut == FALSE)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] %s has no positions in it.", __FUNCTIONW__, SnapshotFileName);
+
+		Result = ERROR_BAD_FORMAT;
+
+		goto Exit;
+	}
+
+	// MainWindowProc only acts on input once discovery has finished. There is no discovery here, so an event that's
+	// already set stands in for its thread.
+
+	if ((gDiscoveryThread = CreateEventW(NULL, TRUE, TRUE, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	Width = gInputReplayHeader.Resolution.Width;
+
+	Height = gInputReplayHeader.Resolution.Height;
+
+	BitmapInfo.bmiHeader.biSize = sizeof(BitmapInfo.bmiHeader);
+
+	BitmapInfo.bmiHeader.biWidth = Width;
+
+	BitmapInfo.bmiHeader.biHeight = Height;
+
+	BitmapInfo.bmiHeader.biBitCount = 32;
+
+	BitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+	BitmapInfo.bmiHeader.biPlanes = 1;
+
+	if ((List = CreateRenderList()) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	if ((DeviceContext = CreateCompatibleDC(NULL)) == NULL ||
+		(Bitmap = CreateDIBSection(DeviceContext, &BitmapInfo, DIB_RGB_COLORS, &Bits, NULL, 0)) == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	SelectObject(DeviceContext, Bitmap);
+
+	SetBkMode(DeviceContext, TRANSPARENT);
+
+	SetTextColor(DeviceContext, RGB(255, 255, 255));
+
+	CreateDrawingObjects();
+
+	// Snapshots don't say where labels went, so place them the way discovery would have, measured in the bitmap that
+	// frames are drawn into.
+
+	{
+		LABEL_FONT LabelFonts[LFS_COUNT] = { 0 };
+
+		GdiLabelFont(DeviceContext, gGraphicsData.HugeFont, &LabelFonts[LFS_HUGE]);
+
+		GdiLabelFont(DeviceContext, gGraphicsData.BigFont, &LabelFonts[LFS_BIG]);
+
+		GdiLabelFont(DeviceContext, gGraphicsData.SmallFont, &LabelFonts[LFS_SMALL]);
+
+		PlaceLabels(gEntities, LabelFonts, NULL);
+	}
+
+	if ((Scene = CreateScene(gEntities, NULL, (LAYOUT_MODE)gRegParams.Layout)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	PublishScene(Scene);
+
+	gFrameScene = AcquireScene(SR_UI);
+
+	gGraphicsData.Resolution = gInputReplayHeader.Resolution;
+
+	SetRect(&gGraphicsData.ClientRect, 0, 0, gInputReplayHeader.ClientWidth, gInputReplayHeader.ClientHeight);
+
+	BeginInputReplay();
+
+	while (gInputReplayFrame < gInputReplayFrameCount && gContinue)
+	{
+		QueryPerformanceCounter(&Start);
+
+		SendReplayedMessages();
+
+		AnimateCamera();
+
+		FrameStageStart();
+
+		memset(Bits, 0, (UINT64)Width * (UINT64)Height * (32 / 8));
+
+		FrameStageEnd(FS_CLEAR);
+
+		CullEntities();
+
+		FrameStageEnd(FS_CULL);
+
+		ResetRenderList(List, Width, Height);
+
+		RecordScene(List);
+
+		FrameStageEnd(FS_RECORD);
+
+		if (List->Result != ERROR_SUCCESS)
+		{
+			Result = List->Result;
+
+			goto Exit;
+		}
+
+		PlayRenderList(List, DeviceContext);
+
+		GdiFlush();
+
+		FrameStageEnd(FS_PLAY);
+
+		QueryPerformanceCounter(&End);
+
+		FrameStatsEndFrame(((End.QuadPart - Start.QuadPart) * 1000000) / gGraphicsData.PerformanceFrequency.QuadPart, gGraphicsData.EntitiesTested, gGraphicsData.EntitiesOnScreen);
+
+		gGraphicsData.EntitiesTested = 0;
+
+		gGraphicsData.EntitiesOnScreen = 0;
+
+		gGraphicsData.TotalFramesRendered++;
+
+		EndReplayedFrame();
+	}
+
+	// Esc in the trace, or Ctrl+C.
+
+	if (gContinue == FALSE && gInputReplayFrame < gInputReplayFrameCount)
+	{
+		Result = ERROR_CANCELLED;
+
+		goto Exit;
+	}
+
+	Result = FinishInputReplay(Summary);
+
+Exit:
+
+	if (DeviceContext)
+	{
+		DeleteDC(DeviceContext);
+	}
+
+	if (Bitmap)
+	{
+		DeleteObject(Bitmap);
+	}
+
+	FreeRenderList(List);
+
+	if (gDiscoveryThread)
+	{
+		CloseHandle(gDiscoveryThread);
+
+		gDiscoveryThread = NULL;
+	}
+
+	ReleaseScene(SR_UI);
+
+	gFrameScene = NULL;
+
+	FreeScenes();
+
+	return(Result);
+}
+
+void FormatInputReplaySummary(_In_ INPUT_REPLAY_SUMMARY* Summary, _Out_ wchar_t* Text, _In_ size_t Length)
+{
+	wchar_t Diverged[128] = { 0 };
+
+	if (Summary->FirstDiverged == MAXDWORD)
+	{
+		wcscpy_s(Diverged, _countof(Diverged), L"Every frame matched the recording.");
+	}
+	else
+	{
+		_snwprintf_s(Diverged, _countof(Diverged), _TRUNCATE, L"Diverged from the recording at frame %lu; times after that can't be compared.", Summary->FirstDiverged);
+	}
+
+	_snwprintf_s(
+		Text,
+		Length,
+		_TRUNCATE,
+		L"Replayed %u frames.\r\n"
+		L"Frame ms p50:%.3f p95:%.3f p99:%.3f max:%.3f (recorded p50:%.3f p95:%.3f)\r\n"
+		L"Avg ms %s:%.3f %s:%.3f %s:%.3f %s:%.3f %s:%.3f %s:%.3f %s:%.3f\r\n"
+		L"%s\r\n",
+		Summary->Replayed.Frames,
+		Summary->Replayed.P50Microseconds / 1000.0f,
+		Summary->Replayed.P95Microseconds / 1000.0f,
+		Summary->Replayed.P99Microseconds / 1000.0f,
+		Summary->Replayed.MaxMicroseconds / 1000.0f,
+		Summary->RecordedP50Microseconds / 1000.0f,
+		Summary->RecordedP95Microseconds / 1000.0f,
+		gFrameStageNames[FS_CLEAR], Summary->Replayed.StageAverageMicroseconds[FS_CLEAR] / 1000.0f,
+		gFrameStageNames[FS_CULL], Summary->Replayed.StageAverageMicroseconds[FS_CULL] / 1000.0f,
+		gFrameStageNames[FS_RECORD], Summary->Replayed.StageAverageMicroseconds[FS_RECORD] / 1000.0f,
+		gFrameStageNames[FS_PLAY], Summary->Replayed.StageAverageMicroseconds[FS_PLAY] / 1000.0f,
+		gFrameStageNames[FS_TILES], Summary->Replayed.StageAverageMicroseconds[FS_TILES] / 1000.0f,
+		gFrameStageNames[FS_OVERLAY], Summary->Replayed.StageAverageMicroseconds[FS_OVERLAY] / 1000.0f,
+		gFrameStageNames[FS_BLIT], Summary->Replayed.StageAverageMicroseconds[FS_BLIT] / 1000.0f,
+		Diverged);
+}
+
+// Stops recording, and lets go of the trace being replayed. Safe to call whether or not either is happening.
+
+void StopInputTrace(void)
+{
+	if (gInputRecordFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(gInputRecordFile);
+
+		gInputRecordFile = INVALID_HANDLE_VALUE;
+	}
+
+	if (gInputReplayEvents)
+	{
+		HeapFree(GetProcessHeap(), 0, gInputReplayEvents);
+
+		gInputReplayEvents = NULL;
+	}
+
+	if (gInputReplaySamples)
+	{
+		HeapFree(GetProcessHeap(), 0, gInputReplaySamples);
+
+		gInputReplaySamples = NULL;
+	}
+
+	gInputReplayEventCount = 0;
+
+	gInputReplayFrameCount = 0;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+// F9 starts and stops recording an input trace: the same session can then be replayed on any build, so they can all
+// be timed doing exactly the same thing. Recording starts by saving the topology on screen, positions and all, as a
+// snapshot next to the trace, along with the camera and the size of the window. From then on, every mouse and keyboard
+// message MainWindowProc gets is written down with the frame it arrived in and the time since recording started, and
+// every frame ends with a record of where the camera was when it was drawn and how long it took.
+//
+// ADTV.exe -replay <trace> opens the trace's snapshot, as -open would, and once it's on screen, sends each message to
+// MainWindowProc again at the start of the frame it arrived in. Frames are replayed, not times, so a slower build draws
+// the same frames, just later. Real input is ignored while a trace is being replayed, apart from Esc. When the trace
+// runs out, each frame's time and stage times are written to INPUT_REPLAY_CSV_FILE_NAME, a summary of them to
+// INPUT_REPLAY_SUMMARY_FILE_NAME, and the process exits.
+//
+// ADTV.exe -headless -replay <trace> does the same with no window: the scene is drawn into an offscreen bitmap the size
+// of the recorded resolution, the way the render benchmark draws it, so only the stages that don't need a window are
+// timed. Zoomed-out frames are always drawn from scratch, not from tiles.
+//
+// Once a frame's camera isn't where it was when that frame was recorded, the replay has diverged: from there on it isn't
+// drawing what the recording did, and its times can't be compared. Replaying into a window that isn't the size the
+// recording's was does this as soon as the mouse wheel is used. Toggles like M and F11 are replayed, but what they were
+// set to when recording started isn't saved, so turn them on after pressing F9.
+//
+// Everything here is touched only by the UI thread, or the only thread there is, headless.
+//
+// File layout: an INPUT_TRACE_HEADER, then INPUT_TRACE_EVENTs until the end of the file.
+
+#define INPUT_TRACE_MAGIC				0x49544441	// "ADTI"
+
+#define INPUT_TRACE_VERSION				1
+
+#define INPUT_TRACE_FILE_NAME			L"ADTV_input.adtvi"
+
+#define INPUT_TRACE_SNAPSHOT_FILE_NAME	L"ADTV_input.adtv"
+
+#define INPUT_REPLAY_CSV_FILE_NAME		L"ADTV_replay.csv"
+
+#define INPUT_REPLAY_SUMMARY_FILE_NAME	L"ADTV_replay.txt"
+
+// The Message of the event that ends each frame.
+#define INPUT_TRACE_FRAME_END			WM_NULL
+
+typedef struct INPUT_TRACE_HEADER
+{
+	DWORD Magic;
+
+	DWORD Version;
+
+	// Where the topology the trace was recorded against was saved, relative to wherever ADTV.exe was running.
+	wchar_t SnapshotFileName[MAX_PATH];
+
+	CAMERA Camera;
+
+	RESOLUTION Resolution;
+
+	// Mouse positions are in client coordinates, and the mouse wheel zooms towards the mouse relative to the middle of
+	// the client area.
+	int ClientWidth;
+
+	int ClientHeight;
+
+	DWORD DCColorMode;
+
+} INPUT_TRACE_HEADER;
+
+typedef struct INPUT_TRACE_EVENT
+{
+	// Counting from the first frame drawn after recording started.
+	DWORD Frame;
+
+	UINT32 Message;
+
+	UINT64 WParam;
+
+	INT64 LParam;
+
+	// Microseconds since recording started.
+	UINT64 Time;
+
+	// Only for INPUT_TRACE_FRAME_END: where the camera was when the frame was drawn, and how long drawing it took.
+	CAMERA Camera;
+
+	UINT32 Microseconds;
+
+} INPUT_TRACE_EVENT;
+
+typedef struct INPUT_REPLAY_SUMMARY
+{
+	FRAMESUMMARY Replayed;
+
+	// MAXDWORD if the replay never diverged.
+	DWORD FirstDiverged;
+
+	// The same frames' times when they were recorded.
+	UINT32 RecordedP50Microseconds;
+
+	UINT32 RecordedP95Microseconds;
+
+} INPUT_REPLAY_SUMMARY;
+
+BOOL TraceInputMessage(_In_ UINT Message, _In_ WPARAM WParam, _In_ LPARAM LParam);
+
+void ToggleInputRecording(void);
+
+BOOL IsReplayingInput(void);
+
+DWORD StartInputReplay(_In_ wchar_t* FileName, _Out_ wchar_t** SnapshotFileName);
+
+void ReplayInputFrame(void);
+
+void EndInputFrame(void);
+
+DWORD ReplayInputOffscreen(_In_ wchar_t* FileName, _Out_ INPUT_REPLAY_SUMMARY* Summary);
+
+void FormatInputReplaySummary(_In_ INPUT_REPLAY_SUMMARY* Summary, _Out_ wchar_t* Text, _In_ size_t Length);
+
+void StopInputTrace(void);
@@ -0,0 +1,581 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// What-if simulation of the inter-site topology the ISTG would generate. See Kcc.h.
+
+#include <Windows.h>
+
+#include <stdlib.h>
+
+#include "Main.h"
+
+#include "Log.h"
+
+#include "SiteGraph.h"
+
+#include "Kcc.h"
+
+
+
+static int __cdecl KccCompareDCs(_In_ const void* A, _In_ const void* B)
+{
+	return(_wcsicmp((*(ENTITY**)A)->distinguishedname, (*(ENTITY**)B)->distinguishedname));
+}
+
+static int __cdecl KccCompareKeys(_In_ const void* A, _In_ const void* B)
+{
+	return((*(UINT64*)A > *(UINT64*)B) - (*(UINT64*)A < *(UINT64*)B));
+}
+
+static int __cdecl KccCompareConnections(_In_ const void* A, _In_ const void* B)
+{
+	const KCC_CONNECTION* ConnectionA = A;
+
+	const KCC_CONNECTION* ConnectionB = B;
+
+	if (ConnectionA->FromSite != ConnectionB->FromSite)
+	{
+		return((ConnectionA->FromSite > ConnectionB->FromSite) - (ConnectionA->FromSite < ConnectionB->FromSite));
+	}
+
+	return((ConnectionA->ToSite > ConnectionB->ToSite) - (ConnectionA->ToSite < ConnectionB->ToSite));
+}
+
+// Where a link sorts in LinkOrder.
+
+static UINT64 KccLinkKey(_In_ KCC_SIMULATION* Simulation, _In_ DWORD Link)
+{
+	return(((UINT64)Simulation->LinkCosts[Link] << 32) | Link);
+}
+
+static DWORD KccFind(_Inout_ DWORD* Parent, _In_ DWORD Site)
+{
+	while (Parent[Site] != Site)
+	{
+		// Path halving keeps the trees flat without a second pass.
+
+		Parent[Site] = Parent[Parent[Site]];
+
+		Site = Parent[Site];
+	}
+
+	return(Site);
+}
+
+BOOL KccIsDCRemoved(_In_ KCC_SIMULATION* Simulation, _In_ ENTITY* DC)
+{
+	// There are only ever as many of these as the user has removed by hand.
+
+	for (DWORD Index = 0; Index < Simulation->RemovedDCCount; Index++)
+	{
+		if (Simulation->RemovedDCs[Index] == DC)
+		{
+			return(TRUE);
+		}
+	}
+
+	return(FALSE);
+}
+
+static ENTITY* KccPickBridgehead(_In_ KCC_SIMULATION* Simulation, _In_ DWORD Site)
+{
+	ENTITY* ReadOnly = NULL;
+
+	for (DWORD Index = Simulation->SiteDCFirst[Site]; Index < Simulation->SiteDCFirst[Site + 1]; Index++)
+	{
+		ENTITY* DC = Simulation->SiteDCs[Index];
+
+		if (KccIsDCRemoved(Simulation, DC))
+		{
+			continue;
+		}
+
+		if ((DC->Flags & DCF_RODC) == 0)
+		{
+			return(DC);
+		}
+
+		if (ReadOnly == NULL)
+		{
+			ReadOnly = DC;
+		}
+	}
+
+	return(ReadOnly);
+}
+
+static void KccSortLinks(_Inout_ KCC_SIMULATION* Simulation)
+{
+	SITEGRAPH* Graph = Simulation->SiteGraph;
+
+	UINT64* Keys = (UINT64*)Simulation->LinkOrder;
+
+	// LinkOrder was allocated with room for a UINT64 per link, so the keys can be sorted in place and then narrowed.
+
+	for (DWORD Link = 0; Link < Graph->LinkCount; Link++)
+	{
+		Keys[Link] = KccLinkKey(Simulation, Link);
+	}
+
+	qsort(Keys, Graph->LinkCount, sizeof(UINT64), KccCompareKeys);
+
+	for (DWORD Index = 0; Index < Graph->LinkCount; Index++)
+	{
+		Simulation->LinkOrder[Index] = (DWORD)Keys[Index];
+	}
+}
+
+// Rebuilds the spanning tree and the connections from it, then compares them with the connections that exist now.
+
+static void KccRecompute(_Inout_ KCC_SIMULATION* Simulation)
+{
+	SITEGRAPH* Graph = Simulation->SiteGraph;
+
+	DWORD Generated = 0;
+
+	DWORD ActiveSites = 0;
+
+	DWORD LargestGroup = 0;
+
+	LARGE_INTEGER Start = { 0 };
+
+	LARGE_INTEGER End = { 0 };
+
+	QueryPerformanceCounter(&Start);
+
+	for (DWORD Site = 0; Site < Graph->SiteCount; Site++)
+	{
+		Simulation->Parent[Site] = Site;
+
+		Simulation->GroupSizes[Site] = 0;
+	}
+
+	Simulation->ConnectionCount = 0;
+
+	// Kruskal's algorithm, a site link at a time. Every pair of sites in a link is an edge of the link's cost, so
+	// joining each of the link's sites to the first one that has a DC adds the same tree edges the full set of pairs
+	// would.
+
+	for (DWORD Index = 0; Index < Graph->LinkCount; Index++)
+	{
+		DWORD Link = Simulation->LinkOrder[Index];
+
+		DWORD Anchor = SITEGRAPH_NO_SITE;
+
+		for (DWORD Member = 0; Member < Graph->Links[Link].SiteCount; Member++)
+		{
+			DWORD Site = Graph->LinkSites[Graph->Links[Link].FirstSite + Member];
+
+			DWORD AnchorRoot = 0;
+
+			DWORD SiteRoot = 0;
+
+			if (Simulation->Bridgeheads[Site] == NULL)
+			{
+				continue;
+			}
+
+			if (Anchor == SITEGRAPH_NO_SITE)
+			{
+				Anchor = Site;
+
+				continue;
+			}
+
+			if ((AnchorRoot = KccFind(Simulation->Parent, Anchor)) == (SiteRoot = KccFind(Simulation->Parent, Site)))
+			{
+				continue;
+			}
+
+			Simulation->Parent[SiteRoot] = AnchorRoot;
+
+			Simulation->Connections[Simulation->ConnectionCount++] = (KCC_CONNECTION){
+				.FromSite = Anchor, .ToSite = Site, .Link = Link, .FromServer = Simulation->Bridgeheads[Anchor], .ToServer = Simulation->Bridgeheads[Site] };
+
+			Simulation->Connections[Simulation->ConnectionCount++] = (KCC_CONNECTION){
+				.FromSite = Site, .ToSite = Anchor, .Link = Link, .FromServer = Simulation->Bridgeheads[Site], .ToServer = Simulation->Bridgeheads[Anchor] };
+		}
+	}
+
+	qsort(Simulation->Connections, Simulation->ConnectionCount, sizeof(KCC_CONNECTION), KccCompareConnections);
+
+	// Both lists are sorted by (from, to), so walking them side by side finds what's kept, what's new and what would
+	// go.
+
+	Generated = Simulation->ConnectionCount;
+
+	for (DWORD Index = 0, Other = 0; Index < Generated; Index++)
+	{
+		KCC_CONNECTION* Connection = &Simulation->Connections[Index];
+
+		while (Other < Graph->ConnectionCount &&
+			(Graph->Connections[Other].FromSite < Connection->FromSite ||
+			(Graph->Connections[Other].FromSite == Connection->FromSite && Graph->Connections[Other].ToSite < Connection->ToSite)))
+		{
+			Other++;
+		}
+
+		Connection->Change = (Other < Graph->ConnectionCount &&
+			Graph->Connections[Other].FromSite == Connection->FromSite &&
+			Graph->Connections[Other].ToSite == Connection->ToSite) ? KC_KEPT : KC_NEW;
+	}
+
+	for (DWORD Other = 0, Index = 0; Other < Graph->ConnectionCount; Other++)
+	{
+		SITECONNECTION* Connection = &Graph->Connections[Other];
+
+		while (Index < Generated &&
+			(Simulation->Connections[Index].FromSite < Connection->FromSite ||
+			(Simulation->Connections[Index].FromSite == Connection->FromSite && Simulation->Connections[Index].ToSite < Connection->ToSite)))
+		{
+			Index++;
+		}
+
+		if (Index < Generated && Simulation->Connections[Index].FromSite == Connection->FromSite && Simulation->Connections[Index].ToSite == Connection->ToSite)
+		{
+			continue;
+		}
+
+		Simulation->Connections[Simulation->ConnectionCount++] = (KCC_CONNECTION){
+			.FromSite = Connection->FromSite, .ToSite = Connection->ToSite, .Link = MAXDWORD, .Change = KC_REMOVED };
+	}
+
+	memset(Simulation->ChangeCounts, 0, sizeof(Simulation->ChangeCounts));
+
+	for (DWORD Index = 0; Index < Simulation->ConnectionCount; Index++)
+	{
+		Simulation->ChangeCounts[Simulation->Connections[Index].Change]++;
+	}
+
+	for (DWORD Site = 0; Site < Graph->SiteCount; Site++)
+	{
+		if (Simulation->Bridgeheads[Site])
+		{
+			DWORD Root = KccFind(Simulation->Parent, Site);
+
+			ActiveSites++;
+
+			Simulation->GroupSizes[Root]++;
+
+			LargestGroup = max(LargestGroup, Simulation->GroupSizes[Root]);
+		}
+	}
+
+	Simulation->IsolatedSites = ActiveSites - LargestGroup;
+
+	QueryPerformanceCounter(&End);
+
+	Simulation->LastRecomputeMicroseconds = ((double)(End.QuadPart - Start.QuadPart) * 1e6) / (double)gGraphicsData.PerformanceFrequency.QuadPart;
+}
+
+// Builds a simulation of the forest as it is, with no edits. SiteGraph must outlive it, and must have been created
+// from Entities.
+
+KCC_SIMULATION* CreateKccSimulation(_In_ SITEGRAPH* SiteGraph, _In_ ENTITY* Entities)
+{
+	KCC_SIMULATION* Simulation = NULL;
+
+	DWORD* Cursor = NULL;
+
+	DWORD DCCount = 0;
+
+	DWORD SiteCount = max(SiteGraph->SiteCount, 1);
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		DCCount += (Current->Type == ET_DC && Current->SiteIndex < SiteGraph->SiteCount);
+	}
+
+	if ((Simulation = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(KCC_SIMULATION))) == NULL)
+	{
+		return(NULL);
+	}
+
+	Simulation->SiteGraph = SiteGraph;
+
+	// A spanning tree has one edge fewer than it has sites, and every edge is a connection each way. On top of those
+	// there may be every existing connection, if the simulation would remove them all.
+
+	Simulation->ConnectionCapacity = (2 * SiteCount) + SiteGraph->ConnectionCount;
+
+	if ((Simulation->SiteDCFirst = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ((SIZE_T)SiteCount + 1) * sizeof(DWORD))) == NULL ||
+		(Simulation->SiteDCs = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(DCCount, 1) * sizeof(ENTITY*))) == NULL ||
+		(Simulation->Bridgeheads = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (SIZE_T)SiteCount * sizeof(ENTITY*))) == NULL ||
+		(Simulation->LinkCosts = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(SiteGraph->LinkCount, 1) * sizeof(DWORD))) == NULL ||
+		(Simulation->LinkOrder = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(SiteGraph->LinkCount, 1) * sizeof(UINT64))) == NULL ||
+		(Simulation->Parent = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)SiteCount * sizeof(DWORD))) == NULL ||
+		(Simulation->GroupSizes = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)SiteCount * sizeof(DWORD))) == NULL ||
+		(Simulation->Connections = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)Simulation->ConnectionCapacity * sizeof(KCC_CONNECTION))) == NULL ||
+		(Cursor = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)SiteCount * sizeof(DWORD))) == NULL)
+	{
+		FreeKccSimulation(Simulation);
+
+		return(NULL);
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC && Current->SiteIndex < SiteGraph->SiteCount)
+		{
+			Simulation->SiteDCFirst[Current->SiteIndex + 1]++;
+		}
+	}
+
+	for (DWORD Site = 0; Site < SiteGraph->SiteCount; Site++)
+	{
+		Simulation->SiteDCFirst[Site + 1] += Simulation->SiteDCFirst[Site];
+
+		Cursor[Site] = Simulation->SiteDCFirst[Site];
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC && Current->SiteIndex < SiteGraph->SiteCount)
+		{
+			Simulation->SiteDCs[Cursor[Current->SiteIndex]++] = Current;
+		}
+	}
+
+	HeapFree(GetProcessHeap(), 0, Cursor);
+
+	for (DWORD Site = 0; Site < SiteGraph->SiteCount; Site++)
+	{
+		qsort(&Simulation->SiteDCs[Simulation->SiteDCFirst[Site]], Simulation->SiteDCFirst[Site + 1] - Simulation->SiteDCFirst[Site], sizeof(ENTITY*), KccCompareDCs);
+	}
+
+	KccResetEdits(Simulation);
+
+	return(Simulation);
+}
+
+void FreeKccSimulation(_In_opt_ KCC_SIMULATION* Simulation)
+{
+	if (Simulation == NULL)
+	{
+		return;
+	}
+
+	void* Arrays[] = {
+		Simulation->SiteDCFirst, Simulation->SiteDCs, Simulation->Bridgeheads, Simulation->LinkCosts, Simulation->LinkOrder,
+		Simulation->Parent, Simulation->GroupSizes, Simulation->Connections, Simulation->RemovedDCs };
+
+	for (int Index = 0; Index < _countof(Arrays); Index++)
+	{
+		if (Arrays[Index])
+		{
+			HeapFree(GetProcessHeap(), 0, Arrays[Index]);
+		}
+	}
+
+	HeapFree(GetProcessHeap(), 0, Simulation);
+}
+
+// Removes DC from the simulated forest, or puts it back if it was already removed.
+
+DWORD KccToggleDC(_Inout_ KCC_SIMULATION* Simulation, _In_ ENTITY* DC)
+{
+	DWORD Site = DC->SiteIndex;
+
+	ENTITY* OldBridgehead = NULL;
+
+	ENTITY* NewBridgehead = NULL;
+
+	BOOL Restored = FALSE;
+
+	if (DC->Type != ET_DC || Site >= Simulation->SiteGraph->SiteCount)
+	{
+		return(ERROR_NOT_FOUND);
+	}
+
+	for (DWORD Index = 0; Index < Simulation->RemovedDCCount; Index++)
+	{
+		if (Simulation->RemovedDCs[Index] == DC)
+		{
+			Simulation->RemovedDCs[Index] = Simulation->RemovedDCs[--Simulation->RemovedDCCount];
+
+			Restored = TRUE;
+
+			break;
+		}
+	}
+
+	if (Restored == FALSE)
+	{
+		if (Simulation->RemovedDCCount == Simulation->RemovedDCCapacity)
+		{
+			DWORD NewCapacity = max(16, Simulation->RemovedDCCapacity * 2);
+
+			ENTITY** NewArray = Simulation->RemovedDCs ?
+				HeapReAlloc(GetProcessHeap(), 0, Simulation->RemovedDCs, NewCapacity * sizeof(ENTITY*)) :
+				HeapAlloc(GetProcessHeap(), 0, NewCapacity * sizeof(ENTITY*));
+
+			if (NewArray == NULL)
+			{
+				return(ERROR_NOT_ENOUGH_MEMORY);
+			}
+
+			Simulation->RemovedDCs = NewArray;
+
+			Simulation->RemovedDCCapacity = NewCapacity;
+		}
+
+		Simulation->RemovedDCs[Simulation->RemovedDCCount++] = DC;
+	}
+
+	OldBridgehead = Simulation->Bridgeheads[Site];
+
+	NewBridgehead = KccPickBridgehead(Simulation, Site);
+
+	Simulation->Bridgeheads[Site] = NewBridgehead;
+
+	// Only a site gaining its first DC or losing its last one changes the shape of the tree. Otherwise at most the
+	// site's bridgehead changed, and only the connections touching it need to hear about it.
+
+	if ((OldBridgehead == NULL) != (NewBridgehead == NULL))
+	{
+		KccRecompute(Simulation);
+	}
+	else if (OldBridgehead != NewBridgehead)
+	{
+		for (DWORD Index = 0; Index < Simulation->ConnectionCount; Index++)
+		{
+			KCC_CONNECTION* Connection = &Simulation->Connections[Index];
+
+			if (Connection->Change == KC_REMOVED)
+			{
+				continue;
+			}
+
+			if (Connection->FromSite == Site)
+			{
+				Connection->FromServer = NewBridgehead;
+			}
+
+			if (Connection->ToSite == Site)
+			{
+				Connection->ToServer = NewBridgehead;
+			}
+		}
+	}
+
+	return(ERROR_SUCCESS);
+}
+
+// Gives Link a what-if cost, moving it to its new place in the cost order before rebuilding the tree.
+
+DWORD KccSetLinkCost(_Inout_ KCC_SIMULATION* Simulation, _In_ DWORD Link, _In_ DWORD Cost)
+{
+	SITEGRAPH* Graph = Simulation->SiteGraph;
+
+	DWORD Position = 0;
+
+	DWORD Low = 0;
+
+	DWORD High = 0;
+
+	UINT64 Key = 0;
+
+	if (Link >= Graph->LinkCount)
+	{
+		return(ERROR_INVALID_PARAMETER);
+	}
+
+	if (Simulation->LinkCosts[Link] == Cost)
+	{
+		return(ERROR_SUCCESS);
+	}
+
+	// Find the link by its old key, and take it out.
+
+	Key = KccLinkKey(Simulation, Link);
+
+	Low = 0;
+
+	High = Graph->LinkCount;
+
+	while (Low < High)
+	{
+		DWORD Middle = Low + ((High - Low) / 2);
+
+		if (KccLinkKey(Simulation, Simulation->LinkOrder[Middle]) < Key)
+		{
+			Low = Middle + 1;
+		}
+		else
+		{
+			High = Middle;
+		}
+	}
+
+	Position = Low;
+
+	memmove(&Simulation->LinkOrder[Position], &Simulation->LinkOrder[Position + 1], (Graph->LinkCount - Position - 1) * sizeof(DWORD));
+
+	if (Simulation->LinkCosts[Link] == Graph->Links[Link].Cost)
+	{
+		Simulation->ChangedLinkCount++;
+	}
+	else if (Cost == Graph->Links[Link].Cost)
+	{
+		Simulation->ChangedLinkCount--;
+	}
+
+	Simulation->LinkCosts[Link] = Cost;
+
+	// And put it back in where its new key goes.
+
+	Key = KccLinkKey(Simulation, Link);
+
+	Low = 0;
+
+	High = Graph->LinkCount - 1;
+
+	while (Low < High)
+	{
+		DWORD Middle = Low + ((High - Low) / 2);
+
+		if (KccLinkKey(Simulation, Simulation->LinkOrder[Middle]) < Key)
+		{
+			Low = Middle + 1;
+		}
+		else
+		{
+			High = Middle;
+		}
+	}
+
+	memmove(&Simulation->LinkOrder[Low + 1], &Simulation->LinkOrder[Low], (Graph->LinkCount - 1 - Low) * sizeof(DWORD));
+
+	Simulation->LinkOrder[Low] = Link;
+
+	KccRecompute(Simulation);
+
+	return(ERROR_SUCCESS);
+}
+
+// Puts every DC back and every link cost back to what it really is.
+
+DWORD KccResetEdits(_Inout_ KCC_SIMULATION* Simulation)
+{
+	SITEGRAPH* Graph = Simulation->SiteGraph;
+
+	Simulation->RemovedDCCount = 0;
+
+	Simulation->ChangedLinkCount = 0;
+
+	for (DWORD Link = 0; Link < Graph->LinkCount; Link++)
+	{
+		Simulation->LinkCosts[Link] = Graph->Links[Link].Cost;
+	}
+
+	KccSortLinks(Simulation);
+
+	for (DWORD Site = 0; Site < Graph->SiteCount; Site++)
+	{
+		Simulation->Bridgeheads[Site] = KccPickBridgehead(Simulation, Site);
+	}
+
+	KccRecompute(Simulation);
+
+	return(ERROR_SUCCESS);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+// A what-if approximation of the inter-site topology the ISTG would generate, so planned changes can be previewed
+// before they are made. Sites that still have a DC are joined by a minimum spanning tree over site link costs, found
+// with Kruskal's algorithm. Each site picks a bridgehead, and both ends of every tree edge get an inbound connection
+// from the other end's bridgehead.
+//
+// Approximations:
+// - Every site link is treated as bridged, as it is by default. Sites in one link are all equally far apart, so a
+//   link only ever adds edges between its own sites, at its own cost. A path through another link is never costed
+//   as the sum of both links.
+// - A site with no DCs left can't pass replication through, so sites only reachable through it end up isolated.
+// - The bridgehead is the writable DC with the lowest DN, or an RODC if there is nothing else. The real ISTG also
+//   weighs transports and preferred bridgeheads.
+//
+// Edits are recomputed incrementally. Removing a DC only re-picks its site's bridgehead, unless the site loses its
+// last DC. A link cost change moves one link within the cost order. The spanning tree is then rebuilt in time linear
+// in the number of site link memberships, which for 5,000 sites is well under a millisecond.
+
+// How much + and - change the what-if cost of a site link.
+#define KCC_COST_STEP	10
+
+typedef struct KCC_CONNECTION
+{
+	DWORD FromSite;
+
+	DWORD ToSite;
+
+	// The site link the connection replicates over. MAXDWORD for an existing connection the simulation would remove.
+	DWORD Link;
+
+	// NULL for an existing connection the simulation would remove.
+	ENTITY* FromServer;
+
+	ENTITY* ToServer;
+
+	KCC_CHANGE Change;
+
+} KCC_CONNECTION;
+
+typedef struct KCC_SIMULATION
+{
+	// Borrowed: sites, link membership and the connection objects that exist now. Link costs here are never changed.
+	SITEGRAPH* SiteGraph;
+
+	// The DCs in site S are SiteDCs[SiteDCFirst[S]] up to SiteDCs[SiteDCFirst[S + 1]], sorted by DN.
+	DWORD* SiteDCFirst;
+
+	ENTITY** SiteDCs;
+
+	// NULL for a site with no DCs left.
+	ENTITY** Bridgeheads;
+
+	// What-if costs, one per site link.
+	DWORD* LinkCosts;
+
+	// Site links from cheapest to dearest, ties broken by index. Kruskal's algorithm walks them in this order.
+	DWORD* LinkOrder;
+
+	// Union-find forest over sites, rebuilt on every recompute.
+	DWORD* Parent;
+
+	// Scratch, per site, for finding the largest group of sites the tree joins.
+	DWORD* GroupSizes;
+
+	DWORD ConnectionCount;
+
+	DWORD ConnectionCapacity;
+
+	// Sorted by (FromSite, ToSite). Generated connections, then existing ones that would be removed.
+	KCC_CONNECTION* Connections;
+
+	DWORD ChangeCounts[KC_COUNT];
+
+	// Sites that have a DC but aren't joined to the largest group of sites.
+	DWORD IsolatedSites;
+
+	DWORD RemovedDCCount;
+
+	DWORD RemovedDCCapacity;
+
+	ENTITY** RemovedDCs;
+
+	DWORD ChangedLinkCount;
+
+	double LastRecomputeMicroseconds;
+
+} KCC_SIMULATION;
+
+KCC_SIMULATION* CreateKccSimulation(_In_ SITEGRAPH* SiteGraph, _In_ ENTITY* Entities);
+
+void FreeKccSimulation(_In_opt_ KCC_SIMULATION* Simulation);
+
+DWORD KccToggleDC(_Inout_ KCC_SIMULATION* Simulation, _In_ ENTITY* DC);
+
+DWORD KccSetLinkCost(_Inout_ KCC_SIMULATION* Simulation, _In_ DWORD Link, _In_ DWORD Cost);
+
+DWORD KccResetEdits(_Inout_ KCC_SIMULATION* Simulation);
+
+BOOL KccIsDCRemoved(_In_ KCC_SIMULATION* Simulation, _In_ ENTITY* DC);
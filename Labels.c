@@ -0,0 +1,599 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Label placement. See Labels.h.
+
+#include <Windows.h>
+
+#include <stdlib.h>
+
+#include "Main.h"
+
+#include "Labels.h"
+
+
+
+// A grid cell that has boxes in it, found by its coordinates. Head is LABEL_NONE for a slot that isn't in use.
+typedef struct LABEL_CELL
+{
+	UINT64 Key;
+
+	DWORD Head;
+
+} LABEL_CELL;
+
+// One box in one cell. A box is in every cell it covers.
+typedef struct LABEL_ENTRY
+{
+	DWORD Box;
+
+	DWORD Next;
+
+} LABEL_ENTRY;
+
+// Every label placed so far at the altitude being placed, and every DC's triangle.
+typedef struct LABEL_GRID
+{
+	LABEL_CELL* Cells;
+
+	DWORD CellCapacity;
+
+	DWORD CellCount;
+
+	LABEL_ENTRY* Entries;
+
+	DWORD EntryCapacity;
+
+	DWORD EntryCount;
+
+	RECT* Boxes;
+
+	DWORD BoxCapacity;
+
+	DWORD BoxCount;
+
+} LABEL_GRID;
+
+// A label waiting to be placed. Labels are placed lowest Priority first.
+typedef struct LABEL_CANDIDATE
+{
+	UINT64 Priority;
+
+	ENTITY* Entity;
+
+	// For a site, which copy of its name this is. Zero for a DC, which can go in any of its spots.
+	BYTE Spot;
+
+} LABEL_CANDIDATE;
+
+typedef enum LABEL_CLASS
+{
+	LC_SITE,
+
+	LC_ROLE_HOLDER,
+
+	LC_GC,
+
+	LC_DC,
+
+	LC_SITE_COPY
+
+} LABEL_CLASS;
+
+
+
+LABEL_FONT_SIZE LabelFontSize(_In_ ENTITY_TYPE Type, _In_ int Altitude)
+{
+	if (Altitude <= 1)
+	{
+		return(LFS_HUGE);
+	}
+
+	if (Type == ET_SITE)
+	{
+		return(Altitude <= 3 ? LFS_BIG : LFS_SMALL);
+	}
+
+	return(Altitude == 2 ? LFS_BIG : LFS_SMALL);
+}
+
+// Which of Entity's labels are drawn at Altitude: LABEL_SPOTs, without LS_PLACED, or zero for none.
+
+BYTE GetLabelSpots(_In_ ENTITY* Entity, _In_ int Altitude)
+{
+	BYTE Spots = 0;
+
+	if ((Entity->Type != ET_SITE && Entity->Type != ET_DC) || Altitude < 1 ||
+		Altitude > (Entity->Type == ET_SITE ? SITE_LABEL_MAX_ALTITUDE : DC_LABEL_MAX_ALTITUDE))
+	{
+		return(0);
+	}
+
+	Spots = Entity->LabelSpots[Altitude - 1];
+
+	if ((Spots & LS_PLACED) == 0)
+	{
+		return(Entity->Type == ET_SITE ? (LS_ABOVE | LS_BELOW) : LS_RIGHT);
+	}
+
+	return(Spots & ~LS_PLACED);
+}
+
+// Where Entity's label at Spot is drawn at Altitude, before the camera is taken off. Text is where its text is drawn
+// from: the left of it for a DC's name on the right, and otherwise the middle. Sparkline is empty for a site.
+
+void GetLabelPosition(_In_ ENTITY* Entity, _In_ int Altitude, _In_ LABEL_SPOT Spot, _In_ int FontHeight, _Out_ POINT* Text, _Out_ RECT* Sparkline)
+{
+	float Scale = 1.0f / Altitude;
+
+	int Top = (int)(Entity->y * Scale);
+
+	int Bottom = (int)((Entity->y * Scale) + Entity->height * Scale);
+
+	int CenterX = (int)((Entity->x * Scale) + Entity->width * Scale / 2);
+
+	int SparklineWidth = (int)(Entity->width * Scale);
+
+	int SparklineHeight = max(4, (int)(Entity->height * Scale) / 4);
+
+	SetRectEmpty(Sparkline);
+
+	if (Entity->Type == ET_SITE)
+	{
+		Text->x = CenterX;
+
+		Text->y = (Spot == LS_ABOVE) ? Top - FontHeight : Bottom;
+
+		return;
+	}
+
+	switch (Spot)
+	{
+		case LS_RIGHT:
+		{
+			Text->x = (int)((Entity->x * Scale) + Entity->width * Scale);
+
+			Text->y = (int)((Entity->y * Scale) + ((Entity->height / 2) - (FontHeight / 2)) * Scale);
+
+			SetRect(Sparkline, Text->x, Text->y + FontHeight, Text->x + SparklineWidth, Text->y + FontHeight + SparklineHeight);
+
+			break;
+		}
+		case LS_BELOW:
+		{
+			Text->x = CenterX;
+
+			Text->y = Bottom;
+
+			SetRect(Sparkline, CenterX - (SparklineWidth / 2), Bottom + FontHeight, CenterX - (SparklineWidth / 2) + SparklineWidth, Bottom + FontHeight + SparklineHeight);
+
+			break;
+		}
+		default:
+		{
+			Text->x = CenterX;
+
+			Text->y = Top - FontHeight - SparklineHeight;
+
+			SetRect(Sparkline, CenterX - (SparklineWidth / 2), Top - SparklineHeight, CenterX - (SparklineWidth / 2) + SparklineWidth, Top);
+
+			break;
+		}
+	}
+}
+
+static int LabelTextWidth(_In_ LABEL_FONT* Font, _In_ wchar_t* Text)
+{
+	int Width = 0;
+
+	for (wchar_t* Character = Text; *Character != L'\0'; Character++)
+	{
+		Width += (*Character < LABEL_FONT_CHARS) ? Font->Widths[*Character] : Font->MaxWidth;
+	}
+
+	return(Width);
+}
+
+// Everything a label at Spot covers: its text, and for a DC, its sparkline.
+
+static void LabelBox(_In_ ENTITY* Entity, _In_ int Altitude, _In_ LABEL_SPOT Spot, _In_ LABEL_FONT* Font, _In_ int TextWidth, _Out_ RECT* Box)
+{
+	POINT Text = { 0 };
+
+	RECT Sparkline = { 0 };
+
+	RECT TextRect = { 0 };
+
+	GetLabelPosition(Entity, Altitude, Spot, Font->Height, &Text, &Sparkline);
+
+	if (Entity->Type == ET_DC && Spot == LS_RIGHT)
+	{
+		SetRect(&TextRect, Text.x, Text.y, Text.x + TextWidth, Text.y + Font->Height);
+	}
+	else
+	{
+		SetRect(&TextRect, Text.x - (TextWidth / 2), Text.y, Text.x - (TextWidth / 2) + TextWidth, Text.y + Font->Height);
+	}
+
+	if (IsRectEmpty(&Sparkline))
+	{
+		*Box = TextRect;
+	}
+	else
+	{
+		UnionRect(Box, &TextRect, &Sparkline);
+	}
+}
+
+// Cells are numbered from the origin both ways, so a box left of or above it is in a negative cell, not cell zero.
+
+static int LabelCellOf(_In_ int Coordinate)
+{
+	return(Coordinate >= 0 ? Coordinate / LABEL_GRID_CELL : -((-Coordinate + LABEL_GRID_CELL - 1) / LABEL_GRID_CELL));
+}
+
+static LABEL_CELL* LabelFindCell(_In_ LABEL_GRID* Grid, _In_ UINT64 Key)
+{
+	DWORD Slot = (DWORD)((Key * 0x9E3779B97F4A7C15ULL) >> 32) & (Grid->CellCapacity - 1);
+
+	while (Grid->Cells[Slot].Head != LABEL_NONE && Grid->Cells[Slot].Key != Key)
+	{
+		Slot = (Slot + 1) & (Grid->CellCapacity - 1);
+	}
+
+	return(&Grid->Cells[Slot]);
+}
+
+static BOOL LabelGrowCells(_Inout_ LABEL_GRID* Grid)
+{
+	LABEL_CELL* OldCells = Grid->Cells;
+
+	DWORD OldCapacity = Grid->CellCapacity;
+
+	DWORD NewCapacity = max(1024, OldCapacity * 2);
+
+	if ((Grid->Cells = HeapAlloc(GetProcessHeap(), 0, NewCapacity * sizeof(LABEL_CELL))) == NULL)
+	{
+		Grid->Cells = OldCells;
+
+		return(FALSE);
+	}
+
+	Grid->CellCapacity = NewCapacity;
+
+	for (DWORD Slot = 0; Slot < NewCapacity; Slot++)
+	{
+		Grid->Cells[Slot].Head = LABEL_NONE;
+	}
+
+	for (DWORD Slot = 0; Slot < OldCapacity; Slot++)
+	{
+		if (OldCells[Slot].Head != LABEL_NONE)
+		{
+			*LabelFindCell(Grid, OldCells[Slot].Key) = OldCells[Slot];
+		}
+	}
+
+	if (OldCells)
+	{
+		HeapFree(GetProcessHeap(), 0, OldCells);
+	}
+
+	return(TRUE);
+}
+
+// Grows Array, of Capacity elements of Size bytes, so it has room for one more than Count.
+
+static BOOL LabelReserve(_Inout_ void** Array, _Inout_ DWORD* Capacity, _In_ DWORD Count, _In_ size_t Size)
+{
+	DWORD NewCapacity = max(1024, *Capacity * 2);
+
+	void* NewArray = NULL;
+
+	if (Count < *Capacity)
+	{
+		return(TRUE);
+	}
+
+	if ((NewArray = *Array ? HeapReAlloc(GetProcessHeap(), 0, *Array, NewCapacity * Size) : HeapAlloc(GetProcessHeap(), 0, NewCapacity * Size)) == NULL)
+	{
+		return(FALSE);
+	}
+
+	*Array = NewArray;
+
+	*Capacity = NewCapacity;
+
+	return(TRUE);
+}
+
+static BOOL LabelGridOverlaps(_In_ LABEL_GRID* Grid, _In_ RECT* Box)
+{
+	for (int CellY = LabelCellOf(Box->top); CellY <= LabelCellOf(Box->bottom - 1); CellY++)
+	{
+		for (int CellX = LabelCellOf(Box->left); CellX <= LabelCellOf(Box->right - 1); CellX++)
+		{
+			LABEL_CELL* Cell = LabelFindCell(Grid, ((UINT64)(UINT32)CellX << 32) | (UINT32)CellY);
+
+			for (DWORD Entry = Cell->Head; Entry != LABEL_NONE; Entry = Grid->Entries[Entry].Next)
+			{
+				RECT* Other = &Grid->Boxes[Grid->Entries[Entry].Box];
+
+				if (Box->left < Other->right && Other->left < Box->right && Box->top < Other->bottom && Other->top < Box->bottom)
+				{
+					return(TRUE);
+				}
+			}
+		}
+	}
+
+	return(FALSE);
+}
+
+static DWORD LabelGridInsert(_Inout_ LABEL_GRID* Grid, _In_ RECT* Box)
+{
+	if (LabelReserve((void**)&Grid->Boxes, &Grid->BoxCapacity, Grid->BoxCount, sizeof(RECT)) == FALSE)
+	{
+		return(ERROR_NOT_ENOUGH_MEMORY);
+	}
+
+	Grid->Boxes[Grid->BoxCount] = *Box;
+
+	for (int CellY = LabelCellOf(Box->top); CellY <= LabelCellOf(Box->bottom - 1); CellY++)
+	{
+		for (int CellX = LabelCellOf(Box->left); CellX <= LabelCellOf(Box->right - 1); CellX++)
+		{
+			UINT64 Key = ((UINT64)(UINT32)CellX << 32) | (UINT32)CellY;
+
+			LABEL_CELL* Cell = NULL;
+
+			// Kept at most half full, so a lookup only probes a slot or two.
+
+			if ((Grid->CellCount + 1) * 2 > Grid->CellCapacity && LabelGrowCells(Grid) == FALSE)
+			{
+				return(ERROR_NOT_ENOUGH_MEMORY);
+			}
+
+			if (LabelReserve((void**)&Grid->Entries, &Grid->EntryCapacity, Grid->EntryCount, sizeof(LABEL_ENTRY)) == FALSE)
+			{
+				return(ERROR_NOT_ENOUGH_MEMORY);
+			}
+
+			Cell = LabelFindCell(Grid, Key);
+
+			if (Cell->Head == LABEL_NONE)
+			{
+				Cell->Key = Key;
+
+				Grid->CellCount++;
+			}
+
+			Grid->Entries[Grid->EntryCount].Box = Grid->BoxCount;
+
+			Grid->Entries[Grid->EntryCount].Next = Cell->Head;
+
+			Cell->Head = Grid->EntryCount++;
+		}
+	}
+
+	Grid->BoxCount++;
+
+	return(ERROR_SUCCESS);
+}
+
+static void LabelGridReset(_Inout_ LABEL_GRID* Grid)
+{
+	for (DWORD Slot = 0; Slot < Grid->CellCapacity; Slot++)
+	{
+		Grid->Cells[Slot].Head = LABEL_NONE;
+	}
+
+	Grid->CellCount = 0;
+
+	Grid->EntryCount = 0;
+
+	Grid->BoxCount = 0;
+}
+
+static int __cdecl LabelCompareCandidates(_In_ const void* A, _In_ const void* B)
+{
+	UINT64 Left = ((const LABEL_CANDIDATE*)A)->Priority;
+
+	UINT64 Right = ((const LABEL_CANDIDATE*)B)->Priority;
+
+	return((Left > Right) - (Left < Right));
+}
+
+static LABEL_CLASS LabelClassOf(_In_ ENTITY* Entity, _In_ BYTE Spot)
+{
+	if (Entity->Type == ET_SITE)
+	{
+		return(Spot == LS_ABOVE ? LC_SITE : LC_SITE_COPY);
+	}
+
+	if (Entity->Flags & (DCF_PDCE | DCF_RIDMASTER | DCF_INFRASTRUCTUREMASTER | DCF_SCHEMAMASTER | DCF_DOMAINNAMINGMASTER))
+	{
+		return(LC_ROLE_HOLDER);
+	}
+
+	return((Entity->Flags & DCF_GC) ? LC_GC : LC_DC);
+}
+
+// Decides where every site and DC label goes at every altitude, into each entity's LabelSpots; see Labels.h. Fonts
+// has LFS_COUNT fonts. If there isn't memory to do it, every label is left to be drawn where it always was.
+
+DWORD PlaceLabels(_In_ ENTITY* Entities, _In_ LABEL_FONT* Fonts, _Out_opt_ LABEL_STATS* Stats)
+{
+	static const BYTE DCSpots[] = { LS_RIGHT, LS_BELOW, LS_ABOVE };
+
+	DWORD Result = ERROR_SUCCESS;
+
+	LABEL_GRID Grid = { 0 };
+
+	LABEL_CANDIDATE* Candidates = NULL;
+
+	DWORD CandidateCount = 0;
+
+	DWORD EntityCount = 0;
+
+	if (Stats)
+	{
+		memset(Stats, 0, sizeof(LABEL_STATS));
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		memset(Current->LabelSpots, 0, sizeof(Current->LabelSpots));
+
+		EntityCount++;
+	}
+
+	// At most two labels for each entity, at any one altitude.
+
+	if ((Candidates = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)EntityCount * 2 * sizeof(LABEL_CANDIDATE))) == NULL ||
+		LabelGrowCells(&Grid) == FALSE)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	for (int Altitude = 1; Altitude <= SITE_LABEL_MAX_ALTITUDE; Altitude++)
+	{
+		DWORD Ordinal = 0;
+
+		DWORD Placed = 0;
+
+		CandidateCount = 0;
+
+		LabelGridReset(&Grid);
+
+		// DCs' triangles go in first, so no label is drawn over one.
+
+		for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next, Ordinal++)
+		{
+			float Scale = 1.0f / Altitude;
+
+			if (Current->Type == ET_DC)
+			{
+				RECT Triangle = { 0 };
+
+				SetRect(
+					&Triangle,
+					(int)(Current->x * Scale),
+					(int)(Current->y * Scale),
+					(int)((Current->x * Scale) + Current->width * Scale),
+					(int)((Current->y * Scale) + Current->height * Scale));
+
+				if ((Result = LabelGridInsert(&Grid, &Triangle)) != ERROR_SUCCESS)
+				{
+					goto Exit;
+				}
+
+				if (Altitude <= DC_LABEL_MAX_ALTITUDE)
+				{
+					Candidates[CandidateCount].Priority = ((UINT64)LabelClassOf(Current, 0) << 32) | Ordinal;
+
+					Candidates[CandidateCount].Entity = Current;
+
+					Candidates[CandidateCount++].Spot = 0;
+				}
+			}
+			else if (Current->Type == ET_SITE)
+			{
+				Candidates[CandidateCount].Priority = ((UINT64)LC_SITE << 32) | Ordinal;
+
+				Candidates[CandidateCount].Entity = Current;
+
+				Candidates[CandidateCount++].Spot = LS_ABOVE;
+
+				Candidates[CandidateCount].Priority = ((UINT64)LC_SITE_COPY << 32) | Ordinal;
+
+				Candidates[CandidateCount].Entity = Current;
+
+				Candidates[CandidateCount++].Spot = LS_BELOW;
+			}
+		}
+
+		qsort(Candidates, CandidateCount, sizeof(LABEL_CANDIDATE), LabelCompareCandidates);
+
+		for (DWORD Index = 0; Index < CandidateCount; Index++)
+		{
+			ENTITY* Entity = Candidates[Index].Entity;
+
+			LABEL_FONT* Font = &Fonts[LabelFontSize(Entity->Type, Altitude)];
+
+			wchar_t Guess[256] = { 0 };
+
+			int TextWidth = LabelTextWidth(Font, Entity->Type == ET_SITE ? Entity->name : DCLabelText(Entity, Guess, _countof(Guess)));
+
+			for (DWORD Try = 0; Try < (Entity->Type == ET_SITE ? 1U : _countof(DCSpots)); Try++)
+			{
+				BYTE Spot = (Entity->Type == ET_SITE) ? Candidates[Index].Spot : DCSpots[Try];
+
+				RECT Box = { 0 };
+
+				LabelBox(Entity, Altitude, (LABEL_SPOT)Spot, Font, TextWidth, &Box);
+
+				if (LabelGridOverlaps(&Grid, &Box))
+				{
+					continue;
+				}
+
+				if ((Result = LabelGridInsert(&Grid, &Box)) != ERROR_SUCCESS)
+				{
+					goto Exit;
+				}
+
+				Entity->LabelSpots[Altitude - 1] |= Spot;
+
+				Placed++;
+
+				break;
+			}
+
+			Entity->LabelSpots[Altitude - 1] |= LS_PLACED;
+		}
+
+		if (Stats)
+		{
+			Stats->Labels[Altitude - 1] = CandidateCount;
+
+			Stats->Placed[Altitude - 1] = Placed;
+		}
+	}
+
+Exit:
+
+	if (Result != ERROR_SUCCESS)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] Failed to place labels (0x%08lx); they'll all be drawn, overlapping or not.", __FUNCTIONW__, Result);
+
+		for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+		{
+			memset(Current->LabelSpots, 0, sizeof(Current->LabelSpots));
+		}
+	}
+
+	if (Candidates)
+	{
+		HeapFree(GetProcessHeap(), 0, Candidates);
+	}
+
+	if (Grid.Cells)
+	{
+		HeapFree(GetProcessHeap(), 0, Grid.Cells);
+	}
+
+	if (Grid.Entries)
+	{
+		HeapFree(GetProcessHeap(), 0, Grid.Entries);
+	}
+
+	if (Grid.Boxes)
+	{
+		HeapFree(GetProcessHeap(), 0, Grid.Boxes);
+	}
+
+	return(Result);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+// Where each site and DC label goes, or whether it's drawn at all, is worked out once for every altitude labels are
+// drawn at, when discovery finishes, instead of every frame. RecordScene only looks it up, so placing labels costs
+// nothing once the map is on screen.
+//
+// At each altitude, every label there would be is sorted by how much it matters: a site's name above it first, then
+// DCs holding operations master roles, then global catalogs, then other DCs, and last the copy of a site's name below
+// it. Going down that list, each label takes the first of its spots that doesn't overlap a label already placed or
+// any DC's triangle, or is dropped if none of them are free; a DC's sparkline goes wherever its name does. Overlaps
+// are found with a grid of LABEL_GRID_CELL pixel cells, hashed, since the world can be far bigger than the labels in
+// it. Each label only looks in the few cells it covers, so the sort is what costs the most, and the whole thing is
+// O(n log n).
+//
+// Placement works at each altitude's scale with the camera left out, since the camera only moves every label by the
+// same amount. Label widths come from each font's character widths rather than from measuring every string, which is
+// close enough to tell what overlaps, and a DC whose fqdn isn't known yet is placed with the same guess at it that
+// LayoutTopology makes.
+
+// Characters whose widths are looked up; any after these are taken to be as wide as the widest character.
+#define LABEL_FONT_CHARS	256
+
+#define LABEL_GRID_CELL		128
+
+#define LABEL_NONE			MAXDWORD
+
+// Which font labels are drawn in, which depends on the altitude.
+typedef enum LABEL_FONT_SIZE
+{
+	LFS_HUGE,
+
+	LFS_BIG,
+
+	LFS_SMALL,
+
+	LFS_COUNT
+
+} LABEL_FONT_SIZE;
+
+// The bits of ENTITY::LabelSpots. A site's name can be above it, below it, or both; a DC's name and sparkline go in at
+// most one of these, tried right, below, then above. Zero means labels haven't been placed, and everything is drawn
+// where it always was: above and below a site, and to the right of a DC.
+typedef enum LABEL_SPOT
+{
+	LS_ABOVE = 1,
+
+	LS_BELOW = 2,
+
+	LS_RIGHT = 4,
+
+	LS_PLACED = 0x80
+
+} LABEL_SPOT;
+
+typedef struct LABEL_FONT
+{
+	// Cell height, as RenderFontHeight has it.
+	int Height;
+
+	int Widths[LABEL_FONT_CHARS];
+
+	int MaxWidth;
+
+} LABEL_FONT;
+
+typedef struct LABEL_STATS
+{
+	// Labels there were at each altitude, and how many of them were drawn.
+	DWORD Labels[SITE_LABEL_MAX_ALTITUDE];
+
+	DWORD Placed[SITE_LABEL_MAX_ALTITUDE];
+
+} LABEL_STATS;
+
+LABEL_FONT_SIZE LabelFontSize(_In_ ENTITY_TYPE Type, _In_ int Altitude);
+
+BYTE GetLabelSpots(_In_ ENTITY* Entity, _In_ int Altitude);
+
+void GetLabelPosition(_In_ ENTITY* Entity, _In_ int Altitude, _In_ LABEL_SPOT Spot, _In_ int FontHeight, _Out_ POINT* Text, _Out_ RECT* Sparkline);
+
+DWORD PlaceLabels(_In_ ENTITY* Entities, _In_ LABEL_FONT* Fonts, _Out_opt_ LABEL_STATS* Stats);
@@ -0,0 +1,416 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Site and DC layout. See Layout.h.
+
+#include <Windows.h>
+
+#include <stdlib.h>
+
+#include <math.h>
+
+#include "Main.h"
+
+#include "Layout.h"
+
+
+
+// DCs by the site they're in, then by where they were found.
+
+static int __cdecl LayoutCompareDCs(_In_ const void* A, _In_ const void* B)
+{
+	const LAYOUT_ENTITY* Left = (const LAYOUT_ENTITY*)A;
+
+	const LAYOUT_ENTITY* Right = (const LAYOUT_ENTITY*)B;
+
+	int Compare = _wcsicmp(Left->Entity->site, Right->Entity->site);
+
+	if (Compare != 0)
+	{
+		return(Compare);
+	}
+
+	return((Left->Ordinal > Right->Ordinal) - (Left->Ordinal < Right->Ordinal));
+}
+
+// Tallest sites first, then widest, then in the order they were found.
+
+static int __cdecl LayoutCompareSites(_In_ const void* A, _In_ const void* B)
+{
+	const LAYOUT_ENTITY* Left = (const LAYOUT_ENTITY*)A;
+
+	const LAYOUT_ENTITY* Right = (const LAYOUT_ENTITY*)B;
+
+	if (Left->Entity->height != Right->Entity->height)
+	{
+		return(Left->Entity->height > Right->Entity->height ? -1 : 1);
+	}
+
+	if (Left->Entity->width != Right->Entity->width)
+	{
+		return(Left->Entity->width > Right->Entity->width ? -1 : 1);
+	}
+
+	return((Left->Ordinal > Right->Ordinal) - (Left->Ordinal < Right->Ordinal));
+}
+
+// The first of DCs, sorted by LayoutCompareDCs, that's in the site SiteDN, or where it would be if there are none.
+
+static DWORD LayoutFirstDCInSite(_In_ LAYOUT_ENTITY* DCs, _In_ DWORD DCCount, _In_ wchar_t* SiteDN)
+{
+	DWORD Low = 0;
+
+	DWORD High = DCCount;
+
+	while (Low < High)
+	{
+		DWORD Middle = Low + ((High - Low) / 2);
+
+		if (_wcsicmp(DCs[Middle].Entity->site, SiteDN) < 0)
+		{
+			Low = Middle + 1;
+		}
+		else
+		{
+			High = Middle;
+		}
+	}
+
+	return(Low);
+}
+
+// Sizes every site in Entities to fit the names of the DCs inside it, puts the sites where Mode says, and stacks the
+// DCs within each site. MeasureText says how wide a DC's fqdn will be when drawn in the huge font. AspectRatio is the
+// screen's width over its height, for LM_PACKED.
+
+DWORD LayoutTopology(_Inout_ ENTITY* Entities, _In_ MEASURE_TEXT_PROC MeasureText, _In_ LAYOUT_MODE Mode, _In_ float AspectRatio)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	ENTITY** Sites = NULL;
+
+	LAYOUT_ENTITY* DCs = NULL;
+
+	DWORD SiteCount = 0;
+
+	DWORD DCCount = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		SiteCount += (Current->Type == ET_SITE);
+
+		DCCount += (Current->Type == ET_DC);
+	}
+
+	if ((Sites = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(SiteCount, 1) * sizeof(ENTITY*))) == NULL ||
+		(DCs = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(DCCount, 1) * sizeof(LAYOUT_ENTITY))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to allocate memory to lay out %lu sites and %lu DCs!", __FUNCTIONW__, SiteCount, DCCount);
+
+		goto Exit;
+	}
+
+	SiteCount = 0;
+
+	DCCount = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_SITE)
+		{
+			Sites[SiteCount++] = Current;
+		}
+		else if (Current->Type == ET_DC)
+		{
+			DCs[DCCount].Entity = Current;
+
+			DCs[DCCount].Ordinal = DCCount;
+
+			DCCount++;
+		}
+	}
+
+	// With the DCs sorted by site, each site's are found with a binary search instead of a walk of every entity.
+
+	qsort(DCs, DCCount, sizeof(LAYOUT_ENTITY), LayoutCompareDCs);
+
+	for (DWORD Site = 0; Site < SiteCount; Site++)
+	{
+		ENTITY* Current = Sites[Site];
+
+		Current->width = 0;
+
+		for (DWORD DC = LayoutFirstDCInSite(DCs, DCCount, Current->distinguishedname);
+			DC < DCCount && _wcsicmp(DCs[DC].Entity->site, Current->distinguishedname) == 0;
+			DC++)
+		{
+			wchar_t Guess[256] = { 0 };
+
+			wchar_t* LabelText = DCLabelText(DCs[DC].Entity, Guess, _countof(Guess));
+
+			Current->width = max(Current->width, MeasureText(LabelText, (int)wcslen(LabelText)));
+		}
+
+		// add extra width for the triangle DC icons, and some padding
+
+		Current->width += DEF_DC_SIZE + (DEF_DC_SIZE / 2);
+
+		if (Current->DCsInSite)
+		{
+			Current->height = (Current->DCsInSite * DEF_DC_SIZE) + (Current->DCsInSite * (DEF_DC_SIZE / 2));
+		}
+		else
+		{
+			Current->height = DEF_DC_SIZE; // an empty site with no dcs in it
+		}
+	}
+
+	if (Mode == LM_PACKED)
+	{
+		if ((Result = PackSites(Sites, SiteCount, AspectRatio, NULL)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+	else
+	{
+		int x = LAYOUT_ORIGIN_X;
+
+		for (DWORD Site = 0; Site < SiteCount; Site++)
+		{
+			Sites[Site]->x = x;
+
+			Sites[Site]->y = LAYOUT_ORIGIN_Y;
+
+			x += Sites[Site]->width + LAYOUT_SITE_GAP;
+		}
+	}
+
+	// The DCs go down the left side of their site, in the order they were found.
+
+	for (DWORD Site = 0; Site < SiteCount; Site++)
+	{
+		ENTITY* Current = Sites[Site];
+
+		int DCIndex = 0;
+
+		for (DWORD DC = LayoutFirstDCInSite(DCs, DCCount, Current->distinguishedname);
+			DC < DCCount && _wcsicmp(DCs[DC].Entity->site, Current->distinguishedname) == 0;
+			DC++, DCIndex++)
+		{
+			ENTITY* Entity = DCs[DC].Entity;
+
+			Entity->x = Current->x + (DEF_DC_SIZE / 4);
+
+			Entity->y = (Current->y + (DEF_DC_SIZE / 4)) + (DCIndex * (DEF_DC_SIZE + (DEF_DC_SIZE / 2)));
+
+			Entity->width = DEF_DC_SIZE;
+
+			Entity->height = DEF_DC_SIZE;
+		}
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Laid out %lu sites and %lu DCs %s.", __FUNCTIONW__, SiteCount, DCCount, Mode == LM_PACKED ? L"packed" : L"in a row");
+
+Exit:
+
+	if (Sites)
+	{
+		HeapFree(GetProcessHeap(), 0, Sites);
+	}
+
+	if (DCs)
+	{
+		HeapFree(GetProcessHeap(), 0, DCs);
+	}
+
+	return(Result);
+}
+
+// Packs SiteCount sites, already sized, into a rectangle about AspectRatio times as wide as it is high, starting from
+// LAYOUT_ORIGIN_X, LAYOUT_ORIGIN_Y; see Layout.h. Only the sites move. Extent is how much of the world they take up.
+
+DWORD PackSites(_Inout_ ENTITY** Sites, _In_ DWORD SiteCount, _In_ float AspectRatio, _Out_opt_ SIZE* Extent)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	LAYOUT_ENTITY* Order = NULL;
+
+	LAYOUT_SEGMENT* Skyline = NULL;
+
+	DWORD SegmentCount = 1;
+
+	double Area = 0.0;
+
+	int PackWidth = 0;
+
+	int Right = 0;
+
+	int Bottom = 0;
+
+	if (Extent)
+	{
+		Extent->cx = 0;
+
+		Extent->cy = 0;
+	}
+
+	if (SiteCount == 0)
+	{
+		goto Exit;
+	}
+
+	if (AspectRatio <= 0.0f)
+	{
+		AspectRatio = LAYOUT_DEF_ASPECT_RATIO;
+	}
+
+	// Placing a site adds at most one segment to the skyline.
+
+	if ((Order = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)SiteCount * sizeof(LAYOUT_ENTITY))) == NULL ||
+		(Skyline = HeapAlloc(GetProcessHeap(), 0, ((SIZE_T)SiteCount + 1) * sizeof(LAYOUT_SEGMENT))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to allocate memory to pack %lu sites!", __FUNCTIONW__, SiteCount);
+
+		goto Exit;
+	}
+
+	for (DWORD Site = 0; Site < SiteCount; Site++)
+	{
+		Order[Site].Entity = Sites[Site];
+
+		Order[Site].Ordinal = Site;
+
+		Area += (double)(Sites[Site]->width + LAYOUT_SITE_GAP) * (double)(Sites[Site]->height + LAYOUT_SITE_GAP);
+
+		PackWidth = max(PackWidth, Sites[Site]->width + LAYOUT_SITE_GAP);
+	}
+
+	PackWidth = max(PackWidth, (int)sqrt(Area * AspectRatio));
+
+	qsort(Order, SiteCount, sizeof(LAYOUT_ENTITY), LayoutCompareSites);
+
+	Skyline[0].x = 0;
+
+	Skyline[0].y = 0;
+
+	Skyline[0].Width = PackWidth;
+
+	for (DWORD Site = 0; Site < SiteCount; Site++)
+	{
+		ENTITY* Current = Order[Site].Entity;
+
+		int Width = Current->width + LAYOUT_SITE_GAP;
+
+		int Height = Current->height + LAYOUT_SITE_GAP;
+
+		DWORD Best = 0;
+
+		int BestY = MAXINT;
+
+		int Left = 0;
+
+		DWORD Covered = 0;
+
+		// The site rests on the highest segment under it. No site is wider than the skyline, so the first segment
+		// always has room.
+
+		for (DWORD Segment = 0; Segment < SegmentCount && Skyline[Segment].x + Width <= PackWidth; Segment++)
+		{
+			int y = Skyline[Segment].y;
+
+			for (DWORD Next = Segment + 1; Next < SegmentCount && Skyline[Next].x < Skyline[Segment].x + Width && y < BestY; Next++)
+			{
+				y = max(y, Skyline[Next].y);
+			}
+
+			if (y < BestY)
+			{
+				BestY = y;
+
+				Best = Segment;
+			}
+		}
+
+		Left = Skyline[Best].x;
+
+		Current->x = LAYOUT_ORIGIN_X + Left;
+
+		Current->y = LAYOUT_ORIGIN_Y + BestY;
+
+		Right = max(Right, Left + Width);
+
+		Bottom = max(Bottom, BestY + Height);
+
+		// The segments it covers become one, along its top; one it only partly covers is cut short.
+
+		Covered = Best;
+
+		while (Covered < SegmentCount && Skyline[Covered].x + Skyline[Covered].Width <= Left + Width)
+		{
+			Covered++;
+		}
+
+		if (Covered < SegmentCount && Skyline[Covered].x < Left + Width)
+		{
+			Skyline[Covered].Width -= (Left + Width) - Skyline[Covered].x;
+
+			Skyline[Covered].x = Left + Width;
+		}
+
+		memmove(&Skyline[Best + 1], &Skyline[Covered], (SegmentCount - Covered) * sizeof(LAYOUT_SEGMENT));
+
+		SegmentCount = SegmentCount - (Covered - Best) + 1;
+
+		Skyline[Best].x = Left;
+
+		Skyline[Best].y = BestY + Height;
+
+		Skyline[Best].Width = Width;
+
+		// Level neighbours are merged, so the skyline stays as short as it can be.
+
+		if (Best + 1 < SegmentCount && Skyline[Best + 1].y == Skyline[Best].y)
+		{
+			Skyline[Best].Width += Skyline[Best + 1].Width;
+
+			memmove(&Skyline[Best + 1], &Skyline[Best + 2], (SegmentCount - Best - 2) * sizeof(LAYOUT_SEGMENT));
+
+			SegmentCount--;
+		}
+
+		if (Best > 0 && Skyline[Best - 1].y == Skyline[Best].y)
+		{
+			Skyline[Best - 1].Width += Skyline[Best].Width;
+
+			memmove(&Skyline[Best], &Skyline[Best + 1], (SegmentCount - Best - 1) * sizeof(LAYOUT_SEGMENT));
+
+			SegmentCount--;
+		}
+	}
+
+	if (Extent)
+	{
+		Extent->cx = Right - LAYOUT_SITE_GAP;
+
+		Extent->cy = Bottom - LAYOUT_SITE_GAP;
+	}
+
+Exit:
+
+	if (Order)
+	{
+		HeapFree(GetProcessHeap(), 0, Order);
+	}
+
+	if (Skyline)
+	{
+		HeapFree(GetProcessHeap(), 0, Skyline);
+	}
+
+	return(Result);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// Where sites and DCs go in the world. Each site is sized to fit the names of the DCs in it, and the DCs are stacked
+// down its left side. Then the sites are either put in one long row, in the order discovery found them, or packed
+// into a rectangle about the shape of the screen, so the whole forest can be seen at once without most of the screen
+// being empty, and fewer sites are near enough to the camera to survive culling.
+//
+// Packing is bottom-left skyline bin packing. Sites are taken tallest first, and each goes in the lowest place along
+// the top edge of the sites packed so far where it fits, leftmost if there's a tie. The rectangle is as wide as the
+// sites would need to fill it at the screen's aspect ratio with nothing wasted, or the widest site if that's wider.
+// The skyline never has more segments than the rectangle has room for sites side by side, so packing n sites costs
+// O(n sqrt n) at worst: tens of milliseconds for tens of thousands of them, and next to nothing for any real forest.
+// Nothing is random and ties are broken by discovery order, so the same forest always comes out the same.
+
+// Between sites, in either direction. Leaves room for a site's name below it and the next one's name above.
+#define LAYOUT_SITE_GAP			256
+
+// Where the first site goes.
+#define LAYOUT_ORIGIN_X			192
+
+#define LAYOUT_ORIGIN_Y			64
+
+// For when there's no screen to go by.
+#define LAYOUT_DEF_ASPECT_RATIO	(16.0f / 9.0f)
+
+// The Layout registry value.
+typedef enum LAYOUT_MODE
+{
+	LM_PACKED,
+
+	LM_ROW
+
+} LAYOUT_MODE;
+
+// A site or DC, and where in the entity list it was, so sorting them keeps ties in the order they were found.
+typedef struct LAYOUT_ENTITY
+{
+	ENTITY* Entity;
+
+	DWORD Ordinal;
+
+} LAYOUT_ENTITY;
+
+// One step of the skyline: the top edge of what's been packed, from x to x + Width, is at y.
+typedef struct LAYOUT_SEGMENT
+{
+	int x;
+
+	int y;
+
+	int Width;
+
+} LAYOUT_SEGMENT;
+
+DWORD LayoutTopology(_Inout_ ENTITY* Entities, _In_ MEASURE_TEXT_PROC MeasureText, _In_ LAYOUT_MODE Mode, _In_ float AspectRatio);
+
+DWORD PackSites(_Inout_ ENTITY** Sites, _In_ DWORD SiteCount, _In_ float AspectRatio, _Out_opt_ SIZE* Extent);
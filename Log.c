@@ -0,0 +1,572 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Logging. LogEventW used to open the log file, seek to the end, write one line and close it again, all inside a
+// critical section, for every single message. At LL_INFO that made discovering a large forest slower than the AD
+// calls themselves.
+//
+// Now callers format their message and drop it into a fixed-size lock-free ring buffer (multiple producers, one
+// consumer), and a background writer thread drains the ring in batches into a file handle that stays open. If the ring
+// fills up, informational messages are dropped and counted while warnings and errors wait for space, unless the
+// LogFullPolicy registry setting says everything should wait.
+//
+// Messages logged before InitializeLog or after ShutdownLog still go straight to the file the old way.
+
+#include <Windows.h>
+
+#include <stdio.h>
+
+#include "Main.h"
+
+#include "Log.h"
+
+
+
+static CRITICAL_SECTION gLogLock;
+
+static wchar_t gLogFileName[MAX_PATH] = LOG_FILE_NAME;
+
+static LOG_SLOT* gLogSlots;
+
+static volatile LONG64 gLogEnqueuePosition;
+
+static LONG64 gLogDequeuePosition;
+
+static volatile LONG64 gLogDropped;
+
+static volatile LONG gLogWriterIdle;
+
+static volatile LONG gLogAsynchronous;
+
+static HANDLE gLogWriterThread;
+
+static HANDLE gLogWakeEvent;
+
+static HANDLE gLogStopEvent;
+
+static HANDLE gLogFileHandle = INVALID_HANDLE_VALUE;
+
+
+
+static HANDLE OpenLogFile(void)
+{
+	HANDLE FileHandle = INVALID_HANDLE_VALUE;
+
+	DWORD BytesWritten = 0;
+
+	// Shared for writing as well, so a message logged synchronously while the writer thread still has the file open
+	// (while the log is being shut down, say) can still get in.
+
+	if ((FileHandle = CreateFileW(gLogFileName, FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		return(INVALID_HANDLE_VALUE);
+	}
+
+	if (SetFilePointer(FileHandle, 0, NULL, FILE_END) == 0)
+	{
+		// If this is the beginning of a new file we need to write the utf16 BOM.
+
+		unsigned char BOM[2] = { 0xFF, 0xFE };
+
+		WriteFile(FileHandle, BOM, 2, &BytesWritten, NULL);
+	}
+
+	return(FileHandle);
+}
+
+static void LogWriteSynchronous(_In_ wchar_t* Text, _In_ DWORD Length)
+{
+	HANDLE FileHandle = INVALID_HANDLE_VALUE;
+
+	DWORD BytesWritten = 0;
+
+	EnterCriticalSection(&gLogLock);
+
+	if ((FileHandle = OpenLogFile()) == INVALID_HANDLE_VALUE)
+	{
+		ASSERT(FALSE, L"Failed to access log file!");
+	}
+	else
+	{
+		WriteFile(FileHandle, Text, Length * sizeof(wchar_t), &BytesWritten, NULL);
+
+		CloseHandle(FileHandle);
+	}
+
+	LeaveCriticalSection(&gLogLock);
+}
+
+static BOOL LogEnqueue(_In_ wchar_t* Text, _In_ DWORD Length, _In_ BOOL MayDrop)
+{
+	LONG64 Position = gLogEnqueuePosition;
+
+	LOG_SLOT* Slot = NULL;
+
+	while (TRUE)
+	{
+		Slot = &gLogSlots[Position & (LOG_RING_SLOTS - 1)];
+
+		LONG64 Difference = Slot->Sequence - Position;
+
+		if (Difference == 0)
+		{
+			// The slot is free for this position, try to claim it.
+
+			if (InterlockedCompareExchange64(&gLogEnqueuePosition, Position + 1, Position) == Position)
+			{
+				break;
+			}
+
+			Position = gLogEnqueuePosition;
+		}
+		else if (Difference < 0)
+		{
+			// The ring is full; the writer hasn't consumed this slot's previous occupant yet.
+
+			if (gLogAsynchronous == FALSE)
+			{
+				// The writer is gone, nobody is going to make room.
+
+				LogWriteSynchronous(Text, Length);
+
+				return(TRUE);
+			}
+
+			if (MayDrop)
+			{
+				InterlockedIncrement64(&gLogDropped);
+
+				return(FALSE);
+			}
+
+			if (InterlockedExchange(&gLogWriterIdle, FALSE))
+			{
+				SetEvent(gLogWakeEvent);
+			}
+
+			SwitchToThread();
+
+			Position = gLogEnqueuePosition;
+		}
+		else
+		{
+			// Another producer got here first.
+
+			Position = gLogEnqueuePosition;
+		}
+	}
+
+	memcpy(Slot->Text, Text, Length * sizeof(wchar_t));
+
+	Slot->Length = Length;
+
+	// Publish. The interlocked exchange is a full barrier, so the writer can't see the new sequence before the text.
+
+	InterlockedExchange64(&Slot->Sequence, Position + 1);
+
+	if (gLogWriterIdle && InterlockedExchange(&gLogWriterIdle, FALSE))
+	{
+		SetEvent(gLogWakeEvent);
+	}
+
+	return(TRUE);
+}
+
+static DWORD WINAPI LogWriterThreadProc(_In_ LPVOID lpParameter)
+{
+	UNREFERENCED_PARAMETER(lpParameter);
+
+	wchar_t* Buffer = NULL;
+
+	DWORD BufferLength = 0;
+
+	DWORD BytesWritten = 0;
+
+	LONG64 DroppedReported = 0;
+
+	BOOL Stopping = FALSE;
+
+	if ((Buffer = HeapAlloc(GetProcessHeap(), 0, LOG_WRITE_BUFFER_CHARS * sizeof(wchar_t))) == NULL)
+	{
+		return(ERROR_NOT_ENOUGH_MEMORY);
+	}
+
+	while (TRUE)
+	{
+		BOOL DrainedAnything = FALSE;
+
+		while (TRUE)
+		{
+			LOG_SLOT* Slot = &gLogSlots[gLogDequeuePosition & (LOG_RING_SLOTS - 1)];
+
+			if (Slot->Sequence != gLogDequeuePosition + 1)
+			{
+				break;
+			}
+
+			if (BufferLength + Slot->Length > LOG_WRITE_BUFFER_CHARS)
+			{
+				WriteFile(gLogFileHandle, Buffer, BufferLength * sizeof(wchar_t), &BytesWritten, NULL);
+
+				BufferLength = 0;
+			}
+
+			memcpy(&Buffer[BufferLength], Slot->Text, Slot->Length * sizeof(wchar_t));
+
+			BufferLength += Slot->Length;
+
+			// Hand the slot back to producers for the position one lap ahead.
+
+			InterlockedExchange64(&Slot->Sequence, gLogDequeuePosition + LOG_RING_SLOTS);
+
+			gLogDequeuePosition++;
+
+			DrainedAnything = TRUE;
+		}
+
+		if (gLogDropped != DroppedReported)
+		{
+			LONG64 Dropped = gLogDropped;
+
+			wchar_t Notice[LOG_DROPPED_NOTICE_CHARS] = { 0 };
+
+			int Written = _snwprintf_s(
+				Notice,
+				_countof(Notice),
+				_TRUNCATE,
+				L"\n[WARN][%s] Log buffer was full, %lld informational messages were dropped.",
+				__FUNCTIONW__,
+				Dropped - DroppedReported);
+
+			if (Written > 0)
+			{
+				// The drain above can leave the buffer full to the last character.
+
+				if (BufferLength + (DWORD)Written > LOG_WRITE_BUFFER_CHARS)
+				{
+					WriteFile(gLogFileHandle, Buffer, BufferLength * sizeof(wchar_t), &BytesWritten, NULL);
+
+					BufferLength = 0;
+				}
+
+				memcpy(&Buffer[BufferLength], Notice, Written * sizeof(wchar_t));
+
+				BufferLength += Written;
+
+				DroppedReported = Dropped;
+			}
+		}
+
+		if (BufferLength > 0)
+		{
+			WriteFile(gLogFileHandle, Buffer, BufferLength * sizeof(wchar_t), &BytesWritten, NULL);
+
+			BufferLength = 0;
+		}
+
+		if (Stopping)
+		{
+			break;
+		}
+
+		if (DrainedAnything)
+		{
+			continue;
+		}
+
+		// Tell producers we're about to sleep, then look one more time so a message enqueued in between isn't stranded.
+
+		InterlockedExchange(&gLogWriterIdle, TRUE);
+
+		if (gLogSlots[gLogDequeuePosition & (LOG_RING_SLOTS - 1)].Sequence == gLogDequeuePosition + 1)
+		{
+			InterlockedExchange(&gLogWriterIdle, FALSE);
+
+			continue;
+		}
+
+		HANDLE WaitHandles[2] = { gLogStopEvent, gLogWakeEvent };
+
+		if (WaitForMultipleObjects(_countof(WaitHandles), WaitHandles, FALSE, LOG_FLUSH_INTERVAL_MS) == WAIT_OBJECT_0)
+		{
+			// One last pass to pick up anything enqueued before producers noticed we're stopping.
+
+			Stopping = TRUE;
+		}
+
+		InterlockedExchange(&gLogWriterIdle, FALSE);
+	}
+
+	HeapFree(GetProcessHeap(), 0, Buffer);
+
+	return(ERROR_SUCCESS);
+}
+
+DWORD InitializeLog(_In_ wchar_t* FileName, _In_ BOOL Asynchronous)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	static BOOL LockInitialized;
+
+	if (LockInitialized == FALSE)
+	{
+		if (InitializeCriticalSectionAndSpinCount(&gLogLock, 0x1000) == 0)
+		{
+			ASSERT(FALSE, L"InitializeCriticalSectionAndSpinCount failed!");
+		}
+
+		LockInitialized = TRUE;
+	}
+
+	wcscpy_s(gLogFileName, _countof(gLogFileName), FileName);
+
+	if (Asynchronous == FALSE)
+	{
+		goto Exit;
+	}
+
+	if ((gLogSlots = VirtualAlloc(NULL, sizeof(LOG_SLOT) * LOG_RING_SLOTS, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE)) == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	for (LONG64 Slot = 0; Slot < LOG_RING_SLOTS; Slot++)
+	{
+		gLogSlots[Slot].Sequence = Slot;
+	}
+
+	gLogEnqueuePosition = 0;
+
+	gLogDequeuePosition = 0;
+
+	gLogDropped = 0;
+
+	gLogWriterIdle = FALSE;
+
+	if ((gLogFileHandle = OpenLogFile()) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	gLogWakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+	gLogStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+	if (gLogWakeEvent == NULL || gLogStopEvent == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	if ((gLogWriterThread = CreateThread(NULL, 0, LogWriterThreadProc, NULL, 0, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	InterlockedExchange(&gLogAsynchronous, TRUE);
+
+Exit:
+
+	if (Result != ERROR_SUCCESS)
+	{
+		// Logging still works, just the slow way.
+
+		ShutdownLog(0);
+	}
+
+	return(Result);
+}
+
+void ShutdownLog(_In_ DWORD TimeoutMilliseconds)
+{
+	// Producers that already checked gLogAsynchronous may still be mid-enqueue, which is why the writer thread
+	// does one last drain after the stop event is set.
+
+	InterlockedExchange(&gLogAsynchronous, FALSE);
+
+	if (gLogWriterThread)
+	{
+		SetEvent(gLogStopEvent);
+
+		if (WaitForSingleObject(gLogWriterThread, TimeoutMilliseconds) != WAIT_OBJECT_0)
+		{
+			// It's still using the file and the events, so they're left open. The process is about to exit anyway.
+
+			return;
+		}
+
+		CloseHandle(gLogWriterThread);
+
+		gLogWriterThread = NULL;
+	}
+
+	if (gLogFileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(gLogFileHandle);
+
+		gLogFileHandle = INVALID_HANDLE_VALUE;
+	}
+
+	if (gLogWakeEvent)
+	{
+		CloseHandle(gLogWakeEvent);
+
+		gLogWakeEvent = NULL;
+	}
+
+	if (gLogStopEvent)
+	{
+		CloseHandle(gLogStopEvent);
+
+		gLogStopEvent = NULL;
+	}
+
+	// The slots are deliberately not freed; a straggling producer may still be writing into one.
+}
+
+UINT64 GetLogDroppedCount(void)
+{
+	return((UINT64)gLogDropped);
+}
+
+void LogEventW(_In_ LOGLEVEL Level, _In_ LOGFLAGS Flags, _In_ wchar_t* Message, ...)
+{
+	va_list Args = NULL;
+
+	size_t MsgLen = 0;
+
+	SYSTEMTIME Time = { 0 };
+
+	int DateTimeLength = 0;
+
+	int FormattedLength = 0;
+
+	wchar_t SeverityString[32] = { 0 };
+
+	wchar_t FinalMessage[LOG_SLOT_CHARS] = { 0 };
+
+	// Filter first. Most calls are LL_INFO and most of the time LL_INFO is off, so this needs to be the cheapest path.
+
+	if (gRegParams.LogLevel < Level)
+	{
+		return;
+	}
+
+	MsgLen = wcslen(Message);
+
+	if (MsgLen < 1 || MsgLen >= 1024)
+	{
+		ASSERT(FALSE, L"LogEventW: Message was either too short or too long!");
+	}
+
+	if (!(Flags & LF_FILE) && !(Flags & LF_DIALOGBOX))
+	{
+		ASSERT(FALSE, L"LogEventW: Must supply some flag!")
+	}
+
+	switch (Level)
+	{
+		case LL_NONE:
+		{
+			return;
+		}
+		case LL_INFO:
+		{
+			wcscpy_s(SeverityString, _countof(SeverityString), L"[INFO]");
+
+			break;
+		}
+		case LL_WARN:
+		{
+			wcscpy_s(SeverityString, _countof(SeverityString), L"[WARN]");
+
+			break;
+		}
+		case LL_ERROR:
+		{
+			wcscpy_s(SeverityString, _countof(SeverityString), L"[ERROR]");
+
+			break;
+		}
+		default:
+		{
+			ASSERT(FALSE, L"LogEventW: Unrecognized log level!");
+		}
+	}
+
+	GetLocalTime(&Time);
+
+	// Format straight into the final buffer instead of going through intermediate strings.
+
+	DateTimeLength = _snwprintf_s(
+		FinalMessage,
+		_countof(FinalMessage),
+		_TRUNCATE,
+		L"\n[%02u/%02u/%u %02u:%02u:%02u.%03u]%s",
+		Time.wMonth, Time.wDay, Time.wYear, Time.wHour, Time.wMinute, Time.wSecond, Time.wMilliseconds,
+		SeverityString);
+
+	va_start(Args, Message);
+
+	FormattedLength = _vsnwprintf_s(&FinalMessage[DateTimeLength], _countof(FinalMessage) - DateTimeLength, _TRUNCATE, Message, Args);
+
+	va_end(Args);
+
+	if (FormattedLength < 0)
+	{
+		// Truncated
+		FormattedLength = (int)wcslen(&FinalMessage[DateTimeLength]);
+	}
+
+	if (Flags & LF_FILE)
+	{
+		if (gLogAsynchronous)
+		{
+			LogEnqueue(FinalMessage, (DWORD)(DateTimeLength + FormattedLength), (Level == LL_INFO && gRegParams.LogFullPolicy == LFP_DROP_INFO));
+		}
+		else
+		{
+			LogWriteSynchronous(FinalMessage, (DWORD)(DateTimeLength + FormattedLength));
+		}
+	}
+
+	if (Flags & LF_DIALOGBOX)
+	{
+		switch (Level)
+		{
+			case LL_NONE:
+			{
+				ASSERT(FALSE, L"LogEventW: Level 0 not valid!");
+			}
+			case LL_INFO:
+			{
+				MessageBoxW(gMainWindowHandle, FinalMessage, SeverityString, MB_OK | MB_ICONINFORMATION);
+
+				break;
+			}
+			case LL_WARN:
+			{
+				MessageBoxW(gMainWindowHandle, FinalMessage, SeverityString, MB_OK | MB_ICONWARNING);
+
+				break;
+			}
+			case LL_ERROR:
+			{
+				MessageBoxW(gMainWindowHandle, FinalMessage, SeverityString, MB_OK | MB_ICONERROR);
+
+				break;
+			}
+			default:
+			{
+				ASSERT(FALSE, L"LogEventW: Unrecognized log level!");
+			}
+		}
+	}
+}
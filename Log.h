@@ -0,0 +1,44 @@
+#pragma once
+
+// Must be a power of two.
+#define LOG_RING_SLOTS			1024
+
+#define LOG_SLOT_CHARS			1280
+
+// The writer thread collects messages into a buffer this big before calling WriteFile.
+#define LOG_WRITE_BUFFER_CHARS	32768
+
+// Room for the line saying how many messages were dropped.
+#define LOG_DROPPED_NOTICE_CHARS	160
+
+// Even if nothing wakes it, the writer thread drains the ring this often.
+#define LOG_FLUSH_INTERVAL_MS	100
+
+#define LOG_SHUTDOWN_TIMEOUT_MS	2000
+
+// What a producer does when the ring is full.
+typedef enum LOG_FULL_POLICY
+{
+	LFP_DROP_INFO,	// Informational messages are dropped (and counted), warnings and errors wait for space
+
+	LFP_BLOCK		// Everything waits for space
+
+} LOG_FULL_POLICY;
+
+typedef struct LOG_SLOT
+{
+	// Vyukov-style sequence number. Equal to the slot's position when the slot is free for that position,
+	// position + 1 once a producer has filled it.
+	volatile LONG64 Sequence;
+
+	DWORD Length;
+
+	wchar_t Text[LOG_SLOT_CHARS];
+
+} LOG_SLOT;
+
+DWORD InitializeLog(_In_ wchar_t* FileName, _In_ BOOL Asynchronous);
+
+void ShutdownLog(_In_ DWORD TimeoutMilliseconds);
+
+UINT64 GetLogDroppedCount(void);
@@ -23,23 +23,79 @@
 
 #include <stdio.h>
 
+#include <stdlib.h>
+
 #include "Main.h"
 
+#include "Replication.h"
+
+#include "Probe.h"
+
+#include "Log.h"
+
+#include "Benchmark.h"
+
+#include "Trace.h"
+
+#include "FrameStats.h"
+
+#include "Export.h"
+
+#include "Snapshot.h"
+
+#include "Headless.h"
+
+#include "Search.h"
+
+#include "Pick.h"
+
+#include "Domains.h"
+
+#include "Diff.h"
+
+#include "SiteGraph.h"
+
+#include "Convergence.h"
+
+#include "Kcc.h"
+
+#include "DCDetails.h"
+
+#include "Cancel.h"
+
+#include "RenderList.h"
+
+#include "DistinguishedName.h"
+
+#include "TilePyramid.h"
+
+#include "TimeSeries.h"
+
+#include "Timeline.h"
+
+#include "InputTrace.h"
+
+#include "Labels.h"
+
+#include "Layout.h"
+
+#include "Scene.h"
+
 #pragma comment(lib, "Winmm.lib")	// For timeBeginPeriod()
 
 #pragma comment(lib, "Netapi32.lib")
 
 #pragma comment(lib, "Ntdsapi.lib")
 
+#pragma comment(lib, "Shell32.lib")	// For CommandLineToArgvW()
 
 
-HWND gMainWindowHandle;
 
-CRITICAL_SECTION gLogLock;
+HWND gMainWindowHandle;
 
 REGPARAMS gRegParams = { .LogLevel = LL_ERROR };
 
-BOOL gContinue = TRUE;
+volatile BOOL gContinue = TRUE;
 
 GRAPHICSDATA gGraphicsData;
 
@@ -47,10 +103,90 @@ CAMERA gCamera = { .x = 0, .y = 0, .z = 1 };
  
 ENTITY* gEntities;
 
+wchar_t gForestName[256];
+
+// The DC that discovery started from, which later LDAP reads go back to.
+wchar_t gDiscoveryDC[256];
+
+VISIBLEENTITY* gVisibleEntities;
+
+int gVisibleEntitiesCapacity;
+
 BOOL gShouldShowDebugText;
 
+BOOL gShouldShowFrameGraph;
+
+BOOL gSearchActive;
+
+wchar_t gSearchQuery[SEARCH_MAX_QUERY_CHARS + 1];
+
+ENTITY* gSearchResults[SEARCH_MAX_RESULTS];
+
+DWORD gSearchResultCount;
+
+DWORD gSearchSelected;
+
+SCENE* gFrameScene;
+
+// The site or DC under the mouse, or NULL. Refreshed every frame, since the camera can move under a still mouse.
+ENTITY* gHoveredEntity;
+
+// Set by -compare. Once discovery is done, the topology is compared against this snapshot.
+wchar_t* gCompareFileName;
+
+TOPOLOGY_DIFF gTopologyDiff;
+
+// The version of the timeline gTopologyDiff is against, or TIMELINE_NONE. Owned by the UI thread.
+DWORD gTimelineVersion = TIMELINE_NONE;
+
+// Site links and inter-site connections. Only read during live discovery; snapshots don't have them.
+SITEGRAPH* gSiteGraph;
+
+CONVERGENCE_GRAPH* gConvergenceGraph;
+
+// The latest simulation to come back for gConvergenceSource. Owned by the UI thread.
+CONVERGENCE_RESULT* gConvergence;
+
+DWORD gConvergenceSource;
+
+// Simulations still running on the thread pool.
+DWORD gConvergencePending;
+
+BOOL gShowConvergence;
+
+// The KCC what-if simulation, built the first time K is pressed.
+KCC_SIMULATION* gKcc;
+
+BOOL gShowKcc;
+
+// The site link that + and - change the what-if cost of, chosen with Tab. MAXDWORD for none.
+DWORD gKccSelectedLink = MAXDWORD;
+
+// Where the camera is flying to, after picking a search result.
+CAMERA gCameraTarget;
+
+BOOL gCameraAnimating;
+
+DC_COLOR_MODE gDCColorMode;
+
+wchar_t* gDCColorModeNames[DCCM_COUNT] = { L"Replication", L"LDAP p95", L"GC p95", L"Kerberos p95" };
+
+// Which role each of gGraphicsData.RoleBrushes stands for, left to right.
+DWORD gRoleBadgeFlags[DC_ROLE_BADGES] = { DCF_PDCE, DCF_RIDMASTER, DCF_INFRASTRUCTUREMASTER, DCF_SCHEMAMASTER, DCF_DOMAINNAMINGMASTER };
+
 HANDLE gDiscoveryThread;
 
+// The scene is recorded into this every frame, then played back with GDI.
+RENDER_LIST* gRenderList;
+
+// Open while R is recording frames to RENDER_RECORD_FILE_NAME.
+HANDLE gRenderRecordFile = INVALID_HANDLE_VALUE;
+
+DWORD gRenderFramesToRecord;
+
+// M shows the whole forest in the corner, from the top of the tile pyramid.
+BOOL gShowMinimap;
+
 POINT gMouseScreenPosition;
 
 POINT gMouseWorldPosition;
@@ -91,7 +227,19 @@ wchar_t* gHelpText = L"H: Dismiss this help text\n"
 					 L"Mouse wheel: zoom\n"
 					 L"Ctrl+Mouse wheel: zoom faster\n"
 					 L"Esc: Quit\n"
-					 L"F11: Debug text";
+					 L"F11: Debug text\n"
+					 L"G: Frame time graph (with F11)\n"
+					 L"C: Cycle DC colour (replication/latency)\n"
+					 L"/ or Ctrl+F: Search\n"
+					 L"E: Export topology (JSON, GraphML, DOT)\n"
+					 L"T: Save timing trace (debug builds)\n"
+					 L"R: Record the next frames' render commands\n"
+					 L"M: Minimap of the whole forest\n"
+					 L"L: Lay out again, packed or in a row\n"
+					 L"V: Convergence heatmap from the site under the mouse\n"
+					 L"K: KCC what-if (Del: remove DC, Tab: pick link, +/-: link cost, Backspace: undo all)\n"
+					 L"Comma/Period: Compare with older/newer versions of the topology\n"
+					 L"F9: Start/stop recording input, for -replay";
 
 
 
@@ -107,10 +255,24 @@ int WINAPI wWinMain(_In_ HINSTANCE Instance, _In_opt_ HINSTANCE PrevInstance, _I
 
 	MSG WindowMsg = { 0 };	
 
-	if (InitializeCriticalSectionAndSpinCount(&gLogLock, 0x1000) == 0)
+	int ArgCount = 0;
+
+	wchar_t** Args = NULL;
+
+	DWORD ExitCode = 0;
+
+	wchar_t* SnapshotFileName = NULL;
+
+	TRACE_THREAD_NAME(L"UI");
+
+	InitializeLog(LOG_FILE_NAME, TRUE);
+
+	if (InitializeCancellation() != ERROR_SUCCESS)
 	{
-		ASSERT(FALSE, L"InitializeCriticalSectionAndSpinCount failed!");
-	}	
+		LogEventW(LL_ERROR, LF_DIALOGBOX | LF_FILE, L"[%s] Failed to create the cancellation event!", __FUNCTIONW__);
+
+		goto Exit;
+	}
 
 	if (ReadRegistrySettings() != ERROR_SUCCESS)
 	{
@@ -119,6 +281,46 @@ int WINAPI wWinMain(_In_ HINSTANCE Instance, _In_opt_ HINSTANCE PrevInstance, _I
 		goto Exit;
 	}
 
+	QueryPerformanceFrequency(&gGraphicsData.PerformanceFrequency);
+
+	if ((Args = CommandLineToArgvW(GetCommandLineW(), &ArgCount)) != NULL)
+	{
+		for (int Arg = 1; Arg < ArgCount; Arg++)
+		{
+			if (_wcsicmp(Args[Arg], L"-benchmark") == 0)
+			{
+				RunBenchmarks((Arg + 1 < ArgCount) ? Args[Arg + 1] : L"all");
+
+				goto Exit;
+			}
+			else if (_wcsicmp(Args[Arg], L"-headless") == 0)
+			{
+				ExitCode = RunHeadless(ArgCount - Arg - 1, &Args[Arg + 1]);
+
+				goto Exit;
+			}
+			else if (_wcsicmp(Args[Arg], L"-open") == 0 && Arg + 1 < ArgCount)
+			{
+				SnapshotFileName = Args[++Arg];
+			}
+			else if (_wcsicmp(Args[Arg], L"-compare") == 0 && Arg + 1 < ArgCount)
+			{
+				gCompareFileName = Args[++Arg];
+			}
+			else if (_wcsicmp(Args[Arg], L"-replay") == 0 && Arg + 1 < ArgCount)
+			{
+				// The trace says which snapshot to open.
+
+				if ((ExitCode = StartInputReplay(Args[++Arg], &SnapshotFileName)) != ERROR_SUCCESS)
+				{
+					LogEventW(LL_ERROR, LF_DIALOGBOX | LF_FILE, L"[%s] Failed to load input trace %s! Error 0x%08lx", __FUNCTIONW__, Args[Arg], ExitCode);
+
+					goto Exit;
+				}
+			}
+		}
+	}
+
 	gGraphicsData.Resolution = gResolutions[gRegParams.ResolutionIndex];
 
 	if (timeBeginPeriod(1) == TIMERR_NOCANDO)
@@ -146,13 +348,11 @@ int WINAPI wWinMain(_In_ HINSTANCE Instance, _In_opt_ HINSTANCE PrevInstance, _I
 
 	GetClientRect(gMainWindowHandle, &gGraphicsData.ClientRect);	
 
-	QueryPerformanceFrequency(&gGraphicsData.PerformanceFrequency);
-
 	gDiscoveryThread = CreateThread(
 		NULL,
 		0,
 		DiscoveryThreadProc,
-		NULL,
+		SnapshotFileName,
 		0,
 		NULL);
 
@@ -169,13 +369,33 @@ int WINAPI wWinMain(_In_ HINSTANCE Instance, _In_opt_ HINSTANCE PrevInstance, _I
 	{
 		QueryPerformanceCounter(&gGraphicsData.FrameStart);
 
+		TRACE_BEGIN("Frame");
+
+		UpdateFrameScene();
+
+		TRACE_BEGIN("Messages");
+
 		while (PeekMessageW(&WindowMsg, NULL, 0, 0, PM_REMOVE))
 		{
+			// For WM_CHAR, which the search box needs.
+
+			TranslateMessage(&WindowMsg);
+
 			DispatchMessageW(&WindowMsg);
 		}
 
+		TRACE_END();
+
+		ReplayInputFrame();
+
+		AnimateCamera();
+
+		UpdateHoveredEntity();
+
 		RenderFrameGraphics();
 
+		TRACE_END();
+
 		QueryPerformanceCounter(&gGraphicsData.FrameEnd);
 
 		gGraphicsData.ElapsedMicroseconds = gGraphicsData.FrameEnd.QuadPart - gGraphicsData.FrameStart.QuadPart;
@@ -184,6 +404,14 @@ int WINAPI wWinMain(_In_ HINSTANCE Instance, _In_opt_ HINSTANCE PrevInstance, _I
 
 		gGraphicsData.ElapsedMicroseconds /= gGraphicsData.PerformanceFrequency.QuadPart;
 
+		FrameStatsEndFrame(gGraphicsData.ElapsedMicroseconds, gGraphicsData.EntitiesTested, gGraphicsData.EntitiesOnScreen);
+
+		EndInputFrame();
+
+		gGraphicsData.EntitiesTested = 0;
+
+		gGraphicsData.EntitiesOnScreen = 0;
+
 		gGraphicsData.TotalFramesRendered++;
 
 		gGraphicsData.ElapsedMicrosecondsAccumulatorRaw += gGraphicsData.ElapsedMicroseconds;
@@ -220,17 +448,67 @@ int WINAPI wWinMain(_In_ HINSTANCE Instance, _In_opt_ HINSTANCE PrevInstance, _I
 
 Exit:
 
+	// Discovery goes first, so it can't start anything below after it has been stopped. Whatever remote call it is
+	// waiting on is abandoned, not waited for.
+
+	RequestShutdown();
+
+	if (gDiscoveryThread && WaitForSingleObject(gDiscoveryThread, DISCOVERY_SHUTDOWN_TIMEOUT_MS) != WAIT_OBJECT_0)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] Discovery thread did not stop within %d ms.", __FUNCTIONW__, DISCOVERY_SHUTDOWN_TIMEOUT_MS);
+	}
+
+	StopSceneRebuild(SCENE_SHUTDOWN_TIMEOUT_MS);
+
+	StopReplicationScheduler(REPL_SHUTDOWN_TIMEOUT_MS);
+
+	StopProbeEngine(PROBE_SHUTDOWN_TIMEOUT_MS);
+
+	StopTimeSeries();
+
+	CloseTimeline();
+
+	StopInputTrace();
+
+	StopDCDetails(DCDETAILS_SHUTDOWN_TIMEOUT_MS);
+
+	// Whatever is still drawing or building a scene keeps it, and it goes with the process.
+
+	if (StopTilePyramid(TILE_SHUTDOWN_TIMEOUT_MS) && IsSceneRebuilding() == FALSE)
+	{
+		ReleaseScene(SR_UI);
+
+		gFrameScene = NULL;
+
+		FreeScenes();
+	}
+
 	LogEventW(LL_INFO, LF_FILE, L"[%s] Process is exiting.", __FUNCTIONW__);
 
 	LogEventW(LL_INFO, LF_FILE, L"[%s] =================================", __FUNCTIONW__);
 
-	return(0);
+	if (Args)
+	{
+		LocalFree(Args);
+	}
+
+	ShutdownLog(LOG_SHUTDOWN_TIMEOUT_MS);
+
+	return((int)ExitCode);
 }
 
 LRESULT CALLBACK MainWindowProc(_In_ HWND WindowHandle, _In_ UINT Message, _In_ WPARAM WParam, _In_ LPARAM LParam)
 {
 	LRESULT Result = 0;
 
+	// Input goes into the trace being recorded, if there is one, and real input is ignored while a trace is being
+	// replayed; see InputTrace.h.
+
+	if (TraceInputMessage(Message, WParam, LParam) == FALSE)
+	{
+		return(Result);
+	}
+
 	switch (Message)
 	{
 		case WM_SIZE:
@@ -247,10 +525,6 @@ LRESULT CALLBACK MainWindowProc(_In_ HWND WindowHandle, _In_ UINT Message, _In_
 
 				gMouseScreenPosition.y = GET_Y_LPARAM(LParam);
 
-				gMouseWorldPosition.x = (gMouseScreenPosition.x + gCamera.x) * gCamera.z;
-
-				gMouseWorldPosition.y = (gMouseScreenPosition.y + gCamera.y) * gCamera.z;
-
 				// clicking and dragging should pan
 				if (WParam & MK_LBUTTON)
 				{
@@ -268,13 +542,42 @@ LRESULT CALLBACK MainWindowProc(_In_ HWND WindowHandle, _In_ UINT Message, _In_
 
 			break;
 		}
+		case WM_CHAR:
+		{
+			if (gSearchActive)
+			{
+				SearchTypeCharacter((wchar_t)WParam);
+			}
+			else if (WParam == L'/')
+			{
+				OpenSearch();
+			}
+
+			break;
+		}
 		case WM_KEYDOWN:
 		{
+			// While the search box is open it gets every key, so typing a name doesn't also toggle things.
+
+			if (gSearchActive)
+			{
+				SearchKeyDown((UINT)WParam);
+
+				break;
+			}
+
+			if (KccKeyDown((UINT)WParam))
+			{
+				break;
+			}
+
+			gCameraAnimating = FALSE;
+
 			switch (WParam)
 			{
 				case VK_ESCAPE:
 				{
-					gContinue = FALSE;
+					RequestShutdown();
 
 					break;
 				}
@@ -286,6 +589,13 @@ LRESULT CALLBACK MainWindowProc(_In_ HWND WindowHandle, _In_ UINT Message, _In_
 				}
 				case 0x46: // 'F'
 				{
+					if (GetKeyState(VK_CONTROL) & 0x8000)
+					{
+						OpenSearch();
+
+						break;
+					}
+
 					if (gFullscreen)
 					{
 						SetWindowLongPtrW(gMainWindowHandle, GWL_STYLE, WS_VISIBLE | WS_OVERLAPPEDWINDOW);
@@ -307,6 +617,100 @@ LRESULT CALLBACK MainWindowProc(_In_ HWND WindowHandle, _In_ UINT Message, _In_
 
 					break;
 				}
+				case 0x43: // 'C'
+				{
+					gDCColorMode = (gDCColorMode + 1) % DCCM_COUNT;
+
+					break;
+				}
+				case 0x45: // 'E'
+				{
+					if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED)
+					{
+						for (int Format = 0; Format < EF_COUNT; Format++)
+						{
+							wchar_t FileName[MAX_PATH] = { 0 };
+
+							_snwprintf_s(FileName, _countof(FileName), _TRUNCATE, L"%s.%s", EXPORT_FILE_BASE_NAME, gExportExtensions[Format]);
+
+							ExportTopology(FileName, (EXPORT_FORMAT)Format, gEntities, NULL);
+						}
+					}
+
+					break;
+				}
+				case 0x56: // 'V'
+				{
+					if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED)
+					{
+						ToggleConvergence();
+					}
+
+					break;
+				}
+				case 0x4B: // 'K'
+				{
+					if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED)
+					{
+						if (gKcc == NULL && gSiteGraph != NULL && (gKcc = CreateKccSimulation(gSiteGraph, gEntities)) == NULL)
+						{
+							LogEventW(LL_ERROR, LF_FILE, L"[%s] CreateKccSimulation failed!", __FUNCTIONW__);
+						}
+
+						gShowKcc = !gShowKcc;
+					}
+
+					break;
+				}
+				case 0x54: // 'T'
+				{
+					TraceDump(TRACE_FILE_NAME);
+
+					break;
+				}
+				case 0x52: // 'R'
+				{
+					if (gRenderRecordFile == INVALID_HANDLE_VALUE)
+					{
+						if ((gRenderRecordFile = CreateFileW(RENDER_RECORD_FILE_NAME, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+						{
+							LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create %s! Error 0x%08lx", __FUNCTIONW__, RENDER_RECORD_FILE_NAME, GetLastError());
+						}
+
+						gRenderFramesToRecord = RENDER_RECORD_FRAMES;
+					}
+
+					break;
+				}
+				case 0x4D: // 'M'
+				{
+					gShowMinimap = !gShowMinimap;
+
+					break;
+				}
+				case 0x4C: // 'L'
+				{
+					// Built in the background and shown once it's ready; see Scene.h. When that is depends on how long
+					// it took, so a trace being replayed can't ask for it.
+
+					if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED && gFrameScene && IsReplayingInput() == FALSE &&
+						StartSceneRebuild(gFrameScene->Layout == LM_PACKED ? LM_ROW : LM_PACKED) == ERROR_SUCCESS)
+					{
+						LogEventW(LL_INFO, LF_FILE, L"[%s] Laying the topology out again.", __FUNCTIONW__);
+					}
+
+					break;
+				}
+				case VK_OEM_COMMA:
+				case VK_OEM_PERIOD:
+				{
+					if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED)
+					{
+						StepTimeline(WParam == VK_OEM_COMMA ? -1 : 1);
+					}
+
+					break;
+				}
 				case VK_HOME:
 				{
 					gCamera.x = 0;
@@ -315,12 +719,27 @@ LRESULT CALLBACK MainWindowProc(_In_ HWND WindowHandle, _In_ UINT Message, _In_
 
 					break;
 				}
+				case VK_F9:
+				{
+					if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED && gFrameScene)
+					{
+						ToggleInputRecording();
+					}
+
+					break;
+				}
 				case VK_F11:
 				{
 					gShouldShowDebugText = !gShouldShowDebugText;
 
 					break;
 				}
+				case 0x47: // 'G'
+				{
+					gShouldShowFrameGraph = !gShouldShowFrameGraph;
+
+					break;
+				}
 				case VK_RIGHT:
 				{
 					if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED)
@@ -389,9 +808,30 @@ LRESULT CALLBACK MainWindowProc(_In_ HWND WindowHandle, _In_ UINT Message, _In_
 
 			break;
 		}
+		case CONVERGENCE_DONE_MESSAGE:
+		{
+			CONVERGENCE_RESULT* Convergence = (CONVERGENCE_RESULT*)LParam;
+
+			gConvergencePending--;
+
+			// Only keep it if it's what the user asked for most recently.
+
+			if (Convergence && Convergence->Source == gConvergenceSource)
+			{
+				FreeConvergenceResult(gConvergence);
+
+				gConvergence = Convergence;
+			}
+			else
+			{
+				FreeConvergenceResult(Convergence);
+			}
+
+			break;
+		}
 		case WM_DESTROY:
 		{
-			gContinue = FALSE;
+			RequestShutdown();
 
 			PostQuitMessage(0);
 
@@ -399,9 +839,13 @@ LRESULT CALLBACK MainWindowProc(_In_ HWND WindowHandle, _In_ UINT Message, _In_
 		}
 		case WM_LBUTTONDOWN:
 		{
-			GetCursorPos(&gMousePreviousCursorPosition);
+			gCameraAnimating = FALSE;
+
+			// Where the click was, not where the cursor is now, so a replayed click lands where the recorded one did.
+
+			gMousePreviousCursorPosition.x = GET_X_LPARAM(LParam);
 
-			ScreenToClient(gMainWindowHandle, &gMousePreviousCursorPosition);
+			gMousePreviousCursorPosition.y = GET_Y_LPARAM(LParam);
 
 			break;
 		}
@@ -409,6 +853,8 @@ LRESULT CALLBACK MainWindowProc(_In_ HWND WindowHandle, _In_ UINT Message, _In_
 		{
 			if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED)
 			{
+				gCameraAnimating = FALSE;
+
 				if ((short)HIWORD(WParam) > 0)
 				{
 					if ((short)LOWORD(WParam) & MK_CONTROL)
@@ -725,301 +1171,218 @@ DWORD ReadRegistrySettings(void)
 
 	LogEventW(LL_INFO, LF_FILE, L"[%s] %s = %s.", __FUNCTIONW__, L"DomainController", wcslen(gRegParams.DomainController) ? gRegParams.DomainController : L"(null)");
 
-Exit:
-
-	return(Result);
-}
+	////////////////////////////////////////////////////////////////
 
-void LogEventW(_In_ LOGLEVEL Level, _In_ LOGFLAGS Flags, _In_ wchar_t* Message, ...)
-{
-	va_list Args = NULL;
+	if ((Result = ReadRegistryDWORD(RegKey, L"LogFullPolicy", &gRegParams.LogFullPolicy, LFP_DROP_INFO)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	size_t MsgLen = wcslen(Message);
+	if ((Result = ReadRegistryDWORD(RegKey, L"ReplicationPollSeconds", &gRegParams.ReplicationPollSeconds, REPL_DEF_POLL_SECONDS)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	SYSTEMTIME Time = { 0 };
+	if ((Result = ReadRegistryDWORD(RegKey, L"ReplicationMaxConcurrent", &gRegParams.ReplicationMaxConcurrent, REPL_DEF_MAX_CONCURRENT)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	HANDLE FileHandle = INVALID_HANDLE_VALUE;
+	if ((Result = ReadRegistryDWORD(RegKey, L"ReplicationTimeoutSeconds", &gRegParams.ReplicationTimeoutSeconds, REPL_DEF_TIMEOUT_SECONDS)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	DWORD EndOfFile = 0;
+	if ((Result = ReadRegistryDWORD(RegKey, L"ReplicationProvider", &gRegParams.ReplicationProvider, RPT_DSREPLICAGETINFO)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	DWORD BytesWritten = 0;
+	if ((Result = ReadRegistryDWORD(RegKey, L"ProbeIntervalSeconds", &gRegParams.ProbeIntervalSeconds, PROBE_DEF_INTERVAL_SECONDS)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	wchar_t DateTimeString[64] = { 0 };
+	if ((Result = ReadRegistryDWORD(RegKey, L"ProbeMaxInFlight", &gRegParams.ProbeMaxInFlight, PROBE_DEF_MAX_IN_FLIGHT)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	wchar_t SeverityString[32] = { 0 };
+	if ((Result = ReadRegistryDWORD(RegKey, L"ProbeTimeoutMs", &gRegParams.ProbeTimeoutMs, PROBE_DEF_TIMEOUT_MS)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	wchar_t FormattedMessage[1024] = { 0 };
+	if ((Result = ReadRegistryDWORD(RegKey, L"ProbeStandIn", &gRegParams.ProbeStandIn, FALSE)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	wchar_t FinalMessage[1280] = { 0 };
+	if ((Result = ReadRegistryDWORD(RegKey, L"DiscoveryCallTimeoutMs", &gRegParams.DiscoveryCallTimeoutMs, DISCOVERY_DEF_CALL_TIMEOUT_MS)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
 
-	if (MsgLen < 1 || MsgLen >= 1024)
+	if ((Result = ReadRegistryDWORD(RegKey, L"TimeSeriesMB", &gRegParams.TimeSeriesMB, TIMESERIES_DEF_MB)) != ERROR_SUCCESS)
 	{
-		ASSERT(FALSE, L"LogEventW: Message was either too short or too long!");
+		goto Exit;
 	}
 
-	if (!(Flags & LF_FILE) && !(Flags & LF_DIALOGBOX))
+	if ((Result = ReadRegistryDWORD(RegKey, L"TimeSeriesPersist", &gRegParams.TimeSeriesPersist, FALSE)) != ERROR_SUCCESS)
 	{
-		ASSERT(FALSE, L"LogEventW: Must supply some flag!")
+		goto Exit;
 	}
 
-	if (gRegParams.LogLevel < Level)
+	if ((Result = ReadRegistryDWORD(RegKey, L"KeepTimeline", &gRegParams.KeepTimeline, TRUE)) != ERROR_SUCCESS)
 	{
-		return;
+		goto Exit;
 	}
 
-	switch (Level)
+	if ((Result = ReadRegistryDWORD(RegKey, L"Layout", &gRegParams.Layout, LM_PACKED)) != ERROR_SUCCESS)
 	{
-		case LL_NONE:
-		{
-			return;
-		}
-		case LL_INFO:
-		{
-			wcscpy_s(SeverityString, _countof(SeverityString), L"[INFO]");
+		goto Exit;
+	}
 
-			break;
-		}
-		case LL_WARN:
-		{
-			wcscpy_s(SeverityString, _countof(SeverityString), L"[WARN]");
+	if (gRegParams.ProbeMaxInFlight == 0)
+	{
+		gRegParams.ProbeMaxInFlight = 1;
+	}
 
-			break;
-		}
-		case LL_ERROR:
-		{
-			wcscpy_s(SeverityString, _countof(SeverityString), L"[ERROR]");
+	if (gRegParams.ReplicationMaxConcurrent == 0)
+	{
+		gRegParams.ReplicationMaxConcurrent = 1;
+	}
 
-			break;
-		}
-		default:
-		{
-			ASSERT(FALSE, L"LogEventW: Unrecognized log level!");
-		}
+	if (gRegParams.ReplicationTimeoutSeconds == 0)
+	{
+		gRegParams.ReplicationTimeoutSeconds = REPL_DEF_TIMEOUT_SECONDS;
 	}
 
-	GetLocalTime(&Time);
+	if (gRegParams.DiscoveryCallTimeoutMs == 0)
+	{
+		gRegParams.DiscoveryCallTimeoutMs = DISCOVERY_DEF_CALL_TIMEOUT_MS;
+	}
 
-	va_start(Args, Message);
+Exit:
 
-	_vsnwprintf_s(FormattedMessage, _countof(FormattedMessage), _TRUNCATE, Message, Args);
+	return(Result);
+}
 
-	va_end(Args);
+DWORD ReadRegistryDWORD(_In_ HKEY RegKey, _In_ wchar_t* ValueName, _Out_ DWORD* Value, _In_ DWORD Default)
+{
+	DWORD Result = ERROR_SUCCESS;
 
-	_snwprintf_s(DateTimeString, _countof(DateTimeString), _TRUNCATE, L"\n[%02u/%02u/%u %02u:%02u:%02u.%03u]", Time.wMonth, Time.wDay, Time.wYear, Time.wHour, Time.wMinute, Time.wSecond, Time.wMilliseconds);
+	DWORD RegBytesRead = sizeof(DWORD);
 
-	_snwprintf_s(FinalMessage, _countof(FinalMessage), _TRUNCATE, L"%s%s%s", DateTimeString, SeverityString, FormattedMessage);
+	Result = RegGetValueW(RegKey, NULL, ValueName, RRF_RT_DWORD, NULL, Value, &RegBytesRead);
 
-	if (Flags & LF_FILE)
+	if (Result != ERROR_SUCCESS)
 	{
-		EnterCriticalSection(&gLogLock);
-
-		if ((FileHandle = CreateFileW(LOG_FILE_NAME, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
-		{
-			ASSERT(FALSE, L"Failed to access log file!");
-		}
-
-		EndOfFile = SetFilePointer(FileHandle, 0, NULL, FILE_END);
-
-		if (EndOfFile == 0)
+		if (Result == ERROR_FILE_NOT_FOUND)
 		{
-			// If this is the beginning of a new file we need to write the utf16 BOM.
+			Result = ERROR_SUCCESS;
 
-			unsigned char BOM[2] = { 0xFF, 0xFE };
+			LogEventW(LL_INFO, LF_FILE, L"[%s] Registry value '%s' not found. Using default of %d.", __FUNCTIONW__, ValueName, Default);
 
-			WriteFile(FileHandle, BOM, 2, &BytesWritten, NULL);
+			*Value = Default;
 		}
-
-		WriteFile(FileHandle, FinalMessage, (DWORD)wcslen(FinalMessage) * sizeof(wchar_t), &BytesWritten, NULL);
-
-		if (FileHandle)
+		else
 		{
-			CloseHandle(FileHandle);
-		}
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to read the '%s' registry value! Error 0x%08lx!", __FUNCTIONW__, ValueName, Result);
 
-		LeaveCriticalSection(&gLogLock);
+			goto Exit;
+		}
 	}
 
-	if (Flags & LF_DIALOGBOX)
-	{
-		switch (Level)
-		{
-			case LL_NONE:
-			{
-				ASSERT(FALSE, L"LogEventW: Level 0 not valid!");
-			}
-			case LL_INFO:
-			{
-				MessageBoxW(gMainWindowHandle, FinalMessage, SeverityString, MB_OK | MB_ICONINFORMATION);
-
-				break;
-			}
-			case LL_WARN:
-			{
-				MessageBoxW(gMainWindowHandle, FinalMessage, SeverityString, MB_OK | MB_ICONWARNING);
+	LogEventW(LL_INFO, LF_FILE, L"[%s] %s = %d.", __FUNCTIONW__, ValueName, *Value);
 
-				break;
-			}
-			case LL_ERROR:
-			{
-				MessageBoxW(gMainWindowHandle, FinalMessage, SeverityString, MB_OK | MB_ICONERROR);
+Exit:
 
-				break;
-			}
-			default:
-			{
-				ASSERT(FALSE, L"LogEventW: Unrecognized log level!");
-			}
-		}
-	}
+	return(Result);
 }
 
 void RenderFrameGraphics(void)
 {
+	FrameStageStart();
+
+	TRACE_BEGIN("Clear");
+
 	memset(gGraphicsData.Bits, 0, (UINT64)gGraphicsData.Resolution.Width * (UINT64)gGraphicsData.Resolution.Height * (32 / 8));	
 
-	if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED && gEntities)
+	TRACE_END();
+
+	FrameStageEnd(FS_CLEAR);
+
+	// Far enough out, the scene is blitted from tiles drawn in the background instead, unless something is being
+	// drawn over it that the tiles don't have; see TilePyramid.h. Until the tiles it needs are ready, it's drawn as
+	// usual.
+
+	if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED && gFrameScene &&
+		gCamera.z >= TILE_MIN_ALTITUDE && gShowConvergence == FALSE && gShowKcc == FALSE && gRenderRecordFile == INVALID_HANDLE_VALUE &&
+		TRACED("Tiles", DrawTiles(
+			gGraphicsData.BackBufferDeviceContext,
+			&gCamera,
+			gGraphicsData.Resolution.Width,
+			gGraphicsData.Resolution.Height,
+			gDCColorMode,
+			gGraphicsData.TotalFramesRendered)))
 	{
-		ENTITY* Current = gEntities;
+		ResetRenderList(gRenderList, gGraphicsData.Resolution.Width, gGraphicsData.Resolution.Height);
 
-		while (Current != NULL)
-		{
-			RECT EntityRect = { 0 };
+		// Nothing is culled, so nothing else asks for the details the tooltip shows.
 
-			SIZE TextSize = { 0 };
+		if (gHoveredEntity && gHoveredEntity->Type == ET_DC)
+		{
+			RequestDCDetails(ENTITY_LIVE(gHoveredEntity), TRUE);
+		}
 
-			SetRect(
-				&EntityRect,
-				(Current->x * (1.0f / gCamera.z)) - gCamera.x,
-				(Current->y * (1.0f / gCamera.z)) - gCamera.y,
-				(Current->x * (1.0f / gCamera.z)) + Current->width * (1.0f / gCamera.z) - gCamera.x,
-				(Current->y * (1.0f / gCamera.z)) + Current->height * (1.0f / gCamera.z) - gCamera.y);
+		FrameStageEnd(FS_TILES);
+	}
+	else if (WaitForSingleObject(gDiscoveryThread, 0) == DISCOVERY_THREAD_FINISHED && gFrameScene)
+	{
+		TRACE_BEGIN("Cull");
 
-			if (EntityRect.left > gGraphicsData.ClientRect.right ||
-				EntityRect.top > gGraphicsData.ClientRect.bottom ||
-				EntityRect.bottom < gGraphicsData.ClientRect.top ||
-				EntityRect.right < 0)
-			{
-				Current = Current->Next;
+		CullEntities();
 
-				continue;
-			}	
+		TRACE_END();
 
+		FrameStageEnd(FS_CULL);
 
-			if (Current->Type == ET_SITE)			
-			{
-				// Rectangles... you would think you only need 4 verticies to draw a rectangle		
-				// but the first vertex needs to be the starting point apparently		
-				POINT Verticies[] = { 			
-					{ EntityRect.left,  EntityRect.top },			
-					{ EntityRect.right, EntityRect.top },			
-					{ EntityRect.right, EntityRect.bottom },			
-					{ EntityRect.left,  EntityRect.bottom },			
-					{ EntityRect.left,  EntityRect.top }		
-				};
-		
-				// FrameRect is always 1 pixel thick, but Polyline uses the currently selected PEN and can be any thickness we want.
-		
-				Polyline(gGraphicsData.BackBufferDeviceContext, Verticies, _countof(Verticies));
+		TRACE_BEGIN("Record");
 
-				// Draw the site name on the top and bottom of the site rectangle
-				// The more we are zoomed in, the larger the text is
-				// if zoomed far enough out, don't draw it at all
+		ResetRenderList(gRenderList, gGraphicsData.Resolution.Width, gGraphicsData.Resolution.Height);
 
-				switch (gCamera.z)
-				{
-					case 1:
-					{
-						SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.HugeFont);
+		RecordScene(gRenderList);
 
-						break;
-					}
-					case 2:
-					case 3:
-					{
-						SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.BigFont);
+		TRACE_END();
 
-						break;
-					}
-					case 4:
-					case 5:
-					{
-						SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.SmallFont);
+		FrameStageEnd(FS_RECORD);
 
-						break;
-					}
-				}
+		TRACE_BEGIN("Play");
 
-				if (gCamera.z < 6)
-				{
-					GetTextExtentPoint32W(gGraphicsData.BackBufferDeviceContext, Current->name, (int)wcslen(Current->name), &TextSize);
-
-					TextOutW(
-						gGraphicsData.BackBufferDeviceContext,
-						((Current->x * (1.0f / gCamera.z)) + Current->width * (1.0f / gCamera.z) / 2) - (TextSize.cx / 2) - gCamera.x,
-						(Current->y * (1.0f / gCamera.z)) + Current->height * (1.0f / gCamera.z) - gCamera.y,
-						Current->name,
-						(int)wcslen(Current->name));
-
-					TextOutW(
-						gGraphicsData.BackBufferDeviceContext,
-						((Current->x * (1.0f / gCamera.z)) + Current->width * (1.0f / gCamera.z) / 2) - (TextSize.cx / 2) - gCamera.x,
-						(Current->y * (1.0f / gCamera.z)) - (TextSize.cy * gCamera.z) * (1.0f / gCamera.z) - gCamera.y,
-						Current->name,
-						(int)wcslen(Current->name));
-				}
-			}
-			else if (Current->Type == ET_DC)
-			{
-						
-				// Triangles
-				POINT Verticies[] = { 
-					{ EntityRect.left, EntityRect.bottom }, 
-					{ EntityRect.right, EntityRect.bottom },
-					{ EntityRect.right - ((EntityRect.right - EntityRect.left) / 2), EntityRect.top}};
+		PlayRenderList(gRenderList, gGraphicsData.BackBufferDeviceContext);
 
-				Polygon(gGraphicsData.BackBufferDeviceContext, Verticies, _countof(Verticies));						
+		// The overlay below draws straight to the back buffer, and expects the default pen.
 
-				switch (gCamera.z)
-				{
-					case 1:
-					{
-						SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.HugeFont);
-						
-						break;
-					}
-					case 2:	
-					{
-						SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.BigFont);
-						
-						break;
-					}
-					case 3:
-					{
-						SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.SmallFont);
+		SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.Pen);
 
-						break;
-					}
-				}
+		TRACE_END();
 
-				if (gCamera.z < 4)
-				{
-					GetTextExtentPoint32W(gGraphicsData.BackBufferDeviceContext, Current->name, (int)wcslen(Current->name), &TextSize);
-					
-					TextOutW(
-						gGraphicsData.BackBufferDeviceContext,
-						((Current->x * (1.0f / gCamera.z)) + Current->width * (1.0f / gCamera.z)) - gCamera.x,
-						(Current->y * (1.0f / gCamera.z)) + ((Current->height / 2) - (TextSize.cy / 2)) * (1.0f / gCamera.z) - gCamera.y,
-						Current->fqdn,
-						(int)wcslen(Current->fqdn));
-				}
-			}
+		FrameStageEnd(FS_PLAY);
 
-			gGraphicsData.EntitiesOnScreen++;
+		if (gRenderRecordFile != INVALID_HANDLE_VALUE)
+		{
+			if (AppendRenderList(gRenderList, gRenderRecordFile) != ERROR_SUCCESS || --gRenderFramesToRecord == 0)
+			{
+				CloseHandle(gRenderRecordFile);
 
-			Current = Current->Next;
+				gRenderRecordFile = INVALID_HANDLE_VALUE;
+			}
 		}
 	}
 
+	TRACE_BEGIN("Overlay");
+
 	if (WaitForSingleObject(gDiscoveryThread, 0) != DISCOVERY_THREAD_FINISHED)
 	{
 		SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.BigFont);
@@ -1066,14 +1429,16 @@ void RenderFrameGraphics(void)
 
 		GetExitCodeThread(gDiscoveryThread, &ExitCode);
 
-		if (ExitCode != ERROR_SUCCESS)
+		if (ExitCode != ERROR_SUCCESS && ExitCode != ERROR_CANCELLED)
 		{			
 			LogEventW(
 				LL_ERROR, 
 				LF_DIALOGBOX | LF_FILE, 
 				L"[%s] Discovery thread failed with error code 0x%08lx!\nThis tool must be run from a system that is a member of the Active Directory forest you wish to analyze, and it must be able to contact a domain controller. Consider using the 'DomainController' registry setting if automatic DC discovery isn't working.", __FUNCTIONW__, ExitCode);
 
-			gContinue = FALSE;
+			RequestShutdown();
+
+			TRACE_END();
 
 			return;
 		}
@@ -1089,7 +1454,7 @@ void RenderFrameGraphics(void)
 			debugtext,
 			_countof(debugtext),
 			_TRUNCATE,
-			L"FPS:%.1f/%.1f CameraXYZ:%d,%d,%d Res:%dx%d EntitiesOnScreen:%d Mouse:(%ld,%ld) (%ld,%ld)",
+			L"FPS:%.1f/%.1f CameraXYZ:%d,%d,%d Res:%dx%d EntitiesOnScreen:%d Mouse:(%ld,%ld) (%ld,%ld) Colour:%s",
 			gGraphicsData.RawFPSAverage, 
 			gGraphicsData.CookedFPSAverage, 
 			gCamera.x, 
@@ -1101,10 +1466,88 @@ void RenderFrameGraphics(void)
 			gMouseScreenPosition.x, 
 			gMouseScreenPosition.y,
 			gMouseWorldPosition.x,
-			gMouseWorldPosition.y);
+			gMouseWorldPosition.y,
+			gDCColorModeNames[gDCColorMode]);
 		
 		TextOutW(gGraphicsData.BackBufferDeviceContext, 0, gGraphicsData.Resolution.Height - 36, debugtext, (int)wcslen(debugtext));
 
+		// The FPS averages above hide stutter, so also show the spread of recent frame times and where the time goes.
+
+		FRAMESUMMARY Summary = { 0 };
+
+		DWORD TilesReady = 0;
+
+		DWORD TilesWaiting = 0;
+
+		FrameStatsSummarize(&Summary);
+
+		GetTileCounts(&TilesReady, &TilesWaiting);
+
+		_snwprintf_s(
+			debugtext,
+			_countof(debugtext),
+			_TRUNCATE,
+			L"Frame ms (last %u) p50:%.2f p95:%.2f p99:%.2f max:%.2f Entities tested:%u drawn:%u Tiles ready:%lu waiting:%lu",
+			Summary.Frames,
+			Summary.P50Microseconds / 1000.0f,
+			Summary.P95Microseconds / 1000.0f,
+			Summary.P99Microseconds / 1000.0f,
+			Summary.MaxMicroseconds / 1000.0f,
+			Summary.EntitiesTested,
+			Summary.EntitiesDrawn,
+			TilesReady,
+			TilesWaiting);
+
+		TextOutW(gGraphicsData.BackBufferDeviceContext, 0, gGraphicsData.Resolution.Height - 72, debugtext, (int)wcslen(debugtext));
+
+		DWORD DetailsReady = 0;
+
+		DWORD DetailsWaiting = 0;
+
+		GetDCDetailsCounts(&DetailsReady, &DetailsWaiting);
+
+		_snwprintf_s(
+			debugtext,
+			_countof(debugtext),
+			_TRUNCATE,
+			L"Avg ms %s:%.2f %s:%.2f %s:%.2f %s:%.2f %s:%.2f %s:%.2f %s:%.2f Commands:%lu DC details fetched:%lu waiting:%lu",
+			gFrameStageNames[FS_CLEAR], Summary.StageAverageMicroseconds[FS_CLEAR] / 1000.0f,
+			gFrameStageNames[FS_CULL], Summary.StageAverageMicroseconds[FS_CULL] / 1000.0f,
+			gFrameStageNames[FS_RECORD], Summary.StageAverageMicroseconds[FS_RECORD] / 1000.0f,
+			gFrameStageNames[FS_PLAY], Summary.StageAverageMicroseconds[FS_PLAY] / 1000.0f,
+			gFrameStageNames[FS_TILES], Summary.StageAverageMicroseconds[FS_TILES] / 1000.0f,
+			gFrameStageNames[FS_OVERLAY], Summary.StageAverageMicroseconds[FS_OVERLAY] / 1000.0f,
+			gFrameStageNames[FS_BLIT], Summary.StageAverageMicroseconds[FS_BLIT] / 1000.0f,
+			gRenderList->CommandCount,
+			DetailsReady,
+			DetailsWaiting);
+
+		TextOutW(gGraphicsData.BackBufferDeviceContext, 0, gGraphicsData.Resolution.Height - 54, debugtext, (int)wcslen(debugtext));
+
+		TIMESERIES_STATS History = { 0 };
+
+		GetTimeSeriesStats(&History);
+
+		_snwprintf_s(
+			debugtext,
+			_countof(debugtext),
+			_TRUNCATE,
+			L"History: %lu series, %llu points in %lu of %lu KB (%.1f bytes/point), back %llu min, %lu dropped",
+			History.Series,
+			History.Points,
+			(History.BlocksInUse * TIMESERIES_BLOCK_BYTES) / 1024,
+			(History.BlockCount * TIMESERIES_BLOCK_BYTES) / 1024,
+			History.Points ? ((double)History.BlocksInUse * TIMESERIES_BLOCK_BYTES) / History.Points : 0.0,
+			History.Oldest ? (UINT64)(TimeSeriesNow() - History.Oldest) / 60 : 0,
+			History.Dropped);
+
+		TextOutW(gGraphicsData.BackBufferDeviceContext, 0, gGraphicsData.Resolution.Height - 90, debugtext, (int)wcslen(debugtext));
+
+		if (gShouldShowFrameGraph)
+		{
+			DrawFrameGraph(gGraphicsData.BackBufferDeviceContext, gGraphicsData.Resolution.Width - FRAME_GRAPH_FRAMES - 8, gGraphicsData.Resolution.Height - 8);
+		}
+
 		_snwprintf_s(
 			debugtext,
 			_countof(debugtext),
@@ -1115,6 +1558,57 @@ void RenderFrameGraphics(void)
 		TextOutW(gGraphicsData.BackBufferDeviceContext, 0, gGraphicsData.Resolution.Height - 18, debugtext, (int)wcslen(debugtext));
 	}
 
+	if (gShowMinimap)
+	{
+		DrawMinimap(
+			gGraphicsData.BackBufferDeviceContext,
+			&gCamera,
+			gGraphicsData.Resolution.Width,
+			gGraphicsData.Resolution.Height,
+			gDCColorMode,
+			gGraphicsData.MainBrush,
+			gGraphicsData.MinimapViewBrush);
+	}
+
+	if (gSearchActive)
+	{
+		DrawSearchBox();
+	}
+	else if (gHoveredEntity != NULL)
+	{
+		DrawTooltip(ENTITY_LIVE(gHoveredEntity));
+	}
+
+	if (gTopologyDiff.BaselineFileName[0] && gSearchActive == FALSE && gShowHelp == FALSE)
+	{
+		wchar_t DiffText[MAX_PATH + 128] = { 0 };
+
+		SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.SmallFont);
+
+		_snwprintf_s(
+			DiffText,
+			_countof(DiffText),
+			_TRUNCATE,
+			L"Compared with %s: %lu added, %lu removed, %lu changed. Details in %s",
+			gTopologyDiff.BaselineFileName,
+			gTopologyDiff.KindCounts[DK_ADDED],
+			gTopologyDiff.KindCounts[DK_REMOVED],
+			gTopologyDiff.KindCounts[DK_CHANGED],
+			DIFF_REPORT_FILE_NAME);
+
+		TextOutW(gGraphicsData.BackBufferDeviceContext, 0, 0, DiffText, (int)wcslen(DiffText));
+	}
+
+	if (gShowConvergence && gSearchActive == FALSE && gShowHelp == FALSE)
+	{
+		DrawConvergenceStatus(gTopologyDiff.BaselineFileName[0] ? 16 : 0);
+	}
+
+	if (gShowKcc && gSearchActive == FALSE && gShowHelp == FALSE)
+	{
+		DrawKccStatus((gTopologyDiff.BaselineFileName[0] ? 16 : 0) + (gShowConvergence ? 16 : 0));
+	}
+
 	if (gShowHelp)
 	{
 		SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.SmallFont);
@@ -1126,6 +1620,12 @@ void RenderFrameGraphics(void)
 			&(RECT) {.left = 0, .top = 0, .bottom = gGraphicsData.Resolution.Height, .right = gGraphicsData.Resolution.Width }, 0, NULL);		
 	}
 
+	TRACE_END();
+
+	FrameStageEnd(FS_OVERLAY);
+
+	TRACE_BEGIN("Blit");
+
 	StretchDIBits(
 		gGraphicsData.ScreenDeviceContext,
 		0,
@@ -1141,66 +1641,1503 @@ void RenderFrameGraphics(void)
 		DIB_RGB_COLORS,
 		SRCCOPY);
 
-	gGraphicsData.EntitiesOnScreen = 0;
+	TRACE_END();
+
+	FrameStageEnd(FS_BLIT);
 }
 
-DWORD InitializeGraphics(void)
+// Draws the last TIMESERIES_SPARKLINE_SECONDS of a DC's Metric across Rect, as the highest value in each of
+// TIMESERIES_SPARKLINE_BUCKETS slices of it, scaled so the highest of those is at the top. Stretches with no points
+// are left as gaps, rather than drawn as if nothing happened.
+
+static void RecordSparkline(_Inout_ RENDER_LIST* List, _In_ ENTITY* DC, _In_ RECT* Rect, _In_ TIMESERIES_METRIC Metric, _In_ INT64 Now)
 {
-	DWORD Result = ERROR_SUCCESS;	
-	
-	gGraphicsData.ScreenDeviceContext = GetDC(gMainWindowHandle);
+	UINT32 Maximums[TIMESERIES_SPARKLINE_BUCKETS] = { 0 };
 
-	gGraphicsData.BackBufferDeviceContext = CreateCompatibleDC(gGraphicsData.ScreenDeviceContext);
+	POINT Points[TIMESERIES_SPARKLINE_BUCKETS] = { 0 };
 
-	if (gGraphicsData.ScreenDeviceContext == NULL || gGraphicsData.BackBufferDeviceContext == NULL)
-	{
-		Result = GetLastError();
+	DWORD PointCount = 0;
 
-		LogEventW(LL_ERROR, LF_FILE, L"[%s] Graphics initialization failed with 0x%08lx!", __FUNCTIONW__, Result);
+	UINT32 Highest = 1;
 
-		goto Exit;
-	}
+	int Width = Rect->right - Rect->left;
 
-	SetBkMode(gGraphicsData.BackBufferDeviceContext, TRANSPARENT);
+	int Height = Rect->bottom - Rect->top;
 
-	gGraphicsData.BackBufferBMInfo.bmiHeader.biSize = sizeof(gGraphicsData.BackBufferBMInfo.bmiHeader);
+	if (SummarizeTimeSeries(ENTITY_LIVE(DC), Metric, Now - TIMESERIES_SPARKLINE_SECONDS, Now, Maximums, _countof(Maximums)) != ERROR_SUCCESS)
+	{
+		return;
+	}
 
-	gGraphicsData.BackBufferBMInfo.bmiHeader.biWidth = gGraphicsData.Resolution.Width;
+	for (int Bucket = 0; Bucket < _countof(Maximums); Bucket++)
+	{
+		if (Maximums[Bucket] != TIMESERIES_NO_VALUE)
+		{
+			Highest = max(Highest, Maximums[Bucket]);
+		}
+	}
 
-	gGraphicsData.BackBufferBMInfo.bmiHeader.biHeight = gGraphicsData.Resolution.Height;
+	RecordPen(List, gGraphicsData.SparklinePen);
 
-	gGraphicsData.BackBufferBMInfo.bmiHeader.biBitCount = 32;
+	for (int Bucket = 0; Bucket <= _countof(Maximums); Bucket++)
+	{
+		if (Bucket < _countof(Maximums) && Maximums[Bucket] != TIMESERIES_NO_VALUE)
+		{
+			Points[PointCount].x = Rect->left + (Bucket * Width) / (_countof(Maximums) - 1);
 
-	gGraphicsData.BackBufferBMInfo.bmiHeader.biCompression = BI_RGB;
+			Points[PointCount].y = Rect->bottom - (int)(((UINT64)Maximums[Bucket] * Height) / Highest);
 
-	gGraphicsData.BackBufferBMInfo.bmiHeader.biPlanes = 1;
+			PointCount++;
 
-	gGraphicsData.BackBufferDIB = CreateDIBSection(gGraphicsData.ScreenDeviceContext, &gGraphicsData.BackBufferBMInfo, DIB_RGB_COLORS, &gGraphicsData.Bits, NULL, 0);
+			continue;
+		}
 
-	if (gGraphicsData.BackBufferDIB == NULL || gGraphicsData.Bits == NULL)
-	{
-		Result = GetLastError();
+		// A slice on its own, between two gaps, is still worth a dot.
 
-		LogEventW(LL_ERROR, LF_FILE, L"[%s] Graphics initialization failed with 0x%08lx!", __FUNCTIONW__, Result);		
+		if (PointCount == 1)
+		{
+			RecordLine(List, Points[0].x, Points[0].y, Points[0].x + 1, Points[0].y);
+		}
+		else if (PointCount > 1)
+		{
+			RecordPolyline(List, Points, PointCount);
+		}
 
-		goto Exit;
+		PointCount = 0;
 	}
+}
 
-	SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.BackBufferDIB);
+// Records everything drawn in world space this frame, for the entities CullEntities found: sites, DCs, their roles
+// and labels, and whichever of the convergence heatmap, -compare outlines and KCC what-if view are showing. Nothing
+// is drawn until the list is played back.
 
+void RecordScene(_Inout_ RENDER_LIST* List)
+{
+	INT64 Now = TimeSeriesNow();
+
+	// The sparkline under each DC's name is the history of whatever its triangle is coloured by.
+
+	TIMESERIES_METRIC SparklineMetric = (gDCColorMode == DCCM_REPLICATION) ? TSM_FAILING_NEIGHBORS : (TIMESERIES_METRIC)(TSM_LDAP_LATENCY + (gDCColorMode - DCCM_LDAP_LATENCY));
+
+	HFONT LabelFonts[LFS_COUNT] = { gGraphicsData.HugeFont, gGraphicsData.BigFont, gGraphicsData.SmallFont };
+
+	RecordPen(List, gGraphicsData.Pen);
+
+	// Filled before anything else is drawn, so the DCs stay on top.
+
+	if (gShowConvergence && gConvergence && gConvergence->Source == gConvergenceSource)
+	{
+		for (int Index = 0; Index < gGraphicsData.EntitiesOnScreen; Index++)
+		{
+			ENTITY* Current = gVisibleEntities[Index].Entity;
+
+			if (Current->Type == ET_SITE && Current->SiteIndex < gConvergence->SiteCount)
+			{
+				RecordFillRect(List, &gVisibleEntities[Index].Rect, gGraphicsData.HeatBrushes[ConvergenceHeatLevel(gConvergence->Seconds[Current->SiteIndex])]);
+			}
+		}
+	}
+
+	for (int Index = 0; Index < gGraphicsData.EntitiesOnScreen; Index++)
+	{
+		ENTITY* Current = gVisibleEntities[Index].Entity;
+
+		RECT EntityRect = gVisibleEntities[Index].Rect;
+
+		RecordEntityShape(List, Current, &EntityRect, gDCColorMode);
+
+		// In the KCC what-if view, DCs taken out are crossed through and bridgeheads are outlined.
+
+		if (gShowKcc && gKcc && Current->Type == ET_DC && Current->SiteIndex < gSiteGraph->SiteCount)
+		{
+			if (KccIsDCRemoved(gKcc, ENTITY_LIVE(Current)))
+			{
+				RecordPen(List, gGraphicsData.KccPens[KC_REMOVED]);
+
+				RecordLine(List, EntityRect.left, EntityRect.top, EntityRect.right, EntityRect.bottom);
+
+				RecordLine(List, EntityRect.right, EntityRect.top, EntityRect.left, EntityRect.bottom);
+			}
+			else if (gKcc->Bridgeheads[Current->SiteIndex] == ENTITY_LIVE(Current))
+			{
+				InflateRect(&EntityRect, 3, 3);
+
+				RecordFrameRect(List, &EntityRect, gGraphicsData.BridgeheadBrush);
+			}
+		}
+	}
+
+	if (gShowKcc && gKcc)
+	{
+		RecordKccConnections(List);
+	}
+
+	// Labels go on last, over everything else. The more we are zoomed in, the larger the text is; if zoomed far
+	// enough out, it isn't drawn at all. Where each one goes, and which are left out so they don't overlap, was
+	// decided by PlaceLabels when discovery finished.
+
+	for (int Index = 0; Index < gGraphicsData.EntitiesOnScreen; Index++)
+	{
+		ENTITY* Current = gVisibleEntities[Index].Entity;
+
+		BYTE Spots = GetLabelSpots(Current, gCamera.z);
+
+		if (Spots == 0)
+		{
+			continue;
+		}
+
+		RecordFont(List, LabelFonts[LabelFontSize(Current->Type, gCamera.z)]);
+
+		for (BYTE Spot = LS_ABOVE; Spot <= LS_RIGHT; Spot <<= 1)
+		{
+			POINT Text = { 0 };
+
+			RECT Sparkline = { 0 };
+
+			if ((Spots & Spot) == 0)
+			{
+				continue;
+			}
+
+			GetLabelPosition(Current, gCamera.z, (LABEL_SPOT)Spot, RenderFontHeight(List), &Text, &Sparkline);
+
+			if (Current->Type == ET_SITE)
+			{
+				RecordText(List, Text.x - gCamera.x, Text.y - gCamera.y, Current->name, RTA_CENTER);
+
+				continue;
+			}
+
+			RecordText(List, Text.x - gCamera.x, Text.y - gCamera.y, ENTITY_LIVE(Current)->fqdn, Spot == LS_RIGHT ? RTA_LEFT : RTA_CENTER);
+
+			OffsetRect(&Sparkline, -gCamera.x, -gCamera.y);
+
+			RecordSparkline(List, Current, &Sparkline, SparklineMetric, Now);
+		}
+	}
+}
+
+// Records the shape of one site or DC, filled and outlined for how it's doing, at EntityRect on the screen. This is
+// all of an entity that's drawn zoomed out, so it's also what the tiles in TilePyramid.c are made of, on their own
+// thread; it mustn't read anything the UI thread changes, other than what it's given as ColorMode.
+
+void RecordEntityShape(_Inout_ RENDER_LIST* List, _In_ ENTITY* Entity, _In_ RECT* EntityRect, _In_ DC_COLOR_MODE ColorMode)
+{
+	RECT Rect = *EntityRect;
+
+	ENTITY* Live = ENTITY_LIVE(Entity);
+
+	if (Entity->Type == ET_SITE)
+	{
+		// Rectangles... you would think you only need 4 verticies to draw a rectangle
+		// but the first vertex needs to be the starting point apparently
+		POINT Verticies[] = {
+			{ Rect.left,  Rect.top },
+			{ Rect.right, Rect.top },
+			{ Rect.right, Rect.bottom },
+			{ Rect.left,  Rect.bottom },
+			{ Rect.left,  Rect.top }
+		};
+
+		// FrameRect is always 1 pixel thick, but Polyline uses the currently selected PEN and can be any thickness we want.
+
+		RecordPen(List, gGraphicsData.Pen);
+
+		RecordPolyline(List, Verticies, _countof(Verticies));
+	}
+	else if (Entity->Type == ET_DC)
+	{
+		// Triangles
+		POINT Verticies[] = {
+			{ Rect.left, Rect.bottom },
+			{ Rect.right, Rect.bottom },
+			{ Rect.right - ((Rect.right - Rect.left) / 2), Rect.top} };
+
+		// Triangles are filled with the current brush, so the fill colour shows either replication health or
+		// how quickly the DC answers on one of its ports.
+
+		if (ColorMode == DCCM_REPLICATION)
+		{
+			RecordBrush(List, gGraphicsData.HealthBrushes[Live->ReplStatus.Health]);
+		}
+		else
+		{
+			RecordBrush(List, gGraphicsData.LatencyBrushes[GetProbeColor(Live, (PROBE_PORT)(ColorMode - DCCM_LDAP_LATENCY))]);
+		}
+
+		// The outline is dashed for an RODC, so it shows whatever the fill colour is.
+
+		RecordPen(List, (Live->Flags & DCF_RODC) ? gGraphicsData.RodcPen : gGraphicsData.Pen);
+
+		RecordPolygon(List, Verticies, _countof(Verticies));
+
+		RecordDCRoles(List, Live, &Rect);
+	}
+
+	// Anything that differs from the -compare snapshot, or the version of the timeline being looked at, gets a coloured
+	// outline.
+
+	if (Live->DiffKind != DK_NONE)
+	{
+		InflateRect(&Rect, 6, 6);
+
+		RecordFrameRect(List, &Rect, gGraphicsData.DiffBrushes[Live->DiffKind]);
+
+		InflateRect(&Rect, 1, 1);
+
+		RecordFrameRect(List, &Rect, gGraphicsData.DiffBrushes[Live->DiffKind]);
+	}
+}
+
+// Everything RecordEntityShape draws an entity differently for, in one number, so the tile worker can tell when an
+// entity's tiles need drawing again.
+
+UINT32 EntityAppearance(_In_ ENTITY* Entity, _In_ DC_COLOR_MODE ColorMode)
+{
+	UINT32 Fill = 0;
+
+	ENTITY* Live = ENTITY_LIVE(Entity);
+
+	if (Entity->Type == ET_DC)
+	{
+		Fill = (ColorMode == DCCM_REPLICATION) ? (UINT32)Live->ReplStatus.Health : 0x80 | (UINT32)GetProbeColor(Live, (PROBE_PORT)(ColorMode - DCCM_LDAP_LATENCY));
+	}
+
+	return((Live->Flags << 16) | ((UINT32)Live->DiffKind << 8) | Fill);
+}
+
+// Builds the list of entities that overlap the screen this frame, along with their screen rectangles, so the drawing
+// passes that follow don't each have to walk the whole entity list again.
+
+void CullEntities(void)
+{
+	gGraphicsData.EntitiesOnScreen = 0;
+
+	gGraphicsData.EntitiesTested = 0;
+
+	for (ENTITY* Current = gFrameScene->Entities; Current != NULL; Current = Current->Next)
+	{
+		RECT EntityRect = { 0 };
+
+		gGraphicsData.EntitiesTested++;
+
+		SetRect(
+			&EntityRect,
+			(Current->x * (1.0f / gCamera.z)) - gCamera.x,
+			(Current->y * (1.0f / gCamera.z)) - gCamera.y,
+			(Current->x * (1.0f / gCamera.z)) + Current->width * (1.0f / gCamera.z) - gCamera.x,
+			(Current->y * (1.0f / gCamera.z)) + Current->height * (1.0f / gCamera.z) - gCamera.y);
+
+		if (EntityRect.left > gGraphicsData.ClientRect.right ||
+			EntityRect.top > gGraphicsData.ClientRect.bottom ||
+			EntityRect.bottom < gGraphicsData.ClientRect.top ||
+			EntityRect.right < 0)
+		{
+			// DCs just off the screen get their details fetched too, in case they're about to be panned to.
+
+			if (Current->Type == ET_DC &&
+				EntityRect.left <= gGraphicsData.ClientRect.right + DCDETAILS_PREFETCH_MARGIN &&
+				EntityRect.top <= gGraphicsData.ClientRect.bottom + DCDETAILS_PREFETCH_MARGIN &&
+				EntityRect.bottom >= gGraphicsData.ClientRect.top - DCDETAILS_PREFETCH_MARGIN &&
+				EntityRect.right >= -DCDETAILS_PREFETCH_MARGIN)
+			{
+				RequestDCDetails(ENTITY_LIVE(Current), FALSE);
+			}
+
+			continue;
+		}
+
+		if (gGraphicsData.EntitiesOnScreen >= gVisibleEntitiesCapacity)
+		{
+			int NewCapacity = max(1024, gVisibleEntitiesCapacity * 2);
+
+			VISIBLEENTITY* NewList = gVisibleEntities ?
+				HeapReAlloc(GetProcessHeap(), 0, gVisibleEntities, NewCapacity * sizeof(VISIBLEENTITY)) :
+				HeapAlloc(GetProcessHeap(), 0, NewCapacity * sizeof(VISIBLEENTITY));
+
+			if (NewList == NULL)
+			{
+				// Out of memory; draw what we have room for.
+
+				break;
+			}
+
+			gVisibleEntities = NewList;
+
+			gVisibleEntitiesCapacity = NewCapacity;
+		}
+
+		ENTITY_LIVE(Current)->LastVisibleFrame = gGraphicsData.TotalFramesRendered;
+
+		if (Current->Type == ET_DC)
+		{
+			RequestDCDetails(ENTITY_LIVE(Current), TRUE);
+		}
+
+		gVisibleEntities[gGraphicsData.EntitiesOnScreen].Entity = Current;
+
+		gVisibleEntities[gGraphicsData.EntitiesOnScreen].Rect = EntityRect;
+
+		gGraphicsData.EntitiesOnScreen++;
+	}
+}
+
+void OpenSearch(void)
+{
+	if (WaitForSingleObject(gDiscoveryThread, 0) != DISCOVERY_THREAD_FINISHED || gFrameScene == NULL || gFrameScene->SearchIndex == NULL)
+	{
+		return;
+	}
+
+	gSearchActive = TRUE;
+
+	gSearchQuery[0] = L'\0';
+
+	gSearchResultCount = 0;
+
+	gSearchSelected = 0;
+}
+
+static void RunSearch(void)
+{
+	gSearchResultCount = SearchQuery(gFrameScene->SearchIndex, gSearchQuery, gSearchResults, SEARCH_MAX_RESULTS);
+
+	gSearchSelected = 0;
+}
+
+void SearchTypeCharacter(_In_ wchar_t Character)
+{
+	size_t Length = wcslen(gSearchQuery);
+
+	// Control characters come through here too, from Backspace, Enter, Esc and Ctrl+F; SearchKeyDown deals with those.
+
+	if (Character < L' ' || Length >= SEARCH_MAX_QUERY_CHARS)
+	{
+		return;
+	}
+
+	gSearchQuery[Length] = Character;
+
+	gSearchQuery[Length + 1] = L'\0';
+
+	RunSearch();
+}
+
+void SearchKeyDown(_In_ UINT VirtualKey)
+{
+	size_t Length = wcslen(gSearchQuery);
+
+	switch (VirtualKey)
+	{
+		case VK_ESCAPE:
+		{
+			gSearchActive = FALSE;
+
+			break;
+		}
+		case VK_RETURN:
+		{
+			if (gSearchResultCount > 0)
+			{
+				FlyCameraTo(gSearchResults[gSearchSelected]);
+
+				gSearchActive = FALSE;
+			}
+
+			break;
+		}
+		case VK_BACK:
+		{
+			if (Length > 0)
+			{
+				gSearchQuery[Length - 1] = L'\0';
+
+				RunSearch();
+			}
+
+			break;
+		}
+		case VK_UP:
+		{
+			if (gSearchSelected > 0)
+			{
+				gSearchSelected--;
+			}
+
+			break;
+		}
+		case VK_DOWN:
+		{
+			if (gSearchSelected + 1 < gSearchResultCount)
+			{
+				gSearchSelected++;
+			}
+
+			break;
+		}
+	}
+}
+
+void DrawSearchBox(void)
+{
+	wchar_t Line[SEARCH_MAX_QUERY_CHARS + 64] = { 0 };
+
+	SIZE TextSize = { 0 };
+
+	RECT Rect = { 0 };
+
+	int LineHeight = 0;
+
+	SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.SmallFont);
+
+	GetTextExtentPoint32W(gGraphicsData.BackBufferDeviceContext, L"X", 1, &TextSize);
+
+	LineHeight = TextSize.cy + 2;
+
+	SetRect(&Rect, gGraphicsData.Resolution.Width / 4, 8, (gGraphicsData.Resolution.Width * 3) / 4, 8 + (LineHeight * (gSearchResultCount + 1)) + 8);
+
+	FillRect(gGraphicsData.BackBufferDeviceContext, &Rect, GetStockObject(BLACK_BRUSH));
+
+	FrameRect(gGraphicsData.BackBufferDeviceContext, &Rect, gGraphicsData.MainBrush);
+
+	_snwprintf_s(Line, _countof(Line), _TRUNCATE, L"Find: %s_", gSearchQuery);
+
+	TextOutW(gGraphicsData.BackBufferDeviceContext, Rect.left + 4, Rect.top + 4, Line, (int)wcslen(Line));
+
+	for (DWORD Result = 0; Result < gSearchResultCount; Result++)
+	{
+		ENTITY* Entity = gSearchResults[Result];
+
+		_snwprintf_s(
+			Line,
+			_countof(Line),
+			_TRUNCATE,
+			L"%s %s %s",
+			Result == gSearchSelected ? L">" : L" ",
+			Entity->Type == ET_SITE ? L"Site" : (Entity->Type == ET_DC ? L"DC  " : L"    "),
+			ENTITY_LIVE(Entity)->fqdn[0] ? ENTITY_LIVE(Entity)->fqdn : Entity->name);
+
+		TextOutW(gGraphicsData.BackBufferDeviceContext, Rect.left + 4, Rect.top + 4 + (LineHeight * (Result + 1)), Line, (int)wcslen(Line));
+	}
+}
+
+// Marks a DC's roles on top of its triangle, which fills Rect: a black dot in the middle for a GC, and a square
+// under it for each FSMO role.
+
+void RecordDCRoles(_Inout_ RENDER_LIST* List, _In_ ENTITY* DC, _In_ RECT* Rect)
+{
+	int Width = Rect->right - Rect->left;
+
+	int Height = Rect->bottom - Rect->top;
+
+	int BadgeSize = max(2, Width / 6);
+
+	int BadgeLeft = Rect->left;
+
+	if (DC->Flags & DCF_GC)
+	{
+		int CenterX = Rect->left + (Width / 2);
+
+		int CenterY = Rect->bottom - (Height / 3);
+
+		int Radius = max(2, Width / 8);
+
+		RecordPen(List, gGraphicsData.Pen);
+
+		RecordBrush(List, gGraphicsData.GcBrush);
+
+		RecordEllipse(List, CenterX - Radius, CenterY - Radius, CenterX + Radius, CenterY + Radius);
+	}
+
+	for (int Role = 0; Role < DC_ROLE_BADGES; Role++)
+	{
+		RECT Badge = { 0 };
+
+		if ((DC->Flags & gRoleBadgeFlags[Role]) == 0)
+		{
+			continue;
+		}
+
+		SetRect(&Badge, BadgeLeft, Rect->bottom + 2, BadgeLeft + BadgeSize, Rect->bottom + 2 + BadgeSize);
+
+		RecordFillRect(List, &Badge, gGraphicsData.RoleBrushes[Role]);
+
+		BadgeLeft += BadgeSize + 2;
+	}
+}
+
+// Starts the camera moving so Entity ends up in the middle of the screen, zoomed in far enough to read its label.
+// The zoom changes straight away, around the current centre of the screen, and then AnimateCamera pans over.
+
+void FlyCameraTo(_In_ ENTITY* Entity)
+{
+	int Zoom = min(gCamera.z, Entity->Type == ET_DC ? 2 : 3);
+
+	int CenterX = (gCamera.x + (gGraphicsData.Resolution.Width / 2)) * gCamera.z;
+
+	int CenterY = (gCamera.y + (gGraphicsData.Resolution.Height / 2)) * gCamera.z;
+
+	gCamera.x = (CenterX / Zoom) - (gGraphicsData.Resolution.Width / 2);
+
+	gCamera.y = (CenterY / Zoom) - (gGraphicsData.Resolution.Height / 2);
+
+	gCamera.z = Zoom;
+
+	gCameraTarget.x = ((Entity->x + (Entity->width / 2)) / Zoom) - (gGraphicsData.Resolution.Width / 2);
+
+	gCameraTarget.y = ((Entity->y + (Entity->height / 2)) / Zoom) - (gGraphicsData.Resolution.Height / 2);
+
+	gCameraTarget.z = Zoom;
+
+	gCameraAnimating = TRUE;
+}
+
+// Called once a frame. Covers a fifth of the remaining distance each time, so the camera moves quickly across long
+// distances and eases in at the end.
+
+void AnimateCamera(void)
+{
+	int DeltaX = gCameraTarget.x - gCamera.x;
+
+	int DeltaY = gCameraTarget.y - gCamera.y;
+
+	if (gCameraAnimating == FALSE)
+	{
+		return;
+	}
+
+	if (abs(DeltaX) <= 2 && abs(DeltaY) <= 2)
+	{
+		gCamera.x = gCameraTarget.x;
+
+		gCamera.y = gCameraTarget.y;
+
+		gCameraAnimating = FALSE;
+
+		return;
+	}
+
+	gCamera.x += (abs(DeltaX) > 2) ? (DeltaX / 5) + (DeltaX > 0 ? 1 : -1) : DeltaX;
+
+	gCamera.y += (abs(DeltaY) > 2) ? (DeltaY / 5) + (DeltaY > 0 ? 1 : -1) : DeltaY;
+}
+
+// The back buffer is stretched to fill the client area, so the mouse position has to be scaled back into back buffer
+// pixels before the camera transform is applied, or picking drifts further off the further the mouse is from the
+// top left corner whenever the window isn't the same size as the resolution.
+
+void UpdateHoveredEntity(void)
+{
+	int ClientWidth = gGraphicsData.ClientRect.right - gGraphicsData.ClientRect.left;
+
+	int ClientHeight = gGraphicsData.ClientRect.bottom - gGraphicsData.ClientRect.top;
+
+	if (WaitForSingleObject(gDiscoveryThread, 0) != DISCOVERY_THREAD_FINISHED || gFrameScene == NULL || ClientWidth <= 0 || ClientHeight <= 0)
+	{
+		gHoveredEntity = NULL;
+
+		return;
+	}
+
+	gMouseWorldPosition.x = ((gMouseScreenPosition.x * gGraphicsData.Resolution.Width / ClientWidth) + gCamera.x) * gCamera.z;
+
+	gMouseWorldPosition.y = ((gMouseScreenPosition.y * gGraphicsData.Resolution.Height / ClientHeight) + gCamera.y) * gCamera.z;
+
+	gHoveredEntity = PickEntity(gFrameScene->PickIndex, gMouseWorldPosition);
+}
+
+// Moves the UI thread onto the newest scene, once one has been published. The one it was on stays pinned until the
+// tile worker has stopped drawing it too, so neither can have it freed underneath them; see Scene.h.
+
+void UpdateFrameScene(void)
+{
+	if (IsNewSceneReady(gFrameScene) == FALSE)
+	{
+		return;
+	}
+
+	// Stopping takes as long as the tile being drawn, if there is one. Rather than wait for it, keep drawing the scene
+	// it's drawing and look again next frame.
+
+	if (StopTilePyramid(0) == FALSE)
+	{
+		return;
+	}
+
+	ReleaseScene(SR_UI);
+
+	gFrameScene = AcquireScene(SR_UI);
+
+	// These point into the scene that was just let go of.
+
+	gHoveredEntity = NULL;
+
+	if (gSearchActive)
+	{
+		RunSearch();
+	}
+
+	// Without tiles, zoomed-out frames are drawn from scratch like any other, and there's no minimap.
+
+	if (gFrameScene->PickIndex && StartTilePyramid(gFrameScene->PickIndex) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] Zoomed-out frames will not be drawn from tiles.", __FUNCTIONW__);
+	}
+}
+
+// Draws a box of details about Entity next to the mouse, kept on the screen. Nothing in it depends on where Entity
+// is, so it's given the one with the status on it; see ENTITY_LIVE.
+
+void DrawTooltip(_In_ ENTITY* Entity)
+{
+	static const wchar_t* HealthNames[] = { L"not polled yet", L"healthy", L"degraded", L"failing", L"unreachable" };
+
+	static const wchar_t* PortNames[PP_COUNT] = { L"LDAP", L"GC", L"Kerberos" };
+
+	wchar_t Lines[10][320] = { 0 };
+
+	int LineCount = 0;
+
+	SIZE TextSize = { 0 };
+
+	int Width = 0;
+
+	int LineHeight = 0;
+
+	POINT Origin = { 0 };
+
+	RECT Rect = { 0 };
+
+	int ClientWidth = gGraphicsData.ClientRect.right - gGraphicsData.ClientRect.left;
+
+	int ClientHeight = gGraphicsData.ClientRect.bottom - gGraphicsData.ClientRect.top;
+
+	if (Entity->Type == ET_SITE)
+	{
+		_snwprintf_s(Lines[LineCount++], _countof(Lines[0]), _TRUNCATE, L"Site %s", Entity->name);
+
+		_snwprintf_s(Lines[LineCount++], _countof(Lines[0]), _TRUNCATE, L"%s", Entity->distinguishedname);
+
+		_snwprintf_s(Lines[LineCount++], _countof(Lines[0]), _TRUNCATE, L"Domain controllers: %lu", Entity->DCsInSite);
+
+		if (gShowConvergence && gConvergence && gConvergence->Source == gConvergenceSource && Entity->SiteIndex < gConvergence->SiteCount)
+		{
+			wchar_t Duration[32] = { 0 };
+
+			FormatDuration(gConvergence->Seconds[Entity->SiteIndex], Duration, _countof(Duration));
+
+			_snwprintf_s(
+				Lines[LineCount++],
+				_countof(Lines[0]),
+				_TRUNCATE,
+				(gConvergence->Source == CONVERGENCE_ALL_SITES) ? L"A change made here reaches every site it can in %s" : L"Has the change after %s",
+				Duration);
+		}
+	}
+	else
+	{
+		wchar_t SiteName[128] = { 0 };
+
+		wchar_t* Roles = NULL;
+
+		// The site is stored as the site's DN; its name is the part worth showing.
+
+		if (DnFirstValue(Entity->site, SiteName, _countof(SiteName)) != ERROR_SUCCESS && SiteName[0] == L'\0')
+		{
+			wcsncpy_s(SiteName, _countof(SiteName), Entity->site, _TRUNCATE);
+		}
+
+		_snwprintf_s(Lines[LineCount++], _countof(Lines[0]), _TRUNCATE, L"DC %s", Entity->fqdn[0] ? Entity->fqdn : L"(DNS host name not known yet)");
+
+		_snwprintf_s(Lines[LineCount++], _countof(Lines[0]), _TRUNCATE, L"%s", Entity->distinguishedname);
+
+		_snwprintf_s(Lines[LineCount++], _countof(Lines[0]), _TRUNCATE, L"Site: %s  Domain: %s", SiteName, Entity->domain[0] ? Entity->domain : L"?");
+
+		Roles = Lines[LineCount++];
+
+		wcscpy_s(Roles, _countof(Lines[0]), L"Roles:");
+
+		if (Entity->Flags & DCF_GC) wcscat_s(Roles, _countof(Lines[0]), L" GC");
+
+		if (Entity->Flags & DCF_RODC) wcscat_s(Roles, _countof(Lines[0]), L" RODC");
+
+		if (Entity->Flags & DCF_PDCE) wcscat_s(Roles, _countof(Lines[0]), L" PDC");
+
+		if (Entity->Flags & DCF_SCHEMAMASTER) wcscat_s(Roles, _countof(Lines[0]), L" Schema");
+
+		if (Entity->Flags & DCF_DOMAINNAMINGMASTER) wcscat_s(Roles, _countof(Lines[0]), L" DomainNaming");
+
+		if (Entity->Flags & DCF_RIDMASTER) wcscat_s(Roles, _countof(Lines[0]), L" RID");
+
+		if (Entity->Flags & DCF_INFRASTRUCTUREMASTER) wcscat_s(Roles, _countof(Lines[0]), L" Infrastructure");
+
+		if (wcslen(Roles) == wcslen(L"Roles:")) wcscat_s(Roles, _countof(Lines[0]), L" none");
+
+		// The rest is only known once the DC details workers have got to this DC, which hovering over it hurries up.
+
+		if (Entity->DetailsState == DDS_READY)
+		{
+			DCDETAILS* Details = Entity->Details;
+
+			wchar_t* Partners = NULL;
+
+			_snwprintf_s(
+				Lines[LineCount++],
+				_countof(Lines[0]),
+				_TRUNCATE,
+				L"OS: %s %s%s%s",
+				Details->OperatingSystem[0] ? Details->OperatingSystem : L"?",
+				Details->OperatingSystemVersion,
+				(Details->DsaOptions & NTDSDSA_OPT_DISABLE_INBOUND_REPL) ? L"  Inbound replication disabled" : L"",
+				(Details->DsaOptions & NTDSDSA_OPT_DISABLE_OUTBOUND_REPL) ? L"  Outbound replication disabled" : L"");
+
+			Partners = Lines[LineCount++];
+
+			_snwprintf_s(Partners, _countof(Lines[0]), _TRUNCATE, L"Replicates from %lu:", Details->InboundPartners);
+
+			for (DWORD Partner = 0; Partner < min(Details->InboundPartners, DCDETAILS_MAX_PARTNER_NAMES); Partner++)
+			{
+				wcscat_s(Partners, _countof(Lines[0]), Partner ? L", " : L" ");
+
+				wcscat_s(Partners, _countof(Lines[0]), Details->PartnerNames[Partner]);
+			}
+
+			if (Details->InboundPartners > DCDETAILS_MAX_PARTNER_NAMES)
+			{
+				wcscat_s(Partners, _countof(Lines[0]), L"...");
+			}
+		}
+		else if (Entity->DetailsState == DDS_FAILED)
+		{
+			_snwprintf_s(Lines[LineCount++], _countof(Lines[0]), _TRUNCATE, L"Details: failed with 0x%08lx, will try again", Entity->Details->Result);
+		}
+		else if (Entity->Details)
+		{
+			wcscpy_s(Lines[LineCount++], _countof(Lines[0]), L"Details: loading...");
+		}
+
+		if (Entity->ReplStatus.Health == RH_UNKNOWN)
+		{
+			_snwprintf_s(Lines[LineCount++], _countof(Lines[0]), _TRUNCATE, L"Replication: %s", HealthNames[RH_UNKNOWN]);
+		}
+		else
+		{
+			_snwprintf_s(
+				Lines[LineCount++],
+				_countof(Lines[0]),
+				_TRUNCATE,
+				L"Replication: %s, %lu of %lu inbound neighbours failing, %lu operations queued, polled %llus ago",
+				HealthNames[Entity->ReplStatus.Health],
+				Entity->ReplStatus.FailingNeighbors,
+				Entity->ReplStatus.Neighbors,
+				Entity->ReplStatus.PendingOps,
+				(GetTickCount64() - Entity->ReplStatus.LastPolled) / 1000);
+		}
+
+		wcscpy_s(Lines[LineCount], _countof(Lines[0]), L"p95 ms:");
+
+		for (int Port = 0; Port < PP_COUNT; Port++)
+		{
+			wchar_t Latency[32] = { 0 };
+
+			PROBE_COLOR Color = GetProbeColor(Entity, (PROBE_PORT)Port);
+
+			if (Color == PC_NO_DATA)
+			{
+				_snwprintf_s(Latency, _countof(Latency), _TRUNCATE, L" %s:-", PortNames[Port]);
+			}
+			else if (Color == PC_DOWN)
+			{
+				_snwprintf_s(Latency, _countof(Latency), _TRUNCATE, L" %s:down", PortNames[Port]);
+			}
+			else
+			{
+				_snwprintf_s(Latency, _countof(Latency), _TRUNCATE, L" %s:%.1f", PortNames[Port], Entity->ProbeStats->PercentileMicroseconds[Port] / 1000.0f);
+			}
+
+			wcscat_s(Lines[LineCount], _countof(Lines[0]), Latency);
+		}
+
+		LineCount++;
+
+		// The worst of the last couple of hours, from the time-series store, for anything that's been recorded.
+
+		wcscpy_s(Lines[LineCount], _countof(Lines[0]), L"Worst in 2h:");
+
+		for (int Metric = 0; Metric < TSM_COUNT; Metric++)
+		{
+			static const wchar_t* MetricNames[TSM_COUNT] = { L"failing", L"queued", L"LDAP", L"GC", L"Kerberos" };
+
+			INT64 Now = TimeSeriesNow();
+
+			UINT32 Worst = TIMESERIES_NO_VALUE;
+
+			wchar_t Value[32] = { 0 };
+
+			if (SummarizeTimeSeries(Entity, (TIMESERIES_METRIC)Metric, Now - TIMESERIES_SPARKLINE_SECONDS, Now, &Worst, 1) != ERROR_SUCCESS)
+			{
+				break;
+			}
+
+			if (Worst == TIMESERIES_NO_VALUE)
+			{
+				_snwprintf_s(Value, _countof(Value), _TRUNCATE, L" %s:-", MetricNames[Metric]);
+			}
+			else if (Metric >= TSM_LDAP_LATENCY)
+			{
+				_snwprintf_s(Value, _countof(Value), _TRUNCATE, L" %s:%.1fms", MetricNames[Metric], Worst / 1000.0f);
+			}
+			else
+			{
+				_snwprintf_s(Value, _countof(Value), _TRUNCATE, L" %s:%lu", MetricNames[Metric], Worst);
+			}
+
+			wcscat_s(Lines[LineCount], _countof(Lines[0]), Value);
+		}
+
+		if (wcslen(Lines[LineCount]) > wcslen(L"Worst in 2h:"))
+		{
+			LineCount++;
+		}
+		else
+		{
+			Lines[LineCount][0] = L'\0';
+		}
+
+		if (gShowKcc && gKcc && Entity->SiteIndex < gSiteGraph->SiteCount)
+		{
+			if (KccIsDCRemoved(gKcc, Entity))
+			{
+				wcscpy_s(Lines[LineCount++], _countof(Lines[0]), L"What-if: removed (Del to put it back)");
+			}
+			else if (gKcc->Bridgeheads[Entity->SiteIndex] == Entity)
+			{
+				wcscpy_s(Lines[LineCount++], _countof(Lines[0]), L"What-if: inter-site bridgehead for its site");
+			}
+		}
+	}
+
+	SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.SmallFont);
+
+	for (int Line = 0; Line < LineCount; Line++)
+	{
+		GetTextExtentPoint32W(gGraphicsData.BackBufferDeviceContext, Lines[Line], (int)wcslen(Lines[Line]), &TextSize);
+
+		Width = max(Width, TextSize.cx);
+	}
+
+	LineHeight = TextSize.cy + 2;
+
+	// Same scaling as UpdateHoveredEntity, the other way round.
+
+	if (ClientWidth > 0 && ClientHeight > 0)
+	{
+		Origin.x = (gMouseScreenPosition.x * gGraphicsData.Resolution.Width / ClientWidth) + 16;
+
+		Origin.y = (gMouseScreenPosition.y * gGraphicsData.Resolution.Height / ClientHeight) + 16;
+	}
+
+	SetRect(&Rect, Origin.x, Origin.y, Origin.x + Width + 8, Origin.y + (LineHeight * LineCount) + 8);
+
+	if (Rect.right > gGraphicsData.Resolution.Width)
+	{
+		OffsetRect(&Rect, gGraphicsData.Resolution.Width - Rect.right, 0);
+	}
+
+	if (Rect.bottom > gGraphicsData.Resolution.Height)
+	{
+		OffsetRect(&Rect, 0, (Origin.y - 32) - Rect.bottom);
+	}
+
+	FillRect(gGraphicsData.BackBufferDeviceContext, &Rect, GetStockObject(BLACK_BRUSH));
+
+	FrameRect(gGraphicsData.BackBufferDeviceContext, &Rect, gGraphicsData.MainBrush);
+
+	for (int Line = 0; Line < LineCount; Line++)
+	{
+		TextOutW(gGraphicsData.BackBufferDeviceContext, Rect.left + 4, Rect.top + 4 + (LineHeight * Line), Lines[Line], (int)wcslen(Lines[Line]));
+	}
+}
+
+// Starts a convergence simulation from the site under the mouse, or from every site if there isn't one. Pressing V
+// again for the same thing turns the heatmap back off.
+
+void ToggleConvergence(void)
+{
+	DWORD Source = CONVERGENCE_ALL_SITES;
+
+	DWORD Result = ERROR_SUCCESS;
+
+	if (gConvergenceGraph == NULL)
+	{
+		gShowConvergence = !gShowConvergence;
+
+		return;
+	}
+
+	if (gHoveredEntity != NULL)
+	{
+		Source = gHoveredEntity->SiteIndex;
+
+		// A DC whose site isn't in the site graph falls back to the all-sites view.
+
+		if (Source == SITEGRAPH_NO_SITE)
+		{
+			Source = CONVERGENCE_ALL_SITES;
+		}
+	}
+
+	if (gShowConvergence && Source == gConvergenceSource)
+	{
+		gShowConvergence = FALSE;
+
+		return;
+	}
+
+	gShowConvergence = TRUE;
+
+	gConvergenceSource = Source;
+
+	if ((Result = StartConvergence(gConvergenceGraph, Source, CurrentWeekSecond(), gMainWindowHandle)) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] StartConvergence failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		return;
+	}
+
+	gConvergencePending++;
+}
+
+// Compares the topology with the version of the timeline Step versions older (negative) or newer than the one it's
+// compared with now. Stepping back from none goes to the newest version, and stepping forward past the newest goes
+// back to none, taking any -compare snapshot with it.
+
+void StepTimeline(_In_ int Step)
+{
+	DWORD Count = GetTimelineCount();
+
+	DWORD Version = gTimelineVersion;
+
+	DWORD Result = ERROR_SUCCESS;
+
+	ENTITY* Baseline = NULL;
+
+	TIMELINE_RECORD Record = { 0 };
+
+	SYSTEMTIME Utc = { 0 };
+
+	SYSTEMTIME Local = { 0 };
+
+	wchar_t Name[MAX_PATH] = { 0 };
+
+	if (Count == 0)
+	{
+		return;
+	}
+
+	if (Version == TIMELINE_NONE)
+	{
+		Version = (Step < 0) ? Count - 1 : TIMELINE_NONE;
+	}
+	else if (Step < 0)
+	{
+		Version = (Version >= (DWORD)-Step) ? Version + Step : 0;
+	}
+	else
+	{
+		Version = (Version + Step < Count) ? Version + Step : TIMELINE_NONE;
+	}
+
+	if (Version == gTimelineVersion)
+	{
+		return;
+	}
+
+	UnmarkTopologyDiff(&gTopologyDiff);
+
+	FreeTopologyDiff(&gTopologyDiff);
+
+	gTimelineVersion = Version;
+
+	if (Version == TIMELINE_NONE)
+	{
+		return;
+	}
+
+	if ((Result = LoadTimelineVersion(Version, &Baseline)) != ERROR_SUCCESS)
+	{
+		gTimelineVersion = TIMELINE_NONE;
+
+		return;
+	}
+
+	GetTimelineRecord(Version, &Record);
+
+	FileTimeToSystemTime(&Record.Created, &Utc);
+
+	SystemTimeToTzSpecificLocalTime(NULL, &Utc, &Local);
+
+	_snwprintf_s(Name, _countof(Name), _TRUNCATE, L"version %lu of %lu, from %04d-%02d-%02d %02d:%02d",
+		Version + 1,
+		Count,
+		Local.wYear,
+		Local.wMonth,
+		Local.wDay,
+		Local.wHour,
+		Local.wMinute);
+
+	if ((Result = CompareWithBaseline(Baseline, Name, gEntities, &gTopologyDiff)) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] CompareWithBaseline failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		UnmarkTopologyDiff(&gTopologyDiff);
+
+		FreeTopologyDiff(&gTopologyDiff);
+
+		gTimelineVersion = TIMELINE_NONE;
+
+		return;
+	}
+
+	WriteDiffReport(DIFF_REPORT_FILE_NAME, &gTopologyDiff);
+}
+
+// Which of the heat brushes a site's convergence time gets, relative to the rest of the forest.
+
+int ConvergenceHeatLevel(_In_ DWORD Seconds)
+{
+	DWORD Range = gConvergence->MaxSeconds - gConvergence->MinSeconds;
+
+	if (Seconds == CONVERGENCE_UNREACHABLE)
+	{
+		return(HEAT_LEVELS);
+	}
+
+	if (Range == 0)
+	{
+		return(0);
+	}
+
+	return((int)(((UINT64)(Seconds - gConvergence->MinSeconds) * (HEAT_LEVELS - 1)) / Range));
+}
+
+void FormatDuration(_In_ DWORD Seconds, _Out_ wchar_t* Text, _In_ size_t Length)
+{
+	if (Seconds == CONVERGENCE_UNREACHABLE)
+	{
+		wcscpy_s(Text, Length, L"never");
+	}
+	else if (Seconds >= 86400)
+	{
+		_snwprintf_s(Text, Length, _TRUNCATE, L"%lud %luh", Seconds / 86400, (Seconds % 86400) / 3600);
+	}
+	else if (Seconds >= 3600)
+	{
+		_snwprintf_s(Text, Length, _TRUNCATE, L"%luh %lum", Seconds / 3600, (Seconds % 3600) / 60);
+	}
+	else
+	{
+		_snwprintf_s(Text, Length, _TRUNCATE, L"%lum %lus", Seconds / 60, Seconds % 60);
+	}
+}
+
+// One line at the top of the screen saying what the heatmap is showing.
+
+void DrawConvergenceStatus(_In_ int Top)
+{
+	static const wchar_t* DayNames[] = { L"Sun", L"Mon", L"Tue", L"Wed", L"Thu", L"Fri", L"Sat" };
+
+	wchar_t Text[512] = { 0 };
+
+	SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.SmallFont);
+
+	if (gConvergenceGraph == NULL)
+	{
+		wcscpy_s(Text, _countof(Text), L"Convergence: no site link data. Site links are only read when discovering a live forest.");
+	}
+	else if (gConvergence == NULL || gConvergence->Source != gConvergenceSource)
+	{
+		wcscpy_s(Text, _countof(Text), gConvergencePending ? L"Convergence: simulating..." : L"Convergence: simulation failed; see the log.");
+	}
+	else
+	{
+		wchar_t Fastest[32] = { 0 };
+
+		wchar_t Slowest[32] = { 0 };
+
+		DWORD Start = gConvergence->StartWeekSecond;
+
+		FormatDuration(gConvergence->MinSeconds, Fastest, _countof(Fastest));
+
+		FormatDuration(gConvergence->MaxSeconds, Slowest, _countof(Slowest));
+
+		if (gConvergence->Source == CONVERGENCE_ALL_SITES)
+		{
+			_snwprintf_s(
+				Text,
+				_countof(Text),
+				_TRUNCATE,
+				L"Convergence from every site, starting %s %02lu:%02lu UTC: best %s, worst %s. %lu sites can't reach all the others. (%lu sites, %llu ms)",
+				DayNames[Start / 86400], (Start % 86400) / 3600, (Start % 3600) / 60,
+				Fastest, Slowest, gConvergence->Unreachable, gConvergence->SiteCount, gConvergence->ElapsedMilliseconds);
+		}
+		else
+		{
+			_snwprintf_s(
+				Text,
+				_countof(Text),
+				_TRUNCATE,
+				L"Convergence from %s, starting %s %02lu:%02lu UTC: fastest %s, slowest %s, %lu sites never. (%s, %llu ms)",
+				gSiteGraph->Sites[gConvergence->Source]->name,
+				DayNames[Start / 86400], (Start % 86400) / 3600, (Start % 3600) / 60,
+				Fastest, Slowest, gConvergence->Unreachable,
+				gConvergenceGraph->UsesConnections ? L"over connection objects" : L"over site links",
+				gConvergence->ElapsedMilliseconds);
+		}
+	}
+
+	TextOutW(gGraphicsData.BackBufferDeviceContext, 0, Top, Text, (int)wcslen(Text));
+}
+
+// Keys that edit the KCC what-if simulation while it's being shown. Returns TRUE if the key was one of them.
+
+BOOL KccKeyDown(_In_ UINT VirtualKey)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	if (gShowKcc == FALSE || gKcc == NULL)
+	{
+		return(FALSE);
+	}
+
+	switch (VirtualKey)
+	{
+		case VK_DELETE:
+		{
+			if (gHoveredEntity && gHoveredEntity->Type == ET_DC)
+			{
+				Result = KccToggleDC(gKcc, ENTITY_LIVE(gHoveredEntity));
+			}
+
+			break;
+		}
+		case VK_TAB:
+		{
+			// Steps through the site links of the site under the mouse, one press at a time.
+
+			DWORD Site = gHoveredEntity ? gHoveredEntity->SiteIndex : SITEGRAPH_NO_SITE;
+
+			DWORD First = 0;
+
+			DWORD Last = 0;
+
+			DWORD Next = 0;
+
+			if (Site >= gSiteGraph->SiteCount)
+			{
+				break;
+			}
+
+			First = gSiteGraph->SiteLinkFirst[Site];
+
+			Last = gSiteGraph->SiteLinkFirst[Site + 1];
+
+			if (First == Last)
+			{
+				gKccSelectedLink = MAXDWORD;
+
+				break;
+			}
+
+			for (Next = First; Next < Last && gSiteGraph->SiteLinks[Next] != gKccSelectedLink; Next++)
+			{
+			}
+
+			gKccSelectedLink = gSiteGraph->SiteLinks[(Next + 1 < Last) ? Next + 1 : First];
+
+			break;
+		}
+		case VK_ADD:
+		case VK_OEM_PLUS:
+		case VK_SUBTRACT:
+		case VK_OEM_MINUS:
+		{
+			LONG Cost = 0;
+
+			if (gKccSelectedLink == MAXDWORD)
+			{
+				break;
+			}
+
+			Cost = (LONG)gKcc->LinkCosts[gKccSelectedLink] + ((VirtualKey == VK_ADD || VirtualKey == VK_OEM_PLUS) ? KCC_COST_STEP : -KCC_COST_STEP);
+
+			Result = KccSetLinkCost(gKcc, gKccSelectedLink, (DWORD)max(Cost, 1));
+
+			break;
+		}
+		case VK_BACK:
+		{
+			Result = KccResetEdits(gKcc);
+
+			break;
+		}
+		default:
+		{
+			return(FALSE);
+		}
+	}
+
+	if (Result != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Editing the KCC what-if simulation failed with 0x%08lx!", __FUNCTIONW__, Result);
+	}
+
+	return(TRUE);
+}
+
+// Draws every simulated inter-site connection as a line between the centres of its two sites: green if it exists
+// now, cyan if the KCC would add it, dotted red if the KCC would take it away.
+
+void RecordKccConnections(_Inout_ RENDER_LIST* List)
+{
+	float Scale = 1.0f / gCamera.z;
+
+	for (DWORD Index = 0; Index < gKcc->ConnectionCount; Index++)
+	{
+		KCC_CONNECTION* Connection = &gKcc->Connections[Index];
+
+		// Where this scene put the sites, which isn't necessarily where discovery did.
+
+		ENTITY* From = Connection->FromSite < gFrameScene->SiteCount ? gFrameScene->Sites[Connection->FromSite] : NULL;
+
+		ENTITY* To = Connection->ToSite < gFrameScene->SiteCount ? gFrameScene->Sites[Connection->ToSite] : NULL;
+
+		if (From == NULL || To == NULL)
+		{
+			continue;
+		}
+
+		POINT A = {
+			(LONG)(((From->x + (From->width / 2)) * Scale) - gCamera.x),
+			(LONG)(((From->y + (From->height / 2)) * Scale) - gCamera.y) };
+
+		POINT B = {
+			(LONG)(((To->x + (To->width / 2)) * Scale) - gCamera.x),
+			(LONG)(((To->y + (To->height / 2)) * Scale) - gCamera.y) };
+
+		// Only lines with both ends off the same side of the screen are certain not to cross it.
+
+		if ((A.x < 0 && B.x < 0) ||
+			(A.y < 0 && B.y < 0) ||
+			(A.x > gGraphicsData.Resolution.Width && B.x > gGraphicsData.Resolution.Width) ||
+			(A.y > gGraphicsData.Resolution.Height && B.y > gGraphicsData.Resolution.Height))
+		{
+			continue;
+		}
+
+		RecordPen(List, gGraphicsData.KccPens[Connection->Change]);
+
+		RecordLine(List, A.x, A.y, B.x, B.y);
+	}
+}
+
+// What the KCC what-if simulation has come up with, and the link being edited, at the top of the screen.
+
+void DrawKccStatus(_In_ int Top)
+{
+	wchar_t Text[512] = { 0 };
+
+	SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.SmallFont);
+
+	if (gKcc == NULL)
+	{
+		wcscpy_s(Text, _countof(Text), L"KCC what-if: no site link data. Site links are only read when discovering a live forest.");
+
+		TextOutW(gGraphicsData.BackBufferDeviceContext, 0, Top, Text, (int)wcslen(Text));
+
+		return;
+	}
+
+	_snwprintf_s(
+		Text,
+		_countof(Text),
+		_TRUNCATE,
+		L"KCC what-if: %lu connections kept, %lu new, %lu removed; %lu isolated sites. Edits: %lu DCs removed, %lu link costs changed. Recomputed in %.0f us.",
+		gKcc->ChangeCounts[KC_KEPT],
+		gKcc->ChangeCounts[KC_NEW],
+		gKcc->ChangeCounts[KC_REMOVED],
+		gKcc->IsolatedSites,
+		gKcc->RemovedDCCount,
+		gKcc->ChangedLinkCount,
+		gKcc->LastRecomputeMicroseconds);
+
+	TextOutW(gGraphicsData.BackBufferDeviceContext, 0, Top, Text, (int)wcslen(Text));
+
+	if (gKccSelectedLink < gSiteGraph->LinkCount)
+	{
+		SITELINK* Link = &gSiteGraph->Links[gKccSelectedLink];
+
+		_snwprintf_s(
+			Text,
+			_countof(Text),
+			_TRUNCATE,
+			L"Site link %s: %lu sites, what-if cost %lu (really %lu)",
+			Link->Name,
+			Link->SiteCount,
+			gKcc->LinkCosts[gKccSelectedLink],
+			Link->Cost);
+
+		TextOutW(gGraphicsData.BackBufferDeviceContext, 0, Top + 16, Text, (int)wcslen(Text));
+	}
+}
+
+// The pens, brushes and fonts everything is drawn with. Needs no window, so benchmarks can record with them too.
+
+void CreateDrawingObjects(void)
+{
 	gGraphicsData.MainBrush = CreateSolidBrush(RGB(255, 255, 255));
 
-	//gGraphicsData.InactiveBrush = CreateSolidBrush(RGB(96, 96, 96));
+	gGraphicsData.HealthBrushes[RH_UNKNOWN] = gGraphicsData.MainBrush;
+
+	gGraphicsData.HealthBrushes[RH_HEALTHY] = CreateSolidBrush(RGB(0, 192, 0));
+
+	gGraphicsData.HealthBrushes[RH_DEGRADED] = CreateSolidBrush(RGB(255, 192, 0));
+
+	gGraphicsData.HealthBrushes[RH_FAILING] = CreateSolidBrush(RGB(224, 0, 0));
+
+	gGraphicsData.HealthBrushes[RH_UNREACHABLE] = CreateSolidBrush(RGB(96, 96, 96));
+
+	gGraphicsData.LatencyBrushes[PC_NO_DATA] = gGraphicsData.MainBrush;
+
+	gGraphicsData.LatencyBrushes[PC_FAST] = CreateSolidBrush(RGB(0, 192, 0));
+
+	gGraphicsData.LatencyBrushes[PC_OK] = CreateSolidBrush(RGB(160, 224, 0));
+
+	gGraphicsData.LatencyBrushes[PC_SLOW] = CreateSolidBrush(RGB(255, 160, 0));
+
+	gGraphicsData.LatencyBrushes[PC_VERY_SLOW] = CreateSolidBrush(RGB(224, 0, 0));
+
+	gGraphicsData.LatencyBrushes[PC_DOWN] = CreateSolidBrush(RGB(96, 96, 96));
+
+	gGraphicsData.DiffBrushes[DK_NONE] = gGraphicsData.MainBrush;
+
+	gGraphicsData.DiffBrushes[DK_ADDED] = CreateSolidBrush(RGB(0, 224, 255));
+
+	gGraphicsData.DiffBrushes[DK_REMOVED] = CreateSolidBrush(RGB(255, 0, 255));
+
+	gGraphicsData.DiffBrushes[DK_CHANGED] = CreateSolidBrush(RGB(255, 255, 0));
+
+	// Green through yellow to red, dark enough that white site names stay readable.
+
+	for (int Level = 0; Level < HEAT_LEVELS; Level++)
+	{
+		int Red = min(160, (Level * 320) / (HEAT_LEVELS - 1));
+
+		int Green = min(160, ((HEAT_LEVELS - 1 - Level) * 320) / (HEAT_LEVELS - 1));
+
+		gGraphicsData.HeatBrushes[Level] = CreateSolidBrush(RGB(Red, Green, 0));
+	}
+
+	gGraphicsData.HeatBrushes[HEAT_LEVELS] = CreateSolidBrush(RGB(64, 64, 64));
+
+	gGraphicsData.KccPens[KC_KEPT] = CreatePen(PS_SOLID, 1, RGB(0, 192, 0));
+
+	gGraphicsData.KccPens[KC_NEW] = CreatePen(PS_SOLID, 2, RGB(0, 224, 255));
+
+	// Dotted pens can only be one pixel wide.
+
+	gGraphicsData.KccPens[KC_REMOVED] = CreatePen(PS_DOT, 1, RGB(255, 64, 64));
+
+	gGraphicsData.BridgeheadBrush = CreateSolidBrush(RGB(255, 224, 0));
+
+	gGraphicsData.RodcPen = CreatePen(PS_DASH, 1, RGB(255, 255, 255));
+
+	gGraphicsData.GcBrush = GetStockObject(BLACK_BRUSH);
+
+	// PDC, RID, Infrastructure, Schema, Domain Naming; see gRoleBadgeFlags.
+
+	gGraphicsData.RoleBrushes[0] = CreateSolidBrush(RGB(255, 215, 0));
+
+	gGraphicsData.RoleBrushes[1] = CreateSolidBrush(RGB(255, 128, 0));
+
+	gGraphicsData.RoleBrushes[2] = CreateSolidBrush(RGB(160, 96, 255));
+
+	gGraphicsData.RoleBrushes[3] = CreateSolidBrush(RGB(255, 0, 160));
+
+	gGraphicsData.RoleBrushes[4] = CreateSolidBrush(RGB(0, 160, 255));
+
+	gGraphicsData.MinimapViewBrush = CreateSolidBrush(RGB(0, 255, 128));
+
+	gGraphicsData.SparklinePen = CreatePen(PS_SOLID, 1, RGB(0, 224, 255));
+
+	//gGraphicsData.InactiveBrush = CreateSolidBrush(RGB(96, 96, 96));
+
+	gGraphicsData.Pen = CreatePen(PS_SOLID, 2, RGB(255, 255, 255));
+
+	gGraphicsData.HugeFont = CreateFontW(60, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, gRegParams.FontFace);
+
+	gGraphicsData.BigFont = CreateFontW(36, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, gRegParams.FontFace);
+
+	gGraphicsData.SmallFont = CreateFontW(18, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, gRegParams.FontFace);
+}
+
+DWORD InitializeGraphics(void)
+{
+	DWORD Result = ERROR_SUCCESS;	
+	
+	gGraphicsData.ScreenDeviceContext = GetDC(gMainWindowHandle);
+
+	gGraphicsData.BackBufferDeviceContext = CreateCompatibleDC(gGraphicsData.ScreenDeviceContext);
+
+	if (gGraphicsData.ScreenDeviceContext == NULL || gGraphicsData.BackBufferDeviceContext == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Graphics initialization failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
 
-	gGraphicsData.Pen = CreatePen(PS_SOLID, 2, RGB(255, 255, 255));
+	SetBkMode(gGraphicsData.BackBufferDeviceContext, TRANSPARENT);
+
+	gGraphicsData.BackBufferBMInfo.bmiHeader.biSize = sizeof(gGraphicsData.BackBufferBMInfo.bmiHeader);
+
+	gGraphicsData.BackBufferBMInfo.bmiHeader.biWidth = gGraphicsData.Resolution.Width;
+
+	gGraphicsData.BackBufferBMInfo.bmiHeader.biHeight = gGraphicsData.Resolution.Height;
+
+	gGraphicsData.BackBufferBMInfo.bmiHeader.biBitCount = 32;
+
+	gGraphicsData.BackBufferBMInfo.bmiHeader.biCompression = BI_RGB;
+
+	gGraphicsData.BackBufferBMInfo.bmiHeader.biPlanes = 1;
+
+	gGraphicsData.BackBufferDIB = CreateDIBSection(gGraphicsData.ScreenDeviceContext, &gGraphicsData.BackBufferBMInfo, DIB_RGB_COLORS, &gGraphicsData.Bits, NULL, 0);
+
+	if (gGraphicsData.BackBufferDIB == NULL || gGraphicsData.Bits == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Graphics initialization failed with 0x%08lx!", __FUNCTIONW__, Result);		
+
+		goto Exit;
+	}
+
+	SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.BackBufferDIB);
+
+	CreateDrawingObjects();
 
 	SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.Pen);
 
-	gGraphicsData.HugeFont = CreateFontW(60, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, gRegParams.FontFace);
+	if ((gRenderList = CreateRenderList()) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
 
-	gGraphicsData.BigFont = CreateFontW(36, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, gRegParams.FontFace);
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Graphics initialization failed with 0x%08lx!", __FUNCTIONW__, Result);
 
-	gGraphicsData.SmallFont = CreateFontW(18, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, gRegParams.FontFace);
+		goto Exit;
+	}
 
 	SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.BigFont);
 
@@ -1213,12 +3150,210 @@ Exit:
 
 DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 {
-	UNREFERENCED_PARAMETER(lpParameter);
+	// If we were given a snapshot file, show that instead of discovering the forest we're in.
+
+	wchar_t* SnapshotFileName = lpParameter;
 
 	DWORD Result = ERROR_SUCCESS;
 
 	wchar_t WindowText[128] = { 0 };
 
+	BOOL LaidOut = FALSE;
+
+	SCENE* Scene = NULL;
+
+	TRACE_THREAD_NAME(L"Discovery");
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Discovery thread beginning.", __FUNCTIONW__);
+
+	if (SnapshotFileName)
+	{
+		if ((Result = LoadSnapshot(SnapshotFileName, &gEntities, &LaidOut)) != ERROR_SUCCESS)
+		{
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] LoadSnapshot failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+			goto Exit;
+		}
+	}
+	else if ((Result = DiscoverTopology()) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	// Every stage below checks whether the user has quit before it starts. None of them take long on their own,
+	// apart from reading the site graph, which watches for it as it goes.
+
+	if (gContinue == FALSE)
+	{
+		Result = ERROR_CANCELLED;
+
+		goto Exit;
+	}
+
+	GetWindowTextW(gMainWindowHandle, WindowText, _countof(WindowText));
+
+	wcscat_s(WindowText, _countof(WindowText), L" - ");
+
+	wcscat_s(WindowText, _countof(WindowText), gForestName);
+
+	SetWindowTextW(gMainWindowHandle, WindowText);
+
+	if (LaidOut == FALSE)
+	{
+		TRACE_BEGIN("Layout");
+
+		SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.HugeFont);
+
+		Result = LayoutTopology(gEntities, GdiMeasureText, (LAYOUT_MODE)gRegParams.Layout, (float)gGraphicsData.Resolution.Width / (float)gGraphicsData.Resolution.Height);
+
+		TRACE_END();
+
+		if (Result != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+
+	// Labels that can't be placed are drawn where they always were, overlapping or not.
+
+	TRACE_BEGIN("PlaceLabels");
+
+	{
+		LABEL_FONT LabelFonts[LFS_COUNT] = { 0 };
+
+		GdiLabelFont(gGraphicsData.BackBufferDeviceContext, gGraphicsData.HugeFont, &LabelFonts[LFS_HUGE]);
+
+		GdiLabelFont(gGraphicsData.BackBufferDeviceContext, gGraphicsData.BigFont, &LabelFonts[LFS_BIG]);
+
+		GdiLabelFont(gGraphicsData.BackBufferDeviceContext, gGraphicsData.SmallFont, &LabelFonts[LFS_SMALL]);
+
+		PlaceLabels(gEntities, LabelFonts, NULL);
+	}
+
+	TRACE_END();
+
+	// A failed comparison shouldn't stop the topology from being shown; it's in the log.
+
+	if (gCompareFileName)
+	{
+		TRACE_BEGIN("CompareWithSnapshot");
+
+		if (CompareWithSnapshot(gCompareFileName, gEntities, &gTopologyDiff) == ERROR_SUCCESS)
+		{
+			WriteDiffReport(DIFF_REPORT_FILE_NAME, &gTopologyDiff);
+		}
+
+		TRACE_END();
+	}
+
+	// Only live discovery adds to the timeline, but it can be looked back through with a snapshot open as well.
+	// Without it, there's just nothing for , and . to step through.
+
+	if (gRegParams.KeepTimeline)
+	{
+		TRACE_BEGIN("OpenTimeline");
+
+		OpenTimeline(TIMELINE_FILE_NAME, SnapshotFileName ? NULL : gEntities, NULL);
+
+		TRACE_END();
+	}
+
+	// Site links have to be read over LDAP, so they only exist for a live forest. Without them there's no
+	// convergence to simulate, but nothing else is affected.
+
+	if (gContinue == FALSE)
+	{
+		Result = ERROR_CANCELLED;
+
+		goto Exit;
+	}
+
+	if (SnapshotFileName == NULL)
+	{
+		TRACE_BEGIN("DiscoverSiteGraph");
+
+		if (DiscoverSiteGraph(gDiscoveryDC, gEntities, &gSiteGraph) == ERROR_SUCCESS)
+		{
+			gConvergenceGraph = BuildConvergenceGraph(gSiteGraph);
+		}
+
+		TRACE_END();
+	}
+
+	// The first scene is the entities discovery made, as they are. Everything above decides where things go, so the
+	// UI thread can pick it up now and start drawing tiles of it. Nothing is drawn until this thread is done.
+
+	TRACE_BEGIN("CreateScene");
+
+	Scene = CreateScene(gEntities, NULL, (LAYOUT_MODE)gRegParams.Layout);
+
+	TRACE_END();
+
+	if (Scene == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	PublishScene(Scene);
+
+	if (gContinue == FALSE)
+	{
+		Result = ERROR_CANCELLED;
+
+		goto Exit;
+	}
+
+	// Details of each DC are fetched once it's on screen. Without them the map is just less informative.
+
+	if (SnapshotFileName == NULL && StartDCDetails(gDiscoveryDC, gEntities) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] DC details will not be shown.", __FUNCTIONW__);
+	}
+
+	// Now that every DC is known, start keeping an eye on their replication health in the background. Without
+	// history there are no sparklines, but the map is otherwise the same.
+
+	if (StartTimeSeries(gEntities, gRegParams.TimeSeriesMB, gRegParams.TimeSeriesPersist ? TIMESERIES_FILE_NAME : NULL) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] No history of replication and probe results will be kept.", __FUNCTIONW__);
+	}
+
+	// A replay has to draw the same thing every time it's run, so nothing is polled while one is running.
+
+	if (IsReplayingInput() == FALSE)
+	{
+		// Without the scheduler the map is still shown, just without replication health.
+
+		if (StartReplicationScheduler() != ERROR_SUCCESS)
+		{
+			LogEventW(LL_WARN, LF_FILE, L"[%s] Replication health will not be polled.", __FUNCTIONW__);
+		}
+
+		// Or without reachability, if the probes can't start.
+
+		if (StartProbeEngine() != ERROR_SUCCESS)
+		{
+			LogEventW(LL_WARN, LF_FILE, L"[%s] DCs will not be probed for reachability.", __FUNCTIONW__);
+		}
+	}
+
+Exit:
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Discovery thread ending with 0x%08lx.", __FUNCTIONW__, Result);
+
+	return(Result);
+}
+
+// Finds every site, DC and domain in the forest and adds them to gEntities. Positions are left at zero; see
+// LayoutTopology. Touches nothing to do with the window or graphics, so it can run headless. Every remote call has
+// DiscoveryCallTimeoutMs to return, and the whole thing gives up with ERROR_CANCELLED as soon as the user quits.
+
+DWORD DiscoverTopology(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
 	DOMAIN_CONTROLLER_INFOW* DCLocatorInfo = NULL;
 
 	HANDLE DSBindHandle = NULL;	
@@ -1231,14 +3366,14 @@ DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 
 	ENTITY* Current = NULL;
 
-	LogEventW(LL_INFO, LF_FILE, L"[%s] Discovery thread beginning.", __FUNCTIONW__);
+	DOMAIN_DISCOVERY_SET* Domains = NULL;
 
 	// First find our initial DC... the rest of the discovery of the entire forest has to begin somewhere... we don't know yet
 	// whether we are joined to the forest root domain or a child domain of it. Azure AD/Hybrid joined systems don't work with DCLocator
 	// as far as I know, in which case you have to give the app a hint by populating the DomainController registry setting with an initial DC to contact.
 	// If the user has not specified DomainController, it will be NULL, which should work fine for traditional AD-joined systems.
 
-	if ((Result = DsGetDcNameW(gRegParams.DomainController, NULL, NULL, NULL, DS_GC_SERVER_REQUIRED, &DCLocatorInfo)) != ERROR_SUCCESS)
+	if ((Result = DeadlineDsGetDcNameW(gRegParams.DomainController, DS_GC_SERVER_REQUIRED, &DCLocatorInfo, gRegParams.DiscoveryCallTimeoutMs)) != ERROR_SUCCESS)
 	{		
 		LogEventW(LL_ERROR, LF_FILE, L"[%s] DsGetDcNameW failed with 0x%08lx!", __FUNCTIONW__, Result);
 
@@ -1251,18 +3386,14 @@ DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 		DCLocatorInfo->DomainName,
 		DCLocatorInfo->DnsForestName);
 
-	GetWindowTextW(gMainWindowHandle, WindowText, _countof(WindowText));
-
-	wcscat_s(WindowText, _countof(WindowText), L" - ");
-
-	wcscat_s(WindowText, _countof(WindowText), DCLocatorInfo->DnsForestName);
+	wcscpy_s(gForestName, _countof(gForestName), DCLocatorInfo->DnsForestName);
 
-	SetWindowTextW(gMainWindowHandle, WindowText);
+	wcscpy_s(gDiscoveryDC, _countof(gDiscoveryDC), DCLocatorInfo->DomainControllerName);
 
 	// Since most of the info we need will come from the configuration NC, which is forest-wide, it doesn't matter right now whether we're talking to a 
 	// forest root DC or a child domain DC.
 
-	if ((Result = DsBindW(DCLocatorInfo->DomainControllerName, NULL, &DSBindHandle)) != ERROR_SUCCESS)
+	if ((Result = DeadlineDsBindW(DCLocatorInfo->DomainControllerName, &DSBindHandle, gRegParams.DiscoveryCallTimeoutMs)) != ERROR_SUCCESS)
 	{
 		LogEventW(LL_ERROR, LF_FILE, L"[%s] DsBindW failed with 0x%08lx!", __FUNCTIONW__, Result);
 
@@ -1271,7 +3402,7 @@ DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 
 	LogEventW(LL_INFO, LF_FILE, L"[%s] Successfully bound to DC.", __FUNCTIONW__);
 
-	if ((Result = DsEnumerateDomainTrustsW(DCLocatorInfo->DomainControllerName, DS_DOMAIN_TREE_ROOT | DS_DOMAIN_IN_FOREST, &Trusts, &TrustCount)) != ERROR_SUCCESS)
+	if ((Result = DeadlineDsEnumerateDomainTrustsW(DCLocatorInfo->DomainControllerName, DS_DOMAIN_TREE_ROOT | DS_DOMAIN_IN_FOREST, &Trusts, &TrustCount, gRegParams.DiscoveryCallTimeoutMs)) != ERROR_SUCCESS)
 	{
 		LogEventW(LL_ERROR, LF_FILE, L"[%s] DsEnumerateDomainTrustsW failed with 0x%08lx!", __FUNCTIONW__, Result);
 
@@ -1293,7 +3424,17 @@ DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 		New->Flags = Trusts[trust].Flags;
 	}
 
-	if ((Result = DsListSitesW(DSBindHandle, &Sites)) != NO_ERROR)
+	// What each domain knows about its own DCs is collected in the background, one domain per thread pool callback,
+	// while the configuration NC is walked below. If that can't be started, every DC is just looked up individually.
+
+	if ((Result = StartDomainDiscovery(gEntities, &Domains)) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] StartDomainDiscovery failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		Result = ERROR_SUCCESS;
+	}
+
+	if ((Result = DeadlineDsListSitesW(&DSBindHandle, &Sites, gRegParams.DiscoveryCallTimeoutMs)) != NO_ERROR)
 	{
 		LogEventW(LL_ERROR, LF_FILE, L"[%s] DsListSitesW failed with 0x%08lx!", __FUNCTIONW__, Result);
 
@@ -1317,26 +3458,19 @@ DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 
 		ENTITY* New = NewEntity();
 
-		wchar_t CommonName[64] = { 0 };
-
 		New->Type = ET_SITE;
 
 		wcscpy_s(New->distinguishedname, _countof(New->distinguishedname), Sites->rItems[site].pName);
 
 		// we have a dn now like cn=sitename,cn=sites,dc=configuration,dc=domain,dc=com or whatever
-		// I just want to extract the cn from that
+		// I just want the site name from that
 
-		for (int character = 3; character < _countof(CommonName) - 1; character++)
+		if (DnFirstValue(New->distinguishedname, New->name, _countof(New->name)) != ERROR_SUCCESS && New->name[0] == L'\0')
 		{
-			if (New->distinguishedname[character] == L',')
-			{
-				break;
-			}
+			LogEventW(LL_WARN, LF_FILE, L"[%s] Site DN %s could not be parsed!", __FUNCTIONW__, New->distinguishedname);
 
-			CommonName[character - 3] = New->distinguishedname[character];
+			wcsncpy_s(New->name, _countof(New->name), New->distinguishedname, _TRUNCATE);
 		}
-
-		wcscpy_s(New->name, _countof(New->name), CommonName);		
 	}
 
 	Current = gEntities;
@@ -1347,7 +3481,7 @@ DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 		{
 			DS_NAME_RESULTW* ServersInSite = NULL;			
 
-			if ((Result = DsListServersInSiteW(DSBindHandle, Current->distinguishedname, &ServersInSite)) != NO_ERROR)
+			if ((Result = DeadlineDsListServersInSiteW(&DSBindHandle, Current->distinguishedname, &ServersInSite, gRegParams.DiscoveryCallTimeoutMs)) != NO_ERROR)
 			{
 				LogEventW(LL_ERROR, LF_FILE, L"[%s] DsListServersInSiteW reports error 0x%08lx!", __FUNCTIONW__, Result);
 
@@ -1356,8 +3490,6 @@ DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 
 			for (unsigned int dc = 0; dc < ServersInSite->cItems; dc++)
 			{
-				DS_NAME_RESULTW* DCInfo = NULL;
-
 				if (ServersInSite->rItems[dc].status != NO_ERROR)
 				{
 					Result = ServersInSite->rItems[dc].status;
@@ -1375,21 +3507,7 @@ DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 
 				wcscpy_s(New->site, _countof(New->site), Current->distinguishedname);
 
-				// we currently only have the distinguishedname, now to get the dns fqdn of this dc
-
-				if ((Result = DsListInfoForServerW(DSBindHandle, ServersInSite->rItems[dc].pName, &DCInfo)) != NO_ERROR)
-				{
-					LogEventW(LL_ERROR, LF_FILE, L"[%s] DsListInfoForServerW reports error 0x%08lx!", __FUNCTIONW__, Result);
-
-					goto Exit;
-				}
-
-				wcscpy_s(New->fqdn, _countof(New->fqdn), DCInfo->rItems[DS_LIST_DNS_HOST_NAME_FOR_SERVER].pName);
-
-				if (DCInfo)
-				{
-					DsFreeNameResultW(DCInfo);
-				}
+				// The fqdn comes from the per-domain results below.
 
 				Current->DCsInSite++;
 			}
@@ -1405,96 +3523,45 @@ DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter)
 		Current = Current->Next;
 	}
 
-	//// position the sites
-	//// then position the dcs within the sites
-
-	POINT PreviousSite = { .x = -64, .y = 64 };
-
-	int PreviousSiteWidth = 0;
-
-	Current = gEntities;	
+	// A domain that hangs only costs the wait. Whatever the others found is merged all the same.
 
-	while (Current != NULL)
+	if (Domains && ((Result = WaitForDomainDiscovery(Domains, DOMAIN_DISCOVERY_TIMEOUT_MS)) == ERROR_SUCCESS || Result == ERROR_TIMEOUT))
 	{
-		if (Current->Type == ET_SITE)
-		{			
-			Current->x = PreviousSite.x + PreviousSiteWidth + 256;
-
-			Current->y = PreviousSite.y;
+		DWORD MergeResult = ERROR_SUCCESS;
 
-			// calculate width of the site based on the largest text size of the dc names
-			ENTITY* DC = gEntities;
+		TRACE_BEGIN("MergeDomainDiscovery");
 
-			int DCindex = 0;
-
-			while (DC != NULL)
-			{
-				SelectObject(gGraphicsData.BackBufferDeviceContext, gGraphicsData.HugeFont);
-
-				if ((DC->Type == ET_DC) && (_wcsicmp(DC->site, Current->distinguishedname) == 0))
-				{
-					// this dc is in this site
-
-					SIZE TextSize;
-
-					GetTextExtentPointW(gGraphicsData.BackBufferDeviceContext, DC->fqdn, (int)wcslen(DC->fqdn), &TextSize);
-	
-					// expand the width of the site if necessary
-					if (TextSize.cx > Current->width)	
-					{							
-						Current->width = TextSize.cx;
-					}
-								
-					DC->x = Current->x + (DEF_DC_SIZE / 4);
-			
-					DC->y = (Current->y + (DEF_DC_SIZE / 4)) + (DCindex * (DEF_DC_SIZE + (DEF_DC_SIZE / 2)));
-			
-					DC->width = DEF_DC_SIZE;
-			
-					DC->height = DEF_DC_SIZE;
-
-					DCindex++;
-				}				
-
-				DC = DC->Next;
-			}
-				
-
-			// add extra width for the triangle DC icons, and some padding
-
-			Current->width += DEF_DC_SIZE + (DEF_DC_SIZE / 2);
-
-			if (Current->DCsInSite)
-			{
-				Current->height = (Current->DCsInSite * DEF_DC_SIZE) + (Current->DCsInSite * (DEF_DC_SIZE / 2));
-			}
-			else
-			{
-				Current->height = DEF_DC_SIZE; // an empty site with no dcs in it
-			}
+		MergeResult = MergeDomainDiscovery(Domains, gEntities);
 
+		TRACE_END();
 
-			PreviousSite.x = Current->x;
-
-			PreviousSite.y = Current->y;
-
-			PreviousSiteWidth = Current->width;
+		if (MergeResult != ERROR_SUCCESS)
+		{
+			Result = MergeResult;
 		}
-
-		Current = Current->Next;
 	}
 
-	Current = gEntities;
+	if (Result == ERROR_CANCELLED)
+	{
+		goto Exit;
+	}
 
-	while (Current != NULL)
+	if (Result != ERROR_SUCCESS)
 	{
-		Current = Current->Next;
+		LogEventW(LL_WARN, LF_FILE, L"[%s] Per-domain discovery did not complete (0x%08lx)! DCs it didn't name will be filled in as they come into view.", __FUNCTIONW__, Result);
+
+		Result = ERROR_SUCCESS;
 	}
 
-	
+	// Any DC that its domain didn't tell us about, because the domain couldn't be reached or the DC's objects are
+	// out of step, is left without an fqdn for now. The DC details workers read it from the DC's server object once
+	// the DC comes into view, which is far quicker than looking up thousands of DCs one at a time before showing
+	// anything. Headless discovery does that itself with FetchMissingDCNames.
 
 Exit:
 
+	FreeDomainDiscovery(Domains);
+
 	if (Trusts)
 	{
 		NetApiBufferFree(Trusts);
@@ -1515,11 +3582,63 @@ Exit:
 		DsUnBindW(&DSBindHandle);
 	}
 
-	LogEventW(LL_INFO, LF_FILE, L"[%s] Discovery thread ending.", __FUNCTIONW__);
-
 	return(Result);
 }
 
+int GdiMeasureText(_In_ wchar_t* Text, _In_ int Length)
+{
+	SIZE TextSize = { 0 };
+
+	GetTextExtentPointW(gGraphicsData.BackBufferDeviceContext, Text, Length, &TextSize);
+
+	return(TextSize.cx);
+}
+
+// What PlaceLabels needs to know about a font to tell how wide labels drawn in it are, measured in DeviceContext.
+
+void GdiLabelFont(_In_ HDC DeviceContext, _In_ HFONT Font, _Out_ LABEL_FONT* LabelFont)
+{
+	LOGFONTW LogFont = { 0 };
+
+	TEXTMETRICW TextMetrics = { 0 };
+
+	HGDIOBJ PreviousFont = SelectObject(DeviceContext, Font);
+
+	GetObjectW(Font, sizeof(LogFont), &LogFont);
+
+	LabelFont->Height = abs(LogFont.lfHeight);
+
+	GetCharWidth32W(DeviceContext, 0, LABEL_FONT_CHARS - 1, LabelFont->Widths);
+
+	GetTextMetricsW(DeviceContext, &TextMetrics);
+
+	LabelFont->MaxWidth = TextMetrics.tmMaxCharWidth;
+
+	SelectObject(DeviceContext, PreviousFont);
+}
+
+// The name a DC's label will have: its fqdn, or until that's known, a guess at it written into Guess. A DC whose fqdn
+// isn't known yet will most likely be named for the server, in the forest root domain or one under it. Leaving room
+// for that keeps the label inside the site, and clear of other labels, once it arrives.
+
+wchar_t* DCLabelText(_In_ ENTITY* DC, _Out_ wchar_t* Guess, _In_ size_t Length)
+{
+	wchar_t ServerName[128] = { 0 };
+
+	if (DC->fqdn[0] != L'\0')
+	{
+		Guess[0] = L'\0';
+
+		return(DC->fqdn);
+	}
+
+	DnFirstValue(DC->distinguishedname, ServerName, _countof(ServerName));
+
+	_snwprintf_s(Guess, Length, _TRUNCATE, L"%s.%s", ServerName, gForestName);
+
+	return(Guess);
+}
+
 ENTITY* NewEntity(void)
 {
 	if (gEntities == NULL)
@@ -44,6 +44,14 @@
 
 #define DEF_DC_SIZE	256
 
+// Site names are drawn up to this altitude, and DC names up to the next one.
+#define SITE_LABEL_MAX_ALTITUDE	5
+
+#define DC_LABEL_MAX_ALTITUDE	3
+
+// Shades of the convergence heatmap, from fastest to slowest. There is one more brush after them for never.
+#define HEAT_LEVELS	8
+
 typedef enum LOGLEVEL
 {
 	LL_NONE,	// Log nothing
@@ -83,6 +91,34 @@ typedef struct REGPARAMS
 
 	wchar_t DomainController[64];
 
+	DWORD LogFullPolicy;
+
+	DWORD ReplicationPollSeconds;
+
+	DWORD ReplicationMaxConcurrent;
+
+	DWORD ReplicationTimeoutSeconds;
+
+	DWORD ReplicationProvider;
+
+	DWORD ProbeIntervalSeconds;
+
+	DWORD ProbeMaxInFlight;
+
+	DWORD ProbeTimeoutMs;
+
+	DWORD ProbeStandIn;
+
+	DWORD DiscoveryCallTimeoutMs;
+
+	DWORD TimeSeriesMB;
+
+	DWORD TimeSeriesPersist;
+
+	DWORD KeepTimeline;
+
+	DWORD Layout;
+
 } REGPARAMS;
 
 //typedef union PIXEL32 
@@ -103,6 +139,37 @@ typedef struct REGPARAMS
 //
 //} PIXEL32;
 
+// How an entity differs from the snapshot it was compared against with -compare.
+typedef enum DIFF_KIND
+{
+	DK_NONE,
+
+	DK_ADDED,
+
+	DK_REMOVED,		// On a site that is still there: some of the DCs that were in it are gone
+
+	DK_CHANGED,
+
+	DK_COUNT
+
+} DIFF_KIND;
+
+// How a connection generated by the KCC what-if simulation compares with the connection objects that exist now.
+typedef enum KCC_CHANGE
+{
+	KC_KEPT,
+
+	KC_NEW,
+
+	KC_REMOVED,
+
+	KC_COUNT
+
+} KCC_CHANGE;
+
+// Each FSMO role a DC holds is shown as a small square of the role's own colour under the DC.
+#define DC_ROLE_BADGES	5
+
 typedef struct GRAPHICSDATA
 {
 	HDC ScreenDeviceContext;
@@ -147,12 +214,51 @@ typedef struct GRAPHICSDATA
 
 	HFONT SmallFont;
 
+	HBRUSH HealthBrushes[5];
+
+	HBRUSH LatencyBrushes[6];
+
+	HBRUSH DiffBrushes[DK_COUNT];
+
+	HBRUSH HeatBrushes[HEAT_LEVELS + 1];
+
+	HPEN KccPens[KC_COUNT];
+
+	HBRUSH BridgeheadBrush;
+
+	HPEN RodcPen;
+
+	HBRUSH GcBrush;
+
+	HBRUSH RoleBrushes[DC_ROLE_BADGES];
+
+	HBRUSH MinimapViewBrush;
+
+	HPEN SparklinePen;
+
 	int EntitiesOnScreen;
 
+	int EntitiesTested;
+
 	MONITORINFO MonitorInfo;
 
 } GRAPHICSDATA;
 
+// What the fill colour of the DC triangles means. The C key cycles through these.
+typedef enum DC_COLOR_MODE
+{
+	DCCM_REPLICATION,
+
+	DCCM_LDAP_LATENCY,
+
+	DCCM_GC_LATENCY,
+
+	DCCM_KERBEROS_LATENCY,
+
+	DCCM_COUNT
+
+} DC_COLOR_MODE;
+
 typedef struct CAMERA
 {
 	int x;
@@ -196,6 +302,44 @@ typedef enum ENTITY_TYPE
 
 } ENTITY_TYPE;
 
+// Replication health of a DC, as last reported by the replication scheduler.
+typedef enum REPL_HEALTH
+{
+	RH_UNKNOWN,		// Not polled yet
+
+	RH_HEALTHY,		// All inbound neighbours replicating
+
+	RH_DEGRADED,	// Some inbound neighbours failing
+
+	RH_FAILING,		// Every inbound neighbour failing
+
+	RH_UNREACHABLE	// Could not bind to the DC, or the poll timed out
+
+} REPL_HEALTH;
+
+typedef struct REPLSTATUS
+{
+	REPL_HEALTH Health;
+
+	DWORD Neighbors;
+
+	DWORD FailingNeighbors;
+
+	DWORD ConsecutiveFailures;
+
+	DWORD KccFailures;
+
+	// Replication operations queued on the DC, waiting to run.
+	DWORD PendingOps;
+
+	DWORD LastResult;
+
+	FILETIME OldestLastSuccess;
+
+	UINT64 LastPolled;
+
+} REPLSTATUS;
+
 typedef struct ENTITY
 {
 	struct ENTITY* Next;
@@ -220,14 +364,98 @@ typedef struct ENTITY
 
 	wchar_t site[128];
 
+	// DNS name of the domain a DC belongs to.
+	wchar_t domain[256];
+
 	DWORD DCsInSite;
 
 	DWORD Flags;
 
+	// Only written by the replication scheduler thread.
+	REPLSTATUS ReplStatus;
+
+	// The frame number on which this entity was last drawn, so background work can prioritize what the user is looking at.
+	volatile UINT64 LastVisibleFrame;
+
+	// Reachability probe results, owned by the probe engine. NULL until probing starts.
+	struct PROBESTATS* ProbeStats;
+
+	// Set by MarkTopologyDiff when the topology has been compared against a snapshot.
+	DIFF_KIND DiffKind;
+
+	// Filled in by the DC details workers once the DC has been looked at; see DCDetails.h. Details is NULL until
+	// they start, and DetailsState is a DCDETAILS_STATE. Details is only worth reading once that is DDS_READY.
+	volatile LONG DetailsState;
+
+	struct DCDETAILS* Details;
+
+	// For a site, its position in the site graph's Sites array. For a DC, that of the site it's in. SITEGRAPH_NO_SITE
+	// for everything else.
+	DWORD SiteIndex;
+
+	// For a DC, one more than its row in the time-series store; see TimeSeries.h. Zero until the store starts.
+	DWORD TimeSeriesRow;
+
+	// Where this site's or DC's labels go at each altitude they're drawn at, as LABEL_SPOTs; see Labels.h. Written once
+	// by PlaceLabels, before the topology is shown.
+	BYTE LabelSpots[SITE_LABEL_MAX_ALTITUDE];
+
+	// For a copy made for a scene, the entity discovery made that it's a copy of, which is the one the fields above
+	// that change after discovery are kept up to date on. NULL for that entity itself. See Scene.h.
+	struct ENTITY* Live;
+
 	// bitmap? shape? sitelinks?
 
 } ENTITY;
 
+// Where to read or write an entity's status from, whether it's a scene's copy or not.
+#define ENTITY_LIVE(Entity) ((Entity)->Live ? (Entity)->Live : (Entity))
+
+// An entity that survived culling this frame, and where it lands on the screen.
+typedef struct VISIBLEENTITY
+{
+	ENTITY* Entity;
+
+	RECT Rect;
+
+} VISIBLEENTITY;
+
+extern HWND gMainWindowHandle;
+
+extern REGPARAMS gRegParams;
+
+extern volatile BOOL gContinue;
+
+extern GRAPHICSDATA gGraphicsData;
+
+extern CAMERA gCamera;
+
+extern ENTITY* gEntities;
+
+extern wchar_t gForestName[256];
+
+extern wchar_t gDiscoveryDC[256];
+
+// Finished once the topology is ready to be shown; see DISCOVERY_THREAD_FINISHED.
+extern HANDLE gDiscoveryThread;
+
+extern DC_COLOR_MODE gDCColorMode;
+
+// See RenderList.h.
+struct RENDER_LIST;
+
+// See Labels.h.
+struct LABEL_FONT;
+
+// See Scene.h.
+struct SCENE;
+
+// The scene the UI thread is drawing, pinned until a newer one is published. NULL until discovery has finished.
+extern struct SCENE* gFrameScene;
+
+// Returns how many pixels wide Text would be when drawn in the huge font.
+typedef int(*MEASURE_TEXT_PROC)(_In_ wchar_t* Text, _In_ int Length);
+
 
 
 int WINAPI wWinMain(_In_ HINSTANCE Instance, _In_opt_ HINSTANCE PrevInstance, _In_ PWSTR CmdLine, _In_ int CmdShow);
@@ -238,14 +466,70 @@ DWORD CreateMainWindow(void);
 
 DWORD ReadRegistrySettings(void);
 
+DWORD ReadRegistryDWORD(_In_ HKEY RegKey, _In_ wchar_t* ValueName, _Out_ DWORD* Value, _In_ DWORD Default);
+
+void CreateDrawingObjects(void);
+
 DWORD InitializeGraphics(void);
 
 void LogEventW(_In_ LOGLEVEL Level, _In_ LOGFLAGS Flags, _In_ wchar_t* Message, ...);
 
 void RenderFrameGraphics(void);
 
+void CullEntities(void);
+
+void RecordScene(_Inout_ struct RENDER_LIST* List);
+
+void OpenSearch(void);
+
+void SearchTypeCharacter(_In_ wchar_t Character);
+
+void SearchKeyDown(_In_ UINT VirtualKey);
+
+void DrawSearchBox(void);
+
+void FlyCameraTo(_In_ ENTITY* Entity);
+
+void RecordEntityShape(_Inout_ struct RENDER_LIST* List, _In_ ENTITY* Entity, _In_ RECT* EntityRect, _In_ DC_COLOR_MODE ColorMode);
+
+UINT32 EntityAppearance(_In_ ENTITY* Entity, _In_ DC_COLOR_MODE ColorMode);
+
+void RecordDCRoles(_Inout_ struct RENDER_LIST* List, _In_ ENTITY* DC, _In_ RECT* Rect);
+
+void AnimateCamera(void);
+
+void UpdateHoveredEntity(void);
+
+void UpdateFrameScene(void);
+
+void DrawTooltip(_In_ ENTITY* Entity);
+
+void DrawConvergenceStatus(_In_ int Top);
+
+void ToggleConvergence(void);
+
+int ConvergenceHeatLevel(_In_ DWORD Seconds);
+
+BOOL KccKeyDown(_In_ UINT VirtualKey);
+
+void RecordKccConnections(_Inout_ struct RENDER_LIST* List);
+
+void DrawKccStatus(_In_ int Top);
+
+void StepTimeline(_In_ int Step);
+
+void FormatDuration(_In_ DWORD Seconds, _Out_ wchar_t* Text, _In_ size_t Length);
+
 DWORD WINAPI DiscoveryThreadProc(_In_ LPVOID lpParameter);
 
+DWORD DiscoverTopology(void);
+
+int GdiMeasureText(_In_ wchar_t* Text, _In_ int Length);
+
+void GdiLabelFont(_In_ HDC DeviceContext, _In_ HFONT Font, _Out_ struct LABEL_FONT* LabelFont);
+
+wchar_t* DCLabelText(_In_ ENTITY* DC, _Out_ wchar_t* Guess, _In_ size_t Length);
+
 ENTITY* NewEntity(void);
 
 //DWORD Load32BppBitmapFromFile(_In_ wchar_t* FileName, _Inout_ ADTVBITMAP* Bitmap);
\ No newline at end of file
@@ -0,0 +1,266 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Mouse picking. See Pick.h.
+
+#include <Windows.h>
+
+#include <stdlib.h>
+
+#include "Main.h"
+
+#include "Pick.h"
+
+
+
+static int __cdecl PickCompareX(_In_ const void* A, _In_ const void* B)
+{
+	LONG CenterA = ((PICK_ITEM*)A)->Bounds.left + ((PICK_ITEM*)A)->Bounds.right;
+
+	LONG CenterB = ((PICK_ITEM*)B)->Bounds.left + ((PICK_ITEM*)B)->Bounds.right;
+
+	return((CenterA > CenterB) - (CenterA < CenterB));
+}
+
+static int __cdecl PickCompareY(_In_ const void* A, _In_ const void* B)
+{
+	LONG CenterA = ((PICK_ITEM*)A)->Bounds.top + ((PICK_ITEM*)A)->Bounds.bottom;
+
+	LONG CenterB = ((PICK_ITEM*)B)->Bounds.top + ((PICK_ITEM*)B)->Bounds.bottom;
+
+	return((CenterA > CenterB) - (CenterA < CenterB));
+}
+
+// Builds the subtree for Items[First] up to Items[First + Count], splitting at the median along whichever axis the
+// items are spread out along most. Returns the index of the subtree's root node.
+
+static DWORD PickBuildNode(_Inout_ PICKINDEX* Index, _In_ DWORD First, _In_ DWORD Count)
+{
+	DWORD NodeIndex = Index->NodeCount++;
+
+	PICK_NODE* Node = &Index->Nodes[NodeIndex];
+
+	RECT Centers = { MAXLONG, MAXLONG, MINLONG, MINLONG };
+
+	Node->Bounds = Index->Items[First].Bounds;
+
+	for (DWORD Item = First; Item < First + Count; Item++)
+	{
+		RECT* Bounds = &Index->Items[Item].Bounds;
+
+		UnionRect(&Node->Bounds, &Node->Bounds, Bounds);
+
+		Centers.left = min(Centers.left, (Bounds->left + Bounds->right) / 2);
+
+		Centers.right = max(Centers.right, (Bounds->left + Bounds->right) / 2);
+
+		Centers.top = min(Centers.top, (Bounds->top + Bounds->bottom) / 2);
+
+		Centers.bottom = max(Centers.bottom, (Bounds->top + Bounds->bottom) / 2);
+	}
+
+	if (Count <= PICK_LEAF_ITEMS)
+	{
+		Node->First = First;
+
+		Node->Count = Count;
+
+		return(NodeIndex);
+	}
+
+	qsort(&Index->Items[First], Count, sizeof(PICK_ITEM), (Centers.right - Centers.left >= Centers.bottom - Centers.top) ? PickCompareX : PickCompareY);
+
+	Node->Count = 0;
+
+	// The left child always comes straight after its parent, so only the right one needs remembering. Nodes is
+	// allocated up front, so Node stays valid while the children are built.
+
+	PickBuildNode(Index, First, Count / 2);
+
+	Node->Right = PickBuildNode(Index, First + (Count / 2), Count - (Count / 2));
+
+	return(NodeIndex);
+}
+
+PICKINDEX* BuildPickIndex(_In_ ENTITY* Entities)
+{
+	PICKINDEX* Index = NULL;
+
+	DWORD Count = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if ((Current->Type == ET_SITE || Current->Type == ET_DC) && Current->width > 0 && Current->height > 0)
+		{
+			Count++;
+		}
+	}
+
+	if ((Index = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(PICKINDEX))) == NULL)
+	{
+		goto Failed;
+	}
+
+	if (Count == 0)
+	{
+		return(Index);
+	}
+
+	// A binary tree with leaves of at least one item has fewer than twice as many nodes as items.
+
+	Index->Items = HeapAlloc(GetProcessHeap(), 0, Count * sizeof(PICK_ITEM));
+
+	Index->Nodes = HeapAlloc(GetProcessHeap(), 0, Count * 2 * sizeof(PICK_NODE));
+
+	if (Index->Items == NULL || Index->Nodes == NULL)
+	{
+		goto Failed;
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if ((Current->Type == ET_SITE || Current->Type == ET_DC) && Current->width > 0 && Current->height > 0)
+		{
+			PICK_ITEM* Item = &Index->Items[Index->ItemCount++];
+
+			SetRect(&Item->Bounds, Current->x, Current->y, Current->x + Current->width, Current->y + Current->height);
+
+			Item->Entity = Current;
+		}
+	}
+
+	PickBuildNode(Index, 0, Index->ItemCount);
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Pick index has %lu entities in %lu nodes.", __FUNCTIONW__, Index->ItemCount, Index->NodeCount);
+
+	return(Index);
+
+Failed:
+
+	LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+	FreePickIndex(Index);
+
+	return(NULL);
+}
+
+void FreePickIndex(_In_opt_ PICKINDEX* Index)
+{
+	if (Index == NULL)
+	{
+		return;
+	}
+
+	if (Index->Items)
+	{
+		HeapFree(GetProcessHeap(), 0, Index->Items);
+	}
+
+	if (Index->Nodes)
+	{
+		HeapFree(GetProcessHeap(), 0, Index->Nodes);
+	}
+
+	HeapFree(GetProcessHeap(), 0, Index);
+}
+
+// Returns the entity under a point in world coordinates, or NULL. DCs sit inside their sites, so when more than one
+// entity contains the point, the smallest one wins.
+
+ENTITY* PickEntity(_In_opt_ PICKINDEX* Index, _In_ POINT World)
+{
+	DWORD Stack[PICK_MAX_DEPTH] = { 0 };
+
+	int StackSize = 0;
+
+	ENTITY* Best = NULL;
+
+	INT64 BestArea = MAXLONGLONG;
+
+	if (Index == NULL || Index->NodeCount == 0)
+	{
+		return(NULL);
+	}
+
+	Stack[StackSize++] = 0;
+
+	while (StackSize > 0)
+	{
+		PICK_NODE* Node = &Index->Nodes[Stack[--StackSize]];
+
+		if (PtInRect(&Node->Bounds, World) == FALSE)
+		{
+			continue;
+		}
+
+		if (Node->Count > 0)
+		{
+			for (DWORD Item = Node->First; Item < Node->First + Node->Count; Item++)
+			{
+				RECT* Bounds = &Index->Items[Item].Bounds;
+
+				INT64 Area = (INT64)(Bounds->right - Bounds->left) * (Bounds->bottom - Bounds->top);
+
+				if (Area < BestArea && PtInRect(Bounds, World))
+				{
+					Best = Index->Items[Item].Entity;
+
+					BestArea = Area;
+				}
+			}
+		}
+		else if (StackSize + 2 <= PICK_MAX_DEPTH)
+		{
+			Stack[StackSize++] = Node->Right;
+
+			Stack[StackSize++] = (DWORD)(Node - Index->Nodes) + 1;
+		}
+	}
+
+	return(Best);
+}
+
+// Calls Visit for every site and DC whose world rectangle overlaps World, in no particular order.
+
+void VisitPickItems(_In_opt_ PICKINDEX* Index, _In_ RECT* World, _In_ PICK_VISIT_PROC Visit, _In_ void* Context)
+{
+	DWORD Stack[PICK_MAX_DEPTH] = { 0 };
+
+	int StackSize = 0;
+
+	RECT Overlap = { 0 };
+
+	if (Index == NULL || Index->NodeCount == 0)
+	{
+		return;
+	}
+
+	Stack[StackSize++] = 0;
+
+	while (StackSize > 0)
+	{
+		PICK_NODE* Node = &Index->Nodes[Stack[--StackSize]];
+
+		if (IntersectRect(&Overlap, &Node->Bounds, World) == FALSE)
+		{
+			continue;
+		}
+
+		if (Node->Count > 0)
+		{
+			for (DWORD Item = Node->First; Item < Node->First + Node->Count; Item++)
+			{
+				if (IntersectRect(&Overlap, &Index->Items[Item].Bounds, World))
+				{
+					Visit(&Index->Items[Item], Context);
+				}
+			}
+		}
+		else if (StackSize + 2 <= PICK_MAX_DEPTH)
+		{
+			Stack[StackSize++] = Node->Right;
+
+			Stack[StackSize++] = (DWORD)(Node - Index->Nodes) + 1;
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Bounding volume hierarchy over the world rectangles of every site and DC, for finding what's under the mouse, and
+// what's in a tile, without walking the entity list.
+
+#define PICK_LEAF_ITEMS		4
+
+#define PICK_MAX_DEPTH		64
+
+typedef struct PICK_ITEM
+{
+	RECT Bounds;
+
+	ENTITY* Entity;
+
+} PICK_ITEM;
+
+typedef struct PICK_NODE
+{
+	RECT Bounds;
+
+	// Leaves have Count > 0 and own Items[First] up to Items[First + Count]. Inner nodes have Count == 0; their left
+	// child is the next node in the array and their right child is Nodes[Right].
+	DWORD First;
+
+	DWORD Count;
+
+	DWORD Right;
+
+} PICK_NODE;
+
+typedef struct PICKINDEX
+{
+	DWORD ItemCount;
+
+	PICK_ITEM* Items;
+
+	DWORD NodeCount;
+
+	PICK_NODE* Nodes;
+
+} PICKINDEX;
+
+// Called by VisitPickItems for each item it finds.
+typedef void(*PICK_VISIT_PROC)(_In_ PICK_ITEM* Item, _In_ void* Context);
+
+PICKINDEX* BuildPickIndex(_In_ ENTITY* Entities);
+
+void FreePickIndex(_In_opt_ PICKINDEX* Index);
+
+ENTITY* PickEntity(_In_opt_ PICKINDEX* Index, _In_ POINT World);
+
+void VisitPickItems(_In_opt_ PICKINDEX* Index, _In_ RECT* World, _In_ PICK_VISIT_PROC Visit, _In_ void* Context);
@@ -0,0 +1,1110 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// DC reachability probes. One thread keeps up to ProbeMaxInFlight non-blocking TCP probes going at once against the
+// LDAP, GC and Kerberos ports of every discovered DC, all multiplexed through a single WSAPoll call. LDAP and GC probes
+// send an anonymous bind and wait for the answer, so they measure a real round trip through the directory service and
+// not just the TCP stack. Kerberos probes only measure the connect.
+//
+// Latencies go into a fixed-size HDR-style histogram per DC per port, so memory doesn't grow no matter how long we run.
+//
+// With the ProbeStandIn registry setting, every probe goes to local listeners instead of the real DCs. The listeners
+// reply after random delays, sometimes drop or never answer, and a few "DCs" refuse every connection, so the whole
+// engine can be exercised without a forest.
+
+#include <WinSock2.h>
+
+#include <WS2tcpip.h>
+
+#include <Windows.h>
+
+#include <stdio.h>
+
+#include "Main.h"
+
+#include "Probe.h"
+
+#include "TimeSeries.h"
+
+#pragma comment(lib, "Ws2_32.lib")
+
+
+
+typedef enum PROBE_SLOT_STATE
+{
+	PSS_CONNECTING,
+
+	PSS_AWAITING_REPLY
+
+} PROBE_SLOT_STATE;
+
+typedef enum PROBE_RESOLVE_STATE
+{
+	PRS_UNRESOLVED,
+
+	PRS_RESOLVING,
+
+	PRS_RESOLVED,
+
+	PRS_FAILED
+
+} PROBE_RESOLVE_STATE;
+
+typedef struct PROBE_TARGET
+{
+	ENTITY* DC;
+
+	volatile LONG ResolveState;
+
+	SOCKADDR_STORAGE Address;
+
+	int AddressLength;
+
+} PROBE_TARGET;
+
+typedef struct PROBE_SLOT
+{
+	SOCKET Socket;
+
+	PROBE_TARGET* Target;
+
+	PROBE_PORT Port;
+
+	PROBE_SLOT_STATE State;
+
+	LARGE_INTEGER Start;
+
+	UINT64 Deadline;
+
+} PROBE_SLOT;
+
+typedef struct STANDIN_CONNECTION
+{
+	SOCKET Socket;
+
+	PROBE_PORT Port;
+
+	UINT64 ReplyAt;
+
+	UINT64 CloseAt;
+
+	BOOL Replied;
+
+} STANDIN_CONNECTION;
+
+static const USHORT gProbePorts[PP_COUNT] = { 389, 3268, 88 };
+
+// An anonymous LDAPv3 simple bind: SEQUENCE { messageID 1, [APPLICATION 0] { version 3, name "", simple "" } }
+static const char gLdapAnonymousBind[] = { 0x30, 0x0C, 0x02, 0x01, 0x01, 0x60, 0x07, 0x02, 0x01, 0x03, 0x04, 0x00, (char)0x80, 0x00 };
+
+// A successful bindResponse to the above
+static const char gLdapBindResponse[] = { 0x30, 0x0C, 0x02, 0x01, 0x01, 0x61, 0x07, 0x0A, 0x01, 0x00, 0x04, 0x00, 0x04, 0x00 };
+
+static HANDLE gProbeThread;
+
+static HANDLE gProbeStopEvent;
+
+// Whether StartProbeEngine's WSAStartup succeeded, so StopProbeEngine knows to match it.
+static BOOL gProbeWinsockStarted;
+
+static PROBE_TARGET* gProbeTargets;
+
+static PROBESTATS* gProbeStats;
+
+static DWORD gProbeTargetCount;
+
+static volatile LONG gProbeResolvesInFlight;
+
+static HANDLE gStandInThread;
+
+static SOCKET gStandInListeners[PP_COUNT] = { INVALID_SOCKET, INVALID_SOCKET, INVALID_SOCKET };
+
+static USHORT gStandInPorts[PP_COUNT];
+
+// Bound but never listening, so connecting to it is refused. Used to play dead DCs.
+static SOCKET gStandInRefuser = INVALID_SOCKET;
+
+static USHORT gStandInRefuserPort;
+
+
+
+static DWORD HistogramIndex(_In_ UINT64 Microseconds)
+{
+	unsigned long Magnitude = 0;
+
+	if (Microseconds >= (1ULL << PROBE_HISTOGRAM_MAX_BITS))
+	{
+		Microseconds = (1ULL << PROBE_HISTOGRAM_MAX_BITS) - 1;
+	}
+
+	if (Microseconds < PROBE_HISTOGRAM_SUB_BUCKETS)
+	{
+		return((DWORD)Microseconds);
+	}
+
+	_BitScanReverse64(&Magnitude, Microseconds);
+
+	return((PROBE_HISTOGRAM_SUB_BUCKETS * (Magnitude - PROBE_HISTOGRAM_SUB_BUCKET_BITS)) + (DWORD)(Microseconds >> (Magnitude - PROBE_HISTOGRAM_SUB_BUCKET_BITS)));
+}
+
+void HistogramRecord(_Inout_ PROBE_HISTOGRAM* Histogram, _In_ UINT64 Microseconds)
+{
+	DWORD Index = HistogramIndex(Microseconds);
+
+	if (Microseconds >= (1ULL << PROBE_HISTOGRAM_MAX_BITS))
+	{
+		Microseconds = (1ULL << PROBE_HISTOGRAM_MAX_BITS) - 1;
+	}
+
+	if (Histogram->Counts[Index] == 0xFFFF)
+	{
+		// Halve everything rather than grow; old samples fade out and the shape of the distribution is kept.
+
+		Histogram->TotalCount = 0;
+
+		for (DWORD Bucket = 0; Bucket < PROBE_HISTOGRAM_BUCKETS; Bucket++)
+		{
+			Histogram->Counts[Bucket] /= 2;
+
+			Histogram->TotalCount += Histogram->Counts[Bucket];
+		}
+	}
+
+	Histogram->Counts[Index]++;
+
+	Histogram->TotalCount++;
+
+	if (Microseconds > Histogram->MaxMicroseconds)
+	{
+		Histogram->MaxMicroseconds = (UINT32)Microseconds;
+	}
+}
+
+// Takes back a value recorded earlier, for callers that keep a rolling window. MaxMicroseconds is left alone, so such
+// callers should track their own maximum.
+
+void HistogramRemove(_Inout_ PROBE_HISTOGRAM* Histogram, _In_ UINT64 Microseconds)
+{
+	DWORD Index = HistogramIndex(Microseconds);
+
+	if (Histogram->Counts[Index] > 0)
+	{
+		Histogram->Counts[Index]--;
+
+		Histogram->TotalCount--;
+	}
+}
+
+static UINT32 HistogramBucketMidpoint(_In_ DWORD Index)
+{
+	DWORD Shift = 0;
+
+	UINT32 Lowest = 0;
+
+	if (Index < PROBE_HISTOGRAM_SUB_BUCKETS)
+	{
+		return(Index);
+	}
+
+	Shift = (Index / PROBE_HISTOGRAM_SUB_BUCKETS) - 1;
+
+	Lowest = ((Index % PROBE_HISTOGRAM_SUB_BUCKETS) + PROBE_HISTOGRAM_SUB_BUCKETS) << Shift;
+
+	return(Lowest + ((1U << Shift) / 2));
+}
+
+UINT32 HistogramPercentile(_In_ PROBE_HISTOGRAM* Histogram, _In_ double Percentile)
+{
+	UINT64 Rank = 0;
+
+	UINT64 Seen = 0;
+
+	if (Histogram->TotalCount == 0)
+	{
+		return(0);
+	}
+
+	Rank = (UINT64)((Percentile / 100.0) * Histogram->TotalCount + 0.5);
+
+	Rank = max(Rank, 1);
+
+	for (DWORD Index = 0; Index < PROBE_HISTOGRAM_BUCKETS; Index++)
+	{
+		Seen += Histogram->Counts[Index];
+
+		if (Seen >= Rank)
+		{
+			return(min(HistogramBucketMidpoint(Index), Histogram->MaxMicroseconds));
+		}
+	}
+
+	return(Histogram->MaxMicroseconds);
+}
+
+PROBE_COLOR GetProbeColor(_In_ ENTITY* DC, _In_ PROBE_PORT Port)
+{
+	PROBESTATS* Stats = DC->ProbeStats;
+
+	DWORD Percentile = 0;
+
+	if (Stats == NULL || (Stats->Successes[Port] == 0 && Stats->Failures[Port] == 0))
+	{
+		return(PC_NO_DATA);
+	}
+
+	if (Stats->ConsecutiveFailures[Port] >= 2 || Stats->Successes[Port] == 0)
+	{
+		return(PC_DOWN);
+	}
+
+	Percentile = Stats->PercentileMicroseconds[Port];
+
+	if (Percentile < 5000)
+	{
+		return(PC_FAST);
+	}
+	else if (Percentile < 20000)
+	{
+		return(PC_OK);
+	}
+	else if (Percentile < 100000)
+	{
+		return(PC_SLOW);
+	}
+
+	return(PC_VERY_SLOW);
+}
+
+static void ProbeRecordResult(_In_ PROBE_TARGET* Target, _In_ PROBE_PORT Port, _In_ BOOL Success, _In_ UINT64 Microseconds, _In_ DWORD Error)
+{
+	PROBESTATS* Stats = Target->DC->ProbeStats;
+
+	if (Success)
+	{
+		HistogramRecord(&Stats->Histograms[Port], Microseconds);
+
+		Stats->PercentileMicroseconds[Port] = HistogramPercentile(&Stats->Histograms[Port], PROBE_COLOR_PERCENTILE);
+
+		Stats->Successes[Port]++;
+
+		Stats->ConsecutiveFailures[Port] = 0;
+
+		Stats->LastError[Port] = ERROR_SUCCESS;
+
+		RecordTimeSeries(Target->DC, (TIMESERIES_METRIC)(TSM_LDAP_LATENCY + Port), TimeSeriesNow(), (UINT32)min(Microseconds, MAXDWORD - 1));
+	}
+	else
+	{
+		Stats->Failures[Port]++;
+
+		Stats->ConsecutiveFailures[Port]++;
+
+		Stats->LastError[Port] = Error;
+	}
+}
+
+static void ProbeCloseSocket(_In_ SOCKET Socket)
+{
+	// Abortive close. We open thousands of short connections a minute; a graceful close would leave every one of them
+	// in TIME_WAIT and we'd run out of ephemeral ports long before the DCs noticed anything.
+
+	struct linger Linger = { .l_onoff = 1, .l_linger = 0 };
+
+	setsockopt(Socket, SOL_SOCKET, SO_LINGER, (char*)&Linger, sizeof(Linger));
+
+	closesocket(Socket);
+}
+
+static void CALLBACK ProbeResolveCallback(_Inout_ PTP_CALLBACK_INSTANCE Instance, _Inout_opt_ PVOID Context)
+{
+	UNREFERENCED_PARAMETER(Instance);
+
+	PROBE_TARGET* Target = Context;
+
+	ADDRINFOW Hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_protocol = IPPROTO_TCP };
+
+	ADDRINFOW* AddressInfo = NULL;
+
+	LONG NewState = PRS_FAILED;
+
+	if (GetAddrInfoW(Target->DC->fqdn, NULL, &Hints, &AddressInfo) == 0 && AddressInfo != NULL)
+	{
+		memcpy(&Target->Address, AddressInfo->ai_addr, AddressInfo->ai_addrlen);
+
+		Target->AddressLength = (int)AddressInfo->ai_addrlen;
+
+		NewState = PRS_RESOLVED;
+	}
+
+	if (AddressInfo)
+	{
+		FreeAddrInfoW(AddressInfo);
+	}
+
+	InterlockedExchange(&Target->ResolveState, NewState);
+
+	InterlockedDecrement(&gProbeResolvesInFlight);
+}
+
+static BOOL ProbeStart(_In_ PROBE_TARGET* Target, _In_ PROBE_PORT Port, _Out_ PROBE_SLOT* Slot, _Out_ DWORD* Error)
+{
+	SOCKADDR_STORAGE Address = Target->Address;
+
+	int AddressLength = Target->AddressLength;
+
+	u_long NonBlocking = 1;
+
+	USHORT PortNumber = gProbePorts[Port];
+
+	*Error = ERROR_SUCCESS;
+
+	if (gRegParams.ProbeStandIn)
+	{
+		// Every tenth "DC" is dead and refuses everything, the rest go to the stand-in listeners.
+
+		SOCKADDR_IN* Loopback = (SOCKADDR_IN*)&Address;
+
+		memset(&Address, 0, sizeof(Address));
+
+		Loopback->sin_family = AF_INET;
+
+		Loopback->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		AddressLength = sizeof(SOCKADDR_IN);
+
+		PortNumber = ((DWORD)(Target - gProbeTargets) % 10 == 7) ? gStandInRefuserPort : gStandInPorts[Port];
+	}
+
+	if (Address.ss_family == AF_INET6)
+	{
+		((SOCKADDR_IN6*)&Address)->sin6_port = htons(PortNumber);
+	}
+	else
+	{
+		((SOCKADDR_IN*)&Address)->sin_port = htons(PortNumber);
+	}
+
+	Slot->Target = Target;
+
+	Slot->Port = Port;
+
+	Slot->State = PSS_CONNECTING;
+
+	Slot->Deadline = GetTickCount64() + gRegParams.ProbeTimeoutMs;
+
+	if ((Slot->Socket = socket(Address.ss_family, SOCK_STREAM, IPPROTO_TCP)) == INVALID_SOCKET)
+	{
+		*Error = WSAGetLastError();
+
+		return(FALSE);
+	}
+
+	ioctlsocket(Slot->Socket, FIONBIO, &NonBlocking);
+
+	QueryPerformanceCounter(&Slot->Start);
+
+	if (connect(Slot->Socket, (SOCKADDR*)&Address, AddressLength) == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK)
+	{
+		*Error = WSAGetLastError();
+
+		ProbeCloseSocket(Slot->Socket);
+
+		return(FALSE);
+	}
+
+	return(TRUE);
+}
+
+static UINT64 ProbeElapsedMicroseconds(_In_ PROBE_SLOT* Slot)
+{
+	LARGE_INTEGER Now = { 0 };
+
+	QueryPerformanceCounter(&Now);
+
+	return(((Now.QuadPart - Slot->Start.QuadPart) * 1000000) / gGraphicsData.PerformanceFrequency.QuadPart);
+}
+
+static DWORD WINAPI ProbeThreadProc(_In_ LPVOID lpParameter)
+{
+	UNREFERENCED_PARAMETER(lpParameter);
+
+	DWORD MaxInFlight = gRegParams.ProbeMaxInFlight;
+
+	// Slots and PollFds are kept parallel and packed; a finished probe is swapped with the last one.
+	PROBE_SLOT* Slots = NULL;
+
+	WSAPOLLFD* PollFds = NULL;
+
+	DWORD ActiveCount = 0;
+
+	DWORD TotalProbes = gProbeTargetCount * PP_COUNT;
+
+	DWORD Cursor = 0;
+
+	DWORD ResolveCursor = 0;
+
+	UINT64 RoundStart = GetTickCount64();
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Probe thread beginning. %d DCs, %d in flight, %ds interval%s.",
+		__FUNCTIONW__,
+		gProbeTargetCount,
+		MaxInFlight,
+		gRegParams.ProbeIntervalSeconds,
+		gRegParams.ProbeStandIn ? L", using stand-in listeners" : L"");
+
+	Slots = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(PROBE_SLOT) * MaxInFlight);
+
+	PollFds = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(WSAPOLLFD) * MaxInFlight);
+
+	if (Slots == NULL || PollFds == NULL)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	while (gContinue && WaitForSingleObject(gProbeStopEvent, 0) != WAIT_OBJECT_0)
+	{
+		UINT64 Now = GetTickCount64();
+
+		// 1. Start a new round once the previous one has been fully dispatched and the interval has passed.
+
+		if (Cursor >= TotalProbes && Now >= RoundStart + ((UINT64)gRegParams.ProbeIntervalSeconds * 1000))
+		{
+			Cursor = 0;
+
+			ResolveCursor = 0;
+
+			RoundStart = Now;
+		}
+
+		// 2. Keep name resolution going independently of the probes. Resolving blocks, so it happens on the thread pool,
+		// a few at a time. DCs that failed to resolve get another try every round.
+
+		while (gRegParams.ProbeStandIn == FALSE && ResolveCursor < gProbeTargetCount && gProbeResolvesInFlight < PROBE_MAX_RESOLVES_IN_FLIGHT)
+		{
+			PROBE_TARGET* Target = &gProbeTargets[ResolveCursor++];
+
+			if ((Target->ResolveState != PRS_UNRESOLVED && Target->ResolveState != PRS_FAILED) || wcslen(Target->DC->fqdn) == 0)
+			{
+				continue;
+			}
+
+			InterlockedIncrement(&gProbeResolvesInFlight);
+
+			InterlockedExchange(&Target->ResolveState, PRS_RESOLVING);
+
+			if (TrySubmitThreadpoolCallback(ProbeResolveCallback, Target, NULL) == FALSE)
+			{
+				InterlockedExchange(&Target->ResolveState, PRS_UNRESOLVED);
+
+				InterlockedDecrement(&gProbeResolvesInFlight);
+
+				break;
+			}
+		}
+
+		// 3. Dispatch as many probes as there are free slots. DCs that aren't resolved yet are simply skipped this round.
+
+		while (Cursor < TotalProbes && ActiveCount < MaxInFlight)
+		{
+			PROBE_TARGET* Target = &gProbeTargets[Cursor / PP_COUNT];
+
+			PROBE_PORT Port = Cursor % PP_COUNT;
+
+			DWORD Error = ERROR_SUCCESS;
+
+			LONG ResolveState = gRegParams.ProbeStandIn ? PRS_RESOLVED : Target->ResolveState;
+
+			Cursor++;
+
+			if (ResolveState == PRS_FAILED)
+			{
+				ProbeRecordResult(Target, Port, FALSE, 0, WSAHOST_NOT_FOUND);
+
+				continue;
+			}
+
+			if (ResolveState != PRS_RESOLVED)
+			{
+				continue;
+			}
+
+			if (ProbeStart(Target, Port, &Slots[ActiveCount], &Error))
+			{
+				PollFds[ActiveCount].fd = Slots[ActiveCount].Socket;
+
+				PollFds[ActiveCount].events = POLLWRNORM;
+
+				PollFds[ActiveCount].revents = 0;
+
+				ActiveCount++;
+			}
+			else
+			{
+				ProbeRecordResult(Target, Port, FALSE, 0, Error);
+			}
+		}
+
+		// 4. Wait for something to happen.
+
+		if (ActiveCount == 0)
+		{
+			WaitForSingleObject(gProbeStopEvent, PROBE_POLL_MS);
+
+			continue;
+		}
+
+		if (WSAPoll(PollFds, ActiveCount, PROBE_POLL_MS) == SOCKET_ERROR)
+		{
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] WSAPoll failed with 0x%08lx!", __FUNCTIONW__, WSAGetLastError());
+
+			Sleep(PROBE_POLL_MS);
+		}
+
+		Now = GetTickCount64();
+
+		// 5. Move every probe along. Note that before Windows 10 2004, WSAPoll does not report a failed connect at all,
+		// so the deadline is what catches refused connections on older systems.
+
+		for (DWORD Index = 0; Index < ActiveCount; )
+		{
+			PROBE_SLOT* Slot = &Slots[Index];
+
+			WSAPOLLFD* PollFd = &PollFds[Index];
+
+			BOOL Finished = FALSE;
+
+			BOOL Success = FALSE;
+
+			DWORD Error = ERROR_SUCCESS;
+
+			if (PollFd->revents & (POLLERR | POLLHUP | POLLNVAL))
+			{
+				int ErrorLength = sizeof(Error);
+
+				getsockopt(Slot->Socket, SOL_SOCKET, SO_ERROR, (char*)&Error, &ErrorLength);
+
+				Error = Error ? Error : WSAECONNRESET;
+
+				Finished = TRUE;
+			}
+			else if (Slot->State == PSS_CONNECTING && (PollFd->revents & POLLWRNORM))
+			{
+				if (Slot->Port == PP_KERBEROS)
+				{
+					Success = TRUE;
+
+					Finished = TRUE;
+				}
+				else if (send(Slot->Socket, gLdapAnonymousBind, sizeof(gLdapAnonymousBind), 0) == sizeof(gLdapAnonymousBind))
+				{
+					Slot->State = PSS_AWAITING_REPLY;
+
+					PollFd->events = POLLRDNORM;
+				}
+				else
+				{
+					Error = WSAGetLastError();
+
+					Finished = TRUE;
+				}
+			}
+			else if (Slot->State == PSS_AWAITING_REPLY && (PollFd->revents & POLLRDNORM))
+			{
+				char Reply[64] = { 0 };
+
+				int Received = recv(Slot->Socket, Reply, sizeof(Reply), 0);
+
+				// Any LDAPMessage at all means the directory service is alive and answering. Even a bind refusal counts.
+
+				Success = (Received > 0 && (unsigned char)Reply[0] == 0x30);
+
+				Error = Success ? ERROR_SUCCESS : (Received < 0 ? WSAGetLastError() : ERROR_INVALID_DATA);
+
+				Finished = TRUE;
+			}
+			else if (Now >= Slot->Deadline)
+			{
+				Error = ERROR_TIMEOUT;
+
+				Finished = TRUE;
+			}
+
+			PollFd->revents = 0;
+
+			if (Finished == FALSE)
+			{
+				Index++;
+
+				continue;
+			}
+
+			ProbeRecordResult(Slot->Target, Slot->Port, Success, Success ? ProbeElapsedMicroseconds(Slot) : 0, Error);
+
+			ProbeCloseSocket(Slot->Socket);
+
+			ActiveCount--;
+
+			Slots[Index] = Slots[ActiveCount];
+
+			PollFds[Index] = PollFds[ActiveCount];
+		}
+	}
+
+Exit:
+
+	for (DWORD Index = 0; Index < ActiveCount; Index++)
+	{
+		ProbeCloseSocket(Slots[Index].Socket);
+	}
+
+	if (Slots)
+	{
+		HeapFree(GetProcessHeap(), 0, Slots);
+	}
+
+	if (PollFds)
+	{
+		HeapFree(GetProcessHeap(), 0, PollFds);
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Probe thread ending.", __FUNCTIONW__);
+
+	return(ERROR_SUCCESS);
+}
+
+static DWORD WINAPI StandInThreadProc(_In_ LPVOID lpParameter)
+{
+	UNREFERENCED_PARAMETER(lpParameter);
+
+	DWORD MaxConnections = gRegParams.ProbeMaxInFlight + PP_COUNT;
+
+	STANDIN_CONNECTION* Connections = NULL;
+
+	WSAPOLLFD* PollFds = NULL;
+
+	DWORD ConnectionCount = 0;
+
+	UINT64 Random = GetTickCount64() | 1;
+
+	Connections = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(STANDIN_CONNECTION) * MaxConnections);
+
+	PollFds = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(WSAPOLLFD) * MaxConnections);
+
+	if (Connections == NULL || PollFds == NULL)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	// The listeners occupy the first PP_COUNT entries and never move.
+
+	for (DWORD Port = 0; Port < PP_COUNT; Port++)
+	{
+		Connections[Port].Socket = gStandInListeners[Port];
+
+		Connections[Port].Port = Port;
+
+		PollFds[Port].fd = gStandInListeners[Port];
+
+		PollFds[Port].events = POLLRDNORM;
+	}
+
+	ConnectionCount = PP_COUNT;
+
+	while (gContinue && WaitForSingleObject(gProbeStopEvent, 0) != WAIT_OBJECT_0)
+	{
+		UINT64 Now = 0;
+
+		WSAPoll(PollFds, ConnectionCount, PROBE_POLL_MS);
+
+		Now = GetTickCount64();
+
+		for (DWORD Port = 0; Port < PP_COUNT; Port++)
+		{
+			SOCKET Accepted = INVALID_SOCKET;
+
+			if ((PollFds[Port].revents & POLLRDNORM) == 0)
+			{
+				continue;
+			}
+
+			while ((Accepted = accept(gStandInListeners[Port], NULL, NULL)) != INVALID_SOCKET)
+			{
+				STANDIN_CONNECTION* Connection = &Connections[ConnectionCount];
+
+				DWORD Roll = 0;
+
+				u_long NonBlocking = 1;
+
+				Random ^= Random << 13;
+
+				Random ^= Random >> 7;
+
+				Random ^= Random << 17;
+
+				Roll = (DWORD)(Random % 100);
+
+				if (ConnectionCount >= MaxConnections || Roll < 5)
+				{
+					// Fail the probe outright.
+
+					ProbeCloseSocket(Accepted);
+
+					continue;
+				}
+
+				ioctlsocket(Accepted, FIONBIO, &NonBlocking);
+
+				memset(Connection, 0, sizeof(STANDIN_CONNECTION));
+
+				Connection->Socket = Accepted;
+
+				Connection->Port = Port;
+
+				Connection->CloseAt = Now + 10000;
+
+				if (Roll < 10)
+				{
+					// Never answer, the probe should time out.
+
+					Connection->ReplyAt = MAXULONGLONG;
+				}
+				else if (Roll < 25)
+				{
+					// Slow DC.
+
+					Connection->ReplyAt = Now + 200 + (Random >> 8) % 1300;
+				}
+				else
+				{
+					Connection->ReplyAt = Now + (Random >> 8) % 20;
+				}
+
+				PollFds[ConnectionCount].fd = Accepted;
+
+				PollFds[ConnectionCount].events = POLLRDNORM;
+
+				PollFds[ConnectionCount].revents = 0;
+
+				ConnectionCount++;
+			}
+
+			PollFds[Port].revents = 0;
+		}
+
+		for (DWORD Index = PP_COUNT; Index < ConnectionCount; )
+		{
+			STANDIN_CONNECTION* Connection = &Connections[Index];
+
+			BOOL Close = FALSE;
+
+			if (PollFds[Index].revents & (POLLERR | POLLHUP | POLLNVAL))
+			{
+				Close = TRUE;
+			}
+			else if (PollFds[Index].revents & POLLRDNORM)
+			{
+				char Discard[256];
+
+				if (recv(Connection->Socket, Discard, sizeof(Discard), 0) <= 0)
+				{
+					Close = TRUE;
+				}
+			}
+
+			if (Close == FALSE && Connection->Replied == FALSE && Connection->Port != PP_KERBEROS && Now >= Connection->ReplyAt)
+			{
+				send(Connection->Socket, gLdapBindResponse, sizeof(gLdapBindResponse), 0);
+
+				Connection->Replied = TRUE;
+			}
+
+			PollFds[Index].revents = 0;
+
+			if (Close == FALSE && Now < Connection->CloseAt)
+			{
+				Index++;
+
+				continue;
+			}
+
+			ProbeCloseSocket(Connection->Socket);
+
+			ConnectionCount--;
+
+			Connections[Index] = Connections[ConnectionCount];
+
+			PollFds[Index] = PollFds[ConnectionCount];
+		}
+	}
+
+Exit:
+
+	// The listeners are StopProbeEngine's to close, since they're there whether or not this thread ever ran.
+
+	for (DWORD Index = PP_COUNT; Index < ConnectionCount; Index++)
+	{
+		ProbeCloseSocket(Connections[Index].Socket);
+	}
+
+	if (Connections)
+	{
+		HeapFree(GetProcessHeap(), 0, Connections);
+	}
+
+	if (PollFds)
+	{
+		HeapFree(GetProcessHeap(), 0, PollFds);
+	}
+
+	return(ERROR_SUCCESS);
+}
+
+static DWORD StartStandInListeners(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	u_long NonBlocking = 1;
+
+	for (DWORD Port = 0; Port <= PP_COUNT; Port++)
+	{
+		SOCKADDR_IN Address = { .sin_family = AF_INET, .sin_port = 0 };
+
+		int AddressLength = sizeof(Address);
+
+		SOCKET Socket = INVALID_SOCKET;
+
+		Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		if ((Socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == INVALID_SOCKET ||
+			bind(Socket, (SOCKADDR*)&Address, sizeof(Address)) == SOCKET_ERROR ||
+			getsockname(Socket, (SOCKADDR*)&Address, &AddressLength) == SOCKET_ERROR)
+		{
+			Result = WSAGetLastError();
+
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create stand-in listener! Error 0x%08lx", __FUNCTIONW__, Result);
+
+			goto Exit;
+		}
+
+		if (Port == PP_COUNT)
+		{
+			gStandInRefuser = Socket;
+
+			gStandInRefuserPort = ntohs(Address.sin_port);
+
+			break;
+		}
+
+		if (listen(Socket, SOMAXCONN) == SOCKET_ERROR)
+		{
+			Result = WSAGetLastError();
+
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] listen failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+			closesocket(Socket);
+
+			goto Exit;
+		}
+
+		ioctlsocket(Socket, FIONBIO, &NonBlocking);
+
+		gStandInListeners[Port] = Socket;
+
+		gStandInPorts[Port] = ntohs(Address.sin_port);
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Stand-in listeners on 127.0.0.1 ports %d (LDAP), %d (GC), %d (Kerberos), %d (refused).",
+		__FUNCTIONW__,
+		gStandInPorts[PP_LDAP],
+		gStandInPorts[PP_GC],
+		gStandInPorts[PP_KERBEROS],
+		gStandInRefuserPort);
+
+	if ((gStandInThread = CreateThread(NULL, 0, StandInThreadProc, NULL, 0, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create stand-in thread! Error 0x%08lx", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+Exit:
+
+	return(Result);
+}
+
+DWORD StartProbeEngine(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	WSADATA WsaData = { 0 };
+
+	DWORD DCCount = 0;
+
+	if (gRegParams.ProbeIntervalSeconds == 0)
+	{
+		LogEventW(LL_INFO, LF_FILE, L"[%s] ProbeIntervalSeconds is 0, reachability probes are disabled.", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	for (ENTITY* Current = gEntities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			DCCount++;
+		}
+	}
+
+	if (DCCount == 0)
+	{
+		goto Exit;
+	}
+
+	if ((Result = WSAStartup(MAKEWORD(2, 2), &WsaData)) != 0)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] WSAStartup failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	gProbeWinsockStarted = TRUE;
+
+	gProbeTargets = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(PROBE_TARGET) * DCCount);
+
+	gProbeStats = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(PROBESTATS) * DCCount);
+
+	if (gProbeTargets == NULL || gProbeStats == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	for (ENTITY* Current = gEntities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			gProbeTargets[gProbeTargetCount].DC = Current;
+
+			Current->ProbeStats = &gProbeStats[gProbeTargetCount];
+
+			gProbeTargetCount++;
+		}
+	}
+
+	if ((gProbeStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] CreateEventW failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	if (gRegParams.ProbeStandIn && (Result = StartStandInListeners()) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	if ((gProbeThread = CreateThread(NULL, 0, ProbeThreadProc, NULL, 0, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create probe thread! Error 0x%08lx", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+Exit:
+
+	// Discovery carries on without probes, so don't leave the stand-in or Winsock running for nothing.
+
+	if (Result != ERROR_SUCCESS)
+	{
+		StopProbeEngine(PROBE_SHUTDOWN_TIMEOUT_MS);
+	}
+
+	return(Result);
+}
+
+void StopProbeEngine(_In_ DWORD TimeoutMilliseconds)
+{
+	HANDLE Threads[2] = { 0 };
+
+	DWORD ThreadCount = 0;
+
+	if (gProbeStopEvent)
+	{
+		SetEvent(gProbeStopEvent);
+	}
+
+	if (gProbeThread)
+	{
+		Threads[ThreadCount++] = gProbeThread;
+	}
+
+	if (gStandInThread)
+	{
+		Threads[ThreadCount++] = gStandInThread;
+	}
+
+	if (ThreadCount && WaitForMultipleObjects(ThreadCount, Threads, TRUE, TimeoutMilliseconds) != WAIT_OBJECT_0)
+	{
+		// They're still using everything below, so leave it all be.
+
+		LogEventW(LL_WARN, LF_FILE, L"[%s] Probe threads did not stop within %dms.", __FUNCTIONW__, TimeoutMilliseconds);
+
+		return;
+	}
+
+	for (DWORD Thread = 0; Thread < ThreadCount; Thread++)
+	{
+		CloseHandle(Threads[Thread]);
+	}
+
+	gProbeThread = NULL;
+
+	gStandInThread = NULL;
+
+	if (gProbeStopEvent)
+	{
+		CloseHandle(gProbeStopEvent);
+
+		gProbeStopEvent = NULL;
+	}
+
+	for (DWORD Port = 0; Port < PP_COUNT; Port++)
+	{
+		if (gStandInListeners[Port] != INVALID_SOCKET)
+		{
+			closesocket(gStandInListeners[Port]);
+
+			gStandInListeners[Port] = INVALID_SOCKET;
+		}
+	}
+
+	if (gStandInRefuser != INVALID_SOCKET)
+	{
+		closesocket(gStandInRefuser);
+
+		gStandInRefuser = INVALID_SOCKET;
+	}
+
+	// A name lookup still running on the thread pool would fail if Winsock went away under it. That only happens when
+	// a DC's DNS is slow at exit, and the process is going away then anyway.
+
+	if (gProbeWinsockStarted && gProbeResolvesInFlight == 0)
+	{
+		WSACleanup();
+
+		gProbeWinsockStarted = FALSE;
+	}
+}
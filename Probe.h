@@ -0,0 +1,98 @@
+#pragma once
+
+#define PROBE_DEF_INTERVAL_SECONDS	30
+
+#define PROBE_DEF_MAX_IN_FLIGHT		1024
+
+#define PROBE_DEF_TIMEOUT_MS		2000
+
+// WSAPoll is given at most this long to wait, so new probes get started promptly even when nothing is happening.
+#define PROBE_POLL_MS				10
+
+// How many fqdns may be resolving in the thread pool at once.
+#define PROBE_MAX_RESOLVES_IN_FLIGHT	32
+
+#define PROBE_SHUTDOWN_TIMEOUT_MS	2000
+
+// HDR-style histogram: every power of two is split into 2^PROBE_HISTOGRAM_SUB_BUCKET_BITS linear sub-buckets, which keeps
+// the relative error of any recorded value under ~6% while using a fixed, small amount of memory per DC per port.
+#define PROBE_HISTOGRAM_SUB_BUCKET_BITS	4
+
+#define PROBE_HISTOGRAM_SUB_BUCKETS		(1 << PROBE_HISTOGRAM_SUB_BUCKET_BITS)
+
+// Values are in microseconds; anything at or above 2^PROBE_HISTOGRAM_MAX_BITS (~16.7 seconds) lands in the last bucket.
+#define PROBE_HISTOGRAM_MAX_BITS		24
+
+#define PROBE_HISTOGRAM_BUCKETS		(PROBE_HISTOGRAM_SUB_BUCKETS * (PROBE_HISTOGRAM_MAX_BITS - PROBE_HISTOGRAM_SUB_BUCKET_BITS + 1))
+
+// DC triangles are coloured by this percentile when in one of the latency colour modes.
+#define PROBE_COLOR_PERCENTILE		95
+
+typedef enum PROBE_PORT
+{
+	PP_LDAP,
+
+	PP_GC,
+
+	PP_KERBEROS,
+
+	PP_COUNT
+
+} PROBE_PORT;
+
+typedef struct PROBE_HISTOGRAM
+{
+	UINT16 Counts[PROBE_HISTOGRAM_BUCKETS];
+
+	UINT32 TotalCount;
+
+	UINT32 MaxMicroseconds;
+
+} PROBE_HISTOGRAM;
+
+typedef struct PROBESTATS
+{
+	PROBE_HISTOGRAM Histograms[PP_COUNT];
+
+	// Cached by the probe thread after every result, so the renderer never has to walk a histogram.
+	volatile DWORD PercentileMicroseconds[PP_COUNT];
+
+	volatile DWORD Successes[PP_COUNT];
+
+	volatile DWORD Failures[PP_COUNT];
+
+	volatile DWORD ConsecutiveFailures[PP_COUNT];
+
+	volatile DWORD LastError[PP_COUNT];
+
+} PROBESTATS;
+
+typedef enum PROBE_COLOR
+{
+	PC_NO_DATA,
+
+	PC_FAST,
+
+	PC_OK,
+
+	PC_SLOW,
+
+	PC_VERY_SLOW,
+
+	PC_DOWN,
+
+	PC_COUNT
+
+} PROBE_COLOR;
+
+DWORD StartProbeEngine(void);
+
+void StopProbeEngine(_In_ DWORD TimeoutMilliseconds);
+
+PROBE_COLOR GetProbeColor(_In_ ENTITY* DC, _In_ PROBE_PORT Port);
+
+void HistogramRecord(_Inout_ PROBE_HISTOGRAM* Histogram, _In_ UINT64 Microseconds);
+
+void HistogramRemove(_Inout_ PROBE_HISTOGRAM* Histogram, _In_ UINT64 Microseconds);
+
+UINT32 HistogramPercentile(_In_ PROBE_HISTOGRAM* Histogram, _In_ double Percentile);
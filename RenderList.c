@@ -0,0 +1,461 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Recorded render command lists and the GDI backend that plays them. See RenderList.h.
+
+#include <Windows.h>
+
+#include <stdlib.h>
+
+#include "Main.h"
+
+#include "RenderList.h"
+
+
+
+// Which command selects each kind of resource.
+static const RENDER_OP gRenderSelectOps[RRK_COUNT] = { RO_PEN, RO_BRUSH, RO_FONT };
+
+
+
+RENDER_LIST* CreateRenderList(void)
+{
+	RENDER_LIST* List = NULL;
+
+	if ((List = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(RENDER_LIST))) == NULL)
+	{
+		return(NULL);
+	}
+
+	if ((List->Words = HeapAlloc(GetProcessHeap(), 0, RENDER_LIST_INITIAL_WORDS * sizeof(UINT32))) == NULL)
+	{
+		HeapFree(GetProcessHeap(), 0, List);
+
+		return(NULL);
+	}
+
+	List->WordCapacity = RENDER_LIST_INITIAL_WORDS;
+
+	ResetRenderList(List, 0, 0);
+
+	return(List);
+}
+
+void FreeRenderList(_In_opt_ RENDER_LIST* List)
+{
+	if (List == NULL)
+	{
+		return;
+	}
+
+	if (List->Words)
+	{
+		HeapFree(GetProcessHeap(), 0, List->Words);
+	}
+
+	HeapFree(GetProcessHeap(), 0, List);
+}
+
+// Empties the list for a new frame. Resources are kept, but none of them count as selected any more.
+
+void ResetRenderList(_Inout_ RENDER_LIST* List, _In_ int Width, _In_ int Height)
+{
+	List->Width = Width;
+
+	List->Height = Height;
+
+	List->CommandCount = 0;
+
+	List->WordCount = 0;
+
+	List->Result = ERROR_SUCCESS;
+
+	for (int Kind = 0; Kind < RRK_COUNT; Kind++)
+	{
+		List->Selected[Kind] = RENDER_NO_RESOURCE;
+	}
+}
+
+// Room for a command of Words words, with its header filled in, or NULL if the list couldn't grow.
+
+static RENDER_HEADER* RenderAllocate(_Inout_ RENDER_LIST* List, _In_ RENDER_OP Op, _In_ DWORD Words)
+{
+	RENDER_HEADER* Header = NULL;
+
+	if (List->Result != ERROR_SUCCESS || Words > MAXWORD)
+	{
+		return(NULL);
+	}
+
+	if (List->WordCount + Words > List->WordCapacity)
+	{
+		DWORD NewCapacity = max(List->WordCapacity * 2, List->WordCount + Words);
+
+		UINT32* NewWords = HeapReAlloc(GetProcessHeap(), 0, List->Words, NewCapacity * sizeof(UINT32));
+
+		if (NewWords == NULL)
+		{
+			List->Result = ERROR_NOT_ENOUGH_MEMORY;
+
+			return(NULL);
+		}
+
+		List->Words = NewWords;
+
+		List->WordCapacity = NewCapacity;
+	}
+
+	Header = (RENDER_HEADER*)&List->Words[List->WordCount];
+
+	Header->Op = (UINT16)Op;
+
+	Header->Words = (UINT16)Words;
+
+	List->WordCount += Words;
+
+	List->CommandCount++;
+
+	return(Header);
+}
+
+// The index of Handle in the resource table, adding it if it's new. RENDER_NO_RESOURCE if the table is full.
+
+static UINT32 RenderResourceIndex(_Inout_ RENDER_LIST* List, _In_ RENDER_RESOURCE_KIND Kind, _In_ HGDIOBJ Handle)
+{
+	RENDER_RESOURCE* Resource = NULL;
+
+	for (DWORD Index = 0; Index < List->ResourceCount; Index++)
+	{
+		if (List->Handles[Index] == Handle)
+		{
+			return(Index);
+		}
+	}
+
+	if (List->ResourceCount == RENDER_MAX_RESOURCES)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] More than %d pens, brushes and fonts!", __FUNCTIONW__, RENDER_MAX_RESOURCES);
+
+		return(RENDER_NO_RESOURCE);
+	}
+
+	Resource = &List->Resources[List->ResourceCount];
+
+	Resource->Kind = Kind;
+
+	switch (Kind)
+	{
+		case RRK_PEN:
+		{
+			LOGPEN Pen = { 0 };
+
+			GetObjectW(Handle, sizeof(Pen), &Pen);
+
+			Resource->Color = Pen.lopnColor;
+
+			Resource->Size = Pen.lopnWidth.x;
+
+			Resource->Style = Pen.lopnStyle;
+
+			break;
+		}
+		case RRK_BRUSH:
+		{
+			LOGBRUSH Brush = { 0 };
+
+			GetObjectW(Handle, sizeof(Brush), &Brush);
+
+			Resource->Color = Brush.lbColor;
+
+			break;
+		}
+		case RRK_FONT:
+		{
+			LOGFONTW Font = { 0 };
+
+			GetObjectW(Handle, sizeof(Font), &Font);
+
+			Resource->Size = abs(Font.lfHeight);
+
+			break;
+		}
+	}
+
+	List->Handles[List->ResourceCount] = Handle;
+
+	return(List->ResourceCount++);
+}
+
+static void RecordSelect(_Inout_ RENDER_LIST* List, _In_ RENDER_RESOURCE_KIND Kind, _In_ HGDIOBJ Handle)
+{
+	RENDER_SELECT* Select = NULL;
+
+	UINT32 Index = List->Selected[Kind];
+
+	if (Index != RENDER_NO_RESOURCE && List->Handles[Index] == Handle)
+	{
+		return;
+	}
+
+	if ((Index = RenderResourceIndex(List, Kind, Handle)) == RENDER_NO_RESOURCE ||
+		(Select = (RENDER_SELECT*)RenderAllocate(List, gRenderSelectOps[Kind], sizeof(RENDER_SELECT) / sizeof(UINT32))) == NULL)
+	{
+		return;
+	}
+
+	Select->Resource = Index;
+
+	List->Selected[Kind] = Index;
+}
+
+void RecordPen(_Inout_ RENDER_LIST* List, _In_ HPEN Pen)
+{
+	RecordSelect(List, RRK_PEN, Pen);
+}
+
+void RecordBrush(_Inout_ RENDER_LIST* List, _In_ HBRUSH Brush)
+{
+	RecordSelect(List, RRK_BRUSH, Brush);
+}
+
+void RecordFont(_Inout_ RENDER_LIST* List, _In_ HFONT Font)
+{
+	RecordSelect(List, RRK_FONT, Font);
+}
+
+// How tall a line of text in the selected font is, which is what GetTextExtentPoint32W would say for any string. Text
+// is only ever positioned by its height or centred, so nothing recorded has to measure text.
+
+int RenderFontHeight(_In_ RENDER_LIST* List)
+{
+	UINT32 Index = List->Selected[RRK_FONT];
+
+	return(Index == RENDER_NO_RESOURCE ? 0 : List->Resources[Index].Size);
+}
+
+static void RecordPoints(_Inout_ RENDER_LIST* List, _In_ RENDER_OP Op, _In_ POINT* Points, _In_ DWORD Count)
+{
+	RENDER_POINTS* Command = NULL;
+
+	INT32* Coordinates = NULL;
+
+	if ((Command = (RENDER_POINTS*)RenderAllocate(List, Op, (sizeof(RENDER_POINTS) / sizeof(UINT32)) + (Count * 2))) == NULL)
+	{
+		return;
+	}
+
+	Command->Count = Count;
+
+	Coordinates = (INT32*)(Command + 1);
+
+	for (DWORD Point = 0; Point < Count; Point++)
+	{
+		Coordinates[Point * 2] = Points[Point].x;
+
+		Coordinates[(Point * 2) + 1] = Points[Point].y;
+	}
+}
+
+void RecordPolyline(_Inout_ RENDER_LIST* List, _In_ POINT* Points, _In_ DWORD Count)
+{
+	RecordPoints(List, RO_POLYLINE, Points, Count);
+}
+
+void RecordPolygon(_Inout_ RENDER_LIST* List, _In_ POINT* Points, _In_ DWORD Count)
+{
+	RecordPoints(List, RO_POLYGON, Points, Count);
+}
+
+void RecordLine(_Inout_ RENDER_LIST* List, _In_ int FromX, _In_ int FromY, _In_ int ToX, _In_ int ToY)
+{
+	POINT Points[2] = { { FromX, FromY }, { ToX, ToY } };
+
+	RecordPoints(List, RO_POLYLINE, Points, _countof(Points));
+}
+
+static void RecordRect(_Inout_ RENDER_LIST* List, _In_ RENDER_OP Op, _In_ int Left, _In_ int Top, _In_ int Right, _In_ int Bottom, _In_ UINT32 Resource)
+{
+	RENDER_RECT* Command = NULL;
+
+	if ((Command = (RENDER_RECT*)RenderAllocate(List, Op, sizeof(RENDER_RECT) / sizeof(UINT32))) == NULL)
+	{
+		return;
+	}
+
+	Command->Resource = Resource;
+
+	Command->Left = Left;
+
+	Command->Top = Top;
+
+	Command->Right = Right;
+
+	Command->Bottom = Bottom;
+}
+
+void RecordEllipse(_Inout_ RENDER_LIST* List, _In_ int Left, _In_ int Top, _In_ int Right, _In_ int Bottom)
+{
+	RecordRect(List, RO_ELLIPSE, Left, Top, Right, Bottom, RENDER_NO_RESOURCE);
+}
+
+void RecordFillRect(_Inout_ RENDER_LIST* List, _In_ RECT* Rect, _In_ HBRUSH Brush)
+{
+	UINT32 Resource = RenderResourceIndex(List, RRK_BRUSH, Brush);
+
+	if (Resource != RENDER_NO_RESOURCE)
+	{
+		RecordRect(List, RO_FILL_RECT, Rect->left, Rect->top, Rect->right, Rect->bottom, Resource);
+	}
+}
+
+void RecordFrameRect(_Inout_ RENDER_LIST* List, _In_ RECT* Rect, _In_ HBRUSH Brush)
+{
+	UINT32 Resource = RenderResourceIndex(List, RRK_BRUSH, Brush);
+
+	if (Resource != RENDER_NO_RESOURCE)
+	{
+		RecordRect(List, RO_FRAME_RECT, Rect->left, Rect->top, Rect->right, Rect->bottom, Resource);
+	}
+}
+
+void RecordText(_Inout_ RENDER_LIST* List, _In_ int X, _In_ int Y, _In_ wchar_t* Text, _In_ RENDER_TEXT_ALIGN Align)
+{
+	RENDER_TEXT* Command = NULL;
+
+	size_t Length = min(wcslen(Text), MAXWORD);
+
+	if ((Command = (RENDER_TEXT*)RenderAllocate(List, RO_TEXT, (DWORD)((sizeof(RENDER_TEXT) / sizeof(UINT32)) + ((Length + 1) / 2)))) == NULL)
+	{
+		return;
+	}
+
+	Command->X = X;
+
+	Command->Y = Y;
+
+	Command->Length = (UINT16)Length;
+
+	Command->Align = (UINT16)Align;
+
+	memcpy(Command + 1, Text, Length * sizeof(wchar_t));
+
+	// Zero the padding, so the same frame always writes the same bytes.
+
+	if (Length % 2)
+	{
+		((wchar_t*)(Command + 1))[Length] = L'\0';
+	}
+}
+
+// The GDI backend. Pens, brushes and fonts are the handles they were recorded from.
+
+void PlayRenderList(_In_ RENDER_LIST* List, _In_ HDC DeviceContext)
+{
+	RENDER_TEXT_ALIGN Align = RTA_LEFT;
+
+	RENDER_HEADER* Header = NULL;
+
+	for (DWORD Offset = 0; Offset < List->WordCount; Offset += Header->Words)
+	{
+		Header = (RENDER_HEADER*)&List->Words[Offset];
+
+		switch (Header->Op)
+		{
+			case RO_PEN:
+			case RO_BRUSH:
+			case RO_FONT:
+			{
+				SelectObject(DeviceContext, List->Handles[((RENDER_SELECT*)Header)->Resource]);
+
+				break;
+			}
+			case RO_POLYLINE:
+			{
+				// POINT is two LONGs, so the coordinates can be handed over as they are.
+
+				Polyline(DeviceContext, (POINT*)((RENDER_POINTS*)Header + 1), (int)((RENDER_POINTS*)Header)->Count);
+
+				break;
+			}
+			case RO_POLYGON:
+			{
+				Polygon(DeviceContext, (POINT*)((RENDER_POINTS*)Header + 1), (int)((RENDER_POINTS*)Header)->Count);
+
+				break;
+			}
+			case RO_ELLIPSE:
+			{
+				RENDER_RECT* Rect = (RENDER_RECT*)Header;
+
+				Ellipse(DeviceContext, Rect->Left, Rect->Top, Rect->Right, Rect->Bottom);
+
+				break;
+			}
+			case RO_FILL_RECT:
+			{
+				RENDER_RECT* Rect = (RENDER_RECT*)Header;
+
+				FillRect(DeviceContext, (RECT*)&Rect->Left, List->Handles[Rect->Resource]);
+
+				break;
+			}
+			case RO_FRAME_RECT:
+			{
+				RENDER_RECT* Rect = (RENDER_RECT*)Header;
+
+				FrameRect(DeviceContext, (RECT*)&Rect->Left, List->Handles[Rect->Resource]);
+
+				break;
+			}
+			case RO_TEXT:
+			{
+				RENDER_TEXT* Text = (RENDER_TEXT*)Header;
+
+				if (Text->Align != Align)
+				{
+					Align = Text->Align;
+
+					SetTextAlign(DeviceContext, Align == RTA_CENTER ? TA_CENTER : TA_LEFT);
+				}
+
+				TextOutW(DeviceContext, Text->X, Text->Y, (wchar_t*)(Text + 1), Text->Length);
+
+				break;
+			}
+		}
+	}
+
+	if (Align != RTA_LEFT)
+	{
+		SetTextAlign(DeviceContext, TA_LEFT);
+	}
+}
+
+// Writes the list to the end of File as one frame.
+
+DWORD AppendRenderList(_In_ RENDER_LIST* List, _In_ HANDLE File)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD Written = 0;
+
+	RENDER_FRAME_HEADER Header = {
+		.Magic = RENDER_LIST_MAGIC,
+		.Version = RENDER_LIST_VERSION,
+		.Width = List->Width,
+		.Height = List->Height,
+		.ResourceCount = List->ResourceCount,
+		.CommandCount = List->CommandCount,
+		.WordCount = List->WordCount };
+
+	if (WriteFile(File, &Header, sizeof(Header), &Written, NULL) == FALSE ||
+		WriteFile(File, List->Resources, List->ResourceCount * sizeof(RENDER_RESOURCE), &Written, NULL) == FALSE ||
+		WriteFile(File, List->Words, List->WordCount * sizeof(UINT32), &Written, NULL) == FALSE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] WriteFile failed with 0x%08lx!", __FUNCTIONW__, Result);
+	}
+
+	return(Result);
+}
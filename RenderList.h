@@ -0,0 +1,232 @@
+#pragma once
+
+// The scene part of a frame, everything drawn in world space, recorded as a flat list of commands and then played
+// back by a backend. Recording walks the visible entities and decides what to draw; playing back only draws. That
+// keeps the two apart, so a backend can be timed, or replaced, on a recorded list without running the app. Press R
+// to append the next RENDER_RECORD_FRAMES frames to RENDER_RECORD_FILE_NAME, and -benchmark render writes a sweep
+// over a synthetic forest; Tools/ReplayBench.c plays either file back without Windows.
+//
+// Commands are 32-bit words, stored in memory exactly as they are in the file. Pens, brushes and fonts are referred
+// to by their index in the list's resource table, which describes each one well enough for another backend to make
+// its own. Selecting what is already selected records nothing.
+//
+// Everything from here to RENDERLIST_FORMAT_ONLY is the file format, and has to build without Windows.h.
+
+#define RENDER_LIST_MAGIC			0x4C524441	// 'ADRL'
+
+#define RENDER_LIST_VERSION			1
+
+#define RENDER_MAX_RESOURCES		64
+
+// Selected resources start out as this, so the first selection of each kind in a frame is always recorded.
+#define RENDER_NO_RESOURCE			0xFFFFFFFF
+
+typedef enum RENDER_OP
+{
+	RO_PEN,				// RENDER_SELECT
+
+	RO_BRUSH,			// RENDER_SELECT
+
+	RO_FONT,			// RENDER_SELECT
+
+	RO_POLYLINE,		// RENDER_POINTS, drawn with the pen
+
+	RO_POLYGON,			// RENDER_POINTS, outlined with the pen and filled with the brush
+
+	RO_ELLIPSE,			// RENDER_RECT, outlined with the pen and filled with the brush
+
+	RO_FILL_RECT,		// RENDER_RECT, with its own brush
+
+	RO_FRAME_RECT,		// RENDER_RECT, one pixel wide, with its own brush
+
+	RO_TEXT,			// RENDER_TEXT, in the font
+
+	RO_COUNT
+
+} RENDER_OP;
+
+typedef enum RENDER_RESOURCE_KIND
+{
+	RRK_PEN,
+
+	RRK_BRUSH,
+
+	RRK_FONT,
+
+	RRK_COUNT
+
+} RENDER_RESOURCE_KIND;
+
+// RENDER_TEXT Align.
+typedef enum RENDER_TEXT_ALIGN
+{
+	RTA_LEFT,
+
+	RTA_CENTER,		// X is the middle of the text
+
+	RTA_COUNT
+
+} RENDER_TEXT_ALIGN;
+
+typedef struct RENDER_RESOURCE
+{
+	UINT32 Kind;
+
+	// 0x00BBGGRR, as RGB() makes.
+	UINT32 Color;
+
+	// Pen width or font cell height, in pixels.
+	INT32 Size;
+
+	// PS_SOLID, PS_DASH or PS_DOT for a pen.
+	UINT32 Style;
+
+} RENDER_RESOURCE;
+
+typedef struct RENDER_HEADER
+{
+	UINT16 Op;
+
+	// The whole command, header included, in 32-bit words.
+	UINT16 Words;
+
+} RENDER_HEADER;
+
+typedef struct RENDER_SELECT
+{
+	RENDER_HEADER Header;
+
+	UINT32 Resource;
+
+} RENDER_SELECT;
+
+// Followed by Count pairs of INT32 x and y.
+typedef struct RENDER_POINTS
+{
+	RENDER_HEADER Header;
+
+	UINT32 Count;
+
+} RENDER_POINTS;
+
+typedef struct RENDER_RECT
+{
+	RENDER_HEADER Header;
+
+	// The brush, for RO_FILL_RECT and RO_FRAME_RECT.
+	UINT32 Resource;
+
+	INT32 Left;
+
+	INT32 Top;
+
+	INT32 Right;
+
+	INT32 Bottom;
+
+} RENDER_RECT;
+
+// Followed by Length UTF-16 code units, padded to a whole word.
+typedef struct RENDER_TEXT
+{
+	RENDER_HEADER Header;
+
+	INT32 X;
+
+	INT32 Y;
+
+	UINT16 Length;
+
+	UINT16 Align;
+
+} RENDER_TEXT;
+
+// A frame in a file is this, then ResourceCount RENDER_RESOURCEs, then WordCount words of commands. A file is any
+// number of frames back to back.
+typedef struct RENDER_FRAME_HEADER
+{
+	UINT32 Magic;
+
+	UINT32 Version;
+
+	INT32 Width;
+
+	INT32 Height;
+
+	UINT32 ResourceCount;
+
+	UINT32 CommandCount;
+
+	UINT32 WordCount;
+
+} RENDER_FRAME_HEADER;
+
+#ifndef RENDERLIST_FORMAT_ONLY
+
+#define RENDER_LIST_INITIAL_WORDS	65536
+
+#define RENDER_RECORD_FILE_NAME		L"ADTV_frames.adtvr"
+
+#define RENDER_RECORD_FRAMES		120
+
+typedef struct RENDER_LIST
+{
+	int Width;
+
+	int Height;
+
+	DWORD CommandCount;
+
+	DWORD WordCount;
+
+	DWORD WordCapacity;
+
+	UINT32* Words;
+
+	// The first allocation failure since the list was reset. Commands after it are dropped.
+	DWORD Result;
+
+	// Kept from frame to frame; a handle only has to be looked up and described the first time it's used.
+	DWORD ResourceCount;
+
+	RENDER_RESOURCE Resources[RENDER_MAX_RESOURCES];
+
+	HGDIOBJ Handles[RENDER_MAX_RESOURCES];
+
+	UINT32 Selected[RRK_COUNT];
+
+} RENDER_LIST;
+
+RENDER_LIST* CreateRenderList(void);
+
+void FreeRenderList(_In_opt_ RENDER_LIST* List);
+
+void ResetRenderList(_Inout_ RENDER_LIST* List, _In_ int Width, _In_ int Height);
+
+void RecordPen(_Inout_ RENDER_LIST* List, _In_ HPEN Pen);
+
+void RecordBrush(_Inout_ RENDER_LIST* List, _In_ HBRUSH Brush);
+
+void RecordFont(_Inout_ RENDER_LIST* List, _In_ HFONT Font);
+
+int RenderFontHeight(_In_ RENDER_LIST* List);
+
+void RecordPolyline(_Inout_ RENDER_LIST* List, _In_ POINT* Points, _In_ DWORD Count);
+
+void RecordPolygon(_Inout_ RENDER_LIST* List, _In_ POINT* Points, _In_ DWORD Count);
+
+void RecordLine(_Inout_ RENDER_LIST* List, _In_ int FromX, _In_ int FromY, _In_ int ToX, _In_ int ToY);
+
+void RecordEllipse(_Inout_ RENDER_LIST* List, _In_ int Left, _In_ int Top, _In_ int Right, _In_ int Bottom);
+
+void RecordFillRect(_Inout_ RENDER_LIST* List, _In_ RECT* Rect, _In_ HBRUSH Brush);
+
+void RecordFrameRect(_Inout_ RENDER_LIST* List, _In_ RECT* Rect, _In_ HBRUSH Brush);
+
+void RecordText(_Inout_ RENDER_LIST* List, _In_ int X, _In_ int Y, _In_ wchar_t* Text, _In_ RENDER_TEXT_ALIGN Align);
+
+void PlayRenderList(_In_ RENDER_LIST* List, _In_ HDC DeviceContext);
+
+DWORD AppendRenderList(_In_ RENDER_LIST* List, _In_ HANDLE File);
+
+#endif
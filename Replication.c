@@ -0,0 +1,689 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Replication status scheduler. Once discovery has finished, this periodically asks every DC for its inbound replication
+// neighbours and KCC failure counts, and attaches the answer to the DC entity so the renderer can colour it.
+//
+// With thousands of DCs we can't just loop over them, so:
+// - every DC sits in a min-heap ordered by when it is next due,
+// - at most ReplicationMaxConcurrent polls are in flight at once, and at most one per DC,
+// - each interval is jittered so DCs spread out over time instead of all coming due together,
+// - DCs currently on screen are polled more often and jump the queue,
+// - a poll that doesn't come back within ReplicationTimeoutSeconds is abandoned. The DC is marked unreachable and its
+//   concurrency slot is handed to someone else. The DC isn't polled again until the stuck call returns, so a dead DC
+//   can never tie up more than one thread.
+
+#include <Windows.h>
+
+#include <NtDsAPI.h>
+
+#include <intrin.h>
+
+#include <stdio.h>
+
+#include "Main.h"
+
+#include "Replication.h"
+
+#include "TimeSeries.h"
+
+#include "Trace.h"
+
+
+
+static HANDLE gReplSchedulerThread;
+
+static HANDLE gReplStopEvent;
+
+static HANDLE gReplCompletionEvent;
+
+static SLIST_HEADER gReplCompletions;
+
+static REPL_TARGET* gReplTargets;
+
+static DWORD gReplTargetCount;
+
+static REPL_TARGET** gReplHeap;
+
+static DWORD gReplHeapCount;
+
+static UINT64 gReplRandomState;
+
+
+
+static UINT64 ReplRandom(void)
+{
+	// xorshift64, only ever called from the scheduler thread
+
+	gReplRandomState ^= gReplRandomState << 13;
+
+	gReplRandomState ^= gReplRandomState >> 7;
+
+	gReplRandomState ^= gReplRandomState << 17;
+
+	return(gReplRandomState);
+}
+
+static BOOL ReplIsVisible(_In_ REPL_TARGET* Target)
+{
+	UINT64 LastVisible = Target->DC->LastVisibleFrame;
+
+	return(LastVisible != 0 && gGraphicsData.TotalFramesRendered - LastVisible < REPL_VISIBLE_FRAMES);
+}
+
+static UINT64 ReplNextInterval(_In_ REPL_TARGET* Target)
+{
+	UINT64 Interval = (UINT64)gRegParams.ReplicationPollSeconds * 1000;
+
+	INT64 Jitter = 0;
+
+	if (ReplIsVisible(Target))
+	{
+		Interval /= REPL_VISIBLE_SPEEDUP;
+	}
+
+	Interval <<= min(Target->ConsecutiveErrors, REPL_MAX_BACKOFF_SHIFT);
+
+	Jitter = (INT64)(ReplRandom() % ((Interval * REPL_JITTER_PERCENT * 2 / 100) + 1)) - (INT64)(Interval * REPL_JITTER_PERCENT / 100);
+
+	return((UINT64)((INT64)Interval + Jitter));
+}
+
+static void ReplHeapPush(_In_ REPL_TARGET* Target)
+{
+	DWORD Index = gReplHeapCount++;
+
+	while (Index > 0)
+	{
+		DWORD Parent = (Index - 1) / 2;
+
+		if (gReplHeap[Parent]->NextDue <= Target->NextDue)
+		{
+			break;
+		}
+
+		gReplHeap[Index] = gReplHeap[Parent];
+
+		Index = Parent;
+	}
+
+	gReplHeap[Index] = Target;
+}
+
+static REPL_TARGET* ReplHeapPop(void)
+{
+	REPL_TARGET* Top = gReplHeap[0];
+
+	REPL_TARGET* Last = gReplHeap[--gReplHeapCount];
+
+	DWORD Index = 0;
+
+	while (TRUE)
+	{
+		DWORD Child = (Index * 2) + 1;
+
+		if (Child >= gReplHeapCount)
+		{
+			break;
+		}
+
+		if (Child + 1 < gReplHeapCount && gReplHeap[Child + 1]->NextDue < gReplHeap[Child]->NextDue)
+		{
+			Child++;
+		}
+
+		if (Last->NextDue <= gReplHeap[Child]->NextDue)
+		{
+			break;
+		}
+
+		gReplHeap[Index] = gReplHeap[Child];
+
+		Index = Child;
+	}
+
+	if (gReplHeapCount > 0)
+	{
+		gReplHeap[Index] = Last;
+	}
+
+	return(Top);
+}
+
+static int __cdecl ReplCompareReady(_In_ const void* A, _In_ const void* B)
+{
+	REPL_TARGET* TargetA = *(REPL_TARGET**)A;
+
+	REPL_TARGET* TargetB = *(REPL_TARGET**)B;
+
+	BOOL VisibleA = ReplIsVisible(TargetA);
+
+	BOOL VisibleB = ReplIsVisible(TargetB);
+
+	if (VisibleA != VisibleB)
+	{
+		return(VisibleA ? -1 : 1);
+	}
+
+	return((TargetA->NextDue > TargetB->NextDue) - (TargetA->NextDue < TargetB->NextDue));
+}
+
+static void CALLBACK ReplWorkCallback(_Inout_ PTP_CALLBACK_INSTANCE Instance, _Inout_opt_ PVOID Context)
+{
+	UNREFERENCED_PARAMETER(Instance);
+
+	REPL_JOB* Job = Context;
+
+	Job->Error = Job->Provider(Job->Target->DC, &Job->Status);
+
+	InterlockedPushEntrySList(&gReplCompletions, &Job->ListEntry);
+
+	SetEvent(gReplCompletionEvent);
+}
+
+DWORD ReplicaGetInfoProvider(_In_ ENTITY* DC, _Out_ REPLSTATUS* Status)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	HANDLE BindHandle = NULL;
+
+	DS_REPL_NEIGHBORSW* Neighbors = NULL;
+
+	DS_REPL_KCC_DSA_FAILURESW* LinkFailures = NULL;
+
+	DS_REPL_PENDING_OPSW* PendingOps = NULL;
+
+	memset(Status, 0, sizeof(REPLSTATUS));
+
+	if ((Result = TRACED("DsBindW", DsBindW(DC->fqdn, NULL, &BindHandle))) != ERROR_SUCCESS)
+	{
+		Status->Health = RH_UNREACHABLE;
+
+		goto Exit;
+	}
+
+	if ((Result = TRACED("DsReplicaGetInfoW", DsReplicaGetInfoW(BindHandle, DS_REPL_INFO_NEIGHBORS, NULL, NULL, &Neighbors))) != ERROR_SUCCESS)
+	{
+		Status->Health = RH_UNREACHABLE;
+
+		goto Exit;
+	}
+
+	Status->Neighbors = Neighbors->cNumNeighbors;
+
+	for (DWORD Neighbor = 0; Neighbor < Neighbors->cNumNeighbors; Neighbor++)
+	{
+		DS_REPL_NEIGHBORW* Current = &Neighbors->rgNeighbor[Neighbor];
+
+		if (Current->dwLastSyncResult != ERROR_SUCCESS || Current->cNumConsecutiveSyncFailures > 0)
+		{
+			Status->FailingNeighbors++;
+
+			Status->ConsecutiveFailures += Current->cNumConsecutiveSyncFailures;
+
+			Status->LastResult = Current->dwLastSyncResult;
+		}
+
+		if ((Status->OldestLastSuccess.dwHighDateTime == 0 && Status->OldestLastSuccess.dwLowDateTime == 0) ||
+			CompareFileTime(&Current->ftimeLastSyncSuccess, &Status->OldestLastSuccess) < 0)
+		{
+			Status->OldestLastSuccess = Current->ftimeLastSyncSuccess;
+		}
+	}
+
+	// Failure counts are nice to have; a DC that answers neighbours but not this is still healthy as far as we know.
+
+	if (TRACED("DsReplicaGetInfoW", DsReplicaGetInfoW(BindHandle, DS_REPL_INFO_KCC_DSA_LINK_FAILURES, NULL, NULL, &LinkFailures)) == ERROR_SUCCESS)
+	{
+		for (DWORD Failure = 0; Failure < LinkFailures->cNumEntries; Failure++)
+		{
+			Status->KccFailures += LinkFailures->rgDsaFailure[Failure].cNumFailures;
+		}
+	}
+
+	if (TRACED("DsReplicaGetInfoW", DsReplicaGetInfoW(BindHandle, DS_REPL_INFO_PENDING_OPS, NULL, NULL, &PendingOps)) == ERROR_SUCCESS)
+	{
+		Status->PendingOps = PendingOps->cNumPendingOps;
+	}
+
+	if (Status->FailingNeighbors == 0)
+	{
+		Status->Health = RH_HEALTHY;
+	}
+	else if (Status->FailingNeighbors < Status->Neighbors)
+	{
+		Status->Health = RH_DEGRADED;
+	}
+	else
+	{
+		Status->Health = RH_FAILING;
+	}
+
+Exit:
+
+	if (PendingOps)
+	{
+		DsReplicaFreeInfo(DS_REPL_INFO_PENDING_OPS, PendingOps);
+	}
+
+	if (LinkFailures)
+	{
+		DsReplicaFreeInfo(DS_REPL_INFO_KCC_DSA_LINK_FAILURES, LinkFailures);
+	}
+
+	if (Neighbors)
+	{
+		DsReplicaFreeInfo(DS_REPL_INFO_NEIGHBORS, Neighbors);
+	}
+
+	if (BindHandle)
+	{
+		DsUnBindW(&BindHandle);
+	}
+
+	Status->LastResult = (Result != ERROR_SUCCESS) ? Result : Status->LastResult;
+
+	return(Result);
+}
+
+DWORD SimulatedReplProvider(_In_ ENTITY* DC, _Out_ REPLSTATUS* Status)
+{
+	// Stands in for a forest we don't have. Each DC gets a stable personality derived from its name, so the map
+	// doesn't flicker between polls, plus a little noise. A few DCs are "dead" and hang past the poll timeout.
+
+	DWORD Hash = 2166136261;
+
+	DWORD Noise = (DWORD)__rdtsc();
+
+	memset(Status, 0, sizeof(REPLSTATUS));
+
+	for (wchar_t* Character = DC->distinguishedname; *Character; Character++)
+	{
+		Hash = (Hash ^ *Character) * 16777619;
+	}
+
+	if (Hash % 97 == 0)
+	{
+		Sleep((gRegParams.ReplicationTimeoutSeconds + 5) * 1000);
+
+		Status->Health = RH_UNREACHABLE;
+
+		return(ERROR_TIMEOUT);
+	}
+
+	Sleep(10 + (Noise % 200));
+
+	Status->Neighbors = 1 + (Hash % 6);
+
+	if (Hash % 13 == 0)
+	{
+		Status->FailingNeighbors = Status->Neighbors;
+	}
+	else if (Hash % 7 == 0 || Noise % 50 == 0)
+	{
+		Status->FailingNeighbors = 1;
+	}
+
+	Status->ConsecutiveFailures = Status->FailingNeighbors * (1 + (Noise % 10));
+
+	Status->KccFailures = Status->FailingNeighbors ? (Hash % 4) : 0;
+
+	// A queue that's usually empty, and backs up now and then, more so where replication is failing.
+
+	Status->PendingOps = (Noise % 17 == 0) ? (Noise % 40) : 0;
+
+	Status->PendingOps += Status->FailingNeighbors * (Hash % 5);
+
+	Status->LastResult = Status->FailingNeighbors ? RPC_S_SERVER_UNAVAILABLE : ERROR_SUCCESS;
+
+	GetSystemTimeAsFileTime(&Status->OldestLastSuccess);
+
+	if (Status->FailingNeighbors == 0)
+	{
+		Status->Health = RH_HEALTHY;
+	}
+	else if (Status->FailingNeighbors < Status->Neighbors)
+	{
+		Status->Health = RH_DEGRADED;
+	}
+	else
+	{
+		Status->Health = RH_FAILING;
+	}
+
+	return(ERROR_SUCCESS);
+}
+
+static DWORD WINAPI ReplSchedulerThreadProc(_In_ LPVOID lpParameter)
+{
+	UNREFERENCED_PARAMETER(lpParameter);
+
+	REPL_PROVIDER Provider = (gRegParams.ReplicationProvider == RPT_SIMULATED) ? SimulatedReplProvider : ReplicaGetInfoProvider;
+
+	UINT64 Timeout = (UINT64)gRegParams.ReplicationTimeoutSeconds * 1000;
+
+	DWORD MaxConcurrent = gRegParams.ReplicationMaxConcurrent;
+
+	// Jobs that are running and still count against MaxConcurrent.
+	REPL_JOB** Active = NULL;
+
+	DWORD ActiveCount = 0;
+
+	// Jobs we've given up on but whose thread pool thread is still stuck in the provider.
+	DWORD AbandonedCount = 0;
+
+	REPL_TARGET** Ready = NULL;
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Replication scheduler beginning. %d DCs, %d concurrent, %ds interval, %ds timeout.",
+		__FUNCTIONW__,
+		gReplTargetCount,
+		MaxConcurrent,
+		gRegParams.ReplicationPollSeconds,
+		gRegParams.ReplicationTimeoutSeconds);
+
+	Active = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(REPL_JOB*) * MaxConcurrent);
+
+	Ready = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(REPL_TARGET*) * ((SIZE_T)gReplTargetCount + 1));
+
+	if (Active == NULL || Ready == NULL)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	while (gContinue && WaitForSingleObject(gReplStopEvent, 0) != WAIT_OBJECT_0)
+	{
+		UINT64 Now = GetTickCount64();
+
+		DWORD ReadyCount = 0;
+
+		SLIST_ENTRY* Completed = InterlockedFlushSList(&gReplCompletions);
+
+		// 1. Collect finished polls.
+
+		while (Completed)
+		{
+			REPL_JOB* Job = CONTAINING_RECORD(Completed, REPL_JOB, ListEntry);
+
+			REPL_TARGET* Target = Job->Target;
+
+			Completed = Completed->Next;
+
+			if (Job->TimedOut)
+			{
+				// We already marked this DC unreachable when it timed out, the answer is too late to matter.
+
+				AbandonedCount--;
+			}
+			else
+			{
+				for (DWORD Index = 0; Index < ActiveCount; Index++)
+				{
+					if (Active[Index] == Job)
+					{
+						Active[Index] = Active[--ActiveCount];
+
+						break;
+					}
+				}
+
+				Job->Status.LastPolled = Now;
+
+				Target->DC->ReplStatus = Job->Status;
+
+				if (Job->Error == ERROR_SUCCESS)
+				{
+					INT64 Time = TimeSeriesNow();
+
+					RecordTimeSeries(Target->DC, TSM_FAILING_NEIGHBORS, Time, Job->Status.FailingNeighbors);
+
+					RecordTimeSeries(Target->DC, TSM_PENDING_OPS, Time, Job->Status.PendingOps);
+				}
+
+				Target->ConsecutiveErrors = (Job->Error == ERROR_SUCCESS) ? 0 : Target->ConsecutiveErrors + 1;
+			}
+
+			Target->InFlight = FALSE;
+
+			Target->NextDue = Now + ReplNextInterval(Target);
+
+			ReplHeapPush(Target);
+
+			HeapFree(GetProcessHeap(), 0, Job);
+		}
+
+		// 2. Give up on polls that are taking too long, so a handful of dead DCs can't starve everybody else.
+
+		for (DWORD Index = 0; Index < ActiveCount; )
+		{
+			REPL_JOB* Job = Active[Index];
+
+			if (Now - Job->DispatchedAt > Timeout)
+			{
+				LogEventW(LL_WARN, LF_FILE, L"[%s] Replication poll of %s timed out.", __FUNCTIONW__, Job->Target->DC->fqdn);
+
+				Job->TimedOut = TRUE;
+
+				Job->Target->DC->ReplStatus.Health = RH_UNREACHABLE;
+
+				Job->Target->DC->ReplStatus.LastResult = ERROR_TIMEOUT;
+
+				Job->Target->DC->ReplStatus.LastPolled = Now;
+
+				Job->Target->ConsecutiveErrors++;
+
+				Active[Index] = Active[--ActiveCount];
+
+				AbandonedCount++;
+
+				continue;
+			}
+
+			Index++;
+		}
+
+		// 3. Pull everything that's due, put on-screen DCs first, and hand out as many slots as we have.
+
+		while (gReplHeapCount > 0 && gReplHeap[0]->NextDue <= Now)
+		{
+			Ready[ReadyCount++] = ReplHeapPop();
+		}
+
+		if (ReadyCount > 1)
+		{
+			qsort(Ready, ReadyCount, sizeof(REPL_TARGET*), ReplCompareReady);
+		}
+
+		for (DWORD Index = 0; Index < ReadyCount; Index++)
+		{
+			REPL_TARGET* Target = Ready[Index];
+
+			// Abandoned jobs still hold a thread pool thread, so they count against the limit too, just less harshly.
+			// Without this a forest full of dead DCs could grow the thread pool without bound.
+
+			if (ActiveCount >= MaxConcurrent || AbandonedCount >= MaxConcurrent || wcslen(Target->DC->fqdn) == 0)
+			{
+				if (wcslen(Target->DC->fqdn) == 0)
+				{
+					Target->NextDue = Now + ReplNextInterval(Target);
+				}
+
+				ReplHeapPush(Target);
+
+				continue;
+			}
+
+			REPL_JOB* Job = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(REPL_JOB));
+
+			if (Job == NULL)
+			{
+				ReplHeapPush(Target);
+
+				continue;
+			}
+
+			Job->Target = Target;
+
+			Job->Provider = Provider;
+
+			Job->DispatchedAt = Now;
+
+			Target->InFlight = TRUE;
+
+			if (TrySubmitThreadpoolCallback(ReplWorkCallback, Job, NULL) == FALSE)
+			{
+				LogEventW(LL_ERROR, LF_FILE, L"[%s] TrySubmitThreadpoolCallback failed with 0x%08lx!", __FUNCTIONW__, GetLastError());
+
+				Target->InFlight = FALSE;
+
+				Target->NextDue = Now + ReplNextInterval(Target);
+
+				ReplHeapPush(Target);
+
+				HeapFree(GetProcessHeap(), 0, Job);
+
+				continue;
+			}
+
+			Active[ActiveCount++] = Job;
+		}
+
+		HANDLE WaitHandles[2] = { gReplStopEvent, gReplCompletionEvent };
+
+		WaitForMultipleObjects(_countof(WaitHandles), WaitHandles, FALSE, REPL_SCHEDULER_TICK_MS);
+	}
+
+Exit:
+
+	// Jobs still in flight own their memory from here on; they will push themselves onto a list nobody reads,
+	// which is fine since we only stop the scheduler when the process is exiting.
+
+	if (Active)
+	{
+		HeapFree(GetProcessHeap(), 0, Active);
+	}
+
+	if (Ready)
+	{
+		HeapFree(GetProcessHeap(), 0, Ready);
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Replication scheduler ending.", __FUNCTIONW__);
+
+	return(ERROR_SUCCESS);
+}
+
+DWORD StartReplicationScheduler(void)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD DCCount = 0;
+
+	UINT64 Now = GetTickCount64();
+
+	UINT64 Spread = 0;
+
+	if (gRegParams.ReplicationPollSeconds == 0)
+	{
+		LogEventW(LL_INFO, LF_FILE, L"[%s] ReplicationPollSeconds is 0, replication polling is disabled.", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	for (ENTITY* Current = gEntities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			DCCount++;
+		}
+	}
+
+	if (DCCount == 0)
+	{
+		goto Exit;
+	}
+
+	gReplTargets = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(REPL_TARGET) * DCCount);
+
+	gReplHeap = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(REPL_TARGET*) * DCCount);
+
+	if (gReplTargets == NULL || gReplHeap == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	gReplRandomState = GetTickCount64() ^ ((UINT64)GetCurrentThreadId() << 32) ^ 0x9E3779B97F4A7C15ULL;
+
+	// Spread the first round of polls over the interval DCs on screen are polled at, instead of hammering every DC at
+	// startup. That's shorter than the full interval so that whatever is on screen first shows its health as soon as
+	// it would once it's running; DCs off screen just get their second poll a full interval later. Jitter keeps them
+	// spread out from then on.
+
+	Spread = (UINT64)gRegParams.ReplicationPollSeconds * 1000;
+
+	for (ENTITY* Current = gEntities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			REPL_TARGET* Target = &gReplTargets[gReplTargetCount++];
+
+			Target->DC = Current;
+
+			Target->NextDue = Now + (ReplRandom() % (Spread / REPL_VISIBLE_SPEEDUP + 1));
+
+			ReplHeapPush(Target);
+		}
+	}
+
+	InitializeSListHead(&gReplCompletions);
+
+	gReplStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+	gReplCompletionEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+	if (gReplStopEvent == NULL || gReplCompletionEvent == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] CreateEventW failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	if ((gReplSchedulerThread = CreateThread(NULL, 0, ReplSchedulerThreadProc, NULL, 0, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create replication scheduler thread! Error 0x%08lx", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+Exit:
+
+	return(Result);
+}
+
+void StopReplicationScheduler(_In_ DWORD TimeoutMilliseconds)
+{
+	if (gReplSchedulerThread == NULL)
+	{
+		return;
+	}
+
+	SetEvent(gReplStopEvent);
+
+	if (WaitForSingleObject(gReplSchedulerThread, TimeoutMilliseconds) != WAIT_OBJECT_0)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] Replication scheduler did not stop within %dms.", __FUNCTIONW__, TimeoutMilliseconds);
+	}
+
+	CloseHandle(gReplSchedulerThread);
+
+	gReplSchedulerThread = NULL;
+}
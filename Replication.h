@@ -0,0 +1,77 @@
+#pragma once
+
+// How often each DC is polled, unless overridden by the ReplicationPollSeconds registry setting.
+#define REPL_DEF_POLL_SECONDS		300
+
+// How many polls may be in flight at once across the whole forest.
+#define REPL_DEF_MAX_CONCURRENT		16
+
+// A poll that takes longer than this is abandoned and the DC is marked unreachable.
+#define REPL_DEF_TIMEOUT_SECONDS	30
+
+// Each poll interval is randomized by up to +/- this much so that thousands of DCs don't all come due on the same tick.
+#define REPL_JITTER_PERCENT			20
+
+// DCs that are on screen get polled this many times more often than DCs that are not.
+#define REPL_VISIBLE_SPEEDUP		4
+
+// A DC counts as visible if it was drawn within this many frames.
+#define REPL_VISIBLE_FRAMES			120
+
+// A DC that keeps failing backs off up to this many poll intervals.
+#define REPL_MAX_BACKOFF_SHIFT		3
+
+#define REPL_SCHEDULER_TICK_MS		250
+
+#define REPL_SHUTDOWN_TIMEOUT_MS	2000
+
+typedef enum REPL_PROVIDER_TYPE
+{
+	RPT_DSREPLICAGETINFO,	// Ask the real DC
+
+	RPT_SIMULATED			// Make up plausible answers, for testing without a forest
+
+} REPL_PROVIDER_TYPE;
+
+// A provider fills out the replication status of a single DC. It runs on a thread pool thread and may block.
+typedef DWORD(*REPL_PROVIDER)(_In_ ENTITY* DC, _Out_ REPLSTATUS* Status);
+
+typedef struct REPL_TARGET
+{
+	ENTITY* DC;
+
+	UINT64 NextDue;
+
+	DWORD ConsecutiveErrors;
+
+	// The target is either in the due heap or has exactly one poll in flight, never both.
+	BOOL InFlight;
+
+} REPL_TARGET;
+
+typedef struct REPL_JOB
+{
+	SLIST_ENTRY ListEntry;
+
+	REPL_TARGET* Target;
+
+	REPL_PROVIDER Provider;
+
+	UINT64 DispatchedAt;
+
+	// Only touched by the scheduler thread.
+	BOOL TimedOut;
+
+	DWORD Error;
+
+	REPLSTATUS Status;
+
+} REPL_JOB;
+
+DWORD StartReplicationScheduler(void);
+
+void StopReplicationScheduler(_In_ DWORD TimeoutMilliseconds);
+
+DWORD ReplicaGetInfoProvider(_In_ ENTITY* DC, _Out_ REPLSTATUS* Status);
+
+DWORD SimulatedReplProvider(_In_ ENTITY* DC, _Out_ REPLSTATUS* Status);
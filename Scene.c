@@ -0,0 +1,439 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Immutable scenes, swapped in whole. See Scene.h.
+//
+// gScene is the newest scene, and is only ever changed with an interlocked exchange. The scenes it has replaced are
+// kept in a list that only the publisher touches, until ReclaimScenes finds nothing can still be reading them.
+
+#include <Windows.h>
+
+#include "Main.h"
+
+#include "Trace.h"
+
+#include "Pick.h"
+
+#include "Search.h"
+
+#include "SiteGraph.h"
+
+#include "Labels.h"
+
+#include "Layout.h"
+
+#include "Scene.h"
+
+static SCENE* volatile gScene;
+
+// Starts at one, so a reader's slot is never zero while it's pinned.
+static volatile LONG64 gSceneEpoch = 1;
+
+static volatile LONG64 gSceneReaderEpochs[SR_COUNT];
+
+static SCENE* gRetiredScenes;
+
+static HANDLE gSceneRebuildThread;
+
+// Only the rebuild thread measures text, in a DC of its own, so it never touches the back buffer's.
+static HDC gSceneMeasureDC;
+
+
+
+// Builds the indexes for Entities, which must not change while the scene exists. Storage, if given, belongs to the
+// scene from here on, and is freed with it, even if this fails.
+
+SCENE* CreateScene(_In_ ENTITY* Entities, _In_opt_ ENTITY* Storage, _In_ LAYOUT_MODE Layout)
+{
+	SCENE* Scene = NULL;
+
+	if ((Scene = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(SCENE))) == NULL)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		if (Storage)
+		{
+			HeapFree(GetProcessHeap(), 0, Storage);
+		}
+
+		return(NULL);
+	}
+
+	Scene->Entities = Entities;
+
+	Scene->Storage = Storage;
+
+	Scene->Layout = Layout;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		Scene->EntityCount++;
+
+		if (Current->Type == ET_SITE && Current->SiteIndex != SITEGRAPH_NO_SITE)
+		{
+			Scene->SiteCount = max(Scene->SiteCount, Current->SiteIndex + 1);
+		}
+	}
+
+	// Without it, the KCC what-if view has no lines to draw between sites.
+
+	if (Scene->SiteCount && (Scene->Sites = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, Scene->SiteCount * sizeof(ENTITY*))) == NULL)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] Out of memory for %lu sites!", __FUNCTIONW__, Scene->SiteCount);
+
+		Scene->SiteCount = 0;
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL && Scene->Sites; Current = Current->Next)
+	{
+		if (Current->Type == ET_SITE && Current->SiteIndex != SITEGRAPH_NO_SITE)
+		{
+			Scene->Sites[Current->SiteIndex] = Current;
+		}
+	}
+
+	// Search is nice to have; if there isn't memory for the index, everything else still works.
+
+	TRACE_BEGIN("BuildSearchIndex");
+
+	Scene->SearchIndex = BuildSearchIndex(Entities);
+
+	TRACE_END();
+
+	// Same for hover tooltips.
+
+	TRACE_BEGIN("BuildPickIndex");
+
+	Scene->PickIndex = BuildPickIndex(Entities);
+
+	TRACE_END();
+
+	return(Scene);
+}
+
+void FreeScene(_In_opt_ SCENE* Scene)
+{
+	if (Scene == NULL)
+	{
+		return;
+	}
+
+	FreePickIndex(Scene->PickIndex);
+
+	FreeSearchIndex(Scene->SearchIndex);
+
+	if (Scene->Sites)
+	{
+		HeapFree(GetProcessHeap(), 0, Scene->Sites);
+	}
+
+	if (Scene->Storage)
+	{
+		HeapFree(GetProcessHeap(), 0, Scene->Storage);
+	}
+
+	HeapFree(GetProcessHeap(), 0, Scene);
+}
+
+// Makes Scene the one readers get from now on. The one it replaces is kept until ReclaimScenes can free it.
+
+void PublishScene(_In_ SCENE* Scene)
+{
+	SCENE* Replaced = InterlockedExchangePointer((PVOID volatile*)&gScene, Scene);
+
+	if (Replaced == NULL)
+	{
+		return;
+	}
+
+	// Anyone who pins after this can only see Scene, and will have an epoch at least this high.
+
+	Replaced->RetiredEpoch = InterlockedIncrement64(&gSceneEpoch);
+
+	Replaced->NextRetired = gRetiredScenes;
+
+	gRetiredScenes = Replaced;
+}
+
+// Pins the newest scene for Reader until ReleaseScene, or until Reader acquires again. NULL until one is published.
+
+SCENE* AcquireScene(_In_ SCENE_READER Reader)
+{
+	// The exchange is a full barrier, so ReclaimScenes can't miss the pin and still free the scene read below.
+
+	InterlockedExchange64(&gSceneReaderEpochs[Reader], gSceneEpoch);
+
+	return(gScene);
+}
+
+void ReleaseScene(_In_ SCENE_READER Reader)
+{
+	InterlockedExchange64(&gSceneReaderEpochs[Reader], 0);
+}
+
+// Whether a newer scene than Scene has been published. Scene has to be pinned, so its address can't have been reused.
+
+BOOL IsNewSceneReady(_In_opt_ SCENE* Scene)
+{
+	return(gScene != Scene);
+}
+
+// Frees every replaced scene that nothing can still be reading. Returns how many are left. Publisher only.
+
+DWORD ReclaimScenes(void)
+{
+	LONG64 Oldest = MAXLONG64;
+
+	DWORD Waiting = 0;
+
+	for (int Reader = 0; Reader < SR_COUNT; Reader++)
+	{
+		LONG64 Pinned = gSceneReaderEpochs[Reader];
+
+		if (Pinned != 0 && Pinned < Oldest)
+		{
+			Oldest = Pinned;
+		}
+	}
+
+	for (SCENE** Link = &gRetiredScenes; *Link != NULL;)
+	{
+		SCENE* Scene = *Link;
+
+		if (Scene->RetiredEpoch <= Oldest)
+		{
+			*Link = Scene->NextRetired;
+
+			FreeScene(Scene);
+		}
+		else
+		{
+			Link = &Scene->NextRetired;
+
+			Waiting++;
+		}
+	}
+
+	return(Waiting);
+}
+
+// Frees every scene, pinned or not. Only once nothing draws them any more and nothing is rebuilding one.
+
+void FreeScenes(void)
+{
+	while (gRetiredScenes)
+	{
+		SCENE* Scene = gRetiredScenes;
+
+		gRetiredScenes = Scene->NextRetired;
+
+		FreeScene(Scene);
+	}
+
+	FreeScene(InterlockedExchangePointer((PVOID volatile*)&gScene, NULL));
+
+	for (int Reader = 0; Reader < SR_COUNT; Reader++)
+	{
+		gSceneReaderEpochs[Reader] = 0;
+	}
+}
+
+static int SceneMeasureText(_In_ wchar_t* Text, _In_ int Length)
+{
+	SIZE TextSize = { 0 };
+
+	GetTextExtentPointW(gSceneMeasureDC, Text, Length, &TextSize);
+
+	return(TextSize.cx);
+}
+
+// Copies of every entity in Scene, in one allocation and in the same order, each pointing back at the entity that
+// holds its status. Status copied along with everything else is never read.
+
+static ENTITY* CopySceneEntities(_In_ SCENE* Scene)
+{
+	ENTITY* Copies = NULL;
+
+	DWORD Index = 0;
+
+	if ((Copies = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Scene->EntityCount, 1) * sizeof(ENTITY))) == NULL)
+	{
+		return(NULL);
+	}
+
+	for (ENTITY* Current = Scene->Entities; Current != NULL; Current = Current->Next, Index++)
+	{
+		Copies[Index] = *Current;
+
+		Copies[Index].Live = ENTITY_LIVE(Current);
+
+		Copies[Index].Next = Current->Next ? &Copies[Index + 1] : NULL;
+	}
+
+	return(Copies);
+}
+
+// Lays the current scene out again with the layout given as lpParameter, and publishes it. Nothing else publishes
+// while this is running, so the scene being copied can't be replaced or freed underneath it.
+
+static DWORD WINAPI SceneRebuildThreadProc(_In_ LPVOID lpParameter)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	LAYOUT_MODE Layout = (LAYOUT_MODE)(ULONG_PTR)lpParameter;
+
+	SCENE* Current = gScene;
+
+	SCENE* Scene = NULL;
+
+	ENTITY* Storage = NULL;
+
+	ULONGLONG Started = GetTickCount64();
+
+	LABEL_FONT LabelFonts[LFS_COUNT] = { 0 };
+
+	TRACE_THREAD_NAME(L"SceneRebuild");
+
+	if ((Storage = CopySceneEntities(Current)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to allocate memory to copy %lu entities!", __FUNCTIONW__, Current->EntityCount);
+
+		goto Exit;
+	}
+
+	if ((gSceneMeasureDC = CreateCompatibleDC(NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] CreateCompatibleDC failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	SelectObject(gSceneMeasureDC, gGraphicsData.HugeFont);
+
+	TRACE_BEGIN("Layout");
+
+	Result = LayoutTopology(Storage, SceneMeasureText, Layout, (float)gGraphicsData.Resolution.Width / (float)gGraphicsData.Resolution.Height);
+
+	TRACE_END();
+
+	if (Result != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	TRACE_BEGIN("PlaceLabels");
+
+	GdiLabelFont(gSceneMeasureDC, gGraphicsData.HugeFont, &LabelFonts[LFS_HUGE]);
+
+	GdiLabelFont(gSceneMeasureDC, gGraphicsData.BigFont, &LabelFonts[LFS_BIG]);
+
+	GdiLabelFont(gSceneMeasureDC, gGraphicsData.SmallFont, &LabelFonts[LFS_SMALL]);
+
+	PlaceLabels(Storage, LabelFonts, NULL);
+
+	TRACE_END();
+
+	// From here on the copies belong to the scene.
+
+	Scene = CreateScene(Storage, Storage, Layout);
+
+	Storage = NULL;
+
+	if (Scene == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	PublishScene(Scene);
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Published a scene of %lu entities, laid out %s, in %llu ms.", __FUNCTIONW__, Scene->EntityCount, Layout == LM_PACKED ? L"packed" : L"in a row", GetTickCount64() - Started);
+
+	// The UI thread moves onto the new scene at the start of its next frame. Whatever is left when the user quits
+	// is freed by FreeScenes.
+
+	while (ReclaimScenes() > 0 && gContinue)
+	{
+		Sleep(SCENE_RECLAIM_INTERVAL_MS);
+	}
+
+Exit:
+
+	if (Storage)
+	{
+		HeapFree(GetProcessHeap(), 0, Storage);
+	}
+
+	if (gSceneMeasureDC)
+	{
+		DeleteDC(gSceneMeasureDC);
+
+		gSceneMeasureDC = NULL;
+	}
+
+	return(Result);
+}
+
+// Starts laying the scene out again with Layout, in the background. Only once there's a scene, and only one at a time.
+
+DWORD StartSceneRebuild(_In_ LAYOUT_MODE Layout)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	if (gScene == NULL || IsSceneRebuilding())
+	{
+		Result = ERROR_BUSY;
+
+		goto Exit;
+	}
+
+	if (gSceneRebuildThread)
+	{
+		CloseHandle(gSceneRebuildThread);
+	}
+
+	if ((gSceneRebuildThread = CreateThread(NULL, 0, SceneRebuildThreadProc, (LPVOID)(ULONG_PTR)Layout, 0, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create scene rebuild thread! Error 0x%08lx", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+Exit:
+
+	return(Result);
+}
+
+BOOL IsSceneRebuilding(void)
+{
+	return(gSceneRebuildThread != NULL && WaitForSingleObject(gSceneRebuildThread, 0) == WAIT_TIMEOUT);
+}
+
+// Waits for a rebuild that's running to finish. It can't be interrupted while it's laying out, but that doesn't
+// take long; after publishing, it stops waiting to free the old scene as soon as gContinue is cleared.
+
+void StopSceneRebuild(_In_ DWORD TimeoutMilliseconds)
+{
+	if (gSceneRebuildThread == NULL)
+	{
+		return;
+	}
+
+	if (WaitForSingleObject(gSceneRebuildThread, TimeoutMilliseconds) != WAIT_OBJECT_0)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] Scene rebuild thread did not stop within %dms.", __FUNCTIONW__, TimeoutMilliseconds);
+
+		return;
+	}
+
+	CloseHandle(gSceneRebuildThread);
+
+	gSceneRebuildThread = NULL;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+// What the UI thread draws from: every site, DC and domain, where each one goes and where its labels go, and the pick
+// and search indexes over them. A scene is never changed once it has been published. A new one is built in the
+// background, on its own copies of the entities, and swapped in with one pointer exchange; the UI thread moves onto it
+// at the start of its next frame, so no frame ever sees half of one layout and half of another, or waits for one to
+// be built. L builds one with the other layout; see LAYOUT_MODE.
+//
+// Only where things are is copied. Everything the background threads keep up to date (replication health, probe
+// results, DC details, the fqdn and domain once they're known, role flags, and whether it differs from a snapshot)
+// stays on the entities discovery made, and is read through ENTITY_LIVE, so it's never out of date in any scene.
+// The first scene is those entities themselves.
+//
+// A scene that has been replaced is freed once nothing can still be drawing it. Each thread that draws scenes has a
+// slot, which holds the epoch it started reading at, or zero while it isn't. Every publish moves the epoch on and
+// stamps the scene it replaced with the new one; a replaced scene can go once every slot is either zero or at least
+// its stamp, since whoever pinned after that can only have seen something newer. Readers never wait for the
+// publisher, and the publisher never waits for a frame; it only holds on to the old scene a little longer.
+//
+// Only one thread publishes at a time: discovery, the first time, and the rebuild thread after that.
+//
+// Include Pick.h, Search.h and Layout.h first.
+
+// How often the rebuild thread looks again at whether the scene it replaced can be freed.
+#define SCENE_RECLAIM_INTERVAL_MS	16
+
+#define SCENE_SHUTDOWN_TIMEOUT_MS	2000
+
+// One for each thread that draws scenes.
+typedef enum SCENE_READER
+{
+	SR_UI,
+
+	SR_COUNT
+
+} SCENE_READER;
+
+typedef struct SCENE
+{
+	// In discovery order. Status is read through ENTITY_LIVE.
+	ENTITY* Entities;
+
+	// The copies Entities is made of, in one allocation, or NULL when Entities is the list discovery made.
+	ENTITY* Storage;
+
+	DWORD EntityCount;
+
+	// Sites by SiteIndex, so the KCC what-if view can draw lines between where this scene put them. NULL if there
+	// is no site graph.
+	ENTITY** Sites;
+
+	DWORD SiteCount;
+
+	// Either could be NULL if there wasn't memory for it, the same as when discovery used to build them.
+	PICKINDEX* PickIndex;
+
+	SEARCHINDEX* SearchIndex;
+
+	LAYOUT_MODE Layout;
+
+	// Only used once the scene has been replaced, by the publisher.
+	struct SCENE* NextRetired;
+
+	LONG64 RetiredEpoch;
+
+} SCENE;
+
+SCENE* CreateScene(_In_ ENTITY* Entities, _In_opt_ ENTITY* Storage, _In_ LAYOUT_MODE Layout);
+
+void FreeScene(_In_opt_ SCENE* Scene);
+
+void PublishScene(_In_ SCENE* Scene);
+
+SCENE* AcquireScene(_In_ SCENE_READER Reader);
+
+void ReleaseScene(_In_ SCENE_READER Reader);
+
+BOOL IsNewSceneReady(_In_opt_ SCENE* Scene);
+
+DWORD ReclaimScenes(void);
+
+void FreeScenes(void);
+
+DWORD StartSceneRebuild(_In_ LAYOUT_MODE Layout);
+
+BOOL IsSceneRebuilding(void);
+
+void StopSceneRebuild(_In_ DWORD TimeoutMilliseconds);
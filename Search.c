@@ -0,0 +1,368 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Entity search. Queries are matched case-insensitively as substrings of each entity's name and fqdn. Matches at the
+// start of a name or fqdn come first, found by binary search over a sorted prefix list; the rest are found by
+// intersecting the posting lists of the query's trigrams and then checking each candidate for real.
+
+#include <Windows.h>
+
+#include <stdlib.h>
+
+#include "Main.h"
+
+#include "Search.h"
+
+
+
+static DWORD SearchTrigramBucket(_In_ const wchar_t* Text)
+{
+	UINT64 Trigram = ((UINT64)Text[0] << 32) | ((UINT64)Text[1] << 16) | (UINT64)Text[2];
+
+	// Fibonacci hashing; the top bits are the well mixed ones.
+
+	return((DWORD)((Trigram * 0x9E3779B97F4A7C15ULL) >> (64 - 16)) & (SEARCH_TRIGRAM_BUCKETS - 1));
+}
+
+static BOOL SearchIsTrigram(_In_ const wchar_t* Text)
+{
+	return(Text[0] && Text[1] && Text[2] &&
+		Text[0] != SEARCH_FIELD_SEPARATOR && Text[1] != SEARCH_FIELD_SEPARATOR && Text[2] != SEARCH_FIELD_SEPARATOR);
+}
+
+// Compares two keys up to the end of the field they're in.
+
+static int SearchCompareKeys(_In_ const wchar_t* A, _In_ const wchar_t* B)
+{
+	while (*A && *A != SEARCH_FIELD_SEPARATOR && *A == *B)
+	{
+		A++;
+
+		B++;
+	}
+
+	return((*A == SEARCH_FIELD_SEPARATOR ? 0 : (int)*A) - (*B == SEARCH_FIELD_SEPARATOR ? 0 : (int)*B));
+}
+
+static int __cdecl SearchComparePrefixes(_In_ const void* A, _In_ const void* B)
+{
+	return(SearchCompareKeys(((SEARCH_PREFIX*)A)->Key, ((SEARCH_PREFIX*)B)->Key));
+}
+
+void FreeSearchIndex(_In_opt_ SEARCHINDEX* Index)
+{
+	if (Index == NULL)
+	{
+		return;
+	}
+
+	void* Allocations[] = { Index->Entities, Index->Text, Index->TextPool, Index->Prefixes, Index->BucketStart, Index->Postings };
+
+	for (int Allocation = 0; Allocation < _countof(Allocations); Allocation++)
+	{
+		if (Allocations[Allocation])
+		{
+			HeapFree(GetProcessHeap(), 0, Allocations[Allocation]);
+		}
+	}
+
+	HeapFree(GetProcessHeap(), 0, Index);
+}
+
+SEARCHINDEX* BuildSearchIndex(_In_ ENTITY* Entities)
+{
+	SEARCHINDEX* Index = NULL;
+
+	size_t PoolLength = 0;
+
+	wchar_t* Cursor = NULL;
+
+	DWORD Postings = 0;
+
+	if ((Index = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(SEARCHINDEX))) == NULL)
+	{
+		goto Failed;
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		Index->EntityCount++;
+
+		PoolLength += wcslen(Current->name) + 1 + wcslen(Current->fqdn) + 1;
+	}
+
+	Index->Entities = HeapAlloc(GetProcessHeap(), 0, max(Index->EntityCount, 1) * sizeof(ENTITY*));
+
+	Index->Text = HeapAlloc(GetProcessHeap(), 0, max(Index->EntityCount, 1) * sizeof(wchar_t*));
+
+	Index->TextPool = HeapAlloc(GetProcessHeap(), 0, max(PoolLength, 1) * sizeof(wchar_t));
+
+	Index->Prefixes = HeapAlloc(GetProcessHeap(), 0, max(Index->EntityCount, 1) * 2 * sizeof(SEARCH_PREFIX));
+
+	Index->BucketStart = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (SEARCH_TRIGRAM_BUCKETS + 1) * sizeof(DWORD));
+
+	if (!Index->Entities || !Index->Text || !Index->TextPool || !Index->Prefixes || !Index->BucketStart)
+	{
+		goto Failed;
+	}
+
+	Cursor = Index->TextPool;
+
+	DWORD EntityIndex = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next, EntityIndex++)
+	{
+		size_t NameLength = wcslen(Current->name);
+
+		size_t FqdnLength = wcslen(Current->fqdn);
+
+		Index->Entities[EntityIndex] = Current;
+
+		Index->Text[EntityIndex] = Cursor;
+
+		memcpy(Cursor, Current->name, NameLength * sizeof(wchar_t));
+
+		Cursor[NameLength] = SEARCH_FIELD_SEPARATOR;
+
+		memcpy(&Cursor[NameLength + 1], Current->fqdn, FqdnLength * sizeof(wchar_t));
+
+		Cursor[NameLength + 1 + FqdnLength] = L'\0';
+
+		CharLowerBuffW(Cursor, (DWORD)(NameLength + 1 + FqdnLength));
+
+		if (NameLength)
+		{
+			Index->Prefixes[Index->PrefixCount].Key = Cursor;
+
+			Index->Prefixes[Index->PrefixCount++].Entity = EntityIndex;
+		}
+
+		if (FqdnLength && (NameLength != FqdnLength || _wcsnicmp(Current->name, Current->fqdn, NameLength) != 0))
+		{
+			Index->Prefixes[Index->PrefixCount].Key = &Cursor[NameLength + 1];
+
+			Index->Prefixes[Index->PrefixCount++].Entity = EntityIndex;
+		}
+
+		Cursor += NameLength + 1 + FqdnLength + 1;
+	}
+
+	qsort(Index->Prefixes, Index->PrefixCount, sizeof(SEARCH_PREFIX), SearchComparePrefixes);
+
+	// Two passes over every trigram: count how many entities land in each bucket, then fill the buckets in. Entities
+	// are visited in order, so each posting list comes out sorted, and an entity that has several trigrams in the same
+	// bucket is only listed once because it's always the last one added.
+
+	for (DWORD Entity = 0; Entity < Index->EntityCount; Entity++)
+	{
+		for (wchar_t* Text = Index->Text[Entity]; *Text; Text++)
+		{
+			if (SearchIsTrigram(Text))
+			{
+				Index->BucketStart[SearchTrigramBucket(Text) + 1]++;
+			}
+		}
+	}
+
+	for (DWORD Bucket = 0; Bucket < SEARCH_TRIGRAM_BUCKETS; Bucket++)
+	{
+		Index->BucketStart[Bucket + 1] += Index->BucketStart[Bucket];
+	}
+
+	if ((Index->Postings = HeapAlloc(GetProcessHeap(), 0, max(Index->BucketStart[SEARCH_TRIGRAM_BUCKETS], 1) * sizeof(DWORD))) == NULL)
+	{
+		goto Failed;
+	}
+
+	{
+		// Where the next posting goes in each bucket.
+
+		DWORD* Fill = HeapAlloc(GetProcessHeap(), 0, SEARCH_TRIGRAM_BUCKETS * sizeof(DWORD));
+
+		if (Fill == NULL)
+		{
+			goto Failed;
+		}
+
+		memcpy(Fill, Index->BucketStart, SEARCH_TRIGRAM_BUCKETS * sizeof(DWORD));
+
+		for (DWORD Entity = 0; Entity < Index->EntityCount; Entity++)
+		{
+			for (wchar_t* Text = Index->Text[Entity]; *Text; Text++)
+			{
+				if (SearchIsTrigram(Text))
+				{
+					DWORD Bucket = SearchTrigramBucket(Text);
+
+					if (Fill[Bucket] == Index->BucketStart[Bucket] || Index->Postings[Fill[Bucket] - 1] != Entity)
+					{
+						Index->Postings[Fill[Bucket]++] = Entity;
+					}
+				}
+			}
+		}
+
+		// Duplicates were skipped, so buckets may not be full. Close the gaps up.
+
+		for (DWORD Bucket = 0; Bucket < SEARCH_TRIGRAM_BUCKETS; Bucket++)
+		{
+			DWORD Length = Fill[Bucket] - Index->BucketStart[Bucket];
+
+			memmove(&Index->Postings[Postings], &Index->Postings[Index->BucketStart[Bucket]], Length * sizeof(DWORD));
+
+			Index->BucketStart[Bucket] = Postings;
+
+			Postings += Length;
+		}
+
+		Index->BucketStart[SEARCH_TRIGRAM_BUCKETS] = Postings;
+
+		HeapFree(GetProcessHeap(), 0, Fill);
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Indexed %lu entities, %lu prefixes, %lu trigram postings.", __FUNCTIONW__, Index->EntityCount, Index->PrefixCount, Postings);
+
+	return(Index);
+
+Failed:
+
+	LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+	FreeSearchIndex(Index);
+
+	return(NULL);
+}
+
+static BOOL SearchAddResult(_Inout_ ENTITY** Results, _Inout_ DWORD* Count, _In_ ENTITY* Entity)
+{
+	for (DWORD Result = 0; Result < *Count; Result++)
+	{
+		if (Results[Result] == Entity)
+		{
+			return(FALSE);
+		}
+	}
+
+	Results[(*Count)++] = Entity;
+
+	return(TRUE);
+}
+
+// Returns how many entities were written to Results: those with a name or fqdn starting with Query first, then
+// those that merely contain it.
+
+DWORD SearchQuery(_In_ SEARCHINDEX* Index, _In_ const wchar_t* Query, _Out_ ENTITY** Results, _In_ DWORD MaxResults)
+{
+	wchar_t Lowered[SEARCH_MAX_QUERY_CHARS + 1] = { 0 };
+
+	size_t Length = 0;
+
+	DWORD Count = 0;
+
+	DWORD Low = 0;
+
+	DWORD High = 0;
+
+	wcsncpy_s(Lowered, _countof(Lowered), Query, _TRUNCATE);
+
+	Length = wcslen(Lowered);
+
+	if (Length == 0 || MaxResults == 0 || Index == NULL)
+	{
+		return(0);
+	}
+
+	CharLowerBuffW(Lowered, (DWORD)Length);
+
+	// Prefix matches: find the first key that isn't less than the query, and take keys from there while they start with it.
+
+	High = Index->PrefixCount;
+
+	while (Low < High)
+	{
+		DWORD Middle = Low + (High - Low) / 2;
+
+		if (SearchCompareKeys(Index->Prefixes[Middle].Key, Lowered) < 0)
+		{
+			Low = Middle + 1;
+		}
+		else
+		{
+			High = Middle;
+		}
+	}
+
+	for (DWORD Prefix = Low; Prefix < Index->PrefixCount && Count < MaxResults; Prefix++)
+	{
+		if (wcsncmp(Index->Prefixes[Prefix].Key, Lowered, Length) != 0)
+		{
+			break;
+		}
+
+		SearchAddResult(Results, &Count, Index->Entities[Index->Prefixes[Prefix].Entity]);
+	}
+
+	if (Length < 3 || Count == MaxResults)
+	{
+		return(Count);
+	}
+
+	// Substring matches. Walk the shortest posting list, and keep a candidate only if every other trigram's list has it
+	// too and it really does contain the query. The lists are sorted, so each can be walked alongside with a cursor that
+	// only moves forward, and we stop as soon as we have enough results rather than intersecting everything.
+
+	DWORD* Lists[SEARCH_MAX_QUERY_CHARS] = { 0 };
+
+	DWORD ListLengths[SEARCH_MAX_QUERY_CHARS] = { 0 };
+
+	DWORD Cursors[SEARCH_MAX_QUERY_CHARS] = { 0 };
+
+	DWORD ListCount = 0;
+
+	DWORD Shortest = 0;
+
+	for (const wchar_t* Trigram = Lowered; Trigram[2]; Trigram++)
+	{
+		DWORD Bucket = SearchTrigramBucket(Trigram);
+
+		Lists[ListCount] = &Index->Postings[Index->BucketStart[Bucket]];
+
+		ListLengths[ListCount] = Index->BucketStart[Bucket + 1] - Index->BucketStart[Bucket];
+
+		if (ListLengths[ListCount] < ListLengths[Shortest])
+		{
+			Shortest = ListCount;
+		}
+
+		ListCount++;
+	}
+
+	for (DWORD Candidate = 0; Candidate < ListLengths[Shortest] && Count < MaxResults; Candidate++)
+	{
+		DWORD Entity = Lists[Shortest][Candidate];
+
+		BOOL InAll = TRUE;
+
+		for (DWORD List = 0; List < ListCount && InAll; List++)
+		{
+			if (List == Shortest)
+			{
+				continue;
+			}
+
+			while (Cursors[List] < ListLengths[List] && Lists[List][Cursors[List]] < Entity)
+			{
+				Cursors[List]++;
+			}
+
+			InAll = (Cursors[List] < ListLengths[List] && Lists[List][Cursors[List]] == Entity);
+		}
+
+		if (InAll && wcsstr(Index->Text[Entity], Lowered))
+		{
+			SearchAddResult(Results, &Count, Index->Entities[Entity]);
+		}
+	}
+
+	return(Count);
+}
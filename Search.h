@@ -0,0 +1,51 @@
+#pragma once
+
+// How many matches a query returns, at most. This is also how many lines the search box shows.
+#define SEARCH_MAX_RESULTS		12
+
+#define SEARCH_MAX_QUERY_CHARS	64
+
+// Trigram hash buckets. A power of two. Collisions only cost a little extra verification, never a wrong answer.
+#define SEARCH_TRIGRAM_BUCKETS	65536
+
+// Separates the name from the fqdn in an entity's search text. Never appears in a query, so a match can't span both.
+#define SEARCH_FIELD_SEPARATOR	L'\x01'
+
+typedef struct SEARCH_PREFIX
+{
+	const wchar_t* Key;
+
+	DWORD Entity;
+
+} SEARCH_PREFIX;
+
+// Built once discovery is done and never changed after, so any number of threads can query it at once.
+typedef struct SEARCHINDEX
+{
+	DWORD EntityCount;
+
+	ENTITY** Entities;
+
+	// Lower-cased "name<separator>fqdn" for every entity, all in one allocation.
+	wchar_t** Text;
+
+	wchar_t* TextPool;
+
+	// The start of every name and fqdn, sorted, for prefix matches. Also the only way to match queries of 1 or 2 characters.
+	DWORD PrefixCount;
+
+	SEARCH_PREFIX* Prefixes;
+
+	// Posting lists of entity indexes, one per trigram hash bucket, ascending. Bucket b's list is
+	// Postings[BucketStart[b]] up to Postings[BucketStart[b + 1]].
+	DWORD* BucketStart;
+
+	DWORD* Postings;
+
+} SEARCHINDEX;
+
+SEARCHINDEX* BuildSearchIndex(_In_ ENTITY* Entities);
+
+void FreeSearchIndex(_In_opt_ SEARCHINDEX* Index);
+
+DWORD SearchQuery(_In_ SEARCHINDEX* Index, _In_ const wchar_t* Query, _Out_ ENTITY** Results, _In_ DWORD MaxResults);
@@ -0,0 +1,731 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// The inter-site replication graph. See SiteGraph.h.
+
+#include <Windows.h>
+
+#include <Winldap.h>
+
+#include <Winber.h>
+
+#include <NtDsAPI.h>
+
+#include <stdlib.h>
+
+#include "Main.h"
+
+#include "Trace.h"
+
+#include "SiteGraph.h"
+
+#pragma comment(lib, "Wldap32.lib")
+
+typedef DWORD(*SITEGRAPH_ENTRY_PROC)(_In_ LDAP* Ldap, _In_ LDAPMessage* Entry, _Inout_ SITEGRAPH* Graph);
+
+
+
+static int __cdecl SiteGraphCompareSites(_In_ const void* A, _In_ const void* B)
+{
+	return(_wcsicmp((*(ENTITY**)A)->distinguishedname, (*(ENTITY**)B)->distinguishedname));
+}
+
+static int __cdecl SiteGraphCompareIndices(_In_ const void* A, _In_ const void* B)
+{
+	return((*(DWORD*)A > *(DWORD*)B) - (*(DWORD*)A < *(DWORD*)B));
+}
+
+static int __cdecl SiteGraphCompareConnections(_In_ const void* A, _In_ const void* B)
+{
+	const SITECONNECTION* ConnectionA = A;
+
+	const SITECONNECTION* ConnectionB = B;
+
+	if (ConnectionA->FromSite != ConnectionB->FromSite)
+	{
+		return((ConnectionA->FromSite > ConnectionB->FromSite) - (ConnectionA->FromSite < ConnectionB->FromSite));
+	}
+
+	return((ConnectionA->ToSite > ConnectionB->ToSite) - (ConnectionA->ToSite < ConnectionB->ToSite));
+}
+
+// Makes sure *Array has room for Needed elements, at least doubling it when it has to grow.
+
+static BOOL SiteGraphGrow(_Inout_ void** Array, _Inout_ DWORD* Capacity, _In_ DWORD Needed, _In_ SIZE_T ElementSize)
+{
+	DWORD NewCapacity = max(64, *Capacity);
+
+	void* NewArray = NULL;
+
+	if (Needed <= *Capacity)
+	{
+		return(TRUE);
+	}
+
+	while (NewCapacity < Needed)
+	{
+		NewCapacity *= 2;
+	}
+
+	NewArray = *Array ?
+		HeapReAlloc(GetProcessHeap(), 0, *Array, NewCapacity * ElementSize) :
+		HeapAlloc(GetProcessHeap(), 0, NewCapacity * ElementSize);
+
+	if (NewArray == NULL)
+	{
+		return(FALSE);
+	}
+
+	*Array = NewArray;
+
+	*Capacity = NewCapacity;
+
+	return(TRUE);
+}
+
+// Collects the sites of Entities, ready for links and connections to be added, and points every DC at its site.
+
+SITEGRAPH* CreateSiteGraph(_In_ ENTITY* Entities)
+{
+	SITEGRAPH* Graph = NULL;
+
+	DWORD SiteCount = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		SiteCount += (Current->Type == ET_SITE);
+	}
+
+	if ((Graph = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(SITEGRAPH))) == NULL ||
+		(Graph->Sites = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(SiteCount, 1) * sizeof(ENTITY*))) == NULL)
+	{
+		FreeSiteGraph(Graph);
+
+		return(NULL);
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		Current->SiteIndex = SITEGRAPH_NO_SITE;
+
+		if (Current->Type == ET_SITE)
+		{
+			Graph->Sites[Graph->SiteCount++] = Current;
+		}
+	}
+
+	qsort(Graph->Sites, Graph->SiteCount, sizeof(ENTITY*), SiteGraphCompareSites);
+
+	for (DWORD Site = 0; Site < Graph->SiteCount; Site++)
+	{
+		Graph->Sites[Site]->SiteIndex = Site;
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			Current->SiteIndex = SiteGraphFindSite(Graph, Current->site);
+		}
+	}
+
+	return(Graph);
+}
+
+// Returns the index of the site with the given distinguished name, or SITEGRAPH_NO_SITE.
+
+DWORD SiteGraphFindSite(_In_ SITEGRAPH* Graph, _In_ wchar_t* SiteDN)
+{
+	DWORD Low = 0;
+
+	DWORD High = Graph->SiteCount;
+
+	while (Low < High)
+	{
+		DWORD Middle = Low + ((High - Low) / 2);
+
+		int Comparison = _wcsicmp(SiteDN, Graph->Sites[Middle]->distinguishedname);
+
+		if (Comparison == 0)
+		{
+			return(Middle);
+		}
+
+		if (Comparison < 0)
+		{
+			High = Middle;
+		}
+		else
+		{
+			Low = Middle + 1;
+		}
+	}
+
+	return(SITEGRAPH_NO_SITE);
+}
+
+// Schedule may be NULL for a link that can always replicate. Sites are site indices, in any order.
+
+DWORD SiteGraphAddLink(_Inout_ SITEGRAPH* Graph, _In_ wchar_t* Name, _In_ DWORD Cost, _In_ DWORD IntervalMinutes, _In_opt_ UINT64* Schedule, _In_ DWORD* Sites, _In_ DWORD SiteCount)
+{
+	SITELINK* Link = NULL;
+
+	DWORD* LinkSites = NULL;
+
+	if (!SiteGraphGrow(&Graph->Links, &Graph->LinkCapacity, Graph->LinkCount + 1, sizeof(SITELINK)) ||
+		!SiteGraphGrow(&Graph->LinkSites, &Graph->LinkSiteCapacity, Graph->LinkSiteCount + SiteCount, sizeof(DWORD)))
+	{
+		return(ERROR_NOT_ENOUGH_MEMORY);
+	}
+
+	Link = &Graph->Links[Graph->LinkCount++];
+
+	memset(Link, 0, sizeof(SITELINK));
+
+	wcsncpy_s(Link->Name, _countof(Link->Name), Name, _TRUNCATE);
+
+	Link->Cost = Cost;
+
+	Link->IntervalMinutes = max(IntervalMinutes, SITEGRAPH_MIN_INTERVAL_MINUTES);
+
+	if (Schedule)
+	{
+		memcpy(Link->Schedule, Schedule, sizeof(Link->Schedule));
+	}
+	else
+	{
+		Link->Schedule[0] = MAXULONGLONG;
+
+		Link->Schedule[1] = MAXULONGLONG;
+
+		Link->Schedule[2] = (1ULL << (SITEGRAPH_HOURS_PER_WEEK - 128)) - 1;
+	}
+
+	Link->FirstSite = Graph->LinkSiteCount;
+
+	LinkSites = &Graph->LinkSites[Link->FirstSite];
+
+	memcpy(LinkSites, Sites, SiteCount * sizeof(DWORD));
+
+	qsort(LinkSites, SiteCount, sizeof(DWORD), SiteGraphCompareIndices);
+
+	// The same site listed twice would only confuse the simulators.
+
+	for (DWORD Site = 0; Site < SiteCount; Site++)
+	{
+		if (Link->SiteCount == 0 || LinkSites[Link->SiteCount - 1] != LinkSites[Site])
+		{
+			LinkSites[Link->SiteCount++] = LinkSites[Site];
+		}
+	}
+
+	Graph->LinkSiteCount += Link->SiteCount;
+
+	return(ERROR_SUCCESS);
+}
+
+DWORD SiteGraphAddConnection(_Inout_ SITEGRAPH* Graph, _In_ DWORD FromSite, _In_ DWORD ToSite)
+{
+	if (FromSite == ToSite || FromSite >= Graph->SiteCount || ToSite >= Graph->SiteCount)
+	{
+		return(ERROR_SUCCESS);
+	}
+
+	if (!SiteGraphGrow(&Graph->Connections, &Graph->ConnectionCapacity, Graph->ConnectionCount + 1, sizeof(SITECONNECTION)))
+	{
+		return(ERROR_NOT_ENOUGH_MEMORY);
+	}
+
+	Graph->Connections[Graph->ConnectionCount++] = (SITECONNECTION){ .FromSite = FromSite, .ToSite = ToSite, .Link = MAXDWORD };
+
+	return(ERROR_SUCCESS);
+}
+
+static BOOL SiteLinkContains(_In_ SITEGRAPH* Graph, _In_ SITELINK* Link, _In_ DWORD Site)
+{
+	return(bsearch(&Site, &Graph->LinkSites[Link->FirstSite], Link->SiteCount, sizeof(DWORD), SiteGraphCompareIndices) != NULL);
+}
+
+// Builds the per-site link index and matches every connection up with the site link it replicates over. Call again
+// after adding or changing links.
+
+DWORD FinalizeSiteGraph(_Inout_ SITEGRAPH* Graph)
+{
+	DWORD* Cursor = NULL;
+
+	DWORD Unique = 0;
+
+	if (Graph->SiteLinkFirst)
+	{
+		HeapFree(GetProcessHeap(), 0, Graph->SiteLinkFirst);
+	}
+
+	if (Graph->SiteLinks)
+	{
+		HeapFree(GetProcessHeap(), 0, Graph->SiteLinks);
+	}
+
+	Graph->SiteLinks = NULL;
+
+	if ((Graph->SiteLinkFirst = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ((SIZE_T)Graph->SiteCount + 1) * sizeof(DWORD))) == NULL ||
+		(Graph->SiteLinks = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Graph->LinkSiteCount, 1) * sizeof(DWORD))) == NULL ||
+		(Cursor = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Graph->SiteCount, 1) * sizeof(DWORD))) == NULL)
+	{
+		return(ERROR_NOT_ENOUGH_MEMORY);
+	}
+
+	for (DWORD Index = 0; Index < Graph->LinkSiteCount; Index++)
+	{
+		Graph->SiteLinkFirst[Graph->LinkSites[Index] + 1]++;
+	}
+
+	for (DWORD Site = 0; Site < Graph->SiteCount; Site++)
+	{
+		Graph->SiteLinkFirst[Site + 1] += Graph->SiteLinkFirst[Site];
+
+		Cursor[Site] = Graph->SiteLinkFirst[Site];
+	}
+
+	for (DWORD Link = 0; Link < Graph->LinkCount; Link++)
+	{
+		for (DWORD Index = 0; Index < Graph->Links[Link].SiteCount; Index++)
+		{
+			Graph->SiteLinks[Cursor[Graph->LinkSites[Graph->Links[Link].FirstSite + Index]]++] = Link;
+		}
+	}
+
+	HeapFree(GetProcessHeap(), 0, Cursor);
+
+	// Several DCs in one site usually pull from the same other site; for the site graph that's one edge.
+
+	qsort(Graph->Connections, Graph->ConnectionCount, sizeof(SITECONNECTION), SiteGraphCompareConnections);
+
+	for (DWORD Index = 0; Index < Graph->ConnectionCount; Index++)
+	{
+		SITECONNECTION* Connection = &Graph->Connections[Index];
+
+		if (Unique > 0 && Graph->Connections[Unique - 1].FromSite == Connection->FromSite && Graph->Connections[Unique - 1].ToSite == Connection->ToSite)
+		{
+			continue;
+		}
+
+		Connection->Link = MAXDWORD;
+
+		for (DWORD Index2 = Graph->SiteLinkFirst[Connection->FromSite]; Index2 < Graph->SiteLinkFirst[Connection->FromSite + 1]; Index2++)
+		{
+			SITELINK* Link = &Graph->Links[Graph->SiteLinks[Index2]];
+
+			if ((Connection->Link == MAXDWORD || Link->Cost < Graph->Links[Connection->Link].Cost) && SiteLinkContains(Graph, Link, Connection->ToSite))
+			{
+				Connection->Link = Graph->SiteLinks[Index2];
+			}
+		}
+
+		Graph->Connections[Unique++] = *Connection;
+	}
+
+	Graph->ConnectionCount = Unique;
+
+	return(ERROR_SUCCESS);
+}
+
+void FreeSiteGraph(_In_opt_ SITEGRAPH* Graph)
+{
+	if (Graph == NULL)
+	{
+		return;
+	}
+
+	void* Arrays[] = { Graph->Sites, Graph->Links, Graph->LinkSites, Graph->SiteLinkFirst, Graph->SiteLinks, Graph->Connections };
+
+	for (int Index = 0; Index < _countof(Arrays); Index++)
+	{
+		if (Arrays[Index])
+		{
+			HeapFree(GetProcessHeap(), 0, Arrays[Index]);
+		}
+	}
+
+	HeapFree(GetProcessHeap(), 0, Graph);
+}
+
+BOOL SiteLinkIsOpen(_In_ SITELINK* Link, _In_ UINT64 WeekHour)
+{
+	WeekHour %= SITEGRAPH_HOURS_PER_WEEK;
+
+	return((Link->Schedule[WeekHour / 64] >> (WeekHour % 64)) & 1);
+}
+
+// The schedule attribute is a SCHEDULE header followed by 168 bytes, one per hour of the week, of which the low four
+// bits say which quarter hours are open. An hour with any open quarter counts as open.
+
+static void SiteGraphParseSchedule(_In_ struct berval* Value, _Out_ UINT64* Schedule)
+{
+	SCHEDULE* Header = (SCHEDULE*)Value->bv_val;
+
+	Schedule[0] = MAXULONGLONG;
+
+	Schedule[1] = MAXULONGLONG;
+
+	Schedule[2] = (1ULL << (SITEGRAPH_HOURS_PER_WEEK - 128)) - 1;
+
+	if (Value->bv_len < sizeof(SCHEDULE) ||
+		Value->bv_len < FIELD_OFFSET(SCHEDULE, Schedules) + ((SIZE_T)Header->NumberOfSchedules * sizeof(SCHEDULE_HEADER)))
+	{
+		return;
+	}
+
+	for (DWORD Index = 0; Index < Header->NumberOfSchedules; Index++)
+	{
+		UCHAR* Hours = (UCHAR*)Value->bv_val + Header->Schedules[Index].Offset;
+
+		if (Header->Schedules[Index].Type != SCHEDULE_INTERVAL || (SIZE_T)Header->Schedules[Index].Offset + SITEGRAPH_HOURS_PER_WEEK > Value->bv_len)
+		{
+			continue;
+		}
+
+		memset(Schedule, 0, 3 * sizeof(UINT64));
+
+		for (DWORD Hour = 0; Hour < SITEGRAPH_HOURS_PER_WEEK; Hour++)
+		{
+			if (Hours[Hour] & 0x0F)
+			{
+				Schedule[Hour / 64] |= 1ULL << (Hour % 64);
+			}
+		}
+
+		return;
+	}
+}
+
+// Server, NTDS Settings and connection objects all live under CN=<server>,CN=Servers,<site DN>.
+
+static wchar_t* SiteGraphSiteOfServerObject(_In_ wchar_t* DN)
+{
+	for (wchar_t* Character = DN; *Character; Character++)
+	{
+		if (_wcsnicmp(Character, L",CN=Servers,", 12) == 0)
+		{
+			return(Character + 12);
+		}
+	}
+
+	return(NULL);
+}
+
+static DWORD SiteGraphAddLinkEntry(_In_ LDAP* Ldap, _In_ LDAPMessage* Entry, _Inout_ SITEGRAPH* Graph)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	wchar_t** Names = ldap_get_valuesW(Ldap, Entry, L"cn");
+
+	wchar_t** Costs = ldap_get_valuesW(Ldap, Entry, L"cost");
+
+	wchar_t** Intervals = ldap_get_valuesW(Ldap, Entry, L"replInterval");
+
+	wchar_t** SiteList = ldap_get_valuesW(Ldap, Entry, L"siteList");
+
+	struct berval** Schedules = ldap_get_values_lenW(Ldap, Entry, L"schedule");
+
+	ULONG SiteListCount = SiteList ? ldap_count_valuesW(SiteList) : 0;
+
+	DWORD* Sites = NULL;
+
+	DWORD SiteCount = 0;
+
+	UINT64 Schedule[3] = { 0 };
+
+	if ((Sites = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(SiteListCount, 1) * sizeof(DWORD))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	for (ULONG Index = 0; Index < SiteListCount; Index++)
+	{
+		DWORD Site = SiteGraphFindSite(Graph, SiteList[Index]);
+
+		if (Site != SITEGRAPH_NO_SITE)
+		{
+			Sites[SiteCount++] = Site;
+		}
+	}
+
+	if (Schedules && Schedules[0])
+	{
+		SiteGraphParseSchedule(Schedules[0], Schedule);
+	}
+
+	Result = SiteGraphAddLink(
+		Graph,
+		Names ? Names[0] : L"?",
+		Costs ? wcstoul(Costs[0], NULL, 10) : SITEGRAPH_DEF_COST,
+		Intervals ? wcstoul(Intervals[0], NULL, 10) : SITEGRAPH_DEF_INTERVAL_MINUTES,
+		(Schedules && Schedules[0]) ? Schedule : NULL,
+		Sites,
+		SiteCount);
+
+Exit:
+
+	if (Sites)
+	{
+		HeapFree(GetProcessHeap(), 0, Sites);
+	}
+
+	wchar_t** Values[] = { Names, Costs, Intervals, SiteList };
+
+	for (int Index = 0; Index < _countof(Values); Index++)
+	{
+		if (Values[Index])
+		{
+			ldap_value_freeW(Values[Index]);
+		}
+	}
+
+	if (Schedules)
+	{
+		ldap_value_free_len(Schedules);
+	}
+
+	return(Result);
+}
+
+static DWORD SiteGraphAddConnectionEntry(_In_ LDAP* Ldap, _In_ LDAPMessage* Entry, _Inout_ SITEGRAPH* Graph)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	wchar_t* DN = ldap_get_dnW(Ldap, Entry);
+
+	wchar_t** FromServer = ldap_get_valuesW(Ldap, Entry, L"fromServer");
+
+	wchar_t** Enabled = ldap_get_valuesW(Ldap, Entry, L"enabledConnection");
+
+	wchar_t* ToSiteDN = DN ? SiteGraphSiteOfServerObject(DN) : NULL;
+
+	wchar_t* FromSiteDN = FromServer ? SiteGraphSiteOfServerObject(FromServer[0]) : NULL;
+
+	// A connection that has been switched off doesn't carry anything.
+
+	if (ToSiteDN && FromSiteDN && (Enabled == NULL || _wcsicmp(Enabled[0], L"FALSE") != 0))
+	{
+		Result = SiteGraphAddConnection(Graph, SiteGraphFindSite(Graph, FromSiteDN), SiteGraphFindSite(Graph, ToSiteDN));
+	}
+
+	if (DN)
+	{
+		ldap_memfreeW(DN);
+	}
+
+	if (FromServer)
+	{
+		ldap_value_freeW(FromServer);
+	}
+
+	if (Enabled)
+	{
+		ldap_value_freeW(Enabled);
+	}
+
+	return(Result);
+}
+
+// Runs a paged subtree search, handing every entry that comes back to Proc.
+
+static DWORD SiteGraphSearch(_In_ LDAP* Ldap, _In_ wchar_t* Base, _In_ wchar_t* Filter, _In_ wchar_t** Attributes, _In_ SITEGRAPH_ENTRY_PROC Proc, _Inout_ SITEGRAPH* Graph)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	PLDAPSearch Search = NULL;
+
+	// How long we wait for each page, as opposed to how long the DC may spend on the search.
+
+	LDAP_TIMEVAL Timeout = { .tv_sec = gRegParams.DiscoveryCallTimeoutMs / 1000, .tv_usec = (gRegParams.DiscoveryCallTimeoutMs % 1000) * 1000 };
+
+	if ((Search = ldap_search_init_pageW(Ldap, Base, LDAP_SCOPE_SUBTREE, Filter, Attributes, FALSE, NULL, NULL, SITEGRAPH_LDAP_TIMEOUT_SECONDS, 0, NULL)) == NULL)
+	{
+		return(LdapMapErrorToWin32(LdapGetLastError()));
+	}
+
+	while (Result == ERROR_SUCCESS)
+	{
+		LDAPMessage* Page = NULL;
+
+		ULONG TotalCount = 0;
+
+		if (gContinue == FALSE)
+		{
+			Result = ERROR_CANCELLED;
+
+			break;
+		}
+
+		ULONG LdapResult = TRACED("ldap_get_next_page_s", ldap_get_next_page_s(Ldap, Search, &Timeout, SITEGRAPH_LDAP_PAGE_SIZE, &TotalCount, &Page));
+
+		if (LdapResult == LDAP_NO_RESULTS_RETURNED)
+		{
+			if (Page)
+			{
+				ldap_msgfree(Page);
+			}
+
+			break;
+		}
+
+		if (LdapResult != LDAP_SUCCESS)
+		{
+			Result = LdapMapErrorToWin32(LdapResult);
+		}
+
+		for (LDAPMessage* Entry = Page ? ldap_first_entry(Ldap, Page) : NULL; Entry != NULL && Result == ERROR_SUCCESS; Entry = ldap_next_entry(Ldap, Entry))
+		{
+			Result = Proc(Ldap, Entry, Graph);
+		}
+
+		if (Page)
+		{
+			ldap_msgfree(Page);
+		}
+	}
+
+	ldap_search_abandon_page(Ldap, Search);
+
+	return(Result);
+}
+
+// Reads every site link and inter-site connection from the configuration NC through DomainController, and builds a
+// finalized graph over the sites in Entities.
+
+DWORD DiscoverSiteGraph(_In_ wchar_t* DomainController, _In_ ENTITY* Entities, _Out_ SITEGRAPH** Graph)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	LDAP* Ldap = NULL;
+
+	LDAPMessage* RootDSE = NULL;
+
+	wchar_t** ConfigurationNC = NULL;
+
+	wchar_t Base[512] = { 0 };
+
+	ULONG Version = LDAP_VERSION3;
+
+	ULONG TimeLimit = SITEGRAPH_LDAP_TIMEOUT_SECONDS;
+
+	LDAP_TIMEVAL ConnectTimeout = { .tv_sec = gRegParams.DiscoveryCallTimeoutMs / 1000, .tv_usec = (gRegParams.DiscoveryCallTimeoutMs % 1000) * 1000 };
+
+	wchar_t* RootDSEAttributes[] = { L"configurationNamingContext", NULL };
+
+	wchar_t* LinkAttributes[] = { L"cn", L"cost", L"replInterval", L"siteList", L"schedule", NULL };
+
+	wchar_t* ConnectionAttributes[] = { L"fromServer", L"enabledConnection", NULL };
+
+	SITEGRAPH* New = NULL;
+
+	*Graph = NULL;
+
+	// DsGetDcName hands back names like \\dc01.contoso.com.
+
+	while (*DomainController == L'\\')
+	{
+		DomainController++;
+	}
+
+	if ((New = CreateSiteGraph(Entities)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	if ((Ldap = ldap_initW(DomainController, LDAP_PORT)) == NULL)
+	{
+		Result = LdapMapErrorToWin32(LdapGetLastError());
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] ldap_initW failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	ldap_set_optionW(Ldap, LDAP_OPT_PROTOCOL_VERSION, &Version);
+
+	ldap_set_optionW(Ldap, LDAP_OPT_REFERRALS, LDAP_OPT_OFF);
+
+	ldap_set_optionW(Ldap, LDAP_OPT_TIMELIMIT, &TimeLimit);
+
+	// Without an explicit connect, the bind below would wait as long as TCP does for a DC that has gone away.
+
+	if ((Result = LdapMapErrorToWin32(TRACED("ldap_connect", ldap_connect(Ldap, &ConnectTimeout)))) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] ldap_connect failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	if ((Result = LdapMapErrorToWin32(TRACED("ldap_bind_sW", ldap_bind_sW(Ldap, NULL, NULL, LDAP_AUTH_NEGOTIATE)))) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] ldap_bind_sW failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	if ((Result = LdapMapErrorToWin32(TRACED("ldap_search_sW", ldap_search_sW(Ldap, L"", LDAP_SCOPE_BASE, L"(objectClass=*)", RootDSEAttributes, FALSE, &RootDSE)))) != ERROR_SUCCESS ||
+		(ConfigurationNC = ldap_get_valuesW(Ldap, ldap_first_entry(Ldap, RootDSE), L"configurationNamingContext")) == NULL)
+	{
+		Result = (Result != ERROR_SUCCESS) ? Result : ERROR_DS_NO_ATTRIBUTE_OR_VALUE;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Reading configurationNamingContext from the RootDSE failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	_snwprintf_s(Base, _countof(Base), _TRUNCATE, L"CN=Inter-Site Transports,CN=Sites,%s", ConfigurationNC[0]);
+
+	if ((Result = SiteGraphSearch(Ldap, Base, L"(objectClass=siteLink)", LinkAttributes, SiteGraphAddLinkEntry, New)) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Reading site links failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	_snwprintf_s(Base, _countof(Base), _TRUNCATE, L"CN=Sites,%s", ConfigurationNC[0]);
+
+	if ((Result = SiteGraphSearch(Ldap, Base, L"(objectClass=nTDSConnection)", ConnectionAttributes, SiteGraphAddConnectionEntry, New)) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Reading connection objects failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	if ((Result = FinalizeSiteGraph(New)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Site graph has %lu sites, %lu site links and %lu inter-site connections.", __FUNCTIONW__, New->SiteCount, New->LinkCount, New->ConnectionCount);
+
+	*Graph = New;
+
+	New = NULL;
+
+Exit:
+
+	FreeSiteGraph(New);
+
+	if (ConfigurationNC)
+	{
+		ldap_value_freeW(ConfigurationNC);
+	}
+
+	if (RootDSE)
+	{
+		ldap_msgfree(RootDSE);
+	}
+
+	if (Ldap)
+	{
+		ldap_unbind(Ldap);
+	}
+
+	return(Result);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+// The inter-site replication graph: which sites each site link joins, what the links cost, how often and when they
+// replicate, and which inter-site connection objects the KCC has actually created. Read over LDAP from the
+// configuration NC, since NtDsAPI has nothing for site links.
+
+#define SITEGRAPH_LDAP_PAGE_SIZE		500
+
+#define SITEGRAPH_LDAP_TIMEOUT_SECONDS	60
+
+// What AD assumes when a site link doesn't say.
+#define SITEGRAPH_DEF_COST				100
+
+#define SITEGRAPH_DEF_INTERVAL_MINUTES	180
+
+// AD won't replicate over a site link more often than this.
+#define SITEGRAPH_MIN_INTERVAL_MINUTES	15
+
+#define SITEGRAPH_HOURS_PER_WEEK		168
+
+// Entity SiteIndex of anything that isn't a site in the graph, or a DC in one.
+#define SITEGRAPH_NO_SITE				MAXDWORD
+
+typedef struct SITELINK
+{
+	wchar_t Name[64];
+
+	DWORD Cost;
+
+	DWORD IntervalMinutes;
+
+	// One bit per hour of the week, UTC, starting Sunday midnight. Set if replication may happen during that hour.
+	UINT64 Schedule[3];
+
+	// The link's sites are LinkSites[FirstSite] up to LinkSites[FirstSite + SiteCount], sorted.
+	DWORD FirstSite;
+
+	DWORD SiteCount;
+
+} SITELINK;
+
+// Changes flow from FromSite to ToSite: some DC in ToSite has a connection object pulling from a DC in FromSite.
+typedef struct SITECONNECTION
+{
+	DWORD FromSite;
+
+	DWORD ToSite;
+
+	// The cheapest site link containing both sites, whose schedule the connection follows. MAXDWORD if there isn't one.
+	DWORD Link;
+
+} SITECONNECTION;
+
+typedef struct SITEGRAPH
+{
+	// Sorted by distinguished name. Each site entity's SiteIndex is its position here.
+	DWORD SiteCount;
+
+	ENTITY** Sites;
+
+	DWORD LinkCount;
+
+	DWORD LinkCapacity;
+
+	SITELINK* Links;
+
+	DWORD LinkSiteCount;
+
+	DWORD LinkSiteCapacity;
+
+	DWORD* LinkSites;
+
+	// The links each site is in: SiteLinks[SiteLinkFirst[Site]] up to SiteLinks[SiteLinkFirst[Site + 1]]. Built by
+	// FinalizeSiteGraph.
+	DWORD* SiteLinkFirst;
+
+	DWORD* SiteLinks;
+
+	// Inter-site only, at most one per ordered pair of sites once finalized.
+	DWORD ConnectionCount;
+
+	DWORD ConnectionCapacity;
+
+	SITECONNECTION* Connections;
+
+} SITEGRAPH;
+
+SITEGRAPH* CreateSiteGraph(_In_ ENTITY* Entities);
+
+DWORD SiteGraphFindSite(_In_ SITEGRAPH* Graph, _In_ wchar_t* SiteDN);
+
+DWORD SiteGraphAddLink(_Inout_ SITEGRAPH* Graph, _In_ wchar_t* Name, _In_ DWORD Cost, _In_ DWORD IntervalMinutes, _In_opt_ UINT64* Schedule, _In_ DWORD* Sites, _In_ DWORD SiteCount);
+
+DWORD SiteGraphAddConnection(_Inout_ SITEGRAPH* Graph, _In_ DWORD FromSite, _In_ DWORD ToSite);
+
+DWORD FinalizeSiteGraph(_Inout_ SITEGRAPH* Graph);
+
+void FreeSiteGraph(_In_opt_ SITEGRAPH* Graph);
+
+DWORD DiscoverSiteGraph(_In_ wchar_t* DomainController, _In_ ENTITY* Entities, _Out_ SITEGRAPH** Graph);
+
+BOOL SiteLinkIsOpen(_In_ SITELINK* Link, _In_ UINT64 WeekHour);
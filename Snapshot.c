@@ -0,0 +1,519 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Saving and loading snapshots of the discovered topology. See Snapshot.h for the file layout.
+
+#include <Windows.h>
+
+#include "Main.h"
+
+#include "Snapshot.h"
+
+
+
+// Writes to FileHandle, or to Output in memory when FileHandle is INVALID_HANDLE_VALUE.
+
+typedef struct SNAPSHOT_WRITER
+{
+	HANDLE FileHandle;
+
+	DWORD Result;
+
+	DWORD Used;
+
+	BYTE* Output;
+
+	DWORD OutputUsed;
+
+	DWORD OutputCapacity;
+
+	BYTE Buffer[SNAPSHOT_BUFFER_BYTES];
+
+} SNAPSHOT_WRITER;
+
+static void SnapshotFlush(_Inout_ SNAPSHOT_WRITER* Writer)
+{
+	DWORD Written = 0;
+
+	if (Writer->Used == 0 || Writer->Result != ERROR_SUCCESS)
+	{
+		Writer->Used = 0;
+
+		return;
+	}
+
+	if (Writer->FileHandle != INVALID_HANDLE_VALUE)
+	{
+		if (WriteFile(Writer->FileHandle, Writer->Buffer, Writer->Used, &Written, NULL) == FALSE)
+		{
+			Writer->Result = GetLastError();
+		}
+	}
+	else
+	{
+		if (Writer->OutputUsed + Writer->Used > Writer->OutputCapacity)
+		{
+			DWORD Capacity = max(Writer->OutputCapacity * 2, Writer->OutputUsed + Writer->Used);
+
+			BYTE* Output = Writer->Output ?
+				HeapReAlloc(GetProcessHeap(), 0, Writer->Output, Capacity) :
+				HeapAlloc(GetProcessHeap(), 0, Capacity);
+
+			if (Output == NULL)
+			{
+				Writer->Result = ERROR_NOT_ENOUGH_MEMORY;
+
+				Writer->Used = 0;
+
+				return;
+			}
+
+			Writer->Output = Output;
+
+			Writer->OutputCapacity = Capacity;
+		}
+
+		memcpy(&Writer->Output[Writer->OutputUsed], Writer->Buffer, Writer->Used);
+
+		Writer->OutputUsed += Writer->Used;
+	}
+
+	Writer->Used = 0;
+}
+
+static void SnapshotWrite(_Inout_ SNAPSHOT_WRITER* Writer, _In_ const void* Data, _In_ DWORD Size)
+{
+	const BYTE* Bytes = Data;
+
+	while (Size > 0)
+	{
+		DWORD Chunk = min(Size, SNAPSHOT_BUFFER_BYTES - Writer->Used);
+
+		memcpy(&Writer->Buffer[Writer->Used], Bytes, Chunk);
+
+		Writer->Used += Chunk;
+
+		Bytes += Chunk;
+
+		Size -= Chunk;
+
+		if (Writer->Used == SNAPSHOT_BUFFER_BYTES)
+		{
+			SnapshotFlush(Writer);
+		}
+	}
+}
+
+static void SnapshotWriteEntity(_Inout_ SNAPSHOT_WRITER* Writer, _In_ ENTITY* Entity)
+{
+	// Where it is comes from the entity passed in, which may be a scene's copy; everything else comes from the entity
+	// that's kept up to date.
+	ENTITY* Live = ENTITY_LIVE(Entity);
+
+	SNAPSHOT_ENTITY Record = {
+		.Type = Live->Type,
+		.x = Entity->x,
+		.y = Entity->y,
+		.width = Entity->width,
+		.height = Entity->height,
+		.DCsInSite = Live->DCsInSite,
+		.Flags = Live->Flags,
+		.NameLength = (UINT16)wcsnlen(Live->name, _countof(Live->name)),
+		.FqdnLength = (UINT16)wcsnlen(Live->fqdn, _countof(Live->fqdn)),
+		.DistinguishedNameLength = (UINT16)wcsnlen(Live->distinguishedname, _countof(Live->distinguishedname)),
+		.NtdsSettingsDNLength = (UINT16)wcsnlen(Live->ntdssettingsdn, _countof(Live->ntdssettingsdn)),
+		.SiteLength = (UINT16)wcsnlen(Live->site, _countof(Live->site)),
+		.DomainLength = (UINT16)wcsnlen(Live->domain, _countof(Live->domain)) };
+
+	SnapshotWrite(Writer, &Record, sizeof(Record));
+
+	SnapshotWrite(Writer, Live->name, Record.NameLength * sizeof(wchar_t));
+
+	SnapshotWrite(Writer, Live->fqdn, Record.FqdnLength * sizeof(wchar_t));
+
+	SnapshotWrite(Writer, Live->distinguishedname, Record.DistinguishedNameLength * sizeof(wchar_t));
+
+	SnapshotWrite(Writer, Live->ntdssettingsdn, Record.NtdsSettingsDNLength * sizeof(wchar_t));
+
+	SnapshotWrite(Writer, Live->site, Record.SiteLength * sizeof(wchar_t));
+
+	SnapshotWrite(Writer, Live->domain, Record.DomainLength * sizeof(wchar_t));
+}
+
+DWORD SaveSnapshot(_In_ wchar_t* FileName, _In_ ENTITY* Entities, _In_ BOOL LaidOut)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	SNAPSHOT_WRITER* Writer = NULL;
+
+	SNAPSHOT_HEADER Header = { .Magic = SNAPSHOT_MAGIC, .Version = SNAPSHOT_VERSION, .Flags = LaidOut ? SNAPSHOT_FLAG_LAID_OUT : 0 };
+
+	LARGE_INTEGER Distance = { 0 };
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		Header.EntityCount++;
+	}
+
+	GetSystemTimeAsFileTime(&Header.Created);
+
+	wcscpy_s(Header.ForestName, _countof(Header.ForestName), gForestName);
+
+	if ((Writer = HeapAlloc(GetProcessHeap(), 0, sizeof(SNAPSHOT_WRITER))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	Writer->Result = ERROR_SUCCESS;
+
+	Writer->Used = 0;
+
+	if ((Writer->FileHandle = CreateFileW(FileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+	// Write a header with a bad magic number first, and only put the real one in once everything else has made it to
+	// disk, so a half-written snapshot can never be mistaken for a good one.
+
+	Header.Magic = 0;
+
+	SnapshotWrite(Writer, &Header, sizeof(Header));
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		SnapshotWriteEntity(Writer, Current);
+	}
+
+	SnapshotFlush(Writer);
+
+	if (Writer->Result == ERROR_SUCCESS)
+	{
+		Header.Magic = SNAPSHOT_MAGIC;
+
+		SetFilePointerEx(Writer->FileHandle, Distance, NULL, FILE_BEGIN);
+
+		SnapshotWrite(Writer, &Header, sizeof(Header));
+
+		SnapshotFlush(Writer);
+	}
+
+	if ((Result = Writer->Result) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Saved %lu entities to %s.", __FUNCTIONW__, Header.EntityCount, FileName);
+
+Exit:
+
+	if (Writer)
+	{
+		if (Writer->FileHandle != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(Writer->FileHandle);
+		}
+
+		HeapFree(GetProcessHeap(), 0, Writer);
+	}
+
+	return(Result);
+}
+
+// Writes Count entities, in order, to a new buffer in the same format as a snapshot file. On success *Data belongs to
+// the caller, to free with HeapFree. Positions are written but the snapshot isn't marked as laid out.
+
+DWORD SaveSnapshotToMemory(_In_ ENTITY** Entities, _In_ DWORD Count, _Out_ BYTE** Data, _Out_ DWORD* Size)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	SNAPSHOT_WRITER* Writer = NULL;
+
+	SNAPSHOT_HEADER Header = { .Magic = SNAPSHOT_MAGIC, .Version = SNAPSHOT_VERSION, .EntityCount = Count };
+
+	*Data = NULL;
+
+	*Size = 0;
+
+	GetSystemTimeAsFileTime(&Header.Created);
+
+	wcscpy_s(Header.ForestName, _countof(Header.ForestName), gForestName);
+
+	if ((Writer = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(SNAPSHOT_WRITER))) == NULL)
+	{
+		return(ERROR_NOT_ENOUGH_MEMORY);
+	}
+
+	Writer->FileHandle = INVALID_HANDLE_VALUE;
+
+	SnapshotWrite(Writer, &Header, sizeof(Header));
+
+	for (DWORD Index = 0; Index < Count; Index++)
+	{
+		SnapshotWriteEntity(Writer, Entities[Index]);
+	}
+
+	SnapshotFlush(Writer);
+
+	if ((Result = Writer->Result) == ERROR_SUCCESS)
+	{
+		*Data = Writer->Output;
+
+		*Size = Writer->OutputUsed;
+	}
+	else if (Writer->Output)
+	{
+		HeapFree(GetProcessHeap(), 0, Writer->Output);
+	}
+
+	HeapFree(GetProcessHeap(), 0, Writer);
+
+	return(Result);
+}
+
+// Copies Length characters out of the file into Destination, if they fit. Advances Offset past them either way.
+
+static BOOL SnapshotReadString(_In_ BYTE* File, _In_ UINT64 FileSize, _Inout_ UINT64* Offset, _In_ UINT16 Length, _Out_ wchar_t* Destination, _In_ size_t Capacity)
+{
+	UINT64 Bytes = (UINT64)Length * sizeof(wchar_t);
+
+	if (Length >= Capacity || *Offset + Bytes > FileSize)
+	{
+		return(FALSE);
+	}
+
+	memcpy(Destination, &File[*Offset], Bytes);
+
+	Destination[Length] = L'\0';
+
+	*Offset += Bytes;
+
+	return(TRUE);
+}
+
+// Reads a snapshot that's already in memory into a new entity list. On success *Entities is the head of the list,
+// which belongs to the caller, and Header, if given, gets a copy of the snapshot's header; on failure *Entities is NULL
+// and nothing is left allocated. Returns ERROR_BAD_FORMAT for something that isn't a snapshot and ERROR_INVALID_DATA
+// for one that's damaged.
+
+DWORD ReadSnapshot(_In_ BYTE* Data, _In_ UINT64 Size, _Out_ ENTITY** Entities, _Out_opt_ SNAPSHOT_HEADER* Header)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	SNAPSHOT_HEADER* FileHeader = (SNAPSHOT_HEADER*)Data;
+
+	UINT64 Offset = sizeof(SNAPSHOT_HEADER);
+
+	ENTITY* Head = NULL;
+
+	ENTITY* Tail = NULL;
+
+	*Entities = NULL;
+
+	if (Size < sizeof(SNAPSHOT_HEADER) || FileHeader->Magic != SNAPSHOT_MAGIC || FileHeader->Version < 1 || FileHeader->Version > SNAPSHOT_VERSION)
+	{
+		Result = ERROR_BAD_FORMAT;
+
+		goto Exit;
+	}
+
+	for (DWORD Index = 0; Index < FileHeader->EntityCount; Index++)
+	{
+		SNAPSHOT_ENTITY Record = { 0 };
+
+		ENTITY* New = NULL;
+
+		if (Offset + sizeof(Record) > Size)
+		{
+			Result = ERROR_INVALID_DATA;
+
+			goto Exit;
+		}
+
+		memcpy(&Record, &Data[Offset], sizeof(Record));
+
+		Offset += sizeof(Record);
+
+		if ((New = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(ENTITY))) == NULL)
+		{
+			Result = ERROR_NOT_ENOUGH_MEMORY;
+
+			goto Exit;
+		}
+
+		if (Tail)
+		{
+			Tail->Next = New;
+		}
+		else
+		{
+			Head = New;
+		}
+
+		Tail = New;
+
+		New->Type = Record.Type <= ET_TRUST ? (ENTITY_TYPE)Record.Type : ET_NONE;
+
+		New->x = Record.x;
+
+		New->y = Record.y;
+
+		New->width = Record.width;
+
+		New->height = Record.height;
+
+		New->DCsInSite = Record.DCsInSite;
+
+		New->Flags = Record.Flags;
+
+		if (!SnapshotReadString(Data, Size, &Offset, Record.NameLength, New->name, _countof(New->name)) ||
+			!SnapshotReadString(Data, Size, &Offset, Record.FqdnLength, New->fqdn, _countof(New->fqdn)) ||
+			!SnapshotReadString(Data, Size, &Offset, Record.DistinguishedNameLength, New->distinguishedname, _countof(New->distinguishedname)) ||
+			!SnapshotReadString(Data, Size, &Offset, Record.NtdsSettingsDNLength, New->ntdssettingsdn, _countof(New->ntdssettingsdn)) ||
+			!SnapshotReadString(Data, Size, &Offset, Record.SiteLength, New->site, _countof(New->site)) ||
+			!SnapshotReadString(Data, Size, &Offset, Record.DomainLength, New->domain, _countof(New->domain)))
+		{
+			Result = ERROR_INVALID_DATA;
+
+			goto Exit;
+		}
+	}
+
+	if (Header)
+	{
+		*Header = *FileHeader;
+
+		Header->ForestName[_countof(Header->ForestName) - 1] = L'\0';
+	}
+
+	*Entities = Head;
+
+	Head = NULL;
+
+Exit:
+
+	FreeEntities(Head);
+
+	return(Result);
+}
+
+// Reads a whole snapshot file into a new entity list, as ReadSnapshot does, and takes the forest name from it.
+
+DWORD LoadSnapshot(_In_ wchar_t* FileName, _Out_ ENTITY** Entities, _Out_opt_ BOOL* LaidOut)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	HANDLE FileHandle = INVALID_HANDLE_VALUE;
+
+	LARGE_INTEGER FileSize = { 0 };
+
+	BYTE* File = NULL;
+
+	DWORD BytesRead = 0;
+
+	SNAPSHOT_HEADER Header = { 0 };
+
+	*Entities = NULL;
+
+	if (LaidOut)
+	{
+		*LaidOut = FALSE;
+	}
+
+	if ((FileHandle = CreateFileW(FileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to open %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+	if (GetFileSizeEx(FileHandle, &FileSize) == FALSE)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	if (FileSize.QuadPart < (LONGLONG)sizeof(SNAPSHOT_HEADER) || FileSize.QuadPart > MAXDWORD)
+	{
+		Result = ERROR_INVALID_DATA;
+
+		goto Exit;
+	}
+
+	if ((File = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)FileSize.QuadPart)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	if (ReadFile(FileHandle, File, (DWORD)FileSize.QuadPart, &BytesRead, NULL) == FALSE || BytesRead != FileSize.QuadPart)
+	{
+		Result = GetLastError() ? GetLastError() : ERROR_HANDLE_EOF;
+
+		goto Exit;
+	}
+
+	if ((Result = ReadSnapshot(File, FileSize.QuadPart, Entities, &Header)) == ERROR_BAD_FORMAT)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] %s is not a version 1 to %d snapshot, or was not completely written!", __FUNCTIONW__, FileName, SNAPSHOT_VERSION);
+	}
+
+	if (Result != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	wcscpy_s(gForestName, _countof(gForestName), Header.ForestName);
+
+	if (LaidOut)
+	{
+		*LaidOut = (Header.Flags & SNAPSHOT_FLAG_LAID_OUT) != 0;
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Loaded %lu entities from %s.", __FUNCTIONW__, Header.EntityCount, FileName);
+
+Exit:
+
+	if (Result == ERROR_INVALID_DATA)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] %s is damaged!", __FUNCTIONW__, FileName);
+	}
+
+	if (File)
+	{
+		HeapFree(GetProcessHeap(), 0, File);
+	}
+
+	if (FileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(FileHandle);
+	}
+
+	return(Result);
+}
+
+// Frees an entity list where every entity was allocated on its own, as NewEntity and LoadSnapshot do.
+
+void FreeEntities(_In_opt_ ENTITY* Entities)
+{
+	while (Entities)
+	{
+		ENTITY* Next = Entities->Next;
+
+		HeapFree(GetProcessHeap(), 0, Entities);
+
+		Entities = Next;
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// A snapshot is the discovered topology saved to a file, so it can be collected in one place and looked at in another.
+//
+// File layout: a SNAPSHOT_HEADER, then for every entity a SNAPSHOT_ENTITY followed by its strings, in the order of
+// the length fields, as UTF-16 without terminators.
+
+#define SNAPSHOT_MAGIC				0x56544441	// "ADTV"
+
+// Version 2 added the domain string. Version 1 snapshots, which wrote zero in its place, can still be loaded.
+#define SNAPSHOT_VERSION			2
+
+#define SNAPSHOT_DEF_FILE_NAME		L"ADTV_snapshot.adtv"
+
+#define SNAPSHOT_BUFFER_BYTES		65536
+
+// The entities have positions; LayoutTopology doesn't need to be run after loading.
+#define SNAPSHOT_FLAG_LAID_OUT		1
+
+typedef struct SNAPSHOT_HEADER
+{
+	DWORD Magic;
+
+	DWORD Version;
+
+	DWORD Flags;
+
+	DWORD EntityCount;
+
+	FILETIME Created;
+
+	wchar_t ForestName[256];
+
+} SNAPSHOT_HEADER;
+
+typedef struct SNAPSHOT_ENTITY
+{
+	DWORD Type;
+
+	INT32 x;
+
+	INT32 y;
+
+	INT32 width;
+
+	INT32 height;
+
+	DWORD DCsInSite;
+
+	DWORD Flags;
+
+	UINT16 NameLength;
+
+	UINT16 FqdnLength;
+
+	UINT16 DistinguishedNameLength;
+
+	UINT16 NtdsSettingsDNLength;
+
+	UINT16 SiteLength;
+
+	UINT16 DomainLength;
+
+} SNAPSHOT_ENTITY;
+
+DWORD SaveSnapshot(_In_ wchar_t* FileName, _In_ ENTITY* Entities, _In_ BOOL LaidOut);
+
+DWORD SaveSnapshotToMemory(_In_ ENTITY** Entities, _In_ DWORD Count, _Out_ BYTE** Data, _Out_ DWORD* Size);
+
+DWORD LoadSnapshot(_In_ wchar_t* FileName, _Out_ ENTITY** Entities, _Out_opt_ BOOL* LaidOut);
+
+DWORD ReadSnapshot(_In_ BYTE* Data, _In_ UINT64 Size, _Out_ ENTITY** Entities, _Out_opt_ SNAPSHOT_HEADER* Header);
+
+void FreeEntities(_In_opt_ ENTITY* Entities);
@@ -0,0 +1,1102 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// The zoomed-out scene, drawn into tiles in the background. See TilePyramid.h.
+//
+// One worker thread draws tiles; the UI thread only ever blits them. Each frame, DrawTiles posts the tiles it needs
+// that aren't drawn or are out of date, replacing whatever it posted the frame before, and the worker draws them in
+// that order. With nothing posted, it keeps the top of the pyramid drawn, for the minimap and to stand in for tiles
+// that aren't ready yet. Every TILE_SWEEP_MS it also looks for entities that would be drawn differently now, and marks
+// the tiles around them stale. A stale tile is still shown until it has been drawn again, so a DC changing colour
+// shows up a moment late rather than as a hole in the map.
+//
+// Tiles are looked up by level, column and row in a hash table over a fixed array of slots. The worker is the only
+// thing that adds, evicts or draws tiles, and the sweep runs on it too, so a tile can't go stale while it's being
+// drawn. gTileLock is held by the UI thread for as long as it's blitting, and by the worker only to change a slot.
+
+#include <Windows.h>
+
+#include "Main.h"
+
+#include "Trace.h"
+
+#include "RenderList.h"
+
+#include "Pick.h"
+
+#include "TilePyramid.h"
+
+#define TILE_NONE	MAXDWORD
+
+typedef struct TILE_KEY
+{
+	int Level;
+
+	int Column;
+
+	int Row;
+
+} TILE_KEY;
+
+typedef struct TILE
+{
+	TILE_KEY Key;
+
+	// Drawn at least once, so it can be shown, even if it's stale.
+	BOOL Drawn;
+
+	// Something in it has changed since it was drawn.
+	BOOL Stale;
+
+	// There was nothing to draw in it. Pixels is NULL and nothing is blitted.
+	BOOL Empty;
+
+	// TILE_SIZE * TILE_SIZE, bottom-up like the back buffer. Kept when the slot is reused.
+	DWORD* Pixels;
+
+	// The frame it was last shown on; the least recently shown tile is the first to go.
+	UINT64 LastUsedFrame;
+
+	// The next slot in the same hash bucket, or TILE_NONE.
+	DWORD Next;
+
+} TILE;
+
+// What a tile is being drawn with, for TileRecordItem.
+typedef struct TILE_DRAW_CONTEXT
+{
+	RENDER_LIST* List;
+
+	ENTITY_TYPE Type;
+
+	float Scale;
+
+	int OriginX;
+
+	int OriginY;
+
+	DC_COLOR_MODE ColorMode;
+
+	DWORD Count;
+
+} TILE_DRAW_CONTEXT;
+
+// Where a tile on screen comes from: its own pixels, or a square of those of a tile a level or two above it.
+typedef struct TILE_SOURCE
+{
+	TILE* Tile;
+
+	RECT Destination;
+
+	int X;
+
+	int Y;
+
+	int Size;
+
+} TILE_SOURCE;
+
+
+
+static PICKINDEX* gTileIndex;
+
+// The bounding box of every site and DC, in world units.
+static RECT gTileWorld;
+
+static int gTileLevels;
+
+// What EntityAppearance said about each of gTileIndex->Items when the worker last looked.
+static UINT32* gTileAppearances;
+
+static CRITICAL_SECTION gTileLock;
+
+static TILE gTiles[TILE_CACHE_MAX_TILES];
+
+static DWORD gTileBuckets[TILE_HASH_BUCKETS];
+
+static DWORD gTilesInUse;
+
+static TILE_KEY gTilesWanted[TILE_MAX_VISIBLE];
+
+static DWORD gTilesWantedCount;
+
+// How far the worker has got through gTilesWanted.
+static DWORD gTilesWantedNext;
+
+// The last frame DrawTiles was called for. Tiles drawn since count as used on it, so they aren't evicted straight away.
+static UINT64 gTileFrame;
+
+// The colour mode the UI thread last drew with. Tiles are drawn, and the sweep compares, in this.
+static volatile DC_COLOR_MODE gTileColorMode;
+
+static BITMAPINFO gTileBitmapInfo;
+
+static HANDLE gTileThread;
+
+static HANDLE gTileStopEvent;
+
+static HANDLE gTileWakeEvent;
+
+// Whether gTileStopEvent has been set, so a StopTilePyramid that's polled every frame only sets it once.
+static BOOL gTileStopping;
+
+static INT64 TileFloorDivide(_In_ INT64 Numerator, _In_ INT64 Denominator)
+{
+	INT64 Quotient = Numerator / Denominator;
+
+	if ((Numerator % Denominator) != 0 && ((Numerator < 0) != (Denominator < 0)))
+	{
+		Quotient--;
+	}
+
+	return(Quotient);
+}
+
+static int TileAltitude(_In_ int Level)
+{
+	return(TILE_MIN_ALTITUDE << Level);
+}
+
+// How many world units a tile is across, at Level.
+static int TileSpan(_In_ int Level)
+{
+	return(TILE_SIZE * TileAltitude(Level));
+}
+
+// The world, and the margin drawn around it, as columns and rows of tiles at Level.
+static void TileWorldRange(_In_ int Level, _Out_ RECT* Range)
+{
+	int Margin = TILE_MARGIN_PIXELS * TileAltitude(Level);
+
+	Range->left = (LONG)TileFloorDivide((INT64)gTileWorld.left - Margin, TileSpan(Level));
+
+	Range->top = (LONG)TileFloorDivide((INT64)gTileWorld.top - Margin, TileSpan(Level));
+
+	Range->right = (LONG)TileFloorDivide((INT64)gTileWorld.right + Margin - 1, TileSpan(Level));
+
+	Range->bottom = (LONG)TileFloorDivide((INT64)gTileWorld.bottom + Margin - 1, TileSpan(Level));
+}
+
+// The part of the world that a tile's pixels show, plus the margin around it that can still be drawn into it.
+static void TileWorldRect(_In_ TILE_KEY* Key, _Out_ RECT* World)
+{
+	int Span = TileSpan(Key->Level);
+
+	int Margin = TILE_MARGIN_PIXELS * TileAltitude(Key->Level);
+
+	SetRect(World, Key->Column * Span - Margin, Key->Row * Span - Margin, (Key->Column + 1) * Span + Margin, (Key->Row + 1) * Span + Margin);
+}
+
+static void TileTopKey(_Out_ TILE_KEY* Key)
+{
+	Key->Level = gTileLevels - 1;
+
+	Key->Column = (int)TileFloorDivide(gTileWorld.left, TileSpan(Key->Level));
+
+	Key->Row = (int)TileFloorDivide(gTileWorld.top, TileSpan(Key->Level));
+}
+
+static DWORD TileHash(_In_ TILE_KEY* Key)
+{
+	return(((DWORD)Key->Level * 2654435761u ^ (DWORD)Key->Column * 73856093u ^ (DWORD)Key->Row * 19349663u) & (TILE_HASH_BUCKETS - 1));
+}
+
+static BOOL TileKeysEqual(_In_ TILE_KEY* A, _In_ TILE_KEY* B)
+{
+	return(A->Level == B->Level && A->Column == B->Column && A->Row == B->Row);
+}
+
+// Call with gTileLock held.
+static TILE* TileFind(_In_ TILE_KEY* Key)
+{
+	for (DWORD Slot = gTileBuckets[TileHash(Key)]; Slot != TILE_NONE; Slot = gTiles[Slot].Next)
+	{
+		if (TileKeysEqual(&gTiles[Slot].Key, Key))
+		{
+			return(&gTiles[Slot]);
+		}
+	}
+
+	return(NULL);
+}
+
+// Takes a free slot for Key, or the one shown least recently if there are none. The top of the pyramid is never the
+// one taken. Call with gTileLock held.
+static TILE* TileInsert(_In_ TILE_KEY* Key)
+{
+	DWORD Slot = TILE_NONE;
+
+	TILE* Tile = NULL;
+
+	if (gTilesInUse < TILE_CACHE_MAX_TILES)
+	{
+		Slot = gTilesInUse++;
+	}
+	else
+	{
+		DWORD* Link = NULL;
+
+		TILE_KEY Top = { 0 };
+
+		TileTopKey(&Top);
+
+		for (DWORD Candidate = 0; Candidate < TILE_CACHE_MAX_TILES; Candidate++)
+		{
+			if (TileKeysEqual(&gTiles[Candidate].Key, &Top) == FALSE &&
+				(Slot == TILE_NONE || gTiles[Candidate].LastUsedFrame < gTiles[Slot].LastUsedFrame))
+			{
+				Slot = Candidate;
+			}
+		}
+
+		// Unlink it from its bucket, wherever it is in it.
+
+		Link = &gTileBuckets[TileHash(&gTiles[Slot].Key)];
+
+		while (*Link != Slot)
+		{
+			Link = &gTiles[*Link].Next;
+		}
+
+		*Link = gTiles[Slot].Next;
+	}
+
+	Tile = &gTiles[Slot];
+
+	Tile->Key = *Key;
+
+	Tile->Drawn = FALSE;
+
+	Tile->Stale = FALSE;
+
+	Tile->Empty = FALSE;
+
+	Tile->LastUsedFrame = gTileFrame;
+
+	Tile->Next = gTileBuckets[TileHash(Key)];
+
+	gTileBuckets[TileHash(Key)] = Slot;
+
+	return(Tile);
+}
+
+// Picks the next tile for the worker to draw, if there's anything to do. Call with gTileLock held.
+static BOOL TileNextWanted(_Out_ TILE_KEY* Key)
+{
+	TILE* Tile = NULL;
+
+	while (gTilesWantedNext < gTilesWantedCount)
+	{
+		*Key = gTilesWanted[gTilesWantedNext++];
+
+		if ((Tile = TileFind(Key)) == NULL || Tile->Drawn == FALSE || Tile->Stale)
+		{
+			return(TRUE);
+		}
+	}
+
+	TileTopKey(Key);
+
+	return((Tile = TileFind(Key)) == NULL || Tile->Drawn == FALSE || Tile->Stale);
+}
+
+static void TileRecordItem(_In_ PICK_ITEM* Item, _In_ void* Parameter)
+{
+	TILE_DRAW_CONTEXT* Context = Parameter;
+
+	ENTITY* Entity = Item->Entity;
+
+	RECT Rect = { 0 };
+
+	if (Entity->Type != Context->Type)
+	{
+		return;
+	}
+
+	SetRect(
+		&Rect,
+		(int)(Entity->x * Context->Scale) - Context->OriginX,
+		(int)(Entity->y * Context->Scale) - Context->OriginY,
+		(int)((Entity->x * Context->Scale) + Entity->width * Context->Scale) - Context->OriginX,
+		(int)((Entity->y * Context->Scale) + Entity->height * Context->Scale) - Context->OriginY);
+
+	RecordEntityShape(Context->List, Entity, &Rect, Context->ColorMode);
+
+	Context->Count++;
+}
+
+// Draws the tile at Key into the worker's bitmap. Returns how many entities were drawn in it.
+
+static DWORD TileDraw(_In_ TILE_KEY* Key, _Inout_ RENDER_LIST* List, _In_ HDC DeviceContext, _Out_ void* Bits)
+{
+	TILE_DRAW_CONTEXT Context = { 0 };
+
+	RECT World = { 0 };
+
+	TileWorldRect(Key, &World);
+
+	Context.List = List;
+
+	Context.Scale = 1.0f / TileAltitude(Key->Level);
+
+	Context.OriginX = Key->Column * TILE_SIZE;
+
+	Context.OriginY = Key->Row * TILE_SIZE;
+
+	Context.ColorMode = gTileColorMode;
+
+	ResetRenderList(List, TILE_SIZE, TILE_SIZE);
+
+	// Sites first and then DCs, as RecordScene has them, so that DCs stay on top.
+
+	Context.Type = ET_SITE;
+
+	VisitPickItems(gTileIndex, &World, TileRecordItem, &Context);
+
+	Context.Type = ET_DC;
+
+	VisitPickItems(gTileIndex, &World, TileRecordItem, &Context);
+
+	if (List->Result != ERROR_SUCCESS)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] Tile %d,%d at level %d is missing some of its commands: 0x%08lx.", __FUNCTIONW__, Key->Column, Key->Row, Key->Level, List->Result);
+	}
+
+	memset(Bits, 0, TILE_SIZE * TILE_SIZE * sizeof(DWORD));
+
+	if (Context.Count > 0)
+	{
+		PlayRenderList(List, DeviceContext);
+
+		GdiFlush();
+	}
+
+	return(Context.Count);
+}
+
+// Looks for entities that would be drawn differently than when the worker last looked, and marks the tiles around
+// them stale. The first time, there's nothing drawn to mark; it only has to remember how everything looks.
+
+static void TileSweep(void)
+{
+	RECT Changed[TILE_SWEEP_MAX_CHANGES];
+
+	DWORD ChangedCount = 0;
+
+	DC_COLOR_MODE ColorMode = gTileColorMode;
+
+	for (DWORD Item = 0; Item < gTileIndex->ItemCount; Item++)
+	{
+		UINT32 Appearance = EntityAppearance(gTileIndex->Items[Item].Entity, ColorMode);
+
+		if (Appearance == gTileAppearances[Item])
+		{
+			continue;
+		}
+
+		gTileAppearances[Item] = Appearance;
+
+		if (ChangedCount < TILE_SWEEP_MAX_CHANGES)
+		{
+			Changed[ChangedCount] = gTileIndex->Items[Item].Bounds;
+		}
+
+		ChangedCount++;
+	}
+
+	if (ChangedCount == 0)
+	{
+		return;
+	}
+
+	EnterCriticalSection(&gTileLock);
+
+	for (DWORD Slot = 0; Slot < gTilesInUse; Slot++)
+	{
+		TILE* Tile = &gTiles[Slot];
+
+		RECT World = { 0 };
+
+		RECT Overlap = { 0 };
+
+		if (Tile->Drawn == FALSE || Tile->Stale)
+		{
+			continue;
+		}
+
+		if (ChangedCount > TILE_SWEEP_MAX_CHANGES)
+		{
+			Tile->Stale = TRUE;
+
+			continue;
+		}
+
+		TileWorldRect(&Tile->Key, &World);
+
+		for (DWORD Change = 0; Change < ChangedCount; Change++)
+		{
+			if (IntersectRect(&Overlap, &World, &Changed[Change]))
+			{
+				Tile->Stale = TRUE;
+
+				break;
+			}
+		}
+	}
+
+	LeaveCriticalSection(&gTileLock);
+}
+
+static DWORD WINAPI TileWorkerThreadProc(_In_ LPVOID Parameter)
+{
+	HANDLE Handles[] = { gTileStopEvent, gTileWakeEvent };
+
+	DWORD Result = ERROR_SUCCESS;
+
+	HDC DeviceContext = NULL;
+
+	HBITMAP Bitmap = NULL;
+
+	void* Bits = NULL;
+
+	RENDER_LIST* List = NULL;
+
+	UINT64 LastSweep = 0;
+
+	UNREFERENCED_PARAMETER(Parameter);
+
+	TRACE_THREAD_NAME(L"Tiles");
+
+	if ((DeviceContext = CreateCompatibleDC(NULL)) == NULL ||
+		(Bitmap = CreateDIBSection(DeviceContext, &gTileBitmapInfo, DIB_RGB_COLORS, &Bits, NULL, 0)) == NULL ||
+		(List = CreateRenderList()) == NULL)
+	{
+		Result = (List == NULL && Bitmap != NULL) ? ERROR_NOT_ENOUGH_MEMORY : GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to set up for drawing tiles! Error 0x%08lx", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	SelectObject(DeviceContext, Bitmap);
+
+	SetBkMode(DeviceContext, TRANSPARENT);
+
+	TileSweep();
+
+	LastSweep = GetTickCount64();
+
+	while (WaitForSingleObject(gTileStopEvent, 0) != WAIT_OBJECT_0)
+	{
+		TILE_KEY Key = { 0 };
+
+		TILE* Tile = NULL;
+
+		DWORD Count = 0;
+
+		if (GetTickCount64() - LastSweep >= TILE_SWEEP_MS)
+		{
+			TRACE_BEGIN("SweepTiles");
+
+			TileSweep();
+
+			TRACE_END();
+
+			LastSweep = GetTickCount64();
+		}
+
+		EnterCriticalSection(&gTileLock);
+
+		if (TileNextWanted(&Key))
+		{
+			if ((Tile = TileFind(&Key)) == NULL)
+			{
+				Tile = TileInsert(&Key);
+			}
+
+			// Anything that changes from here on is drawn as it is now, so the tile is up to date once it's drawn.
+
+			Tile->Stale = FALSE;
+		}
+
+		LeaveCriticalSection(&gTileLock);
+
+		if (Tile == NULL)
+		{
+			if (WaitForMultipleObjects(_countof(Handles), Handles, FALSE, TILE_SWEEP_MS) == WAIT_OBJECT_0)
+			{
+				break;
+			}
+
+			continue;
+		}
+
+		TRACE_BEGIN("DrawTile");
+
+		Count = TileDraw(&Key, List, DeviceContext, Bits);
+
+		TRACE_END();
+
+		EnterCriticalSection(&gTileLock);
+
+		if (Count == 0)
+		{
+			if (Tile->Pixels)
+			{
+				HeapFree(GetProcessHeap(), 0, Tile->Pixels);
+
+				Tile->Pixels = NULL;
+			}
+
+			Tile->Empty = TRUE;
+
+			Tile->Drawn = TRUE;
+		}
+		else if (Tile->Pixels || (Tile->Pixels = HeapAlloc(GetProcessHeap(), 0, TILE_SIZE * TILE_SIZE * sizeof(DWORD))) != NULL)
+		{
+			memcpy(Tile->Pixels, Bits, TILE_SIZE * TILE_SIZE * sizeof(DWORD));
+
+			Tile->Empty = FALSE;
+
+			Tile->Drawn = TRUE;
+		}
+
+		LeaveCriticalSection(&gTileLock);
+	}
+
+Exit:
+
+	FreeRenderList(List);
+
+	if (DeviceContext)
+	{
+		DeleteDC(DeviceContext);
+	}
+
+	if (Bitmap)
+	{
+		DeleteObject(Bitmap);
+	}
+
+	return(Result);
+}
+
+// Starts drawing tiles of everything in Index, which has to stay as it is until StopTilePyramid. With nothing in it,
+// there's nothing to draw, and DrawTiles always says so.
+
+DWORD StartTilePyramid(_In_ PICKINDEX* Index)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	BOOL LockInitialized = FALSE;
+
+	if (Index->NodeCount == 0)
+	{
+		goto Exit;
+	}
+
+	gTileIndex = Index;
+
+	gTileWorld = Index->Nodes[0].Bounds;
+
+	// Enough levels that the whole world fits in one tile at the top, so there's always something to fall back on.
+
+	for (gTileLevels = 1; gTileLevels < TILE_MAX_LEVELS; gTileLevels++)
+	{
+		RECT Range = { 0 };
+
+		TileWorldRange(gTileLevels - 1, &Range);
+
+		if (Range.left == Range.right && Range.top == Range.bottom)
+		{
+			break;
+		}
+	}
+
+	if ((gTileAppearances = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, Index->ItemCount * sizeof(UINT32))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	memset(gTiles, 0, sizeof(gTiles));
+
+	memset(gTileBuckets, 0xFF, sizeof(gTileBuckets));
+
+	gTilesInUse = 0;
+
+	gTilesWantedCount = 0;
+
+	gTilesWantedNext = 0;
+
+	gTileBitmapInfo.bmiHeader.biSize = sizeof(gTileBitmapInfo.bmiHeader);
+
+	gTileBitmapInfo.bmiHeader.biWidth = TILE_SIZE;
+
+	gTileBitmapInfo.bmiHeader.biHeight = TILE_SIZE;
+
+	gTileBitmapInfo.bmiHeader.biBitCount = 32;
+
+	gTileBitmapInfo.bmiHeader.biCompression = BI_RGB;
+
+	gTileBitmapInfo.bmiHeader.biPlanes = 1;
+
+	InitializeCriticalSection(&gTileLock);
+
+	LockInitialized = TRUE;
+
+	gTileStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+	gTileWakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+	if (gTileStopEvent == NULL || gTileWakeEvent == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] CreateEventW failed with 0x%08lx!", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	if ((gTileThread = CreateThread(NULL, 0, TileWorkerThreadProc, NULL, 0, NULL)) == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create tile worker thread! Error 0x%08lx", __FUNCTIONW__, Result);
+
+		goto Exit;
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Drawing tiles of %lu entities, in %d levels.", __FUNCTIONW__, Index->ItemCount, gTileLevels);
+
+Exit:
+
+	// Leave it as StopTilePyramid would have, so DrawTiles finds no worker and it can be started again later.
+
+	if (Result != ERROR_SUCCESS)
+	{
+		if (gTileStopEvent)
+		{
+			CloseHandle(gTileStopEvent);
+
+			gTileStopEvent = NULL;
+		}
+
+		if (gTileWakeEvent)
+		{
+			CloseHandle(gTileWakeEvent);
+
+			gTileWakeEvent = NULL;
+		}
+
+		if (LockInitialized)
+		{
+			DeleteCriticalSection(&gTileLock);
+		}
+
+		if (gTileAppearances)
+		{
+			HeapFree(GetProcessHeap(), 0, gTileAppearances);
+
+			gTileAppearances = NULL;
+		}
+
+		gTileIndex = NULL;
+	}
+
+	return(Result);
+}
+
+// Stops the worker and lets go of every tile, so the pyramid can be started again on something else. FALSE if the
+// worker is still going, in which case it's still using the index it was started with. With a timeout of zero, this
+// only asks the worker to stop and checks whether it has, so it can be called every frame until it has.
+
+BOOL StopTilePyramid(_In_ DWORD TimeoutMilliseconds)
+{
+	if (gTileThread == NULL)
+	{
+		return(TRUE);
+	}
+
+	if (gTileStopping == FALSE)
+	{
+		SetEvent(gTileStopEvent);
+
+		gTileStopping = TRUE;
+	}
+
+	if (WaitForSingleObject(gTileThread, TimeoutMilliseconds) != WAIT_OBJECT_0)
+	{
+		// It's still using everything below, so leave it all be.
+
+		if (TimeoutMilliseconds)
+		{
+			LogEventW(LL_WARN, LF_FILE, L"[%s] Tile worker did not stop within %dms.", __FUNCTIONW__, TimeoutMilliseconds);
+		}
+
+		return(FALSE);
+	}
+
+	CloseHandle(gTileThread);
+
+	gTileThread = NULL;
+
+	gTileStopping = FALSE;
+
+	CloseHandle(gTileStopEvent);
+
+	gTileStopEvent = NULL;
+
+	CloseHandle(gTileWakeEvent);
+
+	gTileWakeEvent = NULL;
+
+	DeleteCriticalSection(&gTileLock);
+
+	for (DWORD Slot = 0; Slot < TILE_CACHE_MAX_TILES; Slot++)
+	{
+		if (gTiles[Slot].Pixels)
+		{
+			HeapFree(GetProcessHeap(), 0, gTiles[Slot].Pixels);
+		}
+	}
+
+	memset(gTiles, 0, sizeof(gTiles));
+
+	HeapFree(GetProcessHeap(), 0, gTileAppearances);
+
+	gTileAppearances = NULL;
+
+	gTileIndex = NULL;
+
+	return(TRUE);
+}
+
+// Blits the scene from tiles, for a Width x Height back buffer seen through Camera. Returns FALSE without drawing
+// anything if the camera is too low for tiles, or some of the screen has nothing ready to show; draw the scene as
+// usual then. Tiles that were missing or out of date are drawn in the background for a later frame.
+
+BOOL DrawTiles(_In_ HDC DeviceContext, _In_ CAMERA* Camera, _In_ int Width, _In_ int Height, _In_ DC_COLOR_MODE ColorMode, _In_ UINT64 Frame)
+{
+	static TILE_SOURCE Sources[TILE_MAX_VISIBLE];
+
+	DWORD SourceCount = 0;
+
+	BOOL Missing = FALSE;
+
+	int Level = 0;
+
+	int Span = 0;
+
+	RECT Range = { 0 };
+
+	RECT Visible = { 0 };
+
+	if (gTileThread == NULL || Camera->z < TILE_MIN_ALTITUDE)
+	{
+		return(FALSE);
+	}
+
+	gTileColorMode = ColorMode;
+
+	while (Level + 1 < gTileLevels && TileAltitude(Level + 1) <= Camera->z)
+	{
+		Level++;
+	}
+
+	Span = TileSpan(Level);
+
+	// The camera's x and y are in screen pixels at its own altitude, so the left of the screen is x * z in the world.
+
+	TileWorldRange(Level, &Range);
+
+	Visible.left = max(Range.left, (LONG)TileFloorDivide((INT64)Camera->x * Camera->z, Span));
+
+	Visible.top = max(Range.top, (LONG)TileFloorDivide((INT64)Camera->y * Camera->z, Span));
+
+	Visible.right = min(Range.right, (LONG)TileFloorDivide((INT64)(Camera->x + Width) * Camera->z - 1, Span));
+
+	Visible.bottom = min(Range.bottom, (LONG)TileFloorDivide((INT64)(Camera->y + Height) * Camera->z - 1, Span));
+
+	if (Visible.right >= Visible.left && Visible.bottom >= Visible.top &&
+		(INT64)(Visible.right - Visible.left + 1) * (Visible.bottom - Visible.top + 1) > TILE_MAX_VISIBLE)
+	{
+		return(FALSE);
+	}
+
+	EnterCriticalSection(&gTileLock);
+
+	gTileFrame = Frame;
+
+	gTilesWantedCount = 0;
+
+	gTilesWantedNext = 0;
+
+	for (int Row = Visible.top; Row <= Visible.bottom; Row++)
+	{
+		for (int Column = Visible.left; Column <= Visible.right; Column++)
+		{
+			TILE_SOURCE* Source = &Sources[SourceCount++];
+
+			TILE_KEY Key = { .Level = Level, .Column = Column, .Row = Row };
+
+			TILE* Tile = TileFind(&Key);
+
+			// Each edge is worked out the same way for the tiles either side of it, so they meet without a gap.
+
+			SetRect(
+				&Source->Destination,
+				(int)TileFloorDivide((INT64)Column * Span, Camera->z) - Camera->x,
+				(int)TileFloorDivide((INT64)Row * Span, Camera->z) - Camera->y,
+				(int)TileFloorDivide((INT64)(Column + 1) * Span, Camera->z) - Camera->x,
+				(int)TileFloorDivide((INT64)(Row + 1) * Span, Camera->z) - Camera->y);
+
+			Source->Tile = NULL;
+
+			if (Tile == NULL || Tile->Drawn == FALSE || Tile->Stale)
+			{
+				gTilesWanted[gTilesWantedCount++] = Key;
+			}
+
+			// Kept whether or not this frame can be drawn from tiles, so drawing the rest doesn't evict it.
+
+			if (Tile)
+			{
+				Tile->LastUsedFrame = Frame;
+			}
+
+			if (Tile && Tile->Drawn)
+			{
+				Source->Tile = Tile;
+
+				Source->X = 0;
+
+				Source->Y = 0;
+
+				Source->Size = TILE_SIZE;
+
+				continue;
+			}
+
+			for (int Up = 1; Up <= TILE_MAX_FALLBACK_LEVELS && Level + Up < gTileLevels; Up++)
+			{
+				TILE_KEY ParentKey = {
+					.Level = Level + Up,
+					.Column = (int)TileFloorDivide(Column, 1LL << Up),
+					.Row = (int)TileFloorDivide(Row, 1LL << Up) };
+
+				TILE* Parent = TileFind(&ParentKey);
+
+				if (Parent && Parent->Drawn)
+				{
+					Parent->LastUsedFrame = Frame;
+
+					Source->Tile = Parent;
+
+					Source->Size = TILE_SIZE >> Up;
+
+					Source->X = (Column - (ParentKey.Column << Up)) * Source->Size;
+
+					Source->Y = (Row - (ParentKey.Row << Up)) * Source->Size;
+
+					break;
+				}
+			}
+
+			if (Source->Tile == NULL)
+			{
+				Missing = TRUE;
+			}
+		}
+	}
+
+	if (gTilesWantedCount > 0)
+	{
+		SetEvent(gTileWakeEvent);
+	}
+
+	if (Missing == FALSE)
+	{
+		// Shrinking by less than half only ever drops one of two rows or columns, so nothing two pixels wide is lost.
+		// Only when the camera is above the top level does it need blending, which costs more.
+
+		if (TileAltitude(Level) * 2 <= Camera->z)
+		{
+			SetStretchBltMode(DeviceContext, HALFTONE);
+
+			SetBrushOrgEx(DeviceContext, 0, 0, NULL);
+		}
+		else
+		{
+			SetStretchBltMode(DeviceContext, COLORONCOLOR);
+		}
+
+		for (DWORD Index = 0; Index < SourceCount; Index++)
+		{
+			TILE_SOURCE* Source = &Sources[Index];
+
+			if (Source->Tile->Empty)
+			{
+				continue;
+			}
+
+			// The tiles are bottom-up, so their source rectangles are measured from the bottom.
+
+			StretchDIBits(
+				DeviceContext,
+				Source->Destination.left,
+				Source->Destination.top,
+				Source->Destination.right - Source->Destination.left,
+				Source->Destination.bottom - Source->Destination.top,
+				Source->X,
+				TILE_SIZE - Source->Y - Source->Size,
+				Source->Size,
+				Source->Size,
+				Source->Tile->Pixels,
+				&gTileBitmapInfo,
+				DIB_RGB_COLORS,
+				SRCCOPY);
+		}
+	}
+
+	LeaveCriticalSection(&gTileLock);
+
+	return(Missing == FALSE);
+}
+
+// Draws the top of the pyramid, the whole forest, in the top right corner of a Width x Height back buffer, with the
+// part Camera is looking at outlined. Returns FALSE if it isn't drawn yet.
+
+BOOL DrawMinimap(_In_ HDC DeviceContext, _In_ CAMERA* Camera, _In_ int Width, _In_ int Height, _In_ DC_COLOR_MODE ColorMode, _In_ HBRUSH FrameBrush, _In_ HBRUSH ViewBrush)
+{
+	TILE_KEY Key = { 0 };
+
+	TILE* Tile = NULL;
+
+	RECT Source = { 0 };
+
+	RECT Box = { 0 };
+
+	RECT Image = { 0 };
+
+	RECT View = { 0 };
+
+	float Scale = 0.0f;
+
+	int Altitude = 0;
+
+	if (gTileThread == NULL)
+	{
+		return(FALSE);
+	}
+
+	gTileColorMode = ColorMode;
+
+	TileTopKey(&Key);
+
+	Altitude = TileAltitude(Key.Level);
+
+	// The part of the top tile the world is in, in its own pixels.
+
+	Source.left = (gTileWorld.left - (Key.Column * TileSpan(Key.Level))) / Altitude;
+
+	Source.top = (gTileWorld.top - (Key.Row * TileSpan(Key.Level))) / Altitude;
+
+	Source.right = min(TILE_SIZE, max(Source.left + 1, (gTileWorld.right - (Key.Column * TileSpan(Key.Level)) + Altitude - 1) / Altitude));
+
+	Source.bottom = min(TILE_SIZE, max(Source.top + 1, (gTileWorld.bottom - (Key.Row * TileSpan(Key.Level)) + Altitude - 1) / Altitude));
+
+	Scale = min((float)MINIMAP_WIDTH / (Source.right - Source.left), (float)MINIMAP_HEIGHT / (Source.bottom - Source.top));
+
+	Image.right = Width - MINIMAP_MARGIN - 1;
+
+	Image.left = Image.right - max(1, (int)((Source.right - Source.left) * Scale));
+
+	Image.top = MINIMAP_MARGIN + 1 + max(0, (MINIMAP_MIN_HEIGHT - (int)((Source.bottom - Source.top) * Scale)) / 2);
+
+	Image.bottom = Image.top + max(1, (int)((Source.bottom - Source.top) * Scale));
+
+	SetRect(&Box, Image.left - 1, MINIMAP_MARGIN, Image.right + 1, max(Image.bottom, MINIMAP_MARGIN + 1 + MINIMAP_MIN_HEIGHT) + 1);
+
+	EnterCriticalSection(&gTileLock);
+
+	if ((Tile = TileFind(&Key)) == NULL || Tile->Drawn == FALSE)
+	{
+		LeaveCriticalSection(&gTileLock);
+
+		return(FALSE);
+	}
+
+	FillRect(DeviceContext, &Box, GetStockObject(BLACK_BRUSH));
+
+	if (Tile->Empty == FALSE)
+	{
+		SetStretchBltMode(DeviceContext, HALFTONE);
+
+		SetBrushOrgEx(DeviceContext, 0, 0, NULL);
+
+		StretchDIBits(
+			DeviceContext,
+			Image.left,
+			Image.top,
+			Image.right - Image.left,
+			Image.bottom - Image.top,
+			Source.left,
+			TILE_SIZE - Source.bottom,
+			Source.right - Source.left,
+			Source.bottom - Source.top,
+			Tile->Pixels,
+			&gTileBitmapInfo,
+			DIB_RGB_COLORS,
+			SRCCOPY);
+	}
+
+	LeaveCriticalSection(&gTileLock);
+
+	FrameRect(DeviceContext, &Box, FrameBrush);
+
+	// Where the camera is looking, at least a couple of pixels across so it can always be seen.
+
+	View.left = Image.left + (LONG)(((INT64)Camera->x * Camera->z - gTileWorld.left) * (Image.right - Image.left) / max(1, gTileWorld.right - gTileWorld.left));
+
+	View.top = Image.top + (LONG)(((INT64)Camera->y * Camera->z - gTileWorld.top) * (Image.bottom - Image.top) / max(1, gTileWorld.bottom - gTileWorld.top));
+
+	View.right = max(View.left + 2, Image.left + (LONG)(((INT64)(Camera->x + Width) * Camera->z - gTileWorld.left) * (Image.right - Image.left) / max(1, gTileWorld.right - gTileWorld.left)));
+
+	View.bottom = max(View.top + 2, Image.top + (LONG)(((INT64)(Camera->y + Height) * Camera->z - gTileWorld.top) * (Image.bottom - Image.top) / max(1, gTileWorld.bottom - gTileWorld.top)));
+
+	if (IntersectRect(&View, &View, &Box))
+	{
+		FrameRect(DeviceContext, &View, ViewBrush);
+	}
+
+	return(TRUE);
+}
+
+// How many tiles are drawn and ready, and how many of those the last frame asked for are still to be drawn.
+
+void GetTileCounts(_Out_ DWORD* Ready, _Out_ DWORD* Waiting)
+{
+	*Ready = 0;
+
+	*Waiting = 0;
+
+	if (gTileThread == NULL)
+	{
+		return;
+	}
+
+	EnterCriticalSection(&gTileLock);
+
+	for (DWORD Slot = 0; Slot < gTilesInUse; Slot++)
+	{
+		*Ready += (gTiles[Slot].Drawn && gTiles[Slot].Stale == FALSE);
+	}
+
+	*Waiting = gTilesWantedCount - gTilesWantedNext;
+
+	LeaveCriticalSection(&gTileLock);
+}
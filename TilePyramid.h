@@ -0,0 +1,68 @@
+#pragma once
+
+// Zoomed out far enough that no labels are drawn, a frame is thousands of tiny shapes that are the same as they were
+// the frame before, and drawing them all again is most of what the frame costs. Instead, the scene is drawn once into
+// TILE_SIZE square tiles, kept in a pyramid of levels: level 0 is drawn at TILE_MIN_ALTITUDE, each level above it at
+// twice the altitude of the one below, and the top level is the one where the whole forest fits in a single tile. A
+// frame blits the tiles of the highest level drawn at or below the camera's altitude, shrunk to fit, so what it costs
+// depends on the size of the window rather than on how many entities are in it. A worker thread draws tiles as they
+// are needed and draws them again when something in them changes. M shows the top of the pyramid as a minimap.
+//
+// Entities aren't culled while the scene is drawn from tiles, so DCs in view don't get their details prefetched or
+// their replication polled more often for being on screen. At these altitudes that would be most of the forest. The
+// convergence heatmap and the KCC what-if view draw over sites and DCs from state the UI thread owns, so the scene is
+// drawn as usual while either of them is showing, or while frames are being recorded with R.
+//
+// Include Pick.h first.
+
+#define TILE_SIZE					256
+
+// The lowest altitude the scene is drawn from tiles at. Labels stop being drawn below this; see RecordScene.
+#define TILE_MIN_ALTITUDE			8
+
+// Enough for a forest 67 million world units across to have a single tile at the top.
+#define TILE_MAX_LEVELS				16
+
+// At most this many tiles are kept, each TILE_SIZE * TILE_SIZE * 4 bytes unless there's nothing in it. The one shown
+// least recently is drawn over first.
+#define TILE_CACHE_MAX_TILES		512
+
+// A power of two.
+#define TILE_HASH_BUCKETS			1024
+
+// A frame that would need more tiles than this is drawn as usual. A 2560 x 1440 window needs about 300 at worst.
+#define TILE_MAX_VISIBLE			384
+
+// A tile that isn't ready can be stood in for by part of one this many levels above it, at most, magnified. Any more
+// and it's too blurry to be worth showing; the frame is drawn as usual instead.
+#define TILE_MAX_FALLBACK_LEVELS	2
+
+// Outlines and role badges reach this far outside the entity they're drawn for, in pixels.
+#define TILE_MARGIN_PIXELS			12
+
+// How often the worker looks for entities that would be drawn differently now than when their tiles were drawn.
+#define TILE_SWEEP_MS				250
+
+// When more entities than this have changed in one sweep, every tile is drawn again rather than working out which.
+#define TILE_SWEEP_MAX_CHANGES		256
+
+#define TILE_SHUTDOWN_TIMEOUT_MS	2000
+
+// The minimap is at most this big, in the top right corner, and never less than MINIMAP_MIN_HEIGHT tall.
+#define MINIMAP_WIDTH				TILE_SIZE
+
+#define MINIMAP_HEIGHT				144
+
+#define MINIMAP_MIN_HEIGHT			24
+
+#define MINIMAP_MARGIN				8
+
+DWORD StartTilePyramid(_In_ PICKINDEX* Index);
+
+BOOL StopTilePyramid(_In_ DWORD TimeoutMilliseconds);
+
+BOOL DrawTiles(_In_ HDC DeviceContext, _In_ CAMERA* Camera, _In_ int Width, _In_ int Height, _In_ DC_COLOR_MODE ColorMode, _In_ UINT64 Frame);
+
+BOOL DrawMinimap(_In_ HDC DeviceContext, _In_ CAMERA* Camera, _In_ int Width, _In_ int Height, _In_ DC_COLOR_MODE ColorMode, _In_ HBRUSH FrameBrush, _In_ HBRUSH ViewBrush);
+
+void GetTileCounts(_Out_ DWORD* Ready, _Out_ DWORD* Waiting);
@@ -0,0 +1,1075 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// A fixed amount of memory's worth of history for every DC's replication and probe results. See TimeSeries.h.
+//
+// The replication scheduler and the probe thread write points, and the UI thread reads them for sparklines and
+// tooltips. All of them go through gSeriesLock. Writing a point is a few dozen instructions and reading a sparkline's
+// worth is a few thousand, so nobody waits long.
+
+#include <Windows.h>
+
+#include <intrin.h>
+
+#include "Main.h"
+
+#include "TimeSeries.h"
+
+
+
+// The most bits one point can take: a 32 bit delta of deltas and a 32 bit XOR in a new window, with their prefixes.
+#define SERIES_SCRATCH_BYTES		16
+
+// A gap between points longer than this starts a new block, so that a delta of deltas always fits in 32 bits.
+#define SERIES_MAX_DELTA			0x3FFFFFFF
+
+typedef struct SERIES_CURSOR
+{
+	DWORD Block;
+
+	DWORD Index;
+
+	DWORD Position;
+
+	INT64 Time;
+
+	INT64 Delta;
+
+	UINT32 Value;
+
+	DWORD Leading;
+
+	DWORD Length;
+
+} SERIES_CURSOR;
+
+static CRITICAL_SECTION gSeriesLock;
+
+static BOOL gSeriesLockInitialized;
+
+// Only changed with gSeriesLock held. Writers look at it without the lock first, so they don't take it for nothing.
+static volatile BOOL gSeriesReady;
+
+static HANDLE gSeriesFile = INVALID_HANDLE_VALUE;
+
+static HANDLE gSeriesMapping;
+
+static BYTE* gSeriesMemory;
+
+static TIMESERIES_HEADER* gSeriesHeader;
+
+static TIMESERIES_SERIES* gSeriesTable;
+
+static TIMESERIES_BLOCK* gSeriesBlocks;
+
+// For every DC, which series each of its metrics is. A DC's TimeSeriesRow is one more than its row here.
+static DWORD (*gSeriesRows)[TSM_COUNT];
+
+static DWORD gSeriesRowCount;
+
+
+
+static void SeriesWriteBits(_Inout_ BYTE* Bits, _Inout_ DWORD* Position, _In_ UINT64 Value, _In_ DWORD Count)
+{
+	while (Count > 0)
+	{
+		DWORD Free = 8 - (*Position & 7);
+
+		DWORD Take = min(Free, Count);
+
+		BYTE Chunk = (BYTE)((Value >> (Count - Take)) & ((1u << Take) - 1));
+
+		Bits[*Position >> 3] |= (BYTE)(Chunk << (Free - Take));
+
+		*Position += Take;
+
+		Count -= Take;
+	}
+}
+
+static UINT64 SeriesReadBits(_In_ BYTE* Bits, _Inout_ DWORD* Position, _In_ DWORD Count)
+{
+	UINT64 Value = 0;
+
+	while (Count > 0)
+	{
+		DWORD Left = 8 - (*Position & 7);
+
+		DWORD Take = min(Left, Count);
+
+		Value = (Value << Take) | ((Bits[*Position >> 3] >> (Left - Take)) & ((1u << Take) - 1));
+
+		*Position += Take;
+
+		Count -= Take;
+	}
+
+	return(Value);
+}
+
+// Writes a point into Scratch the way it would follow the last one in State, and moves State on past it. Returns
+// how many bits it took.
+//
+// The time is written as how far its delta is from the last delta: 0 as a single 0 bit, then 10, 110 and 1110
+// followed by 7, 9 and 12 bits for small differences, and 1111 followed by all 32 for anything else. The value is
+// written as its XOR with the last value: a single 0 bit if it's the same, 10 followed by the XOR's meaningful bits if
+// they fit in the same window as the last XOR written in full, or 11, 5 bits of leading zeros, 5 bits of length and
+// the meaningful bits otherwise.
+
+static DWORD SeriesEncode(_Inout_ TIMESERIES_BLOCK_HEADER* State, _In_ INT64 Time, _In_ UINT32 Value, _Out_ BYTE* Scratch)
+{
+	DWORD Position = 0;
+
+	INT64 Delta = Time - State->LastTime;
+
+	INT64 DeltaOfDelta = Delta - State->LastDelta;
+
+	UINT32 Xor = Value ^ State->LastValue;
+
+	memset(Scratch, 0, SERIES_SCRATCH_BYTES);
+
+	if (DeltaOfDelta == 0)
+	{
+		SeriesWriteBits(Scratch, &Position, 0, 1);
+	}
+	else if (DeltaOfDelta >= -63 && DeltaOfDelta <= 64)
+	{
+		SeriesWriteBits(Scratch, &Position, 0x2, 2);
+
+		SeriesWriteBits(Scratch, &Position, (UINT64)(DeltaOfDelta + 63), 7);
+	}
+	else if (DeltaOfDelta >= -255 && DeltaOfDelta <= 256)
+	{
+		SeriesWriteBits(Scratch, &Position, 0x6, 3);
+
+		SeriesWriteBits(Scratch, &Position, (UINT64)(DeltaOfDelta + 255), 9);
+	}
+	else if (DeltaOfDelta >= -2047 && DeltaOfDelta <= 2048)
+	{
+		SeriesWriteBits(Scratch, &Position, 0xE, 4);
+
+		SeriesWriteBits(Scratch, &Position, (UINT64)(DeltaOfDelta + 2047), 12);
+	}
+	else
+	{
+		SeriesWriteBits(Scratch, &Position, 0xF, 4);
+
+		SeriesWriteBits(Scratch, &Position, (UINT32)(INT32)DeltaOfDelta, 32);
+	}
+
+	if (Xor == 0)
+	{
+		SeriesWriteBits(Scratch, &Position, 0, 1);
+	}
+	else
+	{
+		unsigned long High = 0;
+
+		unsigned long Low = 0;
+
+		_BitScanReverse(&High, Xor);
+
+		_BitScanForward(&Low, Xor);
+
+		if (State->Length != 0 && 31 - High >= State->Leading && Low >= 32u - State->Leading - State->Length)
+		{
+			SeriesWriteBits(Scratch, &Position, 0x2, 2);
+
+			SeriesWriteBits(Scratch, &Position, Xor >> (32 - State->Leading - State->Length), State->Length);
+		}
+		else
+		{
+			State->Leading = (BYTE)(31 - High);
+
+			State->Length = (BYTE)(High - Low + 1);
+
+			SeriesWriteBits(Scratch, &Position, 0x3, 2);
+
+			SeriesWriteBits(Scratch, &Position, State->Leading, 5);
+
+			SeriesWriteBits(Scratch, &Position, State->Length - 1, 5);
+
+			SeriesWriteBits(Scratch, &Position, Xor >> Low, State->Length);
+		}
+	}
+
+	State->LastTime = Time;
+
+	State->LastDelta = (INT32)Delta;
+
+	State->LastValue = Value;
+
+	State->Count++;
+
+	return(Position);
+}
+
+// Reads the next point of the block the cursor is on into Time and Value. Returns FALSE once there are no more.
+
+static BOOL SeriesDecode(_Inout_ SERIES_CURSOR* Cursor)
+{
+	TIMESERIES_BLOCK* Block = &gSeriesBlocks[Cursor->Block];
+
+	if (Cursor->Index >= Block->Header.Count)
+	{
+		return(FALSE);
+	}
+
+	if (Cursor->Index == 0)
+	{
+		Cursor->Time = Block->Header.FirstTime;
+
+		Cursor->Value = Block->Header.FirstValue;
+
+		Cursor->Delta = 0;
+
+		Cursor->Position = 0;
+
+		Cursor->Leading = 0;
+
+		Cursor->Length = 0;
+	}
+	else
+	{
+		INT64 DeltaOfDelta = 0;
+
+		if (SeriesReadBits(Block->Bits, &Cursor->Position, 1) == 0)
+		{
+			DeltaOfDelta = 0;
+		}
+		else if (SeriesReadBits(Block->Bits, &Cursor->Position, 1) == 0)
+		{
+			DeltaOfDelta = (INT64)SeriesReadBits(Block->Bits, &Cursor->Position, 7) - 63;
+		}
+		else if (SeriesReadBits(Block->Bits, &Cursor->Position, 1) == 0)
+		{
+			DeltaOfDelta = (INT64)SeriesReadBits(Block->Bits, &Cursor->Position, 9) - 255;
+		}
+		else if (SeriesReadBits(Block->Bits, &Cursor->Position, 1) == 0)
+		{
+			DeltaOfDelta = (INT64)SeriesReadBits(Block->Bits, &Cursor->Position, 12) - 2047;
+		}
+		else
+		{
+			DeltaOfDelta = (INT32)(UINT32)SeriesReadBits(Block->Bits, &Cursor->Position, 32);
+		}
+
+		Cursor->Delta += DeltaOfDelta;
+
+		Cursor->Time += Cursor->Delta;
+
+		if (SeriesReadBits(Block->Bits, &Cursor->Position, 1) != 0)
+		{
+			if (SeriesReadBits(Block->Bits, &Cursor->Position, 1) != 0)
+			{
+				Cursor->Leading = (DWORD)SeriesReadBits(Block->Bits, &Cursor->Position, 5);
+
+				Cursor->Length = (DWORD)SeriesReadBits(Block->Bits, &Cursor->Position, 5) + 1;
+			}
+
+			Cursor->Value ^= (UINT32)SeriesReadBits(Block->Bits, &Cursor->Position, Cursor->Length) << (32 - Cursor->Leading - Cursor->Length);
+		}
+	}
+
+	Cursor->Index++;
+
+	return(TRUE);
+}
+
+// Moves the cursor on to the next point of the series at or after From. Returns FALSE once there isn't one at or
+// before To. Blocks that end before From aren't decoded at all.
+
+static BOOL SeriesNextPoint(_Inout_ SERIES_CURSOR* Cursor, _In_ INT64 From, _In_ INT64 To)
+{
+	while (Cursor->Block != TIMESERIES_NONE)
+	{
+		TIMESERIES_BLOCK* Block = &gSeriesBlocks[Cursor->Block];
+
+		if (Block->Header.FirstTime > To)
+		{
+			return(FALSE);
+		}
+
+		if (Cursor->Index == 0 && Block->Header.LastTime < From)
+		{
+			Cursor->Block = Block->Header.Next;
+
+			continue;
+		}
+
+		while (SeriesDecode(Cursor))
+		{
+			if (Cursor->Time > To)
+			{
+				return(FALSE);
+			}
+
+			if (Cursor->Time >= From)
+			{
+				return(TRUE);
+			}
+		}
+
+		Cursor->Block = Block->Header.Next;
+
+		Cursor->Index = 0;
+	}
+
+	return(FALSE);
+}
+
+// Hands out the block the ring is on, taking it from its series first if it has one. Returns TIMESERIES_NONE if every
+// block is the one its series is writing to, which only happens when TimeSeriesMB is far too small.
+
+static DWORD SeriesAllocateBlock(void)
+{
+	for (DWORD Tries = 0; Tries < gSeriesHeader->BlockCount; Tries++)
+	{
+		DWORD Index = gSeriesHeader->NextBlock;
+
+		TIMESERIES_BLOCK* Block = &gSeriesBlocks[Index];
+
+		gSeriesHeader->NextBlock = (Index + 1) % gSeriesHeader->BlockCount;
+
+		if (Block->Header.Series != TIMESERIES_NONE)
+		{
+			TIMESERIES_SERIES* Owner = &gSeriesTable[Block->Header.Series];
+
+			if (Owner->Tail == Index)
+			{
+				continue;
+			}
+
+			// A series' blocks are handed out in the order the ring goes round, so by the time it comes back to one,
+			// every older block of the same series has already been taken. This is the oldest.
+
+			ASSERT(Owner->Head == Index, L"A time series lost track of its oldest block.");
+
+			Owner->Head = Block->Header.Next;
+
+			gSeriesHeader->Points -= Block->Header.Count;
+
+			gSeriesHeader->Oldest = max(gSeriesHeader->Oldest, Block->Header.LastTime);
+
+			gSeriesHeader->BlocksInUse--;
+		}
+
+		memset(Block, 0, sizeof(TIMESERIES_BLOCK));
+
+		Block->Header.Series = TIMESERIES_NONE;
+
+		Block->Header.Next = TIMESERIES_NONE;
+
+		gSeriesHeader->BlocksInUse++;
+
+		return(Index);
+	}
+
+	return(TIMESERIES_NONE);
+}
+
+static void SeriesAppend(_In_ DWORD SeriesIndex, _In_ INT64 Time, _In_ UINT32 Value)
+{
+	TIMESERIES_SERIES* Series = &gSeriesTable[SeriesIndex];
+
+	TIMESERIES_BLOCK* Block = NULL;
+
+	DWORD NewBlock = TIMESERIES_NONE;
+
+	if (Series->Tail != TIMESERIES_NONE)
+	{
+		Block = &gSeriesBlocks[Series->Tail];
+
+		// A clock that goes backwards puts the point at the same time as the one before it.
+
+		Time = max(Time, Block->Header.LastTime);
+
+		if (Time - Block->Header.LastTime <= SERIES_MAX_DELTA)
+		{
+			TIMESERIES_BLOCK_HEADER State = Block->Header;
+
+			BYTE Scratch[SERIES_SCRATCH_BYTES];
+
+			DWORD Bits = SeriesEncode(&State, Time, Value, Scratch);
+
+			if (State.BitCount + Bits <= sizeof(Block->Bits) * 8)
+			{
+				DWORD Position = State.BitCount;
+
+				DWORD ScratchPosition = 0;
+
+				while (ScratchPosition < Bits)
+				{
+					DWORD Take = min(32, Bits - ScratchPosition);
+
+					SeriesWriteBits(Block->Bits, &Position, SeriesReadBits(Scratch, &ScratchPosition, Take), Take);
+				}
+
+				State.BitCount = (UINT16)Position;
+
+				Block->Header = State;
+
+				gSeriesHeader->Points++;
+
+				return;
+			}
+		}
+	}
+
+	if ((NewBlock = SeriesAllocateBlock()) == TIMESERIES_NONE)
+	{
+		gSeriesHeader->Dropped++;
+
+		return;
+	}
+
+	Block = &gSeriesBlocks[NewBlock];
+
+	Block->Header.Series = SeriesIndex;
+
+	Block->Header.FirstTime = Time;
+
+	Block->Header.LastTime = Time;
+
+	Block->Header.FirstValue = Value;
+
+	Block->Header.LastValue = Value;
+
+	Block->Header.Count = 1;
+
+	if (Series->Tail != TIMESERIES_NONE)
+	{
+		gSeriesBlocks[Series->Tail].Header.Next = NewBlock;
+	}
+	else
+	{
+		Series->Head = NewBlock;
+	}
+
+	Series->Tail = NewBlock;
+
+	gSeriesHeader->Points++;
+
+	if (gSeriesHeader->Oldest == 0)
+	{
+		gSeriesHeader->Oldest = Time;
+	}
+}
+
+static UINT64 SeriesKey(_In_ ENTITY* DC, _In_ TIMESERIES_METRIC Metric)
+{
+	UINT64 Hash = 14695981039346656037ULL;
+
+	for (wchar_t* Character = DC->distinguishedname; *Character; Character++)
+	{
+		Hash = (Hash ^ *Character) * 1099511628211ULL;
+	}
+
+	Hash = (Hash ^ ((UINT64)Metric + 1)) * 1099511628211ULL;
+
+	return(Hash ? Hash : 1);
+}
+
+// Finds Key in Table, which has gSeriesHeader->SeriesCapacity slots. If it isn't there, returns the empty slot it
+// would go in, or TIMESERIES_NONE if there isn't one.
+
+static DWORD SeriesProbe(_In_ TIMESERIES_SERIES* Table, _In_ UINT64 Key)
+{
+	DWORD Mask = gSeriesHeader->SeriesCapacity - 1;
+
+	DWORD Slot = (DWORD)(Key ^ (Key >> 32)) & Mask;
+
+	for (DWORD Probe = 0; Probe < gSeriesHeader->SeriesCapacity; Probe++, Slot = (Slot + 1) & Mask)
+	{
+		if (Table[Slot].Key == Key || Table[Slot].Key == 0)
+		{
+			return(Slot);
+		}
+	}
+
+	return(TIMESERIES_NONE);
+}
+
+// Gives every DC its row of series. The table is rebuilt from scratch with only the series of DCs that are here now,
+// each keeping whatever blocks it had in the file, and blocks belonging to anything else are freed.
+
+static DWORD SeriesAssignRows(_In_ ENTITY* Entities, _In_ DWORD DCCount)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	SIZE_T TableBytes = sizeof(TIMESERIES_SERIES) * gSeriesHeader->SeriesCapacity;
+
+	TIMESERIES_SERIES* Previous = NULL;
+
+	BYTE* Kept = NULL;
+
+	gSeriesRows = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(gSeriesRows[0]) * DCCount);
+
+	Previous = HeapAlloc(GetProcessHeap(), 0, TableBytes);
+
+	Kept = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, gSeriesHeader->BlockCount);
+
+	if (gSeriesRows == NULL || Previous == NULL || Kept == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	memcpy(Previous, gSeriesTable, TableBytes);
+
+	memset(gSeriesTable, 0, TableBytes);
+
+	gSeriesHeader->SeriesCount = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type != ET_DC)
+		{
+			continue;
+		}
+
+		for (int Metric = 0; Metric < TSM_COUNT; Metric++)
+		{
+			UINT64 Key = SeriesKey(Current, (TIMESERIES_METRIC)Metric);
+
+			DWORD Slot = Current->distinguishedname[0] ? SeriesProbe(gSeriesTable, Key) : TIMESERIES_NONE;
+
+			DWORD Old = SeriesProbe(Previous, Key);
+
+			gSeriesRows[gSeriesRowCount][Metric] = Slot;
+
+			// Two DCs with the same DN share their series, rather than the second one starting it over.
+
+			if (Slot == TIMESERIES_NONE || gSeriesTable[Slot].Key == Key)
+			{
+				continue;
+			}
+
+			gSeriesTable[Slot].Key = Key;
+
+			gSeriesTable[Slot].Head = TIMESERIES_NONE;
+
+			gSeriesTable[Slot].Tail = TIMESERIES_NONE;
+
+			gSeriesHeader->SeriesCount++;
+
+			if (Old != TIMESERIES_NONE && Previous[Old].Key == Key)
+			{
+				gSeriesTable[Slot].Head = Previous[Old].Head;
+
+				gSeriesTable[Slot].Tail = Previous[Old].Tail;
+
+				for (DWORD Block = Previous[Old].Head; Block != TIMESERIES_NONE; Block = gSeriesBlocks[Block].Header.Next)
+				{
+					gSeriesBlocks[Block].Header.Series = Slot;
+
+					Kept[Block] = TRUE;
+				}
+			}
+		}
+
+		Current->TimeSeriesRow = ++gSeriesRowCount;
+	}
+
+	for (DWORD Block = 0; Block < gSeriesHeader->BlockCount; Block++)
+	{
+		if (gSeriesBlocks[Block].Header.Series != TIMESERIES_NONE && Kept[Block] == FALSE)
+		{
+			gSeriesHeader->Points -= gSeriesBlocks[Block].Header.Count;
+
+			gSeriesHeader->BlocksInUse--;
+
+			memset(&gSeriesBlocks[Block], 0, sizeof(TIMESERIES_BLOCK));
+
+			gSeriesBlocks[Block].Header.Series = TIMESERIES_NONE;
+
+			gSeriesBlocks[Block].Header.Next = TIMESERIES_NONE;
+		}
+	}
+
+Exit:
+
+	if (Kept)
+	{
+		HeapFree(GetProcessHeap(), 0, Kept);
+	}
+
+	if (Previous)
+	{
+		HeapFree(GetProcessHeap(), 0, Previous);
+	}
+
+	return(Result);
+}
+
+// Gives back the memory or the mapping, and the file. Called with gSeriesLock held.
+
+static void SeriesRelease(void)
+{
+	gSeriesReady = FALSE;
+
+	if (gSeriesMapping)
+	{
+		if (gSeriesMemory)
+		{
+			FlushViewOfFile(gSeriesMemory, 0);
+
+			UnmapViewOfFile(gSeriesMemory);
+		}
+
+		CloseHandle(gSeriesMapping);
+
+		gSeriesMapping = NULL;
+	}
+	else if (gSeriesMemory)
+	{
+		HeapFree(GetProcessHeap(), 0, gSeriesMemory);
+	}
+
+	if (gSeriesFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(gSeriesFile);
+
+		gSeriesFile = INVALID_HANDLE_VALUE;
+	}
+
+	if (gSeriesRows)
+	{
+		HeapFree(GetProcessHeap(), 0, gSeriesRows);
+	}
+
+	gSeriesMemory = NULL;
+
+	gSeriesHeader = NULL;
+
+	gSeriesTable = NULL;
+
+	gSeriesBlocks = NULL;
+
+	gSeriesRows = NULL;
+
+	gSeriesRowCount = 0;
+}
+
+// Opens FileName and maps Bytes of it. If the history in it can be carried on with, sets Reuse and sets Capacity to
+// the size of its series table. Otherwise the file is cut to Bytes, to start over.
+
+static DWORD SeriesMapFile(_In_ wchar_t* FileName, _In_ SIZE_T Bytes, _Inout_ DWORD* Capacity, _Out_ BOOL* Reuse)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	TIMESERIES_HEADER Header = { 0 };
+
+	LARGE_INTEGER Size = { 0 };
+
+	DWORD BytesRead = 0;
+
+	*Reuse = FALSE;
+
+	if ((gSeriesFile = CreateFileW(FileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to open %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+	if (GetFileSizeEx(gSeriesFile, &Size) &&
+		(UINT64)Size.QuadPart == Bytes &&
+		ReadFile(gSeriesFile, &Header, sizeof(Header), &BytesRead, NULL) &&
+		BytesRead == sizeof(Header) &&
+		Header.Magic == TIMESERIES_MAGIC &&
+		Header.Version == TIMESERIES_VERSION &&
+		Header.BlockBytes == TIMESERIES_BLOCK_BYTES &&
+		Header.SeriesCapacity >= *Capacity &&
+		(Header.SeriesCapacity & (Header.SeriesCapacity - 1)) == 0)
+	{
+		*Capacity = Header.SeriesCapacity;
+
+		*Reuse = TRUE;
+	}
+	else
+	{
+		LogEventW(LL_INFO, LF_FILE, L"[%s] %s is empty, from an older version or a different TimeSeriesMB, or too small for this forest. History starts over.", __FUNCTIONW__, FileName);
+
+		Size.QuadPart = (LONGLONG)Bytes;
+
+		if (SetFilePointerEx(gSeriesFile, Size, NULL, FILE_BEGIN) == FALSE || SetEndOfFile(gSeriesFile) == FALSE)
+		{
+			Result = GetLastError();
+
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to size %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+			goto Exit;
+		}
+	}
+
+	if ((gSeriesMapping = CreateFileMappingW(gSeriesFile, NULL, PAGE_READWRITE, (DWORD)((UINT64)Bytes >> 32), (DWORD)Bytes, NULL)) == NULL ||
+		(gSeriesMemory = MapViewOfFile(gSeriesMapping, FILE_MAP_ALL_ACCESS, 0, 0, Bytes)) == NULL)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to map %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+Exit:
+
+	return(Result);
+}
+
+// Sets aside Megabytes for the history of every DC in Entities, in FileName if there is one, and carries on with the
+// history already in it if it's from the same forest. Entities must not change while the store is running.
+
+DWORD StartTimeSeries(_In_ ENTITY* Entities, _In_ DWORD Megabytes, _In_opt_ wchar_t* FileName)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD DCCount = 0;
+
+	DWORD Capacity = TIMESERIES_MIN_SERIES;
+
+	SIZE_T Bytes = (SIZE_T)Megabytes * 1024 * 1024;
+
+	SIZE_T BlockOffset = 0;
+
+	SIZE_T BlockCount = 0;
+
+	BOOL Reuse = FALSE;
+
+	if (Megabytes == 0)
+	{
+		LogEventW(LL_INFO, LF_FILE, L"[%s] TimeSeriesMB is 0, no history will be kept.", __FUNCTIONW__);
+
+		return(ERROR_SUCCESS);
+	}
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		if (Current->Type == ET_DC)
+		{
+			DCCount++;
+		}
+	}
+
+	if (DCCount == 0)
+	{
+		return(ERROR_SUCCESS);
+	}
+
+	while (Capacity < DCCount * TSM_COUNT * 2)
+	{
+		Capacity *= 2;
+	}
+
+	if (gSeriesLockInitialized == FALSE)
+	{
+		InitializeCriticalSection(&gSeriesLock);
+
+		gSeriesLockInitialized = TRUE;
+	}
+
+	EnterCriticalSection(&gSeriesLock);
+
+	SeriesRelease();
+
+	if (FileName)
+	{
+		if ((Result = SeriesMapFile(FileName, Bytes, &Capacity, &Reuse)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+	else if ((gSeriesMemory = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, Bytes)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	BlockOffset = sizeof(TIMESERIES_HEADER) + (sizeof(TIMESERIES_SERIES) * (SIZE_T)Capacity);
+
+	BlockOffset = (BlockOffset + TIMESERIES_BLOCK_BYTES - 1) & ~((SIZE_T)TIMESERIES_BLOCK_BYTES - 1);
+
+	BlockCount = (BlockOffset < Bytes) ? min((Bytes - BlockOffset) / TIMESERIES_BLOCK_BYTES, MAXDWORD - 1) : 0;
+
+	if (BlockCount < TSM_COUNT * 2)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] TimeSeriesMB of %lu is too small to keep any history!", __FUNCTIONW__, Megabytes);
+
+		goto Exit;
+	}
+
+	// Each series needs a block to write to and another for the ring to take from it. Without that, series that
+	// haven't got a block yet lose their points until one comes free, which might be never.
+
+	if (BlockCount < (SIZE_T)DCCount * TSM_COUNT * 2)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] TimeSeriesMB of %lu is too small for %lu DCs; some of their history will be dropped. At least %llu is needed.",
+			__FUNCTIONW__,
+			Megabytes,
+			DCCount,
+			((UINT64)DCCount * TSM_COUNT * 2 * TIMESERIES_BLOCK_BYTES + BlockOffset) / (1024 * 1024) + 1);
+	}
+
+	gSeriesHeader = (TIMESERIES_HEADER*)gSeriesMemory;
+
+	gSeriesTable = (TIMESERIES_SERIES*)(gSeriesMemory + sizeof(TIMESERIES_HEADER));
+
+	gSeriesBlocks = (TIMESERIES_BLOCK*)(gSeriesMemory + BlockOffset);
+
+	if (Reuse && (gSeriesHeader->BlockCount != BlockCount || gSeriesHeader->BlockOffset != BlockOffset || gSeriesHeader->NextBlock >= BlockCount))
+	{
+		Reuse = FALSE;
+	}
+
+	if (Reuse == FALSE)
+	{
+		memset(gSeriesMemory, 0, BlockOffset);
+
+		gSeriesHeader->Magic = TIMESERIES_MAGIC;
+
+		gSeriesHeader->Version = TIMESERIES_VERSION;
+
+		gSeriesHeader->BlockBytes = TIMESERIES_BLOCK_BYTES;
+
+		gSeriesHeader->SeriesCapacity = Capacity;
+
+		gSeriesHeader->BlockCount = (DWORD)BlockCount;
+
+		gSeriesHeader->BlockOffset = (DWORD)BlockOffset;
+
+		for (DWORD Block = 0; Block < BlockCount; Block++)
+		{
+			memset(&gSeriesBlocks[Block], 0, sizeof(TIMESERIES_BLOCK));
+
+			gSeriesBlocks[Block].Header.Series = TIMESERIES_NONE;
+
+			gSeriesBlocks[Block].Header.Next = TIMESERIES_NONE;
+		}
+	}
+
+	if ((Result = SeriesAssignRows(Entities, DCCount)) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Out of memory!", __FUNCTIONW__);
+
+		goto Exit;
+	}
+
+	gSeriesReady = TRUE;
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Keeping history of %lu DCs in %lu blocks%s%s, %llu points carried over.",
+		__FUNCTIONW__,
+		DCCount,
+		gSeriesHeader->BlockCount,
+		FileName ? L" in " : L"",
+		FileName ? FileName : L"",
+		gSeriesHeader->Points);
+
+Exit:
+
+	if (Result != ERROR_SUCCESS)
+	{
+		SeriesRelease();
+	}
+
+	LeaveCriticalSection(&gSeriesLock);
+
+	return(Result);
+}
+
+// Stops recording and writes the history out, if there's a file for it. Points recorded after this are ignored, so
+// it's safe to call while the replication scheduler or probe engine might still be finishing.
+
+void StopTimeSeries(void)
+{
+	if (gSeriesLockInitialized == FALSE)
+	{
+		return;
+	}
+
+	EnterCriticalSection(&gSeriesLock);
+
+	SeriesRelease();
+
+	LeaveCriticalSection(&gSeriesLock);
+}
+
+// Seconds since 1601, which is what every time in the store is.
+
+INT64 TimeSeriesNow(void)
+{
+	FILETIME Now = { 0 };
+
+	GetSystemTimeAsFileTime(&Now);
+
+	return((INT64)((((UINT64)Now.dwHighDateTime << 32) | Now.dwLowDateTime) / 10000000ULL));
+}
+
+static DWORD SeriesOf(_In_ ENTITY* DC, _In_ TIMESERIES_METRIC Metric)
+{
+	if (gSeriesReady == FALSE || DC->TimeSeriesRow == 0 || DC->TimeSeriesRow > gSeriesRowCount)
+	{
+		return(TIMESERIES_NONE);
+	}
+
+	return(gSeriesRows[DC->TimeSeriesRow - 1][Metric]);
+}
+
+void RecordTimeSeries(_In_ ENTITY* DC, _In_ TIMESERIES_METRIC Metric, _In_ INT64 Time, _In_ UINT32 Value)
+{
+	DWORD Series = TIMESERIES_NONE;
+
+	if (gSeriesReady == FALSE)
+	{
+		return;
+	}
+
+	EnterCriticalSection(&gSeriesLock);
+
+	if ((Series = SeriesOf(DC, Metric)) != TIMESERIES_NONE)
+	{
+		SeriesAppend(Series, Time, Value);
+	}
+
+	LeaveCriticalSection(&gSeriesLock);
+}
+
+// Copies out the points of a series from From to To, inclusive, oldest first. If there are more than MaxPoints,
+// the first MaxPoints are copied and ERROR_MORE_DATA is returned.
+
+DWORD QueryTimeSeries(_In_ ENTITY* DC, _In_ TIMESERIES_METRIC Metric, _In_ INT64 From, _In_ INT64 To, _Out_ TIMESERIES_POINT* Points, _In_ DWORD MaxPoints, _Out_ DWORD* Count)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD Series = TIMESERIES_NONE;
+
+	SERIES_CURSOR Cursor = { 0 };
+
+	*Count = 0;
+
+	if (gSeriesReady == FALSE)
+	{
+		return(ERROR_NOT_READY);
+	}
+
+	EnterCriticalSection(&gSeriesLock);
+
+	if ((Series = SeriesOf(DC, Metric)) == TIMESERIES_NONE)
+	{
+		Result = ERROR_NOT_FOUND;
+
+		goto Exit;
+	}
+
+	Cursor.Block = gSeriesTable[Series].Head;
+
+	while (SeriesNextPoint(&Cursor, From, To))
+	{
+		if (*Count == MaxPoints)
+		{
+			Result = ERROR_MORE_DATA;
+
+			break;
+		}
+
+		Points[*Count].Time = Cursor.Time;
+
+		Points[*Count].Value = Cursor.Value;
+
+		(*Count)++;
+	}
+
+Exit:
+
+	LeaveCriticalSection(&gSeriesLock);
+
+	return(Result);
+}
+
+// Splits From to To into Buckets equal parts and gives the highest value in each, or TIMESERIES_NO_VALUE where
+// there's nothing. That's all a sparkline needs, and it's cheaper than copying out every point.
+
+DWORD SummarizeTimeSeries(_In_ ENTITY* DC, _In_ TIMESERIES_METRIC Metric, _In_ INT64 From, _In_ INT64 To, _Out_ UINT32* Maximums, _In_ DWORD Buckets)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD Series = TIMESERIES_NONE;
+
+	SERIES_CURSOR Cursor = { 0 };
+
+	INT64 Span = max(To - From, 1);
+
+	for (DWORD Bucket = 0; Bucket < Buckets; Bucket++)
+	{
+		Maximums[Bucket] = TIMESERIES_NO_VALUE;
+	}
+
+	if (gSeriesReady == FALSE)
+	{
+		return(ERROR_NOT_READY);
+	}
+
+	EnterCriticalSection(&gSeriesLock);
+
+	if ((Series = SeriesOf(DC, Metric)) == TIMESERIES_NONE)
+	{
+		Result = ERROR_NOT_FOUND;
+
+		goto Exit;
+	}
+
+	Cursor.Block = gSeriesTable[Series].Head;
+
+	while (SeriesNextPoint(&Cursor, From, To))
+	{
+		DWORD Bucket = (DWORD)min(((Cursor.Time - From) * Buckets) / Span, (INT64)Buckets - 1);
+
+		if (Maximums[Bucket] == TIMESERIES_NO_VALUE || Cursor.Value > Maximums[Bucket])
+		{
+			Maximums[Bucket] = Cursor.Value;
+		}
+	}
+
+Exit:
+
+	LeaveCriticalSection(&gSeriesLock);
+
+	return(Result);
+}
+
+void GetTimeSeriesStats(_Out_ TIMESERIES_STATS* Stats)
+{
+	memset(Stats, 0, sizeof(TIMESERIES_STATS));
+
+	if (gSeriesReady == FALSE)
+	{
+		return;
+	}
+
+	EnterCriticalSection(&gSeriesLock);
+
+	if (gSeriesHeader)
+	{
+		Stats->Series = gSeriesHeader->SeriesCount;
+
+		Stats->BlocksInUse = gSeriesHeader->BlocksInUse;
+
+		Stats->BlockCount = gSeriesHeader->BlockCount;
+
+		Stats->Points = gSeriesHeader->Points;
+
+		Stats->Dropped = gSeriesHeader->Dropped;
+
+		Stats->Oldest = gSeriesHeader->Oldest;
+	}
+
+	LeaveCriticalSection(&gSeriesLock);
+}
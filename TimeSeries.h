@@ -0,0 +1,182 @@
+#pragma once
+
+// What replication polls and probes find out about each DC over time: how many of its inbound neighbours are failing,
+// how many replication operations it has queued, and how long its LDAP, GC and Kerberos ports take to answer. Every
+// DC has a series of (time, value) points for each of these, and the points are compressed the way Facebook's Gorilla
+// does it: a time is written as how much its gap from the one before differs from the gap before that, which is
+// usually zero when polls come regularly, and a value as its XOR with the one before, which is zero when it hasn't
+// changed and otherwise has only a few bits set, in the middle. A point takes a couple of bytes on average.
+//
+// Points go into TIMESERIES_BLOCK_BYTES blocks, and a series is a list of them, oldest first. All of the blocks come
+// from one array, sized by the TimeSeriesMB registry setting, which is handed out in order like a ring buffer. When it
+// comes round again, the block it's on is the oldest block of whichever series has it, so that series loses its
+// oldest points and the memory used never grows. How far back history goes depends on how many DCs there are.
+//
+// With TimeSeriesPersist, the array lives in a file mapped into memory instead, so history survives a restart.
+// Series are found by a hash of the DC's DN, so a DC keeps its history as long as its DN doesn't change. The file
+// isn't written carefully enough to survive the machine crashing; if it doesn't look right when it's opened, history
+// starts over.
+//
+// File layout: a TIMESERIES_HEADER, the series table of SeriesCapacity TIMESERIES_SERIES, then BlockCount
+// TIMESERIES_BLOCKs starting at BlockOffset.
+
+#define TIMESERIES_MAGIC			0x53544441	// "ADTS"
+
+#define TIMESERIES_VERSION			1
+
+#define TIMESERIES_FILE_NAME		L"ADTV_history.adtvh"
+
+// About 20 hours of history for 500 DCs probed every 30 seconds.
+#define TIMESERIES_DEF_MB			16
+
+// A block with no series, a series with no blocks, or a block with no next.
+#define TIMESERIES_NONE				MAXDWORD
+
+// Summaries have this for a bucket with no points in it.
+#define TIMESERIES_NO_VALUE			MAXDWORD
+
+#define TIMESERIES_BLOCK_BYTES		256
+
+// The series table is at least this big, and twice as big as the number of series it has to hold, rounded up to a
+// power of two, so a DC or two being added doesn't change its size and lose the history in the file.
+#define TIMESERIES_MIN_SERIES		256
+
+// How much history a DC's sparkline and its tooltip show.
+#define TIMESERIES_SPARKLINE_SECONDS	(2 * 60 * 60)
+
+#define TIMESERIES_SPARKLINE_BUCKETS	48
+
+typedef enum TIMESERIES_METRIC
+{
+	TSM_FAILING_NEIGHBORS,
+
+	TSM_PENDING_OPS,
+
+	// In microseconds. These three are in the same order as PROBE_PORT.
+	TSM_LDAP_LATENCY,
+
+	TSM_GC_LATENCY,
+
+	TSM_KERBEROS_LATENCY,
+
+	TSM_COUNT
+
+} TIMESERIES_METRIC;
+
+typedef struct TIMESERIES_HEADER
+{
+	DWORD Magic;
+
+	DWORD Version;
+
+	DWORD BlockBytes;
+
+	DWORD SeriesCapacity;
+
+	DWORD SeriesCount;
+
+	DWORD BlockCount;
+
+	DWORD BlockOffset;
+
+	// The block that will be handed out next, or taken from its series if it has one.
+	DWORD NextBlock;
+
+	DWORD BlocksInUse;
+
+	// Points dropped because every block was the one its series was writing to.
+	DWORD Dropped;
+
+	UINT64 Points;
+
+	// Seconds since 1601, as all times here are. The oldest point still kept is no older than this.
+	INT64 Oldest;
+
+} TIMESERIES_HEADER;
+
+typedef struct TIMESERIES_SERIES
+{
+	// A hash of the DC's DN and the metric. Zero for a slot that isn't used.
+	UINT64 Key;
+
+	DWORD Head;
+
+	DWORD Tail;
+
+} TIMESERIES_SERIES;
+
+typedef struct TIMESERIES_BLOCK_HEADER
+{
+	INT64 FirstTime;
+
+	INT64 LastTime;
+
+	DWORD Series;
+
+	DWORD Next;
+
+	UINT32 FirstValue;
+
+	// Everything from here on is what the next point is written relative to.
+	UINT32 LastValue;
+
+	INT32 LastDelta;
+
+	UINT16 Count;
+
+	UINT16 BitCount;
+
+	// The leading zeros and length of the last XOR that was written out in full, whose window the next one can reuse.
+	// Length is zero until there has been one.
+	BYTE Leading;
+
+	BYTE Length;
+
+} TIMESERIES_BLOCK_HEADER;
+
+typedef struct TIMESERIES_BLOCK
+{
+	TIMESERIES_BLOCK_HEADER Header;
+
+	// Every point after the first, most significant bit first.
+	BYTE Bits[TIMESERIES_BLOCK_BYTES - sizeof(TIMESERIES_BLOCK_HEADER)];
+
+} TIMESERIES_BLOCK;
+
+typedef struct TIMESERIES_POINT
+{
+	INT64 Time;
+
+	UINT32 Value;
+
+} TIMESERIES_POINT;
+
+typedef struct TIMESERIES_STATS
+{
+	DWORD Series;
+
+	DWORD BlocksInUse;
+
+	DWORD BlockCount;
+
+	UINT64 Points;
+
+	DWORD Dropped;
+
+	INT64 Oldest;
+
+} TIMESERIES_STATS;
+
+DWORD StartTimeSeries(_In_ ENTITY* Entities, _In_ DWORD Megabytes, _In_opt_ wchar_t* FileName);
+
+void StopTimeSeries(void);
+
+INT64 TimeSeriesNow(void);
+
+void RecordTimeSeries(_In_ ENTITY* DC, _In_ TIMESERIES_METRIC Metric, _In_ INT64 Time, _In_ UINT32 Value);
+
+DWORD QueryTimeSeries(_In_ ENTITY* DC, _In_ TIMESERIES_METRIC Metric, _In_ INT64 From, _In_ INT64 To, _Out_ TIMESERIES_POINT* Points, _In_ DWORD MaxPoints, _Out_ DWORD* Count);
+
+DWORD SummarizeTimeSeries(_In_ ENTITY* DC, _In_ TIMESERIES_METRIC Metric, _In_ INT64 From, _In_ INT64 To, _Out_ UINT32* Maximums, _In_ DWORD Buckets);
+
+void GetTimeSeriesStats(_Out_ TIMESERIES_STATS* Stats);
@@ -0,0 +1,967 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// A compressed history of every version of the topology that discovery has found. See Timeline.h.
+
+#include <Windows.h>
+
+#include <compressapi.h>
+
+#include "Main.h"
+
+#include "Snapshot.h"
+
+#include "Diff.h"
+
+#include "Timeline.h"
+
+#pragma comment(lib, "Cabinet.lib")
+
+
+
+typedef struct TIMELINE_ENTRY
+{
+	TIMELINE_RECORD Record;
+
+	// Where the payload starts in the file.
+	UINT64 Offset;
+
+} TIMELINE_ENTRY;
+
+static wchar_t gTimelineFileName[MAX_PATH];
+
+static TIMELINE_ENTRY* gTimelineEntries;
+
+static DWORD gTimelineCount;
+
+static DWORD gTimelineCapacity;
+
+// Where the next version goes. Anything in the file past here is left over from a version that wasn't finished.
+static UINT64 gTimelineEnd;
+
+
+
+static DWORD TimelineReadAt(_In_ HANDLE File, _In_ UINT64 Offset, _Out_ void* Buffer, _In_ DWORD Bytes)
+{
+	LARGE_INTEGER Distance = { .QuadPart = (LONGLONG)Offset };
+
+	DWORD BytesRead = 0;
+
+	if (SetFilePointerEx(File, Distance, NULL, FILE_BEGIN) == FALSE || ReadFile(File, Buffer, Bytes, &BytesRead, NULL) == FALSE)
+	{
+		return(GetLastError());
+	}
+
+	return((BytesRead == Bytes) ? ERROR_SUCCESS : ERROR_HANDLE_EOF);
+}
+
+static DWORD TimelineWriteAt(_In_ HANDLE File, _In_ UINT64 Offset, _In_ const void* Buffer, _In_ DWORD Bytes)
+{
+	LARGE_INTEGER Distance = { .QuadPart = (LONGLONG)Offset };
+
+	DWORD Written = 0;
+
+	if (SetFilePointerEx(File, Distance, NULL, FILE_BEGIN) == FALSE || WriteFile(File, Buffer, Bytes, &Written, NULL) == FALSE)
+	{
+		return(GetLastError());
+	}
+
+	return((Written == Bytes) ? ERROR_SUCCESS : ERROR_WRITE_FAULT);
+}
+
+// On success *Compressed belongs to the caller, to free with HeapFree.
+
+static DWORD TimelineCompress(_In_ BYTE* Data, _In_ DWORD Size, _Out_ BYTE** Compressed, _Out_ DWORD* CompressedSize)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	COMPRESSOR_HANDLE Compressor = NULL;
+
+	SIZE_T Needed = 0;
+
+	*Compressed = NULL;
+
+	*CompressedSize = 0;
+
+	if (CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, NULL, &Compressor) == FALSE)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	// Asking with no buffer gets the most it could need.
+
+	if (Compress(Compressor, Data, Size, NULL, 0, &Needed) == FALSE && (Result = GetLastError()) != ERROR_INSUFFICIENT_BUFFER)
+	{
+		goto Exit;
+	}
+
+	Result = ERROR_SUCCESS;
+
+	if (Needed > MAXDWORD || (*Compressed = HeapAlloc(GetProcessHeap(), 0, Needed)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	if (Compress(Compressor, Data, Size, *Compressed, Needed, &Needed) == FALSE)
+	{
+		Result = GetLastError();
+
+		HeapFree(GetProcessHeap(), 0, *Compressed);
+
+		*Compressed = NULL;
+
+		goto Exit;
+	}
+
+	*CompressedSize = (DWORD)Needed;
+
+Exit:
+
+	if (Compressor)
+	{
+		CloseCompressor(Compressor);
+	}
+
+	return(Result);
+}
+
+// Reads and decompresses a version's payload. On success *Data belongs to the caller, to free with HeapFree.
+
+static DWORD TimelineReadPayload(_In_ HANDLE File, _In_ DWORD Version, _Out_ BYTE** Data)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	TIMELINE_ENTRY* Entry = &gTimelineEntries[Version];
+
+	DECOMPRESSOR_HANDLE Decompressor = NULL;
+
+	BYTE* Compressed = NULL;
+
+	SIZE_T Decompressed = 0;
+
+	*Data = NULL;
+
+	if ((Compressed = HeapAlloc(GetProcessHeap(), 0, max(Entry->Record.CompressedBytes, 1))) == NULL ||
+		(*Data = HeapAlloc(GetProcessHeap(), 0, max(Entry->Record.Bytes, 1))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	if ((Result = TimelineReadAt(File, Entry->Offset, Compressed, Entry->Record.CompressedBytes)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	if (CreateDecompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, NULL, &Decompressor) == FALSE)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	if (Decompress(Decompressor, Compressed, Entry->Record.CompressedBytes, *Data, Entry->Record.Bytes, &Decompressed) == FALSE ||
+		Decompressed != Entry->Record.Bytes)
+	{
+		Result = ERROR_INVALID_DATA;
+
+		goto Exit;
+	}
+
+Exit:
+
+	if (Result != ERROR_SUCCESS && *Data)
+	{
+		HeapFree(GetProcessHeap(), 0, *Data);
+
+		*Data = NULL;
+	}
+
+	if (Decompressor)
+	{
+		CloseDecompressor(Decompressor);
+	}
+
+	if (Compressed)
+	{
+		HeapFree(GetProcessHeap(), 0, Compressed);
+	}
+
+	return(Result);
+}
+
+// Finds Key in a table of Capacity slots, a power of two, that index into Keys. Returns the slot it's in, or the empty
+// one it would go in.
+
+static DWORD TimelineProbe(_In_ DWORD* Table, _In_ DWORD Capacity, _In_ UINT64* Keys, _In_ UINT64 Key)
+{
+	DWORD Slot = (DWORD)Key & (Capacity - 1);
+
+	while (Table[Slot] != TIMELINE_NONE && Keys[Table[Slot]] != Key)
+	{
+		Slot = (Slot + 1) & (Capacity - 1);
+	}
+
+	return(Slot);
+}
+
+static DWORD TimelineLoad(_In_ HANDLE File, _In_ DWORD Version, _Out_ ENTITY** Entities)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD Keyframe = Version;
+
+	DWORD Capacity = 0;
+
+	DWORD TableCapacity = 1;
+
+	DWORD Count = 0;
+
+	ENTITY** Slots = NULL;
+
+	UINT64* Keys = NULL;
+
+	DWORD* Table = NULL;
+
+	BYTE* Payload = NULL;
+
+	ENTITY* Loaded = NULL;
+
+	ENTITY* Tail = NULL;
+
+	*Entities = NULL;
+
+	while (gTimelineEntries[Keyframe].Record.Kind != TLK_KEYFRAME)
+	{
+		if (Keyframe == 0)
+		{
+			return(ERROR_INVALID_DATA);
+		}
+
+		Keyframe--;
+	}
+
+	// Every entity any of the versions from the keyframe on has in it gets a slot, in the order it first appears, and
+	// a removed entity's slot is left empty. A key stays in the table after its entity is removed, so it can be
+	// found again if the entity comes back.
+
+	for (DWORD Index = Keyframe; Index <= Version; Index++)
+	{
+		Capacity += (Index == Keyframe) ? gTimelineEntries[Index].Record.EntityCount : gTimelineEntries[Index].Record.Changes;
+	}
+
+	while (TableCapacity < Capacity * 2)
+	{
+		TableCapacity <<= 1;
+	}
+
+	if ((Slots = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, (SIZE_T)max(Capacity, 1) * sizeof(ENTITY*))) == NULL ||
+		(Keys = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Capacity, 1) * sizeof(UINT64))) == NULL ||
+		(Table = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)TableCapacity * sizeof(DWORD))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	for (DWORD Slot = 0; Slot < TableCapacity; Slot++)
+	{
+		Table[Slot] = TIMELINE_NONE;
+	}
+
+	for (DWORD Index = Keyframe; Index <= Version; Index++)
+	{
+		DWORD Bytes = gTimelineEntries[Index].Record.Bytes;
+
+		DWORD Removed = 0;
+
+		UINT64 SnapshotOffset = 0;
+
+		if ((Result = TimelineReadPayload(File, Index, &Payload)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		if (Index != Keyframe)
+		{
+			if (Bytes >= sizeof(DWORD))
+			{
+				memcpy(&Removed, Payload, sizeof(DWORD));
+			}
+
+			if (Bytes < sizeof(DWORD) || (UINT64)Removed * sizeof(UINT64) > Bytes - sizeof(DWORD))
+			{
+				Result = ERROR_INVALID_DATA;
+
+				goto Exit;
+			}
+
+			for (DWORD Key = 0; Key < Removed; Key++)
+			{
+				UINT64 Value = 0;
+
+				DWORD Slot = 0;
+
+				memcpy(&Value, &Payload[sizeof(DWORD) + (Key * sizeof(UINT64))], sizeof(UINT64));
+
+				Slot = TimelineProbe(Table, TableCapacity, Keys, Value);
+
+				if (Table[Slot] != TIMELINE_NONE && Slots[Table[Slot]])
+				{
+					HeapFree(GetProcessHeap(), 0, Slots[Table[Slot]]);
+
+					Slots[Table[Slot]] = NULL;
+				}
+			}
+
+			SnapshotOffset = sizeof(DWORD) + ((UINT64)Removed * sizeof(UINT64));
+		}
+
+		if ((Result = ReadSnapshot(&Payload[SnapshotOffset], Bytes - SnapshotOffset, &Loaded, NULL)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		HeapFree(GetProcessHeap(), 0, Payload);
+
+		Payload = NULL;
+
+		while (Loaded)
+		{
+			ENTITY* Entity = Loaded;
+
+			UINT64 Key = TopologyEntityKey(Entity);
+
+			DWORD Slot = TimelineProbe(Table, TableCapacity, Keys, Key);
+
+			Loaded = Entity->Next;
+
+			Entity->Next = NULL;
+
+			if (Table[Slot] != TIMELINE_NONE)
+			{
+				if (Slots[Table[Slot]])
+				{
+					HeapFree(GetProcessHeap(), 0, Slots[Table[Slot]]);
+				}
+
+				Slots[Table[Slot]] = Entity;
+			}
+			else if (Count < Capacity)
+			{
+				Keys[Count] = Key;
+
+				Slots[Count] = Entity;
+
+				Table[Slot] = Count++;
+			}
+			else
+			{
+				// More entities than the records said there would be.
+
+				HeapFree(GetProcessHeap(), 0, Entity);
+
+				Result = ERROR_INVALID_DATA;
+
+				goto Exit;
+			}
+		}
+	}
+
+	for (DWORD Slot = 0; Slot < Count; Slot++)
+	{
+		if (Slots[Slot] == NULL)
+		{
+			continue;
+		}
+
+		if (Tail)
+		{
+			Tail->Next = Slots[Slot];
+		}
+		else
+		{
+			*Entities = Slots[Slot];
+		}
+
+		Tail = Slots[Slot];
+
+		Slots[Slot] = NULL;
+	}
+
+Exit:
+
+	FreeEntities(Loaded);
+
+	if (Slots)
+	{
+		for (DWORD Slot = 0; Slot < Count; Slot++)
+		{
+			if (Slots[Slot])
+			{
+				HeapFree(GetProcessHeap(), 0, Slots[Slot]);
+			}
+		}
+
+		HeapFree(GetProcessHeap(), 0, Slots);
+	}
+
+	if (Result != ERROR_SUCCESS)
+	{
+		FreeEntities(*Entities);
+
+		*Entities = NULL;
+	}
+
+	if (Keys)
+	{
+		HeapFree(GetProcessHeap(), 0, Keys);
+	}
+
+	if (Table)
+	{
+		HeapFree(GetProcessHeap(), 0, Table);
+	}
+
+	if (Payload)
+	{
+		HeapFree(GetProcessHeap(), 0, Payload);
+	}
+
+	return(Result);
+}
+
+// Reads the index of versions from the file, stopping at the first one that wasn't completely written.
+
+static DWORD TimelineReadIndex(_In_ HANDLE File, _In_ UINT64 FileSize)
+{
+	UINT64 Offset = sizeof(TIMELINE_HEADER);
+
+	while (Offset + sizeof(TIMELINE_RECORD) <= FileSize)
+	{
+		TIMELINE_RECORD Record = { 0 };
+
+		if (TimelineReadAt(File, Offset, &Record, sizeof(Record)) != ERROR_SUCCESS ||
+			Record.Magic != TIMELINE_RECORD_MAGIC ||
+			(Record.Kind != TLK_KEYFRAME && Record.Kind != TLK_DELTA) ||
+			(gTimelineCount == 0 && Record.Kind != TLK_KEYFRAME) ||
+			Offset + sizeof(Record) + Record.CompressedBytes > FileSize)
+		{
+			break;
+		}
+
+		if (gTimelineCount == gTimelineCapacity)
+		{
+			DWORD Capacity = max(gTimelineCapacity * 2, TIMELINE_INITIAL_CAPACITY);
+
+			TIMELINE_ENTRY* Entries = gTimelineEntries ?
+				HeapReAlloc(GetProcessHeap(), 0, gTimelineEntries, Capacity * sizeof(TIMELINE_ENTRY)) :
+				HeapAlloc(GetProcessHeap(), 0, Capacity * sizeof(TIMELINE_ENTRY));
+
+			if (Entries == NULL)
+			{
+				return(ERROR_NOT_ENOUGH_MEMORY);
+			}
+
+			gTimelineEntries = Entries;
+
+			gTimelineCapacity = Capacity;
+		}
+
+		gTimelineEntries[gTimelineCount].Record = Record;
+
+		gTimelineEntries[gTimelineCount].Offset = Offset + sizeof(Record);
+
+		gTimelineCount++;
+
+		Offset += sizeof(Record) + Record.CompressedBytes;
+	}
+
+	gTimelineEnd = Offset;
+
+	return(ERROR_SUCCESS);
+}
+
+// Works out what the next version's payload is: a delta from the newest version, or a keyframe if it's time for one
+// or the delta comes out too big. On success *Compressed belongs to the caller, to free with HeapFree.
+
+static DWORD TimelineBuildVersion(_In_ HANDLE File, _In_ ENTITY* Entities, _In_ TOPOLOGY_TREE* Tree, _Out_ TIMELINE_RECORD* Record, _Out_ BYTE** Compressed)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	DWORD Keyframe = gTimelineCount;
+
+	ENTITY* Previous = NULL;
+
+	TOPOLOGY_TREE* PreviousTree = NULL;
+
+	TOPOLOGY_DIFF Diff = { 0 };
+
+	ENTITY** Changed = NULL;
+
+	DWORD ChangedCount = 0;
+
+	DWORD RemovedCount = 0;
+
+	BYTE* Snapshot = NULL;
+
+	DWORD SnapshotBytes = 0;
+
+	BYTE* Payload = NULL;
+
+	*Compressed = NULL;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		Record->EntityCount++;
+	}
+
+	while (Keyframe > 0 && gTimelineEntries[Keyframe - 1].Record.Kind != TLK_KEYFRAME)
+	{
+		Keyframe--;
+	}
+
+	// Keyframe is now one past the newest keyframe, if there is one.
+
+	if (gTimelineCount > 0 && gTimelineCount - Keyframe + 1 < TIMELINE_KEYFRAME_INTERVAL)
+	{
+		if ((Result = TimelineLoad(File, gTimelineCount - 1, &Previous)) != ERROR_SUCCESS)
+		{
+			LogEventW(LL_WARN, LF_FILE, L"[%s] Couldn't read back the newest version, error 0x%08lx. Writing a keyframe.", __FUNCTIONW__, Result);
+
+			Result = ERROR_SUCCESS;
+		}
+		else if ((PreviousTree = BuildTopologyTree(Previous)) == NULL)
+		{
+			Result = ERROR_NOT_ENOUGH_MEMORY;
+
+			goto Exit;
+		}
+		else if ((Result = DiffTopology(PreviousTree, Tree, &Diff)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+	}
+
+	if (PreviousTree)
+	{
+		Record->Changes = Diff.Count;
+
+		if ((Changed = HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Diff.Count, 1) * sizeof(ENTITY*))) == NULL)
+		{
+			Result = ERROR_NOT_ENOUGH_MEMORY;
+
+			goto Exit;
+		}
+
+		for (DWORD Index = 0; Index < Diff.Count; Index++)
+		{
+			if (Diff.Entries[Index].New)
+			{
+				Changed[ChangedCount++] = Diff.Entries[Index].New;
+			}
+			else
+			{
+				RemovedCount++;
+			}
+		}
+
+		if ((Result = SaveSnapshotToMemory(Changed, ChangedCount, &Snapshot, &SnapshotBytes)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		Record->Bytes = sizeof(DWORD) + (RemovedCount * sizeof(UINT64)) + SnapshotBytes;
+
+		if ((Payload = HeapAlloc(GetProcessHeap(), 0, Record->Bytes)) == NULL)
+		{
+			Result = ERROR_NOT_ENOUGH_MEMORY;
+
+			goto Exit;
+		}
+
+		memcpy(Payload, &RemovedCount, sizeof(DWORD));
+
+		for (DWORD Index = 0, Removed = 0; Index < Diff.Count; Index++)
+		{
+			if (Diff.Entries[Index].New == NULL)
+			{
+				UINT64 Key = TopologyEntityKey(Diff.Entries[Index].Old);
+
+				memcpy(&Payload[sizeof(DWORD) + (Removed++ * sizeof(UINT64))], &Key, sizeof(UINT64));
+			}
+		}
+
+		memcpy(&Payload[sizeof(DWORD) + (RemovedCount * sizeof(UINT64))], Snapshot, SnapshotBytes);
+
+		if ((Result = TimelineCompress(Payload, Record->Bytes, Compressed, &Record->CompressedBytes)) != ERROR_SUCCESS)
+		{
+			goto Exit;
+		}
+
+		if ((UINT64)Record->CompressedBytes * 100 <= (UINT64)gTimelineEntries[Keyframe - 1].Record.CompressedBytes * TIMELINE_KEYFRAME_PERCENT)
+		{
+			Record->Kind = TLK_DELTA;
+
+			goto Exit;
+		}
+
+		HeapFree(GetProcessHeap(), 0, *Compressed);
+
+		*Compressed = NULL;
+
+		HeapFree(GetProcessHeap(), 0, Snapshot);
+
+		Snapshot = NULL;
+	}
+
+	// A keyframe: the whole topology.
+
+	Record->Kind = TLK_KEYFRAME;
+
+	Record->Changes = Record->EntityCount;
+
+	if ((Changed = Changed ? HeapReAlloc(GetProcessHeap(), 0, Changed, (SIZE_T)max(Record->EntityCount, 1) * sizeof(ENTITY*)) :
+		HeapAlloc(GetProcessHeap(), 0, (SIZE_T)max(Record->EntityCount, 1) * sizeof(ENTITY*))) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	ChangedCount = 0;
+
+	for (ENTITY* Current = Entities; Current != NULL; Current = Current->Next)
+	{
+		Changed[ChangedCount++] = Current;
+	}
+
+	if ((Result = SaveSnapshotToMemory(Changed, ChangedCount, &Snapshot, &Record->Bytes)) != ERROR_SUCCESS ||
+		(Result = TimelineCompress(Snapshot, Record->Bytes, Compressed, &Record->CompressedBytes)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+Exit:
+
+	if (Result != ERROR_SUCCESS && *Compressed)
+	{
+		HeapFree(GetProcessHeap(), 0, *Compressed);
+
+		*Compressed = NULL;
+	}
+
+	if (Payload)
+	{
+		HeapFree(GetProcessHeap(), 0, Payload);
+	}
+
+	if (Snapshot)
+	{
+		HeapFree(GetProcessHeap(), 0, Snapshot);
+	}
+
+	if (Changed)
+	{
+		HeapFree(GetProcessHeap(), 0, Changed);
+	}
+
+	FreeTopologyDiff(&Diff);
+
+	FreeTopologyTree(PreviousTree);
+
+	FreeEntities(Previous);
+
+	return(Result);
+}
+
+// Reads the timeline in FileName, if there is one, for the forest in gForestName. With Entities, the file is created
+// if it has to be, and Entities is added as the newest version if it's any different from the one there; Added says
+// whether it was. Returns ERROR_FILE_NOT_FOUND without Entities and no file, and ERROR_INVALID_DATA if the timeline
+// is another forest's.
+
+DWORD OpenTimeline(_In_ wchar_t* FileName, _In_opt_ ENTITY* Entities, _Out_opt_ BOOL* Added)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	HANDLE File = INVALID_HANDLE_VALUE;
+
+	LARGE_INTEGER FileSize = { 0 };
+
+	TIMELINE_HEADER Header = { 0 };
+
+	TOPOLOGY_TREE* Tree = NULL;
+
+	TIMELINE_RECORD Record = { 0 };
+
+	BYTE* Compressed = NULL;
+
+	if (Added)
+	{
+		*Added = FALSE;
+	}
+
+	CloseTimeline();
+
+	wcscpy_s(gTimelineFileName, _countof(gTimelineFileName), FileName);
+
+	if ((File = CreateFileW(
+		FileName,
+		Entities ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+		Entities ? FILE_SHARE_READ : (FILE_SHARE_READ | FILE_SHARE_WRITE),
+		NULL,
+		Entities ? OPEN_ALWAYS : OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		if (Result != ERROR_FILE_NOT_FOUND)
+		{
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to open %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+		}
+
+		goto Exit;
+	}
+
+	if (GetFileSizeEx(File, &FileSize) == FALSE)
+	{
+		Result = GetLastError();
+
+		goto Exit;
+	}
+
+	if (FileSize.QuadPart == 0 && Entities)
+	{
+		Header.Magic = TIMELINE_MAGIC;
+
+		Header.Version = TIMELINE_VERSION;
+
+		wcscpy_s(Header.ForestName, _countof(Header.ForestName), gForestName);
+
+		if ((Result = TimelineWriteAt(File, 0, &Header, sizeof(Header))) != ERROR_SUCCESS)
+		{
+			LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+			goto Exit;
+		}
+
+		FileSize.QuadPart = sizeof(Header);
+	}
+	else if (TimelineReadAt(File, 0, &Header, sizeof(Header)) != ERROR_SUCCESS || Header.Magic != TIMELINE_MAGIC || Header.Version != TIMELINE_VERSION)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] %s is not a version %d timeline!", __FUNCTIONW__, FileName, TIMELINE_VERSION);
+
+		Result = ERROR_BAD_FORMAT;
+
+		goto Exit;
+	}
+
+	Header.ForestName[_countof(Header.ForestName) - 1] = L'\0';
+
+	if (_wcsicmp(Header.ForestName, gForestName) != 0)
+	{
+		LogEventW(LL_WARN, LF_FILE, L"[%s] %s is the timeline of forest %s, not %s. Move it aside to start one for this forest.", __FUNCTIONW__,
+			FileName,
+			Header.ForestName,
+			gForestName);
+
+		Result = ERROR_INVALID_DATA;
+
+		goto Exit;
+	}
+
+	if ((Result = TimelineReadIndex(File, (UINT64)FileSize.QuadPart)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	if (Entities == NULL)
+	{
+		goto Exit;
+	}
+
+	if ((Tree = BuildTopologyTree(Entities)) == NULL)
+	{
+		Result = ERROR_NOT_ENOUGH_MEMORY;
+
+		goto Exit;
+	}
+
+	if (gTimelineCount > 0 && gTimelineEntries[gTimelineCount - 1].Record.Root == Tree->Root)
+	{
+		LogEventW(LL_INFO, LF_FILE, L"[%s] The topology hasn't changed since the newest of the %lu versions in %s.", __FUNCTIONW__, gTimelineCount, FileName);
+
+		goto Exit;
+	}
+
+	Record.Root = Tree->Root;
+
+	GetSystemTimeAsFileTime(&Record.Created);
+
+	if ((Result = TimelineBuildVersion(File, Entities, Tree, &Record, &Compressed)) != ERROR_SUCCESS)
+	{
+		goto Exit;
+	}
+
+	if (gTimelineCount == gTimelineCapacity)
+	{
+		DWORD Capacity = max(gTimelineCapacity * 2, TIMELINE_INITIAL_CAPACITY);
+
+		TIMELINE_ENTRY* Entries = gTimelineEntries ?
+			HeapReAlloc(GetProcessHeap(), 0, gTimelineEntries, Capacity * sizeof(TIMELINE_ENTRY)) :
+			HeapAlloc(GetProcessHeap(), 0, Capacity * sizeof(TIMELINE_ENTRY));
+
+		if (Entries == NULL)
+		{
+			Result = ERROR_NOT_ENOUGH_MEMORY;
+
+			goto Exit;
+		}
+
+		gTimelineEntries = Entries;
+
+		gTimelineCapacity = Capacity;
+	}
+
+	// Anything past the last complete version goes first. The record is written without its magic number, and only
+	// gets it once the payload is in, as snapshots do.
+
+	Record.Magic = 0;
+
+	if ((Result = TimelineWriteAt(File, gTimelineEnd, &Record, sizeof(Record))) != ERROR_SUCCESS ||
+		(Result = TimelineWriteAt(File, gTimelineEnd + sizeof(Record), Compressed, Record.CompressedBytes)) != ERROR_SUCCESS ||
+		SetEndOfFile(File) == FALSE)
+	{
+		Result = Result ? Result : GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+	Record.Magic = TIMELINE_RECORD_MAGIC;
+
+	if ((Result = TimelineWriteAt(File, gTimelineEnd, &Record.Magic, sizeof(Record.Magic))) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to write %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+	gTimelineEntries[gTimelineCount].Record = Record;
+
+	gTimelineEntries[gTimelineCount].Offset = gTimelineEnd + sizeof(Record);
+
+	gTimelineCount++;
+
+	gTimelineEnd += sizeof(Record) + Record.CompressedBytes;
+
+	if (Added)
+	{
+		*Added = TRUE;
+	}
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Added version %lu to %s as a %s: %lu of %lu entities, %lu bytes compressed to %lu.", __FUNCTIONW__,
+		gTimelineCount,
+		FileName,
+		Record.Kind == TLK_KEYFRAME ? L"keyframe" : L"delta",
+		Record.Changes,
+		Record.EntityCount,
+		Record.Bytes,
+		Record.CompressedBytes);
+
+Exit:
+
+	if (Result != ERROR_SUCCESS)
+	{
+		CloseTimeline();
+	}
+
+	if (Compressed)
+	{
+		HeapFree(GetProcessHeap(), 0, Compressed);
+	}
+
+	FreeTopologyTree(Tree);
+
+	if (File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(File);
+	}
+
+	return(Result);
+}
+
+DWORD GetTimelineCount(void)
+{
+	return(gTimelineCount);
+}
+
+BOOL GetTimelineRecord(_In_ DWORD Version, _Out_ TIMELINE_RECORD* Record)
+{
+	if (Version >= gTimelineCount)
+	{
+		return(FALSE);
+	}
+
+	*Record = gTimelineEntries[Version].Record;
+
+	return(TRUE);
+}
+
+// Puts a version back together from its keyframe and the deltas after it. On success *Entities is a new entity list
+// that belongs to the caller, to free with FreeEntities.
+
+DWORD LoadTimelineVersion(_In_ DWORD Version, _Out_ ENTITY** Entities)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	HANDLE File = INVALID_HANDLE_VALUE;
+
+	*Entities = NULL;
+
+	if (Version >= gTimelineCount)
+	{
+		return(ERROR_INVALID_PARAMETER);
+	}
+
+	if ((File = CreateFileW(gTimelineFileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to open %s! Error 0x%08lx", __FUNCTIONW__, gTimelineFileName, Result);
+
+		return(Result);
+	}
+
+	if ((Result = TimelineLoad(File, Version, Entities)) != ERROR_SUCCESS)
+	{
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to read version %lu of %s! Error 0x%08lx", __FUNCTIONW__, Version + 1, gTimelineFileName, Result);
+	}
+
+	CloseHandle(File);
+
+	return(Result);
+}
+
+void CloseTimeline(void)
+{
+	if (gTimelineEntries)
+	{
+		HeapFree(GetProcessHeap(), 0, gTimelineEntries);
+	}
+
+	gTimelineEntries = NULL;
+
+	gTimelineCount = 0;
+
+	gTimelineCapacity = 0;
+
+	gTimelineEnd = 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// Every live discovery adds the topology it found to a timeline file, if it has changed since the newest version
+// there, so the map can later be compared against how the forest looked on any day before. Most versions are written
+// as a delta from the one before: the keys of the entities that went away, and a snapshot of just the entities that
+// were added or changed. Every TIMELINE_KEYFRAME_INTERVAL versions, or when a delta would be nearly as big, the whole
+// topology is written instead, so getting any version back means reading one keyframe and at most
+// TIMELINE_KEYFRAME_INTERVAL - 1 deltas after it. Each is compressed with XPRESS Huffman; snapshots are mostly UTF-16
+// DNs that repeat each other, and shrink a lot. The file grows with how much the forest changes, not with how often
+// it's discovered.
+//
+// Versions are only ever compared against the topology on screen, as -compare does, and comparisons don't look at
+// positions, so a version's positions are whatever they were at its keyframe.
+//
+// OpenTimeline reads the file's index once, on the discovery thread. Everything else is for whichever thread calls it
+// after that, one at a time. The file is only open while it's being read or written, so a headless collection can add
+// to it while the map is showing.
+//
+// File layout: a TIMELINE_HEADER, then for every version a TIMELINE_RECORD followed by CompressedBytes of payload.
+// A keyframe's payload is a snapshot. A delta's is a DWORD count of the entities removed, their UINT64 keys (see
+// TopologyEntityKey), then a snapshot of the entities added or changed.
+
+#define TIMELINE_MAGIC				0x4C544441	// "ADTL"
+
+#define TIMELINE_RECORD_MAGIC		0x52544441	// "ADTR"
+
+#define TIMELINE_VERSION			1
+
+#define TIMELINE_FILE_NAME			L"ADTV_timeline.adtvt"
+
+#define TIMELINE_KEYFRAME_INTERVAL	16
+
+// A delta that would compress to more than this percentage of the newest keyframe is written as a keyframe instead.
+#define TIMELINE_KEYFRAME_PERCENT	50
+
+#define TIMELINE_INITIAL_CAPACITY	64
+
+// No version; the map isn't being compared against the timeline.
+#define TIMELINE_NONE				MAXDWORD
+
+typedef enum TIMELINE_KIND
+{
+	TLK_KEYFRAME = 1,
+
+	TLK_DELTA
+
+} TIMELINE_KIND;
+
+typedef struct TIMELINE_HEADER
+{
+	DWORD Magic;
+
+	DWORD Version;
+
+	// Versions of one forest are only ever deltas from each other; a timeline belongs to the forest that started it.
+	wchar_t ForestName[256];
+
+} TIMELINE_HEADER;
+
+typedef struct TIMELINE_RECORD
+{
+	// Zero until the record and its payload have both been written, so a version that was only half written when the
+	// process died is never read back.
+	DWORD Magic;
+
+	DWORD Kind;
+
+	DWORD CompressedBytes;
+
+	DWORD Bytes;
+
+	// How many entities there are in this version, and how many were added, removed or changed since the one before.
+	DWORD EntityCount;
+
+	DWORD Changes;
+
+	FILETIME Created;
+
+	// The root hash of the version's TOPOLOGY_TREE. A discovery whose root is the same as the newest version's adds
+	// nothing.
+	UINT64 Root;
+
+} TIMELINE_RECORD;
+
+DWORD OpenTimeline(_In_ wchar_t* FileName, _In_opt_ ENTITY* Entities, _Out_opt_ BOOL* Added);
+
+DWORD GetTimelineCount(void);
+
+BOOL GetTimelineRecord(_In_ DWORD Version, _Out_ TIMELINE_RECORD* Record);
+
+DWORD LoadTimelineVersion(_In_ DWORD Version, _Out_ ENTITY** Entities);
+
+void CloseTimeline(void);
@@ -0,0 +1,287 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Fuzzes the DN parser in DistinguishedName.c. The input is taken as UTF-16 and read as a DN, and whatever comes
+// back is checked against what the parser promises: every view lies inside the DN and after the one before it,
+// attributes only ever move on to the next RDN, every value unescapes into a buffer as long as its view, a buffer
+// that's too short gets a terminated prefix of the same thing, escaping a value again and reading it back gives the
+// same value, and a DN's parent reads as the same attributes less the first RDN.
+//
+// With libFuzzer, from the repository root:
+//
+//     clang-cl /fsanitize=fuzzer,address /I. Tools\DnFuzz.c DistinguishedName.c
+//     DnFuzz.exe -max_len=1024 corpus
+//
+// or cl /fsanitize=fuzzer /fsanitize=address in place of clang-cl. Built with DNFUZZ_STANDALONE defined instead, it
+// runs each file named on the command line through the same checks, to replay a crash without libFuzzer.
+
+#include <Windows.h>
+
+#include <stdio.h>
+
+#include <stdlib.h>
+
+#include "DistinguishedName.h"
+
+
+
+#define DNFUZZ_MAX_ATTRIBUTES	1024
+
+// Anything a value has in it that wouldn't read back as itself. A leading # or space, and a trailing space, are
+// escaped as well, where they occur.
+#define DNFUZZ_SPECIALS			L"\"+,;<>\\="
+
+#define DNFUZZ_CHECK(Condition)	if (!(Condition)) { fprintf(stderr, "DnFuzz: %s failed at line %d\n", #Condition, __LINE__); abort(); }
+
+// Writes Value escaped so that it can go back into a DN.
+
+static wchar_t* DnFuzzEscape(_In_ wchar_t* Value)
+{
+	size_t Length = wcslen(Value);
+
+	wchar_t* Escaped = malloc(((Length * 2) + 8) * sizeof(wchar_t));
+
+	wchar_t* Cursor = Escaped;
+
+	DNFUZZ_CHECK(Escaped != NULL);
+
+	wmemcpy(Cursor, L"CN=", 3);
+
+	Cursor += 3;
+
+	for (size_t Index = 0; Index < Length; Index++)
+	{
+		if (wcschr(DNFUZZ_SPECIALS, Value[Index]) != NULL ||
+			(Index == 0 && (Value[Index] == L'#' || Value[Index] == L' ')) ||
+			(Index == Length - 1 && Value[Index] == L' '))
+		{
+			*Cursor++ = L'\\';
+		}
+
+		*Cursor++ = Value[Index];
+	}
+
+	*Cursor = L'\0';
+
+	return(Escaped);
+}
+
+// Reads up to DNFUZZ_MAX_ATTRIBUTES attributes. Returns how many, with the reader's result in Result.
+
+static DWORD DnFuzzRead(_In_ wchar_t* DN, _In_ DWORD Length, _Out_ DN_ATTRIBUTE* Attributes, _Out_ DWORD* Result)
+{
+	DN_READER Reader = { 0 };
+
+	DWORD Count = 0;
+
+	DWORD End = 0;
+
+	InitializeDnReader(&Reader, DN, Length);
+
+	while (Count < DNFUZZ_MAX_ATTRIBUTES && DnNextAttribute(&Reader, &Attributes[Count]) == ERROR_SUCCESS)
+	{
+		DN_ATTRIBUTE* Attribute = &Attributes[Count];
+
+		DNFUZZ_CHECK(Attribute->Type.Length > 0);
+
+		DNFUZZ_CHECK(Attribute->Type.Offset >= End);
+
+		DNFUZZ_CHECK(Attribute->Value.Offset >= Attribute->Type.Offset + Attribute->Type.Length + 1);
+
+		DNFUZZ_CHECK(Attribute->Value.Offset + Attribute->Value.Length <= Length);
+
+		DNFUZZ_CHECK(Count == 0 ? Attribute->Rdn == 0 : (Attribute->Rdn == Attributes[Count - 1].Rdn || Attribute->Rdn == Attributes[Count - 1].Rdn + 1));
+
+		End = Attribute->Value.Offset + Attribute->Value.Length;
+
+		Count++;
+	}
+
+	*Result = Reader.Result;
+
+	DNFUZZ_CHECK(Count == DNFUZZ_MAX_ATTRIBUTES || Reader.Result == ERROR_NO_MORE_ITEMS || Reader.Result == ERROR_INVALID_DATA);
+
+	return(Count);
+}
+
+static void DnFuzzCheckValue(_In_ wchar_t* DN, _In_ DN_ATTRIBUTE* Attribute)
+{
+	// Unescaping never makes a value longer than it's written, so this is always enough. It's allocated to size so
+	// that the address sanitizer catches a write past it.
+
+	size_t Count = Attribute->Value.Length + 1;
+
+	wchar_t* Full = malloc(Count * sizeof(wchar_t));
+
+	DNFUZZ_CHECK(Full != NULL);
+
+	DNFUZZ_CHECK(DnCopyValue(DN, Attribute, Full, Count) == ERROR_SUCCESS);
+
+	for (size_t Short = 1; Short < Count && Short < 64; Short++)
+	{
+		wchar_t* Prefix = malloc(Short * sizeof(wchar_t));
+
+		DWORD Result = 0;
+
+		DNFUZZ_CHECK(Prefix != NULL);
+
+		Result = DnCopyValue(DN, Attribute, Prefix, Short);
+
+		DNFUZZ_CHECK(wcslen(Prefix) < Short);
+
+		DNFUZZ_CHECK(wcsncmp(Prefix, Full, wcslen(Prefix)) == 0);
+
+		DNFUZZ_CHECK(Result == (wcslen(Prefix) == wcslen(Full) ? ERROR_SUCCESS : ERROR_INSUFFICIENT_BUFFER));
+
+		free(Prefix);
+	}
+
+	if ((Attribute->Flags & DNAF_HEX) == 0)
+	{
+		wchar_t* Escaped = DnFuzzEscape(Full);
+
+		wchar_t* Again = malloc(Count * sizeof(wchar_t));
+
+		DN_ATTRIBUTE Reread[DNFUZZ_MAX_ATTRIBUTES];
+
+		DWORD Result = 0;
+
+		DNFUZZ_CHECK(Again != NULL);
+
+		DNFUZZ_CHECK(DnFuzzRead(Escaped, (DWORD)wcslen(Escaped), Reread, &Result) == 1 && Result == ERROR_NO_MORE_ITEMS);
+
+		DNFUZZ_CHECK(DnCopyValue(Escaped, &Reread[0], Again, Count) == ERROR_SUCCESS);
+
+		DNFUZZ_CHECK(wcscmp(Again, Full) == 0);
+
+		free(Again);
+
+		free(Escaped);
+	}
+
+	free(Full);
+}
+
+int LLVMFuzzerTestOneInput(const BYTE* Data, size_t Size)
+{
+	static DN_ATTRIBUTE Attributes[DNFUZZ_MAX_ATTRIBUTES];
+
+	static DN_ATTRIBUTE ParentAttributes[DNFUZZ_MAX_ATTRIBUTES];
+
+	DWORD Length = (DWORD)(Size / sizeof(wchar_t));
+
+	wchar_t* DN = malloc((Length + 1) * sizeof(wchar_t));
+
+	DWORD Count = 0;
+
+	DWORD Result = 0;
+
+	DNFUZZ_CHECK(DN != NULL);
+
+	memcpy(DN, Data, Length * sizeof(wchar_t));
+
+	DN[Length] = L'\0';
+
+	Count = DnFuzzRead(DN, Length, Attributes, &Result);
+
+	for (DWORD Attribute = 0; Attribute < Count; Attribute++)
+	{
+		DnFuzzCheckValue(DN, &Attributes[Attribute]);
+	}
+
+	// The helpers read up to the first NUL, so they're only comparable to the reader when there isn't one earlier.
+
+	if (wcslen(DN) == Length && Count < DNFUZZ_MAX_ATTRIBUTES)
+	{
+		wchar_t* Parent = DnParent(DN);
+
+		wchar_t First[64] = { 0 };
+
+		wchar_t Domain[256] = { 0 };
+
+		DWORD FirstResult = DnFirstValue(DN, First, _countof(First));
+
+		DWORD DomainResult = DnToDomainName(DN, Domain, _countof(Domain));
+
+		if (Result != ERROR_NO_MORE_ITEMS)
+		{
+			DNFUZZ_CHECK(Parent == NULL && First[0] == L'\0' && Domain[0] == L'\0');
+
+			DNFUZZ_CHECK(FirstResult == Result && DomainResult == Result);
+		}
+		else
+		{
+			DNFUZZ_CHECK(FirstResult == (Count ? ERROR_SUCCESS : ERROR_NO_MORE_ITEMS) || FirstResult == ERROR_INSUFFICIENT_BUFFER);
+
+			DNFUZZ_CHECK(DomainResult == ERROR_SUCCESS || DomainResult == ERROR_NOT_FOUND || DomainResult == ERROR_INSUFFICIENT_BUFFER);
+
+			DNFUZZ_CHECK((Parent != NULL) == (Count > 0 && Attributes[Count - 1].Rdn > 0));
+		}
+
+		if (Parent)
+		{
+			DWORD ParentResult = 0;
+
+			DWORD Skipped = 0;
+
+			DWORD ParentCount = DnFuzzRead(Parent, (DWORD)wcslen(Parent), ParentAttributes, &ParentResult);
+
+			DNFUZZ_CHECK(ParentResult == ERROR_NO_MORE_ITEMS);
+
+			while (Attributes[Skipped].Rdn == 0)
+			{
+				Skipped++;
+			}
+
+			DNFUZZ_CHECK(ParentCount == Count - Skipped);
+
+			for (DWORD Attribute = 0; Attribute < ParentCount; Attribute++)
+			{
+				DNFUZZ_CHECK(ParentAttributes[Attribute].Rdn + 1 == Attributes[Attribute + Skipped].Rdn);
+
+				DNFUZZ_CHECK(ParentAttributes[Attribute].Value.Length == Attributes[Attribute + Skipped].Value.Length);
+
+				DNFUZZ_CHECK(wmemcmp(
+					Parent + ParentAttributes[Attribute].Value.Offset,
+					DN + Attributes[Attribute + Skipped].Value.Offset,
+					ParentAttributes[Attribute].Value.Length) == 0);
+			}
+		}
+	}
+
+	free(DN);
+
+	return(0);
+}
+
+#ifdef DNFUZZ_STANDALONE
+
+int main(int argc, char* argv[])
+{
+	for (int Arg = 1; Arg < argc; Arg++)
+	{
+		FILE* File = fopen(argv[Arg], "rb");
+
+		BYTE* Data = NULL;
+
+		long Size = 0;
+
+		if (File == NULL || fseek(File, 0, SEEK_END) != 0 || (Size = ftell(File)) < 0 || fseek(File, 0, SEEK_SET) != 0 ||
+			(Data = malloc((size_t)Size + 1)) == NULL || fread(Data, 1, (size_t)Size, File) != (size_t)Size)
+		{
+			fprintf(stderr, "Couldn't read %s.\n", argv[Arg]);
+
+			return(EXIT_FAILURE);
+		}
+
+		fclose(File);
+
+		LLVMFuzzerTestOneInput(Data, (size_t)Size);
+
+		free(Data);
+	}
+
+	return(EXIT_SUCCESS);
+}
+
+#endif
@@ -0,0 +1,1111 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Plays back render command lists written by ADTV (the R key, or -benchmark render) with backends that don't need
+// Windows, and times each one, so that a change to how frames are drawn can be measured on the same recorded frames
+// every time, on any machine. See RenderList.h for the file format.
+//
+// Needs nothing but a C11 compiler:
+//
+//     gcc -O2 -o ReplayBench ReplayBench.c -lm
+//     cl /O2 ReplayBench.c
+//
+// Usage: ReplayBench <file.adtvr> [-backend null|raster] [-passes n] [-ppm frame]
+//
+// "null" only decodes the commands; it's the floor any real backend is measured against. "raster" draws them into
+// a 32bpp buffer the size of the recorded frame, with pens, brushes and dash styles as recorded. It has no fonts, so
+// text is drawn as one outlined cell per character, in the font's height. Every backend prints a checksum of what it
+// produced; it only changes when the output does, so two builds can be checked against each other as well as timed.
+
+#include <math.h>
+
+#include <stdint.h>
+
+#include <stdio.h>
+
+#include <stdlib.h>
+
+#include <string.h>
+
+#include <time.h>
+
+typedef int32_t INT32;
+
+typedef uint32_t UINT32;
+
+typedef uint16_t UINT16;
+
+typedef uint64_t UINT64;
+
+#define RENDERLIST_FORMAT_ONLY
+
+#include "../RenderList.h"
+
+
+
+#define DEFAULT_PASSES		5
+
+// From wingdi.h.
+#define PS_DASH				1
+
+#define PS_DOT				2
+
+#define TEXT_COLOR			0x00FFFFFF
+
+#define FNV_OFFSET_BASIS	0x811C9DC5u
+
+#define FNV_PRIME			0x01000193u
+
+// Anything further out than this is taken to be damage, not drawing. It keeps the arithmetic on coordinates, and on
+// pen widths and font heights, well inside an int.
+#define MAX_COORDINATE		(1 << 28)
+
+#define MAX_RESOURCE_SIZE	4096
+
+typedef struct FRAME
+{
+	RENDER_FRAME_HEADER* Header;
+
+	RENDER_RESOURCE* Resources;
+
+	UINT32* Words;
+
+} FRAME;
+
+typedef struct RASTER
+{
+	int Width;
+
+	int Height;
+
+	UINT32* Pixels;
+
+	// 0x00RRGGBB, as the pixels are stored.
+	UINT32 PenColor;
+
+	int PenWidth;
+
+	UINT32 PenStyle;
+
+	UINT32 BrushColor;
+
+	int FontHeight;
+
+	// How far along the dash pattern the pen is, carried from one segment of a polyline to the next.
+	int DashPhase;
+
+} RASTER;
+
+typedef UINT32(*BACKEND_PROC)(FRAME* Frame, RASTER* Raster);
+
+typedef struct BACKEND
+{
+	const char* Name;
+
+	BACKEND_PROC Proc;
+
+	// Whether the result is the pixels, rather than whatever Proc returns. They're checksummed after the clock stops.
+	int DrawsPixels;
+
+} BACKEND;
+
+static UINT32 NullBackend(FRAME* Frame, RASTER* Raster);
+
+static UINT32 RasterBackend(FRAME* Frame, RASTER* Raster);
+
+static BACKEND gBackends[] = {
+	{ "null", NullBackend, 0 },
+	{ "raster", RasterBackend, 1 }
+};
+
+
+
+static double Seconds(void)
+{
+	struct timespec Now = { 0 };
+
+	timespec_get(&Now, TIME_UTC);
+
+	return((double)Now.tv_sec + (Now.tv_nsec / 1e9));
+}
+
+static UINT32 Fnv(UINT32 Hash, const void* Data, size_t Size)
+{
+	const unsigned char* Bytes = Data;
+
+	for (size_t Byte = 0; Byte < Size; Byte++)
+	{
+		Hash = (Hash ^ Bytes[Byte]) * FNV_PRIME;
+	}
+
+	return(Hash);
+}
+
+static UINT32 ToPixel(UINT32 ColorRef)
+{
+	return(((ColorRef & 0xFF) << 16) | (ColorRef & 0xFF00) | ((ColorRef >> 16) & 0xFF));
+}
+
+static int CompareDoubles(const void* A, const void* B)
+{
+	double Left = *(const double*)A;
+
+	double Right = *(const double*)B;
+
+	return((Left > Right) - (Left < Right));
+}
+
+// Checks every command in a frame once, when the file is loaded, so the backends can trust what they read.
+
+static int ValidCoordinates(INT32* Coordinates, UINT32 Count)
+{
+	for (UINT32 Coordinate = 0; Coordinate < Count; Coordinate++)
+	{
+		if (Coordinates[Coordinate] < -MAX_COORDINATE || Coordinates[Coordinate] > MAX_COORDINATE)
+		{
+			return(0);
+		}
+	}
+
+	return(1);
+}
+
+static int ValidateFrame(FRAME* Frame)
+{
+	UINT32 Offset = 0;
+
+	UINT32 Commands = 0;
+
+	for (UINT32 Resource = 0; Resource < Frame->Header->ResourceCount; Resource++)
+	{
+		if (Frame->Resources[Resource].Kind >= RRK_COUNT ||
+			Frame->Resources[Resource].Size < 0 || Frame->Resources[Resource].Size > MAX_RESOURCE_SIZE)
+		{
+			return(0);
+		}
+	}
+
+	while (Offset < Frame->Header->WordCount)
+	{
+		RENDER_HEADER* Header = (RENDER_HEADER*)&Frame->Words[Offset];
+
+		UINT32 Minimum = 0;
+
+		if (Header->Words == 0 || Header->Words > Frame->Header->WordCount - Offset || Header->Op >= RO_COUNT)
+		{
+			return(0);
+		}
+
+		switch (Header->Op)
+		{
+			case RO_PEN:
+			case RO_BRUSH:
+			case RO_FONT:
+			{
+				RENDER_SELECT* Select = (RENDER_SELECT*)Header;
+
+				Minimum = sizeof(RENDER_SELECT) / sizeof(UINT32);
+
+				if (Header->Words < Minimum ||
+					Select->Resource >= Frame->Header->ResourceCount ||
+					Frame->Resources[Select->Resource].Kind != (UINT32)(Header->Op - RO_PEN))
+				{
+					return(0);
+				}
+
+				break;
+			}
+			case RO_POLYLINE:
+			case RO_POLYGON:
+			{
+				Minimum = sizeof(RENDER_POINTS) / sizeof(UINT32);
+
+				if (Header->Words < Minimum || ((RENDER_POINTS*)Header)->Count > (UINT32)(Header->Words - Minimum) / 2 ||
+					ValidCoordinates((INT32*)((RENDER_POINTS*)Header + 1), ((RENDER_POINTS*)Header)->Count * 2) == 0)
+				{
+					return(0);
+				}
+
+				break;
+			}
+			case RO_ELLIPSE:
+			case RO_FILL_RECT:
+			case RO_FRAME_RECT:
+			{
+				Minimum = sizeof(RENDER_RECT) / sizeof(UINT32);
+
+				if (Header->Words < Minimum ||
+					(Header->Op != RO_ELLIPSE && ((RENDER_RECT*)Header)->Resource >= Frame->Header->ResourceCount) ||
+					ValidCoordinates(&((RENDER_RECT*)Header)->Left, 4) == 0)
+				{
+					return(0);
+				}
+
+				break;
+			}
+			case RO_TEXT:
+			{
+				Minimum = sizeof(RENDER_TEXT) / sizeof(UINT32);
+
+				if (Header->Words < Minimum || ((RENDER_TEXT*)Header)->Length > (UINT32)(Header->Words - Minimum) * 2 ||
+					ValidCoordinates(&((RENDER_TEXT*)Header)->X, 2) == 0)
+				{
+					return(0);
+				}
+
+				break;
+			}
+		}
+
+		Offset += Header->Words;
+
+		Commands++;
+	}
+
+	return(Commands == Frame->Header->CommandCount);
+}
+
+// Reads the whole file, and points each FRAME into it. Returns the number of frames, or 0 if the file isn't one.
+
+static UINT32 LoadFrames(const char* FileName, unsigned char** Data, FRAME** Frames)
+{
+	FILE* File = NULL;
+
+	long Size = 0;
+
+	size_t Offset = 0;
+
+	UINT32 Count = 0;
+
+	UINT32 Capacity = 0;
+
+	*Data = NULL;
+
+	*Frames = NULL;
+
+	if ((File = fopen(FileName, "rb")) == NULL)
+	{
+		fprintf(stderr, "Couldn't open %s.\n", FileName);
+
+		goto Exit;
+	}
+
+	if (fseek(File, 0, SEEK_END) != 0 || (Size = ftell(File)) <= 0 || fseek(File, 0, SEEK_SET) != 0 ||
+		(*Data = malloc((size_t)Size)) == NULL ||
+		fread(*Data, 1, (size_t)Size, File) != (size_t)Size)
+	{
+		fprintf(stderr, "Couldn't read %s.\n", FileName);
+
+		goto Exit;
+	}
+
+	while (Offset < (size_t)Size)
+	{
+		FRAME Frame = { 0 };
+
+		size_t Remaining = (size_t)Size - Offset;
+
+		if (Remaining < sizeof(RENDER_FRAME_HEADER))
+		{
+			break;
+		}
+
+		Frame.Header = (RENDER_FRAME_HEADER*)(*Data + Offset);
+
+		if (Frame.Header->Magic != RENDER_LIST_MAGIC || Frame.Header->Version != RENDER_LIST_VERSION ||
+			Frame.Header->Width <= 0 || Frame.Header->Height <= 0 ||
+			Frame.Header->ResourceCount > RENDER_MAX_RESOURCES ||
+			Remaining - sizeof(RENDER_FRAME_HEADER) < Frame.Header->ResourceCount * sizeof(RENDER_RESOURCE) ||
+			(size_t)Frame.Header->WordCount > (Remaining - sizeof(RENDER_FRAME_HEADER) - (Frame.Header->ResourceCount * sizeof(RENDER_RESOURCE))) / sizeof(UINT32))
+		{
+			break;
+		}
+
+		Frame.Resources = (RENDER_RESOURCE*)(Frame.Header + 1);
+
+		Frame.Words = (UINT32*)(Frame.Resources + Frame.Header->ResourceCount);
+
+		if (ValidateFrame(&Frame) == 0)
+		{
+			break;
+		}
+
+		if (Count == Capacity)
+		{
+			FRAME* NewFrames = realloc(*Frames, (Capacity ? Capacity * 2 : 64) * sizeof(FRAME));
+
+			if (NewFrames == NULL)
+			{
+				break;
+			}
+
+			*Frames = NewFrames;
+
+			Capacity = Capacity ? Capacity * 2 : 64;
+		}
+
+		(*Frames)[Count++] = Frame;
+
+		Offset += sizeof(RENDER_FRAME_HEADER) + (Frame.Header->ResourceCount * sizeof(RENDER_RESOURCE)) + (Frame.Header->WordCount * sizeof(UINT32));
+	}
+
+	if (Offset != (size_t)Size)
+	{
+		fprintf(stderr, "Frame %u of %s is damaged or not a render list; stopping there.\n", Count, FileName);
+	}
+
+Exit:
+
+	if (File)
+	{
+		fclose(File);
+	}
+
+	return(Count);
+}
+
+// Decodes every command and folds what it says into the checksum, without drawing anything.
+
+static UINT32 NullBackend(FRAME* Frame, RASTER* Raster)
+{
+	UINT32 Hash = FNV_OFFSET_BASIS;
+
+	(void)Raster;
+
+	for (UINT32 Offset = 0; Offset < Frame->Header->WordCount; )
+	{
+		RENDER_HEADER* Header = (RENDER_HEADER*)&Frame->Words[Offset];
+
+		switch (Header->Op)
+		{
+			case RO_PEN:
+			case RO_BRUSH:
+			case RO_FONT:
+			{
+				Hash = Fnv(Hash, &Frame->Resources[((RENDER_SELECT*)Header)->Resource], sizeof(RENDER_RESOURCE));
+
+				break;
+			}
+			case RO_POLYLINE:
+			case RO_POLYGON:
+			{
+				RENDER_POINTS* Points = (RENDER_POINTS*)Header;
+
+				Hash = Fnv(Hash, Points + 1, Points->Count * 2 * sizeof(INT32));
+
+				break;
+			}
+			case RO_ELLIPSE:
+			case RO_FILL_RECT:
+			case RO_FRAME_RECT:
+			{
+				Hash = Fnv(Hash, &((RENDER_RECT*)Header)->Left, 4 * sizeof(INT32));
+
+				break;
+			}
+			case RO_TEXT:
+			{
+				RENDER_TEXT* Text = (RENDER_TEXT*)Header;
+
+				Hash = Fnv(Hash, Text + 1, Text->Length * sizeof(UINT16));
+
+				break;
+			}
+		}
+
+		Hash = Fnv(Hash, &Header->Op, sizeof(Header->Op));
+
+		Offset += Header->Words;
+	}
+
+	return(Hash);
+}
+
+static void FillSpan(RASTER* Raster, int Y, int Left, int Right, UINT32 Color)
+{
+	if (Y < 0 || Y >= Raster->Height)
+	{
+		return;
+	}
+
+	Left = Left < 0 ? 0 : Left;
+
+	Right = Right > Raster->Width ? Raster->Width : Right;
+
+	if (Right <= Left)
+	{
+		return;
+	}
+
+	for (UINT32* Pixel = &Raster->Pixels[(size_t)Y * Raster->Width + Left], *End = Pixel + (Right - Left); Pixel < End; Pixel++)
+	{
+		*Pixel = Color;
+	}
+}
+
+// Fills [Left, Right) x [Top, Bottom), the way FillRect does.
+
+static void FillBox(RASTER* Raster, int Left, int Top, int Right, int Bottom, UINT32 Color)
+{
+	Top = Top < 0 ? 0 : Top;
+
+	Bottom = Bottom > Raster->Height ? Raster->Height : Bottom;
+
+	for (int Y = Top; Y < Bottom; Y++)
+	{
+		FillSpan(Raster, Y, Left, Right, Color);
+	}
+}
+
+static void FrameBox(RASTER* Raster, int Left, int Top, int Right, int Bottom, UINT32 Color)
+{
+	if (Right <= Left || Bottom <= Top)
+	{
+		return;
+	}
+
+	FillBox(Raster, Left, Top, Right, Top + 1, Color);
+
+	FillBox(Raster, Left, Bottom - 1, Right, Bottom, Color);
+
+	FillBox(Raster, Left, Top + 1, Left + 1, Bottom - 1, Color);
+
+	FillBox(Raster, Right - 1, Top + 1, Right, Bottom - 1, Color);
+}
+
+// Whether the pen is down at this step of its dash pattern.
+
+static int PenDown(RASTER* Raster)
+{
+	int Phase = Raster->DashPhase++;
+
+	switch (Raster->PenStyle)
+	{
+		case PS_DASH:
+		{
+			return((Phase % 24) < 18);
+		}
+		case PS_DOT:
+		{
+			return((Phase % 6) < 3);
+		}
+	}
+
+	return(1);
+}
+
+// Bresenham, with a square the pen's width stamped at each step. The end point is left off, as GDI does.
+
+static void DrawLine(RASTER* Raster, int FromX, int FromY, int ToX, int ToY)
+{
+	int DeltaX = 0;
+
+	int DeltaY = 0;
+
+	int StepX = 0;
+
+	int StepY = 0;
+
+	int Error = 0;
+
+	int Half = Raster->PenWidth / 2;
+
+	// Lines are clipped to the buffer, plus the pen's reach, before they're stepped along. Sites and KCC connections
+	// in a zoomed in frame can reach millions of pixels off it. The dash pattern carries on from where it would have
+	// been had the clipped off part been drawn.
+
+	double Start = 0.0;
+
+	double End = 1.0;
+
+	double Deltas[4] = { -(double)(ToX - FromX), (double)(ToX - FromX), -(double)(ToY - FromY), (double)(ToY - FromY) };
+
+	double Distances[4] = { (double)FromX + Half + 1, (double)Raster->Width + Half - FromX, (double)FromY + Half + 1, (double)Raster->Height + Half - FromY };
+
+	int Steps = abs(ToX - FromX) > abs(ToY - FromY) ? abs(ToX - FromX) : abs(ToY - FromY);
+
+	for (int Edge = 0; Edge < 4; Edge++)
+	{
+		if (Deltas[Edge] == 0.0)
+		{
+			if (Distances[Edge] < 0.0)
+			{
+				Raster->DashPhase += Steps;
+
+				return;
+			}
+
+			continue;
+		}
+
+		double Crossing = Distances[Edge] / Deltas[Edge];
+
+		if (Deltas[Edge] < 0.0)
+		{
+			Start = Crossing > Start ? Crossing : Start;
+		}
+		else
+		{
+			End = Crossing < End ? Crossing : End;
+		}
+	}
+
+	if (Start > End)
+	{
+		Raster->DashPhase += Steps;
+
+		return;
+	}
+
+	if (Start > 0.0 || End < 1.0)
+	{
+		int ClippedFromX = FromX + (int)((ToX - FromX) * Start);
+
+		int ClippedFromY = FromY + (int)((ToY - FromY) * Start);
+
+		Raster->DashPhase += (int)(Steps * Start);
+
+		if (End < 1.0)
+		{
+			ToX = FromX + (int)((ToX - FromX) * End);
+
+			ToY = FromY + (int)((ToY - FromY) * End);
+		}
+
+		FromX = ClippedFromX;
+
+		FromY = ClippedFromY;
+	}
+
+	DeltaX = abs(ToX - FromX);
+
+	DeltaY = -abs(ToY - FromY);
+
+	StepX = FromX < ToX ? 1 : -1;
+
+	StepY = FromY < ToY ? 1 : -1;
+
+	Error = DeltaX + DeltaY;
+
+	while (FromX != ToX || FromY != ToY)
+	{
+		int Doubled = 2 * Error;
+
+		if (PenDown(Raster))
+		{
+			if (Raster->PenWidth <= 1)
+			{
+				if (FromX >= 0 && FromY >= 0 && FromX < Raster->Width && FromY < Raster->Height)
+				{
+					Raster->Pixels[(size_t)FromY * Raster->Width + FromX] = Raster->PenColor;
+				}
+			}
+			else
+			{
+				FillBox(Raster, FromX - Half, FromY - Half, FromX - Half + Raster->PenWidth, FromY - Half + Raster->PenWidth, Raster->PenColor);
+			}
+		}
+
+		if (Doubled >= DeltaY)
+		{
+			Error += DeltaY;
+
+			FromX += StepX;
+		}
+
+		if (Doubled <= DeltaX)
+		{
+			Error += DeltaX;
+
+			FromY += StepY;
+		}
+	}
+}
+
+static void DrawPolyline(RASTER* Raster, INT32* Coordinates, UINT32 Count)
+{
+	Raster->DashPhase = 0;
+
+	for (UINT32 Point = 1; Point < Count; Point++)
+	{
+		DrawLine(Raster, Coordinates[(Point - 1) * 2], Coordinates[((Point - 1) * 2) + 1], Coordinates[Point * 2], Coordinates[(Point * 2) + 1]);
+	}
+}
+
+// Even-odd scanline fill at pixel centres, then the outline over it, closed.
+
+static void DrawPolygon(RASTER* Raster, INT32* Coordinates, UINT32 Count)
+{
+	int Top = Raster->Height;
+
+	int Bottom = 0;
+
+	int Crossings[64];
+
+	if (Count < 2)
+	{
+		return;
+	}
+
+	for (UINT32 Point = 0; Point < Count; Point++)
+	{
+		int Y = Coordinates[(Point * 2) + 1];
+
+		Top = Y < Top ? Y : Top;
+
+		Bottom = Y > Bottom ? Y : Bottom;
+	}
+
+	Top = Top < 0 ? 0 : Top;
+
+	Bottom = Bottom > Raster->Height ? Raster->Height : Bottom;
+
+	for (int Y = Top; Y < Bottom; Y++)
+	{
+		double Centre = Y + 0.5;
+
+		int CrossingCount = 0;
+
+		for (UINT32 Point = 0; Point < Count && CrossingCount < (int)(sizeof(Crossings) / sizeof(Crossings[0])); Point++)
+		{
+			UINT32 Next = (Point + 1) % Count;
+
+			double FromX = Coordinates[Point * 2];
+
+			double FromY = Coordinates[(Point * 2) + 1];
+
+			double ToX = Coordinates[Next * 2];
+
+			double ToY = Coordinates[(Next * 2) + 1];
+
+			if ((FromY <= Centre && ToY > Centre) || (ToY <= Centre && FromY > Centre))
+			{
+				int X = (int)(FromX + (Centre - FromY) * (ToX - FromX) / (ToY - FromY) + 0.5);
+
+				int Slot = CrossingCount++;
+
+				while (Slot > 0 && Crossings[Slot - 1] > X)
+				{
+					Crossings[Slot] = Crossings[Slot - 1];
+
+					Slot--;
+				}
+
+				Crossings[Slot] = X;
+			}
+		}
+
+		for (int Crossing = 0; Crossing + 1 < CrossingCount; Crossing += 2)
+		{
+			FillSpan(Raster, Y, Crossings[Crossing], Crossings[Crossing + 1], Raster->BrushColor);
+		}
+	}
+
+	DrawPolyline(Raster, Coordinates, Count);
+
+	DrawLine(Raster, Coordinates[(Count - 1) * 2], Coordinates[((Count - 1) * 2) + 1], Coordinates[0], Coordinates[1]);
+}
+
+// Filled with the brush, with the pen colour on the edge of each row, and across the top and bottom rows.
+
+static void DrawEllipse(RASTER* Raster, RENDER_RECT* Rect)
+{
+	double RadiusX = (Rect->Right - Rect->Left) / 2.0;
+
+	double RadiusY = (Rect->Bottom - Rect->Top) / 2.0;
+
+	double CentreX = Rect->Left + RadiusX;
+
+	double CentreY = Rect->Top + RadiusY;
+
+	int Top = Rect->Top < 0 ? 0 : Rect->Top;
+
+	int Bottom = Rect->Bottom > Raster->Height ? Raster->Height : Rect->Bottom;
+
+	if (RadiusX <= 0 || RadiusY <= 0)
+	{
+		return;
+	}
+
+	for (int Y = Top; Y < Bottom; Y++)
+	{
+		double Row = (Y + 0.5 - CentreY) / RadiusY;
+
+		double HalfWidth = RadiusX * (1.0 - Row * Row > 0 ? sqrt(1.0 - Row * Row) : 0.0);
+
+		int Left = (int)(CentreX - HalfWidth + 0.5);
+
+		int Right = (int)(CentreX + HalfWidth + 0.5);
+
+		if (Right <= Left)
+		{
+			continue;
+		}
+
+		if (Y == Rect->Top || Y == Rect->Bottom - 1)
+		{
+			FillSpan(Raster, Y, Left, Right, Raster->PenColor);
+
+			continue;
+		}
+
+		FillSpan(Raster, Y, Left, Right, Raster->BrushColor);
+
+		FillSpan(Raster, Y, Left, Left + 1, Raster->PenColor);
+
+		FillSpan(Raster, Y, Right - 1, Right, Raster->PenColor);
+	}
+}
+
+static void DrawText(RASTER* Raster, RENDER_TEXT* Text)
+{
+	int Height = Raster->FontHeight ? Raster->FontHeight : 16;
+
+	int Cell = Height / 2 > 1 ? Height / 2 : 1;
+
+	int X = Text->X - (Text->Align == RTA_CENTER ? (Text->Length * Cell) / 2 : 0);
+
+	for (UINT32 Character = 0; Character < Text->Length && X < Raster->Width; Character++, X += Cell)
+	{
+		if (((UINT16*)(Text + 1))[Character] != ' ')
+		{
+			FrameBox(Raster, X + 1, Text->Y + (Height / 4), X + Cell - 1, Text->Y + Height - (Height / 8), TEXT_COLOR);
+		}
+	}
+}
+
+static UINT32 RasterBackend(FRAME* Frame, RASTER* Raster)
+{
+	memset(Raster->Pixels, 0, (size_t)Raster->Width * Raster->Height * sizeof(UINT32));
+
+	Raster->PenColor = TEXT_COLOR;
+
+	Raster->PenWidth = 1;
+
+	Raster->PenStyle = 0;
+
+	Raster->BrushColor = TEXT_COLOR;
+
+	Raster->FontHeight = 0;
+
+	for (UINT32 Offset = 0; Offset < Frame->Header->WordCount; )
+	{
+		RENDER_HEADER* Header = (RENDER_HEADER*)&Frame->Words[Offset];
+
+		switch (Header->Op)
+		{
+			case RO_PEN:
+			{
+				RENDER_RESOURCE* Pen = &Frame->Resources[((RENDER_SELECT*)Header)->Resource];
+
+				Raster->PenColor = ToPixel(Pen->Color);
+
+				Raster->PenWidth = Pen->Size > 0 ? Pen->Size : 1;
+
+				Raster->PenStyle = Pen->Style;
+
+				break;
+			}
+			case RO_BRUSH:
+			{
+				Raster->BrushColor = ToPixel(Frame->Resources[((RENDER_SELECT*)Header)->Resource].Color);
+
+				break;
+			}
+			case RO_FONT:
+			{
+				Raster->FontHeight = Frame->Resources[((RENDER_SELECT*)Header)->Resource].Size;
+
+				break;
+			}
+			case RO_POLYLINE:
+			{
+				DrawPolyline(Raster, (INT32*)((RENDER_POINTS*)Header + 1), ((RENDER_POINTS*)Header)->Count);
+
+				break;
+			}
+			case RO_POLYGON:
+			{
+				DrawPolygon(Raster, (INT32*)((RENDER_POINTS*)Header + 1), ((RENDER_POINTS*)Header)->Count);
+
+				break;
+			}
+			case RO_ELLIPSE:
+			{
+				DrawEllipse(Raster, (RENDER_RECT*)Header);
+
+				break;
+			}
+			case RO_FILL_RECT:
+			case RO_FRAME_RECT:
+			{
+				RENDER_RECT* Rect = (RENDER_RECT*)Header;
+
+				UINT32 Color = ToPixel(Frame->Resources[Rect->Resource].Color);
+
+				if (Header->Op == RO_FILL_RECT)
+				{
+					FillBox(Raster, Rect->Left, Rect->Top, Rect->Right, Rect->Bottom, Color);
+				}
+				else
+				{
+					FrameBox(Raster, Rect->Left, Rect->Top, Rect->Right, Rect->Bottom, Color);
+				}
+
+				break;
+			}
+			case RO_TEXT:
+			{
+				DrawText(Raster, (RENDER_TEXT*)Header);
+
+				break;
+			}
+		}
+
+		Offset += Header->Words;
+	}
+
+	return(0);
+}
+
+static int WritePpm(const char* FileName, RASTER* Raster)
+{
+	FILE* File = NULL;
+
+	int Result = 0;
+
+	if ((File = fopen(FileName, "wb")) == NULL)
+	{
+		return(0);
+	}
+
+	fprintf(File, "P6\n%d %d\n255\n", Raster->Width, Raster->Height);
+
+	for (size_t Pixel = 0; Pixel < (size_t)Raster->Width * Raster->Height; Pixel++)
+	{
+		unsigned char Rgb[3] = { (unsigned char)(Raster->Pixels[Pixel] >> 16), (unsigned char)(Raster->Pixels[Pixel] >> 8), (unsigned char)Raster->Pixels[Pixel] };
+
+		fwrite(Rgb, 1, sizeof(Rgb), File);
+	}
+
+	Result = (ferror(File) == 0);
+
+	fclose(File);
+
+	return(Result);
+}
+
+// Plays every frame Passes times, and keeps each frame's fastest time, which is the one least disturbed by whatever
+// else the machine was doing.
+
+static int RunBackend(BACKEND* Backend, FRAME* Frames, UINT32 FrameCount, int Passes, RASTER* Raster)
+{
+	double* Times = NULL;
+
+	UINT32 Checksum = FNV_OFFSET_BASIS;
+
+	double Total = 0.0;
+
+	if ((Times = malloc(FrameCount * sizeof(double))) == NULL)
+	{
+		return(0);
+	}
+
+	for (UINT32 Frame = 0; Frame < FrameCount; Frame++)
+	{
+		Times[Frame] = 1e9;
+	}
+
+	for (int Pass = 0; Pass < Passes; Pass++)
+	{
+		for (UINT32 Frame = 0; Frame < FrameCount; Frame++)
+		{
+			double Start = 0.0;
+
+			double Elapsed = 0.0;
+
+			UINT32 FrameChecksum = 0;
+
+			Raster->Width = Frames[Frame].Header->Width;
+
+			Raster->Height = Frames[Frame].Header->Height;
+
+			Start = Seconds();
+
+			FrameChecksum = Backend->Proc(&Frames[Frame], Raster);
+
+			Elapsed = Seconds() - Start;
+
+			Times[Frame] = Elapsed < Times[Frame] ? Elapsed : Times[Frame];
+
+			if (Pass == 0)
+			{
+				if (Backend->DrawsPixels)
+				{
+					FrameChecksum = Fnv(FNV_OFFSET_BASIS, Raster->Pixels, (size_t)Raster->Width * Raster->Height * sizeof(UINT32));
+				}
+
+				Checksum = Fnv(Checksum, &FrameChecksum, sizeof(FrameChecksum));
+			}
+		}
+	}
+
+	for (UINT32 Frame = 0; Frame < FrameCount; Frame++)
+	{
+		Total += Times[Frame];
+	}
+
+	qsort(Times, FrameCount, sizeof(double), CompareDoubles);
+
+	printf("%-8s %10.3f ms total, per frame: mean %8.3f  p50 %8.3f  p95 %8.3f  max %8.3f ms, checksum %08x\n",
+		Backend->Name,
+		Total * 1000.0,
+		(Total / FrameCount) * 1000.0,
+		Times[FrameCount / 2] * 1000.0,
+		Times[(FrameCount * 95) / 100 < FrameCount ? (FrameCount * 95) / 100 : FrameCount - 1] * 1000.0,
+		Times[FrameCount - 1] * 1000.0,
+		Checksum);
+
+	free(Times);
+
+	return(1);
+}
+
+int main(int argc, char* argv[])
+{
+	int Result = EXIT_FAILURE;
+
+	const char* FileName = NULL;
+
+	const char* BackendName = NULL;
+
+	int Passes = DEFAULT_PASSES;
+
+	long PpmFrame = -1;
+
+	unsigned char* Data = NULL;
+
+	FRAME* Frames = NULL;
+
+	UINT32 FrameCount = 0;
+
+	RASTER Raster = { 0 };
+
+	size_t MaxPixels = 0;
+
+	UINT64 Commands = 0;
+
+	UINT64 Words = 0;
+
+	for (int Arg = 1; Arg < argc; Arg++)
+	{
+		if (strcmp(argv[Arg], "-backend") == 0 && Arg + 1 < argc)
+		{
+			BackendName = argv[++Arg];
+		}
+		else if (strcmp(argv[Arg], "-passes") == 0 && Arg + 1 < argc)
+		{
+			Passes = atoi(argv[++Arg]);
+		}
+		else if (strcmp(argv[Arg], "-ppm") == 0 && Arg + 1 < argc)
+		{
+			PpmFrame = atol(argv[++Arg]);
+		}
+		else if (FileName == NULL && argv[Arg][0] != '-')
+		{
+			FileName = argv[Arg];
+		}
+		else
+		{
+			FileName = NULL;
+
+			break;
+		}
+	}
+
+	if (FileName == NULL || Passes < 1)
+	{
+		fprintf(stderr, "Usage: ReplayBench <file.adtvr> [-backend null|raster] [-passes n] [-ppm frame]\n");
+
+		goto Exit;
+	}
+
+	if ((FrameCount = LoadFrames(FileName, &Data, &Frames)) == 0)
+	{
+		fprintf(stderr, "No frames in %s.\n", FileName);
+
+		goto Exit;
+	}
+
+	for (UINT32 Frame = 0; Frame < FrameCount; Frame++)
+	{
+		size_t Pixels = (size_t)Frames[Frame].Header->Width * Frames[Frame].Header->Height;
+
+		MaxPixels = Pixels > MaxPixels ? Pixels : MaxPixels;
+
+		Commands += Frames[Frame].Header->CommandCount;
+
+		Words += Frames[Frame].Header->WordCount;
+	}
+
+	if ((Raster.Pixels = malloc(MaxPixels * sizeof(UINT32))) == NULL)
+	{
+		fprintf(stderr, "Out of memory.\n");
+
+		goto Exit;
+	}
+
+	printf("%s: %u frames, %.1f commands and %.1f KB per frame, best of %d passes\n",
+		FileName,
+		FrameCount,
+		(double)Commands / FrameCount,
+		(double)(Words * sizeof(UINT32)) / FrameCount / 1024.0,
+		Passes);
+
+	for (size_t Backend = 0; Backend < sizeof(gBackends) / sizeof(gBackends[0]); Backend++)
+	{
+		if (BackendName == NULL || strcmp(BackendName, gBackends[Backend].Name) == 0)
+		{
+			if (RunBackend(&gBackends[Backend], Frames, FrameCount, Passes, &Raster) == 0)
+			{
+				fprintf(stderr, "Out of memory.\n");
+
+				goto Exit;
+			}
+		}
+	}
+
+	if (PpmFrame >= 0 && (UINT32)PpmFrame < FrameCount)
+	{
+		char PpmName[64] = { 0 };
+
+		snprintf(PpmName, sizeof(PpmName), "replay_%ld.ppm", PpmFrame);
+
+		Raster.Width = Frames[PpmFrame].Header->Width;
+
+		Raster.Height = Frames[PpmFrame].Header->Height;
+
+		RasterBackend(&Frames[PpmFrame], &Raster);
+
+		if (WritePpm(PpmName, &Raster) == 0)
+		{
+			fprintf(stderr, "Couldn't write %s.\n", PpmName);
+
+			goto Exit;
+		}
+
+		printf("Frame %ld drawn to %s\n", PpmFrame, PpmName);
+	}
+
+	Result = EXIT_SUCCESS;
+
+Exit:
+
+	free(Raster.Pixels);
+
+	free(Frames);
+
+	free(Data);
+
+	return(Result);
+}
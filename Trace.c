@@ -0,0 +1,284 @@
+// ADTV - Active Directory Topology Visualizer
+// Joseph Ryan Ries, 2022-2023
+//
+// Timing zones and Chrome trace-event export. See Trace.h.
+
+#include <Windows.h>
+
+#include <stdio.h>
+
+#include "Main.h"
+
+#include "Trace.h"
+
+
+
+#ifdef ADTV_TRACE
+
+static __declspec(thread) TRACE_BUFFER* tTraceBuffer;
+
+static TRACE_BUFFER* gTraceBuffers[TRACE_MAX_THREADS];
+
+static volatile LONG gTraceBufferCount;
+
+static TRACE_BUFFER* TraceGetBuffer(void)
+{
+	LONG Index = 0;
+
+	if (tTraceBuffer)
+	{
+		return(tTraceBuffer);
+	}
+
+	if (gTraceBufferCount >= TRACE_MAX_THREADS)
+	{
+		return(NULL);
+	}
+
+	if ((tTraceBuffer = VirtualAlloc(NULL, sizeof(TRACE_BUFFER), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE)) == NULL)
+	{
+		return(NULL);
+	}
+
+	tTraceBuffer->ThreadId = GetCurrentThreadId();
+
+	_snwprintf_s(tTraceBuffer->ThreadName, _countof(tTraceBuffer->ThreadName), _TRUNCATE, L"Thread %d", tTraceBuffer->ThreadId);
+
+	if ((Index = InterlockedIncrement(&gTraceBufferCount) - 1) >= TRACE_MAX_THREADS)
+	{
+		// Too many threads; this one just doesn't get traced. The buffer is kept so we don't try again.
+
+		tTraceBuffer->Depth = -1;
+
+		return(tTraceBuffer);
+	}
+
+	gTraceBuffers[Index] = tTraceBuffer;
+
+	return(tTraceBuffer);
+}
+
+void TraceBegin(_In_ const char* Name)
+{
+	TRACE_BUFFER* Buffer = TraceGetBuffer();
+
+	LARGE_INTEGER Now = { 0 };
+
+	if (Buffer == NULL || Buffer->Depth < 0)
+	{
+		return;
+	}
+
+	// Zones nested deeper than TRACE_MAX_DEPTH aren't recorded, but are still counted, so each TraceEnd closes the
+	// zone its TraceBegin opened.
+
+	if (Buffer->Depth < TRACE_MAX_DEPTH)
+	{
+		QueryPerformanceCounter(&Now);
+
+		Buffer->OpenNames[Buffer->Depth] = Name;
+
+		Buffer->OpenStarts[Buffer->Depth] = Now.QuadPart;
+	}
+
+	Buffer->Depth++;
+}
+
+DWORD TraceEnd(_In_ DWORD PassThrough)
+{
+	TRACE_BUFFER* Buffer = tTraceBuffer;
+
+	LARGE_INTEGER Now = { 0 };
+
+	TRACE_EVENT* Event = NULL;
+
+	if (Buffer == NULL || Buffer->Depth <= 0)
+	{
+		return(PassThrough);
+	}
+
+	Buffer->Depth--;
+
+	if (Buffer->Depth >= TRACE_MAX_DEPTH)
+	{
+		return(PassThrough);
+	}
+
+	QueryPerformanceCounter(&Now);
+
+	Event = &Buffer->Events[Buffer->Count % TRACE_EVENTS_PER_THREAD];
+
+	Event->Name = Buffer->OpenNames[Buffer->Depth];
+
+	Event->Start = Buffer->OpenStarts[Buffer->Depth];
+
+	Event->End = Now.QuadPart;
+
+	// Only this thread writes Count, but the dump reads it from another thread.
+
+	InterlockedExchange64(&Buffer->Count, Buffer->Count + 1);
+
+	return(PassThrough);
+}
+
+void TraceSetThreadName(_In_ wchar_t* Name)
+{
+	TRACE_BUFFER* Buffer = TraceGetBuffer();
+
+	if (Buffer)
+	{
+		wcscpy_s(Buffer->ThreadName, _countof(Buffer->ThreadName), Name);
+	}
+}
+
+static void TraceWrite(_In_ HANDLE FileHandle, _Inout_ char* Buffer, _Inout_ int* Length, _In_ int Capacity, _In_ BOOL Flush)
+{
+	DWORD BytesWritten = 0;
+
+	if (*Length > 0 && (Flush || *Length > Capacity - 512))
+	{
+		WriteFile(FileHandle, Buffer, *Length, &BytesWritten, NULL);
+
+		*Length = 0;
+	}
+}
+
+DWORD TraceDump(_In_ wchar_t* FileName)
+{
+	DWORD Result = ERROR_SUCCESS;
+
+	HANDLE FileHandle = INVALID_HANDLE_VALUE;
+
+	char Buffer[65536];
+
+	int Length = 0;
+
+	INT64 Base = MAXLONGLONG;
+
+	LONG BufferCount = min(gTraceBufferCount, TRACE_MAX_THREADS);
+
+	double MicrosecondsPerTick = 1000000.0 / (double)gGraphicsData.PerformanceFrequency.QuadPart;
+
+	BOOL First = TRUE;
+
+	UINT64 EventsWritten = 0;
+
+	if ((FileHandle = CreateFileW(FileName, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		Result = GetLastError();
+
+		LogEventW(LL_ERROR, LF_FILE, L"[%s] Failed to create %s! Error 0x%08lx", __FUNCTIONW__, FileName, Result);
+
+		goto Exit;
+	}
+
+	// Timestamps are written relative to the oldest event we still have, so the numbers stay small.
+
+	for (LONG Index = 0; Index < BufferCount; Index++)
+	{
+		TRACE_BUFFER* Trace = gTraceBuffers[Index];
+
+		LONG64 Count = Trace ? Trace->Count : 0;
+
+		LONG64 Oldest = max(0, Count - TRACE_EVENTS_PER_THREAD);
+
+		if (Count > 0 && Trace->Events[Oldest % TRACE_EVENTS_PER_THREAD].Start < Base)
+		{
+			Base = Trace->Events[Oldest % TRACE_EVENTS_PER_THREAD].Start;
+		}
+	}
+
+	Length += sprintf_s(&Buffer[Length], sizeof(Buffer) - Length, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	for (LONG Index = 0; Index < BufferCount; Index++)
+	{
+		TRACE_BUFFER* Trace = gTraceBuffers[Index];
+
+		// Snapshot the count once. The owning thread keeps recording while we read, so on a busy thread a handful of
+		// the oldest events may be overwritten mid-dump. That's fine for a diagnostic.
+
+		LONG64 Count = 0;
+
+		LONG64 Oldest = 0;
+
+		if (Trace == NULL)
+		{
+			continue;
+		}
+
+		Count = Trace->Count;
+
+		Oldest = max(0, Count - TRACE_EVENTS_PER_THREAD);
+
+		Length += sprintf_s(
+			&Buffer[Length],
+			sizeof(Buffer) - Length,
+			"%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"%ls\"}}",
+			First ? "" : ",",
+			Trace->ThreadId,
+			Trace->ThreadName);
+
+		First = FALSE;
+
+		for (LONG64 Event = Oldest; Event < Count; Event++)
+		{
+			TRACE_EVENT* Current = &Trace->Events[Event % TRACE_EVENTS_PER_THREAD];
+
+			Length += sprintf_s(
+				&Buffer[Length],
+				sizeof(Buffer) - Length,
+				",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}",
+				Current->Name,
+				Trace->ThreadId,
+				(double)(Current->Start - Base) * MicrosecondsPerTick,
+				(double)(Current->End - Current->Start) * MicrosecondsPerTick);
+
+			EventsWritten++;
+
+			TraceWrite(FileHandle, Buffer, &Length, sizeof(Buffer), FALSE);
+		}
+	}
+
+	Length += sprintf_s(&Buffer[Length], sizeof(Buffer) - Length, "\n]}\n");
+
+	TraceWrite(FileHandle, Buffer, &Length, sizeof(Buffer), TRUE);
+
+	LogEventW(LL_INFO, LF_FILE, L"[%s] Wrote %llu trace events from %d threads to %s.", __FUNCTIONW__, EventsWritten, BufferCount, FileName);
+
+Exit:
+
+	if (FileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(FileHandle);
+	}
+
+	return(Result);
+}
+
+#else
+
+void TraceBegin(_In_ const char* Name)
+{
+	UNREFERENCED_PARAMETER(Name);
+}
+
+DWORD TraceEnd(_In_ DWORD PassThrough)
+{
+	return(PassThrough);
+}
+
+void TraceSetThreadName(_In_ wchar_t* Name)
+{
+	UNREFERENCED_PARAMETER(Name);
+}
+
+DWORD TraceDump(_In_ wchar_t* FileName)
+{
+	UNREFERENCED_PARAMETER(FileName);
+
+	LogEventW(LL_WARN, LF_FILE, L"[%s] Tracing is not compiled into this build. Build with ADTV_TRACE defined.", __FUNCTIONW__);
+
+	return(ERROR_NOT_SUPPORTED);
+}
+
+#endif
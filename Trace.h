@@ -0,0 +1,78 @@
+#pragma once
+
+// Scoped timing zones, exported as Chrome/Perfetto trace-event JSON. Open the file in chrome://tracing or
+// https://ui.perfetto.dev to see a timeline of every thread side by side.
+//
+// Only compiled in when ADTV_TRACE is defined, which it is for Debug builds. Otherwise every macro below is nothing
+// and costs nothing.
+//
+// Zone names must be string literals without quotes or backslashes; they're written to the JSON as is.
+
+#define TRACE_EVENTS_PER_THREAD	65536
+
+#define TRACE_MAX_THREADS		64
+
+#define TRACE_MAX_DEPTH			32
+
+#define TRACE_FILE_NAME			L"ADTV_trace.json"
+
+typedef struct TRACE_EVENT
+{
+	const char* Name;
+
+	INT64 Start;
+
+	INT64 End;
+
+} TRACE_EVENT;
+
+// One per thread, written only by that thread. When full it wraps and overwrites the oldest events.
+typedef struct TRACE_BUFFER
+{
+	DWORD ThreadId;
+
+	wchar_t ThreadName[32];
+
+	volatile LONG64 Count;
+
+	int Depth;
+
+	const char* OpenNames[TRACE_MAX_DEPTH];
+
+	INT64 OpenStarts[TRACE_MAX_DEPTH];
+
+	TRACE_EVENT Events[TRACE_EVENTS_PER_THREAD];
+
+} TRACE_BUFFER;
+
+#ifdef ADTV_TRACE
+
+#define TRACE_BEGIN(Name)			TraceBegin(Name)
+
+#define TRACE_END()					TraceEnd(0)
+
+// Wraps a call that returns a DWORD status in a zone, and evaluates to that status:
+//     if ((Result = TRACED("DsBindW", DsBindW(DC, NULL, &Handle))) != ERROR_SUCCESS)
+#define TRACED(Name, Expression)	(TraceBegin(Name), TraceEnd((DWORD)(Expression)))
+
+#define TRACE_THREAD_NAME(Name)		TraceSetThreadName(Name)
+
+#else
+
+#define TRACE_BEGIN(Name)			((void)0)
+
+#define TRACE_END()					((void)0)
+
+#define TRACED(Name, Expression)	(Expression)
+
+#define TRACE_THREAD_NAME(Name)		((void)0)
+
+#endif
+
+void TraceBegin(_In_ const char* Name);
+
+DWORD TraceEnd(_In_ DWORD PassThrough);
+
+void TraceSetThreadName(_In_ wchar_t* Name);
+
+DWORD TraceDump(_In_ wchar_t* FileName);